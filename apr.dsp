@@ -335,6 +335,10 @@ SOURCE=.\file_io\win32\dir.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\file_io\unix\dirwalk.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\file_io\unix\fileacc.c
 # End Source File
 # Begin Source File
@@ -668,6 +672,10 @@ SOURCE=.\tables\apr_hash.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\tables\apr_hash_flat.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\tables\apr_tables.c
 # End Source File
 # Begin Source File
@@ -21,6 +21,7 @@
 #include "apr_tables.h"
 #include "apr_buckets.h"
 #include "apr_errno.h"
+#include "apr_portable.h"
 #define APR_WANT_MEMFUNC
 #define APR_WANT_STRFUNC
 #include "apr_want.h"
@@ -29,6 +30,17 @@
 #include <sys/uio.h>
 #endif
 
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <linux/errqueue.h>
+#if defined(MSG_ZEROCOPY) && defined(SO_ZEROCOPY) \
+    && defined(SO_EE_ORIGIN_ZEROCOPY)
+#define BRIGADE_SEND_ZEROCOPY 1
+#endif
+#endif
+
 static apr_status_t brigade_cleanup(void *data)
 {
     return apr_brigade_cleanup(data);
@@ -719,6 +731,329 @@ APR_DECLARE(apr_status_t) apr_brigade_to_iovec(apr_bucket_brigade *b,
     return APR_SUCCESS;
 }
 
+/* Maximum number of buckets written at once by apr_brigade_send_socket() */
+#define SEND_MAX_VECS 64
+/* Smaller file buckets are read and written with the others */
+#define SEND_MIN_SENDFILE 256
+/* Smaller buckets are not worth MSG_ZEROCOPY */
+#define SEND_MIN_ZEROCOPY 16384
+
+typedef struct brigade_send_t {
+    apr_socket_t *sock;
+    apr_bucket_brigade *b;
+    /* Buckets written with MSG_ZEROCOPY, kept until the kernel is done */
+    apr_bucket_brigade *held;
+    /* Whether to use MSG_ZEROCOPY (still) */
+    int zerocopy;
+#ifdef BRIGADE_SEND_ZEROCOPY
+    int fd;
+    /* Number of MSG_ZEROCOPY writes, and of their completions */
+    apr_uint32_t zc_sent;
+    apr_uint32_t zc_done;
+#endif
+} brigade_send_t;
+
+/* Delete the first len bytes of the brigade and the metadata buckets in
+ * front of them (or after them), or hold them until the end of the call.
+ */
+static void brigade_send_consume(brigade_send_t *ctx, apr_size_t len,
+                                 int hold)
+{
+    apr_bucket *e;
+
+    while (!APR_BRIGADE_EMPTY(ctx->b)) {
+        e = APR_BRIGADE_FIRST(ctx->b);
+        if (e->length == (apr_size_t)(-1)) {
+            break;
+        }
+        if (e->length > len) {
+            if (!len) {
+                break;
+            }
+            apr_bucket_split(e, len);
+        }
+        len -= e->length;
+        if (hold && e->length) {
+            APR_BUCKET_REMOVE(e);
+            APR_BRIGADE_INSERT_TAIL(ctx->held, e);
+        }
+        else {
+            apr_bucket_delete(e);
+        }
+    }
+}
+
+#ifdef BRIGADE_SEND_ZEROCOPY
+
+static apr_status_t brigade_send_zerocopy(brigade_send_t *ctx,
+                                          struct iovec *vec, int nvec,
+                                          apr_size_t *len)
+{
+    struct msghdr msg;
+    apr_status_t rv;
+    ssize_t n;
+    int waited = 0;
+
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = vec;
+    msg.msg_iovlen = nvec;
+
+    for (;;) {
+        n = sendmsg(ctx->fd, &msg, MSG_ZEROCOPY);
+        if (n >= 0) {
+            /* Each write which sent something gets a completion */
+            if (n > 0) {
+                ctx->zc_sent++;
+            }
+            *len = n;
+            return APR_SUCCESS;
+        }
+        if (errno == ENOBUFS
+            || (waited && (errno == EAGAIN || errno == EWOULDBLOCK))) {
+            /* Out of memory to pin the pages, which may also show as
+             * EAGAIN while the socket is writable: copy them, and the next
+             * ones since it won't get better until the peer reads.
+             */
+            ctx->zerocopy = 0;
+            return apr_socket_sendv(ctx->sock, vec, nvec, len);
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            waited = 1;
+            rv = apr_socket_wait(ctx->sock, APR_WAIT_WRITE);
+            if (rv != APR_SUCCESS) {
+                *len = 0;
+                return rv;
+            }
+        }
+        else if (errno != EINTR) {
+            *len = 0;
+            return errno;
+        }
+    }
+}
+
+/* Wait for the completions of all the MSG_ZEROCOPY writes, after which
+ * the kernel does not use the buffers anymore.
+ */
+static apr_status_t brigade_send_zerocopy_wait(brigade_send_t *ctx)
+{
+    char control[128];
+    struct msghdr msg;
+    struct cmsghdr *cm;
+    struct pollfd pfd;
+    int n;
+
+    while (ctx->zc_done != ctx->zc_sent) {
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_control = control;
+        msg.msg_controllen = sizeof(control);
+
+        /* Reading the error queue never blocks */
+        if (recvmsg(ctx->fd, &msg, MSG_ERRQUEUE) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                return errno;
+            }
+            /* Blocking socket, so block (POLLERR is always polled) */
+            pfd.fd = ctx->fd;
+            pfd.events = 0;
+            do {
+                n = poll(&pfd, 1, -1);
+            } while (n < 0 && errno == EINTR);
+            if (n < 0) {
+                return errno;
+            }
+            continue;
+        }
+
+        for (cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+            struct sock_extended_err *serr;
+
+            if (!(cm->cmsg_level == SOL_IP && cm->cmsg_type == IP_RECVERR)
+                && !(cm->cmsg_level == SOL_IPV6
+                     && cm->cmsg_type == IPV6_RECVERR)) {
+                continue;
+            }
+            serr = (struct sock_extended_err *)CMSG_DATA(cm);
+            if (serr->ee_origin == SO_EE_ORIGIN_ZEROCOPY
+                && serr->ee_errno == 0) {
+                /* Completions come as ranges of write numbers */
+                ctx->zc_done += serr->ee_data - serr->ee_info + 1;
+            }
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+#endif /* BRIGADE_SEND_ZEROCOPY */
+
+APR_DECLARE(apr_status_t) apr_brigade_send_socket(apr_socket_t *sock,
+                                                  apr_bucket_brigade *b,
+                                                  apr_int32_t flags,
+                                                  apr_size_t *len)
+{
+    struct iovec vec[SEND_MAX_VECS];
+    brigade_send_t ctx;
+    apr_size_t total = 0;
+    apr_status_t rv = APR_SUCCESS;
+
+    ctx.sock = sock;
+    ctx.b = b;
+    ctx.held = NULL;
+    ctx.zerocopy = 0;
+
+#ifdef BRIGADE_SEND_ZEROCOPY
+    ctx.zc_sent = ctx.zc_done = 0;
+    if (flags & APR_BRIGADE_SEND_ZEROCOPY) {
+        apr_interval_time_t timeout;
+        apr_os_sock_t fd;
+        int one = 1;
+
+        apr_socket_timeout_get(sock, &timeout);
+        apr_os_sock_get(&fd, sock);
+        if (timeout < 0
+            && !setsockopt(fd, SOL_SOCKET, SO_ZEROCOPY, &one, sizeof(one))) {
+            ctx.fd = fd;
+            ctx.zerocopy = 1;
+        }
+    }
+#endif
+
+    for (;;) {
+        apr_bucket *e, *file_e = NULL;
+        apr_size_t nbytes = 0, n;
+        int nvec = 0, nheaders = 0, hold = 0;
+
+        /* Gather the in-memory buckets to write, up to a file bucket to
+         * sendfile, and then its trailers.
+         */
+        for (e = APR_BRIGADE_FIRST(b);
+             e != APR_BRIGADE_SENTINEL(b) && nvec < SEND_MAX_VECS;
+             e = APR_BUCKET_NEXT(e)) {
+            const char *data;
+            apr_size_t dlen;
+
+            if (e->length == 0) {
+                continue;
+            }
+#if APR_HAS_SENDFILE
+            if (APR_BUCKET_IS_FILE(e) && e->length >= SEND_MIN_SENDFILE
+                && (apr_file_flags_get(((apr_bucket_file *)e->data)->fd)
+                    & APR_FOPEN_SENDFILE_ENABLED)) {
+                if (file_e) {
+                    break;
+                }
+                file_e = e;
+                nheaders = nvec;
+                continue;
+            }
+#endif
+            rv = apr_bucket_read(e, &data, &dlen, APR_NONBLOCK_READ);
+            if (APR_STATUS_IS_EAGAIN(rv)) {
+                if (nvec || file_e) {
+                    /* Write what we have meanwhile */
+                    rv = APR_SUCCESS;
+                    break;
+                }
+                rv = apr_bucket_read(e, &data, &dlen, APR_BLOCK_READ);
+            }
+            if (rv != APR_SUCCESS) {
+                break;
+            }
+            if (dlen == 0) {
+                continue;
+            }
+            vec[nvec].iov_base = (void *)data;
+            vec[nvec].iov_len = dlen;
+            nvec++;
+            nbytes += dlen;
+            if (ctx.zerocopy && dlen >= SEND_MIN_ZEROCOPY && !file_e) {
+                hold = 1;
+            }
+        }
+        if (rv != APR_SUCCESS && !nvec && !file_e) {
+            break;
+        }
+
+#if APR_HAS_SENDFILE
+        if (file_e) {
+            apr_bucket_file *f = file_e->data;
+            apr_hdtr_t hdtr;
+            apr_off_t offset = file_e->start;
+            apr_status_t srv;
+
+            hdtr.headers = vec;
+            hdtr.numheaders = nheaders;
+            hdtr.trailers = vec + nheaders;
+            hdtr.numtrailers = nvec - nheaders;
+            /* The file length only, though the headers and trailers are
+             * accounted for in the returned length (the bytes to consume).
+             */
+            n = file_e->length;
+            srv = apr_socket_sendfile(sock, f->fd, &hdtr, &offset, &n, 0);
+            /* Don't hold buckets which were not sent with MSG_ZEROCOPY */
+            hold = 0;
+            if (srv != APR_SUCCESS) {
+                rv = srv;
+            }
+        }
+        else
+#endif
+        if (!nvec) {
+            /* Only metadata left */
+            brigade_send_consume(&ctx, 0, 0);
+            break;
+        }
+#ifdef BRIGADE_SEND_ZEROCOPY
+        else if (hold) {
+            apr_status_t srv;
+
+            if (!ctx.held) {
+                ctx.held = apr_brigade_create(b->p, b->bucket_alloc);
+            }
+            srv = brigade_send_zerocopy(&ctx, vec, nvec, &n);
+            if (srv != APR_SUCCESS) {
+                rv = srv;
+            }
+        }
+#endif
+        else {
+            apr_status_t srv;
+
+            srv = apr_socket_sendv(sock, vec, nvec, &n);
+            if (srv != APR_SUCCESS) {
+                rv = srv;
+            }
+        }
+
+        total += n;
+        brigade_send_consume(&ctx, n, hold);
+        if (rv != APR_SUCCESS) {
+            break;
+        }
+    }
+
+#ifdef BRIGADE_SEND_ZEROCOPY
+    if (ctx.zc_sent != ctx.zc_done) {
+        apr_status_t zrv = brigade_send_zerocopy_wait(&ctx);
+        if (rv == APR_SUCCESS) {
+            rv = zrv;
+        }
+    }
+#endif
+    if (ctx.held) {
+        apr_brigade_destroy(ctx.held);
+    }
+
+    if (len) {
+        *len = total;
+    }
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_brigade_vputstrs(apr_bucket_brigade *b,
                                                apr_brigade_flush flush,
                                                void *ctx,
@@ -108,17 +108,18 @@ static apr_status_t file_bucket_read(apr_bucket *e, const char **str,
     }
 #endif
 
+    if (a->readahead && a->readahead_end < fileoffset + filelength) {
+        /* Only a hint, failures don't matter */
+        apr_file_readahead(f, fileoffset, filelength);
+        a->readahead_end = fileoffset + filelength;
+    }
+
     *str = NULL;  /* in case we die prematurely */
     *len = (filelength > a->read_size) ? a->read_size : filelength;
     buf = apr_bucket_alloc(*len, e->list);
 
-    /* Handle offset ... */
-    rv = apr_file_seek(f, APR_SET, &fileoffset);
-    if (rv != APR_SUCCESS) {
-        apr_bucket_free(buf);
-        return rv;
-    }
-    rv = apr_file_read(f, buf, len);
+    /* Read at the offset, the file position is not used */
+    rv = apr_file_read_at(f, fileoffset, buf, len);
     if (rv != APR_SUCCESS && rv != APR_EOF) {
         apr_bucket_free(buf);
         return rv;
@@ -164,6 +165,8 @@ APR_DECLARE(apr_bucket *) apr_bucket_file_make(apr_bucket *b, apr_file_t *fd,
     f->can_mmap = 1;
 #endif
     f->read_size = APR_BUCKET_BUFF_SIZE;
+    f->readahead = 0;
+    f->readahead_end = 0;
 
     b = apr_bucket_shared_make(b, f, offset, len);
     b->type = &apr_bucket_type_file;
@@ -196,6 +199,15 @@ APR_DECLARE(apr_status_t) apr_bucket_file_enable_mmap(apr_bucket *e,
 #endif /* APR_HAS_MMAP */
 }
 
+APR_DECLARE(apr_status_t) apr_bucket_file_enable_readahead(apr_bucket *e,
+                                                           int enabled)
+{
+    apr_bucket_file *a = e->data;
+
+    a->readahead = enabled;
+    return APR_SUCCESS;
+}
+
 APR_DECLARE(apr_status_t) apr_bucket_file_set_buf_size(apr_bucket *e,
                                                        apr_size_t size)
 {
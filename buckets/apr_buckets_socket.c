@@ -15,11 +15,54 @@
  */
 
 #include "apr_buckets.h"
+#include "apr_portable.h"
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+
+#if APR_HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+
+/* Adaptive socket buckets keep their flags and the current read size in
+ * the start of the bucket, which is -1 otherwise.
+ */
+#define SOCKET_SIZE_BITS 24
+#define SOCKET_SIZE_MASK ((1 << SOCKET_SIZE_BITS) - 1)
+#define SOCKET_FLAGS(b)  ((apr_int32_t)((b)->start >> SOCKET_SIZE_BITS))
+#define SOCKET_SIZE(b)   ((apr_size_t)((b)->start & SOCKET_SIZE_MASK))
+#define SOCKET_START(flags, size) \
+    (((apr_off_t)(flags) << SOCKET_SIZE_BITS) | (apr_off_t)(size))
+
+/* How much can be read from the socket without blocking, 0 if unknown */
+static apr_size_t socket_readable(apr_socket_t *sock)
+{
+#ifdef FIONREAD
+    apr_os_sock_t fd;
+#ifdef WIN32
+    u_long n;
+
+    if (apr_os_sock_get(&fd, sock) == APR_SUCCESS
+        && ioctlsocket(fd, FIONREAD, &n) == 0) {
+        return n;
+    }
+#else
+    int n;
+
+    if (apr_os_sock_get(&fd, sock) == APR_SUCCESS
+        && ioctl(fd, FIONREAD, &n) == 0 && n > 0) {
+        return n;
+    }
+#endif
+#endif
+    return 0;
+}
 
 static apr_status_t socket_bucket_read(apr_bucket *a, const char **str,
                                        apr_size_t *len, apr_read_type_e block)
 {
     apr_socket_t *p = a->data;
+    apr_int32_t flags = 0;
+    apr_size_t size = APR_BUCKET_BUFF_SIZE, alloc_len;
     char *buf;
     apr_status_t rv;
     apr_interval_time_t timeout;
@@ -30,7 +73,25 @@ static apr_status_t socket_bucket_read(apr_bucket *a, const char **str,
     }
 
     *str = NULL;
-    *len = APR_BUCKET_BUFF_SIZE;
+    if (a->start >= 0) {
+        flags = SOCKET_FLAGS(a);
+        size = SOCKET_SIZE(a);
+        *len = 0;
+        if (flags & APR_BUCKET_SOCKET_FIONREAD) {
+            *len = socket_readable(p);
+            if (*len > APR_BUCKET_SOCKET_MAX_SIZE) {
+                *len = APR_BUCKET_SOCKET_MAX_SIZE;
+            }
+        }
+        if (!*len) {
+            /* Use all of the allocated block */
+            *len = apr_bucket_alloc_aligned_floor(a->list, size);
+        }
+    }
+    else {
+        *len = APR_BUCKET_BUFF_SIZE;
+    }
+    alloc_len = *len;
     buf = apr_bucket_alloc(*len, a->list); /* XXX: check for failure? */
 
     rv = apr_socket_recv(p, buf, len);
@@ -60,12 +121,44 @@ static apr_status_t socket_bucket_read(apr_bucket *a, const char **str,
      */
     if (*len > 0) {
         apr_bucket_heap *h;
+        apr_bucket *b;
+
+        if (flags) {
+            /* Don't pin a buffer for less than half of its size, and
+             * read more (or less) next time if this one was full (or
+             * short).
+             */
+            if (apr_bucket_alloc_aligned_floor(a->list, *len)
+                    <= alloc_len / 2) {
+                char *copy = apr_bucket_alloc(*len, a->list);
+
+                if (copy) {
+                    memcpy(copy, buf, *len);
+                    apr_bucket_free(buf);
+                    buf = copy;
+                    alloc_len = *len;
+                }
+            }
+            if (*len >= size && size < APR_BUCKET_SOCKET_MAX_SIZE) {
+                size = (size * 2 < APR_BUCKET_SOCKET_MAX_SIZE)
+                       ? size * 2 : APR_BUCKET_SOCKET_MAX_SIZE;
+            }
+            else if (*len < size / 2 && size > APR_BUCKET_BUFF_SIZE) {
+                size = (size / 2 > APR_BUCKET_BUFF_SIZE)
+                       ? size / 2 : APR_BUCKET_BUFF_SIZE;
+            }
+        }
+
         /* Change the current bucket to refer to what we read */
         a = apr_bucket_heap_make(a, buf, *len, apr_bucket_free);
         h = a->data;
-        h->alloc_len = APR_BUCKET_BUFF_SIZE; /* note the real buffer size */
+        h->alloc_len = alloc_len; /* note the real buffer size */
         *str = buf;
-        APR_BUCKET_INSERT_AFTER(a, apr_bucket_socket_create(p, a->list));
+        b = apr_bucket_socket_create_ex(p, flags, a->list);
+        if (flags) {
+            b->start = SOCKET_START(flags, size);
+        }
+        APR_BUCKET_INSERT_AFTER(a, b);
     }
     else {
         apr_bucket_free(buf);
@@ -76,6 +169,13 @@ static apr_status_t socket_bucket_read(apr_bucket *a, const char **str,
 }
 
 APR_DECLARE(apr_bucket *) apr_bucket_socket_make(apr_bucket *b, apr_socket_t *p)
+{
+    return apr_bucket_socket_make_ex(b, p, 0);
+}
+
+APR_DECLARE(apr_bucket *) apr_bucket_socket_make_ex(apr_bucket *b,
+                                                    apr_socket_t *p,
+                                                    apr_int32_t flags)
 {
     /*
      * XXX: We rely on a cleanup on some pool or other to actually
@@ -90,18 +190,30 @@ APR_DECLARE(apr_bucket *) apr_bucket_socket_make(apr_bucket *b, apr_socket_t *p)
     b->start       = -1;
     b->data        = p;
 
+    flags &= APR_BUCKET_SOCKET_ADAPTIVE | APR_BUCKET_SOCKET_FIONREAD;
+    if (flags) {
+        b->start = SOCKET_START(flags, APR_BUCKET_BUFF_SIZE);
+    }
+
     return b;
 }
 
 APR_DECLARE(apr_bucket *) apr_bucket_socket_create(apr_socket_t *p,
                                                    apr_bucket_alloc_t *list)
+{
+    return apr_bucket_socket_create_ex(p, 0, list);
+}
+
+APR_DECLARE(apr_bucket *) apr_bucket_socket_create_ex(apr_socket_t *p,
+                                                      apr_int32_t flags,
+                                                      apr_bucket_alloc_t *list)
 {
     apr_bucket *b = apr_bucket_alloc(sizeof(*b), list);
 
     APR_BUCKET_INIT(b);
     b->free = apr_bucket_free;
     b->list = list;
-    return apr_bucket_socket_make(b, p);
+    return apr_bucket_socket_make_ex(b, p, flags);
 }
 
 APR_DECLARE_DATA const apr_bucket_type_t apr_bucket_type_socket = {
@@ -148,6 +148,40 @@ APR_DECLARE(apr_status_t) apr_file_read(apr_file_t *thefile, void *buf, apr_size
 
 
 
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile,
+                                           apr_off_t offset, void *buf,
+                                           apr_size_t *nbytes)
+{
+    apr_off_t pos = 0;
+    apr_status_t rv, rv2;
+
+    /* No positional read, move to the offset and back */
+    rv = apr_file_seek(thefile, APR_CUR, &pos);
+    if (rv == APR_SUCCESS) {
+        apr_off_t at = offset;
+
+        rv = apr_file_seek(thefile, APR_SET, &at);
+    }
+    if (rv != APR_SUCCESS) {
+        *nbytes = 0;
+        return rv;
+    }
+    rv = apr_file_read(thefile, buf, nbytes);
+    rv2 = apr_file_seek(thefile, APR_SET, &pos);
+
+    return rv != APR_SUCCESS ? rv : rv2;
+}
+
+
+
+APR_DECLARE(apr_status_t) apr_file_readahead(apr_file_t *thefile,
+                                             apr_off_t offset, apr_off_t len)
+{
+    return APR_ENOTIMPL;
+}
+
+
+
 APR_DECLARE(apr_status_t) apr_file_write(apr_file_t *thefile, const void *buf, apr_size_t *nbytes)
 {
     ULONG rc = 0;
@@ -28,9 +28,29 @@
 #define NAME_MAX 255
 #endif
 
+#ifdef APR_USE_GETDENTS64
+/* Room for a few hundred entries per getdents64() */
+#define DIR_DENTS_SIZE (64 * 1024)
+
+/* The buffer is malloc()ed on the first read and freed on close, rather
+ * than taken from the pool for the pool's lifetime */
+static apr_status_t dir_dents_cleanup(void *thedir)
+{
+    apr_dir_t *dir = thedir;
+
+    free(dir->dents);
+    dir->dents = NULL;
+    dir->dents_len = dir->dents_pos = 0;
+    return APR_SUCCESS;
+}
+#endif
+
 static apr_status_t dir_cleanup(void *thedir)
 {
     apr_dir_t *dir = thedir;
+#ifdef APR_USE_GETDENTS64
+    dir_dents_cleanup(dir);
+#endif
     if (closedir(dir->dirstruct) == 0) {
         return APR_SUCCESS;
     }
@@ -100,6 +120,10 @@ apr_status_t apr_dir_open(apr_dir_t **new, const char *dirname,
 #else
     (*new)->entry = NULL;
 #endif
+#ifdef APR_USE_GETDENTS64
+    (*new)->dents = NULL;
+    (*new)->dents_len = (*new)->dents_pos = 0;
+#endif
 
     apr_pool_cleanup_register((*new)->pool, *new, dir_cleanup,
                               apr_pool_cleanup_null);
@@ -139,13 +163,56 @@ static apr_filetype_e filetype_from_dirent_type(int type)
 }
 #endif
 
-apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
-                          apr_dir_t *thedir)
+/* Read the next entry of the directory, giving its name and, when the
+ * entry tells them, its type and inode (else APR_UNKFILE and 0).
+ */
+static apr_status_t dir_next(apr_dir_t *thedir, const char **name,
+                             apr_filetype_e *type, apr_ino_t *inode)
 {
+#ifdef APR_USE_GETDENTS64
+    struct dirent64 *dent;
+
+    /* Refill the buffer with as many entries as fit, which readdir()
+     * would do with a smaller one */
+    if (thedir->dents_pos >= thedir->dents_len) {
+        ssize_t len;
+
+        if (thedir->dents == NULL) {
+            thedir->dents = malloc(DIR_DENTS_SIZE);
+            if (thedir->dents == NULL) {
+                return APR_ENOMEM;
+            }
+        }
+        do {
+            len = getdents64(dirfd(thedir->dirstruct), thedir->dents,
+                             DIR_DENTS_SIZE);
+        } while (len < 0 && errno == EINTR);
+        if (len < 0) {
+            return errno;
+        }
+        if (len == 0) {
+            return APR_ENOENT;
+        }
+        thedir->dents_len = len;
+        thedir->dents_pos = 0;
+    }
+
+    dent = (struct dirent64 *)(thedir->dents + thedir->dents_pos);
+    thedir->dents_pos += dent->d_reclen;
+
+    *name = dent->d_name;
+    *type = filetype_from_dirent_type(dent->d_type);
+    /* Check for overflow if storing a 64-bit d_ino in a 32-bit apr_ino_t */
+    if (sizeof(apr_ino_t) >= sizeof(dent->d_ino)
+        || (apr_ino_t)dent->d_ino == dent->d_ino) {
+        *inode = dent->d_ino;
+    }
+    else {
+        *inode = 0;
+    }
+    return APR_SUCCESS;
+#else
     apr_status_t ret = 0;
-#ifdef DIRENT_TYPE
-    apr_filetype_e type;
-#endif
 #if APR_HAS_THREADS && defined(_POSIX_THREAD_SAFE_FUNCTIONS) \
                     && !defined(READDIR_IS_THREAD_SAFE)
 #ifdef APR_USE_READDIR64_R
@@ -203,20 +270,17 @@ apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
     }
 #endif
 
-    /* No valid bit flag to test here - do we want one? */
-    finfo->fname = NULL;
-
     if (ret) {
-        finfo->valid = 0;
         return ret;
     }
 
+    *name = thedir->entry->d_name;
 #ifdef DIRENT_TYPE
-    type = filetype_from_dirent_type(thedir->entry->DIRENT_TYPE);
-    if (type != APR_UNKFILE) {
-        wanted &= ~APR_FINFO_TYPE;
-    }
+    *type = filetype_from_dirent_type(thedir->entry->DIRENT_TYPE);
+#else
+    *type = APR_UNKFILE;
 #endif
+    *inode = 0;
 #ifdef DIRENT_INODE
     if (thedir->entry->DIRENT_INODE && thedir->entry->DIRENT_INODE != -1) {
 #ifdef APR_USE_READDIR64_R
@@ -224,22 +288,44 @@ apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
          * to fit a 64-bit integer into a 32-bit integer. */
         if (sizeof(apr_ino_t) >= sizeof(retent->DIRENT_INODE)
             || (apr_ino_t)retent->DIRENT_INODE == retent->DIRENT_INODE) {
-            wanted &= ~APR_FINFO_INODE;
-        } else {
-            /* Prevent the fallback code below from filling in the
-             * inode if the stat call fails. */
-            retent->DIRENT_INODE = 0;
+            *inode = retent->DIRENT_INODE;
         }
 #else
-        wanted &= ~APR_FINFO_INODE;
+        *inode = thedir->entry->DIRENT_INODE;
 #endif /* APR_USE_READDIR64_R */
     }
 #endif /* DIRENT_INODE */
 
+    return APR_SUCCESS;
+#endif /* APR_USE_GETDENTS64 */
+}
+
+/* Fill in finfo for the entry NAME just read, stat()ing it for what its
+ * TYPE and INODE don't tell of the wanted fields.
+ */
+static apr_status_t dir_entry_info(apr_finfo_t *finfo, apr_int32_t wanted,
+                                   apr_dir_t *thedir, const char *name,
+                                   apr_filetype_e type, apr_ino_t inode)
+{
+    apr_status_t ret = 0;
+
+    /* No valid bit flag to test here - do we want one? */
+    finfo->fname = NULL;
+
+    if (type != APR_UNKFILE) {
+        wanted &= ~APR_FINFO_TYPE;
+    }
+    if (inode) {
+        wanted &= ~APR_FINFO_INODE;
+    }
     wanted &= ~APR_FINFO_NAME;
 
     if (wanted)
     {
+#ifdef APR_USE_STATAT
+        ret = apr_unix_statat(finfo, dirfd(thedir->dirstruct), name,
+                              APR_FINFO_LINK | wanted, thedir->pool);
+#else
         char fspec[APR_PATH_MAX];
         char *end;
 
@@ -248,12 +334,12 @@ apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
         if (end > fspec && end[-1] != '/' && (end < fspec + APR_PATH_MAX))
             *end++ = '/';
 
-        apr_cpystrn(end, thedir->entry->d_name,
-                    sizeof fspec - (end - fspec));
+        apr_cpystrn(end, name, sizeof fspec - (end - fspec));
 
         ret = apr_stat(finfo, fspec, APR_FINFO_LINK | wanted, thedir->pool);
         /* We passed a stack name that will disappear */
         finfo->fname = NULL;
+#endif
     }
 
     if (wanted && (ret == APR_SUCCESS || ret == APR_INCOMPLETE)) {
@@ -265,21 +351,17 @@ apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
          */
         finfo->pool = thedir->pool;
         finfo->valid = 0;
-#ifdef DIRENT_TYPE
         if (type != APR_UNKFILE) {
             finfo->filetype = type;
             finfo->valid |= APR_FINFO_TYPE;
         }
-#endif
-#ifdef DIRENT_INODE
-        if (thedir->entry->DIRENT_INODE && thedir->entry->DIRENT_INODE != -1) {
-            finfo->inode = thedir->entry->DIRENT_INODE;
+        if (inode) {
+            finfo->inode = inode;
             finfo->valid |= APR_FINFO_INODE;
         }
-#endif
     }
 
-    finfo->name = apr_pstrdup(thedir->pool, thedir->entry->d_name);
+    finfo->name = apr_pstrdup(thedir->pool, name);
     finfo->valid |= APR_FINFO_NAME;
 
     if (wanted)
@@ -288,9 +370,59 @@ apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
     return APR_SUCCESS;
 }
 
+apr_status_t apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
+                          apr_dir_t *thedir)
+{
+    const char *name;
+    apr_filetype_e type;
+    apr_ino_t inode;
+    apr_status_t ret;
+
+    ret = dir_next(thedir, &name, &type, &inode);
+    if (ret) {
+        finfo->fname = NULL;
+        finfo->valid = 0;
+        return ret;
+    }
+
+    return dir_entry_info(finfo, wanted, thedir, name, type, inode);
+}
+
+apr_status_t apr_dir_read_batch(apr_finfo_t *finfos, apr_size_t *nelts,
+                                apr_int32_t wanted, apr_dir_t *thedir)
+{
+    const char *name;
+    apr_filetype_e type;
+    apr_ino_t inode;
+    apr_status_t ret, rv = APR_SUCCESS;
+    apr_size_t n;
+
+    for (n = 0; n < *nelts; n++) {
+        ret = dir_next(thedir, &name, &type, &inode);
+        if (ret) {
+            /* Reported by the next call if some entries were read */
+            if (n == 0) {
+                rv = ret;
+            }
+            break;
+        }
+        if (dir_entry_info(&finfos[n], wanted, thedir, name, type, inode)
+                != APR_SUCCESS) {
+            rv = APR_INCOMPLETE;
+        }
+    }
+    *nelts = n;
+
+    return rv;
+}
+
 apr_status_t apr_dir_rewind(apr_dir_t *thedir)
 {
     rewinddir(thedir->dirstruct);
+#ifdef APR_USE_GETDENTS64
+    /* rewinddir() has seeked back the descriptor too */
+    thedir->dents_len = thedir->dents_pos = 0;
+#endif
     return APR_SUCCESS;
 }
 
@@ -365,8 +497,16 @@ apr_status_t apr_os_dir_put(apr_dir_t **dir, apr_os_dir_t *thedir,
     if ((*dir) == NULL) {
         (*dir) = (apr_dir_t *)apr_pcalloc(pool, sizeof(apr_dir_t));
         (*dir)->pool = pool;
+#ifdef APR_USE_GETDENTS64
+        /* not closed by APR, but the buffer is ours */
+        apr_pool_cleanup_register(pool, *dir, dir_dents_cleanup,
+                                  apr_pool_cleanup_null);
+#endif
     }
     (*dir)->dirstruct = thedir;
+#ifdef APR_USE_GETDENTS64
+    (*dir)->dents_len = (*dir)->dents_pos = 0;
+#endif
     return APR_SUCCESS;
 }
 
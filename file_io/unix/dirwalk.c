@@ -0,0 +1,382 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_atomic.h"
+#include "apr_errno.h"
+#include "apr_file_info.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#define APR_WANT_STRFUNC
+#define APR_WANT_MEMFUNC
+#include "apr_want.h"
+#include <stdlib.h>
+#if APR_HAS_THREADS
+#include "apr_thread_cond.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_pool.h"
+#endif
+
+/* Entries read from a directory at a time */
+#define WALK_BATCH_SIZE 64
+
+/* Directories queued to the thread pool at most, by default */
+#define WALK_QUEUE_SIZE 1024
+
+typedef struct walk_t {
+    apr_int32_t wanted;
+    apr_int32_t flags;
+    apr_dir_walk_filter_fn_t *filter;
+    apr_dir_walk_callback_fn_t *callback;
+    void *baton;
+    /* the first error, which stops the walk */
+    volatile apr_status_t status;
+#if APR_HAS_THREADS
+    apr_thread_pool_t *tp;
+    apr_thread_mutex_t *mutex;
+    apr_thread_cond_t *cond;
+    volatile apr_uint32_t queued;
+    apr_uint32_t queue_size;
+    int done;
+#endif
+} walk_t;
+
+/* A directory to walk, which lives until itself and all of its
+ * subdirectories are walked.  It's a single (malloc()ed) record with the
+ * path and the name, and it's only given a pool while it is being walked,
+ * so that the many subdirectories of a wide directory which wait to be
+ * walked (or queued) take little memory.
+ */
+typedef struct walk_dir_t {
+    walk_t *walk;
+    struct walk_dir_t *parent;
+    /* the next subdirectory of the parent to dispatch */
+    struct walk_dir_t *next;
+    const char *path;
+    /* for the post-order callback */
+    apr_finfo_t finfo;
+    /* itself and its subdirectories not walked yet */
+    volatile apr_uint32_t pending;
+} walk_dir_t;
+
+static void walk_fail(walk_t *walk, apr_status_t rv)
+{
+#if APR_HAS_THREADS
+    if (walk->tp) {
+        apr_thread_mutex_lock(walk->mutex);
+        if (walk->status == APR_SUCCESS) {
+            walk->status = rv;
+        }
+        apr_thread_mutex_unlock(walk->mutex);
+        return;
+    }
+#endif
+    if (walk->status == APR_SUCCESS) {
+        walk->status = rv;
+    }
+}
+
+static void walk_report(walk_t *walk, const apr_finfo_t *finfo,
+                        apr_pool_t *pool)
+{
+    apr_status_t rv;
+
+    if (walk->status == APR_SUCCESS) {
+        rv = walk->callback(walk->baton, finfo, pool);
+        if (rv != APR_SUCCESS) {
+            walk_fail(walk, rv);
+        }
+    }
+}
+
+static apr_status_t dir_create(walk_dir_t **new_dir, walk_t *walk,
+                               walk_dir_t *parent, const char *path,
+                               const apr_finfo_t *finfo)
+{
+    walk_dir_t *dir;
+    apr_size_t path_len = strlen(path) + 1;
+    apr_size_t name_len = finfo ? strlen(finfo->name) + 1 : 0;
+    char *buf;
+
+    /* Not from a pool since the directory may be released by another
+     * thread than the one which created it */
+    dir = calloc(1, sizeof(*dir) + path_len + name_len);
+    if (!dir) {
+        return APR_ENOMEM;
+    }
+    buf = (char *)(dir + 1);
+    dir->walk = walk;
+    dir->parent = parent;
+    dir->path = memcpy(buf, path, path_len);
+    if (finfo) {
+        dir->finfo = *finfo;
+        dir->finfo.pool = NULL;
+        dir->finfo.filehand = NULL;
+        dir->finfo.fname = dir->path;
+        dir->finfo.name = memcpy(buf + path_len, finfo->name, name_len);
+    }
+    dir->pending = 1;
+    if (parent) {
+        apr_atomic_inc32(&parent->pending);
+    }
+
+    *new_dir = dir;
+    return APR_SUCCESS;
+}
+
+/* Done with the directory, or one of its subdirectories */
+static void dir_release(walk_dir_t *dir)
+{
+    walk_t *walk = dir->walk;
+    walk_dir_t *parent;
+    apr_pool_t *pool = NULL;
+
+    while (dir && !apr_atomic_dec32(&dir->pending)) {
+        parent = dir->parent;
+        if (parent && (walk->flags & APR_DIR_WALK_POSTORDER)
+            && walk->status == APR_SUCCESS) {
+            if (!pool) {
+                /* Unmanaged since it's used by the pool's threads */
+                apr_status_t rv = apr_pool_create_unmanaged_ex(&pool, NULL,
+                                                               NULL);
+                if (rv != APR_SUCCESS) {
+                    walk_fail(walk, rv);
+                }
+            }
+            if (pool) {
+                dir->finfo.pool = pool;
+                walk_report(walk, &dir->finfo, pool);
+                apr_pool_clear(pool);
+            }
+        }
+        free(dir);
+#if APR_HAS_THREADS
+        if (!parent && walk->tp) {
+            apr_thread_mutex_lock(walk->mutex);
+            walk->done = 1;
+            apr_thread_cond_signal(walk->cond);
+            apr_thread_mutex_unlock(walk->mutex);
+        }
+#endif
+        dir = parent;
+    }
+    if (pool) {
+        apr_pool_destroy(pool);
+    }
+}
+
+static void dir_walk(walk_dir_t *dir);
+
+#if APR_HAS_THREADS
+static void * APR_THREAD_FUNC dir_task(apr_thread_t *thd, void *data)
+{
+    walk_dir_t *dir = data;
+
+    apr_atomic_dec32(&dir->walk->queued);
+    dir_walk(dir);
+
+    return NULL;
+}
+#endif
+
+/* Queue the subdirectory to the thread pool, unless the queue is full
+ * (or there is no thread pool) in which case it's walked right away.
+ */
+static void dir_dispatch(walk_dir_t *dir)
+{
+#if APR_HAS_THREADS
+    walk_t *walk = dir->walk;
+
+    if (walk->tp && walk->status == APR_SUCCESS) {
+        if (apr_atomic_inc32(&walk->queued) < walk->queue_size
+            && apr_thread_pool_push(walk->tp, dir_task, dir,
+                                    APR_THREAD_TASK_PRIORITY_NORMAL,
+                                    walk) == APR_SUCCESS) {
+            return;
+        }
+        apr_atomic_dec32(&walk->queued);
+    }
+#endif
+    dir_walk(dir);
+}
+
+static void dir_walk(walk_dir_t *dir)
+{
+    walk_t *walk = dir->walk;
+    apr_finfo_t *finfos, *finfo;
+    walk_dir_t *subdirs = NULL, **last = &subdirs, *subdir;
+    apr_pool_t *pool, *iterpool;
+    apr_dir_t *thedir;
+    apr_size_t i, nelts;
+    apr_status_t rv;
+    const char *name, *sep;
+
+    if (walk->status != APR_SUCCESS) {
+        dir_release(dir);
+        return;
+    }
+
+    /* Unmanaged since the walks run concurrently with a thread pool */
+    rv = apr_pool_create_unmanaged_ex(&pool, NULL, NULL);
+    if (rv != APR_SUCCESS) {
+        walk_fail(walk, rv);
+        dir_release(dir);
+        return;
+    }
+    rv = apr_dir_open(&thedir, dir->path, pool);
+    if (rv != APR_SUCCESS) {
+        /* A subdirectory removed since is not an error */
+        if (!dir->parent || !APR_STATUS_IS_ENOENT(rv)) {
+            walk_fail(walk, rv);
+        }
+        apr_pool_destroy(pool);
+        dir_release(dir);
+        return;
+    }
+
+    /* Not on the stack, which the sequential walk of a deep tree (one
+     * level per subdirectory) would exhaust otherwise */
+    finfos = apr_palloc(pool, WALK_BATCH_SIZE * sizeof(*finfos));
+    sep = dir->path[strlen(dir->path) - 1] == '/' ? "" : "/";
+    apr_pool_create(&iterpool, pool);
+
+    while (walk->status == APR_SUCCESS) {
+        nelts = WALK_BATCH_SIZE;
+        rv = apr_dir_read_batch(finfos, &nelts, walk->wanted, thedir);
+        if (APR_STATUS_IS_ENOENT(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+            walk_fail(walk, rv);
+            break;
+        }
+
+        for (i = 0; i < nelts && walk->status == APR_SUCCESS; i++) {
+            finfo = &finfos[i];
+            name = finfo->name;
+            if (name[0] == '.'
+                && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) {
+                continue;
+            }
+
+            apr_pool_clear(iterpool);
+            finfo->fname = apr_pstrcat(iterpool, dir->path, sep, name, NULL);
+            if (walk->filter && !walk->filter(walk->baton, finfo)) {
+                continue;
+            }
+
+            if ((finfo->valid & APR_FINFO_TYPE) && finfo->filetype == APR_DIR) {
+                if (!(walk->flags & APR_DIR_WALK_POSTORDER)) {
+                    walk_report(walk, finfo, iterpool);
+                }
+                rv = dir_create(&subdir, walk, dir, finfo->fname, finfo);
+                if (rv != APR_SUCCESS) {
+                    walk_fail(walk, rv);
+                    break;
+                }
+                *last = subdir;
+                last = &subdir->next;
+            }
+            else {
+                walk_report(walk, finfo, iterpool);
+            }
+        }
+    }
+
+    /* Closed (and the pool destroyed) before descending, which walking
+     * sequentially then needs one descriptor at a time only, and only
+     * the pending subdirectories' records per level */
+    apr_dir_close(thedir);
+    apr_pool_destroy(pool);
+
+    while (subdirs) {
+        subdir = subdirs;
+        /* before it's possibly released (and freed) */
+        subdirs = subdir->next;
+        dir_dispatch(subdir);
+    }
+
+    dir_release(dir);
+}
+
+APR_DECLARE(apr_status_t) apr_dir_walk(const char *path, apr_int32_t wanted,
+                                       apr_int32_t flags,
+                                       apr_dir_walk_filter_fn_t *filter,
+                                       apr_dir_walk_callback_fn_t *callback,
+                                       void *baton,
+                                       struct apr_thread_pool *tp,
+                                       apr_size_t queue_size,
+                                       apr_pool_t *pool)
+{
+    walk_t walk;
+    walk_dir_t *root;
+    apr_size_t len;
+    apr_status_t rv;
+
+    memset(&walk, 0, sizeof(walk));
+    /* The type is needed to descend */
+    walk.wanted = wanted | APR_FINFO_TYPE | APR_FINFO_NAME;
+    walk.flags = flags;
+    walk.filter = filter;
+    walk.callback = callback;
+    walk.baton = baton;
+
+    /* No trailing separators, the entries' paths add theirs */
+    len = strlen(path);
+    while (len > 1 && path[len - 1] == '/') {
+        len--;
+    }
+    path = apr_pstrmemdup(pool, path, len);
+
+#if APR_HAS_THREADS
+    if (tp) {
+        walk.tp = tp;
+        walk.queue_size = queue_size ? (apr_uint32_t)queue_size
+                                     : WALK_QUEUE_SIZE;
+        if ((rv = apr_thread_mutex_create(&walk.mutex,
+                                          APR_THREAD_MUTEX_DEFAULT, pool))
+                != APR_SUCCESS
+            || (rv = apr_thread_cond_create(&walk.cond, pool))
+                != APR_SUCCESS) {
+            return rv;
+        }
+    }
+#else
+    if (tp) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
+    rv = dir_create(&root, &walk, NULL, path, NULL);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    dir_walk(root);
+
+#if APR_HAS_THREADS
+    if (tp) {
+        apr_thread_mutex_lock(walk.mutex);
+        while (!walk.done) {
+            apr_thread_cond_wait(walk.cond, walk.mutex);
+        }
+        apr_thread_mutex_unlock(walk.mutex);
+        apr_thread_cond_destroy(walk.cond);
+        apr_thread_mutex_destroy(walk.mutex);
+    }
+#endif
+
+    return walk.status;
+}
@@ -23,6 +23,9 @@
 #ifdef HAVE_UTIME
 #include <utime.h>
 #endif
+#if defined(APR_USE_STATAT) && defined(HAVE_STATX)
+#include <sys/sysmacros.h>
+#endif
 
 static apr_filetype_e filetype_from_mode(mode_t mode)
 {
@@ -126,6 +129,143 @@ static void fill_out_finfo(apr_finfo_t *finfo, struct_stat *info,
 #endif
 }
 
+#ifdef APR_USE_STATAT
+#ifdef HAVE_STATX
+/* Only ask statx() for what is wanted, which spares a remote filesystem
+ * the fetch of attributes nobody will look at.
+ */
+static unsigned int statx_mask(apr_int32_t wanted)
+{
+    unsigned int mask = 0;
+
+    if (wanted & APR_FINFO_TYPE)
+        mask |= STATX_TYPE;
+    if (wanted & APR_FINFO_PROT)
+        mask |= STATX_MODE;
+    if (wanted & APR_FINFO_USER)
+        mask |= STATX_UID;
+    if (wanted & APR_FINFO_GROUP)
+        mask |= STATX_GID;
+    if (wanted & APR_FINFO_NLINK)
+        mask |= STATX_NLINK;
+    if (wanted & APR_FINFO_INODE)
+        mask |= STATX_INO;
+    if (wanted & APR_FINFO_SIZE)
+        mask |= STATX_SIZE;
+    if (wanted & APR_FINFO_CSIZE)
+        mask |= STATX_BLOCKS;
+    if (wanted & APR_FINFO_ATIME)
+        mask |= STATX_ATIME;
+    if (wanted & APR_FINFO_MTIME)
+        mask |= STATX_MTIME;
+    if (wanted & APR_FINFO_CTIME)
+        mask |= STATX_CTIME;
+
+    return mask;
+}
+
+static void fill_out_finfo_statx(apr_finfo_t *finfo, struct statx *stx)
+{
+    unsigned int mask = stx->stx_mask;
+
+    /* The device is always there */
+    finfo->valid = APR_FINFO_DEV;
+    finfo->device = makedev(stx->stx_dev_major, stx->stx_dev_minor);
+
+    if (mask & STATX_TYPE) {
+        finfo->filetype = filetype_from_mode(stx->stx_mode);
+        finfo->valid |= APR_FINFO_TYPE;
+    }
+    if (mask & STATX_MODE) {
+        finfo->protection = apr_unix_mode2perms(stx->stx_mode);
+        finfo->valid |= APR_FINFO_PROT;
+    }
+    if (mask & STATX_UID) {
+        finfo->user = stx->stx_uid;
+        finfo->valid |= APR_FINFO_USER;
+    }
+    if (mask & STATX_GID) {
+        finfo->group = stx->stx_gid;
+        finfo->valid |= APR_FINFO_GROUP;
+    }
+    if (mask & STATX_NLINK) {
+        finfo->nlink = stx->stx_nlink;
+        finfo->valid |= APR_FINFO_NLINK;
+    }
+    if ((mask & STATX_INO)
+        && (sizeof(apr_ino_t) >= sizeof(stx->stx_ino)
+            || (apr_ino_t)stx->stx_ino == stx->stx_ino)) {
+        finfo->inode = stx->stx_ino;
+        finfo->valid |= APR_FINFO_INODE;
+    }
+    if (mask & STATX_SIZE) {
+        finfo->size = stx->stx_size;
+        finfo->valid |= APR_FINFO_SIZE;
+    }
+    if (mask & STATX_BLOCKS) {
+        /* Always 512-byte units */
+        finfo->csize = (apr_off_t)stx->stx_blocks * (apr_off_t)512;
+        finfo->valid |= APR_FINFO_CSIZE;
+    }
+    if (mask & STATX_ATIME) {
+        apr_time_ansi_put(&finfo->atime, stx->stx_atime.tv_sec);
+        finfo->atime += stx->stx_atime.tv_nsec / APR_TIME_C(1000);
+        finfo->valid |= APR_FINFO_ATIME;
+    }
+    if (mask & STATX_MTIME) {
+        apr_time_ansi_put(&finfo->mtime, stx->stx_mtime.tv_sec);
+        finfo->mtime += stx->stx_mtime.tv_nsec / APR_TIME_C(1000);
+        finfo->valid |= APR_FINFO_MTIME;
+    }
+    if (mask & STATX_CTIME) {
+        apr_time_ansi_put(&finfo->ctime, stx->stx_ctime.tv_sec);
+        finfo->ctime += stx->stx_ctime.tv_nsec / APR_TIME_C(1000);
+        finfo->valid |= APR_FINFO_CTIME;
+    }
+}
+#endif /* HAVE_STATX */
+
+/* apr_stat() of FNAME relative to the directory open as DFD, used by
+ * apr_dir_read() so that the kernel needs not resolve the directory's
+ * path again for each entry.
+ */
+apr_status_t apr_unix_statat(apr_finfo_t *finfo, int dfd, const char *fname,
+                             apr_int32_t wanted, apr_pool_t *pool)
+{
+    int flags = (wanted & APR_FINFO_LINK) ? AT_SYMLINK_NOFOLLOW : 0;
+    struct_stat info;
+#ifdef HAVE_STATX
+    /* Set once the kernel said it has no statx(), not to ask again */
+    static volatile int statx_enosys = 0;
+    struct statx stx;
+
+    if (!statx_enosys) {
+        if (statx(dfd, fname, flags, statx_mask(wanted), &stx) == 0) {
+            finfo->pool = pool;
+            finfo->fname = NULL;
+            fill_out_finfo_statx(finfo, &stx);
+            wanted &= ~APR_FINFO_LINK;
+            return (wanted & ~finfo->valid) ? APR_INCOMPLETE : APR_SUCCESS;
+        }
+        if (errno != ENOSYS) {
+            return errno;
+        }
+        /* else not supported by the kernel, fall through */
+        statx_enosys = 1;
+    }
+#endif
+
+    if (fstatat(dfd, fname, &info, flags) == 0) {
+        finfo->pool = pool;
+        finfo->fname = NULL;
+        fill_out_finfo(finfo, &info, wanted);
+        wanted &= ~APR_FINFO_LINK;
+        return (wanted & ~finfo->valid) ? APR_INCOMPLETE : APR_SUCCESS;
+    }
+    return errno;
+}
+#endif /* APR_USE_STATAT */
+
 apr_status_t apr_file_info_get_locked(apr_finfo_t *finfo, apr_int32_t wanted,
                                       apr_file_t *thefile)
 {
@@ -146,6 +146,90 @@ APR_DECLARE(apr_status_t) apr_file_read(apr_file_t *thefile, void *buf, apr_size
     }
 }
 
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile,
+                                           apr_off_t offset, void *buf,
+                                           apr_size_t *nbytes)
+{
+    apr_ssize_t rv;
+#ifndef HAVE_PREAD
+    apr_off_t pos;
+#endif
+
+    if (*nbytes <= 0) {
+        *nbytes = 0;
+        return APR_SUCCESS;
+    }
+
+    if (thefile->buffered) {
+        /* Pending writes must be in the file to be read, but the read
+         * buffer and the file position are not involved.
+         */
+        file_lock(thefile);
+        rv = (thefile->direction == 1) ? apr_file_flush_locked(thefile) : 0;
+        file_unlock(thefile);
+        if (rv) {
+            *nbytes = 0;
+            return rv;
+        }
+    }
+
+#ifdef HAVE_PREAD
+    do {
+        rv = pread(thefile->filedes, buf, *nbytes, offset);
+    } while (rv == -1 && errno == EINTR);
+#else
+    /* Move to the offset and back, atomically for XTHREAD files only */
+    file_lock(thefile);
+    pos = lseek(thefile->filedes, 0, SEEK_CUR);
+    if (pos == -1 || lseek(thefile->filedes, offset, SEEK_SET) == -1) {
+        rv = errno;
+        file_unlock(thefile);
+        *nbytes = 0;
+        return rv;
+    }
+    do {
+        rv = read(thefile->filedes, buf, *nbytes);
+    } while (rv == -1 && errno == EINTR);
+    if (lseek(thefile->filedes, pos, SEEK_SET) == -1) {
+        rv = -1;
+    }
+    file_unlock(thefile);
+#endif
+
+    if (rv == -1) {
+        *nbytes = 0;
+        return errno;
+    }
+    *nbytes = rv;
+    if (rv == 0) {
+        return APR_EOF;
+    }
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_file_readahead(apr_file_t *thefile,
+                                             apr_off_t offset, apr_off_t len)
+{
+#if defined(HAVE_POSIX_FADVISE) && defined(POSIX_FADV_WILLNEED)
+    return posix_fadvise(thefile->filedes, offset, len, POSIX_FADV_WILLNEED);
+#elif defined(HAVE_READAHEAD)
+    if (len == 0) {
+        struct_stat info;
+
+        if (fstat(thefile->filedes, &info) == -1) {
+            return errno;
+        }
+        len = info.st_size > offset ? info.st_size - offset : 0;
+    }
+    if (readahead(thefile->filedes, offset, len) == -1) {
+        return errno;
+    }
+    return APR_SUCCESS;
+#else
+    return APR_ENOTIMPL;
+#endif
+}
+
 static apr_status_t do_rotating_check(apr_file_t *thefile, apr_time_t now)
 {
     apr_size_t rv = APR_SUCCESS;
@@ -182,6 +182,34 @@ APR_DECLARE(apr_status_t) apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_dir_read_batch(apr_finfo_t *finfos,
+                                             apr_size_t *nelts,
+                                             apr_int32_t wanted,
+                                             apr_dir_t *thedir)
+{
+    apr_status_t ret, rv = APR_SUCCESS;
+    apr_size_t n;
+
+    for (n = 0; n < *nelts; n++) {
+        ret = apr_dir_read(&finfos[n], wanted, thedir);
+        if (ret != APR_SUCCESS && ret != APR_INCOMPLETE) {
+            /* Reported by the next call if some entries were read */
+            if (n == 0) {
+                rv = ret;
+            }
+            break;
+        }
+        if (ret == APR_INCOMPLETE) {
+            rv = APR_INCOMPLETE;
+        }
+        /* The name is overwritten by the next read */
+        finfos[n].name = apr_pstrdup(thedir->pool, finfos[n].name);
+    }
+    *nelts = n;
+
+    return rv;
+}
+
 APR_DECLARE(apr_status_t) apr_dir_rewind(apr_dir_t *dir)
 {
     apr_status_t rv;
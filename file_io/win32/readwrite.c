@@ -287,6 +287,88 @@ APR_DECLARE(apr_status_t) apr_file_read(apr_file_t *thefile, void *buf, apr_size
     return rv;
 }
 
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile,
+                                           apr_off_t offset, void *buf,
+                                           apr_size_t *nbytes)
+{
+    apr_status_t rv = APR_SUCCESS;
+    OVERLAPPED ov;
+    LARGE_INTEGER zero, pos;
+    DWORD bytes_read = 0;
+    int overlapped = (thefile->flags & APR_FOPEN_XTHREAD) != 0;
+
+    if (*nbytes <= 0) {
+        *nbytes = 0;
+        return APR_SUCCESS;
+    }
+
+    if (thefile->buffered) {
+        /* Pending writes must be in the file to be read */
+        if (overlapped) {
+            apr_thread_mutex_lock(thefile->mutex);
+        }
+        if (thefile->direction == 1) {
+            rv = apr_file_flush(thefile);
+        }
+        if (overlapped) {
+            apr_thread_mutex_unlock(thefile->mutex);
+        }
+        if (rv != APR_SUCCESS) {
+            *nbytes = 0;
+            return rv;
+        }
+    }
+
+    memset(&ov, 0, sizeof(ov));
+    ov.Offset = (DWORD)offset;
+    ov.OffsetHigh = (DWORD)(offset >> 32);
+    if (overlapped) {
+        ov.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+        if (!ov.hEvent) {
+            *nbytes = 0;
+            return apr_get_os_error();
+        }
+    }
+    else {
+        /* A synchronous read at an offset moves the file pointer */
+        zero.QuadPart = 0;
+        if (!SetFilePointerEx(thefile->filehand, zero, &pos, FILE_CURRENT)) {
+            *nbytes = 0;
+            return apr_get_os_error();
+        }
+    }
+
+    if (!ReadFile(thefile->filehand, buf, (DWORD)*nbytes, &bytes_read,
+                  &ov)) {
+        rv = apr_get_os_error();
+        if (rv == APR_FROM_OS_ERROR(ERROR_IO_PENDING)) {
+            rv = GetOverlappedResult(thefile->filehand, &ov, &bytes_read,
+                                     TRUE) ? APR_SUCCESS : apr_get_os_error();
+        }
+    }
+
+    if (overlapped) {
+        CloseHandle(ov.hEvent);
+    }
+    else if (!SetFilePointerEx(thefile->filehand, pos, NULL, FILE_BEGIN)
+             && rv == APR_SUCCESS) {
+        rv = apr_get_os_error();
+    }
+
+    *nbytes = bytes_read;
+    if (rv == APR_FROM_OS_ERROR(ERROR_HANDLE_EOF)
+        || (rv == APR_SUCCESS && bytes_read == 0)) {
+        rv = APR_EOF;
+    }
+    return rv;
+}
+
+APR_DECLARE(apr_status_t) apr_file_readahead(apr_file_t *thefile,
+                                             apr_off_t offset, apr_off_t len)
+{
+    return APR_ENOTIMPL;
+}
+
 APR_DECLARE(apr_status_t) apr_file_rotating_check(apr_file_t *thefile)
 {
     return APR_ENOTIMPL;
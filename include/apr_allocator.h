@@ -74,6 +74,38 @@ struct apr_memnode_t {
 APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
                           __attribute__((nonnull(1)));
 
+/** Flag for apr_allocator_create_ex(): back the nodes by (transparent)
+ *  huge pages */
+#define APR_ALLOCATOR_HUGEPAGES  0x01
+/** Flag for apr_allocator_create_ex(): back the nodes by explicit huge
+ *  pages (MAP_HUGETLB) if available, transparent ones otherwise */
+#define APR_ALLOCATOR_HUGETLB    0x02
+
+/**
+ * Create a new allocator whose nodes are carved from dedicated arenas
+ * @param allocator The allocator we have just created.
+ * @param flags Zero or a bitmask of APR_ALLOCATOR_HUGEPAGES and
+ *        APR_ALLOCATOR_HUGETLB.
+ * @param numa_node The NUMA node preferred for the arenas' memory, or -1
+ *        for no binding.
+ * @return APR_SUCCESS, APR_EINVAL if @a numa_node is too high, or
+ *         APR_ENOTIMPL if the platform supports neither arenas nor, for
+ *         @a numa_node >= 0, NUMA binding.
+ * @remark With @a flags or @a numa_node, the small nodes (up to 20 pages)
+ *         are carved from 2MB huge page aligned arenas, which reduces the
+ *         TLB misses on large working sets.  When the requested huge pages
+ *         or NUMA policy are not available from the system, the arenas
+ *         silently fall back to regular pages or to the default policy.
+ * @remark The arenas' nodes are never given back to the system before the
+ *         allocator is destroyed, regardless of apr_allocator_max_free_set().
+ * @remark With zero @a flags and negative @a numa_node, this is the same
+ *         as apr_allocator_create().
+ */
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags,
+                                                  int numa_node)
+                          __attribute__((nonnull(1)));
+
 /**
  * Destroy an allocator
  * @param allocator The allocator to be destroyed
@@ -183,6 +215,31 @@ APR_DECLARE(apr_thread_mutex_t *) apr_allocator_mutex_get(
                                           apr_allocator_t *allocator)
                                   __attribute__((nonnull(1)));
 
+/**
+ * Set up per-thread magazines in front of the allocator's free lists
+ * @param allocator The allocator
+ * @param count The number of magazines (rounded up to a power of two),
+ *        or zero to disable the magazines
+ * @param depth The maximum number of nodes cached per size in each
+ *        magazine, or zero for the default (16)
+ * @return APR_SUCCESS, APR_EINVAL if @a count is above 1024, APR_ENOMEM,
+ *         or APR_ENOTIMPL if the platform has no thread local storage.
+ * @remark Each thread is bound to one magazine which caches the free nodes
+ *         of the smallest sizes (up to 8 pages), and exchanges them with
+ *         the allocator's free lists by batches of half the depth.  This
+ *         reduces contention on the allocator mutex (if any) when many
+ *         threads allocate from the same allocator.  A count of (at
+ *         least) the number of threads gives each thread its own magazine.
+ * @remark The memory held by the magazines is accounted for by
+ *         apr_allocator_max_free_set().
+ * @remark Must not be called while the allocator is used concurrently.
+ */
+APR_DECLARE(apr_status_t) apr_allocator_magazines_set(
+                                          apr_allocator_t *allocator,
+                                          apr_uint32_t count,
+                                          apr_uint32_t depth)
+                          __attribute__((nonnull(1)));
+
 #endif /* APR_HAS_THREADS */
 
 /** @} */
@@ -632,6 +632,11 @@ struct apr_bucket_file {
     apr_pool_t *readpool;
     /** File read block size */
     apr_size_t read_size;
+    /** Whether the system should be told to read ahead what remains
+     *  of the file bucket when it is first read */
+    int readahead;
+    /** The end of what the system was told to read ahead */
+    apr_off_t readahead_end;
 };
 
 /** @see apr_bucket_structs */
@@ -840,6 +845,46 @@ APR_DECLARE(apr_status_t) apr_brigade_to_iovec(apr_bucket_brigade *b,
                                                struct iovec *vec, int *nvec)
                           __attribute__((nonnull(1,2,3)));
 
+/**
+ * Flag for apr_brigade_send_socket(): send the large in-memory buckets
+ * without copying them to the kernel (MSG_ZEROCOPY), where supported.
+ */
+#define APR_BRIGADE_SEND_ZEROCOPY 0x1
+
+/**
+ * Write the content of a bucket brigade to a socket, deleting the buckets
+ * written from the brigade.
+ * @param sock The socket to write to
+ * @param b The bucket brigade to write
+ * @param flags 0 or APR_BRIGADE_SEND_ZEROCOPY
+ * @param len The number of bytes written (output parameter, may be NULL)
+ * @return APR_SUCCESS once the whole brigade is written, or the error of
+ *         the read or write which stopped it, the rest of the data being
+ *         left in the brigade.  In particular with a non-blocking socket,
+ *         APR_EAGAIN (or APR_TIMEUP with a timeout) means that the socket
+ *         is full, so the call should be repeated once it is writable.
+ * @remark Consecutive in-memory buckets are written together with
+ *         apr_socket_sendv(), and file buckets of files opened with
+ *         APR_FOPEN_SENDFILE_ENABLED are written with apr_socket_sendfile(),
+ *         the in-memory buckets around them being its headers and
+ *         trailers.  Other buckets are read like with apr_bucket_read(),
+ *         not blocking until there is nothing to write meanwhile.
+ * @remark Metadata buckets are deleted as they are reached, FLUSH buckets
+ *         having no specific effect since everything is written anyway.
+ * @remark With APR_BRIGADE_SEND_ZEROCOPY, buckets of at least 16K are
+ *         written with MSG_ZEROCOPY on Linux (ignored elsewhere), and the
+ *         call waits for the kernel to release them before returning,
+ *         which may take until the peer acknowledges (or reads, over the
+ *         loopback) the data.  So it is only used with blocking sockets
+ *         (negative timeout), and pays off for large buffers on actual
+ *         network interfaces.
+ */
+APR_DECLARE(apr_status_t) apr_brigade_send_socket(apr_socket_t *sock,
+                                                  apr_bucket_brigade *b,
+                                                  apr_int32_t flags,
+                                                  apr_size_t *len)
+                          __attribute__((nonnull(1,2)));
+
 /**
  * This function writes a list of strings into a bucket brigade.
  * @param b The bucket brigade to add to
@@ -1601,6 +1646,52 @@ APR_DECLARE(apr_bucket *) apr_bucket_socket_make(apr_bucket *b,
                                                  apr_socket_t *thissock)
                           __attribute__((nonnull(1,2)));
 
+/**
+ * @defgroup apr_bucket_socket_flags Socket bucket flags
+ * @{
+ */
+/** Adapt the size of the reads: grow it (up to
+ *  #APR_BUCKET_SOCKET_MAX_SIZE) after reads which filled the buffer,
+ *  shrink it (down to #APR_BUCKET_BUFF_SIZE) after short ones, and copy
+ *  small results out of the buffer so that they don't pin it */
+#define APR_BUCKET_SOCKET_ADAPTIVE   0x01
+/** Like #APR_BUCKET_SOCKET_ADAPTIVE, but also size each read to what
+ *  the socket has available (FIONREAD) when it is known */
+#define APR_BUCKET_SOCKET_FIONREAD   0x02
+/** @} */
+
+/** The largest read of an adaptive socket bucket */
+#define APR_BUCKET_SOCKET_MAX_SIZE   (128 * 1024)
+
+/**
+ * Create a bucket referring to a socket, with the given read behaviour.
+ * @param thissock The socket to put in the bucket
+ * @param flags Zero for the same behaviour as apr_bucket_socket_create(),
+ *              or a combination of #APR_BUCKET_SOCKET_ADAPTIVE and
+ *              #APR_BUCKET_SOCKET_FIONREAD
+ * @param list The freelist from which this bucket should be allocated
+ * @return The new bucket, or NULL if allocation failed
+ * @remark The buckets that reading this one creates for the rest of the
+ *         socket data inherit the flags and the current read size, which
+ *         are kept in the otherwise unused @a start of the bucket.
+ */
+APR_DECLARE(apr_bucket *) apr_bucket_socket_create_ex(apr_socket_t *thissock,
+                                                      apr_int32_t flags,
+                                                      apr_bucket_alloc_t *list)
+                          __attribute__((nonnull(1,3)));
+/**
+ * Make the bucket passed in a bucket refer to a socket, with the given
+ * read behaviour.
+ * @param b The bucket to make into a SOCKET bucket
+ * @param thissock The socket to put in the bucket
+ * @param flags As for apr_bucket_socket_create_ex()
+ * @return The new bucket, or NULL if allocation failed
+ */
+APR_DECLARE(apr_bucket *) apr_bucket_socket_make_ex(apr_bucket *b,
+                                                    apr_socket_t *thissock,
+                                                    apr_int32_t flags)
+                          __attribute__((nonnull(1,2)));
+
 /**
  * Create a bucket referring to a pipe.
  * @param thispipe The pipe to put in the bucket
@@ -1669,6 +1760,21 @@ APR_DECLARE(apr_status_t) apr_bucket_file_enable_mmap(apr_bucket *b,
                                                       int enabled)
                           __attribute__((nonnull(1)));
 
+/**
+ * Enable or disable read-ahead hints for a FILE bucket (default is
+ * disabled).  When enabled, the first read of the bucket (and of the
+ * buckets it is split into) tells the system that the remaining length
+ * will be read soon, with apr_file_readahead().
+ * @param b The bucket
+ * @param enabled Whether read-ahead hints should be enabled
+ * @return APR_SUCCESS normally, or an error code if the operation fails
+ * @remark Relevant/used only when memory-mapping is disabled (@see
+ * apr_bucket_file_enable_mmap)
+ */
+APR_DECLARE(apr_status_t) apr_bucket_file_enable_readahead(apr_bucket *b,
+                                                           int enabled)
+                          __attribute__((nonnull(1)));
+
 /**
  * Set the size of the read buffer allocated by a FILE bucket (default
  * is @a APR_BUCKET_BUFF_SIZE)
@@ -267,11 +267,104 @@ APR_DECLARE(apr_status_t) apr_dir_close(apr_dir_t *thedir);
 APR_DECLARE(apr_status_t) apr_dir_read(apr_finfo_t *finfo, apr_int32_t wanted,
                                        apr_dir_t *thedir);
 
+/**
+ * Read the next entries from the specified directory.
+ * @param finfos An array of at least @a *nelts file info structures,
+ *               filled in as by apr_dir_read
+ * @param nelts On entry, the number of entries to read at most; on exit,
+ *              the number read
+ * @param wanted The desired apr_finfo_t fields, as a bit flag of APR_FINFO_
+ *               values
+ * @param thedir the directory descriptor returned from apr_dir_open
+ * @remark Where the system allows, the entries are fetched many at a time
+ *         and stat()ed relative to the directory rather than by their full
+ *         path, which apr_dir_read also benefits from; this saves the
+ *         per-entry overhead of calling it in a loop.
+ * @note If @c APR_INCOMPLETE is returned all the fields of some entries
+ *       may not be filled in, and you need to check their @c valid bitmask.
+ *       When no more entries are available, APR_ENOENT is returned with
+ *       @a *nelts set to zero; an error met after some entries were read
+ *       is returned by the next call.
+ */
+APR_DECLARE(apr_status_t) apr_dir_read_batch(apr_finfo_t *finfos,
+                                             apr_size_t *nelts,
+                                             apr_int32_t wanted,
+                                             apr_dir_t *thedir);
+
 /**
  * Rewind the directory to the first entry.
  * @param thedir the directory descriptor to rewind.
  */
 APR_DECLARE(apr_status_t) apr_dir_rewind(apr_dir_t *thedir);
+
+/** apr_dir_walk(): report directories before their contents (default) */
+#define APR_DIR_WALK_PREORDER   0x00
+/** apr_dir_walk(): report directories after their contents */
+#define APR_DIR_WALK_POSTORDER  0x01
+
+/**
+ * Called by apr_dir_walk() for the entries to report.
+ * @param baton The baton given to apr_dir_walk
+ * @param finfo The entry, with its path in @c finfo->fname and its name
+ *              in @c finfo->name
+ * @param pool A pool cleared after the call
+ * @return APR_SUCCESS to go on, or an error to stop the walk with
+ */
+typedef apr_status_t (apr_dir_walk_callback_fn_t)(void *baton,
+                                                  const apr_finfo_t *finfo,
+                                                  apr_pool_t *pool);
+
+/**
+ * Called by apr_dir_walk() to filter the entries.
+ * @param baton The baton given to apr_dir_walk
+ * @param finfo The entry, as given to the callback
+ * @return Non-zero to report the entry (and walk it if a directory),
+ *         zero to skip it (and the whole subtree if a directory)
+ */
+typedef int (apr_dir_walk_filter_fn_t)(void *baton, const apr_finfo_t *finfo);
+
+struct apr_thread_pool;
+
+/**
+ * Walk the tree under the specified directory.
+ * @param path The directory to walk, which itself is not reported
+ * @param wanted The desired apr_finfo_t fields of the entries, as a bit
+ *               flag of APR_FINFO_ values (the type and name are always
+ *               given)
+ * @param flags APR_DIR_WALK_PREORDER or APR_DIR_WALK_POSTORDER
+ * @param filter The filter for the entries, or NULL for all of them
+ * @param callback The callback for the entries
+ * @param baton The baton for the filter and the callback
+ * @param tp A thread pool (apr_thread_pool_t) to walk the subdirectories
+ *           in parallel, or NULL to walk them in the calling thread
+ * @param queue_size The number of subdirectories queued to @a tp at most,
+ *                   or zero for a default of 1024
+ * @param pool The pool to use
+ * @return APR_SUCCESS, the first error met, or the first error returned
+ *         by @a callback
+ * @remark The entries of a directory are read (with apr_dir_read_batch) and
+ *         reported before its subdirectories are walked; symbolic links
+ *         are reported, not followed.  Subdirectories which disappear
+ *         before they are walked are skipped.
+ * @remark With @a tp, each subdirectory is walked by a task of the thread
+ *         pool, so the filter and the callback are called concurrently from
+ *         its threads.  When @a queue_size subdirectories are already
+ *         queued, the thread which finds another one walks it itself,
+ *         which bounds the size of the queue on wide trees.  A
+ *         subdirectory only takes its path and apr_finfo_t until it is
+ *         walked, and the memory for reading it while it is.  The
+ *         order of the entries across directories is then unspecified,
+ *         besides the pre or post order of each directory with regard to
+ *         its contents.
+ */
+APR_DECLARE(apr_status_t) apr_dir_walk(const char *path, apr_int32_t wanted,
+                                       apr_int32_t flags,
+                                       apr_dir_walk_filter_fn_t *filter,
+                                       apr_dir_walk_callback_fn_t *callback,
+                                       void *baton,
+                                       struct apr_thread_pool *tp,
+                                       apr_size_t queue_size,
+                                       apr_pool_t *pool);
 /** @} */
 
 /**
@@ -462,6 +462,40 @@ APR_DECLARE(apr_status_t) apr_file_open_flags_stdin(apr_file_t **thefile,
 APR_DECLARE(apr_status_t) apr_file_read(apr_file_t *thefile, void *buf,
                                         apr_size_t *nbytes);
 
+/**
+ * Read data from the specified file at the given offset, without using
+ * nor moving the file pointer.
+ * @param thefile The file descriptor to read from.
+ * @param offset The offset in the file to read from.
+ * @param buf The buffer to store the data to.
+ * @param nbytes On entry, the number of bytes to read; on exit, the number
+ * of bytes read.
+ *
+ * @remark apr_file_read_at() reads up to the specified number of bytes,
+ * #APR_EOF is returned when @a offset is at or past the end of the file.
+ * It is meant for regular files, and neither the read buffer nor the
+ * character put back by apr_file_ungetc() are used.
+ *
+ * @remark Where the system has no positional read (pread()), the file
+ * pointer is moved to @a offset and back, so other users of the file may
+ * see it moved meanwhile.
+ */
+APR_DECLARE(apr_status_t) apr_file_read_at(apr_file_t *thefile,
+                                           apr_off_t offset, void *buf,
+                                           apr_size_t *nbytes);
+
+/**
+ * Tell the system that the given range of the file will be read soon,
+ * so that it can start reading it in the background.
+ * @param thefile The file descriptor.
+ * @param offset The start of the range.
+ * @param len The length of the range, 0 up to the end of the file.
+ * @return #APR_ENOTIMPL if the system has no such hint
+ * (posix_fadvise() or readahead()).
+ */
+APR_DECLARE(apr_status_t) apr_file_readahead(apr_file_t *thefile,
+                                             apr_off_t offset, apr_off_t len);
+
 /**
  * Write data to the specified file.
  * @param thefile The file descriptor to write to.
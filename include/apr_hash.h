@@ -70,6 +70,33 @@ typedef unsigned int (*apr_hashfunc_t)(const char *key, apr_ssize_t *klen);
 APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *key,
                                                       apr_ssize_t *klen);
 
+/**
+ * A fast hash function of the wyhash family, processing the key 16 or 48
+ * bytes per step, with good avalanche properties.
+ * @param key The key.
+ * @param klen The length of the key, or APR_HASH_KEY_STRING to use the string
+ *             length. If APR_HASH_KEY_STRING then returns the actual key length.
+ * @remark The hash is seeded with a random secret chosen once per process,
+ *         so its values must not be stored or shared across processes.
+ * @remark This is also the hash function used (with a per table seed) by
+ *         the hash tables created without a custom hash function.
+ */
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_wyhash(const char *key,
+                                                     apr_ssize_t *klen);
+
+/**
+ * A SipHash-1-3 hash function, slower than apr_hashfunc_wyhash() but a
+ * keyed pseudorandom function, hence suitable for hash tables whose keys
+ * come from untrusted sources.
+ * @param key The key.
+ * @param klen The length of the key, or APR_HASH_KEY_STRING to use the string
+ *             length. If APR_HASH_KEY_STRING then returns the actual key length.
+ * @remark The hash is keyed with a random secret chosen once per process,
+ *         so its values must not be stored or shared across processes.
+ */
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_siphash13(const char *key,
+                                                        apr_ssize_t *klen);
+
 /**
  * Create a hash table.
  * @param pool The pool to allocate the hash table out of
@@ -290,6 +317,184 @@ APR_POOL_DECLARE_ACCESSOR(hash);
 
 /** @} */
 
+/**
+ * @defgroup apr_hash_flat Flat Hash Tables
+ * @ingroup APR
+ * @{
+ */
+
+/**
+ * Abstract type for flat (open addressing) hash tables.
+ *
+ * @remark A flat hash table stores the key and value pointers, the key
+ * length and the hash value of its entries inline in one array, with a
+ * parallel array of control bytes probed 16 at a time (with SSE2 or NEON
+ * where available).  Lookups thus don't chase pointers through scattered
+ * entries like apr_hash_t does, at the cost of reallocating (from the
+ * pool) the whole arrays each time the table grows.
+ */
+typedef struct apr_hash_flat_t apr_hash_flat_t;
+
+/**
+ * Abstract type for scanning flat hash tables.
+ */
+typedef struct apr_hash_flat_index_t apr_hash_flat_index_t;
+
+/**
+ * Create a flat hash table.
+ * @param pool The pool to allocate the hash table out of
+ * @return The hash table just created
+ */
+APR_DECLARE(apr_hash_flat_t *) apr_hash_make_flat(apr_pool_t *pool);
+
+/**
+ * Create a flat hash table with a custom hash function
+ * @param pool The pool to allocate the hash table out of
+ * @param hash_func A custom hash function.
+ * @return The hash table just created
+ */
+APR_DECLARE(apr_hash_flat_t *) apr_hash_make_flat_custom(apr_pool_t *pool,
+                                                         apr_hashfunc_t hash_func);
+
+/**
+ * Make a copy of a flat hash table
+ * @param pool The pool from which to allocate the new hash table
+ * @param h The hash table to clone
+ * @return The hash table just created
+ * @remark Makes a shallow copy
+ */
+APR_DECLARE(apr_hash_flat_t *) apr_hash_flat_copy(apr_pool_t *pool,
+                                                  const apr_hash_flat_t *h);
+
+/**
+ * Associate a value with a key in a flat hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @param val Value to associate with the key
+ * @remark If the value is NULL the hash entry is deleted. The key is stored as is,
+ *         and so must have a lifetime at least as long as the hash table's pool.
+ */
+APR_DECLARE(void) apr_hash_flat_set(apr_hash_flat_t *ht, const void *key,
+                                    apr_ssize_t klen, const void *val);
+
+/**
+ * Look up the value associated with a key in a flat hash table.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string length.
+ * @return Returns NULL if the key is not present.
+ */
+APR_DECLARE(void *) apr_hash_flat_get(apr_hash_flat_t *ht, const void *key,
+                                      apr_ssize_t klen);
+
+/**
+ * Look up the value associated with a key in a flat hash table, or if none
+ * exists associate a value.
+ * @param ht The hash table
+ * @param key Pointer to the key
+ * @param klen Length of the key. Can be APR_HASH_KEY_STRING to use the string
+ *        length.
+ * @param val Value to associate with the key (if none exists).
+ * @return Returns the existing value if any, the given value otherwise.
+ * @remark If the given value is NULL and a hash entry exists, nothing is done.
+ */
+APR_DECLARE(void *) apr_hash_flat_get_or_set(apr_hash_flat_t *ht,
+                                             const void *key,
+                                             apr_ssize_t klen,
+                                             const void *val);
+
+/**
+ * Start iterating over the entries in a flat hash table.
+ * @param p The pool to allocate the apr_hash_flat_index_t iterator. If this
+ *          pool is NULL, then an internal, non-thread-safe iterator is used.
+ * @param ht The hash table
+ * @return The iteration state
+ * @remark The current entry can be deleted during an iteration, while
+ * adding entries may grow the table and cause the iteration to skip or
+ * repeat entries.
+ */
+APR_DECLARE(apr_hash_flat_index_t *) apr_hash_flat_first(apr_pool_t *p,
+                                                         apr_hash_flat_t *ht);
+
+/**
+ * Continue iterating over the entries in a flat hash table.
+ * @param hi The iteration state
+ * @return a pointer to the updated iteration state.  NULL if there are no more
+ *         entries.
+ */
+APR_DECLARE(apr_hash_flat_index_t *) apr_hash_flat_next(
+                                                   apr_hash_flat_index_t *hi);
+
+/**
+ * Get the current entry's details from the iteration state.
+ * @param hi The iteration state
+ * @param key Return pointer for the pointer to the key.
+ * @param klen Return pointer for the key length.
+ * @param val Return pointer for the associated value.
+ * @remark The return pointers should point to a variable that will be set to the
+ *         corresponding data, or they may be NULL if the data isn't interesting.
+ */
+APR_DECLARE(void) apr_hash_flat_this(apr_hash_flat_index_t *hi,
+                                     const void **key,
+                                     apr_ssize_t *klen, void **val);
+
+/**
+ * Get the current entry's key from the iteration state.
+ * @param hi The iteration state
+ * @return The pointer to the key
+ */
+APR_DECLARE(const void*) apr_hash_flat_this_key(apr_hash_flat_index_t *hi);
+
+/**
+ * Get the current entry's key length from the iteration state.
+ * @param hi The iteration state
+ * @return The key length
+ */
+APR_DECLARE(apr_ssize_t) apr_hash_flat_this_key_len(apr_hash_flat_index_t *hi);
+
+/**
+ * Get the current entry's value from the iteration state.
+ * @param hi The iteration state
+ * @return The pointer to the value
+ */
+APR_DECLARE(void*) apr_hash_flat_this_val(apr_hash_flat_index_t *hi);
+
+/**
+ * Get the number of key/value pairs in the flat hash table.
+ * @param ht The hash table
+ * @return The number of key/value pairs in the hash table.
+ */
+APR_DECLARE(unsigned int) apr_hash_flat_count(apr_hash_flat_t *ht);
+
+/**
+ * Clear any key/value pairs in the flat hash table.
+ * @param ht The hash table
+ * @remark The capacity of the table is kept.
+ */
+APR_DECLARE(void) apr_hash_flat_clear(apr_hash_flat_t *ht);
+
+/**
+ * Iterate over a flat hash table running the provided function once for
+ * every element in the hash table.
+ *
+ * @param comp The function to run
+ * @param rec The data to pass as the first argument to the function
+ * @param ht The hash table to iterate over
+ * @return FALSE if one of the comp() iterations returned zero; TRUE if all
+ *            iterations returned non-zero
+ * @see apr_hash_do_callback_fn_t
+ */
+APR_DECLARE(int) apr_hash_flat_do(apr_hash_do_callback_fn_t *comp,
+                                  void *rec, const apr_hash_flat_t *ht);
+
+/**
+ * Get a pointer to the pool which the flat hash table was created in
+ */
+APR_POOL_DECLARE_ACCESSOR(hash_flat);
+
+/** @} */
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,313 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef APR_IOQUEUE_H
+#define APR_IOQUEUE_H
+
+/**
+ * @file apr_ioqueue.h
+ * @brief APR Asynchronous I/O Completion Queue
+ */
+
+#include "apr.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_network_io.h"
+#include "apr_file_io.h"
+#include "apr_time.h"
+
+#define APR_WANT_IOVEC
+#include "apr_want.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif /* __cplusplus */
+
+/**
+ * @defgroup apr_ioqueue Asynchronous I/O Completion Queue
+ * @ingroup APR
+ *
+ * An apr_ioqueue_t runs socket and file operations asynchronously: an
+ * operation is submitted with the caller's buffer and a baton, and its
+ * result is returned later by apr_ioqueue_reap(), once the data have
+ * been transferred.  Unlike with apr_pollset_t, there is no readiness
+ * notification to wait for before doing the I/O.
+ *
+ * The buffers (and iovecs) given to the submit functions must remain
+ * valid and untouched until the completion of the operation is reaped.
+ * The socket timeouts do not apply, an operation completes when the
+ * data have been transferred or an error occurred.
+ *
+ * An apr_ioqueue_t is not thread-safe, it should be used by one thread
+ * at a time.
+ * @{
+ */
+
+/** Opaque structure used for the I/O completion queue API */
+typedef struct apr_ioqueue_t apr_ioqueue_t;
+
+/**
+ * Don't fall back to the default method if the method given to
+ * apr_ioqueue_create_ex() is not available.
+ */
+#define APR_IOQUEUE_NODEFAULT     0x001
+
+/** The I/O completion queue methods */
+typedef enum {
+    APR_IOQUEUE_DEFAULT,        /**< Platform default method */
+    APR_IOQUEUE_IOURING,        /**< Linux io_uring method */
+    APR_IOQUEUE_THREAD          /**< Blocking calls run by a thread pool */
+} apr_ioqueue_method_e;
+
+/** The operations of an I/O completion queue */
+typedef enum {
+    APR_IOQUEUE_RECV,           /**< apr_ioqueue_submit_recv() */
+    APR_IOQUEUE_SEND,           /**< apr_ioqueue_submit_send() */
+    APR_IOQUEUE_SENDV,          /**< apr_ioqueue_submit_sendv() */
+    APR_IOQUEUE_READ,           /**< apr_ioqueue_submit_read() */
+    APR_IOQUEUE_WRITE,          /**< apr_ioqueue_submit_write() */
+    APR_IOQUEUE_ACCEPT          /**< apr_ioqueue_submit_accept() */
+} apr_ioqueue_op_e;
+
+/** The completion of an operation, as returned by apr_ioqueue_reap() */
+typedef struct apr_ioqueue_completion_t {
+    /** The operation which completed */
+    apr_ioqueue_op_e op;
+    /** APR_SUCCESS, APR_EOF when receiving or reading at the end of the
+     * stream or file, or the error */
+    apr_status_t status;
+    /** The number of bytes transferred */
+    apr_size_t len;
+    /** The socket accepted, for APR_IOQUEUE_ACCEPT */
+    apr_socket_t *accepted;
+    /** The baton given to the submit function */
+    void *baton;
+} apr_ioqueue_completion_t;
+
+/**
+ * Create an I/O completion queue object, using the platform's default
+ * method
+ * @param ioqueue The pointer in which to return the newly created object
+ * @param size The maximum number of operations in flight
+ * @param p The pool from which to allocate the queue
+ * @param flags Optional flags, currently none (0)
+ * @return APR_SUCCESS, or APR_ENOTIMPL if no method is available on this
+ *         platform
+ * @remark The default method is io_uring on Linux when the kernel
+ *         supports it (5.11 and later), and the thread pool emulation
+ *         otherwise.
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_create(apr_ioqueue_t **ioqueue,
+                                             apr_uint32_t size,
+                                             apr_pool_t *p,
+                                             apr_uint32_t flags);
+
+/**
+ * Create an I/O completion queue object, using the given method
+ * @param ioqueue The pointer in which to return the newly created object
+ * @param size The maximum number of operations in flight
+ * @param p The pool from which to allocate the queue
+ * @param flags Optional flags to modify the operation of the queue,
+ *        APR_IOQUEUE_NODEFAULT to fail rather than fall back to the
+ *        default method
+ * @param method Requested method
+ * @return APR_SUCCESS, or APR_ENOTIMPL if the method (and the default
+ *         one with APR_IOQUEUE_NODEFAULT) is not available
+ * @remark With APR_IOQUEUE_IOURING, the operations are queued in the
+ *         submission ring and submitted by the same system call which
+ *         waits for the completions, in apr_ioqueue_reap(), unless
+ *         apr_ioqueue_flush() is called before.  The I/O itself is done
+ *         by the kernel, without a readiness round trip.  Destroying the
+ *         queue may interrupt the next blocking call of the thread which
+ *         used it (with APR_EINTR), as the kernel signals it to release
+ *         the io_uring instance.
+ * @remark With APR_IOQUEUE_THREAD, each operation is run by a thread of
+ *         a pool (of size threads) with the blocking socket and file
+ *         functions, and its completion is queued for the next
+ *         apr_ioqueue_reap().  Reads and writes at an offset on the
+ *         same file are serialized.
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_create_ex(apr_ioqueue_t **ioqueue,
+                                                apr_uint32_t size,
+                                                apr_pool_t *p,
+                                                apr_uint32_t flags,
+                                                apr_ioqueue_method_e method);
+
+/**
+ * Destroy an I/O completion queue object
+ * @param ioqueue The queue to destroy
+ * @remark The operations in flight are cancelled and waited for with
+ *         io_uring, but the thread pool emulation can only wait for them
+ *         to complete, so their sockets should be shut down first.
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_destroy(apr_ioqueue_t *ioqueue);
+
+/**
+ * Receive data from a socket, asynchronously
+ * @param ioqueue The queue
+ * @param sock The socket to receive from
+ * @param buf The buffer for the data
+ * @param len The size of the buffer
+ * @param baton The baton returned with the completion
+ * @return APR_SUCCESS, or APR_EAGAIN if the maximum number of operations
+ *         are in flight already
+ * @remark Like apr_socket_recv(), the completion has status APR_EOF and
+ *         len 0 when the peer closed the connection.
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_recv(apr_ioqueue_t *ioqueue,
+                                                  apr_socket_t *sock,
+                                                  char *buf, apr_size_t len,
+                                                  void *baton);
+
+/**
+ * Send data over a socket, asynchronously
+ * @param ioqueue The queue
+ * @param sock The socket to send over
+ * @param buf The data to send
+ * @param len The length of the data
+ * @param baton The baton returned with the completion
+ * @return APR_SUCCESS, or APR_EAGAIN if the maximum number of operations
+ *         are in flight already
+ * @remark Like apr_socket_send(), the completion may report less bytes
+ *         sent than len.
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_send(apr_ioqueue_t *ioqueue,
+                                                  apr_socket_t *sock,
+                                                  const char *buf,
+                                                  apr_size_t len,
+                                                  void *baton);
+
+/**
+ * Send multiple buffers over a socket, asynchronously
+ * @param ioqueue The queue
+ * @param sock The socket to send over
+ * @param vec The array of iovec structs, as filled by apr_brigade_to_iovec()
+ *        for instance
+ * @param nvec The number of iovec structs in the array
+ * @param baton The baton returned with the completion
+ * @return APR_SUCCESS, or APR_EAGAIN if the maximum number of operations
+ *         are in flight already
+ * @remark Like apr_socket_sendv(), the completion may report less bytes
+ *         sent than the total length of the buffers.
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_sendv(apr_ioqueue_t *ioqueue,
+                                                   apr_socket_t *sock,
+                                                   const struct iovec *vec,
+                                                   apr_int32_t nvec,
+                                                   void *baton);
+
+/**
+ * Read data from a file, asynchronously
+ * @param ioqueue The queue
+ * @param file The file to read from, not opened with APR_FOPEN_BUFFERED
+ * @param buf The buffer for the data
+ * @param len The size of the buffer
+ * @param offset The offset in the file to read from, or -1 to read from
+ *        the current position (and move it)
+ * @param baton The baton returned with the completion
+ * @return APR_SUCCESS, APR_EINVAL for a buffered file, or APR_EAGAIN if
+ *         the maximum number of operations are in flight already
+ * @remark Like apr_file_read(), the completion has status APR_EOF and
+ *         len 0 at the end of the file.
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_read(apr_ioqueue_t *ioqueue,
+                                                  apr_file_t *file,
+                                                  char *buf, apr_size_t len,
+                                                  apr_off_t offset,
+                                                  void *baton);
+
+/**
+ * Write data to a file, asynchronously
+ * @param ioqueue The queue
+ * @param file The file to write to, not opened with APR_FOPEN_BUFFERED
+ * @param buf The data to write
+ * @param len The length of the data
+ * @param offset The offset in the file to write at, or -1 to write at
+ *        the current position (and move it)
+ * @param baton The baton returned with the completion
+ * @return APR_SUCCESS, APR_EINVAL for a buffered file, or APR_EAGAIN if
+ *         the maximum number of operations are in flight already
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_write(apr_ioqueue_t *ioqueue,
+                                                   apr_file_t *file,
+                                                   const char *buf,
+                                                   apr_size_t len,
+                                                   apr_off_t offset,
+                                                   void *baton);
+
+/**
+ * Accept a connection on a listening socket, asynchronously
+ * @param ioqueue The queue
+ * @param sock The listening socket
+ * @param pool The pool for the accepted socket
+ * @param baton The baton returned with the completion
+ * @return APR_SUCCESS, or APR_EAGAIN if the maximum number of operations
+ *         are in flight already
+ * @remark The accepted socket is blocking (no timeout), as returned by
+ *         apr_os_sock_make().  With APR_IOQUEUE_THREAD, it is allocated
+ *         by another thread, so the pool should not be used until the
+ *         completion is reaped.
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_accept(apr_ioqueue_t *ioqueue,
+                                                    apr_socket_t *sock,
+                                                    apr_pool_t *pool,
+                                                    void *baton);
+
+/**
+ * Start the operations submitted, without waiting for their completion
+ * @param ioqueue The queue
+ * @remark The operations are started by apr_ioqueue_reap() otherwise.
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_flush(apr_ioqueue_t *ioqueue);
+
+/**
+ * Start the operations submitted and return the completed ones
+ * @param ioqueue The queue
+ * @param timeout The amount of time in microseconds to wait for at least
+ *        one completion.  This is a maximum, not a minimum.  If a
+ *        completion is available already, this will return immediately.
+ *        A negative value means to wait until one is.
+ * @param completions The array where to return the completions
+ * @param max The size of the array
+ * @param num Number of completions returned
+ * @return APR_SUCCESS, or APR_TIMEUP if no operation completed within
+ *         the timeout
+ */
+APR_DECLARE(apr_status_t) apr_ioqueue_reap(apr_ioqueue_t *ioqueue,
+                                           apr_interval_time_t timeout,
+                                           apr_ioqueue_completion_t *completions,
+                                           apr_int32_t max,
+                                           apr_int32_t *num);
+
+/**
+ * Return the number of operations submitted and not reaped yet
+ * @param ioqueue The queue
+ */
+APR_DECLARE(apr_uint32_t) apr_ioqueue_pending(apr_ioqueue_t *ioqueue);
+
+/**
+ * Return a printable representation of the method used by the queue
+ * @param ioqueue The queue
+ */
+APR_DECLARE(const char *) apr_ioqueue_method_name(apr_ioqueue_t *ioqueue);
+
+/** @} */
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif  /* ! APR_IOQUEUE_H */
@@ -101,10 +101,19 @@ typedef apr_memcache_server_t* (*apr_memcache_server_func)(void *baton,
                                                  apr_memcache_t *mc,
                                                  const apr_uint32_t hash);
 
+/**
+ * Speak the meta protocol of memcached 1.6 and later (mg, ms, md, ma and
+ * mn commands) rather than the text protocol.  Multiple gets and
+ * pipelines then tag their requests with opaque tokens and have the
+ * servers skip the replies of misses and successful stores, and CAS,
+ * touch and apr_memcache_getb() become available.
+ */
+#define APR_MEMCACHE_META 0x01
+
 /** Container for a set of memcached servers */
 struct apr_memcache_t
 {
-    apr_uint32_t flags; /**< Flags, Not currently used */
+    apr_uint32_t flags; /**< Flags, @see APR_MEMCACHE_META */
     apr_uint16_t nalloc; /**< Number of Servers Allocated */
     apr_uint16_t ntotal; /**< Number of Servers Added */
     apr_memcache_server_t **live_servers; /**< Array of Servers */
@@ -125,6 +134,7 @@ typedef struct
     apr_size_t len;
     char *data;
     apr_uint16_t flags;
+    apr_uint64_t cas; /**< CAS unique of the data, with APR_MEMCACHE_META */
 } apr_memcache_value_t;
 
 /**
@@ -171,6 +181,60 @@ apr_memcache_find_server_hash_default(void *baton,
                                       apr_memcache_t *mc,
                                       const apr_uint32_t hash);
 
+/**
+ * Default number of points per server (and unit of weight) on the
+ * consistent hashing ring.
+ */
+#define APR_MEMCACHE_KETAMA_POINTS 160
+
+/** Opaque consistent hashing (ketama) ring of servers */
+typedef struct apr_memcache_ketama_t apr_memcache_ketama_t;
+
+/**
+ * Build a consistent hashing (ketama) ring from the servers of a client
+ * object, for apr_memcache_find_server_hash_ketama().
+ * @param ring The new ring
+ * @param mc The memcache client object to use
+ * @param weights The weight of each server, in the order they were added
+ *        (0 to leave one out), or NULL for the same weight
+ * @param points The number of points per server and unit of weight on the
+ *        ring (rounded up to a multiple of 4), or 0 for
+ *        APR_MEMCACHE_KETAMA_POINTS
+ * @param p Pool to allocate the ring from
+ * @remark Adding or removing a server only moves the keys between it and
+ * the others, rather than almost all of them with the default selection.
+ * To use the ring, set mc->hash_func to apr_memcache_hash_ketama,
+ * mc->server_func to apr_memcache_find_server_hash_ketama and
+ * mc->server_baton to the ring.  The points and the hashes of the keys are
+ * computed like libketama, from the "host:port" of the servers.
+ * @warning The ring must be rebuilt (and the baton replaced) when servers
+ * are added, which is not thread safe either.
+ */
+APR_DECLARE(apr_status_t) apr_memcache_ketama_create(apr_memcache_ketama_t **ring,
+                                                     apr_memcache_t *mc,
+                                                     const apr_uint32_t *weights,
+                                                     apr_uint32_t points,
+                                                     apr_pool_t *p);
+
+/**
+ * hash compatible with libketama, for the consistent hashing ring
+ * (the first 32 bits of the MD5 of the key).
+ */
+APR_DECLARE(apr_uint32_t) apr_memcache_hash_ketama(void *baton,
+                                                   const char *data,
+                                                   const apr_size_t data_len);
+
+/**
+ * server selection on the consistent hashing ring given as baton, see
+ * apr_memcache_ketama_create().  The server of the first point at or after
+ * the hash is selected, or if it is dead the server of the next points on
+ * the ring.
+ */
+APR_DECLARE(apr_memcache_server_t *)
+apr_memcache_find_server_hash_ketama(void *baton,
+                                     apr_memcache_t *mc,
+                                     const apr_uint32_t hash);
+
 /**
  * Adds a server to a client object
  * @param mc The memcache client object to use
@@ -252,11 +316,38 @@ APR_DECLARE(apr_status_t) apr_memcache_server_create(apr_pool_t *p,
                                                      int max,
                                                      apr_interval_time_t ttl,
                                                      apr_memcache_server_t **ns);
+
+/**
+ * Creates a new Server Object, with a sharded connection list
+ * @param p Pool to use
+ * @param host hostname of the server
+ * @param port port of the server
+ * @param min  minimum number of client sockets to open
+ * @param smax soft maximum number of client connections to open
+ * @param max  hard maximum number of client connections
+ * @param ttl  time to live in microseconds of a client connection
+ * @param shards number of shards of the connection list, or 1
+ * @param flags APR_RESLIST_* creation flags of the connection list
+ * @param ns   location of the new server object
+ * @see apr_reslist_create_sharded
+ * @remark min, smax, and max are only used when APR_HAS_THREADS, and are
+ *         split between the shards
+ */
+APR_DECLARE(apr_status_t) apr_memcache_server_create_ex(apr_pool_t *p,
+                                                        const char *host,
+                                                        apr_port_t port,
+                                                        int min,
+                                                        int smax,
+                                                        int max,
+                                                        apr_interval_time_t ttl,
+                                                        int shards,
+                                                        apr_uint32_t flags,
+                                                        apr_memcache_server_t **ns);
 /**
  * Creates a new memcached client object
  * @param p Pool to use
  * @param max_servers maximum number of servers
- * @param flags Not currently used
+ * @param flags APR_MEMCACHE_META to speak the meta protocol, or 0
  * @param mc   location of the new memcache client object
  */
 APR_DECLARE(apr_status_t) apr_memcache_create(apr_pool_t *p,
@@ -282,6 +373,27 @@ APR_DECLARE(apr_status_t) apr_memcache_getp(apr_memcache_t *mc,
                                             apr_uint16_t *flags);
 
 
+/**
+ * Gets a value from the server into a brigade, as it was read from the
+ * connection, without copying it
+ * @param mc client to use
+ * @param key null terminated string containing the key
+ * @param bb brigade to append the value to, whose bucket allocator reads
+ *        it from the connection
+ * @param len location of the length of the value, or NULL
+ * @param flags location of the flags set by the client for this key, or
+ *        NULL
+ * @param cas location of the CAS unique of the value, or NULL
+ * @return APR_SUCCESS, APR_NOTFOUND if the key was not found, or
+ *         APR_ENOTIMPL without APR_MEMCACHE_META
+ */
+APR_DECLARE(apr_status_t) apr_memcache_getb(apr_memcache_t *mc,
+                                            const char *key,
+                                            apr_bucket_brigade *bb,
+                                            apr_size_t *len,
+                                            apr_uint16_t *flags,
+                                            apr_uint64_t *cas);
+
 /**
  * Add a key to a hash for a multiget query
  *  if the hash (*value) is NULL it will be created
@@ -309,6 +421,102 @@ APR_DECLARE(apr_status_t) apr_memcache_multgetp(apr_memcache_t *mc,
                                                 apr_pool_t *data_pool,
                                                 apr_hash_t *values);
 
+/** Opaque pipeline of operations, sent together to the servers */
+typedef struct apr_memcache_pipeline_t apr_memcache_pipeline_t;
+
+/* Pipeline callback function prototype, called as each reply arrives.
+* @param baton user selected baton
+* @param value the operation's key and status, and the data and flags of
+*        a value found by a get
+*/
+typedef void (*apr_memcache_pipeline_func)(void *baton,
+                                           apr_memcache_value_t *value);
+
+/**
+ * Create a pipeline, which queues get, set and delete operations without
+ * waiting for the replies, then sends them all at once with one write per
+ * server and reads the replies of all the servers through one pollset.
+ * @param pipeline location of the new pipeline
+ * @param mc client to use
+ * @param func optional callback for each reply, or NULL
+ * @param baton user selected baton passed to @a func
+ * @param p pool to allocate the pipeline, the results and their data from
+ * @remark A pipeline is used by one thread at a time, and can be reused
+ * after apr_memcache_pipeline_run() which leaves it empty.
+ */
+APR_DECLARE(apr_status_t) apr_memcache_pipeline_create(
+                                        apr_memcache_pipeline_t **pipeline,
+                                        apr_memcache_t *mc,
+                                        apr_memcache_pipeline_func func,
+                                        void *baton,
+                                        apr_pool_t *p);
+
+/**
+ * Queue getting a value
+ * @param pipeline pipeline to queue to
+ * @param key null terminated string containing the key
+ * @param value optional location of the result, filled in by
+ *        apr_memcache_pipeline_run() with a status of APR_SUCCESS and the
+ *        data and flags if the key was found, or APR_NOTFOUND
+ * @return APR_SUCCESS, or APR_NOTFOUND if there is no server for the key
+ */
+APR_DECLARE(apr_status_t) apr_memcache_pipeline_get(
+                                        apr_memcache_pipeline_t *pipeline,
+                                        const char *key,
+                                        apr_memcache_value_t **value);
+
+/**
+ * Queue setting a value
+ * @param pipeline pipeline to queue to
+ * @param key null terminated string containing the key
+ * @param baton data to store on the server, which must stay valid until
+ *        apr_memcache_pipeline_run() returns
+ * @param data_size length of data at baton
+ * @param timeout time in seconds for the data to live on the server
+ * @param flags any flags set by the client for this key
+ * @param value optional location of the result, with a status of
+ *        APR_SUCCESS or APR_EEXIST if the server did not store the value
+ * @return APR_SUCCESS, or APR_NOTFOUND if there is no server for the key
+ */
+APR_DECLARE(apr_status_t) apr_memcache_pipeline_set(
+                                        apr_memcache_pipeline_t *pipeline,
+                                        const char *key,
+                                        char *baton,
+                                        const apr_size_t data_size,
+                                        apr_uint32_t timeout,
+                                        apr_uint16_t flags,
+                                        apr_memcache_value_t **value);
+
+/**
+ * Queue deleting a key
+ * @param pipeline pipeline to queue to
+ * @param key null terminated string containing the key
+ * @param value optional location of the result, with a status of
+ *        APR_SUCCESS or APR_NOTFOUND if the key did not exist
+ * @return APR_SUCCESS, or APR_NOTFOUND if there is no server for the key
+ */
+APR_DECLARE(apr_status_t) apr_memcache_pipeline_delete(
+                                        apr_memcache_pipeline_t *pipeline,
+                                        const char *key,
+                                        apr_memcache_value_t **value);
+
+/**
+ * Send the queued operations to all their servers at once, and read the
+ * replies as they arrive, filling in the results and calling the
+ * pipeline's callback for each.
+ * @param pipeline pipeline to run
+ * @param timeout time to wait for a server to be ready to read or write
+ *        before giving up on it, or -1 to wait forever
+ * @return APR_SUCCESS if all the servers replied, otherwise the error of
+ *         the last server which failed, whose operations also have it
+ *         as their status
+ * @remark The operations of a server are sent to it in the order they
+ * were queued, but there is no ordering between servers.
+ */
+APR_DECLARE(apr_status_t) apr_memcache_pipeline_run(
+                                        apr_memcache_pipeline_t *pipeline,
+                                        apr_interval_time_t timeout);
+
 /**
  * Sets a value by key on the server
  * @param mc client to use
@@ -360,6 +568,39 @@ APR_DECLARE(apr_status_t) apr_memcache_replace(apr_memcache_t *mc,
                                                const apr_size_t data_size,
                                                apr_uint32_t timeout,
                                                apr_uint16_t flags);
+/**
+ * Sets a value by key on the server, if it was not changed since read
+ * @param mc client to use
+ * @param key   null terminated string containing the key
+ * @param baton data to store on the server
+ * @param data_size   length of data at baton
+ * @param timeout time in seconds for the data to live on the server
+ * @param flags any flags set by the client for this key
+ * @param cas the CAS unique of the value when it was read
+ * @return APR_SUCCESS if the value was set, APR_EEXIST if it changed
+ * since, APR_NOTFOUND if it does not exist anymore, or APR_ENOTIMPL
+ * without APR_MEMCACHE_META
+ */
+APR_DECLARE(apr_status_t) apr_memcache_cas(apr_memcache_t *mc,
+                                           const char *key,
+                                           char *baton,
+                                           const apr_size_t data_size,
+                                           apr_uint32_t timeout,
+                                           apr_uint16_t flags,
+                                           apr_uint64_t cas);
+
+/**
+ * Updates the time to live of a key on the server, without getting it
+ * @param mc client to use
+ * @param key   null terminated string containing the key
+ * @param timeout new time in seconds for the data to live on the server
+ * @return APR_SUCCESS, APR_NOTFOUND if the key was not found, or
+ *         APR_ENOTIMPL without APR_MEMCACHE_META
+ */
+APR_DECLARE(apr_status_t) apr_memcache_touch(apr_memcache_t *mc,
+                                             const char *key,
+                                             apr_uint32_t timeout);
+
 /**
  * Deletes a key from a server
  * @param mc client to use
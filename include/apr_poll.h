@@ -53,6 +53,10 @@ extern "C" {
 #define APR_POLLHUP   0x020     /**< Hangup occurred */
 #define APR_POLLNVAL  0x040     /**< Descriptor invalid */
 #define APR_POLLEXCL  0x080     /**< Exclusive wake up */
+#define APR_POLLET    0x100     /**< Edge-triggered, reported when the
+                                 *   descriptor becomes ready only */
+#define APR_POLLONESHOT 0x200   /**< Reported once, until re-armed with
+                                 *   apr_pollset_rearm() or apr_pollcb_rearm() */
 /** @} */
 
 /**
@@ -85,7 +89,8 @@ typedef enum {
     APR_POLLSET_PORT,           /**< Poll uses Solaris event port method */
     APR_POLLSET_EPOLL,          /**< Poll uses epoll method */
     APR_POLLSET_POLL,           /**< Poll uses poll method */
-    APR_POLLSET_AIO_MSGQ        /**< Poll uses z/OS asio method */
+    APR_POLLSET_AIO_MSGQ,       /**< Poll uses z/OS asio method */
+    APR_POLLSET_IOURING         /**< Poll uses Linux io_uring method */
 } apr_pollset_method_e;
 
 /** Used in apr_pollfd_t to determine what the apr_descriptor is */
@@ -188,6 +193,20 @@ APR_DECLARE(apr_status_t) apr_pollset_create(apr_pollset_t **pollset,
  *         the size parameter controls the maximum number of
  *         descriptors that will be returned by a single call to
  *         apr_pollset_poll().
+ * @remark With APR_POLLSET_IOURING, the descriptors are watched by poll
+ *         requests of an io_uring instance.  The requests for the
+ *         descriptors added or returned since the previous
+ *         apr_pollset_poll() are submitted by the same system call which
+ *         waits for the next events, so apr_pollset_add() doesn't cost
+ *         one (unless the pollset is APR_POLLSET_THREADSAFE).  The events
+ *         are level-triggered like with the other methods.  Since the
+ *         poll requests hold a reference to the descriptors, they must be
+ *         removed from the pollset (or the pollset destroyed) for closing
+ *         them to take effect.  Destroying the pollset may interrupt
+ *         the next blocking poll of the thread which used it (with
+ *         APR_EINTR), as the kernel signals it to release the io_uring
+ *         instance.  If the kernel does not support io_uring (or has it
+ *         disabled), the default method is used.
  */
 APR_DECLARE(apr_status_t) apr_pollset_create_ex(apr_pollset_t **pollset,
                                                 apr_uint32_t size,
@@ -226,10 +245,44 @@ APR_DECLARE(apr_status_t) apr_pollset_destroy(apr_pollset_t *pollset);
  *         for a descriptor change, you must first remove the descriptor
  *         from the pollset with apr_pollset_remove(), then add it again
  *         specifying all requested events.
+ * @remark By default the events are level-triggered: a descriptor is
+ *         returned by each apr_pollset_poll() as long as it is ready.
+ *         With APR_POLLET in reqevents, it is returned once each time it
+ *         becomes ready, so the caller must consume everything available
+ *         (until APR_EAGAIN) to be notified again.  With APR_POLLONESHOT,
+ *         it is returned once and then disabled until apr_pollset_rearm(),
+ *         which lets a thread hand it over to another one without removing
+ *         it from a pollset polled by several threads.  APR_POLLET is
+ *         supported by the APR_POLLSET_EPOLL and APR_POLLSET_KQUEUE
+ *         methods, APR_POLLONESHOT also by APR_POLLSET_IOURING and
+ *         APR_POLLSET_POLL, otherwise APR_ENOTIMPL is returned.
+ * @remark With APR_POLLEXCL in reqevents, when the descriptor is added to
+ *         several pollsets (polled by different threads, e.g. a listening
+ *         socket), only one of them is woken up by an event instead of all
+ *         of them (the thundering herd).  It is only honoured by the
+ *         APR_POLLSET_EPOLL method (Linux 4.5 and later), and ignored
+ *         otherwise.  It can't be combined with APR_POLLONESHOT, and the
+ *         descriptor can't be re-armed.
  */
 APR_DECLARE(apr_status_t) apr_pollset_add(apr_pollset_t *pollset,
                                           const apr_pollfd_t *descriptor);
 
+/**
+ * Re-arm a descriptor added to a pollset with APR_POLLONESHOT
+ * @param pollset The pollset to which the descriptor was added
+ * @param descriptor The descriptor to re-arm
+ * @remark The descriptor is watched again for the events requested in
+ *         its reqevents field (which must include APR_POLLONESHOT for it
+ *         to be disabled again once returned).  The client_data is updated
+ *         too, unless the pollset was created with APR_POLLSET_NOCOPY, in
+ *         which case the descriptor added must be passed.
+ * @remark If the descriptor is not found, APR_NOTFOUND is returned.
+ * @remark If the pollset method does not support APR_POLLONESHOT,
+ *         APR_ENOTIMPL is returned.
+ */
+APR_DECLARE(apr_status_t) apr_pollset_rearm(apr_pollset_t *pollset,
+                                            const apr_pollfd_t *descriptor);
+
 /**
  * Remove a descriptor from a pollset
  * @param pollset The pollset from which to remove the descriptor
@@ -274,6 +327,32 @@ APR_DECLARE(apr_status_t) apr_pollset_poll(apr_pollset_t *pollset,
                                            apr_int32_t *num,
                                            const apr_pollfd_t **descriptors);
 
+/**
+ * Block for activity on the descriptor(s) in a pollset, returning pointers
+ * to the descriptors in the pollset rather than copies
+ * @param pollset The pollset to use
+ * @param timeout The amount of time in microseconds to wait, like for
+ *                apr_pollset_poll()
+ * @param num Number of signalled descriptors (output parameter)
+ * @param descriptors Array of pointers to the signalled descriptors
+ *                    (output parameter)
+ * @remark The descriptors pointed to are the pollset's copies of the ones
+ *         added (or the ones added themselves with APR_POLLSET_NOCOPY),
+ *         with their rtnevents field set, so nothing is copied for each
+ *         event.  They remain valid until the next call to
+ *         apr_pollset_poll() or apr_pollset_poll_ptrs() on the pollset,
+ *         even if they are removed from the pollset meanwhile, and not
+ *         beyond.
+ * @remark With methods which copy the descriptors returned anyway, the
+ *         pointers are to the copies, so the result is the same as with
+ *         apr_pollset_poll().
+ * @remark The return values are the ones of apr_pollset_poll().
+ */
+APR_DECLARE(apr_status_t) apr_pollset_poll_ptrs(apr_pollset_t *pollset,
+                                              apr_interval_time_t timeout,
+                                              apr_int32_t *num,
+                                              const apr_pollfd_t *const **descriptors);
+
 /**
  * Interrupt the blocked apr_pollset_poll() call.
  * @param pollset The pollset to use
@@ -375,9 +454,25 @@ APR_DECLARE(apr_status_t) apr_pollcb_create_ex(apr_pollcb_t **pollcb,
  *         for a descriptor change, you must first remove the descriptor
  *         from the pollcb with apr_pollcb_remove(), then add it again
  *         specifying all requested events.
+ * @remark APR_POLLET, APR_POLLONESHOT and APR_POLLEXCL are supported like
+ *         with apr_pollset_add(), see there.
  */
 APR_DECLARE(apr_status_t) apr_pollcb_add(apr_pollcb_t *pollcb,
                                          apr_pollfd_t *descriptor);
+
+/**
+ * Re-arm a descriptor added to a pollcb with APR_POLLONESHOT
+ * @param pollcb The pollcb to which the descriptor was added
+ * @param descriptor The descriptor to re-arm, the one added
+ * @remark The descriptor is watched again for the events requested in
+ *         its reqevents field (which must include APR_POLLONESHOT for it
+ *         to be disabled again once returned).
+ * @remark If the descriptor is not found, APR_NOTFOUND is returned.
+ * @remark If the pollcb method does not support APR_POLLONESHOT,
+ *         APR_ENOTIMPL is returned.
+ */
+APR_DECLARE(apr_status_t) apr_pollcb_rearm(apr_pollcb_t *pollcb,
+                                           apr_pollfd_t *descriptor);
 /**
  * Remove a descriptor from a pollcb
  * @param pollcb The pollcb from which to remove the descriptor
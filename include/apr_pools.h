@@ -198,6 +198,40 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
                                              apr_allocator_t *allocator)
                           __attribute__((nonnull(1)));
 
+/**
+ * Flag for apr_pool_create_ex2(): make the pool recycle the (small)
+ * allocations given back by apr_pfree().
+ */
+#define APR_POOL_SLAB 0x1
+
+/**
+ * Create a new pool, with creation flags.
+ * @param newpool The pool we have just created.
+ * @param parent See apr_pool_create_ex().
+ * @param abort_fn See apr_pool_create_ex().
+ * @param allocator See apr_pool_create_ex().
+ * @param flags Zero or APR_POOL_SLAB.
+ * @remark With APR_POOL_SLAB, each allocation is sized up to a class
+ *         multiple of 16 bytes (up to 1024) and prefixed by a small header,
+ *         such that apr_pfree() can put it back to the free list of its
+ *         class to be reused by the next apr_palloc() of that class.  This
+ *         allows long-lived pools to churn small objects without growing,
+ *         and without the need of a subpool per object.
+ * @remark The flags are ignored when APR_POOL_DEBUG is defined.
+ */
+APR_DECLARE(apr_status_t) apr_pool_create_ex2(apr_pool_t **newpool,
+                                              apr_pool_t *parent,
+                                              apr_abortfunc_t abort_fn,
+                                              apr_allocator_t *allocator,
+                                              apr_uint32_t flags)
+                          __attribute__((nonnull(1)));
+
+#if APR_POOL_DEBUG
+#define apr_pool_create_ex2(newpool, parent, abort_fn, allocator, flags)  \
+    apr_pool_create_ex_debug(newpool, parent, abort_fn, allocator, \
+                             APR_POOL__FILE_LINE__)
+#endif
+
 /**
  * Create a new unmanaged pool.
  * @param newpool The pool we have just created.
@@ -425,6 +459,21 @@ APR_DECLARE(void *) apr_palloc_debug(apr_pool_t *p, apr_size_t size,
     apr_palloc_debug(p, size, APR_POOL__FILE_LINE__)
 #endif
 
+/**
+ * Give back a block of memory allocated from a pool
+ * @param p The pool the memory was allocated from
+ * @param mem The memory (may be NULL)
+ * @remark This is a noop unless the pool was created with APR_POOL_SLAB,
+ *         otherwise the memory is recycled for a later apr_palloc() of
+ *         the same size class (up to 1024 bytes).  In any case the memory
+ *         must not be used anymore after this call.
+ * @warning Only memory returned by apr_palloc() or apr_pcalloc() (or the
+ *         string functions using them, like apr_pstrdup()) can be given
+ *         back, not memory from apr_psprintf() or apr_pvsprintf().
+ */
+APR_DECLARE(void) apr_pfree(apr_pool_t *p, void *mem)
+                  __attribute__((nonnull(1)));
+
 /**
  * Allocate a block of memory from a pool and set all of the memory to 0
  * @param p The pool to allocate from
@@ -57,6 +57,33 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **queue,
                                            unsigned int queue_capacity,
                                            apr_pool_t *a);
 
+/**
+ * Flag for apr_queue_create_ex(): use a lock-free ring, only taking the
+ * queue's lock to wait when it is full or empty.
+ */
+#define APR_QUEUE_LOCKFREE 0x1
+
+/**
+ * create a FIFO queue, with creation flags
+ * @param queue The new queue
+ * @param queue_capacity maximum size of the queue
+ * @param flags Zero or APR_QUEUE_LOCKFREE.
+ * @param a pool to allocate queue from
+ * @returns APR_EINVAL if queue_capacity is 0 with APR_QUEUE_LOCKFREE
+ * @remark With APR_QUEUE_LOCKFREE, the elements are stored in a bounded
+ * multi-producer/multi-consumer ring whose slots carry a sequence number,
+ * so that the producers and consumers claim them with a compare-and-swap
+ * on apr_atomic rather than under the queue's lock.  The lock and the
+ * condition variables are only used by the threads which have to block
+ * because the queue is full or empty, and by those which wake them up.
+ * The semantics of all the functions below are unchanged, including
+ * apr_queue_interrupt_all() and apr_queue_term().
+ */
+APR_DECLARE(apr_status_t) apr_queue_create_ex(apr_queue_t **queue,
+                                              unsigned int queue_capacity,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *a);
+
 /**
  * push/add an object to the queue, blocking if the queue is already full
  *
@@ -135,6 +162,54 @@ APR_DECLARE(apr_status_t) apr_queue_timedpush(apr_queue_t *queue, void *data,
 APR_DECLARE(apr_status_t) apr_queue_timedpop(apr_queue_t *queue, void **data,
                                              apr_interval_time_t timeout);
 
+/**
+ * push/add several objects to the queue, as many as fit once it is not
+ * full, with a single lock acquisition and wakeup of the poppers
+ *
+ * @param queue the queue
+ * @param data the array of objects to push, in order
+ * @param nelts the number of objects in data, set on return to the number
+ * of objects pushed (the first ones of data, 0 on error)
+ * @param timeout the maximum time to wait for the queue not to be full in
+ * microseconds, a negative value to wait indefinitely or 0 not to wait
+ * @returns APR_EINTR the blocking operation was interrupted (try again)
+ * @returns APR_EAGAIN the queue is full and timeout is 0
+ * @returns APR_TIMEUP the queue is full and the timeout expired
+ * @returns APR_EOF the queue has been terminated
+ * @returns APR_SUCCESS if at least one object was pushed (or nelts is 0)
+ * @remark Like apr_queue_push(), apr_queue_trypush() or
+ * apr_queue_timedpush() (depending on timeout) for the first object, the
+ * others being pushed only while the queue is not full.
+ */
+APR_DECLARE(apr_status_t) apr_queue_push_batch(apr_queue_t *queue,
+                                               void **data,
+                                               unsigned int *nelts,
+                                               apr_interval_time_t timeout);
+
+/**
+ * pop/get several objects from the queue, as many as available once it is
+ * not empty, with a single lock acquisition and wakeup of the pushers
+ *
+ * @param queue the queue
+ * @param data the array where to store the objects popped, in order
+ * @param nelts the size of data, set on return to the number of objects
+ * popped (0 on error)
+ * @param timeout the maximum time to wait for the queue not to be empty in
+ * microseconds, a negative value to wait indefinitely or 0 not to wait
+ * @returns APR_EINTR the blocking operation was interrupted (try again)
+ * @returns APR_EAGAIN the queue is empty and timeout is 0
+ * @returns APR_TIMEUP the queue is empty and the timeout expired
+ * @returns APR_EOF the queue has been terminated
+ * @returns APR_SUCCESS if at least one object was popped (or nelts is 0)
+ * @remark Like apr_queue_pop(), apr_queue_trypop() or apr_queue_timedpop()
+ * (depending on timeout) for the first object, the others being popped
+ * only while the queue is not empty.
+ */
+APR_DECLARE(apr_status_t) apr_queue_pop_batch(apr_queue_t *queue,
+                                              void **data,
+                                              unsigned int *nelts,
+                                              apr_interval_time_t timeout);
+
 /**
  * returns the size of the queue.
  *
@@ -173,6 +173,56 @@ APR_DECLARE(apr_redis_server_t *) apr_redis_find_server_hash_default(void *baton
                                                                       apr_redis_t *rc,
                                                                       const apr_uint32_t hash);
 
+/**
+ * Default number of points per server (and unit of weight) on the
+ * consistent hashing ring.
+ */
+#define APR_REDIS_KETAMA_POINTS 160
+
+/** Opaque consistent hashing (ketama) ring of servers */
+typedef struct apr_redis_ketama_t apr_redis_ketama_t;
+
+/**
+ * Build a consistent hashing (ketama) ring from the servers of a client
+ * object, for apr_redis_find_server_hash_ketama().
+ * @param ring The new ring
+ * @param rc The redis client object to use
+ * @param weights The weight of each server, in the order they were added
+ *        (0 to leave one out), or NULL for the same weight
+ * @param points The number of points per server and unit of weight on the
+ *        ring (rounded up to a multiple of 4), or 0 for
+ *        APR_REDIS_KETAMA_POINTS
+ * @param p Pool to allocate the ring from
+ * @remark To use the ring, set rc->hash_func to apr_redis_hash_ketama,
+ * rc->server_func to apr_redis_find_server_hash_ketama and
+ * rc->server_baton to the ring.  See apr_memcache_ketama_create().
+ * @warning The ring must be rebuilt (and the baton replaced) when servers
+ * are added, which is not thread safe either.
+ */
+APR_DECLARE(apr_status_t) apr_redis_ketama_create(apr_redis_ketama_t **ring,
+                                                  apr_redis_t *rc,
+                                                  const apr_uint32_t *weights,
+                                                  apr_uint32_t points,
+                                                  apr_pool_t *p);
+
+/**
+ * hash compatible with libketama, for the consistent hashing ring
+ * (the first 32 bits of the MD5 of the key).
+ */
+APR_DECLARE(apr_uint32_t) apr_redis_hash_ketama(void *baton,
+                                                const char *data,
+                                                const apr_size_t data_len);
+
+/**
+ * server selection on the consistent hashing ring given as baton, see
+ * apr_redis_ketama_create().  The server of the first point at or after
+ * the hash is selected, or if it is dead the server of the next points on
+ * the ring.
+ */
+APR_DECLARE(apr_redis_server_t *) apr_redis_find_server_hash_ketama(void *baton,
+                                                                     apr_redis_t *rc,
+                                                                     const apr_uint32_t hash);
+
 /**
  * Adds a server to a client object
  * @param rc The redis client object to use
@@ -236,6 +286,35 @@ APR_DECLARE(apr_status_t) apr_redis_server_create(apr_pool_t *p,
                                                   apr_uint32_t ttl,
                                                   apr_uint32_t rwto,
                                                   apr_redis_server_t **ns);
+
+/**
+ * Creates a new Server Object, with a sharded connection list
+ * @param p Pool to use
+ * @param host hostname of the server
+ * @param port port of the server
+ * @param min  minimum number of client sockets to open
+ * @param smax soft maximum number of client connections to open
+ * @param max  hard maximum number of client connections
+ * @param ttl  time to live in microseconds of a client connection
+ * @param rwto r/w timeout value in seconds of a client connection
+ * @param shards number of shards of the connection list, or 1
+ * @param flags APR_RESLIST_* creation flags of the connection list
+ * @param ns   location of the new server object
+ * @see apr_reslist_create_sharded
+ * @remark min, smax, and max are only used when APR_HAS_THREADS, and are
+ *         split between the shards
+ */
+APR_DECLARE(apr_status_t) apr_redis_server_create_ex(apr_pool_t *p,
+                                                     const char *host,
+                                                     apr_port_t port,
+                                                     apr_uint32_t min,
+                                                     apr_uint32_t smax,
+                                                     apr_uint32_t max,
+                                                     apr_uint32_t ttl,
+                                                     apr_uint32_t rwto,
+                                                     int shards,
+                                                     apr_uint32_t flags,
+                                                     apr_redis_server_t **ns);
 /**
  * Creates a new redisd client object
  * @param p Pool to use
@@ -355,6 +434,27 @@ APR_DECLARE(apr_status_t) apr_redis_decr(apr_redis_t *rc,
  */
 APR_DECLARE(apr_status_t) apr_redis_ping(apr_redis_server_t *rs);
 
+/** Returned Data from a multiple get */
+typedef struct
+{
+    apr_status_t status;
+    const char* key;
+    apr_size_t len;
+    char *data;
+    apr_uint16_t flags;
+} apr_redis_value_t;
+
+/**
+ * Add a key to a hash for a multiget query
+ *  if the hash (*value) is NULL it will be created
+ * @param data_pool pool from where the hash and their items are created from
+ * @param key null terminated string containing the key
+ * @param values hash of keys and values that this key will be added to
+ */
+APR_DECLARE(void) apr_redis_add_multget_key(apr_pool_t *data_pool,
+                                            const char *key,
+                                            apr_hash_t **values);
+
 /**
  * Gets multiple values from the server, allocating the values out of p
  * @param rc client to use
@@ -364,12 +464,141 @@ APR_DECLARE(apr_status_t) apr_redis_ping(apr_redis_server_t *rs);
  * @param values hash of apr_redis_value_t keyed by strings, contains the
  *        result of the multiget call.
  * @return
+ * @remark The keys are grouped by server into one MGET each, sent to all
+ * the servers at once.
  */
 APR_DECLARE(apr_status_t) apr_redis_multgetp(apr_redis_t *rc,
                                              apr_pool_t *temp_pool,
                                              apr_pool_t *data_pool,
                                              apr_hash_t *values);
 
+/** Types of the replies of the servers, RESP3 adding the last ones */
+typedef enum
+{
+    APR_REDIS_REPLY_STATUS,  /**< Simple string, such as OK */
+    APR_REDIS_REPLY_ERROR,   /**< Simple or bulk error */
+    APR_REDIS_REPLY_INTEGER,
+    APR_REDIS_REPLY_STRING,  /**< Bulk or verbatim string */
+    APR_REDIS_REPLY_NIL,
+    APR_REDIS_REPLY_ARRAY,
+    APR_REDIS_REPLY_DOUBLE,  /**< As its string */
+    APR_REDIS_REPLY_BOOLEAN, /**< As an integer of 0 or 1 */
+    APR_REDIS_REPLY_BIGNUM,  /**< As its string */
+    APR_REDIS_REPLY_MAP,     /**< Keys and values alternating in elements */
+    APR_REDIS_REPLY_SET
+} apr_redis_reply_type_e;
+
+/** Reply to a pipelined command, or an element of one */
+typedef struct apr_redis_reply_t apr_redis_reply_t;
+struct apr_redis_reply_t
+{
+    /** Of the command: APR_SUCCESS once replied, APR_INCOMPLETE before, or
+     * the error of its server */
+    apr_status_t status;
+    apr_redis_reply_type_e type; /**< @see apr_redis_reply_type_e */
+    /** Null terminated string of statuses, errors, strings, doubles and
+     * big numbers, or NULL */
+    char *str;
+    apr_size_t len; /**< Length of str */
+    apr_int64_t integer; /**< Value of integers and booleans */
+    apr_size_t elements; /**< Number of elements of aggregates */
+    apr_redis_reply_t **element; /**< Elements of aggregates */
+};
+
+/** Opaque pipeline of commands, sent together to the servers */
+typedef struct apr_redis_pipeline_t apr_redis_pipeline_t;
+
+/* Pipeline callback function prototype, called as each reply arrives.
+* @param baton user selected baton
+* @param reply the reply, or the failure of the command with its status
+*/
+typedef void (*apr_redis_pipeline_func)(void *baton,
+                                        apr_redis_reply_t *reply);
+
+/**
+ * Create a pipeline, which queues commands without waiting for the
+ * replies, then sends them all at once with one write per server and
+ * reads the replies of all the servers through one pollset.
+ * @param pipeline location of the new pipeline
+ * @param rc client to use
+ * @param func optional callback for each reply, or NULL
+ * @param baton user selected baton passed to @a func
+ * @param p pool to allocate the pipeline and the replies from
+ * @remark A pipeline is used by one thread at a time, and can be reused
+ * after apr_redis_pipeline_run() which leaves it empty.
+ * @remark The replies are parsed from the data read as it arrives, bulk
+ * strings being left where they were read rather than copied.  Both RESP2
+ * and RESP3 (once negotiated with HELLO 3) are understood; RESP3
+ * attributes and out of band pushes are skipped.
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_create(
+                                        apr_redis_pipeline_t **pipeline,
+                                        apr_redis_t *rc,
+                                        apr_redis_pipeline_func func,
+                                        void *baton,
+                                        apr_pool_t *p);
+
+/**
+ * Queue a command
+ * @param pipeline pipeline to queue to
+ * @param key null terminated string of the key whose server the command
+ *        is sent to
+ * @param argc number of arguments, the command's name being the first
+ * @param argv arguments, which must stay valid until
+ *        apr_redis_pipeline_run() returns
+ * @param argvlen lengths of the arguments, or NULL for null terminated
+ *        strings
+ * @param reply optional location of the reply, filled in by
+ *        apr_redis_pipeline_run()
+ * @return APR_SUCCESS, or APR_NOTFOUND if there is no server for the key
+ * @remark A command changing the state of the connection, such as HELLO
+ * or SELECT, should be reverted in the same pipeline for the connection
+ * to be reused by the other functions.
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_command(
+                                        apr_redis_pipeline_t *pipeline,
+                                        const char *key,
+                                        int argc,
+                                        const char **argv,
+                                        const apr_size_t *argvlen,
+                                        apr_redis_reply_t **reply);
+
+/**
+ * Queue a command of null terminated strings
+ * @param pipeline pipeline to queue to
+ * @param key null terminated string of the key whose server the command
+ *        is sent to
+ * @param reply optional location of the reply, filled in by
+ *        apr_redis_pipeline_run()
+ * @param ... the command's name and arguments, followed by NULL
+ * @return APR_SUCCESS, or APR_NOTFOUND if there is no server for the key
+ */
+APR_DECLARE_NONSTD(apr_status_t) apr_redis_pipeline_commandv(
+                                        apr_redis_pipeline_t *pipeline,
+                                        const char *key,
+                                        apr_redis_reply_t **reply, ...)
+#if defined(__GNUC__) && __GNUC__ >= 4
+    __attribute__((sentinel))
+#endif
+    ;
+
+/**
+ * Send the queued commands to all their servers at once, and read the
+ * replies as they arrive, calling the pipeline's callback for each.
+ * @param pipeline pipeline to run
+ * @param timeout time to wait for a server to be ready to read or write
+ *        before giving up on it, or -1 to wait forever
+ * @return APR_SUCCESS if all the servers replied, otherwise the error of
+ *         the last server which failed, whose commands also have it as
+ *         their status
+ * @remark Error replies are successful replies of type
+ * APR_REDIS_REPLY_ERROR.  The commands of a server are sent to it in the
+ * order they were queued, but there is no ordering between servers.
+ */
+APR_DECLARE(apr_status_t) apr_redis_pipeline_run(
+                                        apr_redis_pipeline_t *pipeline,
+                                        apr_interval_time_t timeout);
+
 typedef enum
 {
     APR_RS_SERVER_MASTER, /**< Server is a master */
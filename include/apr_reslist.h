@@ -94,6 +94,92 @@ APR_DECLARE(apr_status_t) apr_reslist_create(apr_reslist_t **reslist,
                                              void *params,
                                              apr_pool_t *pool);
 
+/* Resource list creation flags */
+#define APR_RESLIST_LOCKFREE         0x1     /**< lock-free LIFO of idle resources */
+#define APR_RESLIST_SHARD_CPU        0x2     /**< pick shards by CPU, not thread */
+
+/**
+ * Create a new resource list, like apr_reslist_create() but with
+ * creation flags.
+ * @param reslist An address where the pointer to the new resource
+ *                list will be stored.
+ * @param min Allowed minimum number of available resources.
+ * @param smax Soft maximum on the total number of resources.
+ * @param hmax Absolute maximum limit on the number of total resources.
+ * @param ttl Maximum amount of time in microseconds an unused resource
+ *            is valid, or zero.
+ * @param con Constructor routine that is called to create a new resource.
+ * @param de Destructor routine that is called to destroy an expired resource.
+ * @param params Passed to constructor and deconstructor
+ * @param flags Bitmask of APR_RESLIST_* creation flags:
+ * <PRE>
+ *           APR_RESLIST_LOCKFREE   Keep the available resources on a
+ *                                  lock-free stack
+ * </PRE>
+ * @param pool The pool from which to create this resource list.
+ * @remark With APR_RESLIST_LOCKFREE, apr_reslist_acquire() pops the most
+ *         recently released resource and apr_reslist_release() pushes it
+ *         back without taking the list mutex; the mutex is only used to
+ *         construct, destroy and wait for resources. The acquire order is
+ *         always LIFO, so APR_RESLIST_ACQUIRE_FIFO gives APR_ENOTIMPL, and
+ *         hmax resource containers are allocated up front.
+ * @see apr_reslist_create
+ */
+APR_DECLARE(apr_status_t) apr_reslist_create_ex(apr_reslist_t **reslist,
+                                                int min, int smax, int hmax,
+                                                apr_interval_time_t ttl,
+                                                apr_reslist_constructor con,
+                                                apr_reslist_destructor de,
+                                                void *params,
+                                                apr_uint32_t flags,
+                                                apr_pool_t *pool);
+
+/**
+ * Create a new resource list split in shards, each serving its own
+ * subset of the threads, like apr_reslist_create_ex() otherwise.
+ * @param reslist An address where the pointer to the new resource
+ *                list will be stored.
+ * @param nshards The number of shards, at most hmax.
+ * @param min Allowed minimum number of available resources, in total.
+ * @param smax Soft maximum on the total number of resources.
+ * @param hmax Absolute maximum limit on the number of total resources.
+ * @param ttl Maximum amount of time in microseconds an unused resource
+ *            is valid, or zero.
+ * @param con Constructor routine that is called to create a new resource.
+ * @param de Destructor routine that is called to destroy an expired resource.
+ * @param params Passed to constructor and deconstructor
+ * @param flags Bitmask of APR_RESLIST_* creation flags:
+ * <PRE>
+ *           APR_RESLIST_LOCKFREE   Each shard keeps its available resources
+ *                                  on a lock-free stack
+ *           APR_RESLIST_SHARD_CPU  Threads use the shard of the CPU they
+ *                                  run on, rather than a shard of their own
+ * </PRE>
+ * @param pool The pool from which to create this resource list.
+ * @remark min, smax and hmax are split evenly between the shards, each
+ *         shard having its own budget and its own lock. An acquire takes
+ *         or constructs a resource from the thread's shard first; only
+ *         when that shard is empty and at its hmax is an idle resource
+ *         borrowed from, or else constructed in, a sibling shard, before
+ *         waiting for the thread's shard. A resource always goes back to
+ *         the shard it was constructed by.
+ * @remark Threads are given shards in turn as they first use the list,
+ *         or by their thread ID where the compiler has no thread local
+ *         storage. APR_RESLIST_SHARD_CPU is ignored where the CPU of the
+ *         calling thread can't be asked for (sched_getcpu()).
+ * @remark With a single shard this is apr_reslist_create_ex().
+ */
+APR_DECLARE(apr_status_t) apr_reslist_create_sharded(apr_reslist_t **reslist,
+                                                     int nshards,
+                                                     int min, int smax,
+                                                     int hmax,
+                                                     apr_interval_time_t ttl,
+                                                     apr_reslist_constructor con,
+                                                     apr_reslist_destructor de,
+                                                     void *params,
+                                                     apr_uint32_t flags,
+                                                     apr_pool_t *pool);
+
 /**
  * Destroy the given resource list and all resources controlled by
  * this list.
@@ -192,6 +278,38 @@ APR_DECLARE(apr_status_t) apr_reslist_maintain(apr_reslist_t *reslist);
 APR_DECLARE(void) apr_reslist_cleanup_order_set(apr_reslist_t *reslist,
                                                 apr_uint32_t mode);
 
+/** Number of buckets in the acquire wait histogram */
+#define APR_RESLIST_WAIT_BUCKETS 8
+
+/**
+ * Resource list statistics, counted since the list was created.
+ */
+typedef struct apr_reslist_stats_t {
+    /** Number of resources constructed */
+    apr_uint32_t constructed;
+    /** Number of resources destroyed, including invalidated ones */
+    apr_uint32_t destroyed;
+    /** Number of acquires that timed out */
+    apr_uint32_t timeouts;
+    /** Histogram of the time successful acquires waited for a resource.
+     * wait[0] counts the acquires that found an idle resource, then
+     * wait[i] those that waited (or constructed one) for less than
+     * 10^i microseconds, the last bucket taking all the longer waits.
+     * The sum is the number of successful acquires.
+     */
+    apr_uint32_t wait[APR_RESLIST_WAIT_BUCKETS];
+} apr_reslist_stats_t;
+
+/**
+ * Get the statistics of a resource list.
+ * @param reslist The resource list.
+ * @param stats Where to store the statistics.
+ * @remark The counters are read one at a time while the list is in
+ *         use, so they are not a consistent snapshot.
+ */
+APR_DECLARE(void) apr_reslist_stats_get(apr_reslist_t *reslist,
+                                        apr_reslist_stats_t *stats);
+
 #ifdef __cplusplus
 }
 #endif
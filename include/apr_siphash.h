@@ -46,7 +46,8 @@ extern "C" {
  *        c is the number of compression rounds, d the number of finalization
  *        rounds; we also define fast implementations for c = 2 with d = 4 (aka
  *        siphash-2-4), and c = 4 with d = 8 (aka siphash-4-8), as recommended
- *        parameters per the authors.
+ *        parameters per the authors, plus c = 1 with d = 3 (aka siphash-1-3)
+ *        which is faster and considered good enough for hash tables.
  */
 
 /** size of the siphash digest */
@@ -114,6 +115,32 @@ APR_DECLARE(void) apr_siphash24_auth(unsigned char out[APR_SIPHASH_DSIZE],
                                      const void *src, apr_size_t len,
                                const unsigned char key[APR_SIPHASH_KSIZE]);
 
+/**
+ * @brief Computes SipHash-1-3, producing a 64bit (APR_SIPHASH_DSIZE) hash
+ * from a message and a 128bit (APR_SIPHASH_KSIZE) secret key.
+ * @param src The message
+ * @param len The length of the message
+ * @param key The secret key
+ * @return The hash value as a 64bit unsigned integer
+ */
+APR_DECLARE(apr_uint64_t) apr_siphash13(const void *src, apr_size_t len,
+                               const unsigned char key[APR_SIPHASH_KSIZE]);
+
+/**
+ * @brief Computes SipHash-1-3, producing a 64bit (APR_SIPHASH_DSIZE) hash
+ * from a message and a 128bit (APR_SIPHASH_KSIZE) secret key, into a possibly
+ * unaligned buffer (using the little endian representation as defined by the
+ * authors for interoperabilty) usable as a MAC.
+ * @param out The output buffer (or MAC)
+ * @param src The message
+ * @param len The length of the message
+ * @param key The secret key
+ * @return The hash value as a 64bit unsigned integer
+ */
+APR_DECLARE(void) apr_siphash13_auth(unsigned char out[APR_SIPHASH_DSIZE],
+                                     const void *src, apr_size_t len,
+                               const unsigned char key[APR_SIPHASH_KSIZE]);
+
 /**
  * @brief Computes SipHash-4-8, producing a 64bit (APR_SIPHASH_DSIZE) hash
  * from a message and a 128bit (APR_SIPHASH_KSIZE) secret key.
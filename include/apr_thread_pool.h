@@ -79,6 +79,42 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t **me,
                                                  apr_size_t max_threads,
                                                  apr_pool_t *pool);
 
+/**
+ * Flag for apr_thread_pool_create_ex(): give each thread its own queue of
+ * tasks and let idle threads steal the tasks queued by the busy ones.
+ */
+#define APR_THREAD_POOL_WORK_STEALING 0x1
+
+/**
+ * Create a thread pool, with creation flags
+ * @param me The pointer in which to return the newly created apr_thread_pool
+ * object, or NULL if thread pool creation fails.
+ * @param init_threads See apr_thread_pool_create().
+ * @param max_threads See apr_thread_pool_create().
+ * @param flags Zero or APR_THREAD_POOL_WORK_STEALING.
+ * @param pool The pool to use
+ * @return APR_SUCCESS if the thread pool was created successfully. Otherwise,
+ * the error code.
+ * @remark With APR_THREAD_POOL_WORK_STEALING, each thread has a lock-free
+ * deque of tasks per priority segment (0-63, 64-127, 128-191 and 192-255).
+ * The tasks pushed by a running task go to the deque of its thread (most
+ * recent first), while the tasks pushed from other threads go to the shared
+ * queue from which the threads take batches.  Threads which run out of
+ * tasks steal the oldest ones from the deques of the others, highest
+ * priority segment first.  This avoids the contention on the pool's lock
+ * with many short tasks, at the cost of the priorities being honored by
+ * segment and per thread only.  Scheduled tasks and the owner semantics of
+ * apr_thread_pool_tasks_cancel() are unchanged.
+ * @remark In this mode the number of threads can't grow above the maximum
+ * given here (or init_threads if higher), whatever the value set later by
+ * apr_thread_pool_thread_max_set().
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_create_ex(apr_thread_pool_t **me,
+                                                    apr_size_t init_threads,
+                                                    apr_size_t max_threads,
+                                                    apr_uint32_t flags,
+                                                    apr_pool_t *pool);
+
 /**
  * Destroy the thread pool and stop all the threads
  * @return APR_SUCCESS if all threads are stopped.
@@ -99,6 +135,27 @@ APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
                                                void *param,
                                                apr_byte_t priority,
                                                void *owner);
+
+/**
+ * Schedule several tasks to the bottom of the tasks of same priority, with
+ * a single lock acquisition and wakeup of the threads.
+ * @param me The thread pool
+ * @param func The task function, for all the tasks
+ * @param params The parameter for the task function of each task, in order
+ * @param nelts The number of tasks (elements of params)
+ * @param priority The priority of the tasks.
+ * @param owner Owner of the tasks.
+ * @return APR_SUCCESS if the tasks had been scheduled successfully
+ * @remark Same as calling apr_thread_pool_push() for each param.  On error,
+ * the tasks of the first params might have been scheduled still.
+ */
+APR_DECLARE(apr_status_t) apr_thread_pool_push_batch(apr_thread_pool_t *me,
+                                                     apr_thread_start_t func,
+                                                     void **params,
+                                                     apr_size_t nelts,
+                                                     apr_byte_t priority,
+                                                     void *owner);
+
 /**
  * Schedule a task to be run after a delay
  * @param me The thread pool
@@ -149,6 +149,15 @@ struct apr_file_t {
 #define fstat(f,b) fstat64(f,b)
 #define lseek(f,o,w) lseek64(f,o,w)
 #define ftruncate(f,l) ftruncate64(f,l)
+#ifdef HAVE_PREAD64
+#define pread(f,b,n,o) pread64(f,b,n,o)
+#endif
+#ifdef HAVE_POSIX_FADVISE64
+#define posix_fadvise(f,o,l,a) posix_fadvise64(f,o,l,a)
+#endif
+#ifdef HAVE_FSTATAT64
+#define fstatat(d,f,b,l) fstatat64(d,f,b,l)
+#endif
 typedef struct stat64 struct_stat;
 #else
 typedef struct stat struct_stat;
@@ -160,6 +169,20 @@ typedef struct stat struct_stat;
 #define APR_USE_READDIR64_R
 #endif
 
+/* Directory entries are stat()ed relative to the directory's descriptor
+ * where possible, rather than by their full path: */
+#if defined(HAVE_FSTATAT) && defined(HAVE_DIRFD) \
+    && defined(AT_SYMLINK_NOFOLLOW) \
+    && (!APR_HAS_LARGE_FILES || !defined(_LARGEFILE64_SOURCE) \
+        || defined(HAVE_FSTATAT64))
+#define APR_USE_STATAT
+#endif
+
+/* and on Linux, read many at a time with getdents64(): */
+#if defined(HAVE_GETDENTS64) && defined(HAVE_DIRFD) && defined(DIRENT_TYPE)
+#define APR_USE_GETDENTS64
+#endif
+
 struct apr_dir_t {
     apr_pool_t *pool;
     char *dirname;
@@ -169,6 +192,11 @@ struct apr_dir_t {
 #else
     struct dirent *entry;
 #endif
+#ifdef APR_USE_GETDENTS64
+    char *dents;              /* entries read by getdents64() */
+    apr_size_t dents_len;     /* bytes of them */
+    apr_size_t dents_pos;     /* offset of the next one */
+#endif
 };
 
 apr_status_t apr_unix_file_cleanup(void *);
@@ -177,6 +205,11 @@ apr_status_t apr_unix_child_file_cleanup(void *);
 mode_t apr_unix_perms2mode(apr_fileperms_t perms);
 apr_fileperms_t apr_unix_mode2perms(mode_t mode);
 
+#ifdef APR_USE_STATAT
+apr_status_t apr_unix_statat(apr_finfo_t *finfo, int dfd, const char *fname,
+                             apr_int32_t wanted, apr_pool_t *pool);
+#endif
+
 apr_status_t apr_file_flush_locked(apr_file_t *thefile);
 apr_status_t apr_file_info_get_locked(apr_finfo_t *finfo, apr_int32_t wanted,
                                       apr_file_t *thefile);
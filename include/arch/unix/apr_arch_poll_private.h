@@ -38,6 +38,10 @@
 #include <sys/epoll.h>
 #endif
 
+#ifdef HAVE_IO_URING
+#include <linux/io_uring.h>
+#endif
+
 #ifdef NETWARE
 #define HAS_SOCKETS(dt) (dt == APR_POLL_SOCKET) ? 1 : 0
 #define HAS_PIPES(dt) (dt == APR_POLL_FILE) ? 1 : 0
@@ -126,7 +130,7 @@ struct apr_pollset_t
     apr_uint32_t nelts;
     apr_uint32_t nalloc;
     apr_uint32_t flags;
-    /* Pipe descriptors used for wakeup */
+    /* Pipe descriptors used for wakeup, both the same eventfd if any */
 #if WAKEUP_USES_PIPE
     apr_file_t *wakeup_pipe[2];
 #else
@@ -136,6 +140,8 @@ struct apr_pollset_t
     volatile apr_uint32_t wakeup_set;
     apr_pollset_private_t *p;
     const apr_pollset_provider_t *provider;
+    /* For apr_pollset_poll_ptrs() without provider support */
+    const apr_pollfd_t **result_ptrs;
 };
 
 typedef union {
@@ -150,6 +156,9 @@ typedef union {
 #endif
 #if defined(HAVE_POLL)
     struct pollfd *ps;
+#endif
+#if defined(HAVE_IO_URING)
+    struct apr_uring_t *uring;
 #endif
     void *undef;
 } apr_pollcb_pset;
@@ -159,7 +168,7 @@ struct apr_pollcb_t {
     apr_uint32_t nelts;
     apr_uint32_t nalloc;
     apr_uint32_t flags;
-    /* Pipe descriptors used for wakeup */
+    /* Pipe descriptors used for wakeup, both the same eventfd if any */
 #if WAKEUP_USES_PIPE
     apr_file_t *wakeup_pipe[2];
 #else
@@ -180,6 +189,10 @@ struct apr_pollset_provider_t {
     apr_status_t (*poll)(apr_pollset_t *, apr_interval_time_t, apr_int32_t *, const apr_pollfd_t **);
     apr_status_t (*cleanup)(apr_pollset_t *);
     const char *name;
+    /* Optional, for APR_POLLET and APR_POLLONESHOT support */
+    apr_status_t (*rearm)(apr_pollset_t *, const apr_pollfd_t *);
+    /* Optional, apr_pollset_poll_ptrs() uses poll's copies otherwise */
+    apr_status_t (*poll_ptrs)(apr_pollset_t *, apr_interval_time_t, apr_int32_t *, const apr_pollfd_t *const **);
 };
 
 struct apr_pollcb_provider_t {
@@ -189,6 +202,8 @@ struct apr_pollcb_provider_t {
     apr_status_t (*poll)(apr_pollcb_t *, apr_interval_time_t, apr_pollcb_cb_t, void *);
     apr_status_t (*cleanup)(apr_pollcb_t *);
     const char *name;
+    /* Optional, for APR_POLLET and APR_POLLONESHOT support */
+    apr_status_t (*rearm)(apr_pollcb_t *, apr_pollfd_t *);
 };
 
 /*
@@ -199,6 +214,7 @@ struct apr_pollcb_provider_t {
 apr_status_t apr_poll_create_wakeup_pipe(apr_pool_t *pool, apr_pollfd_t *pfd,
                                          apr_file_t **wakeup_pipe);
 apr_status_t apr_poll_close_wakeup_pipe(apr_file_t **wakeup_pipe);
+apr_status_t apr_poll_send_wakeup_pipe(apr_file_t **wakeup_pipe);
 void apr_poll_drain_wakeup_pipe(volatile apr_uint32_t *wakeup_set, apr_file_t **wakeup_pipe);
 #else
 apr_status_t apr_poll_create_wakeup_socket(apr_pool_t *pool, apr_pollfd_t *pfd,
@@ -207,4 +223,39 @@ apr_status_t apr_poll_close_wakeup_socket(apr_socket_t **wakeup_socket);
 void apr_poll_drain_wakeup_socket(volatile apr_uint32_t *wakeup_set, apr_socket_t **wakeup_socket);
 #endif
 
+#if defined(HAVE_IO_URING)
+/*
+ * The rings of an io_uring instance, used by both the io_uring pollset
+ * and apr_ioqueue_t.  The submission entries are used in order, they are
+ * queued by apr_uring_ring_get_sqe() and published to the kernel by
+ * apr_uring_ring_submit() or with the sq_tail, for an io_uring_enter()
+ * which also waits.
+ */
+typedef struct apr_uring_ring_t {
+    int fd;
+    void *rings;
+    apr_size_t rings_len;
+    struct io_uring_sqe *sqes;
+    apr_size_t sqes_len;
+    volatile apr_uint32_t *sq_head;
+    volatile apr_uint32_t *sq_ktail;
+    apr_uint32_t sq_tail;
+    apr_uint32_t sq_mask;
+    apr_uint32_t sq_entries;
+    volatile apr_uint32_t *cq_head;
+    volatile apr_uint32_t *cq_tail;
+    apr_uint32_t cq_mask;
+    struct io_uring_cqe *cqes;
+} apr_uring_ring_t;
+
+apr_status_t apr_uring_ring_setup(apr_uring_ring_t *ring,
+                                  apr_uint32_t entries);
+void apr_uring_ring_cleanup(apr_uring_ring_t *ring);
+int apr_uring_ring_enter(apr_uring_ring_t *ring, apr_uint32_t to_submit,
+                         apr_uint32_t min_complete, apr_uint32_t flags,
+                         void *arg, apr_size_t argsz);
+apr_status_t apr_uring_ring_submit(apr_uring_ring_t *ring);
+struct io_uring_sqe *apr_uring_ring_get_sqe(apr_uring_ring_t *ring);
+#endif
+
 #endif /* APR_ARCH_POLL_PRIVATE_H */
@@ -366,6 +366,10 @@ SOURCE=.\file_io\win32\dir.c
 # End Source File
 # Begin Source File
 
+SOURCE=.\file_io\unix\dirwalk.c
+# End Source File
+# Begin Source File
+
 SOURCE=.\file_io\unix\fileacc.c
 # End Source File
 # Begin Source File
@@ -696,6 +700,10 @@ SOURCE=.\strmatch\apr_strmatch.c
 # Begin Source File
 
 SOURCE=.\tables\apr_hash.c
+# End Source File
+# Begin Source File
+
+SOURCE=.\tables\apr_hash_flat.c
 # Begin Source File
 
 SOURCE=.\tables\apr_tables.c
@@ -17,6 +17,8 @@
 #include "apr_memcache.h"
 #include "apr_poll.h"
 #include "apr_version.h"
+#include "apr_md5.h"
+#include "apr_strings.h"
 #include <stdlib.h>
 
 #define BUFFER_SIZE 512
@@ -90,6 +92,9 @@ struct apr_memcache_conn_t
 #define MS_ERROR "ERROR"
 #define MS_ERROR_LEN (sizeof(MS_ERROR)-1)
 
+#define MS_SERVER_ERROR "SERVER_ERROR"
+#define MS_SERVER_ERROR_LEN (sizeof(MS_SERVER_ERROR)-1)
+
 #define MS_VERSION "VERSION"
 #define MS_VERSION_LEN (sizeof(MS_VERSION)-1)
 
@@ -99,6 +104,32 @@ struct apr_memcache_conn_t
 #define MS_END "END"
 #define MS_END_LEN (sizeof(MS_END)-1)
 
+/* Strings for Meta Commands and Replies */
+
+#define MC_META_GET "mg "
+#define MC_META_GET_LEN (sizeof(MC_META_GET)-1)
+
+#define MC_META_SET "ms "
+#define MC_META_SET_LEN (sizeof(MC_META_SET)-1)
+
+#define MC_META_DELETE "md "
+#define MC_META_DELETE_LEN (sizeof(MC_META_DELETE)-1)
+
+#define MC_META_ARITH "ma "
+#define MC_META_ARITH_LEN (sizeof(MC_META_ARITH)-1)
+
+#define MC_META_NOOP "mn" MC_EOL
+#define MC_META_NOOP_LEN (sizeof(MC_META_NOOP)-1)
+
+#define MS_META_VALUE "VA"
+#define MS_META_HEADER "HD"
+#define MS_META_MISS "EN"
+#define MS_META_NOT_STORED "NS"
+#define MS_META_EXISTS "EX"
+#define MS_META_NOT_FOUND "NF"
+#define MS_META_NOOP "MN"
+#define MS_META_LEN 2
+
 /** Server and Query Structure for a multiple get */
 struct cache_server_query_t {
     apr_memcache_server_t* ms;
@@ -156,6 +187,36 @@ apr_memcache_find_server_hash(apr_memcache_t *mc, const apr_uint32_t hash)
     }
 }
 
+/* Whether the server is live, or dead but back to life when retried */
+static int server_usable(apr_memcache_t *mc, apr_memcache_server_t *ms,
+                         apr_time_t *curtime)
+{
+    int usable = 0;
+
+    if (ms->status == APR_MC_SERVER_LIVE) {
+        return 1;
+    }
+
+    if (*curtime == 0) {
+        *curtime = apr_time_now();
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(ms->lock);
+#endif
+    /* Try the dead server, every 5 seconds */
+    if (*curtime - ms->btime > mc->retry_period) {
+        ms->btime = *curtime;
+        if (mc_version_ping(ms) == APR_SUCCESS) {
+            make_server_live(mc, ms);
+            usable = 1;
+        }
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(ms->lock);
+#endif
+    return usable;
+}
+
 APR_DECLARE(apr_memcache_server_t *)
 apr_memcache_find_server_hash_default(void *baton, apr_memcache_t *mc,
                                       const apr_uint32_t hash)
@@ -171,31 +232,9 @@ apr_memcache_find_server_hash_default(void *baton, apr_memcache_t *mc,
 
     do {
         ms = mc->live_servers[h % mc->ntotal];
-        if(ms->status == APR_MC_SERVER_LIVE) {
+        if (server_usable(mc, ms, &curtime)) {
             break;
         }
-        else {
-            if (curtime == 0) {
-                curtime = apr_time_now();
-            }
-#if APR_HAS_THREADS
-            apr_thread_mutex_lock(ms->lock);
-#endif
-            /* Try the dead server, every 5 seconds */
-            if (curtime - ms->btime > mc->retry_period) {
-                ms->btime = curtime;
-                if (mc_version_ping(ms) == APR_SUCCESS) {
-                    make_server_live(mc, ms);
-#if APR_HAS_THREADS
-                    apr_thread_mutex_unlock(ms->lock);
-#endif
-                    break;
-                }
-            }
-#if APR_HAS_THREADS
-            apr_thread_mutex_unlock(ms->lock);
-#endif
-        }
         h++;
         i++;
     } while(i < mc->ntotal);
@@ -207,6 +246,176 @@ apr_memcache_find_server_hash_default(void *baton, apr_memcache_t *mc,
     return ms;
 }
 
+/*
+ * Consistent hashing (ketama): each server is given points on a ring of
+ * 32 bit hashes, in proportion of its weight, and a key goes to the server
+ * of the first point at or after its hash.  Adding or removing a server
+ * only moves the keys of the points it takes or leaves.  The points and
+ * the key hashes are computed like libketama, from the MD5 of respectively
+ * "host:port-n" (four points per digest) and the key.
+ */
+
+typedef struct ketama_point_t {
+    apr_uint32_t point;
+    apr_uint32_t idx;       /* of the server in mc->live_servers */
+    apr_memcache_server_t *ms;
+} ketama_point_t;
+
+struct apr_memcache_ketama_t {
+    apr_uint32_t npoints;
+    ketama_point_t *points;
+    apr_uint32_t nidx;      /* range of the points' idx */
+    apr_uint32_t nservers;  /* with points */
+};
+
+/* Servers tried at most with a bitmap on the stack by the failover */
+#define KETAMA_TRIED_MAX 256
+
+static APR_INLINE apr_uint32_t ketama_digest_point(const unsigned char *d,
+                                                   int n)
+{
+    return ((apr_uint32_t)d[3 + n * 4] << 24)
+           | ((apr_uint32_t)d[2 + n * 4] << 16)
+           | ((apr_uint32_t)d[1 + n * 4] << 8)
+           | (apr_uint32_t)d[n * 4];
+}
+
+static int ketama_point_cmp(const void *a, const void *b)
+{
+    const ketama_point_t *pa = a, *pb = b;
+
+    if (pa->point != pb->point) {
+        return pa->point < pb->point ? -1 : 1;
+    }
+    /* same point for two servers, keep it deterministic */
+    return pa->idx < pb->idx ? -1 : pa->idx > pb->idx;
+}
+
+APR_DECLARE(apr_status_t) apr_memcache_ketama_create(apr_memcache_ketama_t **ring,
+                                                     apr_memcache_t *mc,
+                                                     const apr_uint32_t *weights,
+                                                     apr_uint32_t points,
+                                                     apr_pool_t *p)
+{
+    apr_memcache_ketama_t *r;
+    apr_uint32_t i, n, total = 0;
+
+    if (!points) {
+        points = APR_MEMCACHE_KETAMA_POINTS;
+    }
+    /* four points per MD5 digest */
+    points = (points + 3) & ~3u;
+
+    for (i = 0; i < mc->ntotal; i++) {
+        total += points * (weights ? weights[i] : 1);
+    }
+
+    r = apr_palloc(p, sizeof(*r));
+    r->npoints = 0;
+    r->points = apr_palloc(p, (total ? total : 1) * sizeof(ketama_point_t));
+    r->nidx = mc->ntotal;
+    r->nservers = 0;
+
+    for (i = 0; i < mc->ntotal; i++) {
+        apr_memcache_server_t *ms = mc->live_servers[i];
+        apr_uint32_t count = points * (weights ? weights[i] : 1);
+
+        if (count) {
+            r->nservers++;
+        }
+        for (n = 0; n < count / 4; n++) {
+            unsigned char digest[APR_MD5_DIGESTSIZE];
+            char buf[512];
+            int k;
+
+            apr_snprintf(buf, sizeof(buf), "%s:%u-%u", ms->host,
+                         (unsigned int)ms->port, n);
+            apr_md5(digest, buf, strlen(buf));
+            for (k = 0; k < 4; k++) {
+                ketama_point_t *pt = &r->points[r->npoints++];
+
+                pt->point = ketama_digest_point(digest, k);
+                pt->idx = i;
+                pt->ms = ms;
+            }
+        }
+    }
+
+    qsort(r->points, r->npoints, sizeof(ketama_point_t), ketama_point_cmp);
+
+    *ring = r;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_uint32_t) apr_memcache_hash_ketama(void *baton,
+                                                   const char *data,
+                                                   const apr_size_t data_len)
+{
+    unsigned char digest[APR_MD5_DIGESTSIZE];
+
+    apr_md5(digest, data, data_len);
+    return ketama_digest_point(digest, 0);
+}
+
+APR_DECLARE(apr_memcache_server_t *)
+apr_memcache_find_server_hash_ketama(void *baton, apr_memcache_t *mc,
+                                     const apr_uint32_t hash)
+{
+    apr_memcache_ketama_t *ring = baton;
+    apr_memcache_server_t *ms = NULL;
+    unsigned char tried_buf[KETAMA_TRIED_MAX / 8], *tried = tried_buf;
+    apr_uint32_t lo, hi, i, ntried = 0;
+    apr_time_t curtime = 0;
+
+    if (!ring || ring->npoints == 0) {
+        return NULL;
+    }
+
+    /* first point at or after hash, wrapping around */
+    lo = 0;
+    hi = ring->npoints;
+    while (lo < hi) {
+        apr_uint32_t mid = lo + (hi - lo) / 2;
+        if (ring->points[mid].point < hash) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    /* failover to the servers of the next points, each server tried once
+     * (a dead one takes its lock) until all of them were
+     */
+    if (ring->nidx > KETAMA_TRIED_MAX) {
+        tried = calloc((ring->nidx + 7) / 8, 1);
+        if (!tried) {
+            return NULL;
+        }
+    }
+    else {
+        memset(tried, 0, sizeof(tried_buf));
+    }
+    for (i = 0; i < ring->npoints && ntried < ring->nservers; i++) {
+        const ketama_point_t *pt = &ring->points[(lo + i) % ring->npoints];
+
+        if (tried[pt->idx / 8] & (1u << (pt->idx % 8))) {
+            continue;
+        }
+        tried[pt->idx / 8] |= 1u << (pt->idx % 8);
+        ntried++;
+        if (server_usable(mc, pt->ms, &curtime)) {
+            ms = pt->ms;
+            break;
+        }
+    }
+    if (tried != tried_buf) {
+        free(tried);
+    }
+
+    return ms;
+}
+
 APR_DECLARE(apr_memcache_server_t *) apr_memcache_find_server(apr_memcache_t *mc, const char *host, apr_port_t port)
 {
     int i;
@@ -383,6 +592,12 @@ static apr_status_t conn_connect(apr_memcache_conn_t *conn)
         return APR_ECONNREFUSED;
     }
 
+    /* Requests are written whole, so don't have the tail of a pipeline
+     * wait for the acknowledgement of what precedes (quiet meta commands
+     * have no replies to carry it); this fails harmlessly on unix sockets
+     */
+    apr_socket_opt_set(conn->sock, APR_TCP_NODELAY, 1);
+
     rv = apr_socket_timeout_set(conn->sock, -1);
     if (rv != APR_SUCCESS) {
         return rv;
@@ -457,11 +672,12 @@ mc_conn_destruct(void *conn_, void *params, apr_pool_t *pool)
 }
 #endif
 
-APR_DECLARE(apr_status_t) apr_memcache_server_create(apr_pool_t *p,
-                                                     const char *host, apr_port_t port,
-                                                     int min, int smax,
-                                                     int max, apr_interval_time_t ttl,
-                                                     apr_memcache_server_t **ms)
+APR_DECLARE(apr_status_t) apr_memcache_server_create_ex(apr_pool_t *p,
+                                                        const char *host, apr_port_t port,
+                                                        int min, int smax,
+                                                        int max, apr_interval_time_t ttl,
+                                                        int shards, apr_uint32_t flags,
+                                                        apr_memcache_server_t **ms)
 {
     apr_status_t rv = APR_SUCCESS;
     apr_memcache_server_t *server;
@@ -484,14 +700,15 @@ APR_DECLARE(apr_status_t) apr_memcache_server_create(apr_pool_t *p,
         return rv;
     }
 
-    rv = apr_reslist_create(&server->conns,
+    rv = apr_reslist_create_sharded(&server->conns,
+                               shards,                  /* Number of shards */
                                min,                     /* hard minimum */
                                smax,                    /* soft maximum */
                                max,                     /* hard maximum */
                                ttl,                     /* Time to live */
                                mc_conn_construct,       /* Make a New Connection */
                                mc_conn_destruct,        /* Kill Old Connection */
-                               server, np);
+                               server, flags, np);
     if (rv != APR_SUCCESS) {
         return rv;
     }
@@ -514,6 +731,16 @@ APR_DECLARE(apr_status_t) apr_memcache_server_create(apr_pool_t *p,
     return rv;
 }
 
+APR_DECLARE(apr_status_t) apr_memcache_server_create(apr_pool_t *p,
+                                                     const char *host, apr_port_t port,
+                                                     int min, int smax,
+                                                     int max, apr_interval_time_t ttl,
+                                                     apr_memcache_server_t **ms)
+{
+    return apr_memcache_server_create_ex(p, host, port, min, smax, max, ttl,
+                                         1, 0, ms);
+}
+
 APR_DECLARE(void) apr_memcache_set_retry_period(apr_memcache_t *mc,
                                                 apr_time_t retry_period)
 {
@@ -536,6 +763,7 @@ APR_DECLARE(apr_status_t) apr_memcache_create(apr_pool_t *p,
     mc->p = p;
     mc->nalloc = max_servers;
     mc->ntotal = 0;
+    mc->flags = flags;
     mc->live_servers = apr_palloc(p, mc->nalloc * sizeof(struct apr_memcache_server_t *));
     mc->hash_func = NULL;
     mc->hash_baton = NULL;
@@ -680,29 +908,104 @@ static apr_status_t get_server_line(apr_memcache_conn_t *conn)
     return apr_brigade_cleanup(conn->tb);
 }
 
-static apr_status_t storage_cmd_write(apr_memcache_t *mc,
-                                      char *cmd,
-                                      const apr_size_t cmd_size,
-                                      const char *key,
-                                      char *data,
-                                      const apr_size_t data_size,
-                                      apr_uint32_t timeout,
-                                      apr_uint16_t flags)
+/*
+ * Parses a decimal size from size_str, returning the value in *size.
+ * Returns 1 if parsing was successful, 0 if parsing failed.
+ */
+static int parse_size(const char *size_str, apr_size_t *size)
+{
+    char *endptr;
+    long size_as_long;
+
+    errno = 0;
+    size_as_long = strtol(size_str, &endptr, 10);
+    if ((size_as_long < 0) || (errno != 0) || (endptr == size_str) ||
+        (endptr[0] != ' ' && (endptr[0] != '\r' || endptr[1] != '\n'))) {
+        return 0;
+    }
+
+    *size = (unsigned long)size_as_long;
+    return 1;
+}
+
+/*
+ * Meta protocol: a command is "<mg|ms|md|ma> <key> <flags>*", where each
+ * flag is a letter possibly followed by a token, and its reply is a two
+ * letter code followed by the flags returned.  Values are read like with
+ * the text protocol, after "VA <size> <flags>*".
+ */
+
+/* Whether the meta reply in the line has the code */
+static int meta_is(const char *line, const char *code)
+{
+    return line[0] == code[0] && line[1] == code[1]
+           && (line[2] == ' ' || line[2] == '\r');
+}
+
+/* The token of a flag returned in the meta reply, or NULL */
+static const char *meta_flag(const char *line, char flag)
+{
+    for (; *line != '\r' && *line != '\0'; line++) {
+        if (line[0] == ' ' && line[1] == flag) {
+            return line + 2;
+        }
+    }
+    return NULL;
+}
+
+/* Read the data of a value and its trailing \r\n from the connection */
+static apr_status_t conn_read_data(apr_memcache_conn_t *conn, apr_size_t len,
+                                   apr_pool_t *p, char **data)
+{
+    apr_bucket_brigade *bbb;
+    apr_bucket *e;
+    apr_status_t rv;
+
+    rv = apr_brigade_partition(conn->bb, len + MC_EOL_LEN, &e);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    bbb = apr_brigade_split(conn->bb, e);
+
+    len += MC_EOL_LEN;
+    rv = apr_brigade_pflatten(conn->bb, data, &len, p);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    apr_brigade_destroy(conn->bb);
+    conn->bb = bbb;
+
+    (*data)[len - MC_EOL_LEN] = '\0';
+    return APR_SUCCESS;
+}
+
+/*
+ * Send a meta command for the key, with its data if any, and read the
+ * reply line into conn->buffer; the reply is read with the bucket
+ * allocator if given.  The caller then handles the reply and releases
+ * the connection.
+ */
+static apr_status_t meta_request(apr_memcache_t *mc,
+                                 const char *cmd,
+                                 const char *key,
+                                 const char *args,
+                                 const char *data,
+                                 apr_size_t data_size,
+                                 apr_bucket_alloc_t *ba,
+                                 apr_memcache_server_t **ms_,
+                                 apr_memcache_conn_t **conn_)
 {
-    apr_uint32_t hash;
     apr_memcache_server_t *ms;
     apr_memcache_conn_t *conn;
     apr_status_t rv;
     apr_size_t written;
+    apr_size_t klen = strlen(key);
     struct iovec vec[5];
-    apr_size_t klen;
-
-    apr_size_t key_size = strlen(key);
-
-    hash = apr_memcache_hash(mc, key, key_size);
-
-    ms = apr_memcache_find_server_hash(mc, hash);
+    int nvec = 3;
 
+    ms = apr_memcache_find_server_hash(mc, apr_memcache_hash(mc, key, klen));
     if (ms == NULL)
         return APR_NOTFOUND;
 
@@ -713,27 +1016,34 @@ static apr_status_t storage_cmd_write(apr_memcache_t *mc,
         return rv;
     }
 
-    /* <command name> <key> <flags> <exptime> <bytes>\r\n<data>\r\n */
+    if (ba) {
+        conn->bb = apr_brigade_create(conn->tp, ba);
+        conn->tb = apr_brigade_create(conn->tp, ba);
+        APR_BRIGADE_INSERT_TAIL(conn->bb,
+                                apr_bucket_socket_create(conn->sock, ba));
+    }
 
-    vec[0].iov_base = cmd;
-    vec[0].iov_len  = cmd_size;
+    /* <cmd> <key> <flags>*\r\n[<data>\r\n] */
+    vec[0].iov_base = (void*)cmd;
+    vec[0].iov_len  = strlen(cmd);
 
     vec[1].iov_base = (void*)key;
-    vec[1].iov_len  = key_size;
+    vec[1].iov_len  = klen;
 
-    klen = apr_snprintf(conn->buffer, BUFFER_SIZE, " %u %u %" APR_SIZE_T_FMT " " MC_EOL,
-                        flags, timeout, data_size);
+    vec[2].iov_base = (void*)args;
+    vec[2].iov_len  = strlen(args);
 
-    vec[2].iov_base = conn->buffer;
-    vec[2].iov_len  = klen;
+    if (data) {
+        vec[3].iov_base = (void*)data;
+        vec[3].iov_len  = data_size;
 
-    vec[3].iov_base = data;
-    vec[3].iov_len  = data_size;
+        vec[4].iov_base = MC_EOL;
+        vec[4].iov_len  = MC_EOL_LEN;
 
-    vec[4].iov_base = MC_EOL;
-    vec[4].iov_len  = MC_EOL_LEN;
+        nvec = 5;
+    }
 
-    rv = apr_socket_sendv(conn->sock, vec, 5, &written);
+    rv = apr_socket_sendv(conn->sock, vec, nvec, &written);
 
     if (rv != APR_SUCCESS) {
         ms_bad_conn(ms, conn);
@@ -742,60 +1052,281 @@ static apr_status_t storage_cmd_write(apr_memcache_t *mc,
     }
 
     rv = get_server_line(conn);
-
     if (rv != APR_SUCCESS) {
         ms_bad_conn(ms, conn);
         apr_memcache_disable_server(mc, ms);
         return rv;
     }
 
-    if (strcmp(conn->buffer, MS_STORED MC_EOL) == 0) {
-        rv = APR_SUCCESS;
-    }
-    else if (strcmp(conn->buffer, MS_NOT_STORED MC_EOL) == 0) {
-        rv = APR_EEXIST;
+    *ms_ = ms;
+    *conn_ = conn;
+    return APR_SUCCESS;
+}
+
+/* Release the connection after a reply, unless out of sync */
+static apr_status_t meta_done(apr_memcache_server_t *ms,
+                              apr_memcache_conn_t *conn, int insync,
+                              apr_status_t rv)
+{
+    if (insync) {
+        ms_release_conn(ms, conn);
     }
     else {
-        rv = APR_EGENERAL;
+        ms_bad_conn(ms, conn);
     }
-
-    ms_release_conn(ms, conn);
-
     return rv;
 }
 
-APR_DECLARE(apr_status_t)
-apr_memcache_set(apr_memcache_t *mc,
-                 const char *key,
-                 char *data,
-                 const apr_size_t data_size,
-                 apr_uint32_t timeout,
-                 apr_uint16_t flags)
+static apr_status_t meta_getp(apr_memcache_t *mc,
+                              apr_pool_t *p,
+                              const char *key,
+                              char **baton,
+                              apr_size_t *new_length,
+                              apr_uint16_t *flags_)
 {
-    return storage_cmd_write(mc,
-                           MC_SET, MC_SET_LEN,
-                           key,
-                           data, data_size,
-                           timeout, flags);
-}
+    apr_memcache_server_t *ms;
+    apr_memcache_conn_t *conn;
+    apr_status_t rv;
+    const char *flags;
+    apr_size_t len;
 
-APR_DECLARE(apr_status_t)
-apr_memcache_add(apr_memcache_t *mc,
-                 const char *key,
-                 char *data,
-                 const apr_size_t data_size,
-                 apr_uint32_t timeout,
-                 apr_uint16_t flags)
-{
-    return storage_cmd_write(mc,
-                           MC_ADD, MC_ADD_LEN,
-                           key,
-                           data, data_size,
-                           timeout, flags);
+    rv = meta_request(mc, MC_META_GET, key, " v f" MC_EOL, NULL, 0, NULL,
+                      &ms, &conn);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (meta_is(conn->buffer, MS_META_MISS)) {
+        return meta_done(ms, conn, TRUE, APR_NOTFOUND);
+    }
+    if (!meta_is(conn->buffer, MS_META_VALUE)
+        || !parse_size(conn->buffer + MS_META_LEN + 1, &len)) {
+        return meta_done(ms, conn, FALSE, APR_EGENERAL);
+    }
+
+    if (flags_) {
+        flags = meta_flag(conn->buffer, 'f');
+        *flags_ = flags ? atoi(flags) : 0;
+    }
+
+    rv = conn_read_data(conn, len, p, baton);
+    if (rv != APR_SUCCESS) {
+        return meta_done(ms, conn, FALSE, rv);
+    }
+    *new_length = len;
+
+    return meta_done(ms, conn, TRUE, APR_SUCCESS);
+}
+
+static apr_status_t meta_store(apr_memcache_t *mc,
+                               char mode,
+                               const char *key,
+                               char *data,
+                               const apr_size_t data_size,
+                               apr_uint32_t timeout,
+                               apr_uint16_t flags,
+                               apr_uint64_t cas)
+{
+    apr_memcache_server_t *ms;
+    apr_memcache_conn_t *conn;
+    apr_status_t rv;
+    char args[BUFFER_SIZE];
+
+    /* ms <key> <datalen> F<flags> T<ttl> M<mode>[ C<cas>]\r\n<data>\r\n */
+    if (cas) {
+        apr_snprintf(args, sizeof(args), " %" APR_SIZE_T_FMT " F%u T%u M%c"
+                     " C%" APR_UINT64_T_FMT MC_EOL, data_size, flags,
+                     timeout, mode, cas);
+    }
+    else {
+        apr_snprintf(args, sizeof(args), " %" APR_SIZE_T_FMT " F%u T%u M%c"
+                     MC_EOL, data_size, flags, timeout, mode);
+    }
+
+    rv = meta_request(mc, MC_META_SET, key, args, data, data_size, NULL,
+                      &ms, &conn);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (meta_is(conn->buffer, MS_META_HEADER)) {
+        rv = APR_SUCCESS;
+    }
+    else if (meta_is(conn->buffer, MS_META_NOT_STORED)
+             || meta_is(conn->buffer, MS_META_EXISTS)) {
+        rv = APR_EEXIST;
+    }
+    else if (meta_is(conn->buffer, MS_META_NOT_FOUND)) {
+        rv = APR_NOTFOUND;
+    }
+    else {
+        rv = APR_EGENERAL;
+    }
+
+    return meta_done(ms, conn, TRUE, rv);
+}
+
+static apr_status_t meta_delete(apr_memcache_t *mc, const char *key)
+{
+    apr_memcache_server_t *ms;
+    apr_memcache_conn_t *conn;
+    apr_status_t rv;
+
+    rv = meta_request(mc, MC_META_DELETE, key, MC_EOL, NULL, 0, NULL,
+                      &ms, &conn);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (meta_is(conn->buffer, MS_META_HEADER)) {
+        rv = APR_SUCCESS;
+    }
+    else if (meta_is(conn->buffer, MS_META_NOT_FOUND)) {
+        rv = APR_NOTFOUND;
+    }
+    else {
+        rv = APR_EGENERAL;
+    }
+
+    return meta_done(ms, conn, TRUE, rv);
+}
+
+static apr_status_t meta_arith(apr_memcache_t *mc,
+                               char mode,
+                               const char *key,
+                               const apr_int32_t inc,
+                               apr_uint32_t *new_value)
+{
+    apr_memcache_server_t *ms;
+    apr_memcache_conn_t *conn;
+    apr_status_t rv;
+    apr_size_t len;
+    char args[BUFFER_SIZE];
+    char *data;
+
+    /* ma <key> v D<delta> M<mode>\r\n */
+    apr_snprintf(args, sizeof(args), " v D%u M%c" MC_EOL, inc, mode);
+
+    rv = meta_request(mc, MC_META_ARITH, key, args, NULL, 0, NULL,
+                      &ms, &conn);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (meta_is(conn->buffer, MS_META_NOT_FOUND)) {
+        return meta_done(ms, conn, TRUE, APR_NOTFOUND);
+    }
+    if (!meta_is(conn->buffer, MS_META_VALUE)) {
+        /* such as not a number */
+        return meta_done(ms, conn, TRUE, APR_EGENERAL);
+    }
+    if (!parse_size(conn->buffer + MS_META_LEN + 1, &len)) {
+        return meta_done(ms, conn, FALSE, APR_EGENERAL);
+    }
+
+    rv = conn_read_data(conn, len, conn->tp, &data);
+    if (rv != APR_SUCCESS) {
+        return meta_done(ms, conn, FALSE, rv);
+    }
+    if (new_value) {
+        *new_value = atoi(data);
+    }
+
+    return meta_done(ms, conn, TRUE, APR_SUCCESS);
+}
+
+static apr_status_t storage_cmd_write(apr_memcache_t *mc,
+                                      char *cmd,
+                                      const apr_size_t cmd_size,
+                                      char mode,
+                                      const char *key,
+                                      char *data,
+                                      const apr_size_t data_size,
+                                      apr_uint32_t timeout,
+                                      apr_uint16_t flags)
+{
+    apr_uint32_t hash;
+    apr_memcache_server_t *ms;
+    apr_memcache_conn_t *conn;
+    apr_status_t rv;
+    apr_size_t written;
+    struct iovec vec[5];
+    apr_size_t klen;
+
+    apr_size_t key_size;
+
+    if (mc->flags & APR_MEMCACHE_META) {
+        return meta_store(mc, mode, key, data, data_size, timeout, flags, 0);
+    }
+
+    key_size = strlen(key);
+    hash = apr_memcache_hash(mc, key, key_size);
+
+    ms = apr_memcache_find_server_hash(mc, hash);
+
+    if (ms == NULL)
+        return APR_NOTFOUND;
+
+    rv = ms_find_conn(ms, &conn);
+
+    if (rv != APR_SUCCESS) {
+        apr_memcache_disable_server(mc, ms);
+        return rv;
+    }
+
+    /* <command name> <key> <flags> <exptime> <bytes>\r\n<data>\r\n */
+
+    vec[0].iov_base = cmd;
+    vec[0].iov_len  = cmd_size;
+
+    vec[1].iov_base = (void*)key;
+    vec[1].iov_len  = key_size;
+
+    klen = apr_snprintf(conn->buffer, BUFFER_SIZE, " %u %u %" APR_SIZE_T_FMT " " MC_EOL,
+                        flags, timeout, data_size);
+
+    vec[2].iov_base = conn->buffer;
+    vec[2].iov_len  = klen;
+
+    vec[3].iov_base = data;
+    vec[3].iov_len  = data_size;
+
+    vec[4].iov_base = MC_EOL;
+    vec[4].iov_len  = MC_EOL_LEN;
+
+    rv = apr_socket_sendv(conn->sock, vec, 5, &written);
+
+    if (rv != APR_SUCCESS) {
+        ms_bad_conn(ms, conn);
+        apr_memcache_disable_server(mc, ms);
+        return rv;
+    }
+
+    rv = get_server_line(conn);
+
+    if (rv != APR_SUCCESS) {
+        ms_bad_conn(ms, conn);
+        apr_memcache_disable_server(mc, ms);
+        return rv;
+    }
+
+    if (strcmp(conn->buffer, MS_STORED MC_EOL) == 0) {
+        rv = APR_SUCCESS;
+    }
+    else if (strcmp(conn->buffer, MS_NOT_STORED MC_EOL) == 0) {
+        rv = APR_EEXIST;
+    }
+    else {
+        rv = APR_EGENERAL;
+    }
+
+    ms_release_conn(ms, conn);
+
+    return rv;
 }
 
 APR_DECLARE(apr_status_t)
-apr_memcache_replace(apr_memcache_t *mc,
+apr_memcache_set(apr_memcache_t *mc,
                  const char *key,
                  char *data,
                  const apr_size_t data_size,
@@ -803,31 +1334,41 @@ apr_memcache_replace(apr_memcache_t *mc,
                  apr_uint16_t flags)
 {
     return storage_cmd_write(mc,
-                           MC_REPLACE, MC_REPLACE_LEN,
+                           MC_SET, MC_SET_LEN, 'S',
                            key,
                            data, data_size,
                            timeout, flags);
-
 }
 
-/*
- * Parses a decimal size from size_str, returning the value in *size.
- * Returns 1 if parsing was successful, 0 if parsing failed.
- */
-static int parse_size(const char *size_str, apr_size_t *size)
+APR_DECLARE(apr_status_t)
+apr_memcache_add(apr_memcache_t *mc,
+                 const char *key,
+                 char *data,
+                 const apr_size_t data_size,
+                 apr_uint32_t timeout,
+                 apr_uint16_t flags)
 {
-    char *endptr;
-    long size_as_long;
+    return storage_cmd_write(mc,
+                           MC_ADD, MC_ADD_LEN, 'E',
+                           key,
+                           data, data_size,
+                           timeout, flags);
+}
 
-    errno = 0;
-    size_as_long = strtol(size_str, &endptr, 10);
-    if ((size_as_long < 0) || (errno != 0) || (endptr == size_str) ||
-        (endptr[0] != ' ' && (endptr[0] != '\r' || endptr[1] != '\n'))) {
-        return 0;
-    }
+APR_DECLARE(apr_status_t)
+apr_memcache_replace(apr_memcache_t *mc,
+                 const char *key,
+                 char *data,
+                 const apr_size_t data_size,
+                 apr_uint32_t timeout,
+                 apr_uint16_t flags)
+{
+    return storage_cmd_write(mc,
+                           MC_REPLACE, MC_REPLACE_LEN, 'R',
+                           key,
+                           data, data_size,
+                           timeout, flags);
 
-    *size = (unsigned long)size_as_long;
-    return 1;
 }
 
 APR_DECLARE(apr_status_t)
@@ -846,6 +1387,10 @@ apr_memcache_getp(apr_memcache_t *mc,
     apr_size_t klen = strlen(key);
     struct iovec vec[3];
 
+    if (mc->flags & APR_MEMCACHE_META) {
+        return meta_getp(mc, p, key, baton, new_length, flags_);
+    }
+
     hash = apr_memcache_hash(mc, key, klen);
     ms = apr_memcache_find_server_hash(mc, hash);
     if (ms == NULL)
@@ -962,6 +1507,124 @@ apr_memcache_getp(apr_memcache_t *mc,
     return rv;
 }
 
+APR_DECLARE(apr_status_t)
+apr_memcache_getb(apr_memcache_t *mc,
+                  const char *key,
+                  apr_bucket_brigade *bb,
+                  apr_size_t *len_,
+                  apr_uint16_t *flags_,
+                  apr_uint64_t *cas_)
+{
+    apr_memcache_server_t *ms;
+    apr_memcache_conn_t *conn;
+    apr_bucket_brigade *bbb;
+    apr_bucket *e, *end;
+    apr_status_t rv;
+    const char *flag;
+    apr_size_t len;
+
+    if (!(mc->flags & APR_MEMCACHE_META)) {
+        return APR_ENOTIMPL;
+    }
+
+    /* The value is read with the brigade's allocator, so that its buckets
+     * are just moved there */
+    rv = meta_request(mc, MC_META_GET, key, " v f c" MC_EOL, NULL, 0,
+                      bb->bucket_alloc, &ms, &conn);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (meta_is(conn->buffer, MS_META_MISS)) {
+        return meta_done(ms, conn, TRUE, APR_NOTFOUND);
+    }
+    if (!meta_is(conn->buffer, MS_META_VALUE)
+        || !parse_size(conn->buffer + MS_META_LEN + 1, &len)) {
+        return meta_done(ms, conn, FALSE, APR_EGENERAL);
+    }
+
+    if (flags_) {
+        flag = meta_flag(conn->buffer, 'f');
+        *flags_ = flag ? atoi(flag) : 0;
+    }
+    if (cas_) {
+        flag = meta_flag(conn->buffer, 'c');
+        *cas_ = flag ? apr_strtoi64(flag, NULL, 10) : 0;
+    }
+
+    if ((rv = apr_brigade_partition(conn->bb, len + MC_EOL_LEN, &end))
+            != APR_SUCCESS
+        || (rv = apr_brigade_partition(conn->bb, len, &e)) != APR_SUCCESS) {
+        return meta_done(ms, conn, FALSE, rv);
+    }
+
+    bbb = apr_brigade_split(conn->bb, end);
+    while (APR_BRIGADE_FIRST(conn->bb) != e) {
+        end = APR_BRIGADE_FIRST(conn->bb);
+        APR_BUCKET_REMOVE(end);
+        APR_BRIGADE_INSERT_TAIL(bb, end);
+    }
+    apr_brigade_destroy(conn->bb);
+    conn->bb = bbb;
+
+    if (len_) {
+        *len_ = len;
+    }
+
+    return meta_done(ms, conn, TRUE, APR_SUCCESS);
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_cas(apr_memcache_t *mc,
+                 const char *key,
+                 char *data,
+                 const apr_size_t data_size,
+                 apr_uint32_t timeout,
+                 apr_uint16_t flags,
+                 apr_uint64_t cas)
+{
+    if (!(mc->flags & APR_MEMCACHE_META)) {
+        return APR_ENOTIMPL;
+    }
+
+    return meta_store(mc, 'S', key, data, data_size, timeout, flags, cas);
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_touch(apr_memcache_t *mc,
+                   const char *key,
+                   apr_uint32_t timeout)
+{
+    apr_memcache_server_t *ms;
+    apr_memcache_conn_t *conn;
+    apr_status_t rv;
+    char args[BUFFER_SIZE];
+
+    if (!(mc->flags & APR_MEMCACHE_META)) {
+        return APR_ENOTIMPL;
+    }
+
+    /* mg <key> T<ttl>\r\n */
+    apr_snprintf(args, sizeof(args), " T%u" MC_EOL, timeout);
+
+    rv = meta_request(mc, MC_META_GET, key, args, NULL, 0, NULL, &ms, &conn);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (meta_is(conn->buffer, MS_META_HEADER)) {
+        rv = APR_SUCCESS;
+    }
+    else if (meta_is(conn->buffer, MS_META_MISS)) {
+        rv = APR_NOTFOUND;
+    }
+    else {
+        rv = APR_EGENERAL;
+    }
+
+    return meta_done(ms, conn, TRUE, rv);
+}
+
 APR_DECLARE(apr_status_t)
 apr_memcache_delete(apr_memcache_t *mc,
                     const char *key,
@@ -975,6 +1638,10 @@ apr_memcache_delete(apr_memcache_t *mc,
     struct iovec vec[3];
     apr_size_t klen = strlen(key);
 
+    if (mc->flags & APR_MEMCACHE_META) {
+        return meta_delete(mc, key);
+    }
+
     hash = apr_memcache_hash(mc, key, klen);
     ms = apr_memcache_find_server_hash(mc, hash);
     if (ms == NULL)
@@ -1032,6 +1699,7 @@ apr_memcache_delete(apr_memcache_t *mc,
 static apr_status_t num_cmd_write(apr_memcache_t *mc,
                                       char *cmd,
                                       const apr_uint32_t cmd_size,
+                                      char mode,
                                       const char *key,
                                       const apr_int32_t inc,
                                       apr_uint32_t *new_value)
@@ -1044,7 +1712,11 @@ static apr_status_t num_cmd_write(apr_memcache_t *mc,
     struct iovec vec[3];
     apr_size_t klen = strlen(key);
 
-    hash = apr_memcache_hash(mc, key, klen);
+    if (mc->flags & APR_MEMCACHE_META) {
+        return meta_arith(mc, mode, key, inc, new_value);
+    }
+
+    hash = apr_memcache_hash(mc, key, klen);
     ms = apr_memcache_find_server_hash(mc, hash);
     if (ms == NULL)
         return APR_NOTFOUND;
@@ -1110,6 +1782,7 @@ apr_memcache_incr(apr_memcache_t *mc,
     return num_cmd_write(mc,
                          MC_INCR,
                          MC_INCR_LEN,
+                         'I',
                          key,
                          inc,
                          new_value);
@@ -1125,6 +1798,7 @@ apr_memcache_decr(apr_memcache_t *mc,
     return num_cmd_write(mc,
                          MC_DECR,
                          MC_DECR_LEN,
+                         'D',
                          key,
                          inc,
                          new_value);
@@ -1274,6 +1948,12 @@ static void mget_conn_result(int serverup,
     }
 }
 
+/* Forward declare pipe_multgetp, the multiple get of the meta protocol */
+static apr_status_t pipe_multgetp(apr_memcache_t *mc,
+                                  apr_pool_t *temp_pool,
+                                  apr_pool_t *data_pool,
+                                  apr_hash_t *values);
+
 APR_DECLARE(apr_status_t)
 apr_memcache_multgetp(apr_memcache_t *mc,
                       apr_pool_t *temp_pool,
@@ -1306,6 +1986,9 @@ apr_memcache_multgetp(apr_memcache_t *mc,
     const apr_pollfd_t* activefds;
     apr_pollfd_t* pollfds;
 
+    if (mc->flags & APR_MEMCACHE_META) {
+        return pipe_multgetp(mc, temp_pool, data_pool, values);
+    }
 
     /* build all the queries */
     value_hash_index = apr_hash_first(temp_pool, values);
@@ -1563,6 +2246,736 @@ apr_memcache_multgetp(apr_memcache_t *mc,
 
 }
 
+/* Pipelined operations */
+
+#define PIPELINE_BUFFER_SIZE 16384
+
+typedef enum {
+    PIPE_GET,
+    PIPE_STORE,
+    PIPE_DELETE
+} pipe_op_e;
+
+typedef struct {
+    pipe_op_e type;
+    apr_memcache_value_t *value;
+} pipe_op_t;
+
+/** Operations queued to a server, and their progress while running */
+typedef struct {
+    apr_memcache_server_t *ms;
+    apr_memcache_conn_t *conn;
+    apr_array_header_t *vec;      /* iovecs of the requests */
+    apr_array_header_t *ops;      /* in the order of the requests */
+    int sent;                     /* iovecs written */
+    int replied;                  /* replies read */
+    int done;                     /* all replies read */
+    char *buf;                    /* replies read and not parsed yet */
+    apr_size_t bsize;
+    apr_size_t bpos;
+    apr_size_t blen;
+    apr_pollfd_t pfd;
+} pipe_server_t;
+
+struct apr_memcache_pipeline_t {
+    apr_memcache_t *mc;
+    apr_pool_t *p;
+    apr_pool_t *dp;               /* the data of the values */
+    int meta;
+    apr_memcache_pipeline_func func;
+    void *baton;
+    apr_hash_t *servers;
+};
+
+APR_DECLARE(apr_status_t)
+apr_memcache_pipeline_create(apr_memcache_pipeline_t **pipeline,
+                             apr_memcache_t *mc,
+                             apr_memcache_pipeline_func func,
+                             void *baton,
+                             apr_pool_t *p)
+{
+    apr_memcache_pipeline_t *pl;
+
+    pl = apr_palloc(p, sizeof(apr_memcache_pipeline_t));
+    pl->mc = mc;
+    pl->p = p;
+    pl->dp = p;
+    pl->meta = (mc->flags & APR_MEMCACHE_META) != 0;
+    pl->func = func;
+    pl->baton = baton;
+    pl->servers = apr_hash_make(p);
+
+    *pipeline = pl;
+    return APR_SUCCESS;
+}
+
+/* Queue an operation on the value to the server of its key, returning
+ * NULL if there is none, for the caller to push the request's iovecs.
+ */
+static pipe_server_t *pipe_queue_value(apr_memcache_pipeline_t *pl,
+                                       pipe_op_e type,
+                                       apr_memcache_value_t *value)
+{
+    apr_memcache_server_t *ms;
+    pipe_server_t *ps;
+    pipe_op_t *op;
+
+    ms = apr_memcache_find_server_hash(pl->mc,
+                                       apr_memcache_hash(pl->mc, value->key,
+                                                         strlen(value->key)));
+    if (ms == NULL) {
+        value->status = APR_NOTFOUND;
+        return NULL;
+    }
+    /* until the reply */
+    value->status = APR_INCOMPLETE;
+
+    ps = apr_hash_get(pl->servers, &ms, sizeof(ms));
+    if (!ps) {
+        ps = apr_pcalloc(pl->p, sizeof(pipe_server_t));
+        ps->ms = ms;
+        ps->vec = apr_array_make(pl->p, 64, sizeof(struct iovec));
+        ps->ops = apr_array_make(pl->p, 16, sizeof(pipe_op_t));
+        apr_hash_set(pl->servers, &ps->ms, sizeof(ps->ms), ps);
+    }
+
+    op = apr_array_push(ps->ops);
+    op->type = type;
+    op->value = value;
+
+    return ps;
+}
+
+static pipe_server_t *pipe_queue(apr_memcache_pipeline_t *pl,
+                                 pipe_op_e type,
+                                 const char *key,
+                                 apr_memcache_value_t **value_)
+{
+    apr_memcache_value_t *value;
+
+    value = apr_pcalloc(pl->p, sizeof(apr_memcache_value_t));
+    value->key = apr_pstrdup(pl->p, key);
+    if (value_) {
+        *value_ = value;
+    }
+
+    return pipe_queue_value(pl, type, value);
+}
+
+static void pipe_vec(pipe_server_t *ps, const void *base, apr_size_t len)
+{
+    struct iovec *vec = apr_array_push(ps->vec);
+
+    vec->iov_base = (void *)base;
+    vec->iov_len = len;
+}
+
+/* The meta flags of the last operation queued to the server, with its
+ * opaque token, and whether the server can skip the expected reply
+ */
+static const char *pipe_meta_args(apr_memcache_pipeline_t *pl,
+                                  pipe_server_t *ps, const char *args,
+                                  int quiet)
+{
+    return apr_psprintf(pl->p, "%s%s O%d" MC_EOL, args, quiet ? " q" : "",
+                        ps->ops->nelts - 1);
+}
+
+static void pipe_get_request(apr_memcache_pipeline_t *pl, pipe_server_t *ps,
+                             apr_memcache_value_t *value)
+{
+    const char *args;
+
+    if (pl->meta) {
+        /* mg <key> v f c q O<opaque>\r\n */
+        args = pipe_meta_args(pl, ps, " v f c", TRUE);
+        pipe_vec(ps, MC_META_GET, MC_META_GET_LEN);
+        pipe_vec(ps, value->key, strlen(value->key));
+        pipe_vec(ps, args, strlen(args));
+        return;
+    }
+
+    /* get <key>\r\n */
+    pipe_vec(ps, MC_GET, MC_GET_LEN);
+    pipe_vec(ps, value->key, strlen(value->key));
+    pipe_vec(ps, MC_EOL, MC_EOL_LEN);
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_pipeline_get(apr_memcache_pipeline_t *pipeline,
+                          const char *key,
+                          apr_memcache_value_t **value_)
+{
+    apr_memcache_value_t *value;
+    pipe_server_t *ps;
+
+    ps = pipe_queue(pipeline, PIPE_GET, key, &value);
+    if (value_) {
+        *value_ = value;
+    }
+    if (!ps) {
+        return APR_NOTFOUND;
+    }
+
+    pipe_get_request(pipeline, ps, value);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_pipeline_set(apr_memcache_pipeline_t *pipeline,
+                          const char *key,
+                          char *data,
+                          const apr_size_t data_size,
+                          apr_uint32_t timeout,
+                          apr_uint16_t flags,
+                          apr_memcache_value_t **value_)
+{
+    apr_memcache_value_t *value;
+    pipe_server_t *ps;
+    const char *args;
+
+    ps = pipe_queue(pipeline, PIPE_STORE, key, &value);
+    if (value_) {
+        *value_ = value;
+    }
+    if (!ps) {
+        return APR_NOTFOUND;
+    }
+
+    if (pipeline->meta) {
+        /* ms <key> <bytes> F<flags> T<exptime> q O<opaque>\r\n<data>\r\n */
+        args = apr_psprintf(pipeline->p, " %" APR_SIZE_T_FMT " F%u T%u",
+                            data_size, flags, timeout);
+        args = pipe_meta_args(pipeline, ps, args, TRUE);
+        pipe_vec(ps, MC_META_SET, MC_META_SET_LEN);
+    }
+    else {
+        /* set <key> <flags> <exptime> <bytes>\r\n<data>\r\n */
+        args = apr_psprintf(pipeline->p, " %u %u %" APR_SIZE_T_FMT MC_EOL,
+                            flags, timeout, data_size);
+        pipe_vec(ps, MC_SET, MC_SET_LEN);
+    }
+
+    pipe_vec(ps, value->key, strlen(value->key));
+    pipe_vec(ps, args, strlen(args));
+    pipe_vec(ps, data, data_size);
+    pipe_vec(ps, MC_EOL, MC_EOL_LEN);
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_pipeline_delete(apr_memcache_pipeline_t *pipeline,
+                             const char *key,
+                             apr_memcache_value_t **value_)
+{
+    apr_memcache_value_t *value;
+    pipe_server_t *ps;
+    const char *args;
+
+    ps = pipe_queue(pipeline, PIPE_DELETE, key, &value);
+    if (value_) {
+        *value_ = value;
+    }
+    if (!ps) {
+        return APR_NOTFOUND;
+    }
+
+    if (pipeline->meta) {
+        /* md <key> O<opaque>\r\n, not quiet which would skip NF too */
+        args = pipe_meta_args(pipeline, ps, "", FALSE);
+        pipe_vec(ps, MC_META_DELETE, MC_META_DELETE_LEN);
+        pipe_vec(ps, value->key, strlen(value->key));
+        pipe_vec(ps, args, strlen(args));
+        return APR_SUCCESS;
+    }
+
+    /* delete <key>\r\n */
+    pipe_vec(ps, MC_DELETE, MC_DELETE_LEN);
+    pipe_vec(ps, value->key, strlen(value->key));
+    pipe_vec(ps, MC_EOL, MC_EOL_LEN);
+
+    return APR_SUCCESS;
+}
+
+static void pipe_reply(apr_memcache_pipeline_t *pl, pipe_server_t *ps,
+                       apr_status_t rv)
+{
+    pipe_op_t *op = &APR_ARRAY_IDX(ps->ops, ps->replied, pipe_op_t);
+
+    op->value->status = rv;
+    ps->replied++;
+    if (pl->func) {
+        pl->func(pl->baton, op->value);
+    }
+}
+
+/* Done with the server, failing the operations not replied yet with rv */
+static void pipe_server_done(apr_memcache_pipeline_t *pl, pipe_server_t *ps,
+                             int serverup, apr_status_t rv)
+{
+    while (ps->replied < ps->ops->nelts) {
+        pipe_reply(pl, ps, rv);
+    }
+
+    if (ps->conn) {
+        apr_socket_timeout_set(ps->conn->sock, -1);
+        if (rv == APR_SUCCESS) {
+            ms_release_conn(ps->ms, ps->conn);
+        }
+        else {
+            ms_bad_conn(ps->ms, ps->conn);
+        }
+        ps->conn = NULL;
+    }
+    if (!serverup) {
+        apr_memcache_disable_server(pl->mc, ps->ms);
+    }
+}
+
+/* Write what the socket takes of the requests */
+static apr_status_t pipe_send(pipe_server_t *ps)
+{
+    struct iovec *vec = (struct iovec *)ps->vec->elts;
+    apr_size_t written;
+    apr_status_t rv;
+    int n;
+
+    while (ps->sent < ps->vec->nelts) {
+        n = ps->vec->nelts - ps->sent;
+        rv = apr_socket_sendv(ps->conn->sock, vec + ps->sent,
+                              n > APR_MAX_IOVEC_SIZE ? APR_MAX_IOVEC_SIZE : n,
+                              &written);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+
+        while (ps->sent < ps->vec->nelts && written >= vec[ps->sent].iov_len) {
+            written -= vec[ps->sent].iov_len;
+            ps->sent++;
+        }
+        if (written) {
+            vec[ps->sent].iov_base = (char *)vec[ps->sent].iov_base + written;
+            vec[ps->sent].iov_len -= written;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+/* Whether the line (with its \r\n) is the given reply */
+static int pipe_line_is(const char *line, apr_size_t len,
+                        const char *reply, apr_size_t reply_len)
+{
+    return len == reply_len + MC_EOL_LEN && !memcmp(line, reply, reply_len)
+           && !memcmp(line + reply_len, MC_EOL, MC_EOL_LEN);
+}
+
+/* Reply to the operations before the opaque token, which the server
+ * skipped being quiet
+ */
+static void pipe_skipped(apr_memcache_pipeline_t *pl, pipe_server_t *ps,
+                         int opaque)
+{
+    pipe_op_t *op;
+
+    while (ps->replied < opaque) {
+        op = &APR_ARRAY_IDX(ps->ops, ps->replied, pipe_op_t);
+        pipe_reply(pl, ps, op->type == PIPE_GET ? APR_NOTFOUND : APR_SUCCESS);
+    }
+}
+
+/* Parse the complete meta replies in the buffer, up to MN */
+static apr_status_t pipe_parse_meta(apr_memcache_pipeline_t *pl,
+                                    pipe_server_t *ps)
+{
+    apr_memcache_value_t *value;
+    const char *token;
+    char *line, *eol, *data;
+    apr_size_t len, size;
+    apr_status_t rv;
+    int opaque;
+
+    while (!ps->done) {
+        line = ps->buf + ps->bpos;
+        eol = memchr(line, '\n', ps->blen - ps->bpos);
+        if (!eol) {
+            break;
+        }
+        len = eol + 1 - line;
+        if (len < MS_META_LEN + MC_EOL_LEN || eol[-1] != '\r') {
+            return APR_EGENERAL;
+        }
+
+        if (meta_is(line, MS_META_NOOP)) {
+            ps->bpos += len;
+            pipe_skipped(pl, ps, ps->ops->nelts);
+            ps->done = 1;
+            break;
+        }
+
+        token = meta_flag(line, 'O');
+        opaque = token ? atoi(token) : -1;
+        if (opaque < ps->replied || opaque >= ps->ops->nelts) {
+            /* CLIENT_ERROR, SERVER_ERROR, or out of sync */
+            return APR_EGENERAL;
+        }
+        value = APR_ARRAY_IDX(ps->ops, opaque, pipe_op_t).value;
+
+        if (meta_is(line, MS_META_VALUE)) {
+            /* VA <bytes> f<flags> c<cas> O<opaque>\r\n<data>\r\n */
+            if (!parse_size(line + MS_META_LEN + 1, &size)) {
+                return APR_EGENERAL;
+            }
+            if (ps->blen - ps->bpos - len < size + MC_EOL_LEN) {
+                break;
+            }
+            data = line + len;
+            if (memcmp(data + size, MC_EOL, MC_EOL_LEN)) {
+                return APR_EGENERAL;
+            }
+
+            value->data = apr_palloc(pl->dp, size + 1);
+            memcpy(value->data, data, size);
+            value->data[size] = '\0';
+            value->len = size;
+            token = meta_flag(line, 'f');
+            value->flags = token ? (apr_uint16_t)atoi(token) : 0;
+            token = meta_flag(line, 'c');
+            value->cas = token ? apr_strtoi64(token, NULL, 10) : 0;
+
+            len += size + MC_EOL_LEN;
+            rv = APR_SUCCESS;
+        }
+        else if (meta_is(line, MS_META_HEADER)) {
+            rv = APR_SUCCESS;
+        }
+        else if (meta_is(line, MS_META_MISS)
+                 || meta_is(line, MS_META_NOT_FOUND)) {
+            rv = APR_NOTFOUND;
+        }
+        else if (meta_is(line, MS_META_NOT_STORED)
+                 || meta_is(line, MS_META_EXISTS)) {
+            rv = APR_EEXIST;
+        }
+        else {
+            return APR_EGENERAL;
+        }
+
+        ps->bpos += len;
+        pipe_skipped(pl, ps, opaque);
+        pipe_reply(pl, ps, rv);
+    }
+
+    return APR_SUCCESS;
+}
+
+/* Parse the complete replies in the buffer */
+static apr_status_t pipe_parse(apr_memcache_pipeline_t *pl,
+                               pipe_server_t *ps)
+{
+    apr_memcache_value_t *value;
+    pipe_op_t *op;
+    char *line, *eol, *data, *end;
+    apr_size_t len, klen, size;
+
+    if (pl->meta) {
+        return pipe_parse_meta(pl, ps);
+    }
+
+    while (ps->replied < ps->ops->nelts) {
+        op = &APR_ARRAY_IDX(ps->ops, ps->replied, pipe_op_t);
+        value = op->value;
+
+        line = ps->buf + ps->bpos;
+        eol = memchr(line, '\n', ps->blen - ps->bpos);
+        if (!eol) {
+            break;
+        }
+        len = eol + 1 - line;
+
+        if (op->type == PIPE_GET && value->status == APR_INCOMPLETE
+            && len > MS_VALUE_LEN + 1 && !memcmp(line, MS_VALUE " ",
+                                                 MS_VALUE_LEN + 1)) {
+            /* VALUE <key> <flags> <bytes> [<cas unique>]\r\n<data>\r\n */
+            klen = strlen(value->key);
+            data = line + MS_VALUE_LEN + 1;
+            if (len < MS_VALUE_LEN + 1 + klen + 1
+                || memcmp(data, value->key, klen) || data[klen] != ' ') {
+                /* not the key asked for */
+                return APR_EGENERAL;
+            }
+            data += klen + 1;
+            value->flags = (apr_uint16_t)strtoul(data, &end, 10);
+            if (end == data || *end != ' ' || !parse_size(end + 1, &size)) {
+                return APR_EGENERAL;
+            }
+            if (ps->blen - ps->bpos - len < size + MC_EOL_LEN) {
+                break;
+            }
+            data = line + len;
+            if (memcmp(data + size, MC_EOL, MC_EOL_LEN)) {
+                return APR_EGENERAL;
+            }
+
+            value->data = apr_palloc(pl->dp, size + 1);
+            memcpy(value->data, data, size);
+            value->data[size] = '\0';
+            value->len = size;
+            /* the reply completes with END */
+            value->status = APR_SUCCESS;
+
+            ps->bpos += len + size + MC_EOL_LEN;
+            continue;
+        }
+        ps->bpos += len;
+
+        if (pipe_line_is(line, len, MS_END, MS_END_LEN)
+            && op->type == PIPE_GET) {
+            pipe_reply(pl, ps, value->status == APR_SUCCESS ? APR_SUCCESS
+                                                            : APR_NOTFOUND);
+        }
+        else if (pipe_line_is(line, len, MS_STORED, MS_STORED_LEN)
+                 && op->type == PIPE_STORE) {
+            pipe_reply(pl, ps, APR_SUCCESS);
+        }
+        else if (pipe_line_is(line, len, MS_NOT_STORED, MS_NOT_STORED_LEN)
+                 && op->type == PIPE_STORE) {
+            pipe_reply(pl, ps, APR_EEXIST);
+        }
+        else if (pipe_line_is(line, len, MS_DELETED, MS_DELETED_LEN)
+                 && op->type == PIPE_DELETE) {
+            pipe_reply(pl, ps, APR_SUCCESS);
+        }
+        else if (pipe_line_is(line, len, MS_NOT_FOUND, MS_NOT_FOUND_LEN)
+                 && op->type == PIPE_DELETE) {
+            pipe_reply(pl, ps, APR_NOTFOUND);
+        }
+        else if (len > MS_SERVER_ERROR_LEN
+                 && !memcmp(line, MS_SERVER_ERROR, MS_SERVER_ERROR_LEN)) {
+            /* this operation failed, the next ones may not */
+            pipe_reply(pl, ps, APR_EGENERAL);
+        }
+        else {
+            /* ERROR, CLIENT_ERROR, or out of sync */
+            return APR_EGENERAL;
+        }
+    }
+
+    ps->done = (ps->replied == ps->ops->nelts);
+    return APR_SUCCESS;
+}
+
+/* Read what the socket has of the replies and parse them */
+static apr_status_t pipe_recv(apr_memcache_pipeline_t *pl,
+                              pipe_server_t *ps)
+{
+    apr_size_t len;
+    apr_status_t rv;
+    char *buf;
+
+    while (!ps->done) {
+        if (ps->bpos == ps->blen) {
+            ps->bpos = ps->blen = 0;
+        }
+        else if (ps->blen == ps->bsize) {
+            if (ps->bpos) {
+                memmove(ps->buf, ps->buf + ps->bpos, ps->blen - ps->bpos);
+                ps->blen -= ps->bpos;
+                ps->bpos = 0;
+            }
+            else {
+                /* a reply larger than the buffer */
+                buf = apr_palloc(ps->conn->tp, ps->bsize * 2);
+                memcpy(buf, ps->buf, ps->blen);
+                ps->buf = buf;
+                ps->bsize *= 2;
+            }
+        }
+
+        len = ps->bsize - ps->blen;
+        rv = apr_socket_recv(ps->conn->sock, ps->buf + ps->blen, &len);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        ps->blen += len;
+
+        rv = pipe_parse(pl, ps);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t)
+apr_memcache_pipeline_run(apr_memcache_pipeline_t *pipeline,
+                          apr_interval_time_t timeout)
+{
+    apr_pool_t *tp;
+    apr_pollset_t *pollset;
+    const apr_pollfd_t *activefds;
+    apr_hash_index_t *hi;
+    pipe_server_t *ps;
+    apr_int32_t i, nactive;
+    apr_status_t rv, prv, status = APR_SUCCESS;
+    int running = 0;
+
+    if (!apr_hash_count(pipeline->servers)) {
+        return APR_SUCCESS;
+    }
+
+    apr_pool_create(&tp, pipeline->p);
+    prv = apr_pollset_create(&pollset, apr_hash_count(pipeline->servers),
+                             tp, 0);
+
+    /* connect to all the servers, the requests go once writable */
+    for (hi = apr_hash_first(NULL, pipeline->servers); hi;
+         hi = apr_hash_next(hi)) {
+        ps = apr_hash_this_val(hi);
+
+        if (pipeline->meta) {
+            /* the quiet replies complete with MN */
+            pipe_vec(ps, MC_META_NOOP, MC_META_NOOP_LEN);
+        }
+
+        if (prv != APR_SUCCESS) {
+            pipe_server_done(pipeline, ps, TRUE, prv);
+            status = prv;
+            continue;
+        }
+
+        rv = ms_find_conn(ps->ms, &ps->conn);
+        if (rv != APR_SUCCESS) {
+            ps->conn = NULL;
+            pipe_server_done(pipeline, ps, FALSE, rv);
+            status = rv;
+            continue;
+        }
+
+        ps->buf = apr_palloc(ps->conn->tp, PIPELINE_BUFFER_SIZE);
+        ps->bsize = PIPELINE_BUFFER_SIZE;
+
+        ps->pfd.desc_type = APR_POLL_SOCKET;
+        ps->pfd.reqevents = APR_POLLIN | APR_POLLOUT;
+        ps->pfd.p = tp;
+        ps->pfd.desc.s = ps->conn->sock;
+        ps->pfd.client_data = ps;
+
+        if ((rv = apr_socket_timeout_set(ps->conn->sock, 0)) != APR_SUCCESS
+            || (rv = apr_pollset_add(pollset, &ps->pfd)) != APR_SUCCESS) {
+            pipe_server_done(pipeline, ps, TRUE, rv);
+            status = rv;
+            continue;
+        }
+        running++;
+    }
+
+    while (running) {
+        rv = apr_pollset_poll(pollset, timeout, &nactive, &activefds);
+        if (APR_STATUS_IS_EINTR(rv)) {
+            continue;
+        }
+        if (rv != APR_SUCCESS) {
+            /* timeout, the servers not done yet fail below */
+            status = rv;
+            break;
+        }
+
+        for (i = 0; i < nactive; i++) {
+            ps = activefds[i].client_data;
+
+            if (ps->sent < ps->vec->nelts
+                && (activefds[i].rtnevents & APR_POLLOUT)) {
+                rv = pipe_send(ps);
+                if (rv == APR_SUCCESS && ps->sent == ps->vec->nelts) {
+                    /* all sent, only the replies are left */
+                    apr_pollset_remove(pollset, &ps->pfd);
+                    ps->pfd.reqevents = APR_POLLIN;
+                    rv = apr_pollset_add(pollset, &ps->pfd);
+                }
+                if (rv != APR_SUCCESS) {
+                    apr_pollset_remove(pollset, &ps->pfd);
+                    pipe_server_done(pipeline, ps, FALSE, rv);
+                    status = rv;
+                    running--;
+                    continue;
+                }
+            }
+
+            if (activefds[i].rtnevents & (APR_POLLIN | APR_POLLHUP
+                                          | APR_POLLERR)) {
+                rv = pipe_recv(pipeline, ps);
+                if (rv != APR_SUCCESS) {
+                    apr_pollset_remove(pollset, &ps->pfd);
+                    /* a reply out of sync is not the server's fault */
+                    pipe_server_done(pipeline, ps, rv == APR_EGENERAL, rv);
+                    status = rv;
+                    running--;
+                    continue;
+                }
+            }
+
+            if (ps->done) {
+                apr_pollset_remove(pollset, &ps->pfd);
+                pipe_server_done(pipeline, ps, TRUE, APR_SUCCESS);
+                running--;
+            }
+        }
+    }
+
+    if (running) {
+        for (hi = apr_hash_first(NULL, pipeline->servers); hi;
+             hi = apr_hash_next(hi)) {
+            ps = apr_hash_this_val(hi);
+            if (ps->conn) {
+                pipe_server_done(pipeline, ps, TRUE, status);
+            }
+        }
+    }
+
+    apr_pool_destroy(tp);
+    apr_hash_clear(pipeline->servers);
+
+    return status;
+}
+
+static apr_status_t pipe_multgetp(apr_memcache_t *mc,
+                                  apr_pool_t *temp_pool,
+                                  apr_pool_t *data_pool,
+                                  apr_hash_t *values)
+{
+    apr_memcache_pipeline_t *pl;
+    apr_memcache_value_t *value;
+    apr_hash_index_t *hi;
+    pipe_server_t *ps;
+
+    apr_memcache_pipeline_create(&pl, mc, NULL, NULL, temp_pool);
+    pl->dp = data_pool;
+
+    for (hi = apr_hash_first(temp_pool, values); hi; hi = apr_hash_next(hi)) {
+        value = apr_hash_this_val(hi);
+        ps = pipe_queue_value(pl, PIPE_GET, value);
+        if (ps) {
+            pipe_get_request(pl, ps, value);
+        }
+    }
+
+    /* the values of the servers failing have their status */
+    apr_memcache_pipeline_run(pl, MULT_GET_TIMEOUT);
+
+    apr_pool_clear(temp_pool);
+    return APR_SUCCESS;
+}
+
 
 
 /**
@@ -25,6 +25,7 @@
 #include "apr_allocator.h"
 #include "apr_lib.h"
 #include "apr_thread_mutex.h"
+#include "apr_thread_proc.h" /* for APR_THREAD_LOCAL */
 #include "apr_hash.h"
 #include "apr_time.h"
 #include "apr_support.h"
@@ -44,10 +45,30 @@
 #define APR_ALLOCATOR_USES_MMAP   1
 #endif
 
-#if APR_ALLOCATOR_USES_MMAP
+/*
+ * Huge pages and/or NUMA bound arenas need anonymous mmap()ing.
+ */
+#if HAVE_SYS_MMAN_H && HAVE_MMAP && HAVE_MAP_ANON \
+    && !APR_ALLOCATOR_GUARD_PAGES
+#define ALLOCATOR_HAS_ARENAS 1
+#else
+#define ALLOCATOR_HAS_ARENAS 0
+#endif
+
+#if APR_ALLOCATOR_USES_MMAP || ALLOCATOR_HAS_ARENAS
 #include <sys/mman.h>
 #endif
 
+#if ALLOCATOR_HAS_ARENAS && defined(__linux__) && HAVE_SYS_SYSCALL_H
+#include <sys/syscall.h>
+#if defined(SYS_mbind)
+#define ALLOCATOR_HAS_MBIND 1
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+#endif
+#endif
+
 #if HAVE_VALGRIND
 #define REDZONE APR_ALIGN_DEFAULT(8)
 int apr_running_on_valgrind = 0;
@@ -105,6 +126,15 @@ static unsigned int boundary_size;
 #define TIMEOUT_USECS    3000000
 #define TIMEOUT_INTERVAL   46875
 
+/*
+ * Per-thread magazines need thread local storage.
+ */
+#if APR_HAS_THREADS && APR_HAS_THREAD_LOCAL
+#define ALLOCATOR_HAS_MAGAZINES 1
+#else
+#define ALLOCATOR_HAS_MAGAZINES 0
+#endif
+
 /*
  * Allocator
  *
@@ -142,10 +172,93 @@ struct apr_allocator_t {
      * slot 20: nodes larger than 81920
      */
     apr_memnode_t      *free[MAX_INDEX + 1];
+    /** Nodes with an index below this one are carved from the arenas
+     * (if any), and never given back to the system until the allocator
+     * is destroyed.  @see apr_allocator_create_ex()
+     */
+    apr_size_t          arena_max_index;
+#if ALLOCATOR_HAS_ARENAS
+    apr_uint32_t        arena_flags;
+    int                 arena_numa_node;
+    char               *arena_avail;
+    char               *arena_endp;
+    struct allocator_arena_t *arenas;
+#endif
+#if ALLOCATOR_HAS_MAGAZINES
+    /** Per-thread magazines (if any), @see apr_allocator_magazines_set() */
+    char               *magazines;
+    void               *magazines_mem;
+    apr_uint32_t        magazines_mask;
+    apr_uint32_t        magazine_depth;
+#endif
 };
 
 #define SIZEOF_ALLOCATOR_T  APR_ALIGN_DEFAULT(sizeof(apr_allocator_t))
 
+#if ALLOCATOR_HAS_ARENAS
+/*
+ * Arenas
+ *
+ * Huge page aligned regions which the allocator's small nodes are carved
+ * from, when asked for by apr_allocator_create_ex().  Either explicit huge
+ * pages (MAP_HUGETLB) or transparent ones (MADV_HUGEPAGE) are used, with
+ * a fallback to regular pages if that's not supported.  The arenas can
+ * also be bound to a preferred NUMA node.
+ */
+#define ARENA_SIZE      (2 * 1024 * 1024)
+#define ARENA_NODEMASK  1024 /* max NUMA nodes */
+
+typedef struct allocator_arena_t {
+    struct allocator_arena_t *next;
+    char                     *base;
+} allocator_arena_t;
+#endif /* ALLOCATOR_HAS_ARENAS */
+
+#if ALLOCATOR_HAS_MAGAZINES
+/*
+ * Magazines
+ *
+ * Optional caches of free nodes sitting in front of the allocator's
+ * free[] lists, for the MAGAZINE_SLOTS smallest node sizes.  Each thread
+ * is bound to one magazine (by a thread local slot number) and nodes move
+ * between a magazine and the shared lists in batches of half the magazine
+ * depth, so that the allocator mutex is taken once per batch rather than
+ * once per node.  A magazine which is busy (because another thread maps
+ * to the same slot) is simply bypassed.
+ *
+ * When max_free_index is limited, a magazine reserves some of the
+ * allocator's current_free_index up front and holds free nodes within
+ * that reservation only, such that the total size of the free nodes
+ * kept by the allocator and all its magazines stays bounded by the
+ * max_free_index.
+ */
+#define MAGAZINE_SLOTS          8
+#define MAGAZINE_DEPTH_DEFAULT  16
+#define MAGAZINE_COUNT_MAX      1024
+#define MAGAZINE_CACHELINE      64
+
+typedef struct allocator_magazine_t {
+    /** Non-zero while some thread works on this magazine */
+    apr_uint32_t       lock;
+    /** Number of nodes in each slot */
+    apr_uint32_t       count[MAGAZINE_SLOTS];
+    /** Size (in BOUNDARY_SIZE multiples) of all the nodes held */
+    apr_size_t         held;
+    /** Size (in BOUNDARY_SIZE multiples) reserved from the allocator's
+     * current_free_index, always >= held
+     */
+    apr_size_t         reserved;
+    /** Lists of free nodes, slot i contains nodes of index i */
+    apr_memnode_t     *free[MAGAZINE_SLOTS];
+} allocator_magazine_t;
+
+#define SIZEOF_MAGAZINE_T   APR_ALIGN(sizeof(allocator_magazine_t), \
+                                      MAGAZINE_CACHELINE)
+
+static APR_THREAD_LOCAL apr_uint32_t magazine_slot;
+static apr_uint32_t magazine_slot_next;
+#endif /* ALLOCATOR_HAS_MAGAZINES */
+
 
 /*
  * Allocator
@@ -186,6 +299,72 @@ APR_DECLARE(apr_status_t) apr_allocator_create(apr_allocator_t **allocator)
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_allocator_create_ex(apr_allocator_t **allocator,
+                                                  apr_uint32_t flags,
+                                                  int numa_node)
+{
+#if ALLOCATOR_HAS_ARENAS
+    apr_allocator_t *new_allocator;
+    apr_size_t max_index;
+    apr_status_t rv;
+
+    *allocator = NULL;
+
+    if (numa_node >= ARENA_NODEMASK) {
+        return APR_EINVAL;
+    }
+#if !ALLOCATOR_HAS_MBIND
+    if (numa_node >= 0) {
+        return APR_ENOTIMPL;
+    }
+#endif
+    if (BOUNDARY_SIZE > ARENA_SIZE / 4 && (flags || numa_node >= 0)) {
+        return APR_ENOTIMPL;
+    }
+
+    if ((rv = apr_allocator_create(&new_allocator)) != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (flags || numa_node >= 0) {
+        /* Carve the nodes up to a quarter of an arena, so that the
+         * remainder of an exhausted arena is never too large.
+         */
+        max_index = (ARENA_SIZE / 4) >> BOUNDARY_INDEX;
+        new_allocator->arena_max_index = max_index < MAX_INDEX ? max_index
+                                                               : MAX_INDEX;
+        new_allocator->arena_flags = flags;
+        new_allocator->arena_numa_node = numa_node;
+    }
+
+    *allocator = new_allocator;
+
+    return APR_SUCCESS;
+#else
+    if (!flags && numa_node < 0) {
+        /* Documented as the same as apr_allocator_create() */
+        return apr_allocator_create(allocator);
+    }
+    *allocator = NULL;
+    return APR_ENOTIMPL;
+#endif
+}
+
+static APR_INLINE
+void allocator_node_release(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    if (node->index < allocator->arena_max_index) {
+        /* Owned by an arena */
+        return;
+    }
+#if APR_ALLOCATOR_USES_MMAP
+    munmap((char *)node - GUARDPAGE_SIZE,
+           2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
+#else
+    free(node);
+#endif
+}
+
 APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
 {
     apr_size_t index;
@@ -195,15 +374,39 @@ APR_DECLARE(void) apr_allocator_destroy(apr_allocator_t *allocator)
         ref = &allocator->free[index];
         while ((node = *ref) != NULL) {
             *ref = node->next;
-#if APR_ALLOCATOR_USES_MMAP
-            munmap((char *)node - GUARDPAGE_SIZE,
-                   2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
-#else
-            free(node);
-#endif
+            allocator_node_release(allocator, node);
         }
     }
 
+#if ALLOCATOR_HAS_MAGAZINES
+    if (allocator->magazines) {
+        apr_uint32_t i;
+
+        for (i = 0; i <= allocator->magazines_mask; i++) {
+            allocator_magazine_t *mag = (allocator_magazine_t *)
+                (allocator->magazines + i * SIZEOF_MAGAZINE_T);
+
+            for (index = 0; index < MAGAZINE_SLOTS; index++) {
+                while ((node = mag->free[index]) != NULL) {
+                    mag->free[index] = node->next;
+                    allocator_node_release(allocator, node);
+                }
+            }
+        }
+        free(allocator->magazines_mem);
+    }
+#endif
+
+#if ALLOCATOR_HAS_ARENAS
+    while (allocator->arenas) {
+        allocator_arena_t *arena = allocator->arenas;
+
+        allocator->arenas = arena->next;
+        munmap(arena->base, ARENA_SIZE);
+        free(arena);
+    }
+#endif
+
     free(allocator);
 }
 
@@ -232,12 +435,23 @@ APR_DECLARE(apr_pool_t *) apr_allocator_owner_get(apr_allocator_t *allocator)
     return allocator->owner;
 }
 
+#if ALLOCATOR_HAS_MAGAZINES
+static void magazines_drain(apr_allocator_t *allocator);
+#endif
+
 APR_DECLARE(void) apr_allocator_max_free_set(apr_allocator_t *allocator,
                                              apr_size_t in_size)
 {
     apr_size_t max_free_index;
     apr_size_t size = in_size;
 
+#if ALLOCATOR_HAS_MAGAZINES
+    /* Release the magazines' reservations against the previous limit */
+    if (allocator->magazines) {
+        magazines_drain(allocator);
+    }
+#endif
+
     allocator_lock(allocator);
 
     max_free_index = APR_ALIGN(size, BOUNDARY_SIZE) >> BOUNDARY_INDEX;
@@ -276,6 +490,390 @@ APR_DECLARE(apr_size_t) apr_allocator_align(apr_allocator_t *allocator,
     return allocator_align(size);
 }
 
+#if ALLOCATOR_HAS_ARENAS
+static char *arena_map(apr_allocator_t *allocator)
+{
+    char *base = MAP_FAILED, *mem;
+    apr_size_t head, tail;
+
+#ifdef MAP_HUGETLB
+    if (allocator->arena_flags & APR_ALLOCATOR_HUGETLB) {
+        base = mmap(NULL, ARENA_SIZE, PROT_READ|PROT_WRITE,
+                    MAP_PRIVATE|MAP_ANON|MAP_HUGETLB, -1, 0);
+    }
+#endif
+    if (base == MAP_FAILED) {
+        /* Align the arena on a huge page boundary, so that it can be
+         * backed by transparent huge pages.
+         */
+        mem = mmap(NULL, 2 * ARENA_SIZE, PROT_READ|PROT_WRITE,
+                   MAP_PRIVATE|MAP_ANON, -1, 0);
+        if (mem == MAP_FAILED) {
+            return NULL;
+        }
+        base = (char *)APR_ALIGN((apr_uintptr_t)mem, ARENA_SIZE);
+        head = base - mem;
+        tail = ARENA_SIZE - head;
+        if (head) {
+            munmap(mem, head);
+        }
+        if (tail) {
+            munmap(base + ARENA_SIZE, tail);
+        }
+#ifdef MADV_HUGEPAGE
+        if (allocator->arena_flags & (APR_ALLOCATOR_HUGEPAGES |
+                                      APR_ALLOCATOR_HUGETLB)) {
+            (void)madvise(base, ARENA_SIZE, MADV_HUGEPAGE);
+        }
+#endif
+    }
+
+#if ALLOCATOR_HAS_MBIND
+    if (allocator->arena_numa_node >= 0) {
+        unsigned long mask[ARENA_NODEMASK / (8 * sizeof(unsigned long))];
+        int node = allocator->arena_numa_node;
+
+        /* Best effort, the kernel may not support NUMA */
+        memset(mask, 0, sizeof mask);
+        mask[node / (8 * sizeof(unsigned long))] =
+            1UL << (node % (8 * sizeof(unsigned long)));
+        (void)syscall(SYS_mbind, base, (unsigned long)ARENA_SIZE,
+                      MPOL_PREFERRED, mask, ARENA_NODEMASK + 1, 0);
+    }
+#endif
+
+    return base;
+}
+
+static apr_memnode_t *arena_alloc(apr_allocator_t *allocator, apr_size_t size)
+{
+    allocator_arena_t *arena;
+    apr_memnode_t *node = NULL;
+    apr_size_t remain, index;
+    char *base;
+
+    allocator_lock(allocator);
+
+    remain = allocator->arena_endp - allocator->arena_avail;
+    if (remain < size) {
+        if ((arena = malloc(sizeof(*arena))) == NULL) {
+            goto out;
+        }
+        if ((base = arena_map(allocator)) == NULL) {
+            free(arena);
+            goto out;
+        }
+        arena->base = base;
+        arena->next = allocator->arenas;
+        allocator->arenas = arena;
+
+        /* Recycle the remainder of the previous arena as a free node */
+        if (remain) {
+            node = (apr_memnode_t *)allocator->arena_avail;
+            node->index = index = (remain >> BOUNDARY_INDEX) - 1;
+            node->endp = allocator->arena_endp;
+            node->next = allocator->free[index];
+            allocator->free[index] = node;
+            if (index > allocator->max_index) {
+                allocator->max_index = index;
+            }
+            if (allocator->current_free_index >= index + 1)
+                allocator->current_free_index -= index + 1;
+            else
+                allocator->current_free_index = 0;
+        }
+
+        allocator->arena_avail = base;
+        allocator->arena_endp = base + ARENA_SIZE;
+    }
+
+    node = (apr_memnode_t *)allocator->arena_avail;
+    allocator->arena_avail += size;
+
+out:
+    allocator_unlock(allocator);
+
+    return node;
+}
+#endif /* ALLOCATOR_HAS_ARENAS */
+
+static APR_INLINE
+void allocator_free_shared(apr_allocator_t *allocator, apr_memnode_t *node,
+                           apr_size_t released)
+{
+    apr_memnode_t *next, *freelist = NULL;
+    apr_size_t index, max_index;
+    apr_size_t max_free_index, current_free_index;
+
+    allocator_lock(allocator);
+
+    max_index = allocator->max_index;
+    max_free_index = allocator->max_free_index;
+    current_free_index = allocator->current_free_index;
+
+    /* Give back what the magazines had reserved (if any) */
+    if (released) {
+        current_free_index += released;
+        if (current_free_index > max_free_index)
+            current_free_index = max_free_index;
+    }
+
+    /* Walk the list of submitted nodes and free them one by one,
+     * shoving them in the right 'size' buckets as we go.
+     */
+    for (; node != NULL; node = next) {
+        next = node->next;
+        index = node->index;
+
+        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                              (node->index+1) << BOUNDARY_INDEX);
+
+        if (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
+            && index + 1 > current_free_index
+            && index >= allocator->arena_max_index) {
+            node->next = freelist;
+            freelist = node;
+        }
+        else if (index < MAX_INDEX) {
+            /* Add the node to the appropriate 'size' bucket.  Adjust
+             * the max_index when appropriate.
+             */
+            if ((node->next = allocator->free[index]) == NULL
+                && index > max_index) {
+                max_index = index;
+            }
+            allocator->free[index] = node;
+            if (current_free_index >= index + 1)
+                current_free_index -= index + 1;
+            else
+                current_free_index = 0;
+        }
+        else {
+            /* This node is too large to keep in a specific size bucket,
+             * just add it to the sink (at index MAX_INDEX).
+             */
+            node->next = allocator->free[MAX_INDEX];
+            allocator->free[MAX_INDEX] = node;
+            if (current_free_index >= index + 1)
+                current_free_index -= index + 1;
+            else
+                current_free_index = 0;
+        }
+    }
+
+    allocator->max_index = max_index;
+    allocator->current_free_index = current_free_index;
+
+    allocator_unlock(allocator);
+
+    while (freelist != NULL) {
+        node = freelist;
+        freelist = node->next;
+        allocator_node_release(allocator, node);
+    }
+}
+
+#if ALLOCATOR_HAS_MAGAZINES
+
+static APR_INLINE
+allocator_magazine_t *magazine_get(apr_allocator_t *allocator)
+{
+    apr_uint32_t slot = magazine_slot;
+
+    if (!slot) {
+        slot = magazine_slot = apr_atomic_inc32(&magazine_slot_next) + 1;
+    }
+    return (allocator_magazine_t *)(allocator->magazines
+                                    + (slot & allocator->magazines_mask)
+                                      * SIZEOF_MAGAZINE_T);
+}
+
+static APR_INLINE
+int magazine_trylock(allocator_magazine_t *mag)
+{
+    return apr_atomic_cas32(&mag->lock, 1, 0) == 0;
+}
+
+static APR_INLINE
+void magazine_unlock(allocator_magazine_t *mag)
+{
+    apr_atomic_set32(&mag->lock, 0);
+}
+
+static APR_INLINE
+apr_size_t magazine_batch(apr_allocator_t *allocator)
+{
+    apr_size_t batch = allocator->magazine_depth / 2;
+    return batch ? batch : 1;
+}
+
+static apr_memnode_t *magazine_alloc(apr_allocator_t *allocator,
+                                     apr_size_t index)
+{
+    allocator_magazine_t *mag = magazine_get(allocator);
+    apr_memnode_t *node, *last, **ref;
+    apr_size_t max_index, batch, n;
+
+    if (!magazine_trylock(mag)) {
+        return NULL;
+    }
+
+    if ((node = mag->free[index]) != NULL) {
+        mag->free[index] = node->next;
+        mag->count[index]--;
+        mag->held -= index + 1;
+
+        magazine_unlock(mag);
+
+        return node;
+    }
+
+    /* The magazine is empty for this size, refill it with a batch of
+     * nodes from the shared list (if any), the first one being returned.
+     */
+    if (allocator->free[index] != NULL) {
+        allocator_lock(allocator);
+
+        ref = &allocator->free[index];
+        if ((node = *ref) != NULL) {
+            batch = magazine_batch(allocator);
+            for (last = node, n = 0; n < batch && last->next; n++) {
+                last = last->next;
+            }
+            max_index = allocator->max_index;
+            if ((*ref = last->next) == NULL && index >= max_index) {
+                do {
+                    ref--;
+                    max_index--;
+                }
+                while (*ref == NULL && max_index);
+
+                allocator->max_index = max_index;
+            }
+            last->next = NULL;
+
+            /* Only the returned node leaves the free memory, the others
+             * are kept (and thus reserved) by the magazine.
+             */
+            allocator->current_free_index += index + 1;
+            if (allocator->current_free_index > allocator->max_free_index)
+                allocator->current_free_index = allocator->max_free_index;
+
+            mag->free[index] = node->next;
+            mag->count[index] = (apr_uint32_t)n;
+            mag->held += n * (index + 1);
+            mag->reserved += n * (index + 1);
+        }
+
+        allocator_unlock(allocator);
+    }
+
+    magazine_unlock(mag);
+
+    return node;
+}
+
+static int magazine_reserve(apr_allocator_t *allocator,
+                            allocator_magazine_t *mag, apr_size_t size)
+{
+    apr_size_t needed, wanted;
+
+    needed = mag->held + size - mag->reserved;
+    wanted = needed + magazine_batch(allocator) * size;
+
+    allocator_lock(allocator);
+
+    if (allocator->current_free_index < needed) {
+        allocator_unlock(allocator);
+        return 0;
+    }
+    if (wanted > allocator->current_free_index) {
+        wanted = allocator->current_free_index;
+    }
+    allocator->current_free_index -= wanted;
+
+    allocator_unlock(allocator);
+
+    mag->reserved += wanted;
+
+    return 1;
+}
+
+static void magazine_free(apr_allocator_t *allocator, apr_memnode_t *node)
+{
+    allocator_magazine_t *mag = magazine_get(allocator);
+    apr_memnode_t *next, *rest = NULL;
+    apr_size_t index, batch, released = 0;
+    int limited;
+
+    if (!magazine_trylock(mag)) {
+        allocator_free_shared(allocator, node, 0);
+        return;
+    }
+
+    limited = (allocator->max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED);
+
+    for (; node != NULL; node = next) {
+        next = node->next;
+        index = node->index;
+
+        if (index >= MAGAZINE_SLOTS) {
+            node->next = rest;
+            rest = node;
+            continue;
+        }
+
+        /* If the magazine is full for this size, give back a batch
+         * of its nodes to the shared list.
+         */
+        if (mag->count[index] >= allocator->magazine_depth) {
+            apr_memnode_t *first, *last;
+            apr_size_t n;
+
+            batch = magazine_batch(allocator);
+            first = last = mag->free[index];
+            for (n = 1; n < batch; n++) {
+                last = last->next;
+            }
+            mag->free[index] = last->next;
+            last->next = rest;
+            rest = first;
+
+            mag->count[index] -= (apr_uint32_t)batch;
+            mag->held -= batch * (index + 1);
+            mag->reserved -= batch * (index + 1);
+            released += batch * (index + 1);
+        }
+
+        if (mag->held + index + 1 > mag->reserved) {
+            if (!limited) {
+                mag->reserved = mag->held + index + 1;
+            }
+            else if (!magazine_reserve(allocator, mag, index + 1)) {
+                node->next = rest;
+                rest = node;
+                continue;
+            }
+        }
+
+        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
+                              (node->index+1) << BOUNDARY_INDEX);
+
+        node->next = mag->free[index];
+        mag->free[index] = node;
+        mag->count[index]++;
+        mag->held += index + 1;
+    }
+
+    magazine_unlock(mag);
+
+    if (rest != NULL || released) {
+        allocator_free_shared(allocator, rest, released);
+    }
+}
+
+#endif /* ALLOCATOR_HAS_MAGAZINES */
+
 static APR_INLINE
 apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
 {
@@ -300,6 +898,16 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
         return NULL;
     }
 
+#if ALLOCATOR_HAS_MAGAZINES
+    /* Small nodes come from this thread's magazine first (if any).
+     */
+    if (allocator->magazines && index < MAGAZINE_SLOTS) {
+        if ((node = magazine_alloc(allocator, index)) != NULL) {
+            goto have_node;
+        }
+    }
+#endif
+
     /* First see if there are any nodes in the area we know
      * our node will fit into.
      */
@@ -389,6 +997,15 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
     /* If we haven't got a suitable node, malloc a new one
      * and initialize it.
      */
+#if ALLOCATOR_HAS_ARENAS
+    if (index < allocator->arena_max_index) {
+        if ((node = arena_alloc(allocator, size)) == NULL)
+            return NULL;
+
+        goto have_new_node;
+    }
+#endif
+
 #if APR_ALLOCATOR_GUARD_PAGES
     if ((node = mmap(NULL, size + 2 * GUARDPAGE_SIZE, PROT_NONE,
                      MAP_PRIVATE|MAP_ANON, -1, 0)) == MAP_FAILED)
@@ -406,6 +1023,9 @@ apr_memnode_t *allocator_alloc(apr_allocator_t *allocator, apr_size_t in_size)
         munmap((char *)node - GUARDPAGE_SIZE, size + 2 * GUARDPAGE_SIZE);
         return NULL;
     }
+#endif
+#if ALLOCATOR_HAS_ARENAS
+have_new_node:
 #endif
     node->index = (apr_uint32_t)index;
     node->endp = (char *)node + size;
@@ -422,86 +1042,107 @@ have_node:
 static APR_INLINE
 void allocator_free(apr_allocator_t *allocator, apr_memnode_t *node)
 {
-    apr_memnode_t *next, *freelist = NULL;
-    apr_size_t index, max_index;
-    apr_size_t max_free_index, current_free_index;
+#if ALLOCATOR_HAS_MAGAZINES
+    if (allocator->magazines) {
+        magazine_free(allocator, node);
+        return;
+    }
+#endif
 
-    allocator_lock(allocator);
+    allocator_free_shared(allocator, node, 0);
+}
 
-    max_index = allocator->max_index;
-    max_free_index = allocator->max_free_index;
-    current_free_index = allocator->current_free_index;
+APR_DECLARE(apr_memnode_t *) apr_allocator_alloc(apr_allocator_t *allocator,
+                                                 apr_size_t size)
+{
+    return allocator_alloc(allocator, size);
+}
 
-    /* Walk the list of submitted nodes and free them one by one,
-     * shoving them in the right 'size' buckets as we go.
-     */
-    do {
-        next = node->next;
-        index = node->index;
+APR_DECLARE(void) apr_allocator_free(apr_allocator_t *allocator,
+                                     apr_memnode_t *node)
+{
+    allocator_free(allocator, node);
+}
 
-        APR_VALGRIND_NOACCESS((char *)node + APR_MEMNODE_T_SIZE,
-                              (node->index+1) << BOUNDARY_INDEX);
+#if ALLOCATOR_HAS_MAGAZINES
+static void magazines_drain(apr_allocator_t *allocator)
+{
+    apr_memnode_t *node, *list = NULL;
+    apr_size_t index, released = 0;
+    apr_uint32_t i;
 
-        if (max_free_index != APR_ALLOCATOR_MAX_FREE_UNLIMITED
-            && index + 1 > current_free_index) {
-            node->next = freelist;
-            freelist = node;
+    for (i = 0; i <= allocator->magazines_mask; i++) {
+        allocator_magazine_t *mag = (allocator_magazine_t *)
+            (allocator->magazines + i * SIZEOF_MAGAZINE_T);
+
+        while (!magazine_trylock(mag)) {
+            apr_thread_yield();
         }
-        else if (index < MAX_INDEX) {
-            /* Add the node to the appropriate 'size' bucket.  Adjust
-             * the max_index when appropriate.
-             */
-            if ((node->next = allocator->free[index]) == NULL
-                && index > max_index) {
-                max_index = index;
+        for (index = 0; index < MAGAZINE_SLOTS; index++) {
+            while ((node = mag->free[index]) != NULL) {
+                mag->free[index] = node->next;
+                node->next = list;
+                list = node;
             }
-            allocator->free[index] = node;
-            if (current_free_index >= index + 1)
-                current_free_index -= index + 1;
-            else
-                current_free_index = 0;
+            mag->count[index] = 0;
         }
-        else {
-            /* This node is too large to keep in a specific size bucket,
-             * just add it to the sink (at index MAX_INDEX).
-             */
-            node->next = allocator->free[MAX_INDEX];
-            allocator->free[MAX_INDEX] = node;
-            if (current_free_index >= index + 1)
-                current_free_index -= index + 1;
-            else
-                current_free_index = 0;
-        }
-    } while ((node = next) != NULL);
-
-    allocator->max_index = max_index;
-    allocator->current_free_index = current_free_index;
-
-    allocator_unlock(allocator);
+        released += mag->reserved;
+        mag->reserved = mag->held = 0;
+        magazine_unlock(mag);
+    }
 
-    while (freelist != NULL) {
-        node = freelist;
-        freelist = node->next;
-#if APR_ALLOCATOR_USES_MMAP
-        munmap((char *)node - GUARDPAGE_SIZE,
-               2 * GUARDPAGE_SIZE + ((node->index+1) << BOUNDARY_INDEX));
-#else
-        free(node);
-#endif
+    if (list != NULL || released) {
+        allocator_free_shared(allocator, list, released);
     }
 }
+#endif /* ALLOCATOR_HAS_MAGAZINES */
 
-APR_DECLARE(apr_memnode_t *) apr_allocator_alloc(apr_allocator_t *allocator,
-                                                 apr_size_t size)
+#if APR_HAS_THREADS
+APR_DECLARE(apr_status_t) apr_allocator_magazines_set(
+                              apr_allocator_t *allocator,
+                              apr_uint32_t count, apr_uint32_t depth)
 {
-    return allocator_alloc(allocator, size);
-}
+#if ALLOCATOR_HAS_MAGAZINES
+    apr_uint32_t n;
+    void *mem;
 
-APR_DECLARE(void) apr_allocator_free(apr_allocator_t *allocator,
-                                     apr_memnode_t *node)
-{
-    allocator_free(allocator, node);
+    if (count > MAGAZINE_COUNT_MAX) {
+        return APR_EINVAL;
+    }
+
+    if (allocator->magazines) {
+        magazines_drain(allocator);
+        free(allocator->magazines_mem);
+        allocator->magazines_mem = NULL;
+        allocator->magazines = NULL;
+    }
+    if (!count) {
+        return APR_SUCCESS;
+    }
+
+    /* Round up to a power of two for masking */
+    for (n = 1; n < count; n <<= 1)
+        ;
+    if ((mem = malloc(n * SIZEOF_MAGAZINE_T + MAGAZINE_CACHELINE)) == NULL) {
+        return APR_ENOMEM;
+    }
+    memset(mem, 0, n * SIZEOF_MAGAZINE_T + MAGAZINE_CACHELINE);
+
+    allocator->magazine_depth = depth ? depth : MAGAZINE_DEPTH_DEFAULT;
+    allocator->magazines_mask = n - 1;
+    allocator->magazines_mem = mem;
+    allocator->magazines = (char *)APR_ALIGN((apr_uintptr_t)mem,
+                                             MAGAZINE_CACHELINE);
+
+    return APR_SUCCESS;
+#else
+    (void)allocator;
+    (void)count;
+    (void)depth;
+    return APR_ENOTIMPL;
+#endif
 }
+#endif /* APR_HAS_THREADS */
 
 APR_DECLARE(apr_size_t) apr_allocator_page_size(void)
 {
@@ -586,6 +1227,7 @@ struct apr_pool_t {
     apr_memnode_t        *active;
     apr_memnode_t        *self; /* The node containing the pool itself */
     char                 *self_first_avail;
+    void                **slabs; /* Free lists of APR_POOL_SLAB pools */
 
 #else /* APR_POOL_DEBUG */
     apr_pool_t           *joined; /* the caller has guaranteed that this pool
@@ -617,6 +1259,25 @@ struct apr_pool_t {
 
 #define SIZEOF_POOL_T       APR_ALIGN_DEFAULT(sizeof(apr_pool_t))
 
+#if !APR_POOL_DEBUG
+/*
+ * Slabs
+ *
+ * A pool created with APR_POOL_SLAB prefixes each allocation with a
+ * header recording its size class, so that apr_pfree() can push it on
+ * the free list of its class for apr_palloc() to recycle.  The classes
+ * are multiples of SLAB_QUANTUM up to SLAB_MAX_SIZE, larger allocations
+ * are not recycled (until the pool is cleared).  The free lists' heads
+ * live in the node of the pool itself, right after the pool struct.
+ */
+#define SLAB_QUANTUM        16
+#define SLAB_CLASSES        64
+#define SLAB_MAX_SIZE       (SLAB_QUANTUM * SLAB_CLASSES)
+#define SLAB_LARGE          SLAB_CLASSES
+#define SLAB_HEADER_SIZE    APR_ALIGN_DEFAULT(sizeof(apr_size_t))
+#define SIZEOF_SLABS        APR_ALIGN_DEFAULT(SLAB_CLASSES * sizeof(void *))
+#endif /* !APR_POOL_DEBUG */
+
 
 /*
  * Variables
@@ -823,7 +1484,8 @@ static APR_INLINE void pool_concurrency_set_destroyed(apr_pool_t *pool) { }
  * Memory allocation
  */
 
-APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t in_size)
+static APR_INLINE
+void *pool_palloc(apr_pool_t *pool, apr_size_t in_size)
 {
     apr_memnode_t *active, *node;
     void *mem;
@@ -908,6 +1570,72 @@ have_mem:
 #endif
 }
 
+static void *slab_palloc(apr_pool_t *pool, apr_size_t in_size)
+{
+    apr_size_t index, size;
+    char *mem;
+
+    if (in_size <= SLAB_MAX_SIZE) {
+        index = in_size ? (in_size - 1) / SLAB_QUANTUM : 0;
+        size = (index + 1) * SLAB_QUANTUM;
+
+        pool_concurrency_set_used(pool);
+        if ((mem = pool->slabs[index]) != NULL) {
+            APR_VALGRIND_UNDEFINED(mem, size);
+            pool->slabs[index] = *(void **)mem;
+            pool_concurrency_set_idle(pool);
+            return mem;
+        }
+        pool_concurrency_set_idle(pool);
+    }
+    else {
+        index = SLAB_LARGE;
+        size = in_size;
+        if (size + SLAB_HEADER_SIZE < size) {
+            if (pool->abort_fn)
+                pool->abort_fn(APR_ENOMEM);
+
+            return NULL;
+        }
+    }
+
+    if ((mem = pool_palloc(pool, size + SLAB_HEADER_SIZE)) == NULL) {
+        return NULL;
+    }
+    *(apr_size_t *)mem = index;
+
+    return mem + SLAB_HEADER_SIZE;
+}
+
+APR_DECLARE(void *) apr_palloc(apr_pool_t *pool, apr_size_t size)
+{
+    if (pool->slabs) {
+        return slab_palloc(pool, size);
+    }
+    return pool_palloc(pool, size);
+}
+
+APR_DECLARE(void) apr_pfree(apr_pool_t *pool, void *mem)
+{
+    apr_size_t index;
+
+    if (!pool->slabs || !mem) {
+        return;
+    }
+
+    index = *(apr_size_t *)((char *)mem - SLAB_HEADER_SIZE);
+    if (index >= SLAB_CLASSES) {
+        return;
+    }
+
+    pool_concurrency_set_used(pool);
+    *(void **)mem = pool->slabs[index];
+    pool->slabs[index] = mem;
+    APR_VALGRIND_NOACCESS((char *)mem + sizeof(void *),
+                          (index + 1) * SLAB_QUANTUM - sizeof(void *));
+    pool_concurrency_set_idle(pool);
+}
+
 /* Provide an implementation of apr_pcalloc for backward compatibility
  * with code built before apr_pcalloc was a macro
  */
@@ -970,6 +1698,10 @@ APR_DECLARE(void) apr_pool_clear(apr_pool_t *pool)
     active = pool->active = pool->self;
     active->first_avail = pool->self_first_avail;
 
+    /* Forget the recycled allocations */
+    if (pool->slabs)
+        memset(pool->slabs, 0, SIZEOF_SLABS);
+
     APR_IF_VALGRIND(VALGRIND_MEMPOOL_TRIM(pool, pool, 1));
 
     if (active->next == active) {
@@ -1056,6 +1788,15 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
                                              apr_pool_t *parent,
                                              apr_abortfunc_t abort_fn,
                                              apr_allocator_t *allocator)
+{
+    return apr_pool_create_ex2(newpool, parent, abort_fn, allocator, 0);
+}
+
+APR_DECLARE(apr_status_t) apr_pool_create_ex2(apr_pool_t **newpool,
+                                              apr_pool_t *parent,
+                                              apr_abortfunc_t abort_fn,
+                                              apr_allocator_t *allocator,
+                                              apr_uint32_t flags)
 {
     apr_pool_t *pool;
     apr_memnode_t *node;
@@ -1102,6 +1843,15 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
     pool = (apr_pool_t *)node->first_avail;
     pool->self_first_avail = (char *)pool + SIZEOF_POOL_T;
 #endif
+    if (flags & APR_POOL_SLAB) {
+        pool->slabs = (void **)pool->self_first_avail;
+        pool->self_first_avail += SIZEOF_SLABS;
+        APR_VALGRIND_UNDEFINED(pool->slabs, SIZEOF_SLABS);
+        memset(pool->slabs, 0, SIZEOF_SLABS);
+    }
+    else {
+        pool->slabs = NULL;
+    }
     node->first_avail = pool->self_first_avail;
 
     pool->allocator = allocator;
@@ -1195,6 +1945,7 @@ APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
     pool->subprocesses = NULL;
     pool->user_data = NULL;
     pool->tag = NULL;
+    pool->slabs = NULL;
     pool->parent = NULL;
     pool->sibling = NULL;
     pool->ref = NULL;
@@ -2982,6 +3733,28 @@ APR_DECLARE(apr_status_t) apr_pool_create_ex(apr_pool_t **newpool,
                                     "undefined");
 }
 
+#undef apr_pool_create_ex2
+APR_DECLARE(apr_status_t) apr_pool_create_ex2(apr_pool_t **newpool,
+                                              apr_pool_t *parent,
+                                              apr_abortfunc_t abort_fn,
+                                              apr_allocator_t *allocator,
+                                              apr_uint32_t flags);
+
+APR_DECLARE(apr_status_t) apr_pool_create_ex2(apr_pool_t **newpool,
+                                              apr_pool_t *parent,
+                                              apr_abortfunc_t abort_fn,
+                                              apr_allocator_t *allocator,
+                                              apr_uint32_t flags)
+{
+    return apr_pool_create_ex_debug(newpool, parent,
+                                    abort_fn, allocator,
+                                    "undefined");
+}
+
+APR_DECLARE(void) apr_pfree(apr_pool_t *pool, void *mem)
+{
+}
+
 #undef apr_pool_create_unmanaged_ex
 APR_DECLARE(apr_status_t) apr_pool_create_unmanaged_ex(apr_pool_t **newpool,
                                                   apr_abortfunc_t abort_fn,
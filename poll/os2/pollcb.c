@@ -56,6 +56,14 @@ APR_DECLARE(apr_status_t) apr_pollcb_add(apr_pollcb_t *pollcb,
 
 
 
+APR_DECLARE(apr_status_t) apr_pollcb_rearm(apr_pollcb_t *pollcb,
+                                           apr_pollfd_t *descriptor)
+{
+    return apr_pollset_rearm(pollcb->pollset, descriptor);
+}
+
+
+
 APR_DECLARE(apr_status_t) apr_pollcb_remove(apr_pollcb_t *pollcb,
                                             apr_pollfd_t *descriptor)
 {
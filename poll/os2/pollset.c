@@ -33,6 +33,7 @@ struct apr_pollset_t {
     int num_total;
     apr_pollfd_t *query_set;
     apr_pollfd_t *result_set;
+    const apr_pollfd_t **result_ptrs;
     apr_socket_t *wake_listen;
     apr_socket_t *wake_sender;
     apr_sockaddr_t *wake_address;
@@ -58,6 +59,7 @@ APR_DECLARE(apr_status_t) apr_pollset_create(apr_pollset_t **pollset,
     (*pollset)->pollset = apr_palloc(p, size * sizeof(int) * 3);
     (*pollset)->query_set = apr_palloc(p, size * sizeof(apr_pollfd_t));
     (*pollset)->result_set = apr_palloc(p, size * sizeof(apr_pollfd_t));
+    (*pollset)->result_ptrs = apr_palloc(p, size * sizeof(apr_pollfd_t *));
     (*pollset)->num_read = -1;
     (*pollset)->wake_listen = NULL;
     (*pollset)->wake_sender = NULL;
@@ -122,6 +124,10 @@ APR_DECLARE(apr_status_t) apr_pollset_add(apr_pollset_t *pollset,
         return APR_ENOMEM;
     }
 
+    if (descriptor->reqevents & (APR_POLLET | APR_POLLONESHOT)) {
+        return APR_ENOTIMPL;
+    }
+
     pollset->query_set[pollset->nelts] = *descriptor;
 
     if (descriptor->desc_type != APR_POLL_SOCKET) {
@@ -135,6 +141,14 @@ APR_DECLARE(apr_status_t) apr_pollset_add(apr_pollset_t *pollset,
 
 
 
+APR_DECLARE(apr_status_t) apr_pollset_rearm(apr_pollset_t *pollset,
+                                            const apr_pollfd_t *descriptor)
+{
+    return APR_ENOTIMPL;
+}
+
+
+
 APR_DECLARE(apr_status_t) apr_pollset_remove(apr_pollset_t *pollset,
                                              const apr_pollfd_t *descriptor)
 {
@@ -293,6 +307,30 @@ APR_DECLARE(apr_status_t) apr_pollset_poll(apr_pollset_t *pollset,
 
 
 
+APR_DECLARE(apr_status_t) apr_pollset_poll_ptrs(apr_pollset_t *pollset,
+                                              apr_interval_time_t timeout,
+                                              apr_int32_t *num,
+                                              const apr_pollfd_t *const **descriptors)
+{
+    const apr_pollfd_t *results;
+    apr_status_t rc;
+    apr_int32_t i;
+
+    rc = apr_pollset_poll(pollset, timeout, num, &results);
+
+    for (i = 0; i < *num; i++) {
+        pollset->result_ptrs[i] = &results[i];
+    }
+
+    if (descriptors) {
+        *descriptors = pollset->result_ptrs;
+    }
+
+    return rc;
+}
+
+
+
 APR_DECLARE(apr_status_t) apr_pollset_wakeup(apr_pollset_t *pollset)
 {
     if (!pollset->wake_sender)
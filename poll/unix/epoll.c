@@ -15,6 +15,7 @@
  */
 
 #include "apr.h"
+#include "apr_atomic.h"
 #include "apr_poll.h"
 #include "apr_time.h"
 #include "apr_portable.h"
@@ -35,6 +36,10 @@ static unsigned get_epoll_event(apr_int16_t event)
         rv |= EPOLLPRI;
     if (event & APR_POLLOUT)
         rv |= EPOLLOUT;
+    if (event & APR_POLLET)
+        rv |= EPOLLET;
+    if (event & APR_POLLONESHOT)
+        rv |= EPOLLONESHOT;
 #ifdef EPOLLEXCLUSIVE
     if (event & APR_POLLEXCL)
         rv |= EPOLLEXCLUSIVE;
@@ -68,6 +73,10 @@ struct apr_pollset_private_t
     int epoll_fd;
     struct epoll_event *pollset;
     apr_pollfd_t *result_set;
+    const apr_pollfd_t **result_ptrs;
+    /* Number of pollfd_t in the dead ring, so that _poll() does not have
+     * to lock the rings when there is none to reclaim */
+    apr_uint32_t ndead;
 #if APR_HAS_THREADS
     /* A thread mutex to protect operations on the rings */
     apr_thread_mutex_t *ring_lock;
@@ -77,7 +86,8 @@ struct apr_pollset_private_t
     /* A ring of pollfd_t that have been used, and then _remove()'d */
     APR_RING_HEAD(pfd_free_ring_t, pfd_elem_t) free_ring;
     /* A ring of pollfd_t where rings that have been _remove()`ed but
-        might still be inside a _poll() */
+        might still be inside a _poll(), or be pointed to by the results
+        of the last _poll_ptrs() */
     APR_RING_HEAD(pfd_dead_ring_t, pfd_elem_t) dead_ring;
 };
 
@@ -148,6 +158,7 @@ static apr_status_t impl_pollset_create(apr_pollset_t *pollset,
     pollset->p->epoll_fd = fd;
     pollset->p->pollset = apr_palloc(p, size * sizeof(struct epoll_event));
     pollset->p->result_set = apr_palloc(p, size * sizeof(apr_pollfd_t));
+    pollset->p->result_ptrs = apr_palloc(p, size * sizeof(apr_pollfd_t *));
 
     if (!(flags & APR_POLLSET_NOCOPY)) {
         APR_RING_INIT(&pollset->p->query_ring, pfd_elem_t, link);
@@ -244,6 +255,7 @@ static apr_status_t impl_pollset_remove(apr_pollset_t *pollset,
                 APR_RING_REMOVE(ep, link);
                 APR_RING_INSERT_TAIL(&(pollset->p->dead_ring),
                                      ep, pfd_elem_t, link);
+                apr_atomic_inc32(&pollset->p->ndead);
                 break;
             }
         }
@@ -254,6 +266,76 @@ static apr_status_t impl_pollset_remove(apr_pollset_t *pollset,
     return rv;
 }
 
+static apr_status_t impl_pollset_rearm(apr_pollset_t *pollset,
+                                       const apr_pollfd_t *descriptor)
+{
+    struct epoll_event ev = {0};
+    pfd_elem_t *ep = NULL;
+    apr_status_t rv = APR_SUCCESS;
+    int ret;
+
+    ev.events = get_epoll_event(descriptor->reqevents);
+
+    if (pollset->flags & APR_POLLSET_NOCOPY) {
+        ev.data.ptr = (void *)descriptor;
+    }
+    else {
+        pollset_lock_rings();
+
+        for (ep = APR_RING_FIRST(&(pollset->p->query_ring));
+             ep != APR_RING_SENTINEL(&(pollset->p->query_ring),
+                                     pfd_elem_t, link);
+             ep = APR_RING_NEXT(ep, link)) {
+
+            if (descriptor->desc.s == ep->pfd.desc.s) {
+                break;
+            }
+        }
+        if (ep == APR_RING_SENTINEL(&(pollset->p->query_ring),
+                                    pfd_elem_t, link)) {
+            pollset_unlock_rings();
+            return APR_NOTFOUND;
+        }
+        ep->pfd = *descriptor;
+        ev.data.ptr = ep;
+    }
+
+    if (descriptor->desc_type == APR_POLL_SOCKET) {
+        ret = epoll_ctl(pollset->p->epoll_fd, EPOLL_CTL_MOD,
+                        descriptor->desc.s->socketdes, &ev);
+    }
+    else {
+        ret = epoll_ctl(pollset->p->epoll_fd, EPOLL_CTL_MOD,
+                        descriptor->desc.f->filedes, &ev);
+    }
+    if (ret < 0) {
+        rv = (errno == ENOENT) ? APR_NOTFOUND : apr_get_netos_error();
+    }
+
+    if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
+        pollset_unlock_rings();
+    }
+
+    return rv;
+}
+
+/* Shift all PFDs in the Dead Ring to the Free Ring.  This is done before
+ * waiting rather than after, so that the results of the previous poll
+ * stay valid until this one.
+ */
+static void reclaim_dead_ring(apr_pollset_t *pollset)
+{
+    if (!(pollset->flags & APR_POLLSET_NOCOPY)
+        && apr_atomic_read32(&pollset->p->ndead)) {
+        pollset_lock_rings();
+
+        APR_RING_CONCAT(&(pollset->p->free_ring), &(pollset->p->dead_ring), pfd_elem_t, link);
+        apr_atomic_set32(&pollset->p->ndead, 0);
+
+        pollset_unlock_rings();
+    }
+}
+
 static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
                                            apr_interval_time_t timeout,
                                            apr_int32_t *num,
@@ -268,6 +350,8 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
         timeout = (timeout + 999) / 1000;
     }
 
+    reclaim_dead_ring(pollset);
+
     ret = epoll_wait(pollset->p->epoll_fd, pollset->p->pollset, pollset->nalloc,
                      timeout);
     if (ret < 0) {
@@ -312,13 +396,70 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
         }
     }
 
-    if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
-        pollset_lock_rings();
+    return rv;
+}
 
-        /* Shift all PFDs in the Dead Ring to the Free Ring */
-        APR_RING_CONCAT(&(pollset->p->free_ring), &(pollset->p->dead_ring), pfd_elem_t, link);
+static apr_status_t impl_pollset_poll_ptrs(apr_pollset_t *pollset,
+                                           apr_interval_time_t timeout,
+                                           apr_int32_t *num,
+                                           const apr_pollfd_t *const **descriptors)
+{
+    int ret;
+    apr_status_t rv = APR_SUCCESS;
 
-        pollset_unlock_rings();
+    *num = 0;
+
+    if (timeout > 0) {
+        timeout = (timeout + 999) / 1000;
+    }
+
+    reclaim_dead_ring(pollset);
+
+    ret = epoll_wait(pollset->p->epoll_fd, pollset->p->pollset, pollset->nalloc,
+                     timeout);
+    if (ret < 0) {
+        rv = apr_get_netos_error();
+    }
+    else if (ret == 0) {
+        rv = APR_TIMEUP;
+    }
+    else {
+        int i, j;
+        apr_pollfd_t *fdptr;
+
+        for (i = 0, j = 0; i < ret; i++) {
+            if (pollset->flags & APR_POLLSET_NOCOPY) {
+                fdptr = (apr_pollfd_t *)(pollset->p->pollset[i].data.ptr);
+            }
+            else {
+                fdptr = &(((pfd_elem_t *) (pollset->p->pollset[i].data.ptr))->pfd);
+            }
+            /* Check if the polled descriptor is our
+             * wakeup pipe. In that case do not put it result set.
+             */
+            if ((pollset->flags & APR_POLLSET_WAKEABLE) &&
+                fdptr->desc_type == APR_POLL_FILE &&
+                fdptr->desc.f == pollset->wakeup_pipe[0]) {
+                apr_poll_drain_wakeup_pipe(&pollset->wakeup_set, pollset->wakeup_pipe);
+                rv = APR_EINTR;
+            }
+            else {
+                /* The pollfd_t is not reclaimed before the next poll,
+                 * even if removed meanwhile, so it can be returned as is.
+                 */
+                fdptr->rtnevents =
+                    get_epoll_revent(pollset->p->pollset[i].events);
+                pollset->p->result_ptrs[j] = fdptr;
+                j++;
+            }
+        }
+        if (((*num) = j)) { /* any event besides wakeup pipe? */
+            rv = APR_SUCCESS;
+
+            if (descriptors) {
+                *descriptors = pollset->p->result_ptrs;
+            }
+        }
     }
 
     return rv;
@@ -330,7 +471,9 @@ static const apr_pollset_provider_t impl = {
     impl_pollset_remove,
     impl_pollset_poll,
     impl_pollset_cleanup,
-    "epoll"
+    "epoll",
+    impl_pollset_rearm,
+    impl_pollset_poll_ptrs
 };
 
 const apr_pollset_provider_t *const apr_pollset_provider_epoll = &impl;
@@ -436,6 +579,30 @@ static apr_status_t impl_pollcb_remove(apr_pollcb_t *pollcb,
     return rv;
 }
 
+static apr_status_t impl_pollcb_rearm(apr_pollcb_t *pollcb,
+                                      apr_pollfd_t *descriptor)
+{
+    struct epoll_event ev = { 0 };
+    int ret;
+
+    ev.events = get_epoll_event(descriptor->reqevents);
+    ev.data.ptr = (void *) descriptor;
+
+    if (descriptor->desc_type == APR_POLL_SOCKET) {
+        ret = epoll_ctl(pollcb->fd, EPOLL_CTL_MOD,
+                        descriptor->desc.s->socketdes, &ev);
+    }
+    else {
+        ret = epoll_ctl(pollcb->fd, EPOLL_CTL_MOD,
+                        descriptor->desc.f->filedes, &ev);
+    }
+
+    if (ret == -1) {
+        return (errno == ENOENT) ? APR_NOTFOUND : apr_get_netos_error();
+    }
+
+    return APR_SUCCESS;
+}
 
 static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
                                      apr_interval_time_t timeout,
@@ -486,7 +653,8 @@ static const apr_pollcb_provider_t impl_cb = {
     impl_pollcb_remove,
     impl_pollcb_poll,
     impl_pollcb_cleanup,
-    "epoll"
+    "epoll",
+    impl_pollcb_rearm
 };
 
 const apr_pollcb_provider_t *const apr_pollcb_provider_epoll = &impl_cb;
@@ -0,0 +1,880 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_poll.h"
+#include "apr_time.h"
+#include "apr_portable.h"
+#include "apr_atomic.h"
+#include "apr_arch_file_io.h"
+#include "apr_arch_networkio.h"
+#include "apr_arch_poll_private.h"
+
+#if defined(HAVE_IO_URING)
+
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+/* The descriptors are watched by IORING_OP_POLL_ADD requests, which are
+ * one-shot: a descriptor returned by a poll is re-armed by a new request
+ * submitted with the next io_uring_enter(), i.e. once the caller had a
+ * chance to consume the event, and since the kernel checks the readiness
+ * when a request is armed the events are level-triggered like epoll's.
+ * The wakeup pipe, which is drained each time, uses a multishot request.
+ * APR_POLLONESHOT descriptors are simply not re-armed until _rearm(),
+ * APR_POLLET is not supported.
+ *
+ * The poll requests are only queued by _add() and submitted by the
+ * io_uring_enter() which waits for the completions, unless the pollset is
+ * APR_POLLSET_THREADSAFE, in which case they are submitted immediately
+ * since another thread may be waiting already.  _remove() submits its
+ * cancellation immediately, since the poll request holds a reference to
+ * the descriptor and the caller may close it next.
+ */
+
+/* The kernel must not drop completions and must take the timeout in the
+ * io_uring_enter() arguments (Linux 5.11), otherwise the setup fails with
+ * APR_ENOTIMPL and the default method is used.
+ */
+#define URING_FEATURES (IORING_FEAT_SINGLE_MMAP | \
+                        IORING_FEAT_NODROP | \
+                        IORING_FEAT_EXT_ARG)
+
+#define URING_MAX_ENTRIES 4096
+
+apr_status_t apr_uring_ring_setup(apr_uring_ring_t *ring,
+                                  apr_uint32_t entries)
+{
+    struct io_uring_params params;
+    apr_uint32_t i, *array;
+    apr_status_t rv;
+    char *rings;
+    int fd;
+
+    memset(&params, 0, sizeof(params));
+    fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (fd < 0) {
+        rv = errno;
+        /* Not implemented, or disabled by sysctl or seccomp */
+        if (rv == ENOSYS || rv == EPERM || rv == EACCES || rv == EINVAL) {
+            return APR_ENOTIMPL;
+        }
+        return rv;
+    }
+    if ((params.features & URING_FEATURES) != URING_FEATURES) {
+        close(fd);
+        return APR_ENOTIMPL;
+    }
+
+    ring->fd = fd;
+    ring->rings_len = params.sq_off.array + params.sq_entries * sizeof(__u32);
+    if (ring->rings_len < params.cq_off.cqes +
+                          params.cq_entries * sizeof(struct io_uring_cqe)) {
+        ring->rings_len = params.cq_off.cqes +
+                          params.cq_entries * sizeof(struct io_uring_cqe);
+    }
+    ring->rings = mmap(NULL, ring->rings_len, PROT_READ | PROT_WRITE,
+                       MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->rings == MAP_FAILED) {
+        rv = errno;
+        close(fd);
+        return rv;
+    }
+    ring->sqes_len = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        rv = errno;
+        munmap(ring->rings, ring->rings_len);
+        close(fd);
+        return rv;
+    }
+
+    rings = ring->rings;
+    ring->sq_head = (volatile apr_uint32_t *)(rings + params.sq_off.head);
+    ring->sq_ktail = (volatile apr_uint32_t *)(rings + params.sq_off.tail);
+    ring->sq_mask = *(apr_uint32_t *)(rings + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->sq_tail = *ring->sq_ktail;
+    /* The submission entries are used in order */
+    array = (apr_uint32_t *)(rings + params.sq_off.array);
+    for (i = 0; i < params.sq_entries; i++) {
+        array[i] = i;
+    }
+    ring->cq_head = (volatile apr_uint32_t *)(rings + params.cq_off.head);
+    ring->cq_tail = (volatile apr_uint32_t *)(rings + params.cq_off.tail);
+    ring->cq_mask = *(apr_uint32_t *)(rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+
+    return APR_SUCCESS;
+}
+
+void apr_uring_ring_cleanup(apr_uring_ring_t *ring)
+{
+    munmap(ring->sqes, ring->sqes_len);
+    munmap(ring->rings, ring->rings_len);
+    close(ring->fd);
+}
+
+int apr_uring_ring_enter(apr_uring_ring_t *ring, apr_uint32_t to_submit,
+                         apr_uint32_t min_complete, apr_uint32_t flags,
+                         void *arg, apr_size_t argsz)
+{
+    return (int)syscall(__NR_io_uring_enter, ring->fd, to_submit,
+                        min_complete, flags, arg, argsz);
+}
+
+apr_status_t apr_uring_ring_submit(apr_uring_ring_t *ring)
+{
+    apr_uint32_t to_submit;
+
+    apr_atomic_set32(ring->sq_ktail, ring->sq_tail);
+    while ((to_submit = ring->sq_tail - apr_atomic_read32(ring->sq_head))) {
+        if (apr_uring_ring_enter(ring, to_submit, 0, 0, NULL, 0) < 0
+            && errno != EINTR) {
+            return errno;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+struct io_uring_sqe *apr_uring_ring_get_sqe(apr_uring_ring_t *ring)
+{
+    struct io_uring_sqe *sqe;
+
+    if (ring->sq_tail - apr_atomic_read32(ring->sq_head)
+            == ring->sq_entries) {
+        /* Full, flush it */
+        if (apr_uring_ring_submit(ring) != APR_SUCCESS) {
+            return NULL;
+        }
+    }
+
+    sqe = &ring->sqes[ring->sq_tail++ & ring->sq_mask];
+    memset(sqe, 0, sizeof(*sqe));
+
+    return sqe;
+}
+
+static apr_uint32_t get_uring_event(apr_int16_t event)
+{
+    apr_uint32_t rv = 0;
+
+    if (event & APR_POLLIN)
+        rv |= POLLIN;
+    if (event & APR_POLLPRI)
+        rv |= POLLPRI;
+    if (event & APR_POLLOUT)
+        rv |= POLLOUT;
+    /* APR_POLLERR, APR_POLLHUP and APR_POLLNVAL are return-only */
+
+#if APR_IS_BIGENDIAN
+    /* poll32_events is in little-endian half-word order */
+    rv = (rv << 16) | (rv >> 16);
+#endif
+
+    return rv;
+}
+
+static apr_int16_t get_uring_revent(apr_uint32_t event)
+{
+    apr_int16_t rv = 0;
+
+    if (event & POLLIN)
+        rv |= APR_POLLIN;
+    if (event & POLLPRI)
+        rv |= APR_POLLPRI;
+    if (event & POLLOUT)
+        rv |= APR_POLLOUT;
+    if (event & POLLERR)
+        rv |= APR_POLLERR;
+    if (event & POLLHUP)
+        rv |= APR_POLLHUP;
+    if (event & POLLNVAL)
+        rv |= APR_POLLNVAL;
+
+    return rv;
+}
+
+typedef struct uring_elem_t uring_elem_t;
+
+struct uring_elem_t {
+    APR_RING_ENTRY(uring_elem_t) link;
+    /* The descriptor returned, pfd or the caller's one (not copied) */
+    apr_pollfd_t *descriptor;
+    apr_pollfd_t pfd;
+    int fd;
+    /* A poll request is queued or in flight for this element */
+    int armed;
+    /* The events of that request */
+    apr_uint32_t events;
+    /* Use a multishot poll request (the wakeup pipe) */
+    int multishot;
+    /* Removed, recycled once its poll request completed */
+    int removed;
+};
+
+typedef struct apr_uring_t apr_uring_t;
+
+struct apr_uring_t
+{
+    apr_pool_t *pool;
+#if APR_HAS_THREADS
+    /* Protects the rings below, for APR_POLLSET_THREADSAFE */
+    apr_thread_mutex_t *lock;
+#endif
+    /* The submission and completion rings shared with the kernel */
+    apr_uring_ring_t ring;
+    /* Cleared if the kernel refuses IORING_POLL_ADD_MULTI (< 5.13) */
+    int multishot;
+    /* A ring containing all of the elements that are active */
+    APR_RING_HEAD(uring_query_ring_t, uring_elem_t) query_ring;
+    /* A ring of elements that have been used, and then _remove()'d */
+    APR_RING_HEAD(uring_free_ring_t, uring_elem_t) free_ring;
+    /* A ring of elements _remove()'d whose poll request is in flight */
+    APR_RING_HEAD(uring_dead_ring_t, uring_elem_t) dead_ring;
+};
+
+#if APR_HAS_THREADS
+#define uring_lock(u) \
+    if ((u)->lock) \
+        apr_thread_mutex_lock((u)->lock);
+#define uring_unlock(u) \
+    if ((u)->lock) \
+        apr_thread_mutex_unlock((u)->lock);
+#define uring_is_threadsafe(u) ((u)->lock != NULL)
+#else
+#define uring_lock(u)
+#define uring_unlock(u)
+#define uring_is_threadsafe(u) 0
+#endif
+
+static apr_status_t uring_arm(apr_uring_t *u, uring_elem_t *elem)
+{
+    struct io_uring_sqe *sqe = apr_uring_ring_get_sqe(&u->ring);
+
+    if (!sqe) {
+        return errno;
+    }
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = elem->fd;
+    sqe->poll32_events = get_uring_event(elem->descriptor->reqevents);
+    if (elem->multishot && u->multishot) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    sqe->user_data = (apr_uint64_t)(apr_uintptr_t)elem;
+    elem->armed = 1;
+    elem->events = sqe->poll32_events;
+
+    return APR_SUCCESS;
+}
+
+/* Queue the cancellation of the element's poll request, which completes
+ * with -ECANCELED (unless it completed already).
+ */
+static apr_status_t uring_cancel(apr_uring_t *u, uring_elem_t *elem)
+{
+    struct io_uring_sqe *sqe = apr_uring_ring_get_sqe(&u->ring);
+
+    if (!sqe) {
+        return errno;
+    }
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = (apr_uint64_t)(apr_uintptr_t)elem;
+    sqe->user_data = 0;
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_cleanup(apr_uring_t *u)
+{
+    apr_uring_ring_cleanup(&u->ring);
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_create(apr_uring_t **ret, apr_uint32_t size,
+                                 apr_pool_t *p, apr_uint32_t flags)
+{
+    apr_uint32_t entries;
+    apr_uring_t *u;
+    apr_status_t rv;
+
+#if !APR_HAS_THREADS
+    if (flags & APR_POLLSET_THREADSAFE) {
+        return APR_ENOTIMPL;
+    }
+#endif
+
+    /* Room for a poll and a remove request per descriptor, the ring
+     * is flushed if it gets full anyway.
+     */
+    for (entries = 8; entries < 2 * size && entries < URING_MAX_ENTRIES;
+         entries <<= 1)
+        ;
+
+    u = apr_pcalloc(p, sizeof(*u));
+    rv = apr_uring_ring_setup(&u->ring, entries);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    u->pool = p;
+    u->multishot = 1;
+
+#if APR_HAS_THREADS
+    if ((flags & APR_POLLSET_THREADSAFE) &&
+        ((rv = apr_thread_mutex_create(&u->lock, APR_THREAD_MUTEX_DEFAULT,
+                                       p)) != APR_SUCCESS)) {
+        uring_cleanup(u);
+        return rv;
+    }
+#endif
+
+    APR_RING_INIT(&u->query_ring, uring_elem_t, link);
+    APR_RING_INIT(&u->free_ring, uring_elem_t, link);
+    APR_RING_INIT(&u->dead_ring, uring_elem_t, link);
+
+    *ret = u;
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_add(apr_uring_t *u, const apr_pollfd_t *descriptor,
+                              int copy, int multishot)
+{
+    uring_elem_t *elem;
+    apr_status_t rv;
+
+    if (descriptor->reqevents & APR_POLLET) {
+        return APR_ENOTIMPL;
+    }
+
+    uring_lock(u);
+
+    if (!APR_RING_EMPTY(&u->free_ring, uring_elem_t, link)) {
+        elem = APR_RING_FIRST(&u->free_ring);
+        APR_RING_REMOVE(elem, link);
+    }
+    else {
+        elem = (uring_elem_t *) apr_palloc(u->pool, sizeof(uring_elem_t));
+        APR_RING_ELEM_INIT(elem, link);
+    }
+    if (copy) {
+        elem->pfd = *descriptor;
+        elem->descriptor = &elem->pfd;
+    }
+    else {
+        elem->descriptor = (apr_pollfd_t *)descriptor;
+    }
+    if (descriptor->desc_type == APR_POLL_SOCKET) {
+        elem->fd = descriptor->desc.s->socketdes;
+    }
+    else {
+        elem->fd = descriptor->desc.f->filedes;
+    }
+    elem->multishot = multishot;
+    elem->removed = 0;
+
+    rv = uring_arm(u, elem);
+    if (rv == APR_SUCCESS && uring_is_threadsafe(u)) {
+        rv = apr_uring_ring_submit(&u->ring);
+    }
+    if (rv == APR_SUCCESS) {
+        APR_RING_INSERT_TAIL(&u->query_ring, elem, uring_elem_t, link);
+    }
+    else {
+        APR_RING_INSERT_TAIL(&u->free_ring, elem, uring_elem_t, link);
+    }
+
+    uring_unlock(u);
+
+    return rv;
+}
+
+static apr_status_t uring_remove(apr_uring_t *u,
+                                 const apr_pollfd_t *descriptor)
+{
+    uring_elem_t *elem;
+    apr_status_t rv = APR_NOTFOUND;
+
+    uring_lock(u);
+
+    for (elem = APR_RING_FIRST(&u->query_ring);
+         elem != APR_RING_SENTINEL(&u->query_ring, uring_elem_t, link);
+         elem = APR_RING_NEXT(elem, link)) {
+
+        if (descriptor->desc.s == elem->descriptor->desc.s) {
+            APR_RING_REMOVE(elem, link);
+            elem->removed = 1;
+            rv = APR_SUCCESS;
+
+            if (!elem->armed) {
+                APR_RING_INSERT_TAIL(&u->free_ring, elem, uring_elem_t,
+                                     link);
+                break;
+            }
+
+            /* The element is recycled when the poll request completes,
+             * with -ECANCELED or before being cancelled.
+             */
+            APR_RING_INSERT_TAIL(&u->dead_ring, elem, uring_elem_t, link);
+            rv = uring_cancel(u, elem);
+            if (rv == APR_SUCCESS) {
+                /* Submitted now for the descriptor to be released, should
+                 * the caller close it.
+                 */
+                rv = apr_uring_ring_submit(&u->ring);
+            }
+            break;
+        }
+    }
+
+    uring_unlock(u);
+
+    return rv;
+}
+
+static apr_status_t uring_rearm(apr_uring_t *u,
+                                const apr_pollfd_t *descriptor, int copy)
+{
+    uring_elem_t *elem;
+    apr_status_t rv = APR_NOTFOUND;
+
+    uring_lock(u);
+
+    for (elem = APR_RING_FIRST(&u->query_ring);
+         elem != APR_RING_SENTINEL(&u->query_ring, uring_elem_t, link);
+         elem = APR_RING_NEXT(elem, link)) {
+
+        if (descriptor->desc.s == elem->descriptor->desc.s) {
+            if (copy) {
+                elem->pfd = *descriptor;
+            }
+            rv = APR_SUCCESS;
+            if (!elem->armed) {
+                rv = uring_arm(u, elem);
+            }
+            else if (elem->events
+                     != get_uring_event(elem->descriptor->reqevents)) {
+                /* The request in flight still has the former events, it
+                 * is re-armed with the new ones once cancelled.
+                 */
+                rv = uring_cancel(u, elem);
+                if (rv == APR_SUCCESS) {
+                    elem->events =
+                        get_uring_event(elem->descriptor->reqevents);
+                }
+            }
+            else {
+                break;
+            }
+            if (rv == APR_SUCCESS && uring_is_threadsafe(u)) {
+                rv = apr_uring_ring_submit(&u->ring);
+            }
+            break;
+        }
+    }
+
+    uring_unlock(u);
+
+    return rv;
+}
+
+/* Submit the queued requests and wait for completions, if none is
+ * available already.
+ */
+static apr_status_t uring_wait(apr_uring_t *u, apr_interval_time_t timeout)
+{
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    apr_uint32_t to_submit, min_complete = 1;
+    apr_uint32_t flags = IORING_ENTER_GETEVENTS;
+    apr_status_t rv = APR_SUCCESS;
+    int ready;
+
+    uring_lock(u);
+    apr_atomic_set32(u->ring.sq_ktail, u->ring.sq_tail);
+    to_submit = u->ring.sq_tail - apr_atomic_read32(u->ring.sq_head);
+    if (to_submit && uring_is_threadsafe(u)) {
+        /* The submissions are serialized, not the waits */
+        rv = apr_uring_ring_submit(&u->ring);
+        to_submit = 0;
+    }
+    ready = apr_atomic_read32(u->ring.cq_tail) != *u->ring.cq_head;
+    uring_unlock(u);
+
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    if (ready || timeout == 0) {
+        if (!to_submit) {
+            return APR_SUCCESS;
+        }
+        min_complete = 0;
+        flags = 0;
+    }
+    else if (timeout > 0) {
+        memset(&arg, 0, sizeof(arg));
+        ts.tv_sec = apr_time_sec(timeout);
+        ts.tv_nsec = apr_time_usec(timeout) * 1000;
+        arg.ts = (apr_uint64_t)(apr_uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    if (apr_uring_ring_enter(&u->ring, to_submit, min_complete, flags,
+                    (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL,
+                    (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0) < 0) {
+        rv = errno;
+        if (rv == ETIME) {
+            rv = APR_TIMEUP;
+        }
+        else if (rv == EBUSY || rv == EAGAIN) {
+            /* Completions to reap first */
+            rv = APR_SUCCESS;
+        }
+    }
+
+    return rv;
+}
+
+/* Reap up to max completions, into results (copies) or ptrs (the
+ * descriptors themselves, with their rtnevents set), and re-arm the
+ * descriptors returned.
+ */
+static apr_uint32_t uring_reap(apr_uring_t *u, apr_pollfd_t *results,
+                               apr_pollfd_t **ptrs, apr_uint32_t max)
+{
+    apr_uint32_t head, tail, n = 0;
+
+    uring_lock(u);
+
+    head = *u->ring.cq_head;
+    tail = apr_atomic_read32(u->ring.cq_tail);
+    while (head != tail && n < max) {
+        struct io_uring_cqe *cqe = &u->ring.cqes[head & u->ring.cq_mask];
+        uring_elem_t *elem = (uring_elem_t *)(apr_uintptr_t)cqe->user_data;
+        apr_int32_t res = cqe->res;
+        apr_int16_t revents;
+
+        /* Release the entry before possibly submitting (when re-arming
+         * with a full submission ring).
+         */
+        apr_atomic_set32(u->ring.cq_head, ++head);
+
+        if (!elem) {
+            /* IORING_OP_POLL_REMOVE's completion */
+            continue;
+        }
+        if (!(cqe->flags & IORING_CQE_F_MORE)) {
+            elem->armed = 0;
+        }
+        if (elem->removed) {
+            if (!elem->armed) {
+                APR_RING_REMOVE(elem, link);
+                APR_RING_INSERT_TAIL(&u->free_ring, elem, uring_elem_t,
+                                     link);
+            }
+            continue;
+        }
+
+        if (res < 0) {
+            if (res == -ECANCELED || (res == -EINVAL && elem->multishot
+                                                     && u->multishot)) {
+                if (res == -EINVAL) {
+                    u->multishot = 0;
+                }
+                if (!elem->armed) {
+                    uring_arm(u, elem);
+                }
+                continue;
+            }
+            /* Not re-armed, until removed and added again */
+            revents = (res == -EBADF) ? APR_POLLNVAL : APR_POLLERR;
+        }
+        else {
+            revents = get_uring_revent((apr_uint32_t)res);
+            if (!elem->armed
+                && !(elem->descriptor->reqevents & APR_POLLONESHOT)) {
+                uring_arm(u, elem);
+            }
+            /* Not the events of a request completed before being
+             * cancelled by _rearm() with new ones.
+             */
+            revents &= elem->descriptor->reqevents
+                       | APR_POLLERR | APR_POLLHUP | APR_POLLNVAL;
+            if (!revents) {
+                continue;
+            }
+        }
+
+        if (results) {
+            results[n] = *elem->descriptor;
+            results[n].rtnevents = revents;
+        }
+        else {
+            elem->descriptor->rtnevents = revents;
+            ptrs[n] = elem->descriptor;
+        }
+        n++;
+    }
+
+    uring_unlock(u);
+
+    return n;
+}
+
+struct apr_pollset_private_t
+{
+    apr_uring_t *uring;
+    apr_pollfd_t *result_set;
+};
+
+static apr_status_t impl_pollset_cleanup(apr_pollset_t *pollset)
+{
+    return uring_cleanup(pollset->p->uring);
+}
+
+static apr_status_t impl_pollset_create(apr_pollset_t *pollset,
+                                        apr_uint32_t size,
+                                        apr_pool_t *p,
+                                        apr_uint32_t flags)
+{
+    apr_uring_t *uring;
+    apr_status_t rv;
+
+    rv = uring_create(&uring, size, p, flags);
+    if (rv != APR_SUCCESS) {
+        pollset->p = NULL;
+        return rv;
+    }
+
+    pollset->p = apr_palloc(p, sizeof(apr_pollset_private_t));
+    pollset->p->uring = uring;
+    pollset->p->result_set = apr_palloc(p, size * sizeof(apr_pollfd_t));
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
+                                     const apr_pollfd_t *descriptor)
+{
+    int wakeup = descriptor == &pollset->wakeup_pfd;
+
+    return uring_add(pollset->p->uring, descriptor,
+                     !(pollset->flags & APR_POLLSET_NOCOPY), wakeup);
+}
+
+static apr_status_t impl_pollset_remove(apr_pollset_t *pollset,
+                                        const apr_pollfd_t *descriptor)
+{
+    return uring_remove(pollset->p->uring, descriptor);
+}
+
+static apr_status_t impl_pollset_rearm(apr_pollset_t *pollset,
+                                       const apr_pollfd_t *descriptor)
+{
+    return uring_rearm(pollset->p->uring, descriptor,
+                       !(pollset->flags & APR_POLLSET_NOCOPY));
+}
+
+static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
+                                      apr_interval_time_t timeout,
+                                      apr_int32_t *num,
+                                      const apr_pollfd_t **descriptors)
+{
+    apr_uring_t *uring = pollset->p->uring;
+    apr_pollfd_t *result_set = pollset->p->result_set;
+    apr_time_t deadline = 0;
+    apr_uint32_t i, j, n;
+    apr_status_t rv;
+
+    *num = 0;
+
+    if (timeout > 0) {
+        deadline = apr_time_now() + timeout;
+    }
+
+    for (;;) {
+        rv = uring_wait(uring, timeout);
+        if (rv != APR_SUCCESS && rv != APR_TIMEUP) {
+            return rv;
+        }
+
+        n = uring_reap(uring, result_set, NULL, pollset->nalloc);
+        for (i = 0, j = 0; i < n; i++) {
+            /* Check if the polled descriptor is our
+             * wakeup pipe. In that case do not put it result set.
+             */
+            if ((pollset->flags & APR_POLLSET_WAKEABLE) &&
+                result_set[i].desc_type == APR_POLL_FILE &&
+                result_set[i].desc.f == pollset->wakeup_pipe[0]) {
+                apr_poll_drain_wakeup_pipe(&pollset->wakeup_set,
+                                           pollset->wakeup_pipe);
+                rv = APR_EINTR;
+            }
+            else {
+                if (i != j) {
+                    result_set[j] = result_set[i];
+                }
+                j++;
+            }
+        }
+        if (((*num) = j)) { /* any event besides wakeup pipe? */
+            if (descriptors) {
+                *descriptors = result_set;
+            }
+            return APR_SUCCESS;
+        }
+        if (rv != APR_SUCCESS || n || timeout == 0) {
+            return rv == APR_SUCCESS ? APR_TIMEUP : rv;
+        }
+
+        /* Only completions of removed descriptors, wait more */
+        if (timeout > 0) {
+            timeout = deadline - apr_time_now();
+            if (timeout <= 0) {
+                return APR_TIMEUP;
+            }
+        }
+    }
+}
+
+static const apr_pollset_provider_t impl = {
+    impl_pollset_create,
+    impl_pollset_add,
+    impl_pollset_remove,
+    impl_pollset_poll,
+    impl_pollset_cleanup,
+    "io_uring",
+    impl_pollset_rearm
+};
+
+const apr_pollset_provider_t *const apr_pollset_provider_io_uring = &impl;
+
+static apr_status_t impl_pollcb_cleanup(apr_pollcb_t *pollcb)
+{
+    return uring_cleanup(pollcb->pollset.uring);
+}
+
+static apr_status_t impl_pollcb_create(apr_pollcb_t *pollcb,
+                                       apr_uint32_t size,
+                                       apr_pool_t *p,
+                                       apr_uint32_t flags)
+{
+    apr_uring_t *uring;
+    apr_status_t rv;
+
+    rv = uring_create(&uring, size, p, flags);
+    if (rv != APR_SUCCESS) {
+        pollcb->fd = -1;
+        return rv;
+    }
+
+    pollcb->fd = uring->ring.fd;
+    pollcb->pollset.uring = uring;
+    pollcb->copyset = apr_palloc(p, size * sizeof(apr_pollfd_t *));
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t impl_pollcb_add(apr_pollcb_t *pollcb,
+                                    apr_pollfd_t *descriptor)
+{
+    int wakeup = descriptor == &pollcb->wakeup_pfd;
+
+    return uring_add(pollcb->pollset.uring, descriptor, 0, wakeup);
+}
+
+static apr_status_t impl_pollcb_remove(apr_pollcb_t *pollcb,
+                                       apr_pollfd_t *descriptor)
+{
+    return uring_remove(pollcb->pollset.uring, descriptor);
+}
+
+static apr_status_t impl_pollcb_rearm(apr_pollcb_t *pollcb,
+                                      apr_pollfd_t *descriptor)
+{
+    return uring_rearm(pollcb->pollset.uring, descriptor, 0);
+}
+
+static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
+                                     apr_interval_time_t timeout,
+                                     apr_pollcb_cb_t func,
+                                     void *baton)
+{
+    apr_uring_t *uring = pollcb->pollset.uring;
+    apr_time_t deadline = 0;
+    apr_uint32_t i, n;
+    apr_status_t rv;
+
+    if (timeout > 0) {
+        deadline = apr_time_now() + timeout;
+    }
+
+    for (;;) {
+        rv = uring_wait(uring, timeout);
+        if (rv != APR_SUCCESS && rv != APR_TIMEUP) {
+            return rv;
+        }
+
+        n = uring_reap(uring, NULL, pollcb->copyset, pollcb->nalloc);
+        for (i = 0; i < n; i++) {
+            apr_pollfd_t *pollfd = pollcb->copyset[i];
+
+            if ((pollcb->flags & APR_POLLSET_WAKEABLE) &&
+                pollfd->desc_type == APR_POLL_FILE &&
+                pollfd->desc.f == pollcb->wakeup_pipe[0]) {
+                apr_poll_drain_wakeup_pipe(&pollcb->wakeup_set,
+                                           pollcb->wakeup_pipe);
+                return APR_EINTR;
+            }
+
+            rv = func(baton, pollfd);
+            if (rv) {
+                return rv;
+            }
+        }
+        if (n) {
+            return APR_SUCCESS;
+        }
+        if (rv != APR_SUCCESS || timeout == 0) {
+            return APR_TIMEUP;
+        }
+
+        /* Only completions of removed descriptors, wait more */
+        if (timeout > 0) {
+            timeout = deadline - apr_time_now();
+            if (timeout <= 0) {
+                return APR_TIMEUP;
+            }
+        }
+    }
+}
+
+static const apr_pollcb_provider_t impl_cb = {
+    impl_pollcb_create,
+    impl_pollcb_add,
+    impl_pollcb_remove,
+    impl_pollcb_poll,
+    impl_pollcb_cleanup,
+    "io_uring",
+    impl_pollcb_rearm
+};
+
+const apr_pollcb_provider_t *const apr_pollcb_provider_io_uring = &impl_cb;
+
+#endif /* HAVE_IO_URING */
@@ -0,0 +1,886 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr.h"
+#include "apr_ioqueue.h"
+#include "apr_poll.h"
+#include "apr_portable.h"
+#include "apr_ring.h"
+#include "apr_atomic.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
+#include "apr_thread_pool.h"
+#include "apr_arch_file_io.h"
+#include "apr_arch_networkio.h"
+#include "apr_arch_poll_private.h"
+
+#if defined(HAVE_IO_URING)
+#include <string.h>
+#include <sys/socket.h>
+#endif
+
+typedef struct ioqueue_op_t ioqueue_op_t;
+
+struct ioqueue_op_t {
+    APR_RING_ENTRY(ioqueue_op_t) link;
+    apr_ioqueue_t *ioqueue;
+    /* The completion returned, with the op and baton set on submit */
+    apr_ioqueue_completion_t completion;
+    apr_socket_t *sock;
+    apr_file_t *file;
+    char *buf;
+    apr_size_t len;
+    const struct iovec *vec;
+    apr_int32_t nvec;
+    apr_off_t offset;
+    apr_pool_t *pool;
+    /* Submitted and not reaped yet */
+    int pending;
+#if defined(HAVE_IO_URING)
+    /* Must live until the completion for IORING_OP_SENDMSG and
+     * IORING_OP_ACCEPT */
+    struct msghdr msg;
+    struct sockaddr_storage addr;
+    socklen_t addrlen;
+#endif
+};
+
+typedef struct ioqueue_provider_t {
+    apr_status_t (*create)(apr_ioqueue_t *, apr_uint32_t, apr_pool_t *);
+    apr_status_t (*submit)(apr_ioqueue_t *, ioqueue_op_t *);
+    apr_status_t (*flush)(apr_ioqueue_t *);
+    apr_status_t (*reap)(apr_ioqueue_t *, apr_interval_time_t,
+                         apr_ioqueue_completion_t *, apr_int32_t,
+                         apr_int32_t *);
+    apr_status_t (*cleanup)(apr_ioqueue_t *);
+    const char *name;
+} ioqueue_provider_t;
+
+struct apr_ioqueue_t
+{
+    apr_pool_t *pool;
+    const ioqueue_provider_t *provider;
+    /* Operations submitted and not reaped yet */
+    apr_uint32_t pending;
+    ioqueue_op_t *ops;
+    apr_uint32_t size;
+    /* A ring of the operations available for submission */
+    APR_RING_HEAD(ioqueue_free_ring_t, ioqueue_op_t) free_ring;
+#if defined(HAVE_IO_URING)
+    apr_uring_ring_t ring;
+#endif
+#if APR_HAS_THREADS
+    apr_thread_pool_t *threads;
+    /* Protects done_ring, signaled by the threads on completion */
+    apr_thread_mutex_t *lock;
+    apr_thread_cond_t *cond;
+    /* Serializes the reads and writes at an offset (seek + I/O) */
+    apr_thread_mutex_t *file_lock;
+    /* A ring of the operations completed by the threads */
+    APR_RING_HEAD(ioqueue_done_ring_t, ioqueue_op_t) done_ring;
+#endif
+};
+
+static void ioqueue_op_done(ioqueue_op_t *op, apr_status_t status,
+                            apr_size_t len)
+{
+    op->completion.status = status;
+    op->completion.len = len;
+    if (status == APR_SUCCESS && len == 0 && op->len > 0
+        && (op->completion.op == APR_IOQUEUE_RECV
+            || op->completion.op == APR_IOQUEUE_READ)) {
+        op->completion.status = APR_EOF;
+    }
+}
+
+#if defined(HAVE_IO_URING)
+
+/* The operations are queued in the submission ring by _submit() and
+ * submitted by the io_uring_enter() which waits for the completions in
+ * _reap(), or by _flush().  The ring has at least as many entries as
+ * operations can be in flight, so it never needs to be flushed early.
+ */
+
+#define URING_MAX_ENTRIES 4096
+
+static apr_status_t uring_create(apr_ioqueue_t *ioqueue, apr_uint32_t size,
+                                 apr_pool_t *p)
+{
+    apr_uint32_t entries;
+
+    for (entries = 8; entries < size && entries < URING_MAX_ENTRIES;
+         entries <<= 1)
+        ;
+
+    return apr_uring_ring_setup(&ioqueue->ring, entries);
+}
+
+/* The operations in flight are cancelled and waited for before closing the
+ * ring, the kernel could still use their buffers otherwise.
+ */
+static apr_status_t uring_cleanup(apr_ioqueue_t *ioqueue)
+{
+    apr_uring_ring_t *ring = &ioqueue->ring;
+    struct io_uring_sqe *sqe;
+    apr_uint32_t i, head, tail;
+
+    for (i = 0; i < ioqueue->size && ioqueue->pending; i++) {
+        if (ioqueue->ops[i].pending) {
+            if (!(sqe = apr_uring_ring_get_sqe(ring))) {
+                break;
+            }
+            sqe->opcode = IORING_OP_ASYNC_CANCEL;
+            sqe->fd = -1;
+            sqe->addr = (apr_uint64_t)(apr_uintptr_t)&ioqueue->ops[i];
+            sqe->user_data = 0;
+        }
+    }
+    apr_atomic_set32(ring->sq_ktail, ring->sq_tail);
+    while (ioqueue->pending) {
+        if (apr_uring_ring_enter(ring,
+                                 ring->sq_tail
+                                 - apr_atomic_read32(ring->sq_head),
+                                 1, IORING_ENTER_GETEVENTS, NULL, 0) < 0
+            && errno != EINTR && errno != EBUSY && errno != EAGAIN) {
+            break;
+        }
+        head = *ring->cq_head;
+        tail = apr_atomic_read32(ring->cq_tail);
+        for (; head != tail; head++) {
+            ioqueue_op_t *op = (ioqueue_op_t *)(apr_uintptr_t)
+                               ring->cqes[head & ring->cq_mask].user_data;
+
+            if (op) {
+                if (op->completion.op == APR_IOQUEUE_ACCEPT
+                    && ring->cqes[head & ring->cq_mask].res >= 0) {
+                    close(ring->cqes[head & ring->cq_mask].res);
+                }
+                op->pending = 0;
+                ioqueue->pending--;
+            }
+        }
+        apr_atomic_set32(ring->cq_head, head);
+    }
+
+    apr_uring_ring_cleanup(ring);
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_submit(apr_ioqueue_t *ioqueue, ioqueue_op_t *op)
+{
+    struct io_uring_sqe *sqe = apr_uring_ring_get_sqe(&ioqueue->ring);
+
+    if (!sqe) {
+        return errno;
+    }
+
+    switch (op->completion.op) {
+    case APR_IOQUEUE_RECV:
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = op->sock->socketdes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)op->buf;
+        sqe->len = (apr_uint32_t)op->len;
+        break;
+    case APR_IOQUEUE_SEND:
+        sqe->opcode = IORING_OP_SEND;
+        sqe->fd = op->sock->socketdes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)op->buf;
+        sqe->len = (apr_uint32_t)op->len;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        break;
+    case APR_IOQUEUE_SENDV:
+        memset(&op->msg, 0, sizeof(op->msg));
+        op->msg.msg_iov = (struct iovec *)op->vec;
+        op->msg.msg_iovlen = op->nvec;
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = op->sock->socketdes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)&op->msg;
+        sqe->len = 1;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        break;
+    case APR_IOQUEUE_READ:
+    case APR_IOQUEUE_WRITE:
+        sqe->opcode = (op->completion.op == APR_IOQUEUE_READ)
+                      ? IORING_OP_READ : IORING_OP_WRITE;
+        sqe->fd = op->file->filedes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)op->buf;
+        sqe->len = (apr_uint32_t)op->len;
+        /* -1 for the current position */
+        sqe->off = (apr_uint64_t)op->offset;
+        break;
+    case APR_IOQUEUE_ACCEPT:
+        op->addrlen = sizeof(op->addr);
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = op->sock->socketdes;
+        sqe->addr = (apr_uint64_t)(apr_uintptr_t)&op->addr;
+        sqe->addr2 = (apr_uint64_t)(apr_uintptr_t)&op->addrlen;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        break;
+    }
+    sqe->user_data = (apr_uint64_t)(apr_uintptr_t)op;
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t uring_flush(apr_ioqueue_t *ioqueue)
+{
+    return apr_uring_ring_submit(&ioqueue->ring);
+}
+
+static void uring_complete(ioqueue_op_t *op, apr_int32_t res)
+{
+    apr_os_sock_info_t info;
+    apr_os_sock_t fd;
+    apr_status_t rv;
+
+    if (res < 0) {
+        ioqueue_op_done(op, -res, 0);
+        return;
+    }
+    if (op->completion.op != APR_IOQUEUE_ACCEPT) {
+        ioqueue_op_done(op, APR_SUCCESS, (apr_size_t)res);
+        return;
+    }
+
+    fd = res;
+    memset(&info, 0, sizeof(info));
+    info.os_sock = &fd;
+    info.remote = (struct sockaddr *)&op->addr;
+    info.family = op->sock->local_addr->family;
+    info.type = op->sock->type;
+    info.protocol = op->sock->protocol;
+    rv = apr_os_sock_make(&op->completion.accepted, &info, op->pool);
+    if (rv != APR_SUCCESS) {
+        close(fd);
+    }
+    ioqueue_op_done(op, rv, 0);
+}
+
+static apr_status_t uring_reap(apr_ioqueue_t *ioqueue,
+                               apr_interval_time_t timeout,
+                               apr_ioqueue_completion_t *completions,
+                               apr_int32_t max, apr_int32_t *num)
+{
+    apr_uring_ring_t *ring = &ioqueue->ring;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    apr_uint32_t to_submit, head, tail;
+    apr_uint32_t min_complete = 1, flags = IORING_ENTER_GETEVENTS;
+    apr_status_t rv = APR_SUCCESS;
+    apr_int32_t n = 0;
+
+    apr_atomic_set32(ring->sq_ktail, ring->sq_tail);
+    to_submit = ring->sq_tail - apr_atomic_read32(ring->sq_head);
+    if (apr_atomic_read32(ring->cq_tail) != *ring->cq_head
+        || timeout == 0) {
+        min_complete = 0;
+        flags = 0;
+    }
+    else if (timeout > 0) {
+        memset(&arg, 0, sizeof(arg));
+        ts.tv_sec = apr_time_sec(timeout);
+        ts.tv_nsec = apr_time_usec(timeout) * 1000;
+        arg.ts = (apr_uint64_t)(apr_uintptr_t)&ts;
+        flags |= IORING_ENTER_EXT_ARG;
+    }
+
+    if ((to_submit || min_complete)
+        && apr_uring_ring_enter(ring, to_submit, min_complete, flags,
+                                (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL,
+                                (flags & IORING_ENTER_EXT_ARG)
+                                ? sizeof(arg) : 0) < 0) {
+        rv = errno;
+        if (rv == ETIME) {
+            rv = APR_TIMEUP;
+        }
+        else if (rv == EBUSY || rv == EAGAIN) {
+            /* Completions to reap first */
+            rv = APR_SUCCESS;
+        }
+    }
+
+    head = *ring->cq_head;
+    tail = apr_atomic_read32(ring->cq_tail);
+    while (head != tail && n < max) {
+        struct io_uring_cqe *cqe = &ring->cqes[head & ring->cq_mask];
+        ioqueue_op_t *op = (ioqueue_op_t *)(apr_uintptr_t)cqe->user_data;
+
+        head++;
+        if (!op) {
+            /* IORING_OP_ASYNC_CANCEL's completion */
+            continue;
+        }
+        uring_complete(op, cqe->res);
+        op->pending = 0;
+        completions[n++] = op->completion;
+        APR_RING_INSERT_TAIL(&ioqueue->free_ring, op, ioqueue_op_t, link);
+    }
+    apr_atomic_set32(ring->cq_head, head);
+
+    *num = n;
+    if (n) {
+        return APR_SUCCESS;
+    }
+    return rv == APR_SUCCESS ? APR_TIMEUP : rv;
+}
+
+static const ioqueue_provider_t ioqueue_uring = {
+    uring_create,
+    uring_submit,
+    uring_flush,
+    uring_reap,
+    uring_cleanup,
+    "io_uring"
+};
+
+#endif /* HAVE_IO_URING */
+
+#if APR_HAS_THREADS
+
+/* Each operation is run by a thread of the pool with the blocking
+ * functions, waiting for the descriptor with apr_poll() should it be
+ * non-blocking (or have a timeout), and moved to the done ring where
+ * _reap() picks it.
+ */
+
+static apr_status_t thread_wait(ioqueue_op_t *op, apr_int16_t reqevents)
+{
+    apr_pollfd_t pfd;
+    apr_int32_t nsds;
+    apr_status_t rv;
+
+    memset(&pfd, 0, sizeof(pfd));
+    pfd.reqevents = reqevents;
+    if (op->sock) {
+        pfd.desc_type = APR_POLL_SOCKET;
+        pfd.desc.s = op->sock;
+    }
+    else {
+        pfd.desc_type = APR_POLL_FILE;
+        pfd.desc.f = op->file;
+    }
+    do {
+        rv = apr_poll(&pfd, 1, &nsds, -1);
+    } while (APR_STATUS_IS_EINTR(rv));
+
+    return rv;
+}
+
+#define THREAD_RETRY(rv) (APR_STATUS_IS_EAGAIN(rv) || APR_STATUS_IS_TIMEUP(rv))
+
+static apr_status_t thread_file_io(ioqueue_op_t *op, apr_size_t *len)
+{
+    apr_thread_mutex_t *file_lock = op->ioqueue->file_lock;
+    apr_off_t pos = 0, off = op->offset;
+    apr_status_t rv;
+
+    if (op->offset < 0) {
+        if (op->completion.op == APR_IOQUEUE_READ) {
+            return apr_file_read(op->file, op->buf, len);
+        }
+        return apr_file_write(op->file, op->buf, len);
+    }
+
+    /* Like pread()/pwrite(), the position is restored */
+    apr_thread_mutex_lock(file_lock);
+    rv = apr_file_seek(op->file, APR_CUR, &pos);
+    if (rv == APR_SUCCESS) {
+        rv = apr_file_seek(op->file, APR_SET, &off);
+    }
+    if (rv == APR_SUCCESS) {
+        if (op->completion.op == APR_IOQUEUE_READ) {
+            rv = apr_file_read(op->file, op->buf, len);
+        }
+        else {
+            rv = apr_file_write(op->file, op->buf, len);
+        }
+        apr_file_seek(op->file, APR_SET, &pos);
+    }
+    apr_thread_mutex_unlock(file_lock);
+
+    return rv;
+}
+
+static void *APR_THREAD_FUNC thread_run(apr_thread_t *thd, void *data)
+{
+    ioqueue_op_t *op = data;
+    apr_ioqueue_t *ioqueue = op->ioqueue;
+    apr_size_t len;
+    apr_status_t rv;
+
+    for (;;) {
+        len = op->len;
+        switch (op->completion.op) {
+        case APR_IOQUEUE_RECV:
+            rv = apr_socket_recv(op->sock, op->buf, &len);
+            break;
+        case APR_IOQUEUE_SEND:
+            rv = apr_socket_send(op->sock, op->buf, &len);
+            break;
+        case APR_IOQUEUE_SENDV:
+            rv = apr_socket_sendv(op->sock, op->vec, op->nvec, &len);
+            break;
+        case APR_IOQUEUE_ACCEPT:
+            len = 0;
+            rv = apr_socket_accept(&op->completion.accepted, op->sock,
+                                   op->pool);
+            break;
+        default:
+            rv = thread_file_io(op, &len);
+            break;
+        }
+        if (!THREAD_RETRY(rv)) {
+            break;
+        }
+        rv = thread_wait(op, (op->completion.op == APR_IOQUEUE_RECV
+                              || op->completion.op == APR_IOQUEUE_READ
+                              || op->completion.op == APR_IOQUEUE_ACCEPT)
+                             ? APR_POLLIN : APR_POLLOUT);
+        if (rv != APR_SUCCESS) {
+            len = 0;
+            break;
+        }
+    }
+    if (op->completion.op == APR_IOQUEUE_ACCEPT && rv == APR_SUCCESS) {
+        /* Blocking like io_uring's */
+        apr_socket_timeout_set(op->completion.accepted, -1);
+    }
+    if (rv == APR_EOF) {
+        /* apr_socket_recv() and apr_file_read() may return it with data */
+        rv = APR_SUCCESS;
+    }
+    ioqueue_op_done(op, rv, len);
+
+    apr_thread_mutex_lock(ioqueue->lock);
+    APR_RING_INSERT_TAIL(&ioqueue->done_ring, op, ioqueue_op_t, link);
+    apr_thread_cond_signal(ioqueue->cond);
+    apr_thread_mutex_unlock(ioqueue->lock);
+
+    return NULL;
+}
+
+static apr_status_t thread_create(apr_ioqueue_t *ioqueue, apr_uint32_t size,
+                                  apr_pool_t *p)
+{
+    apr_status_t rv;
+
+    if ((rv = apr_thread_mutex_create(&ioqueue->lock,
+                                      APR_THREAD_MUTEX_DEFAULT,
+                                      p)) != APR_SUCCESS
+        || (rv = apr_thread_mutex_create(&ioqueue->file_lock,
+                                         APR_THREAD_MUTEX_DEFAULT,
+                                         p)) != APR_SUCCESS
+        || (rv = apr_thread_cond_create(&ioqueue->cond, p)) != APR_SUCCESS
+        /* A thread for each operation in flight, since they may all
+         * block, started now (the pool won't start one for a task as
+         * long as a thread is idle, even if it's not woken up yet).
+         */
+        || (rv = apr_thread_pool_create(&ioqueue->threads, size, size,
+                                        p)) != APR_SUCCESS) {
+        return rv;
+    }
+
+    APR_RING_INIT(&ioqueue->done_ring, ioqueue_op_t, link);
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t thread_cleanup(apr_ioqueue_t *ioqueue)
+{
+    return apr_thread_pool_destroy(ioqueue->threads);
+}
+
+static apr_status_t thread_submit(apr_ioqueue_t *ioqueue, ioqueue_op_t *op)
+{
+    return apr_thread_pool_push(ioqueue->threads, thread_run, op,
+                                APR_THREAD_TASK_PRIORITY_NORMAL, ioqueue);
+}
+
+static apr_status_t thread_flush(apr_ioqueue_t *ioqueue)
+{
+    /* Started already */
+    return APR_SUCCESS;
+}
+
+static apr_status_t thread_reap(apr_ioqueue_t *ioqueue,
+                                apr_interval_time_t timeout,
+                                apr_ioqueue_completion_t *completions,
+                                apr_int32_t max, apr_int32_t *num)
+{
+    apr_time_t deadline = 0;
+    apr_int32_t n = 0;
+
+    if (timeout > 0) {
+        deadline = apr_time_now() + timeout;
+    }
+
+    apr_thread_mutex_lock(ioqueue->lock);
+    while (APR_RING_EMPTY(&ioqueue->done_ring, ioqueue_op_t, link)
+           && timeout != 0) {
+        if (timeout < 0) {
+            apr_thread_cond_wait(ioqueue->cond, ioqueue->lock);
+        }
+        else {
+            apr_thread_cond_timedwait(ioqueue->cond, ioqueue->lock, timeout);
+            timeout = deadline - apr_time_now();
+            if (timeout < 0) {
+                timeout = 0;
+            }
+        }
+    }
+    while (!APR_RING_EMPTY(&ioqueue->done_ring, ioqueue_op_t, link)
+           && n < max) {
+        ioqueue_op_t *op = APR_RING_FIRST(&ioqueue->done_ring);
+
+        APR_RING_REMOVE(op, link);
+        op->pending = 0;
+        completions[n++] = op->completion;
+        APR_RING_INSERT_TAIL(&ioqueue->free_ring, op, ioqueue_op_t, link);
+    }
+    apr_thread_mutex_unlock(ioqueue->lock);
+
+    *num = n;
+    return n ? APR_SUCCESS : APR_TIMEUP;
+}
+
+static const ioqueue_provider_t ioqueue_thread = {
+    thread_create,
+    thread_submit,
+    thread_flush,
+    thread_reap,
+    thread_cleanup,
+    "thread"
+};
+
+#endif /* APR_HAS_THREADS */
+
+#if defined(HAVE_IO_URING)
+static apr_ioqueue_method_e ioqueue_default_method = APR_IOQUEUE_IOURING;
+#else
+static apr_ioqueue_method_e ioqueue_default_method = APR_IOQUEUE_THREAD;
+#endif
+
+static const ioqueue_provider_t *ioqueue_provider(apr_ioqueue_method_e method)
+{
+    const ioqueue_provider_t *provider = NULL;
+
+    switch (method) {
+        case APR_IOQUEUE_IOURING:
+#if defined(HAVE_IO_URING)
+            provider = &ioqueue_uring;
+#endif
+        break;
+        case APR_IOQUEUE_THREAD:
+#if APR_HAS_THREADS
+            provider = &ioqueue_thread;
+#endif
+        break;
+        case APR_IOQUEUE_DEFAULT:
+        break;
+    }
+    return provider;
+}
+
+static apr_status_t ioqueue_cleanup(void *p)
+{
+    apr_ioqueue_t *ioqueue = (apr_ioqueue_t *) p;
+
+    return (*ioqueue->provider->cleanup)(ioqueue);
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_create_ex(apr_ioqueue_t **ret_ioqueue,
+                                                apr_uint32_t size,
+                                                apr_pool_t *p,
+                                                apr_uint32_t flags,
+                                                apr_ioqueue_method_e method)
+{
+    apr_ioqueue_t *ioqueue;
+    ioqueue_op_t *ops;
+    apr_status_t rv;
+    apr_uint32_t i;
+
+    *ret_ioqueue = NULL;
+
+    if (size == 0) {
+        return APR_EINVAL;
+    }
+    if (method == APR_IOQUEUE_DEFAULT) {
+        method = ioqueue_default_method;
+    }
+
+    ioqueue = apr_pcalloc(p, sizeof(*ioqueue));
+    ioqueue->pool = p;
+
+    for (;;) {
+        ioqueue->provider = ioqueue_provider(method);
+        if (ioqueue->provider) {
+            rv = (*ioqueue->provider->create)(ioqueue, size, p);
+            if (rv != APR_ENOTIMPL) {
+                break;
+            }
+        }
+        else {
+            rv = APR_ENOTIMPL;
+        }
+        /* The default method itself may not be available (io_uring
+         * disabled), then try the emulation.
+         */
+        if (flags & APR_IOQUEUE_NODEFAULT) {
+            return rv;
+        }
+        if (method == ioqueue_default_method) {
+            if (method == APR_IOQUEUE_THREAD) {
+                return rv;
+            }
+            method = APR_IOQUEUE_THREAD;
+        }
+        else {
+            method = ioqueue_default_method;
+        }
+    }
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    APR_RING_INIT(&ioqueue->free_ring, ioqueue_op_t, link);
+    ops = apr_pcalloc(p, size * sizeof(*ops));
+    ioqueue->ops = ops;
+    ioqueue->size = size;
+    for (i = 0; i < size; i++) {
+        ops[i].ioqueue = ioqueue;
+        APR_RING_ELEM_INIT(&ops[i], link);
+        APR_RING_INSERT_TAIL(&ioqueue->free_ring, &ops[i], ioqueue_op_t,
+                             link);
+    }
+
+    /* Before the thread pool (a subpool) and the sockets are gone */
+    apr_pool_pre_cleanup_register(p, ioqueue, ioqueue_cleanup);
+
+    *ret_ioqueue = ioqueue;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_create(apr_ioqueue_t **ioqueue,
+                                             apr_uint32_t size,
+                                             apr_pool_t *p,
+                                             apr_uint32_t flags)
+{
+    return apr_ioqueue_create_ex(ioqueue, size, p, flags,
+                                 APR_IOQUEUE_DEFAULT);
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_destroy(apr_ioqueue_t *ioqueue)
+{
+    return apr_pool_cleanup_run(ioqueue->pool, ioqueue, ioqueue_cleanup);
+}
+
+static ioqueue_op_t *ioqueue_op_get(apr_ioqueue_t *ioqueue,
+                                    apr_ioqueue_op_e type, void *baton)
+{
+    ioqueue_op_t *op;
+
+    if (APR_RING_EMPTY(&ioqueue->free_ring, ioqueue_op_t, link)) {
+        return NULL;
+    }
+    op = APR_RING_FIRST(&ioqueue->free_ring);
+    APR_RING_REMOVE(op, link);
+
+    op->completion.op = type;
+    op->completion.status = APR_SUCCESS;
+    op->completion.len = 0;
+    op->completion.accepted = NULL;
+    op->completion.baton = baton;
+    op->sock = NULL;
+    op->file = NULL;
+    op->buf = NULL;
+    op->len = 0;
+    op->vec = NULL;
+    op->nvec = 0;
+    op->offset = -1;
+    op->pool = NULL;
+
+    return op;
+}
+
+static apr_status_t ioqueue_op_submit(apr_ioqueue_t *ioqueue,
+                                      ioqueue_op_t *op)
+{
+    apr_status_t rv;
+
+    rv = (*ioqueue->provider->submit)(ioqueue, op);
+    if (rv != APR_SUCCESS) {
+        APR_RING_INSERT_HEAD(&ioqueue->free_ring, op, ioqueue_op_t, link);
+        return rv;
+    }
+    op->pending = 1;
+    ioqueue->pending++;
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_recv(apr_ioqueue_t *ioqueue,
+                                                  apr_socket_t *sock,
+                                                  char *buf, apr_size_t len,
+                                                  void *baton)
+{
+    ioqueue_op_t *op = ioqueue_op_get(ioqueue, APR_IOQUEUE_RECV, baton);
+
+    if (!op) {
+        return APR_EAGAIN;
+    }
+    op->sock = sock;
+    op->buf = buf;
+    op->len = len;
+
+    return ioqueue_op_submit(ioqueue, op);
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_send(apr_ioqueue_t *ioqueue,
+                                                  apr_socket_t *sock,
+                                                  const char *buf,
+                                                  apr_size_t len,
+                                                  void *baton)
+{
+    ioqueue_op_t *op = ioqueue_op_get(ioqueue, APR_IOQUEUE_SEND, baton);
+
+    if (!op) {
+        return APR_EAGAIN;
+    }
+    op->sock = sock;
+    op->buf = (char *)buf;
+    op->len = len;
+
+    return ioqueue_op_submit(ioqueue, op);
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_sendv(apr_ioqueue_t *ioqueue,
+                                                   apr_socket_t *sock,
+                                                   const struct iovec *vec,
+                                                   apr_int32_t nvec,
+                                                   void *baton)
+{
+    ioqueue_op_t *op = ioqueue_op_get(ioqueue, APR_IOQUEUE_SENDV, baton);
+    apr_int32_t i;
+
+    if (!op) {
+        return APR_EAGAIN;
+    }
+    op->sock = sock;
+    op->vec = vec;
+    op->nvec = nvec;
+    for (i = 0; i < nvec; i++) {
+        op->len += vec[i].iov_len;
+    }
+
+    return ioqueue_op_submit(ioqueue, op);
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_read(apr_ioqueue_t *ioqueue,
+                                                  apr_file_t *file,
+                                                  char *buf, apr_size_t len,
+                                                  apr_off_t offset,
+                                                  void *baton)
+{
+    ioqueue_op_t *op;
+
+    if (file->buffered) {
+        return APR_EINVAL;
+    }
+    op = ioqueue_op_get(ioqueue, APR_IOQUEUE_READ, baton);
+    if (!op) {
+        return APR_EAGAIN;
+    }
+    op->file = file;
+    op->buf = buf;
+    op->len = len;
+    op->offset = offset < 0 ? -1 : offset;
+
+    return ioqueue_op_submit(ioqueue, op);
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_write(apr_ioqueue_t *ioqueue,
+                                                   apr_file_t *file,
+                                                   const char *buf,
+                                                   apr_size_t len,
+                                                   apr_off_t offset,
+                                                   void *baton)
+{
+    ioqueue_op_t *op;
+
+    if (file->buffered) {
+        return APR_EINVAL;
+    }
+    op = ioqueue_op_get(ioqueue, APR_IOQUEUE_WRITE, baton);
+    if (!op) {
+        return APR_EAGAIN;
+    }
+    op->file = file;
+    op->buf = (char *)buf;
+    op->len = len;
+    op->offset = offset < 0 ? -1 : offset;
+
+    return ioqueue_op_submit(ioqueue, op);
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_submit_accept(apr_ioqueue_t *ioqueue,
+                                                    apr_socket_t *sock,
+                                                    apr_pool_t *pool,
+                                                    void *baton)
+{
+    ioqueue_op_t *op = ioqueue_op_get(ioqueue, APR_IOQUEUE_ACCEPT, baton);
+
+    if (!op) {
+        return APR_EAGAIN;
+    }
+    op->sock = sock;
+    op->pool = pool;
+
+    return ioqueue_op_submit(ioqueue, op);
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_flush(apr_ioqueue_t *ioqueue)
+{
+    return (*ioqueue->provider->flush)(ioqueue);
+}
+
+APR_DECLARE(apr_status_t) apr_ioqueue_reap(apr_ioqueue_t *ioqueue,
+                                           apr_interval_time_t timeout,
+                                           apr_ioqueue_completion_t *completions,
+                                           apr_int32_t max,
+                                           apr_int32_t *num)
+{
+    apr_status_t rv;
+
+    *num = 0;
+    if (max <= 0) {
+        return APR_EINVAL;
+    }
+
+    rv = (*ioqueue->provider->reap)(ioqueue, timeout, completions, max, num);
+    ioqueue->pending -= *num;
+
+    return rv;
+}
+
+APR_DECLARE(apr_uint32_t) apr_ioqueue_pending(apr_ioqueue_t *ioqueue)
+{
+    return ioqueue->pending;
+}
+
+APR_DECLARE(const char *) apr_ioqueue_method_name(apr_ioqueue_t *ioqueue)
+{
+    return ioqueue->provider->name;
+}
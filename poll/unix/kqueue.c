@@ -43,6 +43,27 @@ static apr_int16_t get_kqueue_revent(apr_int16_t event, apr_int16_t flags)
     return rv;
 }
 
+/* The flags of the filters for the requested events (EV_DISPATCH
+ * disables a filter once it is returned, until EV_ENABLE'd again).
+ */
+static apr_status_t get_kqueue_flags(apr_int16_t event, u_short *flags)
+{
+    *flags = EV_ADD;
+
+    if (event & APR_POLLET)
+        *flags |= EV_CLEAR;
+    if (event & APR_POLLONESHOT) {
+#ifdef EV_DISPATCH
+        *flags |= EV_DISPATCH;
+#else
+        return APR_ENOTIMPL;
+#endif
+    }
+    /* APR_POLLEXCL is not handled by kqueue. */
+
+    return APR_SUCCESS;
+}
+
 struct apr_pollset_private_t
 {
     int kqueue_fd;
@@ -145,7 +166,13 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
 {
     apr_os_sock_t fd;
     pfd_elem_t *elem = NULL;
-    apr_status_t rv = APR_SUCCESS;
+    apr_status_t rv;
+    u_short flags;
+
+    if ((rv = get_kqueue_flags(descriptor->reqevents, &flags))
+            != APR_SUCCESS) {
+        return rv;
+    }
 
     if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
         pollset_lock_rings();
@@ -170,11 +197,11 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
 
     if (descriptor->reqevents & APR_POLLIN) {
         if (pollset->flags & APR_POLLSET_NOCOPY) {
-            EV_SET(&pollset->p->kevent, fd, EVFILT_READ, EV_ADD, 0, 0,
+            EV_SET(&pollset->p->kevent, fd, EVFILT_READ, flags, 0, 0,
                    (void *)descriptor);
         }
         else {
-            EV_SET(&pollset->p->kevent, fd, EVFILT_READ, EV_ADD, 0, 0,
+            EV_SET(&pollset->p->kevent, fd, EVFILT_READ, flags, 0, 0,
                    elem);
         }
 
@@ -186,11 +213,11 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
 
     if (descriptor->reqevents & APR_POLLOUT && rv == APR_SUCCESS) {
         if (pollset->flags & APR_POLLSET_NOCOPY) {
-            EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, EV_ADD, 0, 0,
+            EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, flags, 0, 0,
                    (void *)descriptor);
         }
         else {
-            EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, EV_ADD, 0, 0,
+            EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, flags, 0, 0,
                    elem);
         }
 
@@ -270,6 +297,87 @@ static apr_status_t impl_pollset_remove(apr_pollset_t *pollset,
     return rv;
 }
 
+static apr_status_t impl_pollset_rearm(apr_pollset_t *pollset,
+                                       const apr_pollfd_t *descriptor)
+{
+    apr_os_sock_t fd;
+    pfd_elem_t *ep = NULL;
+    void *udata = (void *)descriptor;
+    apr_status_t rv;
+    u_short flags;
+
+    if ((rv = get_kqueue_flags(descriptor->reqevents, &flags))
+            != APR_SUCCESS) {
+        return rv;
+    }
+    flags |= EV_ENABLE;
+
+    if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
+        pollset_lock_rings();
+
+        for (ep = APR_RING_FIRST(&(pollset->p->query_ring));
+             ep != APR_RING_SENTINEL(&(pollset->p->query_ring),
+                                     pfd_elem_t, link);
+             ep = APR_RING_NEXT(ep, link)) {
+
+            if (descriptor->desc.s == ep->pfd.desc.s) {
+                break;
+            }
+        }
+        if (ep == APR_RING_SENTINEL(&(pollset->p->query_ring),
+                                    pfd_elem_t, link)) {
+            pollset_unlock_rings();
+            return APR_NOTFOUND;
+        }
+        ep->pfd = *descriptor;
+        udata = ep;
+    }
+
+    if (descriptor->desc_type == APR_POLL_SOCKET) {
+        fd = descriptor->desc.s->socketdes;
+    }
+    else {
+        fd = descriptor->desc.f->filedes;
+    }
+
+    /* The filter of an event no longer requested is deleted (if it was
+     * there), like EPOLL_CTL_MOD does.
+     */
+    if (descriptor->reqevents & APR_POLLIN) {
+        EV_SET(&pollset->p->kevent, fd, EVFILT_READ, flags, 0, 0, udata);
+
+        if (kevent(pollset->p->kqueue_fd, &pollset->p->kevent, 1, NULL, 0,
+                   NULL) == -1) {
+            rv = apr_get_netos_error();
+        }
+    }
+    else {
+        EV_SET(&pollset->p->kevent, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+        (void)kevent(pollset->p->kqueue_fd, &pollset->p->kevent, 1, NULL, 0,
+                     NULL);
+    }
+
+    if (descriptor->reqevents & APR_POLLOUT && rv == APR_SUCCESS) {
+        EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, flags, 0, 0, udata);
+
+        if (kevent(pollset->p->kqueue_fd, &pollset->p->kevent, 1, NULL, 0,
+                   NULL) == -1) {
+            rv = apr_get_netos_error();
+        }
+    }
+    else if (rv == APR_SUCCESS) {
+        EV_SET(&pollset->p->kevent, fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+        (void)kevent(pollset->p->kqueue_fd, &pollset->p->kevent, 1, NULL, 0,
+                     NULL);
+    }
+
+    if (!(pollset->flags & APR_POLLSET_NOCOPY)) {
+        pollset_unlock_rings();
+    }
+
+    return rv;
+}
+
 static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
                                       apr_interval_time_t timeout,
                                       apr_int32_t *num,
@@ -351,7 +459,8 @@ static const apr_pollset_provider_t impl = {
     impl_pollset_remove,
     impl_pollset_poll,
     impl_pollset_cleanup,
-    "kqueue"
+    "kqueue",
+    impl_pollset_rearm
 };
 
 const apr_pollset_provider_t *apr_pollset_provider_kqueue = &impl;
@@ -405,7 +514,53 @@ static apr_status_t impl_pollcb_add(apr_pollcb_t *pollcb,
 {
     apr_os_sock_t fd;
     struct kevent ev;
-    apr_status_t rv = APR_SUCCESS;
+    apr_status_t rv;
+    u_short flags;
+
+    if ((rv = get_kqueue_flags(descriptor->reqevents, &flags))
+            != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (descriptor->desc_type == APR_POLL_SOCKET) {
+        fd = descriptor->desc.s->socketdes;
+    }
+    else {
+        fd = descriptor->desc.f->filedes;
+    }
+
+    if (descriptor->reqevents & APR_POLLIN) {
+        EV_SET(&ev, fd, EVFILT_READ, flags, 0, 0, descriptor);
+
+        if (kevent(pollcb->fd, &ev, 1, NULL, 0, NULL) == -1) {
+            rv = apr_get_netos_error();
+        }
+    }
+
+    if (descriptor->reqevents & APR_POLLOUT && rv == APR_SUCCESS) {
+        EV_SET(&ev, fd, EVFILT_WRITE, flags, 0, 0, descriptor);
+
+        if (kevent(pollcb->fd, &ev, 1, NULL, 0, NULL) == -1) {
+            rv = apr_get_netos_error();
+        }
+    }
+
+    return rv;
+}
+
+static apr_status_t impl_pollcb_rearm(apr_pollcb_t *pollcb,
+                                      apr_pollfd_t *descriptor)
+{
+    apr_os_sock_t fd;
+    struct kevent ev;
+    apr_status_t rv;
+    u_short flags;
+
+    if ((rv = get_kqueue_flags(descriptor->reqevents, &flags))
+            != APR_SUCCESS) {
+        return rv;
+    }
+    flags |= EV_ENABLE;
 
     if (descriptor->desc_type == APR_POLL_SOCKET) {
         fd = descriptor->desc.s->socketdes;
@@ -414,21 +569,32 @@ static apr_status_t impl_pollcb_add(apr_pollcb_t *pollcb,
         fd = descriptor->desc.f->filedes;
     }
 
+    /* The filter of an event no longer requested is deleted (if it was
+     * there), like EPOLL_CTL_MOD does.
+     */
     if (descriptor->reqevents & APR_POLLIN) {
-        EV_SET(&ev, fd, EVFILT_READ, EV_ADD, 0, 0, descriptor);
+        EV_SET(&ev, fd, EVFILT_READ, flags, 0, 0, descriptor);
 
         if (kevent(pollcb->fd, &ev, 1, NULL, 0, NULL) == -1) {
             rv = apr_get_netos_error();
         }
     }
+    else {
+        EV_SET(&ev, fd, EVFILT_READ, EV_DELETE, 0, 0, NULL);
+        (void)kevent(pollcb->fd, &ev, 1, NULL, 0, NULL);
+    }
 
     if (descriptor->reqevents & APR_POLLOUT && rv == APR_SUCCESS) {
-        EV_SET(&ev, fd, EVFILT_WRITE, EV_ADD, 0, 0, descriptor);
+        EV_SET(&ev, fd, EVFILT_WRITE, flags, 0, 0, descriptor);
 
         if (kevent(pollcb->fd, &ev, 1, NULL, 0, NULL) == -1) {
             rv = apr_get_netos_error();
         }
     }
+    else if (rv == APR_SUCCESS) {
+        EV_SET(&ev, fd, EVFILT_WRITE, EV_DELETE, 0, 0, NULL);
+        (void)kevent(pollcb->fd, &ev, 1, NULL, 0, NULL);
+    }
 
     return rv;
 }
@@ -526,7 +692,8 @@ static const apr_pollcb_provider_t impl_cb = {
     impl_pollcb_remove,
     impl_pollcb_poll,
     impl_pollcb_cleanup,
-    "kqueue"
+    "kqueue",
+    impl_pollcb_rearm
 };
 
 const apr_pollcb_provider_t *apr_pollcb_provider_kqueue = &impl_cb;
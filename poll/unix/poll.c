@@ -178,6 +178,9 @@ static apr_status_t impl_pollset_add(apr_pollset_t *pollset,
     if (pollset->nelts == pollset->nalloc) {
         return APR_ENOMEM;
     }
+    if (descriptor->reqevents & APR_POLLET) {
+        return APR_ENOTIMPL;
+    }
 
     pollset->p->query_set[pollset->nelts] = *descriptor;
 
@@ -226,6 +229,32 @@ static apr_status_t impl_pollset_remove(apr_pollset_t *pollset,
     return APR_NOTFOUND;
 }
 
+/* APR_POLLONESHOT descriptors are disabled once returned by a negative
+ * fd, which poll() ignores, until re-armed.
+ */
+static apr_status_t impl_pollset_rearm(apr_pollset_t *pollset,
+                                       const apr_pollfd_t *descriptor)
+{
+    apr_uint32_t i;
+
+    for (i = 0; i < pollset->nelts; i++) {
+        if (descriptor->desc.s == pollset->p->query_set[i].desc.s) {
+            pollset->p->query_set[i] = *descriptor;
+            if (descriptor->desc_type == APR_POLL_SOCKET) {
+                pollset->p->pollset[i].fd = descriptor->desc.s->socketdes;
+            }
+            else {
+                pollset->p->pollset[i].fd = descriptor->desc.f->filedes;
+            }
+            pollset->p->pollset[i].events =
+                get_event(descriptor->reqevents);
+            return APR_SUCCESS;
+        }
+    }
+
+    return APR_NOTFOUND;
+}
+
 static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
                                       apr_interval_time_t timeout,
                                       apr_int32_t *num,
@@ -289,6 +318,9 @@ static apr_status_t impl_pollset_poll(apr_pollset_t *pollset,
                     pollset->p->result_set[j] = pollset->p->query_set[i];
                     pollset->p->result_set[j].rtnevents =
                         get_revent(pollset->p->pollset[i].revents);
+                    if (pollset->p->query_set[i].reqevents & APR_POLLONESHOT) {
+                        pollset->p->pollset[i].fd = -1;
+                    }
                     j++;
                 }
             }
@@ -308,7 +340,8 @@ static const apr_pollset_provider_t impl = {
     impl_pollset_remove,
     impl_pollset_poll,
     NULL,
-    "poll"
+    "poll",
+    impl_pollset_rearm
 };
 
 const apr_pollset_provider_t *apr_pollset_provider_poll = &impl;
@@ -339,6 +372,9 @@ static apr_status_t impl_pollcb_add(apr_pollcb_t *pollcb,
     if (pollcb->nelts == pollcb->nalloc) {
         return APR_ENOMEM;
     }
+    if (descriptor->reqevents & APR_POLLET) {
+        return APR_ENOTIMPL;
+    }
 
     if (descriptor->desc_type == APR_POLL_SOCKET) {
         pollcb->pollset.ps[pollcb->nelts].fd = descriptor->desc.s->socketdes;
@@ -387,6 +423,27 @@ static apr_status_t impl_pollcb_remove(apr_pollcb_t *pollcb,
     return APR_NOTFOUND;
 }
 
+static apr_status_t impl_pollcb_rearm(apr_pollcb_t *pollcb,
+                                      apr_pollfd_t *descriptor)
+{
+    apr_uint32_t i;
+
+    for (i = 0; i < pollcb->nelts; i++) {
+        if (descriptor->desc.s == pollcb->copyset[i]->desc.s) {
+            if (descriptor->desc_type == APR_POLL_SOCKET) {
+                pollcb->pollset.ps[i].fd = descriptor->desc.s->socketdes;
+            }
+            else {
+                pollcb->pollset.ps[i].fd = descriptor->desc.f->filedes;
+            }
+            pollcb->pollset.ps[i].events = get_event(descriptor->reqevents);
+            return APR_SUCCESS;
+        }
+    }
+
+    return APR_NOTFOUND;
+}
+
 static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
                                      apr_interval_time_t timeout,
                                      apr_pollcb_cb_t func,
@@ -443,6 +500,9 @@ static apr_status_t impl_pollcb_poll(apr_pollcb_t *pollcb,
                 }
 #endif
                 pollfd->rtnevents = get_revent(pollcb->pollset.ps[i].revents);
+                if (pollfd->reqevents & APR_POLLONESHOT) {
+                    pollcb->pollset.ps[i].fd = -1;
+                }
                 rv = func(baton, pollfd);
                 if (rv) {
                     return rv;
@@ -459,7 +519,8 @@ static const apr_pollcb_provider_t impl_cb = {
     impl_pollcb_remove,
     impl_pollcb_poll,
     NULL,
-    "poll"
+    "poll",
+    impl_pollcb_rearm
 };
 
 const apr_pollcb_provider_t *apr_pollcb_provider_poll = &impl_cb;
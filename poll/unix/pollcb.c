@@ -38,6 +38,9 @@ extern const apr_pollcb_provider_t *apr_pollcb_provider_port;
 #if defined(HAVE_EPOLL)
 extern const apr_pollcb_provider_t *apr_pollcb_provider_epoll;
 #endif
+#if defined(HAVE_IO_URING)
+extern const apr_pollcb_provider_t *apr_pollcb_provider_io_uring;
+#endif
 #if defined(HAVE_POLL)
 extern const apr_pollcb_provider_t *apr_pollcb_provider_poll;
 #endif
@@ -59,6 +62,11 @@ static const apr_pollcb_provider_t *pollcb_provider(apr_pollset_method_e method)
         case APR_POLLSET_EPOLL:
 #if defined(HAVE_EPOLL)
             provider = apr_pollcb_provider_epoll;
+#endif
+        break;
+        case APR_POLLSET_IOURING:
+#if defined(HAVE_IO_URING)
+            provider = apr_pollcb_provider_io_uring;
 #endif
         break;
         case APR_POLLSET_POLL:
@@ -207,9 +215,22 @@ APR_DECLARE(apr_status_t) apr_pollcb_create(apr_pollcb_t **pollcb,
 APR_DECLARE(apr_status_t) apr_pollcb_add(apr_pollcb_t *pollcb,
                                          apr_pollfd_t *descriptor)
 {
+    if ((descriptor->reqevents & (APR_POLLET | APR_POLLONESHOT))
+        && !pollcb->provider->rearm) {
+        return APR_ENOTIMPL;
+    }
     return (*pollcb->provider->add)(pollcb, descriptor);
 }
 
+APR_DECLARE(apr_status_t) apr_pollcb_rearm(apr_pollcb_t *pollcb,
+                                           apr_pollfd_t *descriptor)
+{
+    if (!pollcb->provider->rearm) {
+        return APR_ENOTIMPL;
+    }
+    return (*pollcb->provider->rearm)(pollcb, descriptor);
+}
+
 APR_DECLARE(apr_status_t) apr_pollcb_remove(apr_pollcb_t *pollcb,
                                             apr_pollfd_t *descriptor)
 {
@@ -232,7 +253,7 @@ APR_DECLARE(apr_status_t) apr_pollcb_wakeup(apr_pollcb_t *pollcb)
 
     if (apr_atomic_cas32(&pollcb->wakeup_set, 1, 0) == 0) {
 #if WAKEUP_USES_PIPE
-        return apr_file_putc(1, pollcb->wakeup_pipe[1]);
+        return apr_poll_send_wakeup_pipe(pollcb->wakeup_pipe);
 #else
         apr_size_t len = 1;
         return apr_socket_send(pollcb->wakeup_socket[1], "\1", &len);
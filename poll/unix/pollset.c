@@ -57,6 +57,9 @@ extern const apr_pollset_provider_t *apr_pollset_provider_port;
 #if defined(HAVE_EPOLL)
 extern const apr_pollset_provider_t *apr_pollset_provider_epoll;
 #endif
+#if defined(HAVE_IO_URING)
+extern const apr_pollset_provider_t *apr_pollset_provider_io_uring;
+#endif
 #if defined(HAVE_AIO_MSGQ)
 extern const apr_pollset_provider_t *apr_pollset_provider_aio_msgq;
 #endif
@@ -82,6 +85,11 @@ static const apr_pollset_provider_t *pollset_provider(apr_pollset_method_e metho
         case APR_POLLSET_EPOLL:
 #if defined(HAVE_EPOLL)
             provider = apr_pollset_provider_epoll;
+#endif
+        break;
+        case APR_POLLSET_IOURING:
+#if defined(HAVE_IO_URING)
+            provider = apr_pollset_provider_io_uring;
 #endif
         break;
         case APR_POLLSET_AIO_MSGQ:
@@ -165,6 +173,11 @@ APR_DECLARE(apr_status_t) apr_pollset_create_ex(apr_pollset_t **ret_pollset,
     else if (rv != APR_SUCCESS) {
         return rv;
     }
+    if (!pollset->provider->poll_ptrs) {
+        /* Up to two results per descriptor (kqueue) */
+        pollset->result_ptrs = apr_palloc(p, 2 * size *
+                                             sizeof(apr_pollfd_t *));
+    }
     if (flags & APR_POLLSET_WAKEABLE) {
 #if WAKEUP_USES_PIPE
         /* Create wakeup pipe */
@@ -235,7 +248,7 @@ APR_DECLARE(apr_status_t) apr_pollset_wakeup(apr_pollset_t *pollset)
 
     if (apr_atomic_cas32(&pollset->wakeup_set, 1, 0) == 0) {
 #if WAKEUP_USES_PIPE
-        return apr_file_putc(1, pollset->wakeup_pipe[1]);
+        return apr_poll_send_wakeup_pipe(pollset->wakeup_pipe);
 #else
         apr_size_t len = 1;
         return apr_socket_send(pollset->wakeup_socket[1], "\1", &len);
@@ -248,9 +261,22 @@ APR_DECLARE(apr_status_t) apr_pollset_wakeup(apr_pollset_t *pollset)
 APR_DECLARE(apr_status_t) apr_pollset_add(apr_pollset_t *pollset,
                                           const apr_pollfd_t *descriptor)
 {
+    if ((descriptor->reqevents & (APR_POLLET | APR_POLLONESHOT))
+        && !pollset->provider->rearm) {
+        return APR_ENOTIMPL;
+    }
     return (*pollset->provider->add)(pollset, descriptor);
 }
 
+APR_DECLARE(apr_status_t) apr_pollset_rearm(apr_pollset_t *pollset,
+                                            const apr_pollfd_t *descriptor)
+{
+    if (!pollset->provider->rearm) {
+        return APR_ENOTIMPL;
+    }
+    return (*pollset->provider->rearm)(pollset, descriptor);
+}
+
 APR_DECLARE(apr_status_t) apr_pollset_remove(apr_pollset_t *pollset,
                                              const apr_pollfd_t *descriptor)
 {
@@ -264,3 +290,30 @@ APR_DECLARE(apr_status_t) apr_pollset_poll(apr_pollset_t *pollset,
 {
     return (*pollset->provider->poll)(pollset, timeout, num, descriptors);
 }
+
+APR_DECLARE(apr_status_t) apr_pollset_poll_ptrs(apr_pollset_t *pollset,
+                                              apr_interval_time_t timeout,
+                                              apr_int32_t *num,
+                                              const apr_pollfd_t *const **descriptors)
+{
+    const apr_pollfd_t *results;
+    apr_status_t rv;
+    apr_int32_t i;
+
+    if (pollset->provider->poll_ptrs) {
+        return (*pollset->provider->poll_ptrs)(pollset, timeout, num,
+                                               descriptors);
+    }
+
+    rv = (*pollset->provider->poll)(pollset, timeout, num, &results);
+    if (*num > 0) {
+        for (i = 0; i < *num; i++) {
+            pollset->result_ptrs[i] = &results[i];
+        }
+        if (descriptors) {
+            *descriptors = pollset->result_ptrs;
+        }
+    }
+
+    return rv;
+}
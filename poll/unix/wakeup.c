@@ -24,6 +24,10 @@
 #include "apr_arch_poll_private.h"
 #include "apr_arch_inherit.h"
 
+#ifdef HAVE_EVENTFD
+#include <sys/eventfd.h>
+#endif
+
 #if !APR_FILES_AS_SOCKETS
 
 #ifdef WIN32
@@ -81,6 +85,33 @@ apr_status_t apr_poll_create_wakeup_pipe(apr_pool_t *pool, apr_pollfd_t *pfd,
 {
     apr_status_t rv;
 
+#ifdef HAVE_EVENTFD
+    {
+        /* An eventfd counts the wakeups, so a single (non-blocking) read
+         * consumes all of them, and it is one descriptor instead of two.
+         * Both ends of the "pipe" are the same file.
+         */
+        apr_os_file_t fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+        if (fd >= 0) {
+            if ((rv = apr_os_file_put(&wakeup_pipe[0], &fd,
+                                      APR_FOPEN_READ | APR_FOPEN_WRITE,
+                                      pool)) != APR_SUCCESS) {
+                close(fd);
+                return rv;
+            }
+            wakeup_pipe[1] = wakeup_pipe[0];
+
+            pfd->p = pool;
+            pfd->reqevents = APR_POLLIN;
+            pfd->desc_type = APR_POLL_FILE;
+            pfd->desc.f = wakeup_pipe[0];
+            return APR_SUCCESS;
+        }
+        /* Not supported by the running kernel, use a pipe */
+    }
+#endif
+
     /* Read end of the pipe is non-blocking */
     if ((rv = apr_file_pipe_create_ex(&wakeup_pipe[0], &wakeup_pipe[1],
                                       APR_WRITE_BLOCK, pool)))
@@ -120,7 +151,10 @@ apr_status_t apr_poll_close_wakeup_pipe(apr_file_t **wakeup_pipe)
     apr_status_t rv0 = APR_SUCCESS;
     apr_status_t rv1 = APR_SUCCESS;
 
-    /* Close both sides of the wakeup pipe */
+    /* Close both sides of the wakeup pipe, or the eventfd once */
+    if (wakeup_pipe[1] == wakeup_pipe[0]) {
+        wakeup_pipe[1] = NULL;
+    }
     if (wakeup_pipe[0]) {
         rv0 = apr_file_close(wakeup_pipe[0]);
         wakeup_pipe[0] = NULL;
@@ -135,13 +169,43 @@ apr_status_t apr_poll_close_wakeup_pipe(apr_file_t **wakeup_pipe)
 #endif /* APR_FILES_AS_SOCKETS */
 
 #if WAKEUP_USES_PIPE
+/* Write to the wakeup pipe.
+ */
+apr_status_t apr_poll_send_wakeup_pipe(apr_file_t **wakeup_pipe)
+{
+#ifdef HAVE_EVENTFD
+    if (wakeup_pipe[1] == wakeup_pipe[0]) {
+        apr_uint64_t one = 1;
+
+        /* Only blocks (EAGAIN) if the counter would overflow */
+        if (write(wakeup_pipe[1]->filedes, &one, sizeof(one)) < 0) {
+            return errno;
+        }
+        return APR_SUCCESS;
+    }
+#endif
+
+    return apr_file_putc(1, wakeup_pipe[1]);
+}
+
 /* Read and discard whatever is in the wakeup pipe.
  */
 void apr_poll_drain_wakeup_pipe(volatile apr_uint32_t *wakeup_set, apr_file_t **wakeup_pipe)
 {
-    char ch;
+#ifdef HAVE_EVENTFD
+    if (wakeup_pipe[1] == wakeup_pipe[0]) {
+        apr_uint64_t count;
+
+        /* Resets the counter, whatever the number of wakeups */
+        (void)read(wakeup_pipe[0]->filedes, &count, sizeof(count));
+    }
+    else
+#endif
+    {
+        char ch;
 
-    (void)apr_file_getc(&ch, wakeup_pipe[0]);
+        (void)apr_file_getc(&ch, wakeup_pipe[0]);
+    }
     apr_atomic_set32(wakeup_set, 0);
 }
 #else
@@ -15,8 +15,11 @@
  */
 
 #include "apr_redis.h"
+#include "apr_lib.h"
 #include "apr_poll.h"
 #include "apr_version.h"
+#include "apr_md5.h"
+#include "apr_strings.h"
 #include <stdlib.h>
 #include <string.h>
 
@@ -165,6 +168,36 @@ apr_redis_find_server_hash(apr_redis_t *rc, const apr_uint32_t hash)
     }
 }
 
+/* Whether the server is live, or dead but back to life when retried */
+static int server_usable(apr_redis_t *rc, apr_redis_server_t *rs,
+                         apr_time_t *curtime)
+{
+    int usable = 0;
+
+    if (rs->status == APR_RC_SERVER_LIVE) {
+        return 1;
+    }
+
+    if (*curtime == 0) {
+        *curtime = apr_time_now();
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_lock(rs->lock);
+#endif
+    /* Try the dead server, every 5 seconds */
+    if (*curtime - rs->btime > apr_time_from_sec(5)) {
+        rs->btime = *curtime;
+        if (apr_redis_ping(rs) == APR_SUCCESS) {
+            make_server_live(rc, rs);
+            usable = 1;
+        }
+    }
+#if APR_HAS_THREADS
+    apr_thread_mutex_unlock(rs->lock);
+#endif
+    return usable;
+}
+
 APR_DECLARE(apr_redis_server_t *)
 apr_redis_find_server_hash_default(void *baton, apr_redis_t *rc,
                                    const apr_uint32_t hash)
@@ -180,31 +213,9 @@ apr_redis_find_server_hash_default(void *baton, apr_redis_t *rc,
 
     do {
         rs = rc->live_servers[h % rc->ntotal];
-        if (rs->status == APR_RC_SERVER_LIVE) {
+        if (server_usable(rc, rs, &curtime)) {
             break;
         }
-        else {
-            if (curtime == 0) {
-                curtime = apr_time_now();
-            }
-#if APR_HAS_THREADS
-            apr_thread_mutex_lock(rs->lock);
-#endif
-            /* Try the dead server, every 5 seconds */
-            if (curtime - rs->btime > apr_time_from_sec(5)) {
-                rs->btime = curtime;
-                if (apr_redis_ping(rs) == APR_SUCCESS) {
-                    make_server_live(rc, rs);
-#if APR_HAS_THREADS
-                    apr_thread_mutex_unlock(rs->lock);
-#endif
-                    break;
-                }
-            }
-#if APR_HAS_THREADS
-            apr_thread_mutex_unlock(rs->lock);
-#endif
-        }
         h++;
         i++;
     } while (i < rc->ntotal);
@@ -216,6 +227,173 @@ apr_redis_find_server_hash_default(void *baton, apr_redis_t *rc,
     return rs;
 }
 
+/*
+ * Consistent hashing (ketama), as in apr_memcache: each server is given
+ * points on a ring of 32 bit hashes, in proportion of its weight, and a
+ * key goes to the server of the first point at or after its hash.
+ */
+
+typedef struct ketama_point_t {
+    apr_uint32_t point;
+    apr_uint32_t idx;       /* of the server in rc->live_servers */
+    apr_redis_server_t *rs;
+} ketama_point_t;
+
+struct apr_redis_ketama_t {
+    apr_uint32_t npoints;
+    ketama_point_t *points;
+    apr_uint32_t nidx;      /* range of the points' idx */
+    apr_uint32_t nservers;  /* with points */
+};
+
+/* Servers tried at most with a bitmap on the stack by the failover */
+#define KETAMA_TRIED_MAX 256
+
+static APR_INLINE apr_uint32_t ketama_digest_point(const unsigned char *d,
+                                                   int n)
+{
+    return ((apr_uint32_t)d[3 + n * 4] << 24)
+           | ((apr_uint32_t)d[2 + n * 4] << 16)
+           | ((apr_uint32_t)d[1 + n * 4] << 8)
+           | (apr_uint32_t)d[n * 4];
+}
+
+static int ketama_point_cmp(const void *a, const void *b)
+{
+    const ketama_point_t *pa = a, *pb = b;
+
+    if (pa->point != pb->point) {
+        return pa->point < pb->point ? -1 : 1;
+    }
+    /* same point for two servers, keep it deterministic */
+    return pa->idx < pb->idx ? -1 : pa->idx > pb->idx;
+}
+
+APR_DECLARE(apr_status_t) apr_redis_ketama_create(apr_redis_ketama_t **ring,
+                                                  apr_redis_t *rc,
+                                                  const apr_uint32_t *weights,
+                                                  apr_uint32_t points,
+                                                  apr_pool_t *p)
+{
+    apr_redis_ketama_t *r;
+    apr_uint32_t i, n, total = 0;
+
+    if (!points) {
+        points = APR_REDIS_KETAMA_POINTS;
+    }
+    /* four points per MD5 digest */
+    points = (points + 3) & ~3u;
+
+    for (i = 0; i < rc->ntotal; i++) {
+        total += points * (weights ? weights[i] : 1);
+    }
+
+    r = apr_palloc(p, sizeof(*r));
+    r->npoints = 0;
+    r->points = apr_palloc(p, (total ? total : 1) * sizeof(ketama_point_t));
+    r->nidx = rc->ntotal;
+    r->nservers = 0;
+
+    for (i = 0; i < rc->ntotal; i++) {
+        apr_redis_server_t *rs = rc->live_servers[i];
+        apr_uint32_t count = points * (weights ? weights[i] : 1);
+
+        if (count) {
+            r->nservers++;
+        }
+        for (n = 0; n < count / 4; n++) {
+            unsigned char digest[APR_MD5_DIGESTSIZE];
+            char buf[512];
+            int k;
+
+            apr_snprintf(buf, sizeof(buf), "%s:%u-%u", rs->host,
+                         (unsigned int)rs->port, n);
+            apr_md5(digest, buf, strlen(buf));
+            for (k = 0; k < 4; k++) {
+                ketama_point_t *pt = &r->points[r->npoints++];
+
+                pt->point = ketama_digest_point(digest, k);
+                pt->idx = i;
+                pt->rs = rs;
+            }
+        }
+    }
+
+    qsort(r->points, r->npoints, sizeof(ketama_point_t), ketama_point_cmp);
+
+    *ring = r;
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_uint32_t) apr_redis_hash_ketama(void *baton,
+                                                const char *data,
+                                                const apr_size_t data_len)
+{
+    unsigned char digest[APR_MD5_DIGESTSIZE];
+
+    apr_md5(digest, data, data_len);
+    return ketama_digest_point(digest, 0);
+}
+
+APR_DECLARE(apr_redis_server_t *)
+apr_redis_find_server_hash_ketama(void *baton, apr_redis_t *rc,
+                                  const apr_uint32_t hash)
+{
+    apr_redis_ketama_t *ring = baton;
+    apr_redis_server_t *rs = NULL;
+    unsigned char tried_buf[KETAMA_TRIED_MAX / 8], *tried = tried_buf;
+    apr_uint32_t lo, hi, i, ntried = 0;
+    apr_time_t curtime = 0;
+
+    if (!ring || ring->npoints == 0) {
+        return NULL;
+    }
+
+    /* first point at or after hash, wrapping around */
+    lo = 0;
+    hi = ring->npoints;
+    while (lo < hi) {
+        apr_uint32_t mid = lo + (hi - lo) / 2;
+        if (ring->points[mid].point < hash) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+
+    /* failover to the servers of the next points, each server tried once
+     * (a dead one takes its lock) until all of them were
+     */
+    if (ring->nidx > KETAMA_TRIED_MAX) {
+        tried = calloc((ring->nidx + 7) / 8, 1);
+        if (!tried) {
+            return NULL;
+        }
+    }
+    else {
+        memset(tried, 0, sizeof(tried_buf));
+    }
+    for (i = 0; i < ring->npoints && ntried < ring->nservers; i++) {
+        const ketama_point_t *pt = &ring->points[(lo + i) % ring->npoints];
+
+        if (tried[pt->idx / 8] & (1u << (pt->idx % 8))) {
+            continue;
+        }
+        tried[pt->idx / 8] |= 1u << (pt->idx % 8);
+        ntried++;
+        if (server_usable(rc, pt->rs, &curtime)) {
+            rs = pt->rs;
+            break;
+        }
+    }
+    if (tried != tried_buf) {
+        free(tried);
+    }
+
+    return rs;
+}
+
 APR_DECLARE(apr_redis_server_t *) apr_redis_find_server(apr_redis_t *rc,
                                                         const char *host,
                                                         apr_port_t port)
@@ -326,6 +504,11 @@ static apr_status_t conn_connect(apr_redis_conn_t *conn)
         return rv;
     }
 
+    /* Don't hold back the tail of a pipeline written in several parts;
+     * this fails harmlessly on unix sockets
+     */
+    apr_socket_opt_set(conn->sock, APR_TCP_NODELAY, 1);
+
     rv = apr_socket_timeout_set(conn->sock,
                                 conn->rs->rwto * APR_USEC_PER_SEC);
     if (rv != APR_SUCCESS) {
@@ -422,15 +605,17 @@ rc_conn_destruct(void *conn_, void *params, apr_pool_t *pool)
 }
 #endif
 
-APR_DECLARE(apr_status_t) apr_redis_server_create(apr_pool_t *p,
-                                                  const char *host,
-                                                  apr_port_t port,
-                                                  apr_uint32_t min,
-                                                  apr_uint32_t smax,
-                                                  apr_uint32_t max,
-                                                  apr_uint32_t ttl,
-                                                  apr_uint32_t rwto,
-                                                  apr_redis_server_t **rs)
+APR_DECLARE(apr_status_t) apr_redis_server_create_ex(apr_pool_t *p,
+                                                     const char *host,
+                                                     apr_port_t port,
+                                                     apr_uint32_t min,
+                                                     apr_uint32_t smax,
+                                                     apr_uint32_t max,
+                                                     apr_uint32_t ttl,
+                                                     apr_uint32_t rwto,
+                                                     int shards,
+                                                     apr_uint32_t flags,
+                                                     apr_redis_server_t **rs)
 {
     apr_status_t rv = APR_SUCCESS;
     apr_redis_server_t *server;
@@ -455,14 +640,15 @@ APR_DECLARE(apr_status_t) apr_redis_server_create(apr_pool_t *p,
         return rv;
     }
 
-    rv = apr_reslist_create(&server->conns,
+    rv = apr_reslist_create_sharded(&server->conns,
+                            shards,     /* Number of shards */
                             min,        /* hard minimum */
                             smax,       /* soft maximum */
                             max,        /* hard maximum */
                             ttl,        /* Time to live */
                             rc_conn_construct,  /* Make a New Connection */
                             rc_conn_destruct,   /* Kill Old Connection */
-                            server, np);
+                            server, flags, np);
     if (rv != APR_SUCCESS) {
         return rv;
     }
@@ -480,6 +666,20 @@ APR_DECLARE(apr_status_t) apr_redis_server_create(apr_pool_t *p,
     return rv;
 }
 
+APR_DECLARE(apr_status_t) apr_redis_server_create(apr_pool_t *p,
+                                                  const char *host,
+                                                  apr_port_t port,
+                                                  apr_uint32_t min,
+                                                  apr_uint32_t smax,
+                                                  apr_uint32_t max,
+                                                  apr_uint32_t ttl,
+                                                  apr_uint32_t rwto,
+                                                  apr_redis_server_t **rs)
+{
+    return apr_redis_server_create_ex(p, host, port, min, smax, max, ttl, rwto,
+                                      1, 0, rs);
+}
+
 APR_DECLARE(apr_status_t) apr_redis_create(apr_pool_t *p,
                                            apr_uint16_t max_servers,
                                            apr_uint32_t flags,
@@ -1373,13 +1573,779 @@ apr_redis_decr(apr_redis_t *rc, const char *key, apr_int32_t inc, apr_uint32_t *
     return plus_minus(rc, 0, key, inc, new_value);
 }
 
+APR_DECLARE(void)
+apr_redis_add_multget_key(apr_pool_t *data_pool,
+                          const char* key,
+                          apr_hash_t **values)
+{
+    apr_redis_value_t* value;
+    apr_size_t klen = strlen(key);
+
+    /* create the value hash if need be */
+    if (!*values) {
+        *values = apr_hash_make(data_pool);
+    }
+
+    /* init key and add it to the value hash */
+    value = apr_pcalloc(data_pool, sizeof(apr_redis_value_t));
+
+    value->status = APR_NOTFOUND;
+    value->key = apr_pstrdup(data_pool, key);
+
+    apr_hash_set(*values, value->key, klen, value);
+}
+
+/* Parsing of the replies, RESP2 and RESP3 */
+
+#define RESP_MAX_DEPTH 16
+
+/** An aggregate being parsed, with its elements parsed so far */
+typedef struct {
+    apr_redis_reply_t *reply;
+    apr_size_t next;
+    int skip;                     /* attribute or push, dropped once parsed */
+} resp_frame_t;
+
+/** Parser of the replies of a connection, resumed as the data arrives */
+typedef struct {
+    apr_pool_t *p;                /* the replies */
+    resp_frame_t stack[RESP_MAX_DEPTH];
+    int depth;
+    apr_size_t need;              /* bytes wanted to complete a bulk string */
+} resp_parser_t;
+
+/* Parse the integer from s up to the \r at eol */
+static int resp_integer(const char *s, const char *eol, apr_int64_t *n)
+{
+    char *end;
+
+    if (s == eol || !(apr_isdigit(*s) || *s == '-')) {
+        return 0;
+    }
+    *n = apr_strtoi64(s, &end, 10);
+
+    return end == eol;
+}
+
+/* Parse the reply in buf from *pos to len, into top for the reply itself
+ * and allocating its elements.  Returns APR_SUCCESS once complete, or
+ * APR_INCOMPLETE until more data is read, *pos being left after what was
+ * parsed and rp->need the size wanted from there when known.  The strings
+ * stay in buf, null terminated in place of their \r.
+ */
+static apr_status_t resp_parse(resp_parser_t *rp, char *buf, apr_size_t len,
+                               apr_size_t *pos, apr_redis_reply_t *top)
+{
+    apr_redis_reply_t *r;
+    resp_frame_t *f;
+    char *line, *eol, *data;
+    apr_size_t used, size;
+    apr_int64_t n;
+    int skip;
+
+    for (;;) {
+        rp->need = 0;
+        line = buf + *pos;
+        eol = memchr(line, '\n', len - *pos);
+        if (!eol) {
+            return APR_INCOMPLETE;
+        }
+        if (eol - line < 2 || eol[-1] != '\r') {
+            return APR_EGENERAL;
+        }
+        used = eol + 1 - line;
+        eol--;
+
+        r = rp->depth ? apr_palloc(rp->p, sizeof(apr_redis_reply_t)) : top;
+        memset(r, 0, sizeof(apr_redis_reply_t));
+        skip = 0;
+
+        switch (*line) {
+        case '+':
+            r->type = APR_REDIS_REPLY_STATUS;
+            break;
+        case '-':
+            r->type = APR_REDIS_REPLY_ERROR;
+            break;
+        case ',':
+            r->type = APR_REDIS_REPLY_DOUBLE;
+            break;
+        case '(':
+            r->type = APR_REDIS_REPLY_BIGNUM;
+            break;
+        case ':':
+            r->type = APR_REDIS_REPLY_INTEGER;
+            if (!resp_integer(line + 1, eol, &r->integer)) {
+                return APR_EGENERAL;
+            }
+            break;
+        case '#':
+            if (eol - line != 2 || (line[1] != 't' && line[1] != 'f')) {
+                return APR_EGENERAL;
+            }
+            r->type = APR_REDIS_REPLY_BOOLEAN;
+            r->integer = (line[1] == 't');
+            break;
+        case '_':
+            if (eol - line != 1) {
+                return APR_EGENERAL;
+            }
+            r->type = APR_REDIS_REPLY_NIL;
+            break;
+        case '$':
+        case '=':
+        case '!':
+            if (line[1] == '-' && eol - line == 3 && line[2] == '1'
+                && *line == '$') {
+                r->type = APR_REDIS_REPLY_NIL;
+                break;
+            }
+            if (!resp_integer(line + 1, eol, &n) || n < 0
+                || n > APR_INT32_MAX) {
+                return APR_EGENERAL;
+            }
+            size = (apr_size_t)n;
+            if (len - *pos < used + size + RC_EOL_LEN) {
+                rp->need = used + size + RC_EOL_LEN;
+                return APR_INCOMPLETE;
+            }
+            data = line + used;
+            if (data[size] != '\r' || data[size + 1] != '\n') {
+                return APR_EGENERAL;
+            }
+            data[size] = '\0';
+            used += size + RC_EOL_LEN;
+
+            r->type = *line == '!' ? APR_REDIS_REPLY_ERROR
+                                   : APR_REDIS_REPLY_STRING;
+            r->str = data;
+            r->len = size;
+            if (*line == '=') {
+                /* the format, as in txt:<string> */
+                if (size < 4 || data[3] != ':') {
+                    return APR_EGENERAL;
+                }
+                r->str += 4;
+                r->len -= 4;
+            }
+            break;
+        case '*':
+        case '~':
+        case '%':
+        case '|':
+        case '>':
+            if (*line == '*' && eol - line == 3 && line[1] == '-'
+                && line[2] == '1') {
+                r->type = APR_REDIS_REPLY_NIL;
+                break;
+            }
+            if (!resp_integer(line + 1, eol, &n) || n < 0
+                || n > APR_INT32_MAX || rp->depth == RESP_MAX_DEPTH) {
+                return APR_EGENERAL;
+            }
+            r->type = *line == '~' ? APR_REDIS_REPLY_SET
+                      : *line == '%' || *line == '|' ? APR_REDIS_REPLY_MAP
+                      : APR_REDIS_REPLY_ARRAY;
+            r->elements = (apr_size_t)n;
+            if (r->type == APR_REDIS_REPLY_MAP) {
+                r->elements *= 2;
+            }
+            if (r->elements) {
+                r->element = apr_palloc(rp->p, r->elements
+                                               * sizeof(apr_redis_reply_t *));
+            }
+            skip = (*line == '|' || *line == '>');
+            break;
+        default:
+            return APR_EGENERAL;
+        }
+
+        if (r->type < APR_REDIS_REPLY_INTEGER
+            || r->type == APR_REDIS_REPLY_DOUBLE
+            || r->type == APR_REDIS_REPLY_BIGNUM) {
+            if (!r->str) {
+                r->str = line + 1;
+                r->len = eol - r->str;
+                *eol = '\0';
+            }
+        }
+        *pos += used;
+
+        if (r->elements) {
+            f = &rp->stack[rp->depth++];
+            f->reply = r;
+            f->next = 0;
+            f->skip = skip;
+            continue;
+        }
+
+        /* complete, and maybe the aggregates it ends */
+        for (;;) {
+            if (!rp->depth) {
+                if (skip) {
+                    break;
+                }
+                return APR_SUCCESS;
+            }
+            f = &rp->stack[rp->depth - 1];
+            if (!skip) {
+                f->reply->element[f->next++] = r;
+            }
+            if (f->next < f->reply->elements) {
+                break;
+            }
+            r = f->reply;
+            skip = f->skip;
+            rp->depth--;
+        }
+    }
+}
+
+/* Pipelined commands */
+
+#define PIPELINE_BUFFER_SIZE 16384
+#define PIPELINE_READ_MIN 1024
+
+/** Commands queued to a server, and their progress while running */
+typedef struct {
+    apr_redis_server_t *rs;
+    apr_redis_conn_t *conn;
+    apr_array_header_t *vec;      /* iovecs of the commands */
+    apr_array_header_t *replies;  /* in the order of the commands */
+    int sent;                     /* iovecs written */
+    int replied;                  /* replies read */
+    int done;                     /* all replies read */
+    char *buf;                    /* replies read, parsed up to bpos */
+    apr_size_t bsize;
+    apr_size_t bpos;
+    apr_size_t blen;
+    resp_parser_t parser;
+    apr_pollfd_t pfd;
+} pipe_server_t;
+
+struct apr_redis_pipeline_t {
+    apr_redis_t *rc;
+    apr_pool_t *p;
+    apr_pool_t *dp;               /* the buffers the strings are read in */
+    apr_redis_pipeline_func func;
+    void *baton;
+    apr_hash_t *servers;
+};
+
+APR_DECLARE(apr_status_t)
+apr_redis_pipeline_create(apr_redis_pipeline_t **pipeline,
+                          apr_redis_t *rc,
+                          apr_redis_pipeline_func func,
+                          void *baton,
+                          apr_pool_t *p)
+{
+    apr_redis_pipeline_t *pl;
+
+    pl = apr_palloc(p, sizeof(apr_redis_pipeline_t));
+    pl->rc = rc;
+    pl->p = p;
+    pl->dp = p;
+    pl->func = func;
+    pl->baton = baton;
+    pl->servers = apr_hash_make(p);
+
+    *pipeline = pl;
+    return APR_SUCCESS;
+}
+
+static void pipe_vec(pipe_server_t *ps, const void *base, apr_size_t len)
+{
+    struct iovec *vec = apr_array_push(ps->vec);
+
+    vec->iov_base = (void *)base;
+    vec->iov_len = len;
+}
+
+/* Queue the command to the server, returning its reply to be */
+static apr_redis_reply_t *pipe_queue(apr_redis_pipeline_t *pl,
+                                     apr_redis_server_t *rs,
+                                     int argc,
+                                     const char **argv,
+                                     const apr_size_t *argvlen)
+{
+    apr_redis_reply_t *reply;
+    pipe_server_t *ps;
+    apr_size_t len;
+    char *head;
+    int i;
+
+    ps = apr_hash_get(pl->servers, &rs, sizeof(rs));
+    if (!ps) {
+        ps = apr_pcalloc(pl->p, sizeof(pipe_server_t));
+        ps->rs = rs;
+        ps->vec = apr_array_make(pl->p, 64, sizeof(struct iovec));
+        ps->replies = apr_array_make(pl->p, 16, sizeof(apr_redis_reply_t *));
+        ps->parser.p = pl->p;
+        apr_hash_set(pl->servers, &ps->rs, sizeof(ps->rs), ps);
+    }
+
+    reply = apr_pcalloc(pl->p, sizeof(apr_redis_reply_t));
+    /* until the reply */
+    reply->status = APR_INCOMPLETE;
+    reply->type = APR_REDIS_REPLY_NIL;
+    APR_ARRAY_PUSH(ps->replies, apr_redis_reply_t *) = reply;
+
+    /*
+     * RESP Command:
+     *   *<argc>
+     *   $<len>
+     *   arg
+     *   ...
+     * the end of line of an argument going with the length of the next.
+     */
+    for (i = 0; i < argc; i++) {
+        len = argvlen ? argvlen[i] : strlen(argv[i]);
+        head = apr_palloc(pl->p, LILBUFF_SIZE);
+        if (i == 0) {
+            pipe_vec(ps, head, apr_snprintf(head, LILBUFF_SIZE,
+                                            "*%d" RC_EOL "$%" APR_SIZE_T_FMT
+                                            RC_EOL, argc, len));
+        }
+        else {
+            pipe_vec(ps, head, apr_snprintf(head, LILBUFF_SIZE,
+                                            RC_EOL "$%" APR_SIZE_T_FMT RC_EOL,
+                                            len));
+        }
+        pipe_vec(ps, argv[i], len);
+    }
+    pipe_vec(ps, RC_EOL, RC_EOL_LEN);
+
+    return reply;
+}
+
+APR_DECLARE(apr_status_t)
+apr_redis_pipeline_command(apr_redis_pipeline_t *pipeline,
+                           const char *key,
+                           int argc,
+                           const char **argv,
+                           const apr_size_t *argvlen,
+                           apr_redis_reply_t **reply)
+{
+    apr_redis_server_t *rs;
+    apr_redis_reply_t *r;
+
+    if (argc < 1) {
+        return APR_EINVAL;
+    }
+
+    rs = apr_redis_find_server_hash(pipeline->rc,
+                                    apr_redis_hash(pipeline->rc, key,
+                                                   strlen(key)));
+    if (rs == NULL) {
+        return APR_NOTFOUND;
+    }
+
+    r = pipe_queue(pipeline, rs, argc, argv, argvlen);
+    if (reply) {
+        *reply = r;
+    }
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE_NONSTD(apr_status_t)
+apr_redis_pipeline_commandv(apr_redis_pipeline_t *pipeline,
+                            const char *key,
+                            apr_redis_reply_t **reply, ...)
+{
+    const char **argv;
+    const char *arg;
+    va_list adummy;
+    int argc = 0;
+
+    va_start(adummy, reply);
+    while (va_arg(adummy, const char *) != NULL) {
+        argc++;
+    }
+    va_end(adummy);
+
+    argv = apr_palloc(pipeline->p, (argc + 1) * sizeof(const char *));
+    argc = 0;
+    va_start(adummy, reply);
+    while ((arg = va_arg(adummy, const char *)) != NULL) {
+        argv[argc++] = arg;
+    }
+    va_end(adummy);
+
+    return apr_redis_pipeline_command(pipeline, key, argc, argv, NULL,
+                                      reply);
+}
+
+static void pipe_reply(apr_redis_pipeline_t *pl, pipe_server_t *ps,
+                       apr_status_t rv)
+{
+    apr_redis_reply_t *reply;
+
+    reply = APR_ARRAY_IDX(ps->replies, ps->replied, apr_redis_reply_t *);
+    if (rv != APR_SUCCESS) {
+        /* maybe parsed in part */
+        memset(reply, 0, sizeof(apr_redis_reply_t));
+        reply->type = APR_REDIS_REPLY_NIL;
+    }
+    reply->status = rv;
+    ps->replied++;
+    if (pl->func) {
+        pl->func(pl->baton, reply);
+    }
+}
+
+/* Done with the server, failing the commands not replied yet with rv */
+static void pipe_server_done(apr_redis_pipeline_t *pl, pipe_server_t *ps,
+                             int serverup, apr_status_t rv)
+{
+    while (ps->replied < ps->replies->nelts) {
+        pipe_reply(pl, ps, rv);
+    }
+
+    if (ps->conn) {
+        apr_socket_timeout_set(ps->conn->sock,
+                               ps->rs->rwto * APR_USEC_PER_SEC);
+        if (rv == APR_SUCCESS) {
+            rs_release_conn(ps->rs, ps->conn);
+        }
+        else {
+            rs_bad_conn(ps->rs, ps->conn);
+        }
+        ps->conn = NULL;
+    }
+    if (!serverup) {
+        apr_redis_disable_server(pl->rc, ps->rs);
+    }
+}
+
+/* Write what the socket takes of the commands */
+static apr_status_t pipe_send(pipe_server_t *ps)
+{
+    struct iovec *vec = (struct iovec *)ps->vec->elts;
+    apr_size_t written;
+    apr_status_t rv;
+    int n;
+
+    while (ps->sent < ps->vec->nelts) {
+        n = ps->vec->nelts - ps->sent;
+        rv = apr_socket_sendv(ps->conn->sock, vec + ps->sent,
+                              n > APR_MAX_IOVEC_SIZE ? APR_MAX_IOVEC_SIZE : n,
+                              &written);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+
+        while (ps->sent < ps->vec->nelts && written >= vec[ps->sent].iov_len) {
+            written -= vec[ps->sent].iov_len;
+            ps->sent++;
+        }
+        if (written) {
+            vec[ps->sent].iov_base = (char *)vec[ps->sent].iov_base + written;
+            vec[ps->sent].iov_len -= written;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+static apr_status_t pipe_parse(apr_redis_pipeline_t *pl, pipe_server_t *ps)
+{
+    apr_redis_reply_t *reply;
+    apr_status_t rv;
+
+    while (ps->replied < ps->replies->nelts) {
+        reply = APR_ARRAY_IDX(ps->replies, ps->replied, apr_redis_reply_t *);
+        rv = resp_parse(&ps->parser, ps->buf, ps->blen, &ps->bpos, reply);
+        if (rv == APR_INCOMPLETE) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        pipe_reply(pl, ps, APR_SUCCESS);
+    }
+
+    ps->done = (ps->replied == ps->replies->nelts);
+    return APR_SUCCESS;
+}
+
+/* Read what the socket has of the replies and parse them */
+static apr_status_t pipe_recv(apr_redis_pipeline_t *pl, pipe_server_t *ps)
+{
+    apr_size_t len, tail;
+    apr_status_t rv;
+    char *buf;
+
+    while (!ps->done) {
+        if (ps->bsize - ps->blen < PIPELINE_READ_MIN
+            || ps->parser.need > ps->bsize - ps->bpos) {
+            /* The replies parsed point to the buffer, so what is not
+             * parsed yet moves to a new one, as large as a bulk string
+             * which does not fit, or twice a line which does not (no \n
+             * found, so that there is room to read the rest of it).
+             */
+            tail = ps->blen - ps->bpos;
+            len = ps->parser.need ? ps->parser.need : tail * 2;
+            if (len < PIPELINE_BUFFER_SIZE) {
+                len = PIPELINE_BUFFER_SIZE;
+            }
+            buf = apr_palloc(pl->dp, len);
+            if (tail) {
+                memcpy(buf, ps->buf + ps->bpos, tail);
+            }
+            ps->buf = buf;
+            ps->bsize = len;
+            ps->bpos = 0;
+            ps->blen = tail;
+        }
+
+        len = ps->bsize - ps->blen;
+        rv = apr_socket_recv(ps->conn->sock, ps->buf + ps->blen, &len);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        ps->blen += len;
+
+        rv = pipe_parse(pl, ps);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+    }
+
+    return APR_SUCCESS;
+}
+
+APR_DECLARE(apr_status_t)
+apr_redis_pipeline_run(apr_redis_pipeline_t *pipeline,
+                       apr_interval_time_t timeout)
+{
+    apr_pool_t *tp;
+    apr_pollset_t *pollset;
+    const apr_pollfd_t *activefds;
+    apr_hash_index_t *hi;
+    pipe_server_t *ps;
+    apr_int32_t i, nactive;
+    apr_status_t rv, prv, status = APR_SUCCESS;
+    int running = 0;
+
+    if (!apr_hash_count(pipeline->servers)) {
+        return APR_SUCCESS;
+    }
+
+    apr_pool_create(&tp, pipeline->p);
+    prv = apr_pollset_create(&pollset, apr_hash_count(pipeline->servers),
+                             tp, 0);
+
+    /* connect to all the servers, the commands go once writable */
+    for (hi = apr_hash_first(NULL, pipeline->servers); hi;
+         hi = apr_hash_next(hi)) {
+        ps = apr_hash_this_val(hi);
+
+        if (prv != APR_SUCCESS) {
+            pipe_server_done(pipeline, ps, TRUE, prv);
+            status = prv;
+            continue;
+        }
+
+        rv = rs_find_conn(ps->rs, &ps->conn);
+        if (rv != APR_SUCCESS) {
+            ps->conn = NULL;
+            pipe_server_done(pipeline, ps, FALSE, rv);
+            status = rv;
+            continue;
+        }
+
+        ps->pfd.desc_type = APR_POLL_SOCKET;
+        ps->pfd.reqevents = APR_POLLIN | APR_POLLOUT;
+        ps->pfd.p = tp;
+        ps->pfd.desc.s = ps->conn->sock;
+        ps->pfd.client_data = ps;
+
+        if ((rv = apr_socket_timeout_set(ps->conn->sock, 0)) != APR_SUCCESS
+            || (rv = apr_pollset_add(pollset, &ps->pfd)) != APR_SUCCESS) {
+            pipe_server_done(pipeline, ps, TRUE, rv);
+            status = rv;
+            continue;
+        }
+        running++;
+    }
+
+    while (running) {
+        rv = apr_pollset_poll(pollset, timeout, &nactive, &activefds);
+        if (APR_STATUS_IS_EINTR(rv)) {
+            continue;
+        }
+        if (rv != APR_SUCCESS) {
+            /* timeout, the servers not done yet fail below */
+            status = rv;
+            break;
+        }
+
+        for (i = 0; i < nactive; i++) {
+            ps = activefds[i].client_data;
+
+            if (ps->sent < ps->vec->nelts
+                && (activefds[i].rtnevents & APR_POLLOUT)) {
+                rv = pipe_send(ps);
+                if (rv == APR_SUCCESS && ps->sent == ps->vec->nelts) {
+                    /* all sent, only the replies are left */
+                    apr_pollset_remove(pollset, &ps->pfd);
+                    ps->pfd.reqevents = APR_POLLIN;
+                    rv = apr_pollset_add(pollset, &ps->pfd);
+                }
+                if (rv != APR_SUCCESS) {
+                    apr_pollset_remove(pollset, &ps->pfd);
+                    pipe_server_done(pipeline, ps, FALSE, rv);
+                    status = rv;
+                    running--;
+                    continue;
+                }
+            }
+
+            if (activefds[i].rtnevents & (APR_POLLIN | APR_POLLHUP
+                                          | APR_POLLERR)) {
+                rv = pipe_recv(pipeline, ps);
+                if (rv != APR_SUCCESS) {
+                    apr_pollset_remove(pollset, &ps->pfd);
+                    /* a reply out of sync is not the server's fault */
+                    pipe_server_done(pipeline, ps, rv == APR_EGENERAL, rv);
+                    status = rv;
+                    running--;
+                    continue;
+                }
+            }
+
+            if (ps->done) {
+                apr_pollset_remove(pollset, &ps->pfd);
+                pipe_server_done(pipeline, ps, TRUE, APR_SUCCESS);
+                running--;
+            }
+        }
+    }
+
+    if (running) {
+        for (hi = apr_hash_first(NULL, pipeline->servers); hi;
+             hi = apr_hash_next(hi)) {
+            ps = apr_hash_this_val(hi);
+            if (ps->conn) {
+                pipe_server_done(pipeline, ps, TRUE, status);
+            }
+        }
+    }
+
+    apr_pool_destroy(tp);
+    apr_hash_clear(pipeline->servers);
+
+    return status;
+}
+
+/** The keys of a multiple get sent to a server, with their MGET */
+typedef struct {
+    apr_array_header_t *values;
+    apr_redis_reply_t *reply;
+} mget_server_t;
+
 APR_DECLARE(apr_status_t)
 apr_redis_multgetp(apr_redis_t *rc,
                    apr_pool_t *temp_pool,
                    apr_pool_t *data_pool,
                    apr_hash_t *values)
 {
-    return APR_ENOTIMPL;
+    apr_redis_pipeline_t *pl;
+    apr_redis_value_t *value;
+    apr_redis_server_t *rs;
+    apr_redis_reply_t *r;
+    apr_hash_t *servers;
+    apr_hash_index_t *hi;
+    mget_server_t *ms;
+    const char **argv;
+    apr_uint32_t rwto = 0;
+    int i;
+
+    apr_redis_pipeline_create(&pl, rc, NULL, NULL, temp_pool);
+    pl->dp = data_pool;
+
+    /* the keys of each server, in one MGET */
+    servers = apr_hash_make(temp_pool);
+    for (hi = apr_hash_first(temp_pool, values); hi; hi = apr_hash_next(hi)) {
+        value = apr_hash_this_val(hi);
+        rs = apr_redis_find_server_hash(rc, apr_redis_hash(rc, value->key,
+                                                       strlen(value->key)));
+        if (rs == NULL) {
+            value->status = APR_NOTFOUND;
+            continue;
+        }
+        ms = apr_hash_get(servers, &rs, sizeof(rs));
+        if (!ms) {
+            ms = apr_pcalloc(temp_pool, sizeof(mget_server_t));
+            ms->values = apr_array_make(temp_pool, 16,
+                                        sizeof(apr_redis_value_t *));
+            apr_hash_set(servers, apr_pmemdup(temp_pool, &rs, sizeof(rs)),
+                         sizeof(rs), ms);
+            if (rs->rwto > rwto) {
+                rwto = rs->rwto;
+            }
+        }
+        APR_ARRAY_PUSH(ms->values, apr_redis_value_t *) = value;
+    }
+
+    for (hi = apr_hash_first(temp_pool, servers); hi; hi = apr_hash_next(hi)) {
+        rs = *(apr_redis_server_t **)apr_hash_this_key(hi);
+        ms = apr_hash_this_val(hi);
+
+        argv = apr_palloc(temp_pool,
+                          (ms->values->nelts + 1) * sizeof(const char *));
+        argv[0] = "MGET";
+        for (i = 0; i < ms->values->nelts; i++) {
+            argv[i + 1] = APR_ARRAY_IDX(ms->values, i,
+                                        apr_redis_value_t *)->key;
+        }
+        ms->reply = pipe_queue(pl, rs, ms->values->nelts + 1, argv, NULL);
+    }
+
+    /* the values of the servers failing have their status */
+    apr_redis_pipeline_run(pl, apr_time_from_sec(rwto));
+
+    for (hi = apr_hash_first(temp_pool, servers); hi; hi = apr_hash_next(hi)) {
+        ms = apr_hash_this_val(hi);
+
+        for (i = 0; i < ms->values->nelts; i++) {
+            value = APR_ARRAY_IDX(ms->values, i, apr_redis_value_t *);
+            value->flags = 0;
+            if (ms->reply->status != APR_SUCCESS) {
+                value->status = ms->reply->status;
+                continue;
+            }
+            if (ms->reply->type != APR_REDIS_REPLY_ARRAY
+                || ms->reply->elements != (apr_size_t)ms->values->nelts) {
+                value->status = APR_EGENERAL;
+                continue;
+            }
+
+            /* the data stays in the buffers it was read in */
+            r = ms->reply->element[i];
+            if (r->type == APR_REDIS_REPLY_STRING) {
+                value->status = APR_SUCCESS;
+                value->data = r->str;
+                value->len = r->len;
+            }
+            else if (r->type == APR_REDIS_REPLY_NIL) {
+                value->status = APR_NOTFOUND;
+            }
+            else {
+                value->status = APR_EGENERAL;
+            }
+        }
+    }
+
+    apr_pool_clear(temp_pool);
+    return APR_SUCCESS;
 }
 
 /**
@@ -19,6 +19,8 @@
 #include "apr_general.h"
 #include "apr_pools.h"
 #include "apr_time.h"
+#include "apr_atomic.h"
+#include "apr_siphash.h"
 
 #include "apr_hash.h"
 
@@ -273,6 +275,197 @@ APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_default(const char *char_key,
     return hashfunc_default(char_key, klen, 0);
 }
 
+/*
+ * Wide hash functions.
+ *
+ * These are keyed by a secret chosen once per process (randomly if
+ * possible), since the apr_hashfunc_t interface has no room for a per
+ * table seed; the tables' default hash function mixes in their own seed.
+ */
+
+#define HASH_SECRET_NONE  0
+#define HASH_SECRET_INIT  1
+#define HASH_SECRET_READY 2
+
+static apr_uint32_t hash_secret_state = HASH_SECRET_NONE;
+static union {
+    unsigned char bytes[8 + APR_SIPHASH_KSIZE];
+    apr_uint64_t  seed;
+} hash_secret;
+
+static void hash_secret_init(void)
+{
+    if (apr_atomic_cas32(&hash_secret_state, HASH_SECRET_INIT,
+                         HASH_SECRET_NONE) == HASH_SECRET_NONE) {
+        unsigned char *buf = hash_secret.bytes;
+        apr_size_t i;
+#if APR_HAS_RANDOM
+        if (apr_generate_random_bytes(buf, sizeof(hash_secret.bytes))
+                != APR_SUCCESS)
+#endif
+        {
+            apr_uint64_t h = (apr_uint64_t)apr_time_now()
+                             ^ (apr_uintptr_t)&hash_secret
+                             ^ (apr_uintptr_t)&buf;
+            for (i = 0; i < sizeof(hash_secret.bytes); i++) {
+                h = (h ^ (h >> 29)) * APR_UINT64_C(0xbf58476d1ce4e5b9) + i;
+                buf[i] = (unsigned char)(h >> 32);
+            }
+        }
+        apr_atomic_set32(&hash_secret_state, HASH_SECRET_READY);
+    }
+    else {
+        /* Someone else is initializing, wait for the result */
+        while (apr_atomic_read32(&hash_secret_state) != HASH_SECRET_READY)
+            ;
+    }
+}
+
+#define HASH_SECRET_ENSURE() \
+    if (apr_atomic_read32(&hash_secret_state) != HASH_SECRET_READY) \
+        hash_secret_init()
+
+static APR_INLINE apr_uint64_t wy_read8(const unsigned char *p)
+{
+    apr_uint64_t v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static APR_INLINE apr_uint64_t wy_read4(const unsigned char *p)
+{
+    apr_uint32_t v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static APR_INLINE apr_uint64_t wy_read3(const unsigned char *p, apr_size_t k)
+{
+    return ((apr_uint64_t)p[0] << 16) | ((apr_uint64_t)p[k >> 1] << 8)
+           | p[k - 1];
+}
+
+/* 64x64 => 128 bits multiplication, low half in *a and high half in *b */
+static APR_INLINE void wy_mum(apr_uint64_t *a, apr_uint64_t *b)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 r = (unsigned __int128)*a * *b;
+    *a = (apr_uint64_t)r;
+    *b = (apr_uint64_t)(r >> 64);
+#else
+    apr_uint64_t ha = *a >> 32, hb = *b >> 32;
+    apr_uint64_t la = (apr_uint32_t)*a, lb = (apr_uint32_t)*b;
+    apr_uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    apr_uint64_t t = rl + (rm0 << 32), c = t < rl, lo;
+    lo = t + (rm1 << 32);
+    c += lo < t;
+    *a = lo;
+    *b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+static APR_INLINE apr_uint64_t wy_mix(apr_uint64_t a, apr_uint64_t b)
+{
+    wy_mum(&a, &b);
+    return a ^ b;
+}
+
+/* wyhash (final version 4), by Wang Yi, released in the public domain,
+ * see https://github.com/wangyi-fudan/wyhash.
+ */
+static unsigned int hashfunc_wyhash(const char *char_key, apr_ssize_t *klen,
+                                    apr_uint64_t seed)
+{
+    static const apr_uint64_t secret[4] = {
+        APR_UINT64_C(0x2d358dccaa6c78a5), APR_UINT64_C(0x8bb84b93962eacc9),
+        APR_UINT64_C(0x4b33a62ed433d4a3), APR_UINT64_C(0x4d5a2da51de1aa47)
+    };
+    const unsigned char *p = (const unsigned char *)char_key;
+    apr_size_t len;
+    apr_uint64_t a, b;
+
+    if (*klen == APR_HASH_KEY_STRING) {
+        *klen = strlen(char_key);
+    }
+    len = (apr_size_t)*klen;
+
+    seed ^= wy_mix(seed ^ secret[0], secret[1]);
+    if (len <= 16) {
+        if (len >= 4) {
+            a = (wy_read4(p) << 32) | wy_read4(p + ((len >> 3) << 2));
+            b = (wy_read4(p + len - 4) << 32)
+                | wy_read4(p + len - 4 - ((len >> 3) << 2));
+        }
+        else if (len > 0) {
+            a = wy_read3(p, len);
+            b = 0;
+        }
+        else {
+            a = b = 0;
+        }
+    }
+    else {
+        apr_size_t i = len;
+        if (i > 48) {
+            apr_uint64_t see1 = seed, see2 = seed;
+            do {
+                seed = wy_mix(wy_read8(p) ^ secret[1],
+                              wy_read8(p + 8) ^ seed);
+                see1 = wy_mix(wy_read8(p + 16) ^ secret[2],
+                              wy_read8(p + 24) ^ see1);
+                see2 = wy_mix(wy_read8(p + 32) ^ secret[3],
+                              wy_read8(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            } while (i > 48);
+            seed ^= see1 ^ see2;
+        }
+        while (i > 16) {
+            seed = wy_mix(wy_read8(p) ^ secret[1], wy_read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+        a = wy_read8(p + i - 16);
+        b = wy_read8(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    wy_mum(&a, &b);
+    a = wy_mix(a ^ secret[0] ^ len, b ^ secret[1]);
+
+    return (unsigned int)(a ^ (a >> 32));
+}
+
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_wyhash(const char *char_key,
+                                                     apr_ssize_t *klen)
+{
+    HASH_SECRET_ENSURE();
+    return hashfunc_wyhash(char_key, klen, hash_secret.seed);
+}
+
+APR_DECLARE_NONSTD(unsigned int) apr_hashfunc_siphash13(const char *char_key,
+                                                        apr_ssize_t *klen)
+{
+    apr_uint64_t h;
+
+    HASH_SECRET_ENSURE();
+    if (*klen == APR_HASH_KEY_STRING) {
+        *klen = strlen(char_key);
+    }
+    h = apr_siphash13(char_key, *klen, hash_secret.bytes + 8);
+
+    return (unsigned int)(h ^ (h >> 32));
+}
+
+/* The hash function of the tables without a custom one */
+static APR_INLINE unsigned int hashfunc_table(const apr_hash_t *ht,
+                                              const char *key,
+                                              apr_ssize_t *klen)
+{
+    HASH_SECRET_ENSURE();
+    return hashfunc_wyhash(key, klen, hash_secret.seed ^ ht->seed);
+}
+
 /*
  * This is where we keep the details of the hash function and control
  * the maximum collision rate.
@@ -293,7 +486,7 @@ static apr_hash_entry_t **find_entry(apr_hash_t *ht,
     if (ht->hash_func)
         hash = ht->hash_func(key, &klen);
     else
-        hash = hashfunc_default(key, &klen, ht->seed);
+        hash = hashfunc_table(ht, key, &klen);
 
     /* scan linked list */
     for (hep = &ht->array[hash & ht->max], he = *hep;
@@ -505,7 +698,7 @@ APR_DECLARE(apr_hash_t *) apr_hash_merge(apr_pool_t *p,
             if (res->hash_func)
                 hash = res->hash_func(iter->key, &iter->klen);
             else
-                hash = hashfunc_default(iter->key, &iter->klen, res->seed);
+                hash = hashfunc_table(res, iter->key, &iter->klen);
             i = hash & res->max;
             for (ent = res->array[i]; ent; ent = ent->next) {
                 if ((ent->klen == iter->klen) &&
@@ -0,0 +1,611 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_private.h"
+
+#include "apr_general.h"
+#include "apr_pools.h"
+#include "apr_time.h"
+
+#include "apr_hash.h"
+
+#if APR_HAVE_STRING_H
+#include <string.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) \
+    || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASH_FLAT_SSE2 1
+#elif defined(__aarch64__) && defined(__ARM_NEON)
+#include <arm_neon.h>
+#define HASH_FLAT_NEON 1
+#endif
+
+/*
+ * The internal form of a flat hash table.
+ *
+ * The table is an open addressing array of slots holding the entries
+ * inline, and a parallel array of control bytes, one per slot, telling
+ * whether the slot is empty, deleted (a tombstone) or full, in which case
+ * the control byte holds 7 bits of the (mixed) hash value.  The slots are
+ * split in groups of GROUP_WIDTH whose control bytes are matched at once
+ * (SIMD), so that a lookup usually compares a single full key.
+ *
+ * The remaining bits of the mixed hash select the first group to probe,
+ * and the next groups are probed quadratically (triangular numbers, which
+ * visit all the groups of a power of two count) until a group with an
+ * empty slot is found.  Once a group got full it thus never gets empty
+ * slots again (before rehashing), deleting an entry from it leaves a
+ * tombstone which can only be reused by a later insertion.
+ *
+ * The table grows (doubles) when it reaches 7/8 of its capacity, or is
+ * rehashed in place when it's mostly filled with tombstones.
+ */
+
+#define GROUP_WIDTH 16
+#define INITIAL_CAPACITY GROUP_WIDTH /* tunable == GROUP_WIDTH * 2^n */
+
+#define CTRL_EMPTY      ((unsigned char)0x80)
+#define CTRL_DELETED    ((unsigned char)0xFE)
+#define CTRL_IS_FULL(c) (((c) & 0x80) == 0)
+
+#define H1(mixed) ((mixed) >> 7)
+#define H2(mixed) ((unsigned char)((mixed) & 0x7F))
+
+typedef struct hash_flat_slot_t {
+    const void       *key;
+    apr_ssize_t       klen;
+    const void       *val;
+    unsigned int      hash;
+} hash_flat_slot_t;
+
+/*
+ * Data structure for iterating through a flat hash table.
+ */
+struct apr_hash_flat_index_t {
+    apr_hash_flat_t    *ht;
+    unsigned int        this, index;
+};
+
+/*
+ * The capacity is always a power of two (and a multiple of GROUP_WIDTH),
+ * we use the mask rather than the size for modular arithmetic.
+ */
+struct apr_hash_flat_t {
+    apr_pool_t            *pool;
+    hash_flat_slot_t      *slots;
+    unsigned char         *ctrl;
+    apr_hash_flat_index_t  iterator;  /* For apr_hash_flat_first(NULL, ...) */
+    unsigned int           count, mask, growth_left, seed;
+    apr_hashfunc_t         hash_func;
+};
+
+/*
+ * Group matching, each function returns a bitmask of the matching
+ * control bytes of the group (bit N for slot N of the group).
+ */
+
+#if HASH_FLAT_SSE2
+
+static APR_INLINE unsigned int group_match(const unsigned char *group,
+                                           unsigned char c)
+{
+    __m128i ctrl = _mm_loadu_si128((const __m128i *)group);
+    return (unsigned int)_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl,
+                                                 _mm_set1_epi8((char)c)));
+}
+
+static APR_INLINE unsigned int group_match_free(const unsigned char *group)
+{
+    /* empty or deleted, both have the high bit set */
+    return (unsigned int)_mm_movemask_epi8(_mm_loadu_si128(
+                                                 (const __m128i *)group));
+}
+
+#elif HASH_FLAT_NEON
+
+static APR_INLINE unsigned int neon_movemask(uint8x16_t m)
+{
+    static const unsigned char bits[GROUP_WIDTH] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128
+    };
+    m = vandq_u8(m, vld1q_u8(bits));
+    return (unsigned int)vaddv_u8(vget_low_u8(m))
+           | ((unsigned int)vaddv_u8(vget_high_u8(m)) << 8);
+}
+
+static APR_INLINE unsigned int group_match(const unsigned char *group,
+                                           unsigned char c)
+{
+    return neon_movemask(vceqq_u8(vld1q_u8(group), vdupq_n_u8(c)));
+}
+
+static APR_INLINE unsigned int group_match_free(const unsigned char *group)
+{
+    return neon_movemask(vcltq_s8(vreinterpretq_s8_u8(vld1q_u8(group)),
+                                  vdupq_n_s8(0)));
+}
+
+#else /* portable */
+
+static APR_INLINE unsigned int group_match(const unsigned char *group,
+                                           unsigned char c)
+{
+    unsigned int i, mask = 0;
+    for (i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (unsigned int)(group[i] == c) << i;
+    }
+    return mask;
+}
+
+static APR_INLINE unsigned int group_match_free(const unsigned char *group)
+{
+    unsigned int i, mask = 0;
+    for (i = 0; i < GROUP_WIDTH; i++) {
+        mask |= (unsigned int)(group[i] >> 7) << i;
+    }
+    return mask;
+}
+
+#endif
+
+static APR_INLINE unsigned int group_match_empty(const unsigned char *group)
+{
+    return group_match(group, CTRL_EMPTY);
+}
+
+static APR_INLINE unsigned int group_match_full(const unsigned char *group)
+{
+    return ~group_match_free(group) & ((1u << GROUP_WIDTH) - 1);
+}
+
+static APR_INLINE unsigned int lowest_bit(unsigned int mask)
+{
+#if defined(__GNUC__)
+    return (unsigned int)__builtin_ctz(mask);
+#else
+    unsigned int n = 0;
+    while (!(mask & 1)) {
+        mask >>= 1;
+        n++;
+    }
+    return n;
+#endif
+}
+
+/*
+ * Hash value helpers.
+ *
+ * The (custom) hash function's value is stored in the slots and finalized
+ * (with the table's seed) into the mixed value which determines the probe
+ * sequence and the control byte, so that all its bits are significant.
+ */
+
+static APR_INLINE unsigned int hash_key(const apr_hash_flat_t *ht,
+                                        const void *key, apr_ssize_t *klen)
+{
+    if (ht->hash_func)
+        return ht->hash_func(key, klen);
+    else
+        return apr_hashfunc_wyhash(key, klen);
+}
+
+static APR_INLINE unsigned int hash_mix(const apr_hash_flat_t *ht,
+                                        unsigned int hash)
+{
+    apr_uint32_t h = (apr_uint32_t)hash ^ ht->seed;
+
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35U;
+    h ^= h >> 16;
+    return h;
+}
+
+static APR_INLINE unsigned int capacity_to_growth(unsigned int capacity)
+{
+    return capacity - capacity / 8;
+}
+
+/*
+ * Hash creation functions.
+ */
+
+static void alloc_arrays(apr_hash_flat_t *ht, unsigned int capacity)
+{
+    ht->slots = apr_palloc(ht->pool, (sizeof(*ht->slots) + 1) * capacity);
+    ht->ctrl = (unsigned char *)(ht->slots + capacity);
+    memset(ht->ctrl, CTRL_EMPTY, capacity);
+    ht->mask = capacity - 1;
+    ht->growth_left = capacity_to_growth(capacity);
+}
+
+APR_DECLARE(apr_hash_flat_t *) apr_hash_make_flat(apr_pool_t *pool)
+{
+    apr_hash_flat_t *ht;
+    apr_time_t now = apr_time_now();
+
+    ht = apr_palloc(pool, sizeof(apr_hash_flat_t));
+    ht->pool = pool;
+    ht->count = 0;
+    ht->seed = (unsigned int)((now >> 32) ^ now ^ (apr_uintptr_t)pool ^
+                              (apr_uintptr_t)ht ^ (apr_uintptr_t)&now) - 1;
+    ht->hash_func = NULL;
+    alloc_arrays(ht, INITIAL_CAPACITY);
+
+    return ht;
+}
+
+APR_DECLARE(apr_hash_flat_t *) apr_hash_make_flat_custom(apr_pool_t *pool,
+                                                         apr_hashfunc_t hash_func)
+{
+    apr_hash_flat_t *ht = apr_hash_make_flat(pool);
+    ht->hash_func = hash_func;
+    return ht;
+}
+
+APR_DECLARE(apr_hash_flat_t *) apr_hash_flat_copy(apr_pool_t *pool,
+                                                  const apr_hash_flat_t *orig)
+{
+    apr_hash_flat_t *ht;
+    unsigned int capacity = orig->mask + 1;
+
+    ht = apr_palloc(pool, sizeof(apr_hash_flat_t));
+    ht->pool = pool;
+    ht->count = orig->count;
+    ht->seed = orig->seed;
+    ht->hash_func = orig->hash_func;
+    ht->slots = apr_palloc(pool, (sizeof(*ht->slots) + 1) * capacity);
+    ht->ctrl = (unsigned char *)(ht->slots + capacity);
+    memcpy(ht->slots, orig->slots, (sizeof(*ht->slots) + 1) * capacity);
+    ht->mask = orig->mask;
+    ht->growth_left = orig->growth_left;
+
+    return ht;
+}
+
+/*
+ * Probing functions.
+ */
+
+static int find_slot(const apr_hash_flat_t *ht, const void *key,
+                     apr_ssize_t klen, unsigned int hash,
+                     unsigned int mixed, unsigned int *pos)
+{
+    unsigned int gmask = ht->mask / GROUP_WIDTH;
+    unsigned int g = H1(mixed) & gmask, step = 0;
+    unsigned char h2 = H2(mixed);
+
+    for (;;) {
+        const unsigned char *group = ht->ctrl + g * GROUP_WIDTH;
+        unsigned int match = group_match(group, h2);
+
+        while (match) {
+            unsigned int i = g * GROUP_WIDTH + lowest_bit(match);
+            const hash_flat_slot_t *slot = &ht->slots[i];
+            if (slot->hash == hash
+                && slot->klen == klen
+                && memcmp(slot->key, key, klen) == 0) {
+                *pos = i;
+                return 1;
+            }
+            match &= match - 1;
+        }
+        if (group_match_empty(group)) {
+            return 0;
+        }
+        g = (g + ++step) & gmask;
+    }
+}
+
+static unsigned int find_free_slot(const apr_hash_flat_t *ht,
+                                   unsigned int mixed)
+{
+    unsigned int gmask = ht->mask / GROUP_WIDTH;
+    unsigned int g = H1(mixed) & gmask, step = 0;
+
+    for (;;) {
+        unsigned int match = group_match_free(ht->ctrl + g * GROUP_WIDTH);
+        if (match) {
+            return g * GROUP_WIDTH + lowest_bit(match);
+        }
+        g = (g + ++step) & gmask;
+    }
+}
+
+/*
+ * Expanding or rehashing a flat hash table
+ */
+
+static void expand_arrays(apr_hash_flat_t *ht)
+{
+    hash_flat_slot_t *old_slots = ht->slots;
+    unsigned char *old_ctrl = ht->ctrl;
+    unsigned int i, old_capacity = ht->mask + 1;
+
+    alloc_arrays(ht, old_capacity * 2);
+    for (i = 0; i < old_capacity; i++) {
+        if (CTRL_IS_FULL(old_ctrl[i])) {
+            unsigned int mixed = hash_mix(ht, old_slots[i].hash);
+            unsigned int pos = find_free_slot(ht, mixed);
+            ht->ctrl[pos] = H2(mixed);
+            ht->slots[pos] = old_slots[i];
+        }
+    }
+    ht->growth_left -= ht->count;
+}
+
+/* Purge the tombstones without reallocating the arrays: the full slots are
+ * marked deleted and the deleted ones empty, then each (now deleted) entry
+ * is either kept in place if it's in the first group with a free slot of
+ * its probe sequence, or moved to the empty slot found there, or swapped
+ * with the deleted one found there which is then processed the same way.
+ */
+static void rehash_in_place(apr_hash_flat_t *ht)
+{
+    unsigned int i, capacity = ht->mask + 1;
+
+    for (i = 0; i < capacity; i++) {
+        ht->ctrl[i] = CTRL_IS_FULL(ht->ctrl[i]) ? CTRL_DELETED : CTRL_EMPTY;
+    }
+    for (i = 0; i < capacity; i++) {
+        while (ht->ctrl[i] == CTRL_DELETED) {
+            unsigned int mixed = hash_mix(ht, ht->slots[i].hash);
+            unsigned int pos = find_free_slot(ht, mixed);
+
+            if (pos / GROUP_WIDTH == i / GROUP_WIDTH) {
+                ht->ctrl[i] = H2(mixed);
+            }
+            else if (ht->ctrl[pos] == CTRL_EMPTY) {
+                ht->ctrl[pos] = H2(mixed);
+                ht->slots[pos] = ht->slots[i];
+                ht->ctrl[i] = CTRL_EMPTY;
+            }
+            else {
+                hash_flat_slot_t tmp = ht->slots[pos];
+                ht->ctrl[pos] = H2(mixed);
+                ht->slots[pos] = ht->slots[i];
+                ht->slots[i] = tmp;
+            }
+        }
+    }
+    ht->growth_left = capacity_to_growth(capacity) - ht->count;
+}
+
+static unsigned int insert_slot(apr_hash_flat_t *ht, unsigned int mixed)
+{
+    unsigned int pos = find_free_slot(ht, mixed);
+
+    if (ht->growth_left == 0 && ht->ctrl[pos] == CTRL_EMPTY) {
+        if (ht->count < capacity_to_growth(ht->mask + 1) / 2) {
+            rehash_in_place(ht);
+        }
+        else {
+            expand_arrays(ht);
+        }
+        pos = find_free_slot(ht, mixed);
+    }
+    if (ht->ctrl[pos] == CTRL_EMPTY) {
+        ht->growth_left--;
+    }
+    ht->ctrl[pos] = H2(mixed);
+    ht->count++;
+    return pos;
+}
+
+static void erase_slot(apr_hash_flat_t *ht, unsigned int pos)
+{
+    /* If the group has an empty slot, it never got full hence no probe
+     * sequence went through it, so the slot can be emptied too.
+     */
+    if (group_match_empty(ht->ctrl + (pos & ~(GROUP_WIDTH - 1)))) {
+        ht->ctrl[pos] = CTRL_EMPTY;
+        ht->growth_left++;
+    }
+    else {
+        ht->ctrl[pos] = CTRL_DELETED;
+    }
+    ht->count--;
+}
+
+APR_DECLARE(void *) apr_hash_flat_get(apr_hash_flat_t *ht,
+                                      const void *key,
+                                      apr_ssize_t klen)
+{
+    unsigned int hash, pos;
+
+    hash = hash_key(ht, key, &klen);
+    if (find_slot(ht, key, klen, hash, hash_mix(ht, hash), &pos))
+        return (void *)ht->slots[pos].val;
+    else
+        return NULL;
+}
+
+APR_DECLARE(void) apr_hash_flat_set(apr_hash_flat_t *ht,
+                                    const void *key,
+                                    apr_ssize_t klen,
+                                    const void *val)
+{
+    unsigned int hash, mixed, pos;
+
+    hash = hash_key(ht, key, &klen);
+    mixed = hash_mix(ht, hash);
+    if (find_slot(ht, key, klen, hash, mixed, &pos)) {
+        if (!val) {
+            /* delete entry */
+            erase_slot(ht, pos);
+        }
+        else {
+            /* replace entry */
+            ht->slots[pos].val = val;
+        }
+    }
+    else if (val) {
+        /* add a new entry for non-NULL values */
+        hash_flat_slot_t *slot;
+
+        /* may expand the arrays, before the slot is addressed */
+        pos = insert_slot(ht, mixed);
+        slot = &ht->slots[pos];
+        slot->hash = hash;
+        slot->key  = key;
+        slot->klen = klen;
+        slot->val  = val;
+    }
+    /* else key not present and val==NULL */
+}
+
+APR_DECLARE(void *) apr_hash_flat_get_or_set(apr_hash_flat_t *ht,
+                                             const void *key,
+                                             apr_ssize_t klen,
+                                             const void *val)
+{
+    unsigned int hash, mixed, pos;
+
+    hash = hash_key(ht, key, &klen);
+    mixed = hash_mix(ht, hash);
+    if (find_slot(ht, key, klen, hash, mixed, &pos)) {
+        return (void *)ht->slots[pos].val;
+    }
+    if (val) {
+        hash_flat_slot_t *slot;
+
+        /* may expand the arrays, before the slot is addressed */
+        pos = insert_slot(ht, mixed);
+        slot = &ht->slots[pos];
+        slot->hash = hash;
+        slot->key  = key;
+        slot->klen = klen;
+        slot->val  = val;
+        return (void *)val;
+    }
+    /* else key not present and val==NULL */
+    return NULL;
+}
+
+APR_DECLARE(unsigned int) apr_hash_flat_count(apr_hash_flat_t *ht)
+{
+    return ht->count;
+}
+
+APR_DECLARE(void) apr_hash_flat_clear(apr_hash_flat_t *ht)
+{
+    memset(ht->ctrl, CTRL_EMPTY, ht->mask + 1);
+    ht->growth_left = capacity_to_growth(ht->mask + 1);
+    ht->count = 0;
+}
+
+/*
+ * Hash iteration functions.
+ */
+
+static APR_INLINE int next_full_slot(const apr_hash_flat_t *ht,
+                                     unsigned int *index)
+{
+    unsigned int i = *index;
+
+    while (i <= ht->mask) {
+        unsigned int base = i & ~(GROUP_WIDTH - 1);
+        unsigned int full = group_match_full(ht->ctrl + base);
+
+        full &= ~0u << (i - base);
+        if (full) {
+            *index = base + lowest_bit(full);
+            return 1;
+        }
+        i = base + GROUP_WIDTH;
+    }
+    return 0;
+}
+
+APR_DECLARE(apr_hash_flat_index_t *) apr_hash_flat_next(
+                                                   apr_hash_flat_index_t *hi)
+{
+    if (!next_full_slot(hi->ht, &hi->index))
+        return NULL;
+
+    hi->this = hi->index++;
+    return hi;
+}
+
+APR_DECLARE(apr_hash_flat_index_t *) apr_hash_flat_first(apr_pool_t *p,
+                                                         apr_hash_flat_t *ht)
+{
+    apr_hash_flat_index_t *hi;
+    if (p)
+        hi = apr_palloc(p, sizeof(*hi));
+    else
+        hi = &ht->iterator;
+
+    hi->ht = ht;
+    hi->index = 0;
+    hi->this = 0;
+    return apr_hash_flat_next(hi);
+}
+
+APR_DECLARE(void) apr_hash_flat_this(apr_hash_flat_index_t *hi,
+                                     const void **key,
+                                     apr_ssize_t *klen,
+                                     void **val)
+{
+    const hash_flat_slot_t *slot = &hi->ht->slots[hi->this];
+
+    if (key)  *key  = slot->key;
+    if (klen) *klen = slot->klen;
+    if (val)  *val  = (void *)slot->val;
+}
+
+APR_DECLARE(const void *) apr_hash_flat_this_key(apr_hash_flat_index_t *hi)
+{
+    const void *key;
+
+    apr_hash_flat_this(hi, &key, NULL, NULL);
+    return key;
+}
+
+APR_DECLARE(apr_ssize_t) apr_hash_flat_this_key_len(apr_hash_flat_index_t *hi)
+{
+    apr_ssize_t klen;
+
+    apr_hash_flat_this(hi, NULL, &klen, NULL);
+    return klen;
+}
+
+APR_DECLARE(void *) apr_hash_flat_this_val(apr_hash_flat_index_t *hi)
+{
+    void *val;
+
+    apr_hash_flat_this(hi, NULL, NULL, &val);
+    return val;
+}
+
+APR_DECLARE(int) apr_hash_flat_do(apr_hash_do_callback_fn_t *comp,
+                                  void *rec, const apr_hash_flat_t *ht)
+{
+    unsigned int index = 0;
+
+    while (next_full_slot(ht, &index)) {
+        const hash_flat_slot_t *slot = &ht->slots[index++];
+        if (!(*comp)(rec, slot->key, slot->klen, slot->val)) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+APR_POOL_IMPLEMENT_ACCESSOR(hash_flat)
@@ -328,6 +328,57 @@ APR_DECLARE(char *) apr_array_pstrcat(apr_pool_t *p,
     checksum &= CASE_MASK;                     \
 }
 
+/* Tables with many keys sharing the same first byte (e.g. HTTP headers
+ * like Accept-*, X-Forwarded-* or Sec-*) would degrade the first byte
+ * index above into linear scans, so a full (case-insensitive) hash index
+ * of the keys is also built once the table reaches TABLE_HINDEX_MIN
+ * elements.  It maps each distinct key to the offsets of the first and
+ * last entries with that key, using open addressing (linear probing).
+ *
+ * The hash index is kept up to date by the functions adding or unsetting
+ * entries, and rebuilt by table_reindex() when entries are moved.  It is
+ * only used if it indexes all the elements of the table, so that tables
+ * modified behind our back (through apr_table_elts()) fall back to the
+ * first byte index.  It is never built by the lookup functions, so that
+ * concurrent lookups in a (const) table remain safe.
+ */
+#define TABLE_HINDEX_MIN 16
+#define TABLE_HINDEX_IS_VALID(t) \
+    ((t)->hindex && (t)->hindex->nelts == (t)->a.nelts)
+
+typedef struct table_hindex_slot_t {
+    apr_uint32_t hash;
+    int first;          /* -1 for an empty slot */
+    int last;
+} table_hindex_slot_t;
+
+struct table_hindex_t {
+    table_hindex_slot_t *slots;
+    int mask;           /* number of slots - 1 */
+    int count;          /* number of distinct keys */
+    int nelts;          /* number of table elements indexed */
+};
+
+/* Case-insensitive FNV-1a hash of the key, with a final mix since we use
+ * the low bits.
+ */
+static APR_INLINE apr_uint32_t table_key_hash(const char *key)
+{
+    const unsigned char *k = (const unsigned char *)key;
+    apr_uint32_t h = 2166136261U;
+
+    for (; *k; k++) {
+        h ^= *k & (CASE_MASK & 0xff);
+        h *= 16777619U;
+    }
+    h ^= h >> 16;
+    h *= 0x85ebca6bU;
+    h ^= h >> 13;
+    return h;
+}
+
+typedef struct table_hindex_t table_hindex_t;
+
 /** The opaque string-content table type */
 struct apr_table_t {
     /* This has to be first to promote backwards compatibility with
@@ -355,6 +406,8 @@ struct apr_table_t {
     apr_uint32_t index_initialized;
     int index_first[TABLE_HASH_SIZE];
     int index_last[TABLE_HASH_SIZE];
+    /* The full hash index of the keys (or NULL), see table_hindex_t */
+    table_hindex_t *hindex;
 };
 
 /* keep state for apr_table_getm() */
@@ -387,6 +440,179 @@ static apr_table_entry_t *do_table_push(const char *func, apr_table_t *t)
 #define table_push(t)	((apr_table_entry_t *) apr_array_push_noclear(&(t)->a))
 #endif /* MAKE_TABLE_PROFILE */
 
+static table_hindex_slot_t *table_hindex_slot(const apr_table_t *t,
+                                              const char *key,
+                                              apr_uint32_t hash)
+{
+    const table_hindex_t *hi = t->hindex;
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+    int i = (int)(hash & (apr_uint32_t)hi->mask);
+
+    for (;;) {
+        table_hindex_slot_t *slot = &hi->slots[i];
+        if (slot->first < 0
+            || (slot->hash == hash && !strcasecmp(elts[slot->first].key,
+                                                  key))) {
+            return slot;
+        }
+        i = (i + 1) & hi->mask;
+    }
+}
+
+static void table_hindex_build(apr_table_t *t)
+{
+    table_hindex_t *hi = t->hindex;
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)t->a.elts;
+    int i, nslots = TABLE_HINDEX_MIN * 2;
+
+    while (nslots < t->a.nelts * 2) {
+        nslots *= 2;
+    }
+    if (!hi) {
+        hi = t->hindex = apr_palloc(t->a.pool, sizeof(*hi));
+        hi->mask = -1;
+    }
+    if (hi->mask + 1 < nslots) {
+        hi->slots = apr_palloc(t->a.pool, nslots * sizeof(*hi->slots));
+        hi->mask = nslots - 1;
+    }
+    for (i = 0; i <= hi->mask; i++) {
+        hi->slots[i].first = -1;
+    }
+    hi->count = 0;
+    for (i = 0; i < t->a.nelts; i++) {
+        if (elts[i].key) {
+            apr_uint32_t hash = table_key_hash(elts[i].key);
+            table_hindex_slot_t *slot = table_hindex_slot(t, elts[i].key,
+                                                          hash);
+            if (slot->first < 0) {
+                slot->hash = hash;
+                slot->first = i;
+                hi->count++;
+            }
+            slot->last = i;
+        }
+    }
+    hi->nelts = t->a.nelts;
+}
+
+/* Double the number of slots, rehashing them (not the keys) */
+static void table_hindex_grow(apr_table_t *t)
+{
+    table_hindex_t *hi = t->hindex;
+    table_hindex_slot_t *old_slots = hi->slots;
+    int i, j, old_nslots = hi->mask + 1;
+
+    hi->slots = apr_palloc(t->a.pool, 2 * old_nslots * sizeof(*hi->slots));
+    hi->mask = 2 * old_nslots - 1;
+    for (j = 0; j <= hi->mask; j++) {
+        hi->slots[j].first = -1;
+    }
+    for (i = 0; i < old_nslots; i++) {
+        if (old_slots[i].first >= 0) {
+            j = (int)(old_slots[i].hash & (apr_uint32_t)hi->mask);
+            while (hi->slots[j].first >= 0) {
+                j = (j + 1) & hi->mask;
+            }
+            hi->slots[j] = old_slots[i];
+        }
+    }
+}
+
+/* Remove the key which has a single entry at offset pos (before the table
+ * is compacted), shifting back the slots of the same probe sequence and
+ * the offsets of the following entries.
+ */
+static void table_hindex_remove(apr_table_t *t, const char *key, int pos)
+{
+    table_hindex_t *hi = t->hindex;
+    table_hindex_slot_t *slots = hi->slots;
+    int i, j, k;
+
+    i = (int)(table_hindex_slot(t, key, table_key_hash(key)) - slots);
+    for (j = i;;) {
+        slots[i].first = -1;
+        do {
+            j = (j + 1) & hi->mask;
+            if (slots[j].first < 0) {
+                goto shifted;
+            }
+            k = (int)(slots[j].hash & (apr_uint32_t)hi->mask);
+        } while (i <= j ? (i < k && k <= j) : (i < k || k <= j));
+        slots[i] = slots[j];
+        i = j;
+    }
+shifted:
+    for (i = 0; i <= hi->mask; i++) {
+        if (slots[i].first > pos) {
+            slots[i].first--;
+        }
+        if (slots[i].first >= 0 && slots[i].last > pos) {
+            slots[i].last--;
+        }
+    }
+    hi->count--;
+    hi->nelts--;
+}
+
+/* (Re)build the hash index if the table is (or was) large enough */
+static APR_INLINE void table_hindex_update(apr_table_t *t)
+{
+    if (t->hindex || t->a.nelts >= TABLE_HINDEX_MIN) {
+        table_hindex_build(t);
+    }
+}
+
+/* Index the (last) entry just pushed with the given key */
+static void table_hindex_add(apr_table_t *t, const char *key)
+{
+    table_hindex_t *hi = t->hindex;
+
+    if (hi && hi->nelts == t->a.nelts - 1) {
+        apr_uint32_t hash = table_key_hash(key);
+        table_hindex_slot_t *slot;
+        if ((hi->count + 1) * 2 > hi->mask + 1) {
+            table_hindex_grow(t);
+        }
+        slot = table_hindex_slot(t, key, hash);
+        if (slot->first < 0) {
+            slot->hash = hash;
+            slot->first = t->a.nelts - 1;
+            hi->count++;
+        }
+        slot->last = t->a.nelts - 1;
+        hi->nelts = t->a.nelts;
+    }
+    else {
+        table_hindex_update(t);
+    }
+}
+
+/* Find the offsets of the first and last entries which may match the key,
+ * from the hash index if valid (then they do match), or from the first
+ * byte index's (initialized) bucket otherwise.  Returns zero if the hash
+ * index tells that no entry matches.
+ */
+static APR_INLINE int table_find_range(const apr_table_t *t,
+                                       const char *key, int hash,
+                                       int *first, int *last)
+{
+    if (TABLE_HINDEX_IS_VALID(t)) {
+        const table_hindex_slot_t *slot;
+        slot = table_hindex_slot(t, key, table_key_hash(key));
+        if (slot->first < 0) {
+            return 0;
+        }
+        *first = slot->first;
+        *last = slot->last;
+    }
+    else {
+        *first = t->index_first[hash];
+        *last = t->index_last[hash];
+    }
+    return 1;
+}
+
 APR_DECLARE(const apr_array_header_t *) apr_table_elts(const apr_table_t *t)
 {
     return (const apr_array_header_t *)t;
@@ -406,6 +632,7 @@ APR_DECLARE(apr_table_t *) apr_table_make(apr_pool_t *p, int nelts)
     t->creator = __builtin_return_address(0);
 #endif
     t->index_initialized = 0;
+    t->hindex = NULL;
     return t;
 }
 
@@ -428,6 +655,10 @@ APR_DECLARE(apr_table_t *) apr_table_copy(apr_pool_t *p, const apr_table_t *t)
     memcpy(new->index_first, t->index_first, sizeof(int) * TABLE_HASH_SIZE);
     memcpy(new->index_last, t->index_last, sizeof(int) * TABLE_HASH_SIZE);
     new->index_initialized = t->index_initialized;
+    new->hindex = NULL;
+    if (TABLE_HINDEX_IS_VALID(t)) {
+        table_hindex_build(new);
+    }
     return new;
 }
 
@@ -445,7 +676,7 @@ APR_DECLARE(apr_table_t *) apr_table_clone(apr_pool_t *p, const apr_table_t *t)
     return new;
 }
 
-static void table_reindex(apr_table_t *t)
+static void table_reindex_first_byte(apr_table_t *t)
 {
     int i;
     int hash;
@@ -462,10 +693,19 @@ static void table_reindex(apr_table_t *t)
     }
 }
 
+static void table_reindex(apr_table_t *t)
+{
+    table_reindex_first_byte(t);
+    table_hindex_update(t);
+}
+
 APR_DECLARE(void) apr_table_clear(apr_table_t *t)
 {
     t->a.nelts = 0;
     t->index_initialized = 0;
+    if (t->hindex) {
+        table_hindex_build(t);
+    }
 }
 
 APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
@@ -473,19 +713,20 @@ APR_DECLARE(const char *) apr_table_get(const apr_table_t *t, const char *key)
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_uint32_t checksum;
-    int hash;
+    int hash, first, last;
 
     if (key == NULL) {
 	return NULL;
     }
 
     hash = TABLE_HASH(key);
-    if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
+    if (!TABLE_INDEX_IS_INITIALIZED(t, hash)
+        || !table_find_range(t, key, hash, &first, &last)) {
         return NULL;
     }
     COMPUTE_KEY_CHECKSUM(key, checksum);
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -504,7 +745,7 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
     apr_table_entry_t *end_elt;
     apr_table_entry_t *table_end;
     apr_uint32_t checksum;
-    int hash;
+    int hash, first, last;
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
@@ -513,8 +754,11 @@ APR_DECLARE(void) apr_table_set(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_find_range(t, key, hash, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
     for (; next_elt <= end_elt; next_elt++) {
@@ -567,6 +811,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_hindex_add(t, next_elt->key);
 }
 
 APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
@@ -576,7 +821,7 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
     apr_table_entry_t *end_elt;
     apr_table_entry_t *table_end;
     apr_uint32_t checksum;
-    int hash;
+    int hash, first, last;
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
@@ -585,8 +830,11 @@ APR_DECLARE(void) apr_table_setn(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_find_range(t, key, hash, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
     table_end =((apr_table_entry_t *) t->a.elts) + t->a.nelts;
 
     for (; next_elt <= end_elt; next_elt++) {
@@ -639,6 +887,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_hindex_add(t, next_elt->key);
 }
 
 APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
@@ -647,16 +896,24 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
     apr_table_entry_t *end_elt;
     apr_table_entry_t *dst_elt;
     apr_uint32_t checksum;
-    int hash;
-    int must_reindex;
+    int hash, first, last;
+    int must_reindex, hindex_removed;
 
     hash = TABLE_HASH(key);
-    if (!TABLE_INDEX_IS_INITIALIZED(t, hash)) {
+    if (!TABLE_INDEX_IS_INITIALIZED(t, hash)
+        || !table_find_range(t, key, hash, &first, &last)) {
         return;
     }
+    /* A single entry for the key is removed from the hash index directly,
+     * which is cheaper than rebuilding it.
+     */
+    hindex_removed = TABLE_HINDEX_IS_VALID(t) && first == last;
+    if (hindex_removed) {
+        table_hindex_remove(t, key, first);
+    }
     COMPUTE_KEY_CHECKSUM(key, checksum);
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
     must_reindex = 0;
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -690,7 +947,10 @@ APR_DECLARE(void) apr_table_unset(apr_table_t *t, const char *key)
             break;
         }
     }
-    if (must_reindex) {
+    if (hindex_removed) {
+        table_reindex_first_byte(t);
+    }
+    else if (must_reindex) {
         table_reindex(t);
     }
 }
@@ -701,7 +961,7 @@ APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_uint32_t checksum;
-    int hash;
+    int hash, first, last;
 
     COMPUTE_KEY_CHECKSUM(key, checksum);
     hash = TABLE_HASH(key);
@@ -710,8 +970,11 @@ APR_DECLARE(void) apr_table_merge(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_find_range(t, key, hash, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -730,6 +993,7 @@ add_new_elt:
     next_elt->key = apr_pstrdup(t->a.pool, key);
     next_elt->val = apr_pstrdup(t->a.pool, val);
     next_elt->key_checksum = checksum;
+    table_hindex_add(t, next_elt->key);
 }
 
 APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
@@ -738,7 +1002,7 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
     apr_table_entry_t *next_elt;
     apr_table_entry_t *end_elt;
     apr_uint32_t checksum;
-    int hash;
+    int hash, first, last;
 
 #if APR_POOL_DEBUG
     {
@@ -765,8 +1029,11 @@ APR_DECLARE(void) apr_table_mergen(apr_table_t *t, const char *key,
         TABLE_SET_INDEX_INITIALIZED(t, hash);
         goto add_new_elt;
     }
-    next_elt = ((apr_table_entry_t *) t->a.elts) + t->index_first[hash];;
-    end_elt = ((apr_table_entry_t *) t->a.elts) + t->index_last[hash];
+    if (!table_find_range(t, key, hash, &first, &last)) {
+        goto add_new_elt;
+    }
+    next_elt = ((apr_table_entry_t *) t->a.elts) + first;
+    end_elt = ((apr_table_entry_t *) t->a.elts) + last;
 
     for (; next_elt <= end_elt; next_elt++) {
 	if ((checksum == next_elt->key_checksum) &&
@@ -785,6 +1052,7 @@ add_new_elt:
     next_elt->key = (char *)key;
     next_elt->val = (char *)val;
     next_elt->key_checksum = checksum;
+    table_hindex_add(t, next_elt->key);
 }
 
 APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
@@ -805,6 +1073,7 @@ APR_DECLARE(void) apr_table_add(apr_table_t *t, const char *key,
     elts->key = apr_pstrdup(t->a.pool, key);
     elts->val = apr_pstrdup(t->a.pool, val);
     elts->key_checksum = checksum;
+    table_hindex_add(t, elts->key);
 }
 
 APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
@@ -838,6 +1107,7 @@ APR_DECLARE(void) apr_table_addn(apr_table_t *t, const char *key,
     elts->key = (char *)key;
     elts->val = (char *)val;
     elts->key_checksum = checksum;
+    table_hindex_add(t, elts->key);
 }
 
 APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
@@ -868,6 +1138,7 @@ APR_DECLARE(apr_table_t *) apr_table_overlay(apr_pool_t *p,
     res->a.pool = p;
     copy_array_hdr_core(&res->a, &overlay->a);
     apr_array_cat(&res->a, &base->a);
+    res->hindex = NULL;
     table_reindex(res);
     return res;
 }
@@ -970,12 +1241,12 @@ APR_DECLARE(int) apr_table_vdo(apr_table_do_callback_fn_t *comp,
         int rv = 1, i;
         if (argp) {
             /* Scan for entries that match the next key */
-            int hash = TABLE_HASH(argp);
-            if (TABLE_INDEX_IS_INITIALIZED(t, hash)) {
+            int hash = TABLE_HASH(argp), first, last;
+            if (TABLE_INDEX_IS_INITIALIZED(t, hash)
+                && table_find_range(t, argp, hash, &first, &last)) {
                 apr_uint32_t checksum;
                 COMPUTE_KEY_CHECKSUM(argp, checksum);
-                for (i = t->index_first[hash];
-                     rv && (i <= t->index_last[hash]); ++i) {
+                for (i = first; rv && (i <= last); ++i) {
                     if (elts[i].key && (checksum == elts[i].key_checksum) &&
                                         !strcasecmp(elts[i].key, argp)) {
                         rv = (*comp) (rec, elts[i].key, elts[i].val);
@@ -1215,6 +1486,7 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
         memcpy(t->index_first,s->index_first,sizeof(int) * TABLE_HASH_SIZE);
         memcpy(t->index_last, s->index_last, sizeof(int) * TABLE_HASH_SIZE);
         t->index_initialized = s->index_initialized;
+        table_hindex_update(t);
         return;
     }
 
@@ -1228,6 +1500,7 @@ static void apr_table_cat(apr_table_t *t, const apr_table_t *s)
     }
 
     t->index_initialized |= s->index_initialized;
+    table_hindex_update(t);
 }
 
 APR_DECLARE(void) apr_table_overlap(apr_table_t *a, const apr_table_t *b,
@@ -89,6 +89,8 @@ const struct testlist {
     {testdbm},
     {testqueue},
     {testreslist},
+    {testthreadpool},
+    {testioqueue},
     {testlfsabi},
     {testskiplist},
     {testsiphash},
@@ -0,0 +1,345 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* acceptperf.c
+ * This multi-acceptor benchmark runs an increasing number of threads
+ * accepting connections on the same non-blocking listening socket, while
+ * the main thread connects to it one connection at a time (waiting for
+ * the byte the acceptor writes on each).  The acceptors wait for the
+ * listener with the default pollset method in these modes:
+ *
+ *   level      a pollset per thread, level-triggered: each connection
+ *              wakes up all the threads (the thundering herd)
+ *   exclusive  a pollset per thread, with APR_POLLEXCL
+ *   edge       a pollset per thread, with APR_POLLET
+ *   oneshot    one APR_POLLSET_THREADSAFE pollset shared by the threads,
+ *              with APR_POLLONESHOT: the thread which gets the listener
+ *              accepts what is pending then re-arms it
+ *
+ * It prints the connections per second, and per connection the poll
+ * wakeups and the accepts which failed since another thread got there
+ * first.
+ *
+ * To run,
+ *
+ *   ./acceptperf [-t max threads] [-c connections]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_network_io.h"
+#include "apr_poll.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#if APR_HAS_THREADS
+
+#define DEFAULT_MAX_THREADS 8
+#define DEFAULT_CONNECTIONS 5000
+
+static int max_threads = DEFAULT_MAX_THREADS;
+static int connections = DEFAULT_CONNECTIONS;
+
+typedef enum {
+    MODE_LEVEL,
+    MODE_EXCLUSIVE,
+    MODE_EDGE,
+    MODE_ONESHOT
+} mode_e;
+
+static const char *mode_names[] = { "level", "exclusive", "edge", "oneshot" };
+
+typedef struct acceptor_t {
+    apr_pollset_t *pollset;
+    apr_pollfd_t *pfd;
+    mode_e mode;
+    volatile int *done;
+    apr_pool_t *pool;
+    /* counters */
+    long wakeups;
+    long missed;
+} acceptor_t;
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+/* Accept one connection, or all the pending ones, counting a miss if
+ * there was none.
+ */
+static void accept_pending(acceptor_t *acceptor, apr_socket_t *listener,
+                           int all)
+{
+    apr_socket_t *sock;
+    apr_size_t len;
+    apr_status_t rv;
+    int accepted = 0;
+
+    do {
+        rv = apr_socket_accept(&sock, listener, acceptor->pool);
+        if (rv == APR_SUCCESS) {
+            len = 1;
+            apr_socket_send(sock, "a", &len);
+            apr_socket_close(sock);
+            apr_pool_clear(acceptor->pool);
+            accepted++;
+        }
+        else if (!APR_STATUS_IS_EAGAIN(rv)) {
+            fail("Could not accept", rv);
+        }
+    } while (all && rv == APR_SUCCESS);
+
+    if (!accepted) {
+        acceptor->missed++;
+    }
+}
+
+static void * APR_THREAD_FUNC acceptor_thread(apr_thread_t *thd, void *data)
+{
+    acceptor_t *acceptor = data;
+    const apr_pollfd_t *descs;
+    apr_int32_t num;
+    apr_status_t rv;
+
+    while (!*acceptor->done) {
+        rv = apr_pollset_poll(acceptor->pollset, apr_time_from_msec(100),
+                              &num, &descs);
+        if (rv == APR_SUCCESS) {
+            apr_socket_t *listener = descs[0].desc.s;
+
+            acceptor->wakeups++;
+            switch (acceptor->mode) {
+            case MODE_LEVEL:
+            case MODE_EXCLUSIVE:
+                accept_pending(acceptor, listener, 0);
+                break;
+            case MODE_EDGE:
+                accept_pending(acceptor, listener, 1);
+                break;
+            case MODE_ONESHOT:
+                accept_pending(acceptor, listener, 1);
+                rv = apr_pollset_rearm(acceptor->pollset, acceptor->pfd);
+                if (rv != APR_SUCCESS) {
+                    fail("Could not re-arm the listener", rv);
+                }
+                break;
+            }
+        }
+        else if (!APR_STATUS_IS_TIMEUP(rv) && !APR_STATUS_IS_EINTR(rv)) {
+            fail("Could not poll", rv);
+        }
+    }
+
+    return NULL;
+}
+
+/* Connections per second, wakeups and missed accepts per connection */
+static int run(int nthreads, mode_e mode, double *conns_per_sec,
+               double *wakeups, double *missed, apr_pool_t *parent)
+{
+    apr_socket_t *listener, *client;
+    apr_sockaddr_t *sa;
+    apr_pollfd_t pfd;
+    apr_thread_t **threads;
+    acceptor_t *acceptors;
+    apr_pool_t *pool, *cpool;
+    apr_time_t start, end;
+    apr_status_t rv;
+    apr_size_t len;
+    char buf[1];
+    volatile int done = 0;
+    long total_wakeups = 0, total_missed = 0;
+    int i;
+
+    apr_pool_create(&pool, parent);
+
+    if ((rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, pool))
+            != APR_SUCCESS
+        || (rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM,
+                                   APR_PROTO_TCP, pool)) != APR_SUCCESS
+        || (rv = apr_socket_opt_set(listener, APR_SO_REUSEADDR, 1))
+            != APR_SUCCESS
+        || (rv = apr_socket_bind(listener, sa)) != APR_SUCCESS
+        || (rv = apr_socket_listen(listener, SOMAXCONN)) != APR_SUCCESS
+        || (rv = apr_socket_addr_get(&sa, APR_LOCAL, listener))
+            != APR_SUCCESS
+        || (rv = apr_socket_timeout_set(listener, 0)) != APR_SUCCESS) {
+        fail("Could not listen", rv);
+    }
+
+    pfd.p = pool;
+    pfd.desc_type = APR_POLL_SOCKET;
+    pfd.desc.s = listener;
+    pfd.reqevents = APR_POLLIN;
+    pfd.client_data = NULL;
+    if (mode == MODE_EXCLUSIVE) {
+        pfd.reqevents |= APR_POLLEXCL;
+    }
+    else if (mode == MODE_EDGE) {
+        pfd.reqevents |= APR_POLLET;
+    }
+    else if (mode == MODE_ONESHOT) {
+        pfd.reqevents |= APR_POLLONESHOT;
+    }
+
+    acceptors = apr_pcalloc(pool, nthreads * sizeof(acceptor_t));
+    threads = apr_palloc(pool, nthreads * sizeof(apr_thread_t *));
+    for (i = 0; i < nthreads; i++) {
+        acceptors[i].mode = mode;
+        acceptors[i].pfd = &pfd;
+        acceptors[i].done = &done;
+        apr_pool_create(&acceptors[i].pool, pool);
+        if (mode == MODE_ONESHOT && i > 0) {
+            acceptors[i].pollset = acceptors[0].pollset;
+            continue;
+        }
+        rv = apr_pollset_create(&acceptors[i].pollset, 1, pool,
+                                mode == MODE_ONESHOT
+                                    ? APR_POLLSET_THREADSAFE : 0);
+        if (rv == APR_SUCCESS) {
+            rv = apr_pollset_add(acceptors[i].pollset, &pfd);
+        }
+        if (rv == APR_ENOTIMPL) {
+            apr_pool_destroy(pool);
+            return 0;
+        }
+        if (rv != APR_SUCCESS) {
+            fail("Could not set up the pollset", rv);
+        }
+    }
+
+    for (i = 0; i < nthreads; i++) {
+        rv = apr_thread_create(&threads[i], NULL, acceptor_thread,
+                               &acceptors[i], pool);
+        if (rv != APR_SUCCESS) {
+            fail("Could not create an acceptor thread", rv);
+        }
+    }
+
+    apr_pool_create(&cpool, pool);
+    start = apr_time_now();
+    for (i = 0; i < connections; i++) {
+        if ((rv = apr_socket_create(&client, APR_INET, SOCK_STREAM,
+                                    APR_PROTO_TCP, cpool)) != APR_SUCCESS
+            || (rv = apr_socket_connect(client, sa)) != APR_SUCCESS) {
+            fail("Could not connect", rv);
+        }
+        len = 1;
+        if ((rv = apr_socket_recv(client, buf, &len)) != APR_SUCCESS) {
+            fail("Could not receive", rv);
+        }
+        apr_socket_close(client);
+        apr_pool_clear(cpool);
+    }
+    end = apr_time_now();
+
+    done = 1;
+    for (i = 0; i < nthreads; i++) {
+        apr_thread_join(&rv, threads[i]);
+        total_wakeups += acceptors[i].wakeups;
+        total_missed += acceptors[i].missed;
+    }
+    apr_pool_destroy(pool);
+
+    *conns_per_sec = (double)connections * APR_USEC_PER_SEC
+                     / (end > start ? end - start : 1);
+    *wakeups = (double)total_wakeups / connections;
+    *missed = (double)total_missed / connections;
+    return 1;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    double conns_per_sec, wakeups, missed;
+    int n, m;
+
+    printf("APR Multi-Acceptor Wakeup Test\n"
+           "==============================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "c:t:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'c') {
+            connections = atoi(optarg);
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (max_threads < 1 || connections < 1) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    printf("\n%s pollset method, %d connections per run\n\n",
+           apr_poll_method_defname(), connections);
+    printf("%-10s %7s %12s %14s %14s\n", "mode", "threads", "conns/s",
+           "wakeups/conn", "missed/conn");
+
+    for (m = MODE_LEVEL; m <= MODE_ONESHOT; m++) {
+        for (n = 1; n <= max_threads; n *= 2) {
+            if (run(n, m, &conns_per_sec, &wakeups, &missed, pool)) {
+                printf("%-10s %7d %12.0f %14.2f %14.2f\n", mode_names[m], n,
+                       conns_per_sec, wakeups, missed);
+            }
+            else {
+                printf("%-10s %7d %12s\n", mode_names[m], n, "n/a");
+            }
+            fflush(stdout);
+        }
+    }
+
+    return 0;
+}
+
+#else /* !APR_HAS_THREADS */
+
+int main(void)
+{
+    fprintf(stderr, "This test requires APR thread support.\n");
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
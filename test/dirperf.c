@@ -0,0 +1,281 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* dirperf.c
+ * This benchmark scans a synthetic tree of files spread over a number of
+ * directories, in these modes:
+ *
+ *   path stat  apr_dir_read() for the names, then apr_stat() of each
+ *              entry's full path, which is what apr_dir_read() used to do
+ *              when anything else was wanted
+ *   dir read   apr_dir_read()
+ *   batch      apr_dir_read_batch(), 256 entries at a time
+ *
+ * each asked for the names only, for the type, size and mtime, and for
+ * APR_FINFO_NORM.  It prints the entries scanned per second.  The tree is
+ * created unless it exists, and is kept with -k for the next runs.
+ *
+ * To run,
+ *
+ *   ./dirperf [-n files] [-d directories] [-k]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_file_info.h"
+#include "apr_file_io.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+
+#define DEFAULT_FILES 100000
+#define DEFAULT_DIRS 10
+#define BATCH_SIZE 256
+#define TREE_NAME "data/dirperf"
+
+static int files = DEFAULT_FILES;
+static int dirs = DEFAULT_DIRS;
+
+typedef enum {
+    MODE_PATH_STAT,
+    MODE_DIR_READ,
+    MODE_BATCH
+} mode_e;
+
+static const char *mode_names[] = {
+    "path stat", "dir read", "batch"
+};
+
+static const struct {
+    apr_int32_t wanted;
+    const char *name;
+} wanteds[] = {
+    { APR_FINFO_NAME, "name" },
+    { APR_FINFO_NAME | APR_FINFO_TYPE | APR_FINFO_SIZE | APR_FINFO_MTIME,
+      "type+size+mtime" },
+    { APR_FINFO_NAME | APR_FINFO_NORM, "norm" }
+};
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+static const char *dir_name(int d, apr_pool_t *pool)
+{
+    return apr_psprintf(pool, TREE_NAME "/dir%d", d);
+}
+
+static const char *file_name(int d, int f, apr_pool_t *pool)
+{
+    return apr_psprintf(pool, TREE_NAME "/dir%d/file%d", d, f);
+}
+
+/* Whether the tree was created */
+static int make_tree(apr_pool_t *parent)
+{
+    apr_file_t *file;
+    apr_finfo_t finfo;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    int d, f;
+
+    if (apr_stat(&finfo, TREE_NAME, APR_FINFO_TYPE, parent) == APR_SUCCESS) {
+        return 0;
+    }
+
+    apr_pool_create(&pool, parent);
+    for (d = 0; d < dirs; d++) {
+        if ((rv = apr_dir_make_recursive(dir_name(d, pool),
+                                         APR_FPROT_OS_DEFAULT, pool))
+                != APR_SUCCESS) {
+            fail("Could not create a directory", rv);
+        }
+        for (f = d; f < files; f += dirs) {
+            if ((rv = apr_file_open(&file, file_name(d, f, pool),
+                                    APR_FOPEN_WRITE | APR_FOPEN_CREATE,
+                                    APR_FPROT_OS_DEFAULT, pool))
+                    != APR_SUCCESS
+                || (rv = apr_file_close(file)) != APR_SUCCESS) {
+                fail("Could not create a file", rv);
+            }
+        }
+        apr_pool_clear(pool);
+    }
+    apr_pool_destroy(pool);
+    return 1;
+}
+
+static void remove_tree(apr_pool_t *parent)
+{
+    apr_pool_t *pool;
+    int d, f;
+
+    apr_pool_create(&pool, parent);
+    for (d = 0; d < dirs; d++) {
+        for (f = d; f < files; f += dirs) {
+            apr_file_remove(file_name(d, f, pool), pool);
+        }
+        apr_dir_remove(dir_name(d, pool), pool);
+        apr_pool_clear(pool);
+    }
+    apr_dir_remove(TREE_NAME, pool);
+    apr_pool_destroy(pool);
+}
+
+/* Entries scanned in the directory */
+static long scan(mode_e mode, apr_int32_t wanted, const char *name,
+                 apr_pool_t *pool)
+{
+    apr_finfo_t finfos[BATCH_SIZE], finfo;
+    apr_dir_t *dir;
+    apr_size_t nelts;
+    apr_status_t rv;
+    long count = 0;
+
+    if ((rv = apr_dir_open(&dir, name, pool)) != APR_SUCCESS) {
+        fail("Could not open a directory", rv);
+    }
+
+    if (mode == MODE_BATCH) {
+        for (;;) {
+            nelts = BATCH_SIZE;
+            rv = apr_dir_read_batch(finfos, &nelts, wanted, dir);
+            if (APR_STATUS_IS_ENOENT(rv)) {
+                break;
+            }
+            if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+                fail("Could not read a directory", rv);
+            }
+            count += nelts;
+        }
+    }
+    else {
+        for (;;) {
+            rv = apr_dir_read(&finfo, mode == MODE_PATH_STAT ? APR_FINFO_NAME
+                                                             : wanted, dir);
+            if (APR_STATUS_IS_ENOENT(rv)) {
+                break;
+            }
+            if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+                fail("Could not read a directory", rv);
+            }
+            if (mode == MODE_PATH_STAT && wanted != APR_FINFO_NAME) {
+                apr_stat(&finfo, apr_pstrcat(pool, name, "/", finfo.name,
+                                             NULL),
+                         APR_FINFO_LINK | wanted, pool);
+            }
+            count++;
+        }
+    }
+
+    apr_dir_close(dir);
+    return count;
+}
+
+/* Entries per second */
+static double run(mode_e mode, apr_int32_t wanted, apr_pool_t *parent)
+{
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    long count = 0;
+    int d;
+
+    apr_pool_create(&pool, parent);
+
+    start = apr_time_now();
+    for (d = 0; d < dirs; d++) {
+        count += scan(mode, wanted, dir_name(d, pool), pool);
+        apr_pool_clear(pool);
+    }
+    end = apr_time_now();
+
+    apr_pool_destroy(pool);
+
+    return (double)count * APR_USEC_PER_SEC / (end > start ? end - start : 1);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int created, keep = 0, m, w;
+
+    printf("APR Directory Scan Test\n"
+           "=======================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "d:kn:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'd') {
+            dirs = atoi(optarg);
+        }
+        else if (optchar == 'k') {
+            keep = 1;
+        }
+        else if (optchar == 'n') {
+            files = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (files < 1 || dirs < 1) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    created = make_tree(pool);
+
+    printf("\n%s: %d files in %d directories%s\n\n", TREE_NAME, files, dirs,
+           created ? "" : " (existing)");
+    printf("%-10s %-16s %14s\n", "mode", "wanted", "entries/s");
+
+    for (w = 0; w < sizeof(wanteds) / sizeof(wanteds[0]); w++) {
+        for (m = MODE_PATH_STAT; m <= MODE_BATCH; m++) {
+            printf("%-10s %-16s %14.0f\n", mode_names[m], wanteds[w].name,
+                   run(m, wanteds[w].wanted, pool));
+            fflush(stdout);
+        }
+    }
+
+    if (!keep) {
+        remove_tree(pool);
+    }
+    return 0;
+}
@@ -0,0 +1,269 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* dirwalkperf.c
+ * This benchmark walks a synthetic tree of files, two levels of
+ * directories with the files spread over the leaves, asking for the size
+ * and mtime of each entry:
+ *
+ *   recursive  a recursion over apr_dir_open() and apr_dir_read(), as
+ *              users of APR write it
+ *   walk       apr_dir_walk() in the calling thread
+ *   parallel   apr_dir_walk() with a thread pool of 1, 2, 4... threads
+ *
+ * It prints the entries walked per second.  The tree is created unless it
+ * exists, and is kept with -k for the next runs; to measure with a cold
+ * cache drop it before each run, which is where a storage with deep queues
+ * (NVMe, network filesystems) benefits from walking in parallel.
+ *
+ * To run,
+ *
+ *   ./dirwalkperf [-n files] [-d directories per level] [-t threads] [-k]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_atomic.h"
+#include "apr_errno.h"
+#include "apr_file_info.h"
+#include "apr_file_io.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include "apr_thread_pool.h"
+#include "apr_time.h"
+
+#if APR_HAS_THREADS
+
+#define DEFAULT_FILES 1000000
+#define DEFAULT_DIRS 32
+#define DEFAULT_THREADS 8
+#define TREE_NAME "data/dirwalkperf"
+#define WANTED (APR_FINFO_SIZE | APR_FINFO_MTIME)
+
+static int files = DEFAULT_FILES;
+static int dirs = DEFAULT_DIRS;
+static int max_threads = DEFAULT_THREADS;
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+/* Whether the tree was created */
+static int make_tree(apr_pool_t *parent)
+{
+    apr_file_t *file;
+    apr_finfo_t finfo;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    const char *dir;
+    int leaves = dirs * dirs, d, f;
+
+    if (apr_stat(&finfo, TREE_NAME, APR_FINFO_TYPE, parent) == APR_SUCCESS) {
+        return 0;
+    }
+
+    apr_pool_create(&pool, parent);
+    for (d = 0; d < leaves; d++) {
+        dir = apr_psprintf(pool, TREE_NAME "/d%d/d%d", d / dirs, d % dirs);
+        if ((rv = apr_dir_make_recursive(dir, APR_FPROT_OS_DEFAULT, pool))
+                != APR_SUCCESS) {
+            fail("Could not create a directory", rv);
+        }
+        for (f = d; f < files; f += leaves) {
+            if ((rv = apr_file_open(&file,
+                                    apr_psprintf(pool, "%s/f%d", dir, f),
+                                    APR_FOPEN_WRITE | APR_FOPEN_CREATE,
+                                    APR_FPROT_OS_DEFAULT, pool))
+                    != APR_SUCCESS
+                || (rv = apr_file_close(file)) != APR_SUCCESS) {
+                fail("Could not create a file", rv);
+            }
+        }
+        apr_pool_clear(pool);
+    }
+    apr_pool_destroy(pool);
+    return 1;
+}
+
+static apr_status_t remove_entry(void *baton, const apr_finfo_t *finfo,
+                                 apr_pool_t *pool)
+{
+    if (finfo->filetype == APR_DIR) {
+        return apr_dir_remove(finfo->fname, pool);
+    }
+    return apr_file_remove(finfo->fname, pool);
+}
+
+static apr_status_t count_entry(void *baton, const apr_finfo_t *finfo,
+                                apr_pool_t *pool)
+{
+    apr_atomic_inc32(baton);
+    return APR_SUCCESS;
+}
+
+static void walk_recursive(const char *path, apr_uint32_t *count,
+                           apr_pool_t *parent)
+{
+    apr_dir_t *dir;
+    apr_finfo_t finfo;
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+    apr_pool_create(&pool, parent);
+    if ((rv = apr_dir_open(&dir, path, pool)) != APR_SUCCESS) {
+        fail("Could not open a directory", rv);
+    }
+    for (;;) {
+        rv = apr_dir_read(&finfo, WANTED | APR_FINFO_TYPE, dir);
+        if (APR_STATUS_IS_ENOENT(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS && rv != APR_INCOMPLETE) {
+            fail("Could not read a directory", rv);
+        }
+        if (!strcmp(finfo.name, ".") || !strcmp(finfo.name, "..")) {
+            continue;
+        }
+        (*count)++;
+        if (finfo.filetype == APR_DIR) {
+            walk_recursive(apr_pstrcat(pool, path, "/", finfo.name, NULL),
+                           count, pool);
+        }
+    }
+    apr_dir_close(dir);
+    apr_pool_destroy(pool);
+}
+
+/* Entries per second, with threads or -1 for the recursive walk */
+static double run(int threads, apr_pool_t *parent)
+{
+    apr_thread_pool_t *tp = NULL;
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    apr_status_t rv;
+    apr_uint32_t count = 0;
+
+    apr_pool_create(&pool, parent);
+    if (threads > 0 && (rv = apr_thread_pool_create(&tp, threads, threads,
+                                                    pool)) != APR_SUCCESS) {
+        fail("Could not create the thread pool", rv);
+    }
+
+    start = apr_time_now();
+    if (threads < 0) {
+        walk_recursive(TREE_NAME, &count, pool);
+    }
+    else if ((rv = apr_dir_walk(TREE_NAME, WANTED, APR_DIR_WALK_PREORDER,
+                                NULL, count_entry, &count, tp, 0, pool))
+             != APR_SUCCESS) {
+        fail("Could not walk the tree", rv);
+    }
+    end = apr_time_now();
+
+    if (tp) {
+        apr_thread_pool_destroy(tp);
+    }
+    apr_pool_destroy(pool);
+
+    return (double)count * APR_USEC_PER_SEC / (end > start ? end - start : 1);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int created, keep = 0, n;
+
+    printf("APR Directory Walk Test\n"
+           "=======================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "d:kn:t:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'd') {
+            dirs = atoi(optarg);
+        }
+        else if (optchar == 'k') {
+            keep = 1;
+        }
+        else if (optchar == 'n') {
+            files = atoi(optarg);
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (files < 1 || dirs < 1 || max_threads < 1) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    created = make_tree(pool);
+
+    printf("\n%s: %d files in %d directories%s\n\n", TREE_NAME, files,
+           dirs * dirs, created ? "" : " (existing)");
+    printf("%-10s %7s %14s\n", "mode", "threads", "entries/s");
+
+    printf("%-10s %7d %14.0f\n", "recursive", 1, run(-1, pool));
+    printf("%-10s %7d %14.0f\n", "walk", 1, run(0, pool));
+    fflush(stdout);
+    for (n = 1; n <= max_threads; n *= 2) {
+        printf("%-10s %7d %14.0f\n", "parallel", n, run(n, pool));
+        fflush(stdout);
+    }
+
+    if (!keep) {
+        apr_dir_walk(TREE_NAME, 0, APR_DIR_WALK_POSTORDER, NULL,
+                     remove_entry, NULL, NULL, 0, pool);
+        apr_dir_remove(TREE_NAME, pool);
+    }
+    return 0;
+}
+
+#else /* !APR_HAS_THREADS */
+
+int main(void)
+{
+    fprintf(stderr, "This test requires APR thread support.\n");
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -17,16 +17,35 @@
 /* Simple echo daemon, designed to be used for network throughput
  * benchmarks. The aim is to allow us to monitor changes in performance
  * of APR networking code, nothing more.
+ *
+ * With -q, the connections are served concurrently by an apr_ioqueue_t
+ * (io_uring on Linux) rather than one after the other with blocking
+ * calls.
+ *
+ * To run,
+ *
+ *   ./echod [-q] [port]
  */
 
 #include <stdio.h>
 #include <stdlib.h>  /* for atexit() */
+#include <string.h>
 
 #include "apr.h"
 #include "apr_network_io.h"
+#include "apr_ioqueue.h"
 #include "apr_strings.h"
 
 #define BUF_SIZE 4096
+#define MAX_CONNS 256
+
+typedef struct echoConn {
+    apr_pool_t *pool;
+    apr_socket_t *socket;
+    char buf[BUF_SIZE];
+    apr_size_t len;
+    apr_size_t sent;
+} echoConn;
 
 static void reportError(const char *msg, apr_status_t rv,
                         apr_pool_t *pool)
@@ -64,7 +83,107 @@ static apr_status_t talkTalk(apr_socket_t *socket, apr_pool_t *parent)
     return APR_SUCCESS;
 }
 
-static apr_status_t glassToWall(apr_port_t port, apr_pool_t *parent)
+static apr_status_t acceptNext(apr_ioqueue_t *ioqueue, apr_socket_t *listener,
+                               apr_pool_t *parent)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+
+    if ((rv = apr_pool_create(&pool, parent)) != APR_SUCCESS)
+        return rv;
+    rv = apr_ioqueue_submit_accept(ioqueue, listener, pool, pool);
+    if (rv != APR_SUCCESS)
+        apr_pool_destroy(pool);
+    return rv;
+}
+
+/* Each connection has a receive or a send in flight, and the listener
+ * an accept.
+ */
+static apr_status_t ioqueueEcho(apr_socket_t *listener, apr_pool_t *parent)
+{
+    apr_ioqueue_t *ioqueue;
+    apr_ioqueue_completion_t done[MAX_CONNS];
+    apr_int32_t i, num;
+    apr_status_t rv;
+
+    rv = apr_ioqueue_create(&ioqueue, MAX_CONNS + 1, parent, 0);
+    if (rv != APR_SUCCESS) {
+        reportError("Unable to create the ioqueue", rv, parent);
+        return rv;
+    }
+    printf("\tUsing the %s ioqueue\n", apr_ioqueue_method_name(ioqueue));
+
+    rv = acceptNext(ioqueue, listener, parent);
+    while (rv == APR_SUCCESS) {
+        rv = apr_ioqueue_reap(ioqueue, -1, done, MAX_CONNS, &num);
+        if (APR_STATUS_IS_EINTR(rv)) {
+            rv = APR_SUCCESS;
+            continue;
+        }
+        for (i = 0; i < num && rv == APR_SUCCESS; i++) {
+            echoConn *conn = done[i].baton;
+
+            switch (done[i].op) {
+            case APR_IOQUEUE_ACCEPT:
+                if (done[i].status != APR_SUCCESS) {
+                    reportError("Error accepting on socket", done[i].status,
+                                parent);
+                    return done[i].status;
+                }
+                conn = apr_palloc(done[i].baton, sizeof(*conn));
+                conn->pool = done[i].baton;
+                conn->socket = done[i].accepted;
+                printf("\tAnswering connection\n");
+                rv = apr_ioqueue_submit_recv(ioqueue, conn->socket, conn->buf,
+                                             BUF_SIZE, conn);
+                if (rv == APR_SUCCESS) {
+                    rv = acceptNext(ioqueue, listener, parent);
+                }
+                break;
+            case APR_IOQUEUE_RECV:
+                if (done[i].status != APR_SUCCESS || done[i].len == 0) {
+                    apr_socket_close(conn->socket);
+                    apr_pool_destroy(conn->pool);
+                    printf("\tConnection closed\n");
+                    break;
+                }
+                conn->len = done[i].len;
+                conn->sent = 0;
+                rv = apr_ioqueue_submit_send(ioqueue, conn->socket, conn->buf,
+                                             conn->len, conn);
+                break;
+            case APR_IOQUEUE_SEND:
+                if (done[i].status != APR_SUCCESS) {
+                    apr_socket_close(conn->socket);
+                    apr_pool_destroy(conn->pool);
+                    printf("\tConnection closed\n");
+                    break;
+                }
+                conn->sent += done[i].len;
+                if (conn->sent < conn->len) {
+                    rv = apr_ioqueue_submit_send(ioqueue, conn->socket,
+                                                 conn->buf + conn->sent,
+                                                 conn->len - conn->sent,
+                                                 conn);
+                }
+                else {
+                    rv = apr_ioqueue_submit_recv(ioqueue, conn->socket,
+                                                 conn->buf, BUF_SIZE, conn);
+                }
+                break;
+            default:
+                break;
+            }
+        }
+    }
+
+    reportError("Error serving the connections", rv, parent);
+    return rv;
+}
+
+static apr_status_t glassToWall(apr_port_t port, int useIoqueue,
+                                apr_pool_t *parent)
 {
     apr_sockaddr_t *sockAddr;
     apr_socket_t *listener, *accepted;
@@ -92,6 +211,12 @@ static apr_status_t glassToWall(apr_port_t port, apr_pool_t *parent)
         return rv;
     }
 
+    if (useIoqueue) {
+        rv = ioqueueEcho(listener, parent);
+        apr_socket_close(listener);
+        return rv;
+    }
+
     for (;;) {
         rv = apr_socket_accept(&accepted, listener, parent);
         if (rv != APR_SUCCESS) {
@@ -114,6 +239,7 @@ int main(int argc, char **argv)
 {
     apr_pool_t *pool;
     apr_port_t theport = 4747;
+    int useIoqueue = 0;
 
     printf("APR Test Application: echod\n");
 
@@ -122,13 +248,18 @@ int main(int argc, char **argv)
 
     apr_pool_create(&pool, NULL);
 
+    if (argc >= 2 && !strcmp(argv[1], "-q")) {
+        useIoqueue = 1;
+        argc--;
+        argv++;
+    }
     if (argc >= 2) {
         printf("argc = %d, port = '%s'\n", argc, argv[1]);
         theport = atoi(argv[1]);
     }
 
     fprintf(stdout, "Starting to listen on port %d\n", theport);
-    glassToWall(theport, pool);
+    glassToWall(theport, useIoqueue, pool);
 
     return 0;
 }
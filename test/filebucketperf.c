@@ -0,0 +1,342 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* filebucketperf.c
+ * This benchmark streams a large file through brigades of file buckets,
+ * from threads sharing the same apr_file_t and each reading their own
+ * part of the file, in these modes:
+ *
+ *   seek+read  what file buckets used to do: apr_file_seek() then
+ *              apr_file_read() for each block, under a mutex since the
+ *              file position is shared
+ *   bucket     file buckets (without mmap), read with apr_file_read_at()
+ *   readahead  the same, with apr_bucket_file_enable_readahead()
+ *   mmap       file buckets with mmap (the default), for reference
+ *
+ * It prints the throughput and the system calls per megabyte (as made by
+ * each mode, mmap's page faults aside).  The file is created (and cached)
+ * unless one is given, to run with a cold cache drop it before each run.
+ *
+ * To run,
+ *
+ *   ./filebucketperf [-f file] [-m megabytes] [-b read size] [-t threads]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_buckets.h"
+#include "apr_errno.h"
+#include "apr_file_io.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#if APR_HAS_THREADS
+
+#define DEFAULT_MEGABYTES 64
+#define DEFAULT_THREADS 1
+#define DEFAULT_FILE_NAME "data/filebucketperf.dat"
+
+static const char *file_name = DEFAULT_FILE_NAME;
+static int megabytes = DEFAULT_MEGABYTES;
+static apr_size_t read_size = APR_BUCKET_BUFF_SIZE;
+static int max_threads = DEFAULT_THREADS;
+
+typedef enum {
+    MODE_SEEK_READ,
+    MODE_BUCKET,
+    MODE_READAHEAD,
+    MODE_MMAP
+} mode_e;
+
+static const char *mode_names[] = {
+    "seek+read", "bucket", "readahead", "mmap"
+};
+
+typedef struct reader_t {
+    apr_file_t *file;
+    apr_thread_mutex_t *mutex;
+    apr_off_t offset;
+    apr_off_t length;
+    mode_e mode;
+    /* counters */
+    long syscalls;
+    unsigned long sum;
+} reader_t;
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+/* Touch each page read, for mmap to fault them in */
+static void touch(reader_t *reader, const char *data, apr_size_t len)
+{
+    apr_size_t i;
+
+    for (i = 0; i < len; i += 4096) {
+        reader->sum += (unsigned char)data[i];
+    }
+}
+
+static void read_seek(reader_t *reader, apr_bucket_alloc_t *ba)
+{
+    apr_off_t offset = reader->offset, end = offset + reader->length;
+    apr_size_t len;
+    apr_status_t rv;
+    char *buf;
+
+    while (offset < end) {
+        len = end - offset > read_size ? read_size : end - offset;
+        buf = apr_bucket_alloc(len, ba);
+        apr_thread_mutex_lock(reader->mutex);
+        if ((rv = apr_file_seek(reader->file, APR_SET, &offset))
+                != APR_SUCCESS
+            || (rv = apr_file_read(reader->file, buf, &len))
+                != APR_SUCCESS) {
+            fail("Could not read", rv);
+        }
+        apr_thread_mutex_unlock(reader->mutex);
+        touch(reader, buf, len);
+        apr_bucket_free(buf);
+        reader->syscalls += 2;
+        offset += len;
+    }
+}
+
+static void read_buckets(reader_t *reader, apr_bucket_alloc_t *ba,
+                         apr_pool_t *pool)
+{
+    apr_bucket_brigade *bb = apr_brigade_create(pool, ba);
+    apr_bucket *e;
+    const char *data;
+    apr_size_t len;
+    apr_status_t rv;
+
+    apr_brigade_insert_file(bb, reader->file, reader->offset,
+                            reader->length, pool);
+    for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        if (reader->mode != MODE_MMAP) {
+            apr_bucket_file_enable_mmap(e, 0);
+            apr_bucket_file_set_buf_size(e, read_size);
+        }
+        if (reader->mode == MODE_READAHEAD) {
+            apr_bucket_file_enable_readahead(e, 1);
+            reader->syscalls++;
+        }
+    }
+
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        e = APR_BRIGADE_FIRST(bb);
+        if (APR_BUCKET_IS_FILE(e) && reader->mode != MODE_MMAP) {
+            reader->syscalls++;
+        }
+        rv = apr_bucket_read(e, &data, &len, APR_BLOCK_READ);
+        if (rv != APR_SUCCESS) {
+            fail("Could not read a bucket", rv);
+        }
+        touch(reader, data, len);
+        apr_bucket_delete(e);
+    }
+    apr_brigade_destroy(bb);
+}
+
+static void * APR_THREAD_FUNC reader_thread(apr_thread_t *thd, void *data)
+{
+    reader_t *reader = data;
+    apr_bucket_alloc_t *ba;
+    apr_pool_t *pool;
+
+    apr_pool_create(&pool, NULL);
+    ba = apr_bucket_alloc_create(pool);
+
+    if (reader->mode == MODE_SEEK_READ) {
+        read_seek(reader, ba);
+    }
+    else {
+        read_buckets(reader, ba, pool);
+    }
+
+    apr_pool_destroy(pool);
+    return NULL;
+}
+
+/* Megabytes per second, and system calls per megabyte */
+static void run(mode_e mode, int nthreads, apr_off_t size, double *mbps,
+                double *syscalls, apr_pool_t *parent)
+{
+    reader_t *readers;
+    apr_thread_t **threads;
+    apr_thread_mutex_t *mutex;
+    apr_file_t *file;
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    apr_status_t rv;
+    apr_off_t part;
+    long total = 0;
+    int i;
+
+    apr_pool_create(&pool, parent);
+
+    /* One file shared by the threads */
+    rv = apr_file_open(&file, file_name, APR_FOPEN_READ | APR_FOPEN_XTHREAD,
+                       APR_FPROT_OS_DEFAULT, pool);
+    if (rv != APR_SUCCESS) {
+        fail("Could not open the file", rv);
+    }
+    apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+
+    readers = apr_pcalloc(pool, nthreads * sizeof(reader_t));
+    threads = apr_palloc(pool, nthreads * sizeof(apr_thread_t *));
+    part = size / nthreads;
+
+    start = apr_time_now();
+    for (i = 0; i < nthreads; i++) {
+        readers[i].file = file;
+        readers[i].mutex = mutex;
+        readers[i].mode = mode;
+        readers[i].offset = part * i;
+        readers[i].length = (i == nthreads - 1) ? size - part * i : part;
+        rv = apr_thread_create(&threads[i], NULL, reader_thread,
+                               &readers[i], pool);
+        if (rv != APR_SUCCESS) {
+            fail("Could not create a reader thread", rv);
+        }
+    }
+    for (i = 0; i < nthreads; i++) {
+        apr_thread_join(&rv, threads[i]);
+        total += readers[i].syscalls;
+    }
+    end = apr_time_now();
+
+    apr_pool_destroy(pool);
+
+    *mbps = (double)size / (1024 * 1024) * APR_USEC_PER_SEC
+            / (end > start ? end - start : 1);
+    *syscalls = (double)total / ((double)size / (1024 * 1024));
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    apr_finfo_t finfo;
+    char optchar;
+    const char *optarg;
+    double mbps, syscalls;
+    int default_file = 1, created = 0, n, m;
+
+    printf("APR File Bucket Read Test\n"
+           "=========================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "b:f:m:t:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'b') {
+            read_size = atoi(optarg);
+        }
+        else if (optchar == 'f') {
+            file_name = optarg;
+            default_file = 0;
+        }
+        else if (optchar == 'm') {
+            megabytes = atoi(optarg);
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (megabytes < 1 || read_size < 1 || max_threads < 1) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    if (default_file) {
+        apr_file_t *file;
+        char *data = apr_palloc(pool, 1024 * 1024);
+        int i;
+
+        for (i = 0; i < 1024 * 1024; i++) {
+            data[i] = (char)(i * 7 % 251);
+        }
+        rv = apr_file_open(&file, file_name, APR_FOPEN_WRITE
+                           | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE,
+                           APR_FPROT_OS_DEFAULT, pool);
+        for (i = 0; rv == APR_SUCCESS && i < megabytes; i++) {
+            rv = apr_file_write_full(file, data, 1024 * 1024, NULL);
+        }
+        if (rv != APR_SUCCESS || (rv = apr_file_close(file)) != APR_SUCCESS) {
+            fail("Could not write " DEFAULT_FILE_NAME, rv);
+        }
+        created = 1;
+    }
+    if ((rv = apr_stat(&finfo, file_name, APR_FINFO_SIZE, pool))
+            != APR_SUCCESS) {
+        fail("Could not stat the file", rv);
+    }
+
+    printf("\n%s, %" APR_OFF_T_FMT " bytes read by %" APR_SIZE_T_FMT
+           " bytes\n\n", file_name, finfo.size, read_size);
+    printf("%-10s %7s %12s %12s\n", "mode", "threads", "MB/s", "syscalls/MB");
+
+    for (m = MODE_SEEK_READ; m <= MODE_MMAP; m++) {
+        for (n = 1; n <= max_threads; n *= 2) {
+            run(m, n, finfo.size, &mbps, &syscalls, pool);
+            printf("%-10s %7d %12.1f %12.1f\n", mode_names[m], n, mbps,
+                   syscalls);
+            fflush(stdout);
+        }
+    }
+
+    if (created) {
+        apr_file_remove(file_name, pool);
+    }
+    return 0;
+}
+
+#else /* !APR_HAS_THREADS */
+
+int main(void)
+{
+    fprintf(stderr, "This test requires APR thread support.\n");
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -0,0 +1,368 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* ioqueueperf.c
+ * This echo server benchmark opens an increasing number of loopback TCP
+ * connections, then repeatedly sends a message on each of them and waits
+ * for all the echoes.  The server side is run like echod does, with a
+ * thread per connection and blocking calls, and like echod -q does, with
+ * one thread and an apr_ioqueue_t, for each method available (io_uring
+ * and the thread pool emulation).
+ *
+ * It prints the round trips per second.
+ *
+ * To run,
+ *
+ *   ./ioqueueperf [-n max connections] [-s message size] [-m messages]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_ioqueue.h"
+#include "apr_network_io.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#if APR_HAS_THREADS
+
+#define DEFAULT_MAX_CONNS 256
+#define DEFAULT_SIZE 64
+#define DEFAULT_MESSAGES 20000
+#define BUF_SIZE 4096
+
+static int max_conns = DEFAULT_MAX_CONNS;
+static int msg_size = DEFAULT_SIZE;
+static int messages = DEFAULT_MESSAGES;
+
+typedef struct echo_conn_t {
+    apr_socket_t *client;
+    apr_socket_t *server;
+    char buf[BUF_SIZE];
+    apr_size_t len;
+    apr_size_t sent;
+} echo_conn_t;
+
+typedef struct echo_server_t {
+    echo_conn_t *conns;
+    int nconns;
+    apr_ioqueue_method_e method;
+    apr_status_t rv;
+} echo_server_t;
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+static echo_conn_t *open_connections(int n, apr_pool_t *pool)
+{
+    apr_socket_t *listener;
+    apr_sockaddr_t *sa;
+    echo_conn_t *conns;
+    apr_status_t rv;
+    int i;
+
+    conns = apr_pcalloc(pool, n * sizeof(echo_conn_t));
+
+    if ((rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, pool))
+            != APR_SUCCESS
+        || (rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM,
+                                   APR_PROTO_TCP, pool)) != APR_SUCCESS
+        || (rv = apr_socket_opt_set(listener, APR_SO_REUSEADDR, 1))
+            != APR_SUCCESS
+        || (rv = apr_socket_bind(listener, sa)) != APR_SUCCESS
+        || (rv = apr_socket_listen(listener, SOMAXCONN)) != APR_SUCCESS
+        || (rv = apr_socket_addr_get(&sa, APR_LOCAL, listener))
+            != APR_SUCCESS) {
+        fail("Could not listen", rv);
+    }
+
+    for (i = 0; i < n; i++) {
+        if ((rv = apr_socket_create(&conns[i].client, APR_INET, SOCK_STREAM,
+                                    APR_PROTO_TCP, pool)) != APR_SUCCESS
+            || (rv = apr_socket_opt_set(conns[i].client, APR_TCP_NODELAY, 1))
+                != APR_SUCCESS
+            || (rv = apr_socket_connect(conns[i].client, sa)) != APR_SUCCESS
+            || (rv = apr_socket_accept(&conns[i].server, listener, pool))
+                != APR_SUCCESS
+            || (rv = apr_socket_opt_set(conns[i].server, APR_TCP_NODELAY, 1))
+                != APR_SUCCESS) {
+            fail("Could not connect", rv);
+        }
+    }
+
+    apr_socket_close(listener);
+    return conns;
+}
+
+/* echod's loop */
+static void * APR_THREAD_FUNC blocking_server(apr_thread_t *thd, void *data)
+{
+    echo_conn_t *conn = data;
+    apr_size_t len;
+    apr_status_t rv;
+
+    for (;;) {
+        len = BUF_SIZE;
+        rv = apr_socket_recv(conn->server, conn->buf, &len);
+        if (rv != APR_SUCCESS || len == 0)
+            break;
+        rv = apr_socket_send(conn->server, conn->buf, &len);
+        if (rv != APR_SUCCESS || len == 0)
+            break;
+    }
+
+    return NULL;
+}
+
+/* echod -q's loop */
+static void * APR_THREAD_FUNC ioqueue_server(apr_thread_t *thd, void *data)
+{
+    echo_server_t *server = data;
+    apr_ioqueue_completion_t *done;
+    apr_ioqueue_t *ioqueue;
+    apr_pool_t *pool;
+    apr_int32_t i, num;
+    apr_status_t rv;
+    int open;
+
+    apr_pool_create(&pool, NULL);
+    done = apr_palloc(pool, server->nconns * sizeof(*done));
+
+    rv = apr_ioqueue_create_ex(&ioqueue, server->nconns, pool,
+                               APR_IOQUEUE_NODEFAULT, server->method);
+    for (i = 0; i < server->nconns && rv == APR_SUCCESS; i++) {
+        echo_conn_t *conn = &server->conns[i];
+
+        rv = apr_ioqueue_submit_recv(ioqueue, conn->server, conn->buf,
+                                     BUF_SIZE, conn);
+    }
+
+    for (open = server->nconns; open && rv == APR_SUCCESS; ) {
+        rv = apr_ioqueue_reap(ioqueue, -1, done, server->nconns, &num);
+        for (i = 0; i < num && rv == APR_SUCCESS; i++) {
+            echo_conn_t *conn = done[i].baton;
+
+            if (done[i].status != APR_SUCCESS || done[i].len == 0) {
+                open--;
+            }
+            else if (done[i].op == APR_IOQUEUE_RECV) {
+                conn->len = done[i].len;
+                conn->sent = 0;
+                rv = apr_ioqueue_submit_send(ioqueue, conn->server,
+                                             conn->buf, conn->len, conn);
+            }
+            else if ((conn->sent += done[i].len) < conn->len) {
+                rv = apr_ioqueue_submit_send(ioqueue, conn->server,
+                                             conn->buf + conn->sent,
+                                             conn->len - conn->sent, conn);
+            }
+            else {
+                rv = apr_ioqueue_submit_recv(ioqueue, conn->server,
+                                             conn->buf, BUF_SIZE, conn);
+            }
+        }
+    }
+
+    server->rv = rv;
+    apr_pool_destroy(pool);
+    return NULL;
+}
+
+/* Checked once, destroying an io_uring queue in the client's thread could
+ * interrupt its next blocking call.
+ */
+static int available(apr_ioqueue_method_e method, apr_pool_t *pool)
+{
+    apr_ioqueue_t *ioqueue;
+
+    return apr_ioqueue_create_ex(&ioqueue, 1, pool, APR_IOQUEUE_NODEFAULT,
+                                 method) == APR_SUCCESS;
+}
+
+/* Round trips per second */
+static double run(int nconns, const char *method, apr_pool_t *parent)
+{
+    apr_thread_t **threads;
+    echo_server_t server;
+    echo_conn_t *conns;
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    apr_status_t rv;
+    apr_size_t len, got;
+    char *msg, *buf;
+    int blocking = !strcmp(method, "blocking");
+    int nthreads = blocking ? nconns : 1;
+    int rounds = messages / nconns, i, r;
+
+    if (rounds < 1) {
+        rounds = 1;
+    }
+
+    server.method = !strcmp(method, "io_uring") ? APR_IOQUEUE_IOURING
+                                                : APR_IOQUEUE_THREAD;
+
+    apr_pool_create(&pool, parent);
+    conns = open_connections(nconns, pool);
+    msg = apr_palloc(pool, msg_size);
+    buf = apr_palloc(pool, msg_size);
+    memset(msg, 'x', msg_size);
+
+    threads = apr_palloc(pool, nthreads * sizeof(apr_thread_t *));
+    server.conns = conns;
+    server.nconns = nconns;
+    server.rv = APR_SUCCESS;
+    for (i = 0; i < nthreads; i++) {
+        rv = apr_thread_create(&threads[i], NULL,
+                               blocking ? blocking_server : ioqueue_server,
+                               blocking ? (void *)&conns[i]
+                                        : (void *)&server, pool);
+        if (rv != APR_SUCCESS) {
+            fail("Could not create the server thread", rv);
+        }
+    }
+
+    start = apr_time_now();
+    for (r = 0; r < rounds; r++) {
+        for (i = 0; i < nconns; i++) {
+            len = msg_size;
+            rv = apr_socket_send(conns[i].client, msg, &len);
+            if (rv != APR_SUCCESS || len != (apr_size_t)msg_size) {
+                fail("Could not send", rv);
+            }
+        }
+        for (i = 0; i < nconns; i++) {
+            for (got = 0; got < (apr_size_t)msg_size; got += len) {
+                len = msg_size - got;
+                rv = apr_socket_recv(conns[i].client, buf, &len);
+                if (rv != APR_SUCCESS) {
+                    fail("Could not receive", rv);
+                }
+            }
+        }
+    }
+    end = apr_time_now();
+
+    for (i = 0; i < nconns; i++) {
+        apr_socket_close(conns[i].client);
+    }
+    for (i = 0; i < nthreads; i++) {
+        apr_thread_join(&rv, threads[i]);
+    }
+    if (server.rv != APR_SUCCESS) {
+        fail("Server failed", server.rv);
+    }
+    apr_pool_destroy(pool);
+
+    return (double)rounds * nconns * APR_USEC_PER_SEC
+           / (end > start ? end - start : 1);
+}
+
+int main(int argc, const char * const *argv)
+{
+    static const char *methods[] = { "blocking", "thread", "io_uring" };
+    int has[3];
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int n, m;
+
+    printf("APR I/O Completion Queue Echo Server Test\n"
+           "=========================================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "m:n:s:v", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'm') {
+            messages = atoi(optarg);
+        }
+        else if (optchar == 'n') {
+            max_conns = atoi(optarg);
+        }
+        else if (optchar == 's') {
+            msg_size = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (max_conns < 1 || msg_size < 1 || msg_size > BUF_SIZE
+        || messages < 1) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    has[0] = 1;
+    has[1] = available(APR_IOQUEUE_THREAD, pool);
+    has[2] = available(APR_IOQUEUE_IOURING, pool);
+
+    printf("\n%d byte messages, %d messages per run\n\n", msg_size,
+           messages);
+    printf("%8s %14s %14s %14s\n", "", "round trips/s", "", "");
+    printf("%8s", "conns");
+    for (m = 0; m < 3; m++) {
+        printf(" %14s", methods[m]);
+    }
+    printf("\n");
+
+    for (n = 1; n <= max_conns; n *= 4) {
+        printf("%8d", n);
+        for (m = 0; m < 3; m++) {
+            if (has[m]) {
+                printf(" %14.0f", run(n, methods[m], pool));
+            }
+            else {
+                printf(" %14s", "n/a");
+            }
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
+
+#else /* !APR_HAS_THREADS */
+
+int main(void)
+{
+    fprintf(stderr, "This test requires APR thread support.\n");
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -14,17 +14,35 @@
  * limitations under the License.
  */
 
+/* Without arguments, the mock accepts two connections and replies to each
+ * with its version before closing it.
+ *
+ * With -p <port> [-n <servers>], it serves get, gets, set, add, replace,
+ * delete, version and quit of the memcached text protocol, and the mg, ms,
+ * md, ma and mn commands of the meta protocol, from memory, on that many
+ * consecutive ports, until killed or idle for a minute.
+ */
+
 #include <stdlib.h>
+#include <string.h>
+#include "apr_getopt.h"
+#include "apr_hash.h"
+#include "apr_lib.h"
 #include "apr_network_io.h"
+#include "apr_poll.h"
 #include "apr_pools.h"
-#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_time.h"
 #include "testmemcache.h"
 
 #define MOCK_REPLY "VERSION 1.5.22\r\n"
 
-int main(int argc, char *argv[])
+#define MOCK_MAX_SERVERS 64
+#define MOCK_BUFFER_SIZE 16384
+#define MOCK_IDLE_TIMEOUT apr_time_from_sec(60)
+
+static void version_mock(apr_pool_t *p)
 {
-    apr_pool_t *p;
     apr_sockaddr_t *sa;
     apr_socket_t *server;
     apr_socket_t *server_connection;
@@ -32,10 +50,6 @@ int main(int argc, char *argv[])
     apr_size_t length;
     int i;
 
-    apr_initialize();
-    atexit(apr_terminate);
-    apr_pool_create(&p, NULL);
-
     apr_sockaddr_info_get(&sa, MOCK_HOST, APR_UNSPEC, MOCK_PORT, 0, p);
 
     apr_socket_create(&server, sa->family, SOCK_STREAM, 0, p);
@@ -79,6 +93,661 @@ int main(int argc, char *argv[])
     apr_socket_send(server_connection, MOCK_REPLY, &length);
 
     apr_socket_close(server_connection);
+}
+
+typedef struct item_t {
+    char *key;
+    char *data;
+    apr_size_t len;
+    unsigned long flags;
+    apr_uint64_t cas;
+    apr_time_t expires;           /* 0 for never */
+} item_t;
+
+typedef struct conn_t {
+    apr_pool_t *pool;
+    apr_socket_t *sock;
+    apr_pollfd_t pfd;
+    int listening;
+    char *in;
+    apr_size_t in_size;
+    apr_size_t in_len;
+    char *out;
+    apr_size_t out_size;
+    apr_size_t out_pos;
+    apr_size_t out_len;
+} conn_t;
+
+static apr_hash_t *items;
+static apr_uint64_t last_cas;
+static apr_pollset_t *pollset;
+
+static void reserve(char **buf, apr_size_t *size, apr_size_t len,
+                    apr_size_t more)
+{
+    if (len + more > *size) {
+        while (len + more > *size) {
+            *size *= 2;
+        }
+        *buf = realloc(*buf, *size);
+        if (!*buf) {
+            exit(1);
+        }
+    }
+}
+
+static void reply(conn_t *c, const char *data, apr_size_t len)
+{
+    reserve(&c->out, &c->out_size, c->out_len, len);
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+}
+
+static void reply_str(conn_t *c, const char *str)
+{
+    reply(c, str, strlen(str));
+}
+
+/* The expiry time of a TTL in seconds */
+static apr_time_t expiry(const char *ttl)
+{
+    long sec = ttl ? atol(ttl) : 0;
+
+    return sec > 0 ? apr_time_now() + apr_time_from_sec(sec) : 0;
+}
+
+static item_t *store(const char *key, unsigned long flags, const char *data,
+                     apr_size_t len, apr_time_t expires)
+{
+    apr_size_t klen = strlen(key);
+    item_t *item, *old;
+
+    item = malloc(sizeof(item_t) + len + klen + 1);
+    if (!item) {
+        exit(1);
+    }
+    item->data = (char *)(item + 1);
+    item->key = item->data + len;
+    memcpy(item->data, data, len);
+    memcpy(item->key, key, klen + 1);
+    item->len = len;
+    item->flags = flags;
+    item->cas = ++last_cas;
+    item->expires = expires;
+
+    /* the hash keeps the old key on replace, which is freed with it */
+    old = apr_hash_get(items, key, klen);
+    apr_hash_set(items, key, klen, NULL);
+    free(old);
+    apr_hash_set(items, item->key, klen, item);
+
+    return item;
+}
+
+static int remove_item(const char *key)
+{
+    item_t *item = apr_hash_get(items, key, APR_HASH_KEY_STRING);
+
+    if (!item) {
+        return 0;
+    }
+    apr_hash_set(items, key, APR_HASH_KEY_STRING, NULL);
+    free(item);
+    return 1;
+}
+
+/* The item of the key, unless expired */
+static item_t *lookup(const char *key)
+{
+    item_t *item = apr_hash_get(items, key, APR_HASH_KEY_STRING);
+
+    if (item && item->expires && item->expires <= apr_time_now()) {
+        remove_item(key);
+        return NULL;
+    }
+    return item;
+}
+
+/* Reply the meta code with the flags asked for, and the value for VA */
+static void meta_reply(conn_t *c, const char *code, const char **flag,
+                       const char *key, item_t *item)
+{
+    char hdr[512];
+    apr_size_t n;
+    int value = !strcmp(code, "VA");
+
+    n = apr_snprintf(hdr, sizeof(hdr), "%s", code);
+    if (value) {
+        n += apr_snprintf(hdr + n, sizeof(hdr) - n, " %" APR_SIZE_T_FMT,
+                          item->len);
+    }
+    if (item && flag['f']) {
+        n += apr_snprintf(hdr + n, sizeof(hdr) - n, " f%lu", item->flags);
+    }
+    if (item && flag['c']) {
+        n += apr_snprintf(hdr + n, sizeof(hdr) - n, " c%" APR_UINT64_T_FMT,
+                          item->cas);
+    }
+    if (item && flag['s']) {
+        n += apr_snprintf(hdr + n, sizeof(hdr) - n, " s%" APR_SIZE_T_FMT,
+                          item->len);
+    }
+    if (item && flag['t']) {
+        n += apr_snprintf(hdr + n, sizeof(hdr) - n, " t%ld", item->expires
+                          ? (long)apr_time_sec(item->expires
+                                               - apr_time_now() + 999999)
+                          : -1L);
+    }
+    if (flag['k']) {
+        n += apr_snprintf(hdr + n, sizeof(hdr) - n, " k%s", key);
+    }
+    if (flag['O']) {
+        n += apr_snprintf(hdr + n, sizeof(hdr) - n, " O%s", flag['O']);
+    }
+    n += apr_snprintf(hdr + n, sizeof(hdr) - n, "\r\n");
+
+    reply(c, hdr, n);
+    if (value) {
+        reply(c, item->data, item->len);
+        reply_str(c, "\r\n");
+    }
+}
+
+/* Read the meta flags left in the command, by their letter */
+static void meta_flags(const char **flag, char **last)
+{
+    char *tok;
+
+    memset(flag, 0, 128 * sizeof(*flag));
+    while ((tok = apr_strtok(NULL, " ", last))) {
+        /* a flag is a letter, possibly followed by its token */
+        if (apr_isalpha((unsigned char)tok[0])) {
+            flag[(int)tok[0]] = tok + 1;
+        }
+    }
+}
+
+/* Serve the complete requests read, returning 0 to close the connection */
+static int serve(conn_t *c)
+{
+    apr_size_t pos = 0, len, size;
+    char *line, *eol, *cmd, *tok, *last, *key;
+    char hdr[512];
+    const char *flag[128];
+    unsigned long flags;
+    item_t *item;
+    int keep = 1;
+
+    while (keep && pos < c->in_len) {
+        line = c->in + pos;
+        eol = memchr(line, '\n', c->in_len - pos);
+        if (!eol) {
+            break;
+        }
+        len = eol + 1 - line;
+
+        cmd = malloc(len);
+        if (!cmd) {
+            exit(1);
+        }
+        memcpy(cmd, line, len - 1);
+        cmd[len - 1] = '\0';
+        if (len > 1 && cmd[len - 2] == '\r') {
+            cmd[len - 2] = '\0';
+        }
+
+        tok = apr_strtok(cmd, " ", &last);
+        if (!tok) {
+            reply_str(c, "ERROR\r\n");
+        }
+        else if (!strcmp(tok, "get") || !strcmp(tok, "gets")) {
+            while ((key = apr_strtok(NULL, " ", &last))) {
+                item = lookup(key);
+                if (item && tok[3]) {
+                    reply(c, hdr, apr_snprintf(hdr, sizeof(hdr),
+                                               "VALUE %s %lu %" APR_SIZE_T_FMT
+                                               " %" APR_UINT64_T_FMT "\r\n",
+                                               key, item->flags, item->len,
+                                               item->cas));
+                }
+                else if (item) {
+                    reply(c, hdr, apr_snprintf(hdr, sizeof(hdr),
+                                               "VALUE %s %lu %"
+                                               APR_SIZE_T_FMT "\r\n",
+                                               key, item->flags, item->len));
+                }
+                if (item) {
+                    reply(c, item->data, item->len);
+                    reply_str(c, "\r\n");
+                }
+            }
+            reply_str(c, "END\r\n");
+        }
+        else if (!strcmp(tok, "set") || !strcmp(tok, "add")
+                 || !strcmp(tok, "replace")) {
+            char *sflags, *sexp, *ssize;
+
+            key = apr_strtok(NULL, " ", &last);
+            sflags = apr_strtok(NULL, " ", &last);
+            sexp = apr_strtok(NULL, " ", &last);
+            ssize = apr_strtok(NULL, " ", &last);
+            if (!key || !sflags || !sexp || !ssize) {
+                reply_str(c, "CLIENT_ERROR bad command line format\r\n");
+                free(cmd);
+                keep = 0;
+                break;
+            }
+            flags = strtoul(sflags, NULL, 10);
+            size = (apr_size_t)strtoul(ssize, NULL, 10);
+            if (c->in_len - pos < len + size + 2) {
+                /* wait for the data */
+                free(cmd);
+                break;
+            }
+            if (memcmp(line + len + size, "\r\n", 2)) {
+                reply_str(c, "CLIENT_ERROR bad data chunk\r\n");
+                free(cmd);
+                keep = 0;
+                break;
+            }
+            item = lookup(key);
+            if ((tok[0] == 'a' && item) || (tok[0] == 'r' && !item)) {
+                reply_str(c, "NOT_STORED\r\n");
+            }
+            else {
+                store(key, flags, line + len, size, expiry(sexp));
+                reply_str(c, "STORED\r\n");
+            }
+            len += size + 2;
+        }
+        else if (!strcmp(tok, "delete")) {
+            key = apr_strtok(NULL, " ", &last);
+            if (key && lookup(key) && remove_item(key)) {
+                reply_str(c, "DELETED\r\n");
+            }
+            else {
+                reply_str(c, "NOT_FOUND\r\n");
+            }
+        }
+        else if (!strcmp(tok, "mg")) {
+            key = apr_strtok(NULL, " ", &last);
+            if (!key) {
+                reply_str(c, "CLIENT_ERROR bad command line format\r\n");
+                free(cmd);
+                keep = 0;
+                break;
+            }
+            meta_flags(flag, &last);
+            item = lookup(key);
+            if (!item) {
+                if (!flag['q']) {
+                    meta_reply(c, "EN", flag, key, NULL);
+                }
+            }
+            else {
+                if (flag['T']) {
+                    item->expires = expiry(flag['T']);
+                }
+                meta_reply(c, flag['v'] ? "VA" : "HD", flag, key, item);
+            }
+        }
+        else if (!strcmp(tok, "ms")) {
+            char *ssize, *data;
+            apr_size_t dlen;
+            int mode;
+
+            key = apr_strtok(NULL, " ", &last);
+            ssize = apr_strtok(NULL, " ", &last);
+            if (!key || !ssize) {
+                reply_str(c, "CLIENT_ERROR bad command line format\r\n");
+                free(cmd);
+                keep = 0;
+                break;
+            }
+            meta_flags(flag, &last);
+            size = (apr_size_t)strtoul(ssize, NULL, 10);
+            if (c->in_len - pos < len + size + 2) {
+                /* wait for the data */
+                free(cmd);
+                break;
+            }
+            if (memcmp(line + len + size, "\r\n", 2)) {
+                reply_str(c, "CLIENT_ERROR bad data chunk\r\n");
+                free(cmd);
+                keep = 0;
+                break;
+            }
+            mode = flag['M'] ? flag['M'][0] : 'S';
+            item = lookup(key);
+            if (flag['C'] && !item) {
+                meta_reply(c, "NF", flag, key, NULL);
+            }
+            else if (flag['C']
+                     && item->cas != apr_strtoi64(flag['C'], NULL, 10)) {
+                meta_reply(c, "EX", flag, key, NULL);
+            }
+            else if ((mode == 'E' && item) || (mode != 'S' && mode != 'E'
+                                               && !item)) {
+                meta_reply(c, "NS", flag, key, NULL);
+            }
+            else {
+                data = line + len;
+                dlen = size;
+                if (mode == 'A' || mode == 'P') {
+                    /* append or prepend */
+                    dlen += item->len;
+                    data = malloc(dlen);
+                    if (!data) {
+                        exit(1);
+                    }
+                    memcpy(data + (mode == 'A' ? 0 : size), item->data,
+                           item->len);
+                    memcpy(data + (mode == 'A' ? item->len : 0), line + len,
+                           size);
+                    flags = item->flags;
+                }
+                else {
+                    flags = flag['F'] ? strtoul(flag['F'], NULL, 10) : 0;
+                }
+                item = store(key, flags, data, dlen, expiry(flag['T']));
+                if (data != line + len) {
+                    free(data);
+                }
+                if (!flag['q']) {
+                    meta_reply(c, "HD", flag, key, item);
+                }
+            }
+            len += size + 2;
+        }
+        else if (!strcmp(tok, "md")) {
+            key = apr_strtok(NULL, " ", &last);
+            if (!key) {
+                reply_str(c, "CLIENT_ERROR bad command line format\r\n");
+                free(cmd);
+                keep = 0;
+                break;
+            }
+            meta_flags(flag, &last);
+            item = lookup(key);
+            if (item && flag['C']
+                && item->cas != apr_strtoi64(flag['C'], NULL, 10)) {
+                meta_reply(c, "EX", flag, key, NULL);
+            }
+            else if (item) {
+                remove_item(key);
+                if (!flag['q']) {
+                    meta_reply(c, "HD", flag, key, NULL);
+                }
+            }
+            else if (!flag['q']) {
+                meta_reply(c, "NF", flag, key, NULL);
+            }
+        }
+        else if (!strcmp(tok, "ma")) {
+            apr_uint64_t num, delta;
+            char *end;
+
+            key = apr_strtok(NULL, " ", &last);
+            if (!key) {
+                reply_str(c, "CLIENT_ERROR bad command line format\r\n");
+                free(cmd);
+                keep = 0;
+                break;
+            }
+            meta_flags(flag, &last);
+            item = lookup(key);
+            if (!item) {
+                if (!flag['q']) {
+                    meta_reply(c, "NF", flag, key, NULL);
+                }
+            }
+            else {
+                apr_cpystrn(hdr, item->data,
+                            item->len < sizeof(hdr) ? item->len + 1
+                                                    : sizeof(hdr));
+                num = apr_strtoi64(hdr, &end, 10);
+                if (!item->len || *end) {
+                    reply_str(c, "CLIENT_ERROR cannot increment or decrement"
+                                 " non-numeric value\r\n");
+                }
+                else {
+                    delta = flag['D'] ? apr_strtoi64(flag['D'], NULL, 10) : 1;
+                    if (flag['M'] && (flag['M'][0] == 'D'
+                                      || flag['M'][0] == '-')) {
+                        num = num > delta ? num - delta : 0;
+                    }
+                    else {
+                        num += delta;
+                    }
+                    apr_snprintf(hdr, sizeof(hdr), "%" APR_UINT64_T_FMT, num);
+                    item = store(key, item->flags, hdr, strlen(hdr),
+                                 item->expires);
+                    if (flag['v']) {
+                        meta_reply(c, "VA", flag, key, item);
+                    }
+                    else if (!flag['q']) {
+                        meta_reply(c, "HD", flag, key, item);
+                    }
+                }
+            }
+        }
+        else if (!strcmp(tok, "mn")) {
+            reply_str(c, "MN\r\n");
+        }
+        else if (!strcmp(tok, "version")) {
+            reply_str(c, MOCK_REPLY);
+        }
+        else if (!strcmp(tok, "quit")) {
+            keep = 0;
+        }
+        else {
+            reply_str(c, "ERROR\r\n");
+        }
+
+        free(cmd);
+        pos += len;
+    }
+
+    memmove(c->in, c->in + pos, c->in_len - pos);
+    c->in_len -= pos;
+
+    return keep;
+}
+
+static void update_events(conn_t *c, apr_int16_t reqevents)
+{
+    if (c->pfd.reqevents != reqevents) {
+        apr_pollset_remove(pollset, &c->pfd);
+        c->pfd.reqevents = reqevents;
+        apr_pollset_add(pollset, &c->pfd);
+    }
+}
+
+/* Write what the socket takes of the replies, returning 0 on error */
+static int flush(conn_t *c)
+{
+    apr_size_t len;
+    apr_status_t rv;
+
+    while (c->out_pos < c->out_len) {
+        len = c->out_len - c->out_pos;
+        rv = apr_socket_send(c->sock, c->out + c->out_pos, &len);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            return 0;
+        }
+        c->out_pos += len;
+    }
+    if (c->out_pos == c->out_len) {
+        c->out_pos = c->out_len = 0;
+    }
+
+    update_events(c, c->out_len ? APR_POLLIN | APR_POLLOUT : APR_POLLIN);
+    return 1;
+}
+
+static void conn_close(conn_t *c)
+{
+    apr_pollset_remove(pollset, &c->pfd);
+    apr_socket_close(c->sock);
+    free(c->in);
+    free(c->out);
+    apr_pool_destroy(c->pool);
+}
+
+static void conn_accept(conn_t *l, apr_pool_t *p)
+{
+    apr_socket_t *sock;
+    apr_pool_t *pool;
+    conn_t *c;
+
+    for (;;) {
+        apr_pool_create(&pool, p);
+        if (apr_socket_accept(&sock, l->sock, pool) != APR_SUCCESS) {
+            apr_pool_destroy(pool);
+            break;
+        }
+        apr_socket_timeout_set(sock, 0);
+        apr_socket_opt_set(sock, APR_TCP_NODELAY, 1);
+
+        c = apr_pcalloc(pool, sizeof(conn_t));
+        c->pool = pool;
+        c->sock = sock;
+        c->in_size = c->out_size = MOCK_BUFFER_SIZE;
+        c->in = malloc(c->in_size);
+        c->out = malloc(c->out_size);
+        if (!c->in || !c->out) {
+            exit(1);
+        }
+
+        c->pfd.desc_type = APR_POLL_SOCKET;
+        c->pfd.reqevents = APR_POLLIN;
+        c->pfd.desc.s = sock;
+        c->pfd.p = pool;
+        c->pfd.client_data = c;
+        apr_pollset_add(pollset, &c->pfd);
+    }
+}
+
+/* Read and serve what the connection has, returning 0 to close it */
+static int conn_read(conn_t *c)
+{
+    apr_size_t len;
+    apr_status_t rv;
+
+    for (;;) {
+        reserve(&c->in, &c->in_size, c->in_len, MOCK_BUFFER_SIZE);
+        len = c->in_size - c->in_len;
+        rv = apr_socket_recv(c->sock, c->in + c->in_len, &len);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            return 0;
+        }
+        c->in_len += len;
+    }
+
+    return serve(c) && flush(c);
+}
+
+static int server_mock(apr_pool_t *p, apr_port_t port, int servers)
+{
+    apr_sockaddr_t *sa;
+    const apr_pollfd_t *fds;
+    apr_status_t rv;
+    apr_int32_t i, n;
+    conn_t *c;
+
+    items = apr_hash_make(p);
+
+    rv = apr_pollset_create(&pollset, 1024, p, 0);
+    if (rv != APR_SUCCESS) {
+        return 1;
+    }
+
+    for (i = 0; i < servers; i++) {
+        c = apr_pcalloc(p, sizeof(conn_t));
+        c->listening = 1;
+        if (apr_sockaddr_info_get(&sa, MOCK_HOST, APR_UNSPEC,
+                                  (apr_port_t)(port + i), 0, p) != APR_SUCCESS
+            || apr_socket_create(&c->sock, sa->family, SOCK_STREAM, 0, p)
+               != APR_SUCCESS
+            || apr_socket_opt_set(c->sock, APR_SO_REUSEADDR, 1)
+               != APR_SUCCESS
+            || apr_socket_timeout_set(c->sock, 0) != APR_SUCCESS
+            || apr_socket_bind(c->sock, sa) != APR_SUCCESS
+            || apr_socket_listen(c->sock, SOMAXCONN) != APR_SUCCESS) {
+            return 1;
+        }
+
+        c->pfd.desc_type = APR_POLL_SOCKET;
+        c->pfd.reqevents = APR_POLLIN;
+        c->pfd.desc.s = c->sock;
+        c->pfd.p = p;
+        c->pfd.client_data = c;
+        apr_pollset_add(pollset, &c->pfd);
+    }
+
+    for (;;) {
+        rv = apr_pollset_poll(pollset, MOCK_IDLE_TIMEOUT, &n, &fds);
+        if (APR_STATUS_IS_EINTR(rv)) {
+            continue;
+        }
+        if (rv != APR_SUCCESS) {
+            /* idle, or the parent is gone */
+            return APR_STATUS_IS_TIMEUP(rv) ? 0 : 1;
+        }
+
+        for (i = 0; i < n; i++) {
+            c = fds[i].client_data;
+            if (c->listening) {
+                conn_accept(c, p);
+            }
+            else if (((fds[i].rtnevents & APR_POLLOUT) && !flush(c))
+                     || ((fds[i].rtnevents & (APR_POLLIN | APR_POLLHUP
+                                              | APR_POLLERR))
+                         && !conn_read(c))) {
+                conn_close(c);
+            }
+        }
+    }
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *p;
+    apr_getopt_t *opt;
+    apr_status_t rv;
+    char optchar;
+    const char *optarg;
+    int port = 0, servers = 1;
+
+    apr_initialize();
+    atexit(apr_terminate);
+    apr_pool_create(&p, NULL);
+
+    if (argc < 2) {
+        version_mock(p);
+        exit(0);
+    }
+
+    apr_getopt_init(&opt, p, argc, argv);
+    while ((rv = apr_getopt(opt, "n:p:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'n') {
+            servers = atoi(optarg);
+        }
+        else if (optchar == 'p') {
+            port = atoi(optarg);
+        }
+    }
+    if (rv != APR_EOF || port <= 0 || servers < 1
+        || servers > MOCK_MAX_SERVERS || port + servers > 65536) {
+        exit(1);
+    }
 
-    exit(0);
+    exit(server_mock(p, (apr_port_t)port, servers));
 }
@@ -0,0 +1,413 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* memcacheperf.c
+ * This benchmark sets and gets batches of keys spread over a number of
+ * memcached servers, served by memcachedmock, in these modes:
+ *
+ *   set       apr_memcache_set() of each key in turn
+ *   pipe set  apr_memcache_pipeline_set() of the batch, then one run
+ *   getp      apr_memcache_getp() of each key in turn
+ *   multgetp  apr_memcache_multgetp() of the batch
+ *   pipe get  apr_memcache_pipeline_get() of the batch, then one run
+ *
+ * It prints the keys per second of each mode for increasing batch sizes,
+ * with the text protocol or with the meta protocol given -m.  Then it
+ * reads values of increasing sizes with the text protocol's getp, and the
+ * meta protocol's getp and getb (which hands the buckets read over without
+ * copying them), printing the megabytes of values read per second.
+ *
+ * The mock is started from the current directory on the ports from 11300
+ * up, unless -p gives the first port of servers already running (such as
+ * memcached instances).
+ *
+ * To run,
+ *
+ *   ./memcacheperf [-n keys] [-s servers] [-v value size] [-p port] [-m]
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_buckets.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_hash.h"
+#include "apr_memcache.h"
+#include "apr_strings.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#define DEFAULT_KEYS 20000
+#define DEFAULT_SERVERS 12
+#define DEFAULT_VALUE_SIZE 100
+#define MOCK_HOST "localhost"
+#define MOCK_PORT 11300
+#define RUN_TIMEOUT apr_time_from_sec(10)
+#define PARSE_KEYS 16
+#define PARSE_BYTES (32 * 1024 * 1024)
+#define PARSE_MIN_GETS 2000
+
+static int nkeys = DEFAULT_KEYS;
+static int servers = DEFAULT_SERVERS;
+static int value_size = DEFAULT_VALUE_SIZE;
+
+static const int batches[] = { 1, 10, 50, 200, 1000 };
+static const int parse_sizes[] = { 64, 4096, 65536, 1024 * 1024 };
+
+typedef enum {
+    MODE_SET,
+    MODE_PIPE_SET,
+    MODE_GETP,
+    MODE_MULTGETP,
+    MODE_PIPE_GET
+} mode_e;
+
+static const char *mode_names[] = {
+    "set", "pipe set", "getp", "multgetp", "pipe get"
+};
+
+typedef enum {
+    PARSE_GETP_TEXT,
+    PARSE_GETP_META,
+    PARSE_GETB_META
+} parse_e;
+
+static const char *parse_names[] = {
+    "getp text", "getp meta", "getb meta"
+};
+
+static const char **keys;
+static char *value;
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+static void start_mock(apr_proc_t *proc, apr_port_t port, apr_pool_t *pool)
+{
+    apr_procattr_t *procattr;
+    apr_sockaddr_t *sa;
+    apr_socket_t *sock;
+    apr_status_t rv;
+    const char *args[6];
+    int i;
+
+    args[0] = "memcachedmock";
+    args[1] = "-p";
+    args[2] = apr_itoa(pool, port);
+    args[3] = "-n";
+    args[4] = apr_itoa(pool, servers);
+    args[5] = NULL;
+
+    if ((rv = apr_procattr_create(&procattr, pool)) != APR_SUCCESS
+        || (rv = apr_procattr_error_check_set(procattr, 1)) != APR_SUCCESS
+        || (rv = apr_proc_create(proc, "./memcachedmock", args, NULL,
+                                 procattr, pool)) != APR_SUCCESS
+        || (rv = apr_sockaddr_info_get(&sa, MOCK_HOST, APR_UNSPEC,
+                                       port + servers - 1, 0, pool))
+            != APR_SUCCESS) {
+        fail("Could not start memcachedmock", rv);
+    }
+
+    for (i = 0; i < 50; i++) {
+        if ((rv = apr_socket_create(&sock, sa->family, SOCK_STREAM, 0,
+                                    pool)) != APR_SUCCESS) {
+            fail("Could not create a socket", rv);
+        }
+        rv = apr_socket_connect(sock, sa);
+        apr_socket_close(sock);
+        if (rv == APR_SUCCESS) {
+            return;
+        }
+        apr_sleep(apr_time_from_msec(100));
+    }
+    fail("Could not connect to memcachedmock", rv);
+}
+
+static void run_batch(apr_memcache_t *mc, mode_e mode, int first, int n,
+                      apr_pool_t *pool)
+{
+    apr_memcache_pipeline_t *pipeline;
+    apr_hash_t *values = NULL;
+    apr_pool_t *tmppool;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t len;
+    apr_uint16_t flags;
+    char *data;
+    int i;
+
+    switch (mode) {
+    case MODE_SET:
+        for (i = first; i < first + n && rv == APR_SUCCESS; i++) {
+            rv = apr_memcache_set(mc, keys[i], value, value_size, 0, 0);
+        }
+        break;
+    case MODE_GETP:
+        for (i = first; i < first + n && rv == APR_SUCCESS; i++) {
+            rv = apr_memcache_getp(mc, pool, keys[i], &data, &len, &flags);
+        }
+        break;
+    case MODE_MULTGETP:
+        for (i = first; i < first + n; i++) {
+            apr_memcache_add_multget_key(pool, keys[i], &values);
+        }
+        apr_pool_create(&tmppool, pool);
+        rv = apr_memcache_multgetp(mc, tmppool, pool, values);
+        break;
+    case MODE_PIPE_SET:
+    case MODE_PIPE_GET:
+        apr_memcache_pipeline_create(&pipeline, mc, NULL, NULL, pool);
+        for (i = first; i < first + n; i++) {
+            if (mode == MODE_PIPE_SET) {
+                apr_memcache_pipeline_set(pipeline, keys[i], value,
+                                          value_size, 0, 0, NULL);
+            }
+            else {
+                apr_memcache_pipeline_get(pipeline, keys[i], NULL);
+            }
+        }
+        rv = apr_memcache_pipeline_run(pipeline, RUN_TIMEOUT);
+        break;
+    }
+
+    if (rv != APR_SUCCESS) {
+        fail(mode_names[mode], rv);
+    }
+}
+
+/* Keys per second */
+static double run(apr_memcache_t *mc, mode_e mode, int batch,
+                  apr_pool_t *parent)
+{
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    int i;
+
+    apr_pool_create(&pool, parent);
+
+    start = apr_time_now();
+    for (i = 0; i + batch <= nkeys; i += batch) {
+        run_batch(mc, mode, i, batch, pool);
+        apr_pool_clear(pool);
+    }
+    end = apr_time_now();
+
+    apr_pool_destroy(pool);
+
+    return (double)i * APR_USEC_PER_SEC / (end > start ? end - start : 1);
+}
+
+/* Megabytes of values read per second */
+static double run_parse(apr_memcache_t *mc, parse_e mode, apr_size_t size,
+                        apr_pool_t *parent)
+{
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    apr_pool_t *pool, *iterpool;
+    apr_time_t start, end;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t len;
+    apr_uint16_t flags;
+    char *data;
+    int n, i;
+
+    apr_pool_create(&pool, parent);
+    apr_pool_create(&iterpool, pool);
+    ba = apr_bucket_alloc_create(pool);
+    bb = apr_brigade_create(pool, ba);
+
+    n = PARSE_BYTES / size;
+    if (n < PARSE_MIN_GETS) {
+        n = PARSE_MIN_GETS;
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < n && rv == APR_SUCCESS; i++) {
+        if (mode == PARSE_GETB_META) {
+            rv = apr_memcache_getb(mc, keys[i % PARSE_KEYS], bb, &len, &flags,
+                                   NULL);
+            apr_brigade_cleanup(bb);
+        }
+        else {
+            rv = apr_memcache_getp(mc, iterpool, keys[i % PARSE_KEYS], &data,
+                                   &len, &flags);
+            apr_pool_clear(iterpool);
+        }
+    }
+    end = apr_time_now();
+
+    if (rv != APR_SUCCESS) {
+        fail(parse_names[mode], rv);
+    }
+    apr_pool_destroy(pool);
+
+    return (double)n * size / (1024 * 1024) * APR_USEC_PER_SEC
+           / (end > start ? end - start : 1);
+}
+
+static void add_servers(apr_memcache_t *mc, apr_port_t port,
+                        apr_pool_t *pool)
+{
+    apr_memcache_server_t *ms;
+    apr_status_t rv;
+    int i;
+
+    for (i = 0; i < servers; i++) {
+        if ((rv = apr_memcache_server_create(pool, MOCK_HOST, port + i,
+                                             0, 1, 1, apr_time_from_sec(60),
+                                             &ms)) != APR_SUCCESS
+            || (rv = apr_memcache_add_server(mc, ms)) != APR_SUCCESS) {
+            fail("Could not add a server", rv);
+        }
+    }
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    apr_memcache_t *mc, *text, *meta;
+    apr_proc_t proc;
+    apr_exit_why_e why;
+    char optchar;
+    const char *optarg;
+    int port = 0, use_meta = 0, exitcode, b, m, i;
+    char *big;
+
+    printf("APR Memcache Pipeline Test\n"
+           "==========================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "mn:p:s:v:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'm') {
+            use_meta = 1;
+        }
+        else if (optchar == 'n') {
+            nkeys = atoi(optarg);
+        }
+        else if (optchar == 'p') {
+            port = atoi(optarg);
+        }
+        else if (optchar == 's') {
+            servers = atoi(optarg);
+        }
+        else if (optchar == 'v') {
+            value_size = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (nkeys < PARSE_KEYS || servers < 1 || servers > 64 || value_size < 0
+        || port < 0 || port + servers > 65536) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    if (!port) {
+        start_mock(&proc, MOCK_PORT, pool);
+    }
+
+    if ((rv = apr_memcache_create(pool, servers, 0, &text)) != APR_SUCCESS
+        || (rv = apr_memcache_create(pool, servers, APR_MEMCACHE_META,
+                                     &meta)) != APR_SUCCESS) {
+        fail("Could not create the memcache", rv);
+    }
+    add_servers(text, (apr_port_t)(port ? port : MOCK_PORT), pool);
+    add_servers(meta, (apr_port_t)(port ? port : MOCK_PORT), pool);
+    mc = use_meta ? meta : text;
+
+    keys = apr_palloc(pool, nkeys * sizeof(char *));
+    for (i = 0; i < nkeys; i++) {
+        keys[i] = apr_psprintf(pool, "memcacheperf%d", i);
+    }
+    value = apr_palloc(pool, value_size + 1);
+    memset(value, 'v', value_size);
+
+    printf("\n%d keys of %d bytes over %d servers, %s protocol\n\n", nkeys,
+           value_size, servers, use_meta ? "meta" : "text");
+    printf("%-6s", "batch");
+    for (m = MODE_SET; m <= MODE_PIPE_GET; m++) {
+        printf(" %12s", mode_names[m]);
+    }
+    printf("\n");
+
+    for (b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        if (batches[b] > nkeys) {
+            break;
+        }
+        printf("%-6d", batches[b]);
+        for (m = MODE_SET; m <= MODE_PIPE_GET; m++) {
+            printf(" %12.0f", run(mc, m, batches[b], pool));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    printf("\nMB/s of values read, from %d keys\n\n", PARSE_KEYS);
+    printf("%-8s", "size");
+    for (m = PARSE_GETP_TEXT; m <= PARSE_GETB_META; m++) {
+        printf(" %12s", parse_names[m]);
+    }
+    printf("\n");
+
+    big = apr_palloc(pool, parse_sizes[sizeof(parse_sizes)
+                                       / sizeof(parse_sizes[0]) - 1]);
+    for (b = 0; b < sizeof(parse_sizes) / sizeof(parse_sizes[0]); b++) {
+        memset(big, 'v', parse_sizes[b]);
+        for (i = 0; i < PARSE_KEYS; i++) {
+            if ((rv = apr_memcache_set(text, keys[i], big, parse_sizes[b], 0,
+                                       0)) != APR_SUCCESS) {
+                fail("set", rv);
+            }
+        }
+        printf("%-8d", parse_sizes[b]);
+        for (m = PARSE_GETP_TEXT; m <= PARSE_GETB_META; m++) {
+            printf(" %12.1f", run_parse(m == PARSE_GETP_TEXT ? text : meta, m,
+                                        parse_sizes[b], pool));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    if (!port) {
+        apr_proc_kill(&proc, SIGTERM);
+        apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    }
+    return 0;
+}
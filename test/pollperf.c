@@ -0,0 +1,277 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* pollperf.c
+ * This connection scaling benchmark opens an increasing number of
+ * loopback TCP connections, then repeatedly writes a byte on a few of
+ * them, polls the server side of all of them with apr_pollset_poll()
+ * and reads the bytes, for each pollset method available (epoll and
+ * io_uring on Linux).  It is run twice, the second time removing and
+ * adding back each connection served like a server handing connections
+ * over to worker threads does.
+ *
+ * It prints the events per second and the system calls per event, as
+ * counted from the calls made: one per apr_pollset_poll() and read, and
+ * with epoll one per apr_pollset_add() or apr_pollset_remove() too (with
+ * io_uring, adds are submitted by the next poll but removes are not).
+ *
+ * To run,
+ *
+ *   ./pollperf [-n max connections] [-a active connections] [-r rounds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_network_io.h"
+#include "apr_poll.h"
+#include "apr_time.h"
+
+#define DEFAULT_MAX_CONNS 1024
+#define DEFAULT_ACTIVE 32
+#define DEFAULT_ROUNDS 2000
+
+static int max_conns = DEFAULT_MAX_CONNS;
+static int active = DEFAULT_ACTIVE;
+static int rounds = DEFAULT_ROUNDS;
+
+static apr_socket_t **clients;
+static apr_socket_t **servers;
+static apr_pollfd_t *pfds;
+
+typedef struct result_t {
+    double events_per_sec;
+    double syscalls_per_event;
+} result_t;
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+static void open_connections(int n, apr_pool_t *pool)
+{
+    apr_socket_t *listener;
+    apr_sockaddr_t *sa;
+    apr_status_t rv;
+    int i;
+
+    clients = apr_palloc(pool, n * sizeof(apr_socket_t *));
+    servers = apr_palloc(pool, n * sizeof(apr_socket_t *));
+    pfds = apr_pcalloc(pool, n * sizeof(apr_pollfd_t));
+
+    if ((rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, pool))
+            != APR_SUCCESS
+        || (rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM,
+                                   APR_PROTO_TCP, pool)) != APR_SUCCESS
+        || (rv = apr_socket_opt_set(listener, APR_SO_REUSEADDR, 1))
+            != APR_SUCCESS
+        || (rv = apr_socket_bind(listener, sa)) != APR_SUCCESS
+        || (rv = apr_socket_listen(listener, SOMAXCONN)) != APR_SUCCESS
+        || (rv = apr_socket_addr_get(&sa, APR_LOCAL, listener))
+            != APR_SUCCESS) {
+        fail("Could not listen", rv);
+    }
+
+    for (i = 0; i < n; i++) {
+        if ((rv = apr_socket_create(&clients[i], APR_INET, SOCK_STREAM,
+                                    APR_PROTO_TCP, pool)) != APR_SUCCESS
+            || (rv = apr_socket_opt_set(clients[i], APR_TCP_NODELAY, 1))
+                != APR_SUCCESS
+            || (rv = apr_socket_connect(clients[i], sa)) != APR_SUCCESS
+            || (rv = apr_socket_accept(&servers[i], listener, pool))
+                != APR_SUCCESS) {
+            fail("Could not connect", rv);
+        }
+        pfds[i].p = pool;
+        pfds[i].desc_type = APR_POLL_SOCKET;
+        pfds[i].reqevents = APR_POLLIN;
+        pfds[i].desc.s = servers[i];
+        pfds[i].client_data = &pfds[i];
+    }
+
+    apr_socket_close(listener);
+}
+
+static int run(result_t *result, int nconns, apr_pollset_method_e method,
+               int churn, apr_pool_t *pool)
+{
+    apr_pollset_t *pollset;
+    const apr_pollfd_t *descs;
+    apr_int32_t num;
+    apr_time_t start, end;
+    apr_size_t len;
+    apr_status_t rv;
+    long events = 0, syscalls = 0;
+    int add_syscalls, pending, next = 0;
+    int i, j, r;
+    char c;
+
+    if (apr_pollset_create_ex(&pollset, nconns, pool, APR_POLLSET_NODEFAULT,
+                              method) != APR_SUCCESS) {
+        return 0;
+    }
+    /* no fallback */
+    if ((method == APR_POLLSET_EPOLL
+            && strcmp(apr_pollset_method_name(pollset), "epoll"))
+        || (method == APR_POLLSET_IOURING
+            && strcmp(apr_pollset_method_name(pollset), "io_uring"))) {
+        apr_pollset_destroy(pollset);
+        return 0;
+    }
+    add_syscalls = (method == APR_POLLSET_EPOLL);
+
+    for (i = 0; i < nconns; i++) {
+        apr_pollset_add(pollset, &pfds[i]);
+    }
+
+    start = apr_time_now();
+    for (r = 0; r < rounds; r++) {
+        /* wake up the next ones, round robin */
+        for (i = 0; i < active; i++) {
+            len = 1;
+            apr_socket_send(clients[next], "x", &len);
+            next = (next + 1) % nconns;
+        }
+
+        for (pending = active; pending > 0; pending -= num) {
+            rv = apr_pollset_poll(pollset, -1, &num, &descs);
+            if (APR_STATUS_IS_EINTR(rv)) {
+                /* the teardown of the previous io_uring run */
+                num = 0;
+                continue;
+            }
+            if (rv != APR_SUCCESS) {
+                fail("Could not poll", rv);
+            }
+            syscalls++;
+            for (j = 0; j < num; j++) {
+                len = 1;
+                apr_socket_recv(descs[j].desc.s, &c, &len);
+                syscalls++;
+                if (churn) {
+                    apr_pollfd_t *pfd = descs[j].client_data;
+
+                    apr_pollset_remove(pollset, pfd);
+                    apr_pollset_add(pollset, pfd);
+                    syscalls += 1 + add_syscalls;
+                }
+            }
+            events += num;
+        }
+    }
+    end = apr_time_now();
+
+    apr_pollset_destroy(pollset);
+
+    result->events_per_sec = (double)events * APR_USEC_PER_SEC
+                             / (end > start ? end - start : 1);
+    result->syscalls_per_event = (double)syscalls / events;
+    return 1;
+}
+
+static void report(int churn, apr_pool_t *pool)
+{
+    result_t epoll, uring;
+    int n, has_epoll, has_uring;
+
+    printf("\n%s, %d active connections per round, %d rounds\n\n",
+           churn ? "Remove/add each connection served" : "Steady",
+           active, rounds);
+    printf("%8s %14s %14s %14s %14s\n", "", "epoll", "", "io_uring", "");
+    printf("%8s %14s %14s %14s %14s\n", "conns", "events/s",
+           "syscalls/evt", "events/s", "syscalls/evt");
+
+    for (n = active; n <= max_conns; n *= 2) {
+        has_epoll = run(&epoll, n, APR_POLLSET_EPOLL, churn, pool);
+        has_uring = run(&uring, n, APR_POLLSET_IOURING, churn, pool);
+        printf("%8d", n);
+        if (has_epoll) {
+            printf(" %14.0f %14.2f", epoll.events_per_sec,
+                   epoll.syscalls_per_event);
+        }
+        else {
+            printf(" %14s %14s", "n/a", "n/a");
+        }
+        if (has_uring) {
+            printf(" %14.0f %14.2f", uring.events_per_sec,
+                   uring.syscalls_per_event);
+        }
+        else {
+            printf(" %14s %14s", "n/a", "n/a");
+        }
+        printf("\n");
+    }
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+
+    printf("APR Pollset Connection Scaling Test\n"
+           "===================================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "a:n:r:v", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'a') {
+            active = atoi(optarg);
+        }
+        else if (optchar == 'n') {
+            max_conns = atoi(optarg);
+        }
+        else if (optchar == 'r') {
+            rounds = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (active < 1 || max_conns < active || rounds < 1) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    open_connections(max_conns, pool);
+
+    report(0, pool);
+    report(1, pool);
+
+    return 0;
+}
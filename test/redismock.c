@@ -0,0 +1,726 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* With -p <port> [-n <servers>] [-l <usec>], the mock serves PING, ECHO,
+ * GET, SET, SETEX, MGET, DEL, INCR, DECR, INCRBY, DECRBY, FLUSHALL, INFO,
+ * HELLO, QUIT and DEBUG PROTOCOL of Redis, in RESP2 or RESP3, from memory,
+ * on that many consecutive ports, until killed or idle for a minute.
+ *
+ * With -l, it waits that long before serving what it reads, as a network
+ * round trip would.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "apr_cstr.h"
+#include "apr_getopt.h"
+#include "apr_hash.h"
+#include "apr_network_io.h"
+#include "apr_poll.h"
+#include "apr_pools.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include "testredis.h"
+
+#define MOCK_MAX_SERVERS 64
+#define MOCK_BUFFER_SIZE 16384
+#define MOCK_IDLE_TIMEOUT apr_time_from_sec(60)
+
+typedef struct item_t {
+    char *key;
+    apr_size_t klen;
+    char *data;
+    apr_size_t len;
+    apr_time_t expires;           /* 0 for never */
+} item_t;
+
+typedef struct conn_t {
+    apr_pool_t *pool;
+    apr_socket_t *sock;
+    apr_pollfd_t pfd;
+    int listening;
+    int proto;                    /* 2 or 3, with HELLO */
+    char *in;
+    apr_size_t in_size;
+    apr_size_t in_len;
+    char *out;
+    apr_size_t out_size;
+    apr_size_t out_pos;
+    apr_size_t out_len;
+} conn_t;
+
+static apr_hash_t *items;
+static apr_pollset_t *pollset;
+static apr_interval_time_t latency;
+
+/* the arguments of the command being served */
+static char **argv;
+static apr_size_t *argl;
+static int argv_size;
+
+static void reserve(char **buf, apr_size_t *size, apr_size_t len,
+                    apr_size_t more)
+{
+    if (len + more > *size) {
+        while (len + more > *size) {
+            *size *= 2;
+        }
+        *buf = realloc(*buf, *size);
+        if (!*buf) {
+            exit(1);
+        }
+    }
+}
+
+static void reply(conn_t *c, const char *data, apr_size_t len)
+{
+    reserve(&c->out, &c->out_size, c->out_len, len);
+    memcpy(c->out + c->out_len, data, len);
+    c->out_len += len;
+}
+
+static void reply_str(conn_t *c, const char *str)
+{
+    reply(c, str, strlen(str));
+}
+
+static void reply_bulk(conn_t *c, const char *data, apr_size_t len)
+{
+    char hdr[64];
+
+    reply(c, hdr, apr_snprintf(hdr, sizeof(hdr), "$%" APR_SIZE_T_FMT "\r\n",
+                               len));
+    reply(c, data, len);
+    reply_str(c, "\r\n");
+}
+
+static void reply_int(conn_t *c, apr_int64_t n)
+{
+    char hdr[64];
+
+    reply(c, hdr, apr_snprintf(hdr, sizeof(hdr), ":%" APR_INT64_T_FMT "\r\n",
+                               n));
+}
+
+/* The header of an aggregate, as RESP2 has it unless it is an array */
+static void reply_aggregate(conn_t *c, char type, int n)
+{
+    char hdr[64];
+
+    if (c->proto == 2) {
+        n *= (type == '%') ? 2 : 1;
+        type = '*';
+    }
+    reply(c, hdr, apr_snprintf(hdr, sizeof(hdr), "%c%d\r\n", type, n));
+}
+
+static void reply_nil(conn_t *c)
+{
+    reply_str(c, c->proto == 3 ? "_\r\n" : "$-1\r\n");
+}
+
+static item_t *store(const char *key, apr_size_t klen, const char *data,
+                     apr_size_t len, apr_time_t expires)
+{
+    item_t *item, *old;
+
+    item = malloc(sizeof(item_t) + len + klen);
+    if (!item) {
+        exit(1);
+    }
+    item->data = (char *)(item + 1);
+    item->key = item->data + len;
+    memcpy(item->data, data, len);
+    memcpy(item->key, key, klen);
+    item->klen = klen;
+    item->len = len;
+    item->expires = expires;
+
+    /* the hash keeps the old key on replace, which is freed with it */
+    old = apr_hash_get(items, key, klen);
+    apr_hash_set(items, key, klen, NULL);
+    free(old);
+    apr_hash_set(items, item->key, klen, item);
+
+    return item;
+}
+
+static int remove_item(const char *key, apr_size_t klen)
+{
+    item_t *item = apr_hash_get(items, key, klen);
+
+    if (!item) {
+        return 0;
+    }
+    apr_hash_set(items, key, klen, NULL);
+    free(item);
+    return 1;
+}
+
+/* The item of the key, unless expired */
+static item_t *lookup(const char *key, apr_size_t klen)
+{
+    item_t *item = apr_hash_get(items, key, klen);
+
+    if (item && item->expires && item->expires <= apr_time_now()) {
+        remove_item(key, klen);
+        return NULL;
+    }
+    return item;
+}
+
+static void flushall(void)
+{
+    apr_hash_index_t *hi;
+    item_t *item;
+
+    while ((hi = apr_hash_first(NULL, items))) {
+        item = apr_hash_this_val(hi);
+        apr_hash_set(items, item->key, item->klen, NULL);
+        free(item);
+    }
+}
+
+static void push_arg(int argc, char *arg, apr_size_t len)
+{
+    if (argc == argv_size) {
+        argv_size *= 2;
+        argv = realloc(argv, argv_size * sizeof(*argv));
+        argl = realloc(argl, argv_size * sizeof(*argl));
+        if (!argv || !argl) {
+            exit(1);
+        }
+    }
+    argv[argc] = arg;
+    argl[argc] = len;
+}
+
+/* Parse the command at pos, an array of bulk strings or an inline one,
+ * returning its number of arguments, 0 until complete, or -1 on errors
+ */
+static int parse_command(conn_t *c, apr_size_t pos, apr_size_t *used)
+{
+    char *start = c->in + pos, *end = c->in + c->in_len, *p, *eol, *arg;
+    long n, i, len;
+    int argc = 0;
+
+    eol = memchr(start, '\n', end - start);
+    if (!eol) {
+        return 0;
+    }
+
+    if (*start != '*') {
+        /* inline, the arguments separated by spaces */
+        *used = eol + 1 - start;
+        if (eol > start && eol[-1] == '\r') {
+            eol--;
+        }
+        *eol = '\0';
+        for (arg = apr_strtok(start, " ", &p); arg;
+             arg = apr_strtok(NULL, " ", &p)) {
+            push_arg(argc++, arg, strlen(arg));
+        }
+        return argc;
+    }
+
+    n = strtol(start + 1, NULL, 10);
+    if (n < 1) {
+        return -1;
+    }
+    p = eol + 1;
+    for (i = 0; i < n; i++) {
+        eol = memchr(p, '\n', end - p);
+        if (!eol) {
+            return 0;
+        }
+        if (*p != '$' || (len = strtol(p + 1, NULL, 10)) < 0) {
+            return -1;
+        }
+        arg = eol + 1;
+        if (end - arg < len + 2) {
+            return 0;
+        }
+        if (arg[len] != '\r' || arg[len + 1] != '\n') {
+            return -1;
+        }
+        push_arg(argc++, arg, len);
+        p = arg + len + 2;
+    }
+
+    /* complete, the arguments can be null terminated */
+    for (i = 0; i < argc; i++) {
+        argv[i][argl[i]] = '\0';
+    }
+    *used = p - start;
+    return argc;
+}
+
+static int is(int i, const char *name)
+{
+    return !apr_cstr_casecmp(argv[i], name);
+}
+
+static void debug_protocol(conn_t *c, const char *type)
+{
+    if (!apr_cstr_casecmp(type, "string")) {
+        reply_str(c, "$11\r\nHello World\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "integer")) {
+        reply_int(c, 12345);
+    }
+    else if (!apr_cstr_casecmp(type, "double")) {
+        reply_str(c, c->proto == 3 ? ",3.141\r\n" : "$5\r\n3.141\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "bignum")) {
+        reply_str(c, c->proto == 3
+                     ? "(1234567999999999999999999999999999999\r\n"
+                     : "$37\r\n1234567999999999999999999999999999999\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "null")) {
+        reply_nil(c);
+    }
+    else if (!apr_cstr_casecmp(type, "array")) {
+        reply_aggregate(c, '*', 3);
+        reply_str(c, ":0\r\n:1\r\n:2\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "set")) {
+        reply_aggregate(c, '~', 3);
+        reply_str(c, ":0\r\n:1\r\n:2\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "map")) {
+        reply_aggregate(c, '%', 3);
+        reply_str(c, c->proto == 3 ? ":0\r\n#f\r\n:1\r\n#t\r\n:2\r\n#f\r\n"
+                                   : ":0\r\n:0\r\n:1\r\n:1\r\n:2\r\n:0\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "attrib")) {
+        if (c->proto == 3) {
+            reply_str(c, "|1\r\n$14\r\nkey-popularity\r\n"
+                         "*2\r\n$7\r\nkey:123\r\n:90\r\n");
+        }
+        reply_str(c, "$39\r\nSome real reply following the attribute\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "push")) {
+        if (c->proto == 3) {
+            reply_str(c, ">2\r\n$16\r\nserver-cpu-usage\r\n:42\r\n");
+        }
+        reply_str(c, "$40\r\nSome real reply following the push reply\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "true")) {
+        reply_str(c, c->proto == 3 ? "#t\r\n" : ":1\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "false")) {
+        reply_str(c, c->proto == 3 ? "#f\r\n" : ":0\r\n");
+    }
+    else if (!apr_cstr_casecmp(type, "verbatim")) {
+        reply_str(c, c->proto == 3
+                     ? "=29\r\ntxt:This is a verbatim\nstring\r\n"
+                     : "$25\r\nThis is a verbatim\nstring\r\n");
+    }
+    else {
+        reply_str(c, "-ERR Wrong protocol type name\r\n");
+    }
+}
+
+static void info(conn_t *c)
+{
+    char *text;
+
+    text = apr_psprintf(c->pool, "# Server\r\n"
+                                 "redis_version:7.0.0\r\n"
+                                 "process_id:%d\r\n"
+                                 "uptime_in_seconds:1\r\n"
+                                 "arch_bits:%d\r\n"
+                                 "# Clients\r\n"
+                                 "connected_clients:1\r\n"
+                                 "# Stats\r\n"
+                                 "keyspace_hits:0\r\n"
+                                 "keyspace_misses:0\r\n",
+                        1, (int)sizeof(void *) * 8);
+    if (c->proto == 3) {
+        reply_str(c, apr_psprintf(c->pool, "=%" APR_SIZE_T_FMT "\r\ntxt:",
+                                  strlen(text) + 4));
+        reply_str(c, text);
+        reply_str(c, "\r\n");
+    }
+    else {
+        reply_bulk(c, text, strlen(text));
+    }
+}
+
+/* Add to the integer value of the key */
+static void incr(conn_t *c, const char *key, apr_size_t klen, apr_int64_t by)
+{
+    item_t *item = lookup(key, klen);
+    apr_int64_t n = 0;
+    char *end, buf[64];
+
+    if (item) {
+        memcpy(buf, item->data, item->len < 63 ? item->len : 63);
+        buf[item->len < 63 ? item->len : 63] = '\0';
+        n = apr_strtoi64(buf, &end, 10);
+        if (!item->len || *end) {
+            reply_str(c, "-ERR value is not an integer or out of range\r\n");
+            return;
+        }
+    }
+    n += by;
+    apr_snprintf(buf, sizeof(buf), "%" APR_INT64_T_FMT, n);
+    store(key, klen, buf, strlen(buf), item ? item->expires : 0);
+    reply_int(c, n);
+}
+
+/* Serve the complete commands read, returning 0 to close the connection */
+static int serve(conn_t *c)
+{
+    apr_size_t pos = 0, used = 0;
+    item_t *item;
+    int argc, i, n, keep = 1;
+
+    while (keep && pos < c->in_len) {
+        argc = parse_command(c, pos, &used);
+        if (argc < 0) {
+            reply_str(c, "-ERR Protocol error\r\n");
+            keep = 0;
+            break;
+        }
+        if (argc == 0) {
+            if (!memchr(c->in + pos, '\n', c->in_len - pos)
+                || c->in[pos] == '*') {
+                /* wait for the rest */
+                break;
+            }
+            /* an empty inline command */
+            pos += used;
+            continue;
+        }
+        pos += used;
+
+        if (is(0, "PING")) {
+            if (argc > 1) {
+                reply_bulk(c, argv[1], argl[1]);
+            }
+            else {
+                reply_str(c, "+PONG\r\n");
+            }
+        }
+        else if (is(0, "ECHO") && argc == 2) {
+            reply_bulk(c, argv[1], argl[1]);
+        }
+        else if (is(0, "GET") && argc == 2) {
+            item = lookup(argv[1], argl[1]);
+            if (item) {
+                reply_bulk(c, item->data, item->len);
+            }
+            else {
+                reply_nil(c);
+            }
+        }
+        else if (is(0, "MGET") && argc > 1) {
+            reply_aggregate(c, '*', argc - 1);
+            for (i = 1; i < argc; i++) {
+                item = lookup(argv[i], argl[i]);
+                if (item) {
+                    reply_bulk(c, item->data, item->len);
+                }
+                else {
+                    reply_nil(c);
+                }
+            }
+        }
+        else if (is(0, "SET") && argc >= 3) {
+            apr_time_t expires = 0;
+
+            if (argc == 5 && is(3, "EX")) {
+                expires = apr_time_now()
+                          + apr_time_from_sec(atol(argv[4]));
+            }
+            store(argv[1], argl[1], argv[2], argl[2], expires);
+            reply_str(c, "+OK\r\n");
+        }
+        else if (is(0, "SETEX") && argc == 4) {
+            store(argv[1], argl[1], argv[3], argl[3],
+                  apr_time_now() + apr_time_from_sec(atol(argv[2])));
+            reply_str(c, "+OK\r\n");
+        }
+        else if (is(0, "DEL") && argc > 1) {
+            for (n = 0, i = 1; i < argc; i++) {
+                n += lookup(argv[i], argl[i]) != NULL
+                     && remove_item(argv[i], argl[i]);
+            }
+            reply_int(c, n);
+        }
+        else if ((is(0, "INCR") || is(0, "DECR")) && argc == 2) {
+            incr(c, argv[1], argl[1], is(0, "INCR") ? 1 : -1);
+        }
+        else if ((is(0, "INCRBY") || is(0, "DECRBY")) && argc == 3) {
+            apr_int64_t by = apr_atoi64(argv[2]);
+
+            incr(c, argv[1], argl[1], is(0, "INCRBY") ? by : -by);
+        }
+        else if (is(0, "FLUSHALL") || is(0, "FLUSHDB")) {
+            flushall();
+            reply_str(c, "+OK\r\n");
+        }
+        else if (is(0, "INFO")) {
+            info(c);
+        }
+        else if (is(0, "HELLO")) {
+            if (argc > 1 && strcmp(argv[1], "2") && strcmp(argv[1], "3")) {
+                reply_str(c, "-NOPROTO unsupported protocol version\r\n");
+                continue;
+            }
+            if (argc > 1) {
+                c->proto = atoi(argv[1]);
+            }
+            reply_aggregate(c, '%', 3);
+            reply_bulk(c, "server", 6);
+            reply_bulk(c, "redis", 5);
+            reply_bulk(c, "version", 7);
+            reply_bulk(c, "7.0.0", 5);
+            reply_bulk(c, "proto", 5);
+            reply_int(c, c->proto);
+        }
+        else if (is(0, "DEBUG") && argc == 3 && is(1, "PROTOCOL")) {
+            debug_protocol(c, argv[2]);
+        }
+        else if (is(0, "QUIT")) {
+            reply_str(c, "+OK\r\n");
+            keep = 0;
+        }
+        else {
+            /* with the command, as long as it is */
+            reply_str(c, "-ERR unknown command or wrong number of "
+                         "arguments for '");
+            reply(c, argv[0], argl[0]);
+            reply_str(c, "'\r\n");
+        }
+    }
+
+    if (pos) {
+        memmove(c->in, c->in + pos, c->in_len - pos);
+        c->in_len -= pos;
+    }
+    return keep;
+}
+
+static void update_events(conn_t *c, apr_int16_t reqevents)
+{
+    if (c->pfd.reqevents != reqevents) {
+        apr_pollset_remove(pollset, &c->pfd);
+        c->pfd.reqevents = reqevents;
+        apr_pollset_add(pollset, &c->pfd);
+    }
+}
+
+/* Write what the socket takes of the replies, returning 0 on error */
+static int flush(conn_t *c)
+{
+    apr_size_t len;
+    apr_status_t rv;
+
+    while (c->out_pos < c->out_len) {
+        len = c->out_len - c->out_pos;
+        rv = apr_socket_send(c->sock, c->out + c->out_pos, &len);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            return 0;
+        }
+        c->out_pos += len;
+    }
+    if (c->out_pos == c->out_len) {
+        c->out_pos = c->out_len = 0;
+    }
+
+    update_events(c, c->out_len ? APR_POLLIN | APR_POLLOUT : APR_POLLIN);
+    return 1;
+}
+
+static void conn_close(conn_t *c)
+{
+    apr_pollset_remove(pollset, &c->pfd);
+    apr_socket_close(c->sock);
+    free(c->in);
+    free(c->out);
+    apr_pool_destroy(c->pool);
+}
+
+static void conn_accept(conn_t *l, apr_pool_t *p)
+{
+    apr_socket_t *sock;
+    apr_pool_t *pool;
+    conn_t *c;
+
+    for (;;) {
+        apr_pool_create(&pool, p);
+        if (apr_socket_accept(&sock, l->sock, pool) != APR_SUCCESS) {
+            apr_pool_destroy(pool);
+            break;
+        }
+        apr_socket_timeout_set(sock, 0);
+        apr_socket_opt_set(sock, APR_TCP_NODELAY, 1);
+
+        c = apr_pcalloc(pool, sizeof(conn_t));
+        c->pool = pool;
+        c->sock = sock;
+        c->proto = 2;
+        c->in_size = c->out_size = MOCK_BUFFER_SIZE;
+        c->in = malloc(c->in_size);
+        c->out = malloc(c->out_size);
+        if (!c->in || !c->out) {
+            exit(1);
+        }
+
+        c->pfd.desc_type = APR_POLL_SOCKET;
+        c->pfd.reqevents = APR_POLLIN;
+        c->pfd.desc.s = sock;
+        c->pfd.p = pool;
+        c->pfd.client_data = c;
+        apr_pollset_add(pollset, &c->pfd);
+    }
+}
+
+/* Read and serve what the connection has, returning 0 to close it */
+static int conn_read(conn_t *c)
+{
+    apr_size_t len;
+    apr_status_t rv;
+    int got = 0;
+
+    for (;;) {
+        reserve(&c->in, &c->in_size, c->in_len, MOCK_BUFFER_SIZE);
+        len = c->in_size - c->in_len;
+        rv = apr_socket_recv(c->sock, c->in + c->in_len, &len);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            return 0;
+        }
+        c->in_len += len;
+        got = 1;
+    }
+
+    if (got && latency) {
+        apr_sleep(latency);
+    }
+    return serve(c) && flush(c);
+}
+
+static int server_mock(apr_pool_t *p, apr_port_t port, int servers)
+{
+    apr_sockaddr_t *sa;
+    const apr_pollfd_t *fds;
+    apr_status_t rv;
+    apr_int32_t i, n;
+    conn_t *c;
+
+    items = apr_hash_make(p);
+
+    argv_size = 16;
+    argv = malloc(argv_size * sizeof(*argv));
+    argl = malloc(argv_size * sizeof(*argl));
+    if (!argv || !argl) {
+        return 1;
+    }
+
+    rv = apr_pollset_create(&pollset, 1024, p, 0);
+    if (rv != APR_SUCCESS) {
+        return 1;
+    }
+
+    for (i = 0; i < servers; i++) {
+        c = apr_pcalloc(p, sizeof(conn_t));
+        c->listening = 1;
+        if (apr_sockaddr_info_get(&sa, MOCK_HOST, APR_UNSPEC,
+                                  (apr_port_t)(port + i), 0, p) != APR_SUCCESS
+            || apr_socket_create(&c->sock, sa->family, SOCK_STREAM, 0, p)
+               != APR_SUCCESS
+            || apr_socket_opt_set(c->sock, APR_SO_REUSEADDR, 1)
+               != APR_SUCCESS
+            || apr_socket_timeout_set(c->sock, 0) != APR_SUCCESS
+            || apr_socket_bind(c->sock, sa) != APR_SUCCESS
+            || apr_socket_listen(c->sock, SOMAXCONN) != APR_SUCCESS) {
+            return 1;
+        }
+
+        c->pfd.desc_type = APR_POLL_SOCKET;
+        c->pfd.reqevents = APR_POLLIN;
+        c->pfd.desc.s = c->sock;
+        c->pfd.p = p;
+        c->pfd.client_data = c;
+        apr_pollset_add(pollset, &c->pfd);
+    }
+
+    for (;;) {
+        rv = apr_pollset_poll(pollset, MOCK_IDLE_TIMEOUT, &n, &fds);
+        if (APR_STATUS_IS_EINTR(rv)) {
+            continue;
+        }
+        if (rv != APR_SUCCESS) {
+            /* idle, or the parent is gone */
+            return APR_STATUS_IS_TIMEUP(rv) ? 0 : 1;
+        }
+
+        for (i = 0; i < n; i++) {
+            c = fds[i].client_data;
+            if (c->listening) {
+                conn_accept(c, p);
+            }
+            else if (((fds[i].rtnevents & APR_POLLOUT) && !flush(c))
+                     || ((fds[i].rtnevents & (APR_POLLIN | APR_POLLHUP
+                                              | APR_POLLERR))
+                         && !conn_read(c))) {
+                conn_close(c);
+            }
+        }
+    }
+}
+
+int main(int argc, const char * const *args)
+{
+    apr_pool_t *p;
+    apr_getopt_t *opt;
+    apr_status_t rv;
+    char optchar;
+    const char *optarg;
+    int port = 0, servers = 1;
+
+    apr_initialize();
+    atexit(apr_terminate);
+    apr_pool_create(&p, NULL);
+
+    apr_getopt_init(&opt, p, argc, args);
+    while ((rv = apr_getopt(opt, "l:n:p:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'l') {
+            latency = atol(optarg);
+        }
+        else if (optchar == 'n') {
+            servers = atoi(optarg);
+        }
+        else if (optchar == 'p') {
+            port = atoi(optarg);
+        }
+    }
+    if (rv != APR_EOF || port <= 0 || servers < 1 || latency < 0
+        || servers > MOCK_MAX_SERVERS || port + servers > 65536) {
+        exit(1);
+    }
+
+    exit(server_mock(p, (apr_port_t)port, servers));
+}
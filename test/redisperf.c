@@ -0,0 +1,320 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* redisperf.c
+ * This benchmark sets and gets batches of keys spread over a number of
+ * Redis servers, served by redismock, in these modes:
+ *
+ *   set       apr_redis_set() of each key in turn
+ *   pipe set  apr_redis_pipeline_command() of a SET per key, then one run
+ *   getp      apr_redis_getp() of each key in turn
+ *   multgetp  apr_redis_multgetp() of the batch, an MGET per server
+ *   pipe get  apr_redis_pipeline_command() of a GET per key, then one run
+ *
+ * It prints the keys per second of each mode for increasing batch sizes.
+ * The modes of each key in turn make a round trip per key, where the
+ * others make one per server of the batch, which -l shows by having the
+ * mock wait that many microseconds before serving what it reads, as a
+ * network would.
+ *
+ * The mock is started from the current directory on the ports from 11310
+ * up, unless -p gives the first port of servers already running (such as
+ * Redis instances).
+ *
+ * To run,
+ *
+ *   ./redisperf [-n keys] [-s servers] [-v value size] [-l usec] [-p port]
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_hash.h"
+#include "apr_redis.h"
+#include "apr_strings.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#define DEFAULT_KEYS 20000
+#define DEFAULT_SERVERS 4
+#define DEFAULT_VALUE_SIZE 100
+#define MOCK_HOST "localhost"
+#define MOCK_PORT 11310
+#define RUN_TIMEOUT apr_time_from_sec(10)
+
+static int nkeys = DEFAULT_KEYS;
+static int servers = DEFAULT_SERVERS;
+static int value_size = DEFAULT_VALUE_SIZE;
+static long latency = 0;
+
+static const int batches[] = { 1, 10, 50, 200, 1000 };
+
+typedef enum {
+    MODE_SET,
+    MODE_PIPE_SET,
+    MODE_GETP,
+    MODE_MULTGETP,
+    MODE_PIPE_GET
+} mode_e;
+
+static const char *mode_names[] = {
+    "set", "pipe set", "getp", "multgetp", "pipe get"
+};
+
+static const char **keys;
+static char *value;
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+static void start_mock(apr_proc_t *proc, apr_port_t port, apr_pool_t *pool)
+{
+    apr_procattr_t *procattr;
+    apr_sockaddr_t *sa;
+    apr_socket_t *sock;
+    apr_status_t rv;
+    const char *args[8];
+    int i;
+
+    args[0] = "redismock";
+    args[1] = "-p";
+    args[2] = apr_itoa(pool, port);
+    args[3] = "-n";
+    args[4] = apr_itoa(pool, servers);
+    args[5] = "-l";
+    args[6] = apr_ltoa(pool, latency);
+    args[7] = NULL;
+
+    if ((rv = apr_procattr_create(&procattr, pool)) != APR_SUCCESS
+        || (rv = apr_procattr_error_check_set(procattr, 1)) != APR_SUCCESS
+        || (rv = apr_proc_create(proc, "./redismock", args, NULL,
+                                 procattr, pool)) != APR_SUCCESS
+        || (rv = apr_sockaddr_info_get(&sa, MOCK_HOST, APR_UNSPEC,
+                                       port + servers - 1, 0, pool))
+            != APR_SUCCESS) {
+        fail("Could not start redismock", rv);
+    }
+
+    for (i = 0; i < 50; i++) {
+        if ((rv = apr_socket_create(&sock, sa->family, SOCK_STREAM, 0,
+                                    pool)) != APR_SUCCESS) {
+            fail("Could not create a socket", rv);
+        }
+        rv = apr_socket_connect(sock, sa);
+        apr_socket_close(sock);
+        if (rv == APR_SUCCESS) {
+            return;
+        }
+        apr_sleep(apr_time_from_msec(100));
+    }
+    fail("Could not connect to redismock", rv);
+}
+
+static void run_batch(apr_redis_t *rc, mode_e mode, int first, int n,
+                      apr_pool_t *pool)
+{
+    apr_redis_pipeline_t *pipeline;
+    apr_redis_reply_t *reply;
+    apr_hash_t *values = NULL;
+    apr_pool_t *tmppool;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t len, argvlen[3];
+    apr_uint16_t flags;
+    const char *argv[3];
+    char *data;
+    int i;
+
+    switch (mode) {
+    case MODE_SET:
+        for (i = first; i < first + n && rv == APR_SUCCESS; i++) {
+            rv = apr_redis_set(rc, keys[i], value, value_size, 0);
+        }
+        break;
+    case MODE_GETP:
+        for (i = first; i < first + n && rv == APR_SUCCESS; i++) {
+            rv = apr_redis_getp(rc, pool, keys[i], &data, &len, &flags);
+        }
+        break;
+    case MODE_MULTGETP:
+        for (i = first; i < first + n; i++) {
+            apr_redis_add_multget_key(pool, keys[i], &values);
+        }
+        apr_pool_create(&tmppool, pool);
+        rv = apr_redis_multgetp(rc, tmppool, pool, values);
+        break;
+    case MODE_PIPE_SET:
+    case MODE_PIPE_GET:
+        apr_redis_pipeline_create(&pipeline, rc, NULL, NULL, pool);
+        for (i = first; i < first + n; i++) {
+            argv[0] = mode == MODE_PIPE_SET ? "SET" : "GET";
+            argv[1] = keys[i];
+            argv[2] = value;
+            argvlen[0] = 3;
+            argvlen[1] = strlen(keys[i]);
+            argvlen[2] = value_size;
+            apr_redis_pipeline_command(pipeline, keys[i],
+                                       mode == MODE_PIPE_SET ? 3 : 2,
+                                       argv, argvlen, &reply);
+        }
+        rv = apr_redis_pipeline_run(pipeline, RUN_TIMEOUT);
+        break;
+    }
+
+    if (rv != APR_SUCCESS) {
+        fail(mode_names[mode], rv);
+    }
+}
+
+/* Keys per second */
+static double run(apr_redis_t *rc, mode_e mode, int batch,
+                  apr_pool_t *parent)
+{
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    int i;
+
+    apr_pool_create(&pool, parent);
+
+    start = apr_time_now();
+    for (i = 0; i + batch <= nkeys; i += batch) {
+        run_batch(rc, mode, i, batch, pool);
+        apr_pool_clear(pool);
+    }
+    end = apr_time_now();
+
+    apr_pool_destroy(pool);
+
+    return (double)i * APR_USEC_PER_SEC / (end > start ? end - start : 1);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    apr_redis_t *rc;
+    apr_redis_server_t *rs;
+    apr_proc_t proc;
+    apr_exit_why_e why;
+    char optchar;
+    const char *optarg;
+    int port = 0, exitcode, b, m, i;
+
+    printf("APR Redis Pipeline Test\n"
+           "=======================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "l:n:p:s:v:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'l') {
+            latency = atol(optarg);
+        }
+        else if (optchar == 'n') {
+            nkeys = atoi(optarg);
+        }
+        else if (optchar == 'p') {
+            port = atoi(optarg);
+        }
+        else if (optchar == 's') {
+            servers = atoi(optarg);
+        }
+        else if (optchar == 'v') {
+            value_size = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (nkeys < 1 || servers < 1 || servers > 64 || value_size < 0
+        || latency < 0 || port < 0 || port + servers > 65536) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    if (!port) {
+        start_mock(&proc, MOCK_PORT, pool);
+    }
+
+    if ((rv = apr_redis_create(pool, servers, 0, &rc)) != APR_SUCCESS) {
+        fail("Could not create the redis", rv);
+    }
+    for (i = 0; i < servers; i++) {
+        if ((rv = apr_redis_server_create(pool, MOCK_HOST,
+                                          (apr_port_t)((port ? port
+                                                             : MOCK_PORT)
+                                                       + i),
+                                          0, 1, 1, 60, 60, &rs))
+                != APR_SUCCESS
+            || (rv = apr_redis_add_server(rc, rs)) != APR_SUCCESS) {
+            fail("Could not add a server", rv);
+        }
+    }
+
+    keys = apr_palloc(pool, nkeys * sizeof(char *));
+    for (i = 0; i < nkeys; i++) {
+        keys[i] = apr_psprintf(pool, "redisperf%d", i);
+    }
+    value = apr_palloc(pool, value_size + 1);
+    memset(value, 'v', value_size);
+
+    printf("\n%d keys of %d bytes over %d servers, %ld usec of latency\n\n",
+           nkeys, value_size, servers, latency);
+    printf("%-6s", "batch");
+    for (m = MODE_SET; m <= MODE_PIPE_GET; m++) {
+        printf(" %12s", mode_names[m]);
+    }
+    printf("\n");
+
+    for (b = 0; b < sizeof(batches) / sizeof(batches[0]); b++) {
+        if (batches[b] > nkeys) {
+            break;
+        }
+        printf("%-6d", batches[b]);
+        for (m = MODE_SET; m <= MODE_PIPE_GET; m++) {
+            printf(" %12.0f", run(rc, m, batches[b], pool));
+            fflush(stdout);
+        }
+        printf("\n");
+    }
+
+    if (!port) {
+        apr_proc_kill(&proc, SIGTERM);
+        apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    }
+    return 0;
+}
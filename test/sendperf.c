@@ -0,0 +1,303 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* sendperf.c
+ * This benchmark writes brigades to a loopback TCP connection, drained by
+ * a reader thread, and prints the throughput of:
+ *
+ *   naive      apr_bucket_read() then apr_socket_send() for each bucket
+ *   sendv      apr_brigade_send_socket(), gathering the buckets with
+ *              writev()
+ *   file read  a file bucket (without mmap), read then sent bucket by
+ *              bucket
+ *   sendfile   the same file bucket, opened with APR_FOPEN_SENDFILE_ENABLED,
+ *              through apr_brigade_send_socket()
+ *   zerocopy   apr_brigade_send_socket() with APR_BRIGADE_SEND_ZEROCOPY,
+ *              which only pays off on actual network interfaces: over the
+ *              loopback the data is copied anyway
+ *
+ * The in-memory brigades are made of immortal buckets of the given size.
+ *
+ * To run,
+ *
+ *   ./sendperf [-m megabytes per run] [-b bucket size]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_buckets.h"
+#include "apr_errno.h"
+#include "apr_file_io.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_network_io.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#if APR_HAS_THREADS
+
+#define DEFAULT_MEGABYTES 256
+#define DEFAULT_BUCKET_SIZE 4096
+#define BRIGADE_SIZE (1024 * 1024)
+#define FILE_NAME "data/sendperf.dat"
+
+static int megabytes = DEFAULT_MEGABYTES;
+static int bucket_size = DEFAULT_BUCKET_SIZE;
+
+typedef enum {
+    MODE_NAIVE,
+    MODE_SENDV,
+    MODE_FILE_READ,
+    MODE_SENDFILE,
+    MODE_ZEROCOPY
+} mode_e;
+
+static const char *mode_names[] = {
+    "naive", "sendv", "file read", "sendfile", "zerocopy"
+};
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+static void * APR_THREAD_FUNC reader_thread(apr_thread_t *thd, void *data)
+{
+    apr_socket_t *sock = data;
+    char buf[65536];
+    apr_size_t len;
+
+    do {
+        len = sizeof(buf);
+    } while (apr_socket_recv(sock, buf, &len) == APR_SUCCESS);
+
+    return NULL;
+}
+
+static void connect_pair(apr_socket_t **client, apr_socket_t **server,
+                         apr_pool_t *pool)
+{
+    apr_socket_t *listener;
+    apr_sockaddr_t *sa;
+    apr_status_t rv;
+
+    if ((rv = apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0, 0, pool))
+            != APR_SUCCESS
+        || (rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM,
+                                   APR_PROTO_TCP, pool)) != APR_SUCCESS
+        || (rv = apr_socket_bind(listener, sa)) != APR_SUCCESS
+        || (rv = apr_socket_listen(listener, 1)) != APR_SUCCESS
+        || (rv = apr_socket_addr_get(&sa, APR_LOCAL, listener))
+            != APR_SUCCESS
+        || (rv = apr_socket_create(client, APR_INET, SOCK_STREAM,
+                                   APR_PROTO_TCP, pool)) != APR_SUCCESS
+        || (rv = apr_socket_connect(*client, sa)) != APR_SUCCESS
+        || (rv = apr_socket_accept(server, listener, pool)) != APR_SUCCESS) {
+        fail("Could not connect", rv);
+    }
+    apr_socket_close(listener);
+}
+
+/* Fill the brigade with BRIGADE_SIZE bytes, from the file or in memory */
+static void fill_brigade(apr_bucket_brigade *bb, mode_e mode,
+                         const char *data, apr_file_t *file)
+{
+    apr_bucket *e;
+    apr_size_t len;
+
+    if (mode == MODE_FILE_READ || mode == MODE_SENDFILE) {
+        e = apr_bucket_file_create(file, 0, BRIGADE_SIZE, bb->p,
+                                   bb->bucket_alloc);
+        apr_bucket_file_enable_mmap(e, 0);
+        APR_BRIGADE_INSERT_TAIL(bb, e);
+        return;
+    }
+    for (len = 0; len < BRIGADE_SIZE; len += bucket_size) {
+        e = apr_bucket_immortal_create(data, bucket_size, bb->bucket_alloc);
+        APR_BRIGADE_INSERT_TAIL(bb, e);
+    }
+}
+
+static void send_naive(apr_socket_t *sock, apr_bucket_brigade *bb)
+{
+    apr_bucket *e;
+    const char *data;
+    apr_size_t len, n;
+    apr_status_t rv;
+
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        e = APR_BRIGADE_FIRST(bb);
+        if ((rv = apr_bucket_read(e, &data, &len, APR_BLOCK_READ))
+                != APR_SUCCESS) {
+            fail("Could not read a bucket", rv);
+        }
+        while (len) {
+            n = len;
+            if ((rv = apr_socket_send(sock, data, &n)) != APR_SUCCESS) {
+                fail("Could not send", rv);
+            }
+            data += n;
+            len -= n;
+        }
+        apr_bucket_delete(e);
+    }
+}
+
+/* Megabytes per second */
+static double run(mode_e mode, const char *data, apr_pool_t *parent)
+{
+    apr_socket_t *client, *server;
+    apr_thread_t *thread;
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    apr_file_t *file;
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    apr_status_t rv;
+    apr_size_t len;
+    int i;
+
+    apr_pool_create(&pool, parent);
+    ba = apr_bucket_alloc_create(pool);
+    bb = apr_brigade_create(pool, ba);
+
+    rv = apr_file_open(&file, FILE_NAME, APR_FOPEN_READ
+                       | (mode == MODE_SENDFILE ? APR_FOPEN_SENDFILE_ENABLED
+                                                : 0),
+                       APR_FPROT_OS_DEFAULT, pool);
+    if (rv != APR_SUCCESS) {
+        fail("Could not open " FILE_NAME, rv);
+    }
+
+    connect_pair(&client, &server, pool);
+    rv = apr_thread_create(&thread, NULL, reader_thread, server, pool);
+    if (rv != APR_SUCCESS) {
+        fail("Could not create the reader thread", rv);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < megabytes; i++) {
+        fill_brigade(bb, mode, data, file);
+        if (mode == MODE_NAIVE || mode == MODE_FILE_READ) {
+            send_naive(client, bb);
+            continue;
+        }
+        rv = apr_brigade_send_socket(client, bb,
+                                     mode == MODE_ZEROCOPY
+                                         ? APR_BRIGADE_SEND_ZEROCOPY : 0,
+                                     &len);
+        if (rv != APR_SUCCESS) {
+            fail("Could not send the brigade", rv);
+        }
+    }
+    apr_socket_shutdown(client, APR_SHUTDOWN_WRITE);
+    apr_thread_join(&rv, thread);
+    end = apr_time_now();
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+    apr_pool_destroy(pool);
+
+    return (double)megabytes * APR_USEC_PER_SEC
+           / (end > start ? end - start : 1);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    apr_file_t *file;
+    apr_size_t len;
+    char optchar;
+    const char *optarg;
+    char *data;
+    int m;
+
+    printf("APR Brigade Send Test\n"
+           "=====================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "b:m:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'b') {
+            bucket_size = atoi(optarg);
+        }
+        else if (optchar == 'm') {
+            megabytes = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (megabytes < 1 || bucket_size < 1 || bucket_size > BRIGADE_SIZE
+        || BRIGADE_SIZE % bucket_size) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    /* What the in-memory brigades send, and the file */
+    data = apr_palloc(pool, BRIGADE_SIZE);
+    for (len = 0; len < BRIGADE_SIZE; len++) {
+        data[len] = (char)(len * 7 % 251);
+    }
+    len = BRIGADE_SIZE;
+    if ((rv = apr_file_open(&file, FILE_NAME, APR_FOPEN_WRITE
+                            | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE,
+                            APR_FPROT_OS_DEFAULT, pool)) != APR_SUCCESS
+        || (rv = apr_file_write_full(file, data, len, NULL)) != APR_SUCCESS
+        || (rv = apr_file_close(file)) != APR_SUCCESS) {
+        fail("Could not write " FILE_NAME, rv);
+    }
+
+    printf("\n%d MB per run, %d byte buckets\n\n", megabytes, bucket_size);
+    printf("%-10s %12s\n", "mode", "MB/s");
+
+    for (m = MODE_NAIVE; m <= MODE_ZEROCOPY; m++) {
+        printf("%-10s %12.1f\n", mode_names[m], run(m, data, pool));
+        fflush(stdout);
+    }
+
+    apr_file_remove(FILE_NAME, pool);
+    return 0;
+}
+
+#else /* !APR_HAS_THREADS */
+
+int main(void)
+{
+    fprintf(stderr, "This test requires APR thread support.\n");
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -0,0 +1,329 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* socketbucketperf.c
+ * This benchmark reads loopback TCP connections through socket buckets,
+ * created by apr_bucket_socket_create() (default) or
+ * apr_bucket_socket_create_ex() with APR_BUCKET_SOCKET_ADAPTIVE
+ * (adaptive) or APR_BUCKET_SOCKET_FIONREAD (fionread):
+ *
+ *   idle  many connections each receive a small partial request, which
+ *         is read and kept in the connection's brigade as if waiting for
+ *         the rest of it; it prints the buffer memory held per connection
+ *         (the bucket allocator rounds anything larger than
+ *         APR_BUCKET_ALLOC_SIZE up to a whole allocator block)
+ *   bulk  one connection receives a large transfer from a writer thread;
+ *         it prints the throughput and the reads (recv() calls) per
+ *         megabyte
+ *
+ * To run,
+ *
+ *   ./socketbucketperf [-c connections] [-s request size] [-m megabytes]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_buckets.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_network_io.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#if APR_HAS_THREADS
+
+#define DEFAULT_CONNECTIONS 200
+#define DEFAULT_REQUEST_SIZE 100
+#define DEFAULT_MEGABYTES 256
+
+static int connections = DEFAULT_CONNECTIONS;
+static int request_size = DEFAULT_REQUEST_SIZE;
+static int megabytes = DEFAULT_MEGABYTES;
+
+static const struct {
+    apr_int32_t flags;
+    const char *name;
+} modes[] = {
+    { 0, "default" },
+    { APR_BUCKET_SOCKET_ADAPTIVE, "adaptive" },
+    { APR_BUCKET_SOCKET_FIONREAD, "fionread" }
+};
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+static apr_socket_t *listen_local(apr_sockaddr_t **sa, apr_pool_t *pool)
+{
+    apr_socket_t *listener;
+    apr_status_t rv;
+
+    if ((rv = apr_sockaddr_info_get(sa, "127.0.0.1", APR_INET, 0, 0, pool))
+            != APR_SUCCESS
+        || (rv = apr_socket_create(&listener, APR_INET, SOCK_STREAM,
+                                   APR_PROTO_TCP, pool)) != APR_SUCCESS
+        || (rv = apr_socket_bind(listener, *sa)) != APR_SUCCESS
+        || (rv = apr_socket_listen(listener, SOMAXCONN)) != APR_SUCCESS
+        || (rv = apr_socket_addr_get(sa, APR_LOCAL, listener))
+            != APR_SUCCESS) {
+        fail("Could not listen", rv);
+    }
+    return listener;
+}
+
+static void connect_pair(apr_socket_t *listener, apr_sockaddr_t *sa,
+                         apr_socket_t **client, apr_socket_t **server,
+                         apr_pool_t *pool)
+{
+    apr_status_t rv;
+
+    if ((rv = apr_socket_create(client, APR_INET, SOCK_STREAM,
+                                APR_PROTO_TCP, pool)) != APR_SUCCESS
+        || (rv = apr_socket_connect(*client, sa)) != APR_SUCCESS
+        || (rv = apr_socket_accept(server, listener, pool)) != APR_SUCCESS) {
+        fail("Could not connect", rv);
+    }
+}
+
+/* Read what is available of the brigade's socket bucket, returning the
+ * number of reads.
+ */
+static long read_available(apr_bucket_brigade *bb, apr_size_t *held)
+{
+    apr_bucket *e;
+    const char *data;
+    apr_size_t len;
+    apr_status_t rv;
+    long reads = 0;
+
+    for (e = APR_BRIGADE_FIRST(bb); e != APR_BRIGADE_SENTINEL(bb);
+         e = APR_BUCKET_NEXT(e)) {
+        if (!APR_BUCKET_IS_SOCKET(e)) {
+            continue;
+        }
+        reads++;
+        rv = apr_bucket_read(e, &data, &len, APR_NONBLOCK_READ);
+        if (APR_STATUS_IS_EAGAIN(rv)) {
+            break;
+        }
+        if (rv != APR_SUCCESS) {
+            fail("Could not read", rv);
+        }
+        if (len && held) {
+            /* What the buffer really takes from the bucket allocator */
+            *held += apr_bucket_alloc_aligned_floor(
+                         e->list, ((apr_bucket_heap *)e->data)->alloc_len);
+        }
+    }
+    return reads;
+}
+
+/* Buffer bytes held per idle connection */
+static double run_idle(apr_int32_t flags, apr_pool_t *parent)
+{
+    apr_socket_t *listener, *client, *server;
+    apr_sockaddr_t *sa;
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    apr_pool_t *pool;
+    apr_size_t len, held = 0;
+    apr_status_t rv;
+    char *request;
+    int i;
+
+    apr_pool_create(&pool, parent);
+    listener = listen_local(&sa, pool);
+    ba = apr_bucket_alloc_create(pool);
+    request = apr_palloc(pool, request_size);
+    memset(request, 'r', request_size);
+
+    for (i = 0; i < connections; i++) {
+        connect_pair(listener, sa, &client, &server, pool);
+        len = request_size;
+        if ((rv = apr_socket_send(client, request, &len)) != APR_SUCCESS) {
+            fail("Could not send", rv);
+        }
+        /* Let it arrive */
+        apr_socket_timeout_set(server, apr_time_from_sec(1));
+        apr_socket_wait(server, APR_WAIT_READ);
+
+        bb = apr_brigade_create(pool, ba);
+        APR_BRIGADE_INSERT_TAIL(bb,
+                                apr_bucket_socket_create_ex(server, flags, ba));
+        read_available(bb, &held);
+    }
+
+    apr_pool_destroy(pool);
+    return (double)held / connections;
+}
+
+typedef struct writer_t {
+    apr_socket_t *sock;
+    const char *data;
+    apr_size_t len;
+} writer_t;
+
+static void * APR_THREAD_FUNC writer_thread(apr_thread_t *thd, void *data)
+{
+    writer_t *writer = data;
+    apr_size_t len;
+    int i;
+
+    for (i = 0; i < megabytes; i++) {
+        len = writer->len;
+        if (apr_socket_send(writer->sock, writer->data, &len) != APR_SUCCESS
+            || len != writer->len) {
+            fail("Could not send", APR_EGENERAL);
+        }
+    }
+    apr_socket_shutdown(writer->sock, APR_SHUTDOWN_WRITE);
+
+    return NULL;
+}
+
+/* Megabytes per second and reads per megabyte */
+static void run_bulk(apr_int32_t flags, double *mbps, double *reads,
+                     apr_pool_t *parent)
+{
+    apr_socket_t *listener, *client, *server;
+    apr_sockaddr_t *sa;
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    apr_bucket *e;
+    apr_thread_t *thread;
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    apr_status_t rv;
+    writer_t writer;
+    const char *data;
+    apr_size_t len;
+    long count = 0;
+
+    apr_pool_create(&pool, parent);
+    listener = listen_local(&sa, pool);
+    connect_pair(listener, sa, &client, &server, pool);
+    ba = apr_bucket_alloc_create(pool);
+    bb = apr_brigade_create(pool, ba);
+
+    writer.sock = client;
+    writer.len = 1024 * 1024;
+    writer.data = apr_pcalloc(pool, writer.len);
+
+    start = apr_time_now();
+    rv = apr_thread_create(&thread, NULL, writer_thread, &writer, pool);
+    if (rv != APR_SUCCESS) {
+        fail("Could not create the writer thread", rv);
+    }
+
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_socket_create_ex(server, flags,
+                                                            ba));
+    while (!APR_BRIGADE_EMPTY(bb)) {
+        e = APR_BRIGADE_FIRST(bb);
+        count++;
+        rv = apr_bucket_read(e, &data, &len, APR_BLOCK_READ);
+        if (rv != APR_SUCCESS) {
+            fail("Could not read", rv);
+        }
+        apr_bucket_delete(e);
+    }
+    apr_thread_join(&rv, thread);
+    end = apr_time_now();
+
+    apr_pool_destroy(pool);
+
+    *mbps = (double)megabytes * APR_USEC_PER_SEC
+            / (end > start ? end - start : 1);
+    *reads = (double)count / megabytes;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    double held, mbps, reads;
+    int i;
+
+    printf("APR Socket Bucket Test\n"
+           "======================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "c:m:s:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'c') {
+            connections = atoi(optarg);
+        }
+        else if (optchar == 'm') {
+            megabytes = atoi(optarg);
+        }
+        else if (optchar == 's') {
+            request_size = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (connections < 1 || megabytes < 1 || request_size < 1) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    printf("\nidle: %d connections with %d byte requests, "
+           "bulk: %d MB\n\n", connections, request_size, megabytes);
+    printf("%-10s %16s %12s %12s\n", "mode", "idle bytes/conn", "bulk MB/s",
+           "reads/MB");
+
+    for (i = 0; i < sizeof(modes) / sizeof(modes[0]); i++) {
+        held = run_idle(modes[i].flags, pool);
+        run_bulk(modes[i].flags, &mbps, &reads, pool);
+        printf("%-10s %16.0f %12.1f %12.1f\n", modes[i].name, held, mbps,
+               reads);
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+#else /* !APR_HAS_THREADS */
+
+int main(void)
+{
+    fprintf(stderr, "This test requires APR thread support.\n");
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -0,0 +1,189 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Allocator arenas benchmark: build and scan large hash tables and
+ * tables (TLB miss heavy workloads) from pools whose allocator uses
+ * regular memory, regular pages arenas, transparent or explicit huge
+ * pages arenas, and optionally NUMA bound arenas.
+ */
+
+#include "apr_allocator.h"
+#include "apr_pools.h"
+#include "apr_hash.h"
+#include "apr_tables.h"
+#include "apr_strings.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_ENTRIES 1000000
+
+static int entries = DEFAULT_ENTRIES;
+static int numa_node = -1;
+
+struct mode {
+    const char *name;
+    int arenas;
+    apr_uint32_t flags;
+};
+
+static const struct mode modes[] = {
+    { "malloc",       0, 0 },
+    { "arenas",       1, 0 },
+    { "hugepages",    1, APR_ALLOCATOR_HUGEPAGES },
+    { "hugetlb",      1, APR_ALLOCATOR_HUGETLB },
+};
+
+static int do_sum(void *rec, const char *key, const char *value)
+{
+    *(apr_size_t *)rec += value[0];
+    return 1;
+}
+
+static apr_status_t run(const struct mode *mode, int node)
+{
+    apr_allocator_t *allocator;
+    apr_pool_t *pool;
+    apr_hash_t *hash;
+    apr_table_t *table;
+    apr_hash_index_t *hi;
+    apr_time_t t0, t1, t2, t3, t4;
+    apr_size_t sum = 0;
+    char **keys;
+    apr_status_t rv;
+    int i, found = 0;
+
+    if (mode->arenas || node >= 0) {
+        rv = apr_allocator_create_ex(&allocator, mode->flags, node);
+    }
+    else {
+        rv = apr_allocator_create(&allocator);
+    }
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_pool_create_unmanaged_ex(&pool, NULL, allocator);
+    if (rv != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_owner_set(allocator, pool);
+
+    keys = apr_palloc(pool, entries * sizeof(char *));
+    for (i = 0; i < entries; i++) {
+        keys[i] = apr_psprintf(pool, "key-%d-%x", i, (unsigned)i * 2654435761u);
+    }
+
+    t0 = apr_time_now();
+    hash = apr_hash_make(pool);
+    for (i = 0; i < entries; i++) {
+        apr_hash_set(hash, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    t1 = apr_time_now();
+    /* Scan in a scattered order */
+    for (i = 0; i < entries; i++) {
+        int k = (int)(((apr_uint64_t)i * 7919) % entries);
+        found += apr_hash_get(hash, keys[k], APR_HASH_KEY_STRING) != NULL;
+    }
+    for (hi = apr_hash_first(pool, hash); hi; hi = apr_hash_next(hi)) {
+        sum += *(const char *)apr_hash_this_val(hi);
+    }
+    t2 = apr_time_now();
+
+    table = apr_table_make(pool, entries);
+    for (i = 0; i < entries; i++) {
+        apr_table_addn(table, keys[i], keys[i]);
+    }
+    t3 = apr_time_now();
+    for (i = 0; i < 10; i++) {
+        apr_table_do(do_sum, &sum, table, NULL);
+    }
+    t4 = apr_time_now();
+
+    printf("%-10s %5d %12" APR_TIME_T_FMT " %12" APR_TIME_T_FMT
+           " %12" APR_TIME_T_FMT " %12" APR_TIME_T_FMT "%s\n",
+           mode->name, node, t1 - t0, t2 - t1, t3 - t2, t4 - t3,
+           found == entries && sum ? "" : "  (error)");
+
+    apr_pool_destroy(pool);
+
+    return APR_SUCCESS;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Allocator Arenas Performance Test\n"
+           "=====================================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:N:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            entries = atoi(optarg);
+            if (entries < 1) {
+                fprintf(stderr, "Invalid number of entries\n");
+                exit(-1);
+            }
+        }
+        else if (optchar == 'N') {
+            numa_node = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    printf("%d entries, times in usec\n\n", entries);
+    printf("%-10s %5s %12s %12s %12s %12s\n", "mode", "numa",
+           "hash build", "hash scan", "table build", "table scan");
+
+    for (i = 0; i < (int)(sizeof(modes) / sizeof(modes[0])); i++) {
+        rv = run(&modes[i], -1);
+        if (rv == APR_SUCCESS && numa_node >= 0) {
+            rv = run(&modes[i], numa_node);
+        }
+        if (rv != APR_SUCCESS) {
+            printf("%-10s %s\n", modes[i].name,
+                   apr_strerror(rv, errmsg, sizeof errmsg));
+        }
+    }
+
+    return 0;
+}
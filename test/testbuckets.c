@@ -18,6 +18,7 @@
 #include "testutil.h"
 #include "apr_buckets.h"
 #include "apr_strings.h"
+#include "apr_thread_proc.h"
 
 static void test_create(abts_case *tc, void *data)
 {
@@ -459,6 +460,43 @@ static void test_manyfile(abts_case *tc, void *data)
     apr_bucket_alloc_destroy(ba);
 }
 
+static void test_file_readahead(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_bucket *e;
+    apr_file_t *f;
+    apr_off_t pos = 0;
+    char *contents;
+    int i;
+
+    /* Several reads of APR_BUCKET_BUFF_SIZE */
+    contents = apr_palloc(p, 3 * APR_BUCKET_BUFF_SIZE + 1);
+    for (i = 0; i < 3 * APR_BUCKET_BUFF_SIZE; i++) {
+        contents[i] = 'a' + i % 26;
+    }
+    contents[i] = '\0';
+    f = make_test_file(tc, "readahead.txt", contents);
+    APR_ASSERT_SUCCESS(tc, "rewind the file", apr_file_seek(f, APR_SET, &pos));
+
+    e = apr_bucket_file_create(f, 0, 3 * APR_BUCKET_BUFF_SIZE, p, ba);
+    APR_BRIGADE_INSERT_TAIL(bb, e);
+    apr_bucket_file_enable_mmap(e, 0);
+    apr_bucket_file_enable_readahead(e, 1);
+
+    flatten_match(tc, "readahead file", bb, contents);
+
+    /* The reads are positional */
+    APR_ASSERT_SUCCESS(tc, "get the file position",
+                       apr_file_seek(f, APR_CUR, &pos));
+    ABTS_ASSERT(tc, "file position not moved by the reads", pos == 0);
+
+    apr_file_close(f);
+    apr_file_remove("readahead.txt", p);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
 /* Regression test for PR 34708, where a file bucket will keep
  * duplicating itself on being read() when EOF is reached
  * prematurely. */
@@ -567,6 +605,416 @@ static void test_write_putstrs(abts_case *tc, void *data)
     apr_bucket_alloc_destroy(ba);
 }
 
+/* Make a connected pair of TCP sockets over the loopback */
+static void make_socket_pair(abts_case *tc, apr_socket_t **client,
+                             apr_socket_t **server)
+{
+    apr_socket_t *listener;
+    apr_sockaddr_t *sa;
+
+    APR_ASSERT_SUCCESS(tc, "get loopback address",
+                       apr_sockaddr_info_get(&sa, "127.0.0.1", APR_INET, 0,
+                                             0, p));
+    APR_ASSERT_SUCCESS(tc, "create listener",
+                       apr_socket_create(&listener, sa->family, SOCK_STREAM,
+                                         APR_PROTO_TCP, p));
+    APR_ASSERT_SUCCESS(tc, "bind listener", apr_socket_bind(listener, sa));
+    APR_ASSERT_SUCCESS(tc, "listen", apr_socket_listen(listener, 1));
+    APR_ASSERT_SUCCESS(tc, "get listener address",
+                       apr_socket_addr_get(&sa, APR_LOCAL, listener));
+    APR_ASSERT_SUCCESS(tc, "create client",
+                       apr_socket_create(client, sa->family, SOCK_STREAM,
+                                         APR_PROTO_TCP, p));
+    APR_ASSERT_SUCCESS(tc, "connect", apr_socket_connect(*client, sa));
+    APR_ASSERT_SUCCESS(tc, "accept", apr_socket_accept(server, listener, p));
+    apr_socket_close(listener);
+}
+
+/* Write the brigade to the client socket with apr_brigade_send_socket(),
+ * reading from the server socket whenever the client one is full, and
+ * check that what is read is EXPECT, LEN bytes long, repeated if LEN is
+ * larger.  Return the number of calls it took.
+ */
+static int send_match(abts_case *tc, apr_socket_t *client,
+                      apr_socket_t *server, apr_bucket_brigade *bb,
+                      const char *expect,
+                      apr_size_t expect_len, apr_size_t len)
+{
+    char buf[8192];
+    apr_size_t received = 0, sent = 0, n;
+    apr_status_t rv;
+    int calls = 0, match = 1;
+
+    apr_socket_timeout_set(server, 0);
+    while (received < len) {
+        if (!APR_BRIGADE_EMPTY(bb)) {
+            rv = apr_brigade_send_socket(client, bb, 0, &n);
+            calls++;
+            sent += n;
+            if (rv != APR_SUCCESS) {
+                ABTS_ASSERT(tc, "socket full",
+                            APR_STATUS_IS_EAGAIN(rv)
+                            || APR_STATUS_IS_TIMEUP(rv));
+                ABTS_ASSERT(tc, "data left in the brigade",
+                            !APR_BRIGADE_EMPTY(bb));
+            }
+            else {
+                ABTS_ASSERT(tc, "all written", APR_BRIGADE_EMPTY(bb));
+                apr_socket_timeout_set(server, apr_time_from_sec(5));
+            }
+        }
+        do {
+            apr_size_t i, off, k;
+
+            n = sizeof(buf);
+            rv = apr_socket_recv(server, buf, &n);
+            for (i = 0; i < n; i += k) {
+                off = (received + i) % expect_len;
+                k = n - i < expect_len - off ? n - i : expect_len - off;
+                if (memcmp(buf + i, expect + off, k)) {
+                    match = 0;
+                }
+            }
+            received += n;
+        } while (rv == APR_SUCCESS && received < len);
+        if (rv != APR_SUCCESS) {
+            ABTS_ASSERT(tc, "receive would block", APR_STATUS_IS_EAGAIN(rv));
+            if (!APR_STATUS_IS_EAGAIN(rv)) {
+                break;
+            }
+        }
+    }
+
+    ABTS_SIZE_EQUAL(tc, len, sent);
+    ABTS_SIZE_EQUAL(tc, len, received);
+    ABTS_ASSERT(tc, "received data matches", match);
+    return calls;
+}
+
+#define SEND_FNAME "sendsocket.txt"
+
+static void test_send_socket(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_socket_t *client, *server;
+    apr_file_t *f;
+    char body[1000];
+    char *expect;
+    apr_size_t i;
+
+    for (i = 0; i < sizeof(body); i++) {
+        body[i] = 'a' + i % 26;
+    }
+    APR_ASSERT_SUCCESS(tc, "write test file",
+                       apr_file_open(&f, SEND_FNAME,
+                                     APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                                     | APR_FOPEN_TRUNCATE,
+                                     APR_FPROT_OS_DEFAULT, p));
+    APR_ASSERT_SUCCESS(tc, "write test file",
+                       apr_file_write_full(f, body, sizeof(body), NULL));
+    apr_file_close(f);
+    APR_ASSERT_SUCCESS(tc, "open test file",
+                       apr_file_open(&f, SEND_FNAME,
+                                     APR_FOPEN_READ
+                                     | APR_FOPEN_SENDFILE_ENABLED,
+                                     APR_FPROT_OS_DEFAULT, p));
+
+    make_socket_pair(tc, &client, &server);
+
+    /* headers, a sendfile()d file, trailers and a small file read */
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_heap_create("head ", 5, NULL, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_transient_create("er\n", 3, ba));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_flush_create(ba));
+    apr_brigade_insert_file(bb, f, 0, sizeof(body), p);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_pool_create("\ntrailer\n", 9, p,
+                                                       ba));
+    apr_brigade_insert_file(bb, f, 0, 10, p);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_eos_create(ba));
+
+    expect = apr_pstrcat(p, "head er\n", apr_pstrmemdup(p, body, sizeof(body)),
+                         "\ntrailer\n", apr_pstrmemdup(p, body, 10), NULL);
+    send_match(tc, client, server, bb, expect, strlen(expect),
+               strlen(expect));
+    ABTS_ASSERT(tc, "brigade emptied", APR_BRIGADE_EMPTY(bb));
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+    apr_file_close(f);
+    apr_file_remove(SEND_FNAME, p);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+/* A file bucket covering a part of the file only, between headers and
+ * trailers, must not send the file past its end.
+ */
+static void test_send_socket_range(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_socket_t *client, *server;
+    apr_file_t *f;
+    char body[2000];
+    char *expect;
+
+    memset(body, 'A', 1000);
+    memset(body + 1000, 'B', 1000);
+    APR_ASSERT_SUCCESS(tc, "write test file",
+                       apr_file_open(&f, SEND_FNAME,
+                                     APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                                     | APR_FOPEN_TRUNCATE,
+                                     APR_FPROT_OS_DEFAULT, p));
+    APR_ASSERT_SUCCESS(tc, "write test file",
+                       apr_file_write_full(f, body, sizeof(body), NULL));
+    apr_file_close(f);
+    APR_ASSERT_SUCCESS(tc, "open test file",
+                       apr_file_open(&f, SEND_FNAME,
+                                     APR_FOPEN_READ
+                                     | APR_FOPEN_SENDFILE_ENABLED,
+                                     APR_FPROT_OS_DEFAULT, p));
+
+    make_socket_pair(tc, &client, &server);
+
+    /* the A's only, then the last A's and the first B's */
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("HHHHHHHHHH", 10,
+                                                           ba));
+    apr_brigade_insert_file(bb, f, 0, 1000, p);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("TTTTTTTTTT", 10,
+                                                           ba));
+    apr_brigade_insert_file(bb, f, 500, 1000, p);
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_immortal_create("TTTTTTTTTT", 10,
+                                                           ba));
+
+    expect = apr_pstrcat(p, "HHHHHHHHHH", apr_pstrmemdup(p, body, 1000),
+                         "TTTTTTTTTT", apr_pstrmemdup(p, body + 500, 1000),
+                         "TTTTTTTTTT", NULL);
+    send_match(tc, client, server, bb, expect, strlen(expect),
+               strlen(expect));
+    ABTS_ASSERT(tc, "brigade emptied", APR_BRIGADE_EMPTY(bb));
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+    apr_file_close(f);
+    apr_file_remove(SEND_FNAME, p);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+#define SEND_CHUNK_SIZE 65536
+
+static char *make_chunk(void)
+{
+    char *chunk = apr_palloc(p, SEND_CHUNK_SIZE);
+    int i;
+
+    for (i = 0; i < SEND_CHUNK_SIZE; i++) {
+        chunk[i] = (char)(i * 7 % 251);
+    }
+    return chunk;
+}
+
+static void test_send_socket_partial(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_socket_t *client, *server;
+    char *chunk = make_chunk();
+    int i, calls;
+
+    /* 16MB do not fit in the socket buffers */
+    for (i = 0; i < 256; i++) {
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_transient_create(
+                                        chunk, SEND_CHUNK_SIZE, ba));
+    }
+
+    make_socket_pair(tc, &client, &server);
+    apr_socket_timeout_set(client, 0);
+
+    calls = send_match(tc, client, server, bb, chunk, SEND_CHUNK_SIZE,
+                       (apr_size_t)SEND_CHUNK_SIZE * 256);
+    ABTS_ASSERT(tc, "partial writes", calls > 1);
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+#if APR_HAS_THREADS
+
+typedef struct {
+    apr_socket_t *sock;
+    const char *expect;
+    apr_size_t len;
+    apr_size_t received;
+    int matches;
+} reader_t;
+
+/* Read what the other side sends, since zero-copy completions over the
+ * loopback only come once the data is read.
+ */
+static void * APR_THREAD_FUNC reader_thread(apr_thread_t *thd, void *data)
+{
+    reader_t *reader = data;
+    char buf[8192];
+    apr_size_t n, i;
+
+    reader->matches = 1;
+    while (reader->received < reader->len) {
+        n = sizeof(buf);
+        if (apr_socket_recv(reader->sock, buf, &n) != APR_SUCCESS) {
+            break;
+        }
+        for (i = 0; i < n; i++, reader->received++) {
+            if (buf[i] != reader->expect[reader->received % SEND_CHUNK_SIZE]) {
+                reader->matches = 0;
+            }
+        }
+    }
+
+    return NULL;
+}
+
+static void test_send_socket_zerocopy(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_socket_t *client, *server;
+    apr_thread_t *thread;
+    reader_t reader;
+    char *chunk = make_chunk();
+    apr_size_t len;
+    apr_status_t rv, retval;
+    int i;
+
+    for (i = 0; i < 64; i++) {
+        APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_transient_create(
+                                        chunk, SEND_CHUNK_SIZE, ba));
+    }
+
+    make_socket_pair(tc, &client, &server);
+    apr_socket_timeout_set(server, apr_time_from_sec(5));
+
+    memset(&reader, 0, sizeof(reader));
+    reader.sock = server;
+    reader.expect = chunk;
+    reader.len = (apr_size_t)SEND_CHUNK_SIZE * 64;
+    rv = apr_thread_create(&thread, NULL, reader_thread, &reader, p);
+    APR_ASSERT_SUCCESS(tc, "create the reader thread", rv);
+
+    /* A blocking socket, so all of it is written */
+    rv = apr_brigade_send_socket(client, bb, APR_BRIGADE_SEND_ZEROCOPY,
+                                 &len);
+    APR_ASSERT_SUCCESS(tc, "send the brigade", rv);
+    ABTS_SIZE_EQUAL(tc, reader.len, len);
+    ABTS_ASSERT(tc, "brigade is empty", APR_BRIGADE_EMPTY(bb));
+
+    apr_thread_join(&retval, thread);
+    ABTS_SIZE_EQUAL(tc, reader.len, reader.received);
+    ABTS_ASSERT(tc, "data received", reader.matches);
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+#endif /* APR_HAS_THREADS */
+
+static void test_socket_adaptive(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_socket_t *client, *server;
+    apr_bucket *e;
+    const char *str;
+    char *chunk = make_chunk();
+    apr_size_t len, n, max_len = 0;
+    int i;
+
+    make_socket_pair(tc, &client, &server);
+    apr_socket_timeout_set(server, apr_time_from_sec(5));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_socket_create_ex(
+                                    server, APR_BUCKET_SOCKET_ADAPTIVE, ba));
+
+    /* A small read does not pin a whole buffer */
+    len = 100;
+    APR_ASSERT_SUCCESS(tc, "send", apr_socket_send(client, chunk, &len));
+    e = APR_BRIGADE_FIRST(bb);
+    APR_ASSERT_SUCCESS(tc, "read", apr_bucket_read(e, &str, &len,
+                                                   APR_BLOCK_READ));
+    ABTS_SIZE_EQUAL(tc, 100, len);
+    ABTS_ASSERT(tc, "read into a heap bucket", APR_BUCKET_IS_HEAP(e));
+    ABTS_ASSERT(tc, "small buffer",
+                ((apr_bucket_heap *)e->data)->alloc_len
+                    <= APR_BUCKET_BUFF_SIZE / 2);
+    ABTS_ASSERT(tc, "followed by a socket bucket",
+                APR_BUCKET_IS_SOCKET(APR_BUCKET_NEXT(e)));
+    apr_bucket_delete(e);
+
+    /* Full reads grow */
+    for (i = 0; i < 8; i++) {
+        len = SEND_CHUNK_SIZE;
+        APR_ASSERT_SUCCESS(tc, "send chunk",
+                           apr_socket_send(client, chunk, &len));
+        for (n = 0; n < SEND_CHUNK_SIZE; n += len) {
+            e = APR_BRIGADE_FIRST(bb);
+            APR_ASSERT_SUCCESS(tc, "read chunk",
+                               apr_bucket_read(e, &str, &len,
+                                               APR_BLOCK_READ));
+            if (len > max_len) {
+                max_len = len;
+            }
+            apr_bucket_delete(e);
+        }
+    }
+    ABTS_ASSERT(tc, "reads larger than APR_BUCKET_BUFF_SIZE",
+                max_len > APR_BUCKET_BUFF_SIZE);
+    ABTS_ASSERT(tc, "reads up to APR_BUCKET_SOCKET_MAX_SIZE",
+                max_len <= APR_BUCKET_SOCKET_MAX_SIZE);
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
+static void test_socket_fionread(abts_case *tc, void *data)
+{
+    apr_bucket_alloc_t *ba = apr_bucket_alloc_create(p);
+    apr_bucket_brigade *bb = apr_brigade_create(p, ba);
+    apr_socket_t *client, *server;
+    apr_bucket *e;
+    const char *str;
+    char *chunk = make_chunk();
+    apr_size_t len;
+
+    make_socket_pair(tc, &client, &server);
+    apr_socket_timeout_set(server, apr_time_from_sec(5));
+    APR_BRIGADE_INSERT_TAIL(bb, apr_bucket_socket_create_ex(
+                                    server, APR_BUCKET_SOCKET_FIONREAD, ba));
+
+    /* Over the loopback it is all there once sent */
+    len = 20000;
+    APR_ASSERT_SUCCESS(tc, "send", apr_socket_send(client, chunk, &len));
+    e = APR_BRIGADE_FIRST(bb);
+    APR_ASSERT_SUCCESS(tc, "read", apr_bucket_read(e, &str, &len,
+                                                   APR_BLOCK_READ));
+    ABTS_SIZE_EQUAL(tc, 20000, len);
+    ABTS_ASSERT(tc, "data matches", memcmp(str, chunk, len) == 0);
+
+    apr_socket_close(client);
+    e = APR_BUCKET_NEXT(e);
+    APR_ASSERT_SUCCESS(tc, "read EOF", apr_bucket_read(e, &str, &len,
+                                                       APR_BLOCK_READ));
+    ABTS_SIZE_EQUAL(tc, 0, len);
+
+    apr_socket_close(server);
+    apr_brigade_destroy(bb);
+    apr_bucket_alloc_destroy(ba);
+}
+
 abts_suite *testbuckets(abts_suite *suite)
 {
     suite = ADD_SUITE(suite);
@@ -582,9 +1030,18 @@ abts_suite *testbuckets(abts_suite *suite)
     abts_run_test(suite, test_insertfile, NULL);
     abts_run_test(suite, test_manyfile, NULL);
     abts_run_test(suite, test_truncfile, NULL);
+    abts_run_test(suite, test_file_readahead, NULL);
     abts_run_test(suite, test_partition, NULL);
     abts_run_test(suite, test_write_split, NULL);
     abts_run_test(suite, test_write_putstrs, NULL);
+    abts_run_test(suite, test_send_socket, NULL);
+    abts_run_test(suite, test_send_socket_range, NULL);
+    abts_run_test(suite, test_send_socket_partial, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_send_socket_zerocopy, NULL);
+#endif
+    abts_run_test(suite, test_socket_adaptive, NULL);
+    abts_run_test(suite, test_socket_fionread, NULL);
 
     return suite;
 }
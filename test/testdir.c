@@ -21,7 +21,11 @@
 #include "apr_file_info.h"
 #include "apr_errno.h"
 #include "apr_general.h"
+#include "apr_hash.h"
 #include "apr_lib.h"
+#include "apr_strings.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_pool.h"
 #include "apr_thread_proc.h"
 #include "testutil.h"
 
@@ -443,6 +447,340 @@ static void test_readmore_info(abts_case* tc, void* data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
+#define BATCH_FILES 300
+
+static void make_batch_dir(abts_case *tc)
+{
+    apr_file_t *thefile;
+    char name[64];
+    int i;
+
+    APR_ASSERT_SUCCESS(tc, "mkdir", apr_dir_make("data/batchdir",
+                                                 APR_FPROT_OS_DEFAULT, p));
+    for (i = 0; i < BATCH_FILES; i++) {
+        apr_snprintf(name, sizeof name, "data/batchdir/file%d", i);
+        APR_ASSERT_SUCCESS(tc, "create file",
+                           apr_file_open(&thefile, name, APR_FOPEN_WRITE
+                                         | APR_FOPEN_CREATE,
+                                         APR_FPROT_OS_DEFAULT, p));
+        /* Sized after the number, to check the right stat goes with it */
+        APR_ASSERT_SUCCESS(tc, "write file",
+                           apr_file_write_full(thefile, name, i % 17, NULL));
+        apr_file_close(thefile);
+    }
+}
+
+static void remove_batch_dir(abts_case *tc)
+{
+    char name[64];
+    int i;
+
+    for (i = 0; i < BATCH_FILES; i++) {
+        apr_snprintf(name, sizeof name, "data/batchdir/file%d", i);
+        apr_file_remove(name, p);
+    }
+    APR_ASSERT_SUCCESS(tc, "rmdir", apr_dir_remove("data/batchdir", p));
+}
+
+static void test_read_batch(abts_case *tc, void *data)
+{
+    apr_int32_t wanted = APR_FINFO_TYPE | APR_FINFO_SIZE | APR_FINFO_NAME;
+    apr_finfo_t finfos[64];
+    char seen[BATCH_FILES] = { 0 };
+    apr_dir_t *dir;
+    apr_size_t i, nelts;
+    apr_status_t rv;
+    int files = 0, entries = 0, count = 0, n;
+
+    make_batch_dir(tc);
+    APR_ASSERT_SUCCESS(tc, "apr_dir_open failed",
+                       apr_dir_open(&dir, "data/batchdir", p));
+
+    for (;;) {
+        nelts = sizeof(finfos) / sizeof(finfos[0]);
+        rv = apr_dir_read_batch(finfos, &nelts, wanted, dir);
+        if (APR_STATUS_IS_ENOENT(rv)) {
+            ABTS_INT_EQUAL(tc, 0, (int)nelts);
+            break;
+        }
+        APR_ASSERT_SUCCESS(tc, "apr_dir_read_batch failed", rv);
+        ABTS_TRUE(tc, nelts > 0);
+
+        for (i = 0; i < nelts; i++) {
+            ABTS_INT_EQUAL(tc, wanted, finfos[i].valid & wanted);
+            entries++;
+            if (sscanf(finfos[i].name, "file%d", &n) != 1) {
+                continue;
+            }
+            ABTS_TRUE(tc, n >= 0 && n < BATCH_FILES);
+            if (n < 0 || n >= BATCH_FILES) {
+                continue;
+            }
+            ABTS_INT_EQUAL(tc, 0, seen[n]);
+            seen[n] = 1;
+            files++;
+            ABTS_INT_EQUAL(tc, APR_REG, finfos[i].filetype);
+            ABTS_INT_EQUAL(tc, n % 17, (int)finfos[i].size);
+        }
+    }
+    ABTS_INT_EQUAL(tc, BATCH_FILES, files);
+
+    /* Rewound, apr_dir_read() sees the same entries */
+    APR_ASSERT_SUCCESS(tc, "apr_dir_rewind failed", apr_dir_rewind(dir));
+    while (apr_dir_read(&finfos[0], APR_FINFO_DIRENT, dir) == APR_SUCCESS) {
+        count++;
+    }
+    ABTS_INT_EQUAL(tc, entries, count);
+
+    APR_ASSERT_SUCCESS(tc, "apr_dir_close failed", apr_dir_close(dir));
+    remove_batch_dir(tc);
+}
+
+/* What apr_dir_read() gives is what apr_stat() gives */
+static void test_read_stat(abts_case *tc, void *data)
+{
+    apr_int32_t wanted = APR_FINFO_NORM;
+    apr_finfo_t finfo, sinfo;
+    apr_dir_t *dir;
+    apr_status_t rv;
+    char name[64];
+    int found = 0;
+
+    make_batch_dir(tc);
+    APR_ASSERT_SUCCESS(tc, "apr_dir_open failed",
+                       apr_dir_open(&dir, "data/batchdir", p));
+
+    while (!APR_STATUS_IS_ENOENT(rv = apr_dir_read(&finfo, wanted, dir))) {
+        ABTS_TRUE(tc, rv == APR_SUCCESS || rv == APR_INCOMPLETE);
+        if (strncmp(finfo.name, "file", 4)) {
+            continue;
+        }
+        apr_snprintf(name, sizeof name, "data/batchdir/%s", finfo.name);
+        APR_ASSERT_SUCCESS(tc, "apr_stat failed",
+                           apr_stat(&sinfo, name, wanted | APR_FINFO_LINK, p));
+        ABTS_INT_EQUAL(tc, sinfo.valid & wanted, finfo.valid & wanted);
+        ABTS_INT_EQUAL(tc, sinfo.filetype, finfo.filetype);
+        ABTS_INT_EQUAL(tc, sinfo.protection, finfo.protection);
+        ABTS_TRUE(tc, sinfo.size == finfo.size);
+        ABTS_TRUE(tc, sinfo.inode == finfo.inode);
+        ABTS_TRUE(tc, sinfo.device == finfo.device);
+        ABTS_TRUE(tc, sinfo.mtime == finfo.mtime);
+        ABTS_TRUE(tc, sinfo.user == finfo.user);
+        found++;
+    }
+    ABTS_INT_EQUAL(tc, BATCH_FILES, found);
+
+    APR_ASSERT_SUCCESS(tc, "apr_dir_close failed", apr_dir_close(dir));
+    remove_batch_dir(tc);
+}
+
+/* data/walktree/d{0,1,2}/{f0..f3,s0/{f0,f1,f2},s1/{f0,f1,f2}} */
+#define WALK_ENTRIES (3 * (1 + 4 + 2 * (1 + 3)))
+#define WALK_DIRS (3 * (1 + 2))
+
+typedef struct walk_baton_t {
+    apr_hash_t *seen;       /* path -> order of the report */
+    int count;
+    int dirs;
+    int fail_at;
+    const char *skip;
+#if APR_HAS_THREADS
+    apr_thread_mutex_t *mutex;
+#endif
+} walk_baton_t;
+
+static apr_status_t walk_record(void *baton, const apr_finfo_t *finfo,
+                                apr_pool_t *pool)
+{
+    walk_baton_t *wb = baton;
+    apr_status_t rv = APR_SUCCESS;
+    int *order;
+
+#if APR_HAS_THREADS
+    if (wb->mutex)
+        apr_thread_mutex_lock(wb->mutex);
+#endif
+    order = apr_palloc(p, sizeof(*order));
+    *order = wb->count++;
+    apr_hash_set(wb->seen, apr_pstrdup(p, finfo->fname), APR_HASH_KEY_STRING,
+                 order);
+    if (finfo->filetype == APR_DIR) {
+        wb->dirs++;
+    }
+    if (wb->fail_at && wb->count == wb->fail_at) {
+        rv = APR_EGENERAL;
+    }
+#if APR_HAS_THREADS
+    if (wb->mutex)
+        apr_thread_mutex_unlock(wb->mutex);
+#endif
+    return rv;
+}
+
+static int walk_filter(void *baton, const apr_finfo_t *finfo)
+{
+    walk_baton_t *wb = baton;
+
+    return !wb->skip || strcmp(finfo->name, wb->skip) != 0;
+}
+
+static apr_status_t walk_remove(void *baton, const apr_finfo_t *finfo,
+                                apr_pool_t *pool)
+{
+    if (finfo->filetype == APR_DIR) {
+        return apr_dir_remove(finfo->fname, pool);
+    }
+    return apr_file_remove(finfo->fname, pool);
+}
+
+static void make_walk_tree(abts_case *tc)
+{
+    apr_file_t *thefile;
+    const char *dir, *name;
+    int d, s, f;
+
+    for (d = 0; d < 3; d++) {
+        for (s = -1; s < 2; s++) {
+            dir = s < 0 ? apr_psprintf(p, "data/walktree/d%d", d)
+                        : apr_psprintf(p, "data/walktree/d%d/s%d", d, s);
+            APR_ASSERT_SUCCESS(tc, "mkdir",
+                               apr_dir_make_recursive(dir,
+                                                      APR_FPROT_OS_DEFAULT,
+                                                      p));
+            for (f = 0; f < (s < 0 ? 4 : 3); f++) {
+                name = apr_psprintf(p, "%s/f%d", dir, f);
+                APR_ASSERT_SUCCESS(tc, "create file",
+                                   apr_file_open(&thefile, name,
+                                                 APR_FOPEN_WRITE
+                                                 | APR_FOPEN_CREATE,
+                                                 APR_FPROT_OS_DEFAULT, p));
+                apr_file_close(thefile);
+            }
+        }
+    }
+}
+
+static void remove_walk_tree(abts_case *tc)
+{
+    APR_ASSERT_SUCCESS(tc, "remove the tree",
+                       apr_dir_walk("data/walktree", 0,
+                                    APR_DIR_WALK_POSTORDER, NULL,
+                                    walk_remove, NULL, NULL, 0, p));
+    APR_ASSERT_SUCCESS(tc, "rmdir", apr_dir_remove("data/walktree", p));
+}
+
+/* Whether each directory was reported before (or after) its contents */
+static void check_walk_order(abts_case *tc, walk_baton_t *wb, int post)
+{
+    apr_hash_index_t *hi;
+    const char *path, *slash;
+    int *order, *parent_order;
+
+    for (hi = apr_hash_first(p, wb->seen); hi; hi = apr_hash_next(hi)) {
+        path = apr_hash_this_key(hi);
+        order = apr_hash_this_val(hi);
+        slash = strrchr(path, '/');
+        parent_order = apr_hash_get(wb->seen, path, slash - path);
+        if (parent_order) {
+            ABTS_TRUE(tc, post ? *parent_order > *order
+                               : *parent_order < *order);
+        }
+    }
+}
+
+static void walk_baton_init(walk_baton_t *wb)
+{
+    memset(wb, 0, sizeof(*wb));
+    wb->seen = apr_hash_make(p);
+}
+
+static void test_walk(abts_case *tc, void *data)
+{
+    walk_baton_t wb;
+
+    make_walk_tree(tc);
+
+    walk_baton_init(&wb);
+    APR_ASSERT_SUCCESS(tc, "pre-order walk",
+                       apr_dir_walk("data/walktree/", APR_FINFO_SIZE,
+                                    APR_DIR_WALK_PREORDER, NULL, walk_record,
+                                    &wb, NULL, 0, p));
+    ABTS_INT_EQUAL(tc, WALK_ENTRIES, wb.count);
+    ABTS_INT_EQUAL(tc, WALK_DIRS, wb.dirs);
+    ABTS_PTR_NOTNULL(tc, apr_hash_get(wb.seen, "data/walktree/d2/s1/f2",
+                                      APR_HASH_KEY_STRING));
+    check_walk_order(tc, &wb, 0);
+
+    walk_baton_init(&wb);
+    APR_ASSERT_SUCCESS(tc, "post-order walk",
+                       apr_dir_walk("data/walktree", 0,
+                                    APR_DIR_WALK_POSTORDER, NULL, walk_record,
+                                    &wb, NULL, 0, p));
+    ABTS_INT_EQUAL(tc, WALK_ENTRIES, wb.count);
+    check_walk_order(tc, &wb, 1);
+
+    /* Filtered out, s0 and all under it are skipped */
+    walk_baton_init(&wb);
+    wb.skip = "s0";
+    APR_ASSERT_SUCCESS(tc, "filtered walk",
+                       apr_dir_walk("data/walktree", 0, 0, walk_filter,
+                                    walk_record, &wb, NULL, 0, p));
+    ABTS_INT_EQUAL(tc, WALK_ENTRIES - 3 * (1 + 3), wb.count);
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_get(wb.seen, "data/walktree/d0/s0",
+                                          APR_HASH_KEY_STRING));
+
+    /* The callback's error stops the walk */
+    walk_baton_init(&wb);
+    wb.fail_at = 5;
+    ABTS_INT_EQUAL(tc, APR_EGENERAL,
+                   apr_dir_walk("data/walktree", 0, 0, NULL, walk_record,
+                                &wb, NULL, 0, p));
+    ABTS_INT_EQUAL(tc, 5, wb.count);
+
+    ABTS_TRUE(tc, APR_STATUS_IS_ENOENT(apr_dir_walk("data/walktree/none",
+                                                    0, 0, NULL, walk_record,
+                                                    &wb, NULL, 0, p)));
+
+    remove_walk_tree(tc);
+}
+
+#if APR_HAS_THREADS
+static void test_walk_parallel(abts_case *tc, void *data)
+{
+    apr_thread_pool_t *tp;
+    walk_baton_t wb;
+    int post;
+
+    make_walk_tree(tc);
+    APR_ASSERT_SUCCESS(tc, "create the thread pool",
+                       apr_thread_pool_create(&tp, 4, 4, p));
+
+    for (post = 0; post < 2; post++) {
+        walk_baton_init(&wb);
+        apr_thread_mutex_create(&wb.mutex, APR_THREAD_MUTEX_DEFAULT, p);
+        /* A queue of 2 has the threads walk some subdirectories inline */
+        APR_ASSERT_SUCCESS(tc, "parallel walk",
+                           apr_dir_walk("data/walktree", APR_FINFO_SIZE,
+                                        post ? APR_DIR_WALK_POSTORDER
+                                             : APR_DIR_WALK_PREORDER,
+                                        NULL, walk_record, &wb, tp, 2, p));
+        ABTS_INT_EQUAL(tc, WALK_ENTRIES, wb.count);
+        ABTS_INT_EQUAL(tc, WALK_DIRS, wb.dirs);
+        check_walk_order(tc, &wb, post);
+    }
+
+    walk_baton_init(&wb);
+    apr_thread_mutex_create(&wb.mutex, APR_THREAD_MUTEX_DEFAULT, p);
+    wb.fail_at = 3;
+    ABTS_INT_EQUAL(tc, APR_EGENERAL,
+                   apr_dir_walk("data/walktree", 0, 0, NULL, walk_record,
+                                &wb, tp, 0, p));
+
+    apr_thread_pool_destroy(tp);
+    remove_walk_tree(tc);
+}
+#endif
+
 abts_suite *testdir(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -464,6 +802,12 @@ abts_suite *testdir(abts_suite *suite)
     abts_run_test(suite, test_closedir, NULL);
     abts_run_test(suite, test_uncleared_errno, NULL);
     abts_run_test(suite, test_readmore_info, NULL);
+    abts_run_test(suite, test_read_batch, NULL);
+    abts_run_test(suite, test_read_stat, NULL);
+    abts_run_test(suite, test_walk, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_walk_parallel, NULL);
+#endif
 
     return suite;
 }
@@ -288,6 +288,81 @@ static void test_seek(abts_case *tc, void *data)
     apr_file_close(filetest);
 }
 
+static void test_read_at(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_off_t offset = 0;
+    apr_size_t nbytes = 256;
+    char *str = apr_pcalloc(p, nbytes + 1);
+    apr_file_t *filetest = NULL;
+
+    rv = apr_file_open(&filetest, FILENAME, APR_FOPEN_READ,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "Open test file " FILENAME, rv);
+
+    rv = apr_file_read_at(filetest, 5, str, &nbytes);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, strlen(TESTSTR) - 5, nbytes);
+    ABTS_STR_EQUAL(tc, &TESTSTR[5], str);
+
+    rv = apr_file_seek(filetest, APR_CUR, &offset);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_ASSERT(tc, "file position not moved", offset == 0);
+
+    nbytes = 256;
+    rv = apr_file_read_at(filetest, strlen(TESTSTR), str, &nbytes);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+    ABTS_SIZE_EQUAL(tc, 0, nbytes);
+
+    memset(str, 0, 257);
+    nbytes = 256;
+    rv = apr_file_read(filetest, str, &nbytes);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, TESTSTR, str);
+
+    apr_file_close(filetest);
+
+    /* Pending buffered writes are read */
+    rv = apr_file_open(&filetest, "data/file_readat.txt",
+                       APR_FOPEN_READ | APR_FOPEN_WRITE | APR_FOPEN_CREATE
+                       | APR_FOPEN_TRUNCATE | APR_FOPEN_BUFFERED,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "Open data/file_readat.txt", rv);
+
+    rv = apr_file_puts(TESTSTR, filetest);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    memset(str, 0, 257);
+    nbytes = 4;
+    rv = apr_file_read_at(filetest, 0, str, &nbytes);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, 4, nbytes);
+    ABTS_STR_EQUAL(tc, "This", str);
+
+    apr_file_close(filetest);
+    apr_file_remove("data/file_readat.txt", p);
+}
+
+static void test_readahead(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_file_t *filetest = NULL;
+
+    rv = apr_file_open(&filetest, FILENAME, APR_FOPEN_READ,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "Open test file " FILENAME, rv);
+
+    rv = apr_file_readahead(filetest, 0, 0);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_file_readahead");
+    }
+    else {
+        APR_ASSERT_SUCCESS(tc, "read ahead the whole file", rv);
+    }
+
+    apr_file_close(filetest);
+}
+
 static void test_userdata_set(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -2255,6 +2330,8 @@ abts_suite *testfile(abts_suite *suite)
     abts_run_test(suite, test_read, NULL);
     abts_run_test(suite, test_readzero, NULL);
     abts_run_test(suite, test_seek, NULL);
+    abts_run_test(suite, test_read_at, NULL);
+    abts_run_test(suite, test_readahead, NULL);
     abts_run_test(suite, test_filename, NULL);
     abts_run_test(suite, test_fileclose, NULL);
     abts_run_test(suite, test_file_remove, NULL);
@@ -539,6 +539,224 @@ static void overlay_fetch(abts_case *tc, void *data)
                        apr_hash_get(overlay, "overlay5", APR_HASH_KEY_STRING));
 }
 
+static void hashfunc_wide(abts_case *tc, void *data)
+{
+    static const apr_hashfunc_t funcs[] = {
+        apr_hashfunc_wyhash,
+        apr_hashfunc_siphash13
+    };
+    const char *key = "a key long enough to go through the 48 and 16 bytes "
+                      "steps of the wide hash functions";
+    apr_ssize_t len = strlen(key);
+    unsigned int hashes[128];
+    int f, i, j;
+
+    for (f = 0; f < 2; f++) {
+        apr_hash_t *h = apr_hash_make_custom(p, funcs[f]);
+        apr_ssize_t klen = APR_HASH_KEY_STRING;
+        unsigned int hash = funcs[f](key, &klen);
+
+        ABTS_INT_EQUAL(tc, len, klen);
+        ABTS_INT_EQUAL(tc, hash, funcs[f](key, &len));
+
+        /* All the prefixes of the key should hash differently */
+        for (i = 0; i <= len; i++) {
+            klen = i;
+            hashes[i] = funcs[f](key, &klen);
+            for (j = 0; j < i; j++) {
+                ABTS_ASSERT(tc, "prefix collision", hashes[i] != hashes[j]);
+            }
+        }
+
+        for (i = 0; i <= len; i++) {
+            apr_hash_set(h, key, i, key + i);
+        }
+        ABTS_INT_EQUAL(tc, len + 1, apr_hash_count(h));
+        for (i = 0; i <= len; i++) {
+            ABTS_PTR_EQUAL(tc, key + i, apr_hash_get(h, key, i));
+        }
+    }
+}
+
+static unsigned int hash_flat_constant(const char *key, apr_ssize_t *klen)
+{
+    if (*klen == APR_HASH_KEY_STRING)
+        *klen = strlen(key);
+    return 42;
+}
+
+static void flat_set_get(abts_case *tc, void *data)
+{
+    apr_hash_flat_t *h;
+    char *result;
+
+    h = apr_hash_make_flat(p);
+    ABTS_PTR_NOTNULL(tc, h);
+    ABTS_PTR_EQUAL(tc, p, apr_hash_flat_pool_get(h));
+
+    apr_hash_flat_set(h, "key", APR_HASH_KEY_STRING, "value");
+    result = apr_hash_flat_get(h, "key", APR_HASH_KEY_STRING);
+    ABTS_STR_EQUAL(tc, "value", result);
+
+    apr_hash_flat_set(h, "key", 3, "new");
+    result = apr_hash_flat_get(h, "key", APR_HASH_KEY_STRING);
+    ABTS_STR_EQUAL(tc, "new", result);
+    ABTS_INT_EQUAL(tc, 1, apr_hash_flat_count(h));
+
+    result = apr_hash_flat_get(h, "ke", APR_HASH_KEY_STRING);
+    ABTS_PTR_EQUAL(tc, NULL, result);
+
+    apr_hash_flat_set(h, "key", APR_HASH_KEY_STRING, NULL);
+    result = apr_hash_flat_get(h, "key", APR_HASH_KEY_STRING);
+    ABTS_PTR_EQUAL(tc, NULL, result);
+    ABTS_INT_EQUAL(tc, 0, apr_hash_flat_count(h));
+}
+
+static void flat_get_or_set(abts_case *tc, void *data)
+{
+    apr_hash_flat_t *h;
+    char *result;
+
+    h = apr_hash_make_flat(p);
+
+    result = apr_hash_flat_get_or_set(h, "key", APR_HASH_KEY_STRING, "value");
+    ABTS_STR_EQUAL(tc, "value", result);
+
+    result = apr_hash_flat_get_or_set(h, "key", APR_HASH_KEY_STRING, "other");
+    ABTS_STR_EQUAL(tc, "value", result);
+
+    apr_hash_flat_set(h, "key", APR_HASH_KEY_STRING, NULL);
+    result = apr_hash_flat_get_or_set(h, "key", APR_HASH_KEY_STRING, NULL);
+    ABTS_PTR_EQUAL(tc, NULL, result);
+    ABTS_INT_EQUAL(tc, 0, apr_hash_flat_count(h));
+}
+
+static void check_flat_keys(abts_case *tc, apr_hash_flat_t *h,
+                            char **keys, int from, int to, int n)
+{
+    int i;
+
+    for (i = 0; i < n; i++) {
+        char *result = apr_hash_flat_get(h, keys[i], APR_HASH_KEY_STRING);
+        if (i >= from && i < to) {
+            ABTS_PTR_EQUAL(tc, keys[i], result);
+        }
+        else {
+            ABTS_PTR_EQUAL(tc, NULL, result);
+        }
+    }
+}
+
+static void flat_grow_and_churn(abts_case *tc, apr_hash_flat_t *h)
+{
+    const int n = 5000;
+    char **keys = apr_palloc(p, n * sizeof(char *));
+    int i, j;
+
+    for (i = 0; i < n; i++) {
+        keys[i] = apr_psprintf(p, "key%d", i);
+        apr_hash_flat_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    ABTS_INT_EQUAL(tc, n, apr_hash_flat_count(h));
+    check_flat_keys(tc, h, keys, 0, n, n);
+
+    /* Slide a window of entries over the keys so that deleted slots get
+     * reused and rehashed in place.
+     */
+    for (j = 0; j < 4; j++) {
+        for (i = 0; i < n / 2; i++) {
+            apr_hash_flat_set(h, keys[i + j * n / 8], APR_HASH_KEY_STRING,
+                              NULL);
+        }
+        for (i = 0; i < n / 2; i++) {
+            apr_hash_flat_set(h, keys[i + j * n / 8], APR_HASH_KEY_STRING,
+                              keys[i + j * n / 8]);
+        }
+    }
+    ABTS_INT_EQUAL(tc, n, apr_hash_flat_count(h));
+    check_flat_keys(tc, h, keys, 0, n, n);
+
+    for (i = 0; i < n / 2; i++) {
+        apr_hash_flat_set(h, keys[i], APR_HASH_KEY_STRING, NULL);
+    }
+    ABTS_INT_EQUAL(tc, n - n / 2, apr_hash_flat_count(h));
+    check_flat_keys(tc, h, keys, n / 2, n, n);
+}
+
+static void flat_many(abts_case *tc, void *data)
+{
+    flat_grow_and_churn(tc, apr_hash_make_flat(p));
+}
+
+static void flat_collisions(abts_case *tc, void *data)
+{
+    flat_grow_and_churn(tc, apr_hash_make_flat_custom(p, hash_flat_constant));
+}
+
+static int flat_sum_cb(void *rec, const void *key, apr_ssize_t klen,
+                       const void *value)
+{
+    int *sums = rec;
+
+    sums[0] += *(const int *)key;
+    sums[1] += *(const int *)value;
+    return *(const int *)key != 99;
+}
+
+static void flat_traverse(abts_case *tc, void *data)
+{
+    apr_hash_flat_t *h, *h2;
+    apr_hash_flat_index_t *hi;
+    int keys[100], vals[100];
+    int i, count, ksum, vsum, sums[2];
+
+    h = apr_hash_make_flat(p);
+    for (i = 0; i < 100; i++) {
+        keys[i] = i;
+        vals[i] = i * 2;
+        apr_hash_flat_set(h, &keys[i], sizeof(int), &vals[i]);
+    }
+
+    count = ksum = vsum = 0;
+    for (hi = apr_hash_flat_first(p, h); hi; hi = apr_hash_flat_next(hi)) {
+        ABTS_INT_EQUAL(tc, sizeof(int), apr_hash_flat_this_key_len(hi));
+        ksum += *(const int *)apr_hash_flat_this_key(hi);
+        vsum += *(int *)apr_hash_flat_this_val(hi);
+        count++;
+    }
+    ABTS_INT_EQUAL(tc, 100, count);
+    ABTS_INT_EQUAL(tc, 4950, ksum);
+    ABTS_INT_EQUAL(tc, 9900, vsum);
+
+    /* Deleting the current entry while iterating */
+    h2 = apr_hash_flat_copy(p, h);
+    for (hi = apr_hash_flat_first(NULL, h2); hi; hi = apr_hash_flat_next(hi)) {
+        const void *key;
+        void *val;
+
+        apr_hash_flat_this(hi, &key, NULL, &val);
+        if (*(const int *)key % 2) {
+            apr_hash_flat_set(h2, key, sizeof(int), NULL);
+        }
+    }
+    ABTS_INT_EQUAL(tc, 50, apr_hash_flat_count(h2));
+    ABTS_INT_EQUAL(tc, 100, apr_hash_flat_count(h));
+
+    sums[0] = sums[1] = 0;
+    ABTS_INT_EQUAL(tc, 1, apr_hash_flat_do(flat_sum_cb, sums, h2));
+    ABTS_INT_EQUAL(tc, 2450, sums[0]);
+    ABTS_INT_EQUAL(tc, 4900, sums[1]);
+
+    sums[0] = sums[1] = 0;
+    ABTS_INT_EQUAL(tc, 0, apr_hash_flat_do(flat_sum_cb, sums, h));
+
+    apr_hash_flat_clear(h);
+    ABTS_INT_EQUAL(tc, 0, apr_hash_flat_count(h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_flat_first(NULL, h));
+    ABTS_PTR_EQUAL(tc, NULL, apr_hash_flat_get(h, &keys[0], sizeof(int)));
+    ABTS_INT_EQUAL(tc, 50, apr_hash_flat_count(h2));
+}
+
 abts_suite *testhash(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -565,6 +783,14 @@ abts_suite *testhash(abts_suite *suite)
     abts_run_test(suite, overlay_same, NULL);
     abts_run_test(suite, overlay_fetch, NULL);
 
+    abts_run_test(suite, hashfunc_wide, NULL);
+
+    abts_run_test(suite, flat_set_get, NULL);
+    abts_run_test(suite, flat_get_or_set, NULL);
+    abts_run_test(suite, flat_many, NULL);
+    abts_run_test(suite, flat_collisions, NULL);
+    abts_run_test(suite, flat_traverse, NULL);
+
     return suite;
 }
 
@@ -0,0 +1,199 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Hash functions benchmark: throughput of the apr_hashfunc_t functions
+ * across key lengths, and distribution of similar keys (URLs, session
+ * IDs) in a power of two number of buckets as used by apr_hash_t.
+ */
+
+#include "apr_pools.h"
+#include "apr_hash.h"
+#include "apr_strings.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_MAX_COUNTER 10000000
+#define DEFAULT_KEYS 1000000
+#define BUCKETS_BITS 16
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int num_keys = DEFAULT_KEYS;
+static volatile unsigned int sink; /* so that the hashes are computed */
+
+struct hashfunc {
+    const char *name;
+    apr_hashfunc_t func;
+};
+
+static const struct hashfunc hashfuncs[] = {
+    { "times33",   apr_hashfunc_default },
+    { "wyhash",    apr_hashfunc_wyhash },
+    { "siphash13", apr_hashfunc_siphash13 },
+};
+#define NUM_HASHFUNCS (int)(sizeof(hashfuncs) / sizeof(hashfuncs[0]))
+
+static const apr_ssize_t key_lengths[] = {
+    4, 8, 16, 32, 64, 128, 256, 1024
+};
+#define NUM_KEY_LENGTHS (int)(sizeof(key_lengths) / sizeof(key_lengths[0]))
+
+static void throughput(const char *buf)
+{
+    int f, l;
+
+    printf("Throughput in MB/s (nsec per hash)\n\n%-10s", "klen");
+    for (f = 0; f < NUM_HASHFUNCS; f++) {
+        printf(" %22s", hashfuncs[f].name);
+    }
+    printf("\n");
+
+    for (l = 0; l < NUM_KEY_LENGTHS; l++) {
+        apr_ssize_t len = key_lengths[l];
+        long count = max_counter * 16 / (len + 16);
+
+        printf("%-10" APR_SSIZE_T_FMT, len);
+        for (f = 0; f < NUM_HASHFUNCS; f++) {
+            unsigned int sum = 0;
+            apr_time_t start;
+            double nsec;
+            long i;
+
+            start = apr_time_now();
+            for (i = 0; i < count; i++) {
+                apr_ssize_t klen = len;
+                /* vary the key so that nothing gets hoisted */
+                sum += hashfuncs[f].func(buf + (i & 15), &klen);
+            }
+            nsec = (double)(apr_time_now() - start) * 1000 / count;
+            if (nsec <= 0) {
+                nsec = 0.001;
+            }
+            sink += sum;
+            printf(" %12.0f (%7.1f)", len / nsec * 1000, nsec);
+        }
+        printf("\n");
+    }
+}
+
+static void distribution(apr_pool_t *pool, const char *name,
+                         const char *fmt)
+{
+    const unsigned int nbuckets = 1u << BUCKETS_BITS;
+    unsigned int *buckets;
+    double expected = (double)num_keys / nbuckets;
+    char **keys;
+    int f, i;
+
+    keys = apr_palloc(pool, num_keys * sizeof(char *));
+    for (i = 0; i < num_keys; i++) {
+        keys[i] = apr_psprintf(pool, fmt, i, (unsigned)i * 7);
+    }
+    buckets = apr_palloc(pool, nbuckets * sizeof(*buckets));
+
+    for (f = 0; f < NUM_HASHFUNCS; f++) {
+        unsigned int max = 0;
+        double chi2 = 0;
+        unsigned int b;
+
+        memset(buckets, 0, nbuckets * sizeof(*buckets));
+        for (i = 0; i < num_keys; i++) {
+            apr_ssize_t klen = APR_HASH_KEY_STRING;
+            buckets[hashfuncs[f].func(keys[i], &klen) & (nbuckets - 1)]++;
+        }
+        for (b = 0; b < nbuckets; b++) {
+            double d = buckets[b] - expected;
+            chi2 += d * d / expected;
+            if (max < buckets[b]) {
+                max = buckets[b];
+            }
+        }
+        printf("%-10s %-10s %14.3f %10u\n", name, hashfuncs[f].name,
+               chi2 / (nbuckets - 1), max);
+    }
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    char *buf;
+    int i;
+
+    printf("APR Hash Functions Performance Test\n"
+           "===================================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:n:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+            if (max_counter < 1) {
+                fprintf(stderr, "Invalid counter\n");
+                exit(-1);
+            }
+        }
+        else if (optchar == 'n') {
+            num_keys = atoi(optarg);
+            if (num_keys < 1) {
+                fprintf(stderr, "Invalid number of keys\n");
+                exit(-1);
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    buf = apr_palloc(pool, key_lengths[NUM_KEY_LENGTHS - 1] + 16);
+    for (i = 0; i < key_lengths[NUM_KEY_LENGTHS - 1] + 16; i++) {
+        buf[i] = (char)('a' + i % 26);
+    }
+    throughput(buf);
+
+    printf("\nDistribution of %d keys in %u buckets (chi2/df ~ 1.0 is "
+           "uniform)\n\n", num_keys, 1u << BUCKETS_BITS);
+    printf("%-10s %-10s %14s %10s\n", "keys", "hash", "chi2/df",
+           "max chain");
+    distribution(pool, "short", "%d%x");
+    distribution(pool, "url", "http://www.example.com/some/path/to/a/"
+                              "resource/%d/index.html?id=%u");
+    distribution(pool, "session", "SESSIONID=0000000000000000000000000000"
+                                  "%016d%016u");
+
+    return 0;
+}
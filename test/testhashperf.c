@@ -0,0 +1,209 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Hash tables benchmark: insert, hit, miss and iteration costs of the
+ * chained apr_hash_t and the flat apr_hash_flat_t, from 1K to (by
+ * default) 10M entries.
+ */
+
+#include "apr_pools.h"
+#include "apr_hash.h"
+#include "apr_strings.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_MAX_ENTRIES 10000000
+#define MIN_LOOKUPS 1000000
+
+static int max_entries = DEFAULT_MAX_ENTRIES;
+
+struct result {
+    double insert, hit, miss, iterate;  /* nsec per entry/lookup */
+};
+
+static double nsec_per(apr_time_t start, long ops)
+{
+    return (double)(apr_time_now() - start) * 1000 / ops;
+}
+
+static int lookups(int n)
+{
+    return n < MIN_LOOKUPS ? MIN_LOOKUPS : n;
+}
+
+static void run_chained(apr_pool_t *pool, char **keys, char **misses, int n,
+                        struct result *r, long *check)
+{
+    apr_hash_t *h = apr_hash_make(pool);
+    apr_hash_index_t *hi;
+    apr_time_t start;
+    int i, ops = lookups(n);
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        apr_hash_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    r->insert = nsec_per(start, n);
+
+    start = apr_time_now();
+    for (i = 0; i < ops; i++) {
+        int k = (int)(((apr_uint64_t)i * 7919) % n);
+        *check += apr_hash_get(h, keys[k], APR_HASH_KEY_STRING) != NULL;
+    }
+    r->hit = nsec_per(start, ops);
+
+    start = apr_time_now();
+    for (i = 0; i < ops; i++) {
+        *check += apr_hash_get(h, misses[i % n], APR_HASH_KEY_STRING) != NULL;
+    }
+    r->miss = nsec_per(start, ops);
+
+    start = apr_time_now();
+    for (hi = apr_hash_first(NULL, h); hi; hi = apr_hash_next(hi)) {
+        *check += *(const char *)apr_hash_this_val(hi) == 'k';
+    }
+    r->iterate = nsec_per(start, n);
+}
+
+static void run_flat(apr_pool_t *pool, char **keys, char **misses, int n,
+                     struct result *r, long *check)
+{
+    apr_hash_flat_t *h = apr_hash_make_flat(pool);
+    apr_hash_flat_index_t *hi;
+    apr_time_t start;
+    int i, ops = lookups(n);
+
+    start = apr_time_now();
+    for (i = 0; i < n; i++) {
+        apr_hash_flat_set(h, keys[i], APR_HASH_KEY_STRING, keys[i]);
+    }
+    r->insert = nsec_per(start, n);
+
+    start = apr_time_now();
+    for (i = 0; i < ops; i++) {
+        int k = (int)(((apr_uint64_t)i * 7919) % n);
+        *check += apr_hash_flat_get(h, keys[k], APR_HASH_KEY_STRING) != NULL;
+    }
+    r->hit = nsec_per(start, ops);
+
+    start = apr_time_now();
+    for (i = 0; i < ops; i++) {
+        *check += apr_hash_flat_get(h, misses[i % n],
+                                    APR_HASH_KEY_STRING) != NULL;
+    }
+    r->miss = nsec_per(start, ops);
+
+    start = apr_time_now();
+    for (hi = apr_hash_flat_first(NULL, h); hi; hi = apr_hash_flat_next(hi)) {
+        *check += *(const char *)apr_hash_flat_this_val(hi) == 'k';
+    }
+    r->iterate = nsec_per(start, n);
+}
+
+static void print_result(const char *name, int n, const struct result *r)
+{
+    printf("%-8s %9d %10.1f %10.1f %10.1f %10.1f\n",
+           name, n, r->insert, r->hit, r->miss, r->iterate);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool, *subpool;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    char **keys, **misses;
+    int i, n;
+
+    printf("APR Hash Tables Performance Test\n"
+           "================================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "n:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'n') {
+            max_entries = atoi(optarg);
+            if (max_entries < 1000) {
+                fprintf(stderr, "Invalid number of entries (min 1000)\n");
+                exit(-1);
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    keys = apr_palloc(pool, max_entries * sizeof(char *));
+    misses = apr_palloc(pool, max_entries * sizeof(char *));
+    for (i = 0; i < max_entries; i++) {
+        keys[i] = apr_psprintf(pool, "key-%d-%x", i,
+                               (unsigned)i * 2654435761u);
+        misses[i] = apr_psprintf(pool, "miss-%d-%x", i,
+                                 (unsigned)i * 2654435761u);
+    }
+    apr_pool_create(&subpool, pool);
+
+    printf("times in nsec per entry (insert, iterate) or lookup (hit, miss)"
+           "\n\n");
+    printf("%-8s %9s %10s %10s %10s %10s\n",
+           "table", "entries", "insert", "hit", "miss", "iterate");
+
+    for (n = 1000; ; n *= 10) {
+        struct result r;
+        long check = 0;
+
+        if (n > max_entries) {
+            n = max_entries;
+        }
+
+        run_chained(subpool, keys, misses, n, &r, &check);
+        print_result("chained", n, &r);
+        apr_pool_clear(subpool);
+
+        run_flat(subpool, keys, misses, n, &r, &check);
+        print_result("flat", n, &r);
+        apr_pool_clear(subpool);
+
+        if (check != 2 * ((long)lookups(n) + n)) {
+            fprintf(stderr, "Inconsistent results for %d entries\n", n);
+            exit(-2);
+        }
+        if (n == max_entries) {
+            break;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,457 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_ioqueue.h"
+#include "apr_network_io.h"
+#include "apr_file_io.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include "abts.h"
+#include "testutil.h"
+
+#include <string.h>
+
+#define FILENAME "data/testioqueue.txt"
+#define MSG "ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+
+static apr_ioqueue_method_e method_iouring = APR_IOQUEUE_IOURING;
+static apr_ioqueue_method_e method_thread = APR_IOQUEUE_THREAD;
+
+/* The io_uring queues are not destroyed by the tests but with the pool at
+ * exit, the kernel may interrupt the next blocking call otherwise.
+ */
+static apr_ioqueue_t *make_ioqueue(abts_case *tc, void *data,
+                                   apr_uint32_t size)
+{
+    apr_ioqueue_method_e method = *(apr_ioqueue_method_e *)data;
+    apr_ioqueue_t *ioqueue = NULL;
+    apr_status_t rv;
+
+    rv = apr_ioqueue_create_ex(&ioqueue, size, p, APR_IOQUEUE_NODEFAULT,
+                               method);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, method == APR_IOQUEUE_IOURING
+                          ? "io_uring ioqueue" : "thread ioqueue");
+        return NULL;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, method == APR_IOQUEUE_IOURING ? "io_uring" : "thread",
+                   apr_ioqueue_method_name(ioqueue));
+
+    return ioqueue;
+}
+
+static void make_listener(abts_case *tc, apr_socket_t **listener,
+                          apr_sockaddr_t **sa)
+{
+    apr_status_t rv;
+
+    rv = apr_sockaddr_info_get(sa, "127.0.0.1", APR_INET, 0, 0, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't get the address", rv);
+    rv = apr_socket_create(listener, APR_INET, SOCK_STREAM, APR_PROTO_TCP,
+                           p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't create the listener", rv);
+    rv = apr_socket_bind(*listener, *sa);
+    APR_ASSERT_SUCCESS(tc, "Couldn't bind the listener", rv);
+    rv = apr_socket_listen(*listener, 5);
+    APR_ASSERT_SUCCESS(tc, "Couldn't listen", rv);
+    rv = apr_socket_addr_get(sa, APR_LOCAL, *listener);
+    APR_ASSERT_SUCCESS(tc, "Couldn't get the listener address", rv);
+}
+
+static void make_socket_pair(abts_case *tc, apr_socket_t **client,
+                             apr_socket_t **server)
+{
+    apr_socket_t *listener;
+    apr_sockaddr_t *sa;
+    apr_status_t rv;
+
+    make_listener(tc, &listener, &sa);
+    rv = apr_socket_create(client, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't create the client", rv);
+    rv = apr_socket_connect(*client, sa);
+    APR_ASSERT_SUCCESS(tc, "Couldn't connect", rv);
+    rv = apr_socket_accept(server, listener, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't accept", rv);
+    apr_socket_close(listener);
+}
+
+/* Reap (up to 5s) until n completions are returned */
+static int reap_all(abts_case *tc, apr_ioqueue_t *ioqueue,
+                    apr_ioqueue_completion_t *completions, int n)
+{
+    apr_int32_t num;
+    apr_status_t rv;
+    int got = 0, i;
+
+    for (i = 0; i < 50 && got < n; i++) {
+        rv = apr_ioqueue_reap(ioqueue, apr_time_from_msec(100),
+                              completions + got, n - got, &num);
+        if (rv == APR_SUCCESS) {
+            got += num;
+        }
+        else if (!APR_STATUS_IS_TIMEUP(rv)) {
+            APR_ASSERT_SUCCESS(tc, "Couldn't reap", rv);
+            break;
+        }
+    }
+    ABTS_INT_EQUAL(tc, n, got);
+
+    return got;
+}
+
+static void test_recv_send(abts_case *tc, void *data)
+{
+    apr_ioqueue_t *ioqueue = make_ioqueue(tc, data, 4);
+    apr_ioqueue_completion_t completions[2];
+    apr_socket_t *client, *server;
+    apr_int32_t num;
+    apr_status_t rv;
+    char buf[64];
+    int i, recv_idx;
+
+    if (!ioqueue) {
+        return;
+    }
+    make_socket_pair(tc, &client, &server);
+
+    rv = apr_ioqueue_submit_recv(ioqueue, server, buf, sizeof(buf), buf);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, apr_ioqueue_pending(ioqueue));
+
+    /* Nothing to receive yet */
+    rv = apr_ioqueue_reap(ioqueue, 0, completions, 2, &num);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, num);
+    rv = apr_ioqueue_reap(ioqueue, apr_time_from_msec(50), completions, 2,
+                          &num);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+
+    rv = apr_ioqueue_submit_send(ioqueue, client, MSG, strlen(MSG), client);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 2, apr_ioqueue_pending(ioqueue));
+
+    reap_all(tc, ioqueue, completions, 2);
+    ABTS_INT_EQUAL(tc, 0, apr_ioqueue_pending(ioqueue));
+
+    recv_idx = completions[0].op == APR_IOQUEUE_RECV ? 0 : 1;
+    for (i = 0; i < 2; i++) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, completions[i].status);
+        ABTS_SIZE_EQUAL(tc, strlen(MSG), completions[i].len);
+        if (i == recv_idx) {
+            ABTS_INT_EQUAL(tc, APR_IOQUEUE_RECV, completions[i].op);
+            ABTS_PTR_EQUAL(tc, buf, completions[i].baton);
+        }
+        else {
+            ABTS_INT_EQUAL(tc, APR_IOQUEUE_SEND, completions[i].op);
+            ABTS_PTR_EQUAL(tc, client, completions[i].baton);
+        }
+    }
+    ABTS_INT_EQUAL(tc, 0, memcmp(buf, MSG, strlen(MSG)));
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+}
+
+static void test_sendv_eof(abts_case *tc, void *data)
+{
+    apr_ioqueue_t *ioqueue = make_ioqueue(tc, data, 4);
+    apr_ioqueue_completion_t completions[1];
+    apr_socket_t *client, *server;
+    struct iovec vec[3];
+    apr_status_t rv;
+    apr_size_t len;
+    char buf[64];
+
+    if (!ioqueue) {
+        return;
+    }
+    make_socket_pair(tc, &client, &server);
+
+    vec[0].iov_base = "ABCDEFGH";
+    vec[0].iov_len = 8;
+    vec[1].iov_base = "IJKLMNOPQ";
+    vec[1].iov_len = 9;
+    vec[2].iov_base = "RSTUVWXYZ";
+    vec[2].iov_len = 9;
+    rv = apr_ioqueue_submit_sendv(ioqueue, client, vec, 3, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    reap_all(tc, ioqueue, completions, 1);
+    ABTS_INT_EQUAL(tc, APR_IOQUEUE_SENDV, completions[0].op);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, completions[0].status);
+    ABTS_SIZE_EQUAL(tc, strlen(MSG), completions[0].len);
+
+    len = strlen(MSG);
+    rv = apr_socket_recv(server, buf, &len);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, strlen(MSG), len);
+    ABTS_INT_EQUAL(tc, 0, memcmp(buf, MSG, strlen(MSG)));
+
+    rv = apr_ioqueue_submit_recv(ioqueue, server, buf, sizeof(buf), NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_socket_close(client);
+    reap_all(tc, ioqueue, completions, 1);
+    ABTS_INT_EQUAL(tc, APR_IOQUEUE_RECV, completions[0].op);
+    ABTS_INT_EQUAL(tc, APR_EOF, completions[0].status);
+    ABTS_SIZE_EQUAL(tc, 0, completions[0].len);
+
+    apr_socket_close(server);
+}
+
+static void test_accept(abts_case *tc, void *data)
+{
+    apr_ioqueue_t *ioqueue = make_ioqueue(tc, data, 4);
+    apr_ioqueue_completion_t completions[1];
+    apr_socket_t *listener, *client;
+    apr_sockaddr_t *sa, *remote, *local;
+    apr_status_t rv;
+    apr_size_t len;
+    char buf[64];
+
+    if (!ioqueue) {
+        return;
+    }
+    make_listener(tc, &listener, &sa);
+
+    rv = apr_ioqueue_submit_accept(ioqueue, listener, p, listener);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_ioqueue_flush(ioqueue);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_socket_create(&client, APR_INET, SOCK_STREAM, APR_PROTO_TCP, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't create the client", rv);
+    rv = apr_socket_connect(client, sa);
+    APR_ASSERT_SUCCESS(tc, "Couldn't connect", rv);
+
+    reap_all(tc, ioqueue, completions, 1);
+    ABTS_INT_EQUAL(tc, APR_IOQUEUE_ACCEPT, completions[0].op);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, completions[0].status);
+    ABTS_PTR_EQUAL(tc, listener, completions[0].baton);
+    ABTS_PTR_NOTNULL(tc, completions[0].accepted);
+    if (!completions[0].accepted) {
+        return;
+    }
+
+    /* The accepted socket's remote is the client */
+    rv = apr_socket_addr_get(&remote, APR_REMOTE, completions[0].accepted);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_socket_addr_get(&local, APR_LOCAL, client);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, local->port, remote->port);
+
+    len = strlen(MSG);
+    rv = apr_socket_send(completions[0].accepted, MSG, &len);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    len = sizeof(buf);
+    rv = apr_socket_recv(client, buf, &len);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_SIZE_EQUAL(tc, strlen(MSG), len);
+
+    apr_socket_close(completions[0].accepted);
+    apr_socket_close(client);
+    apr_socket_close(listener);
+}
+
+static void test_file(abts_case *tc, void *data)
+{
+    apr_ioqueue_t *ioqueue = make_ioqueue(tc, data, 4);
+    apr_ioqueue_completion_t completions[2];
+    apr_file_t *f;
+    apr_off_t off = 0;
+    apr_status_t rv;
+    char buf[64];
+
+    if (!ioqueue) {
+        return;
+    }
+
+    rv = apr_file_open(&f, FILENAME, APR_FOPEN_READ | APR_FOPEN_WRITE
+                       | APR_FOPEN_CREATE | APR_FOPEN_TRUNCATE,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't open the file", rv);
+
+    /* At an offset, the position is unchanged */
+    rv = apr_ioqueue_submit_write(ioqueue, f, MSG, strlen(MSG), 0, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    reap_all(tc, ioqueue, completions, 1);
+    ABTS_INT_EQUAL(tc, APR_IOQUEUE_WRITE, completions[0].op);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, completions[0].status);
+    ABTS_SIZE_EQUAL(tc, strlen(MSG), completions[0].len);
+    rv = apr_file_seek(f, APR_CUR, &off);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, (int)off);
+
+    memset(buf, 0, sizeof(buf));
+    rv = apr_ioqueue_submit_read(ioqueue, f, buf, 10, 16, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    reap_all(tc, ioqueue, completions, 1);
+    ABTS_INT_EQUAL(tc, APR_IOQUEUE_READ, completions[0].op);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, completions[0].status);
+    ABTS_SIZE_EQUAL(tc, 10, completions[0].len);
+    ABTS_STR_EQUAL(tc, "QRSTUVWXYZ", buf);
+
+    /* At the current position, which moves */
+    memset(buf, 0, sizeof(buf));
+    rv = apr_ioqueue_submit_read(ioqueue, f, buf, 20, -1, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    reap_all(tc, ioqueue, completions, 1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, completions[0].status);
+    ABTS_SIZE_EQUAL(tc, 20, completions[0].len);
+    ABTS_STR_EQUAL(tc, "ABCDEFGHIJKLMNOPQRST", buf);
+
+    rv = apr_ioqueue_submit_read(ioqueue, f, buf, sizeof(buf), -1, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    reap_all(tc, ioqueue, completions, 1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, completions[0].status);
+    ABTS_SIZE_EQUAL(tc, 6, completions[0].len);
+
+    rv = apr_ioqueue_submit_read(ioqueue, f, buf, sizeof(buf), -1, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    reap_all(tc, ioqueue, completions, 1);
+    ABTS_INT_EQUAL(tc, APR_EOF, completions[0].status);
+    ABTS_SIZE_EQUAL(tc, 0, completions[0].len);
+
+    apr_file_close(f);
+
+    /* Buffered files are refused */
+    rv = apr_file_open(&f, FILENAME, APR_FOPEN_READ | APR_FOPEN_BUFFERED,
+                       APR_FPROT_OS_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "Couldn't open the file", rv);
+    rv = apr_ioqueue_submit_read(ioqueue, f, buf, sizeof(buf), 0, NULL);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+    ABTS_INT_EQUAL(tc, 0, apr_ioqueue_pending(ioqueue));
+    apr_file_close(f);
+
+    apr_file_remove(FILENAME, p);
+}
+
+static void test_full(abts_case *tc, void *data)
+{
+    apr_ioqueue_t *ioqueue = make_ioqueue(tc, data, 2);
+    apr_ioqueue_completion_t completions[2];
+    apr_socket_t *client, *server;
+    apr_status_t rv;
+    apr_size_t len;
+    char buf1[8], buf2[8];
+
+    if (!ioqueue) {
+        return;
+    }
+    make_socket_pair(tc, &client, &server);
+
+    rv = apr_ioqueue_submit_recv(ioqueue, server, buf1, 1, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_ioqueue_submit_recv(ioqueue, server, buf2, 1, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_ioqueue_submit_recv(ioqueue, server, buf2, 1, NULL);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_EAGAIN(rv));
+    ABTS_INT_EQUAL(tc, 2, apr_ioqueue_pending(ioqueue));
+
+    len = 2;
+    rv = apr_socket_send(client, "xy", &len);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    reap_all(tc, ioqueue, completions, 2);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, completions[0].status);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, completions[1].status);
+    ABTS_INT_EQUAL(tc, 'x' + 'y', buf1[0] + buf2[0]);
+
+    /* Room again */
+    rv = apr_ioqueue_submit_recv(ioqueue, server, buf1, 1, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_socket_close(client);
+    reap_all(tc, ioqueue, completions, 1);
+    ABTS_INT_EQUAL(tc, APR_EOF, completions[0].status);
+
+    apr_socket_close(server);
+}
+
+static void test_destroy_pending(abts_case *tc, void *data)
+{
+    apr_ioqueue_t *ioqueue = make_ioqueue(tc, data, 2);
+    apr_socket_t *client, *server;
+    apr_status_t rv;
+    char buf[8];
+
+    if (!ioqueue) {
+        return;
+    }
+    make_socket_pair(tc, &client, &server);
+
+    rv = apr_ioqueue_submit_recv(ioqueue, server, buf, sizeof(buf), NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_ioqueue_flush(ioqueue);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* The thread pool emulation needs the socket shut down, io_uring
+     * cancels the recv.
+     */
+    if (*(apr_ioqueue_method_e *)data == APR_IOQUEUE_THREAD) {
+        apr_socket_shutdown(server, APR_SHUTDOWN_READWRITE);
+    }
+    rv = apr_ioqueue_destroy(ioqueue);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* Let the kernel release the io_uring instance (it interrupts the
+     * next blocking call, a sleep is restarted transparently).
+     */
+    apr_sleep(apr_time_from_msec(10));
+
+    apr_socket_close(client);
+    apr_socket_close(server);
+}
+
+static void test_default(abts_case *tc, void *data)
+{
+    apr_ioqueue_t *ioqueue;
+    apr_status_t rv;
+    const char *name;
+
+    rv = apr_ioqueue_create(&ioqueue, 1, p, 0);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "ioqueue");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    name = apr_ioqueue_method_name(ioqueue);
+    ABTS_ASSERT(tc, name,
+                !strcmp(name, "io_uring") || !strcmp(name, "thread"));
+
+    rv = apr_ioqueue_create(&ioqueue, 0, p, 0);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+}
+
+abts_suite *testioqueue(abts_suite *suite)
+{
+    apr_ioqueue_method_e *methods[2];
+    int i;
+
+    suite = ADD_SUITE(suite);
+
+    methods[0] = &method_iouring;
+    methods[1] = &method_thread;
+
+    abts_run_test(suite, test_default, NULL);
+    for (i = 0; i < 2; i++) {
+        abts_run_test(suite, test_recv_send, methods[i]);
+        abts_run_test(suite, test_sendv_eof, methods[i]);
+        abts_run_test(suite, test_accept, methods[i]);
+        abts_run_test(suite, test_file, methods[i]);
+        abts_run_test(suite, test_full, methods[i]);
+        abts_run_test(suite, test_destroy_pending, methods[i]);
+    }
+
+    return suite;
+}
@@ -0,0 +1,204 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Memcache server selection benchmark: cost of a key to server lookup
+ * with the default (crc32 modulo the number of servers) and the
+ * consistent hashing (ketama) selection, for increasing numbers of
+ * servers, and the share of the keys moved when a server is added.
+ * No memcached server is needed, nothing is sent over the network.
+ */
+
+#include "apr_memcache.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_MAX_COUNTER 1000000
+#define NUM_KEYS 10000
+#define MAX_SERVERS 64
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static unsigned int points = APR_MEMCACHE_KETAMA_POINTS;
+
+static const char *keys[NUM_KEYS];
+static apr_size_t lens[NUM_KEYS];
+static apr_memcache_server_t *owners[NUM_KEYS];
+
+static apr_memcache_server_t *lookup(apr_memcache_t *mc, int i)
+{
+    return apr_memcache_find_server_hash(mc,
+                                         apr_memcache_hash(mc, keys[i],
+                                                           lens[i]));
+}
+
+static void setup(apr_memcache_t **mc, apr_memcache_server_t **servers,
+                  int nservers, int ketama, apr_pool_t *pool)
+{
+    apr_memcache_ketama_t *ring;
+    int i;
+
+    if (apr_memcache_create(pool, MAX_SERVERS + 1, 0, mc) != APR_SUCCESS) {
+        fprintf(stderr, "Could not create the memcache\n");
+        exit(-1);
+    }
+    for (i = 0; i < nservers; i++) {
+        apr_memcache_add_server(*mc, servers[i]);
+    }
+    if (ketama) {
+        if (apr_memcache_ketama_create(&ring, *mc, NULL, points, pool)
+                != APR_SUCCESS) {
+            fprintf(stderr, "Could not create the ring\n");
+            exit(-1);
+        }
+        (*mc)->hash_func = apr_memcache_hash_ketama;
+        (*mc)->server_func = apr_memcache_find_server_hash_ketama;
+        (*mc)->server_baton = ring;
+    }
+}
+
+/* nsec per lookup */
+static double time_lookups(apr_memcache_t *mc)
+{
+    apr_time_t start, end;
+    apr_size_t sum = 0;
+    long i;
+
+    start = apr_time_now();
+    for (i = 0; i < max_counter; i++) {
+        sum += (apr_size_t)lookup(mc, (int)(i % NUM_KEYS));
+    }
+    end = apr_time_now();
+
+    /* don't let the compiler drop the lookups */
+    if (sum == 1) {
+        printf("\n");
+    }
+
+    return (double)(end - start) * 1000 / max_counter;
+}
+
+/* percentage of the keys which change server when one is added */
+static double moved_keys(apr_memcache_server_t **servers, int nservers,
+                         int ketama, apr_pool_t *pool)
+{
+    apr_memcache_t *mc;
+    int i, moved = 0;
+
+    setup(&mc, servers, nservers, ketama, pool);
+    for (i = 0; i < NUM_KEYS; i++) {
+        owners[i] = lookup(mc, i);
+    }
+    setup(&mc, servers, nservers + 1, ketama, pool);
+    for (i = 0; i < NUM_KEYS; i++) {
+        moved += lookup(mc, i) != owners[i];
+    }
+
+    return 100.0 * moved / NUM_KEYS;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool, *subpool;
+    apr_memcache_server_t *servers[MAX_SERVERS + 1];
+    apr_memcache_t *mc;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i, n;
+
+    printf("APR Memcache Server Selection Performance Test\n"
+           "==============================================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:p:v", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+            if (max_counter < 1) {
+                fprintf(stderr, "Invalid counter\n");
+                exit(-1);
+            }
+        }
+        else if (optchar == 'p') {
+            points = (unsigned int)atoi(optarg);
+            if (points < 1) {
+                fprintf(stderr, "Invalid number of points\n");
+                exit(-1);
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    for (i = 0; i < NUM_KEYS; i++) {
+        keys[i] = apr_psprintf(pool, "testketamaperf:%d", i);
+        lens[i] = strlen(keys[i]);
+    }
+    for (i = 0; i <= MAX_SERVERS; i++) {
+        if (apr_memcache_server_create(pool, "localhost",
+                                       (apr_port_t)(11211 + i), 0, 1, 1,
+                                       apr_time_from_sec(60), &servers[i])
+                != APR_SUCCESS) {
+            fprintf(stderr, "Could not create the servers\n");
+            exit(-1);
+        }
+    }
+
+    printf("%ld lookups, %u points per server\n\n", max_counter, points);
+    printf("%8s %12s %12s %12s %12s\n", "", "nsec/lookup", "",
+           "% moved", "");
+    printf("%8s %12s %12s %12s %12s\n", "servers", "default", "ketama",
+           "default", "ketama");
+
+    apr_pool_create(&subpool, pool);
+    for (n = 2; n <= MAX_SERVERS; n *= 2) {
+        double tdefault, tketama, mdefault, mketama;
+
+        setup(&mc, servers, n, 0, subpool);
+        tdefault = time_lookups(mc);
+        setup(&mc, servers, n, 1, subpool);
+        tketama = time_lookups(mc);
+        mdefault = moved_keys(servers, n, 0, subpool);
+        mketama = moved_keys(servers, n, 1, subpool);
+        printf("%8d %12.1f %12.1f %12.1f %12.1f\n", n, tdefault, tketama,
+               mdefault, mketama);
+        apr_pool_clear(subpool);
+    }
+
+    return 0;
+}
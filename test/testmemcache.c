@@ -742,17 +742,558 @@ static void test_connection_validation(abts_case *tc, void *data)
     apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
 }
 
+/* pipelined operations, against the mock serving the protocol */
+
+#define PIPELINE_SERVERS 3
+#define PIPELINE_KEYS 200
+#define PIPELINE_BIG_SIZE (256 * 1024)
+
+static apr_status_t start_mock_servers(apr_proc_t *proc, int servers,
+                                       apr_pool_t *pool)
+{
+    apr_procattr_t *procattr;
+    apr_sockaddr_t *sa;
+    apr_socket_t *sock;
+    apr_status_t rv;
+    const char *args[6];
+    int i;
+
+    args[0] = "memcachedmock" EXTENSION;
+    args[1] = "-p";
+    args[2] = apr_itoa(pool, MOCK_SERVERS_PORT);
+    args[3] = "-n";
+    args[4] = apr_itoa(pool, servers);
+    args[5] = NULL;
+
+    if ((rv = apr_procattr_create(&procattr, pool)) != APR_SUCCESS
+        || (rv = apr_procattr_io_set(procattr, APR_NO_PIPE, APR_NO_PIPE,
+                                     APR_NO_PIPE)) != APR_SUCCESS
+        || (rv = apr_procattr_error_check_set(procattr, 1)) != APR_SUCCESS
+        || (rv = apr_procattr_cmdtype_set(procattr, APR_PROGRAM_ENV))
+            != APR_SUCCESS
+        || (rv = apr_proc_create(proc, TESTBINPATH "memcachedmock" EXTENSION,
+                                 args, NULL, procattr, pool)) != APR_SUCCESS
+        || (rv = apr_sockaddr_info_get(&sa, MOCK_HOST, APR_UNSPEC,
+                                       MOCK_SERVERS_PORT + servers - 1, 0,
+                                       pool)) != APR_SUCCESS) {
+        return rv;
+    }
+
+    /* Wait for the last server to listen */
+    for (i = 0; i < 50; i++) {
+        rv = apr_socket_create(&sock, sa->family, SOCK_STREAM, 0, pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        rv = apr_socket_connect(sock, sa);
+        apr_socket_close(sock);
+        if (rv == APR_SUCCESS) {
+            break;
+        }
+        apr_sleep(apr_time_from_msec(100));
+    }
+    return rv;
+}
+
+static void pipeline_count(void *baton, apr_memcache_value_t *value)
+{
+    (*(int *)baton)++;
+}
+
+/* data is NULL, or points to the flags of the memcache */
+static void test_memcache_pipeline(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *tmppool;
+    apr_status_t rv;
+    apr_memcache_t *memcache;
+    apr_memcache_server_t *server;
+    apr_memcache_pipeline_t *pipeline;
+    apr_memcache_value_t *values[PIPELINE_KEYS + 1], *value;
+    apr_hash_t *mvalues = NULL;
+    apr_proc_t proc;
+    apr_exit_why_e why;
+    const char *keys[PIPELINE_KEYS];
+    char *big;
+    int exitcode, count, i;
+
+    apr_pool_create(&pool, p);
+
+    rv = start_mock_servers(&proc, PIPELINE_SERVERS, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS) {
+        return;
+    }
+
+    /* and one more server which is down */
+    rv = apr_memcache_create(pool, PIPELINE_SERVERS + 1,
+                             data ? *(apr_uint32_t *)data : 0, &memcache);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < PIPELINE_SERVERS; i++) {
+        rv = apr_memcache_server_create(pool, MOCK_HOST, MOCK_SERVERS_PORT + i,
+                                        0, 1, 1, apr_time_from_sec(60),
+                                        &server);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_memcache_add_server(memcache, server);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    rv = apr_memcache_pipeline_create(&pipeline, memcache, pipeline_count,
+                                      &count, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* nothing queued */
+    rv = apr_memcache_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* a value larger than the socket buffers, and an empty one */
+    big = apr_palloc(pool, PIPELINE_BIG_SIZE);
+    for (i = 0; i < PIPELINE_BIG_SIZE; i++) {
+        big[i] = 'a' + i % 26;
+    }
+
+    count = 0;
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        keys[i] = apr_psprintf(pool, "%spipeline%d", prefix, i);
+        if (i == 0) {
+            rv = apr_memcache_pipeline_set(pipeline, keys[i], big,
+                                           PIPELINE_BIG_SIZE, 0, 7,
+                                           &values[i]);
+        }
+        else if (i == 1) {
+            rv = apr_memcache_pipeline_set(pipeline, keys[i], "", 0, 0, 0,
+                                           &values[i]);
+        }
+        else {
+            rv = apr_memcache_pipeline_set(pipeline, keys[i],
+                                           (char *)keys[i], strlen(keys[i]),
+                                           0, (apr_uint16_t)i, &values[i]);
+        }
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_INCOMPLETE, values[i]->status);
+    }
+    rv = apr_memcache_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, PIPELINE_KEYS, count);
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, values[i]->status);
+    }
+
+    /* all the keys and a missing one, with the callback only */
+    count = 0;
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        rv = apr_memcache_pipeline_get(pipeline, keys[i], &values[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_memcache_pipeline_get(pipeline, "pipelinemissing", NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, PIPELINE_KEYS + 1, count);
+
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, values[0]->status);
+    ABTS_INT_EQUAL(tc, PIPELINE_BIG_SIZE, values[0]->len);
+    ABTS_INT_EQUAL(tc, 7, values[0]->flags);
+    ABTS_TRUE(tc, memcmp(values[0]->data, big, PIPELINE_BIG_SIZE) == 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, values[1]->status);
+    ABTS_INT_EQUAL(tc, 0, values[1]->len);
+    for (i = 2; i < PIPELINE_KEYS; i++) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, values[i]->status);
+        ABTS_INT_EQUAL(tc, i, values[i]->flags);
+        ABTS_STR_EQUAL(tc, keys[i], values[i]->data);
+    }
+
+    /* what multgetp reads from the same servers */
+    for (i = 2; i < PIPELINE_KEYS; i++) {
+        apr_memcache_add_multget_key(pool, keys[i], &mvalues);
+    }
+    apr_pool_create(&tmppool, pool);
+    rv = apr_memcache_multgetp(memcache, tmppool, pool, mvalues);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 2; i < PIPELINE_KEYS; i++) {
+        value = apr_hash_get(mvalues, keys[i], APR_HASH_KEY_STRING);
+        ABTS_PTR_NOTNULL(tc, value);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, value->status);
+        ABTS_STR_EQUAL(tc, values[i]->data, value->data);
+    }
+
+    /* delete every other key, then get them all */
+    for (i = 0; i < PIPELINE_KEYS; i += 2) {
+        rv = apr_memcache_pipeline_delete(pipeline, keys[i], &values[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_memcache_pipeline_delete(pipeline, "pipelinemissing",
+                                      &values[PIPELINE_KEYS]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < PIPELINE_KEYS; i += 2) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, values[i]->status);
+    }
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, values[PIPELINE_KEYS]->status);
+
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        apr_memcache_pipeline_get(pipeline, keys[i], &values[i]);
+    }
+    rv = apr_memcache_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        ABTS_INT_EQUAL(tc, i % 2 ? APR_SUCCESS : APR_NOTFOUND,
+                       values[i]->status);
+    }
+
+    /* the operations of a server which is down fail, not the others' */
+    rv = apr_memcache_server_create(pool, MOCK_HOST,
+                                    MOCK_SERVERS_PORT + PIPELINE_SERVERS,
+                                    0, 1, 1, apr_time_from_sec(60), &server);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_add_server(memcache, server);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    count = 0;
+    for (i = 1; i < PIPELINE_KEYS; i += 2) {
+        apr_memcache_pipeline_get(pipeline, keys[i], &values[i]);
+    }
+    rv = apr_memcache_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_TRUE(tc, rv != APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, PIPELINE_KEYS / 2, count);
+    for (count = 0, i = 1; i < PIPELINE_KEYS; i += 2) {
+        if (values[i]->status != APR_SUCCESS) {
+            ABTS_INT_EQUAL(tc, rv, values[i]->status);
+            count++;
+        }
+    }
+    ABTS_TRUE(tc, count > 0 && count < PIPELINE_KEYS / 2);
+    ABTS_INT_EQUAL(tc, APR_MC_SERVER_DEAD, server->status);
+
+    apr_proc_kill(&proc, SIGTERM);
+    apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    apr_pool_destroy(pool);
+}
+
+/* the meta protocol, against the mock serving it */
+
+#define METAPROTO_BIG_SIZE (1024 * 1024)
+
+static void test_memcache_metaproto(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *tmppool;
+    apr_status_t rv;
+    apr_memcache_t *memcache, *text;
+    apr_memcache_server_t *server;
+    apr_memcache_value_t *value;
+    apr_bucket_alloc_t *ba;
+    apr_bucket_brigade *bb;
+    apr_hash_t *values = NULL;
+    apr_proc_t proc;
+    apr_exit_why_e why;
+    apr_size_t len;
+    apr_uint16_t flags;
+    apr_uint32_t num;
+    apr_uint64_t cas, cas2;
+    const char *key, *key2, *missing;
+    char *big, *result;
+    int exitcode, i;
+
+    apr_pool_create(&pool, p);
+
+    rv = start_mock_servers(&proc, PIPELINE_SERVERS, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS) {
+        return;
+    }
+
+    rv = apr_memcache_create(pool, PIPELINE_SERVERS, APR_MEMCACHE_META,
+                             &memcache);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_create(pool, PIPELINE_SERVERS, 0, &text);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < PIPELINE_SERVERS; i++) {
+        rv = apr_memcache_server_create(pool, MOCK_HOST, MOCK_SERVERS_PORT + i,
+                                        0, 1, 1, apr_time_from_sec(60),
+                                        &server);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_memcache_add_server(memcache, server);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_memcache_add_server(text, server);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    key = apr_pstrcat(pool, prefix, "meta", NULL);
+    key2 = apr_pstrcat(pool, prefix, "meta2", NULL);
+    missing = apr_pstrcat(pool, prefix, "metamissing", NULL);
+
+    /* storage commands, read back with both protocols */
+    rv = apr_memcache_set(memcache, key, "value", 5, 0, 27);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_getp(memcache, pool, key, &result, &len, &flags);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 5, len);
+    ABTS_INT_EQUAL(tc, 27, flags);
+    ABTS_STR_EQUAL(tc, "value", result);
+    rv = apr_memcache_getp(text, pool, key, &result, &len, &flags);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, "value", result);
+    rv = apr_memcache_getp(memcache, pool, missing, &result, &len, NULL);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+
+    rv = apr_memcache_add(memcache, key, "other", 5, 0, 0);
+    ABTS_INT_EQUAL(tc, APR_EEXIST, rv);
+    rv = apr_memcache_replace(memcache, missing, "other", 5, 0, 0);
+    ABTS_INT_EQUAL(tc, APR_EEXIST, rv);
+    rv = apr_memcache_replace(memcache, key, "other", 5, 0, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_add(memcache, key2, "", 0, 0, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_getp(memcache, pool, key2, &result, &len, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, len);
+
+    rv = apr_memcache_delete(memcache, key2, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_delete(memcache, key2, 0);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+
+    /* arithmetic */
+    rv = apr_memcache_set(memcache, key2, "40", 2, 0, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_incr(memcache, key2, 3, &num);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 43, num);
+    rv = apr_memcache_decr(memcache, key2, 50, &num);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, num);
+    rv = apr_memcache_incr(memcache, missing, 1, &num);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+
+    /* a value read into a brigade, with its CAS unique */
+    big = apr_palloc(pool, METAPROTO_BIG_SIZE);
+    for (i = 0; i < METAPROTO_BIG_SIZE; i++) {
+        big[i] = 'a' + i % 26;
+    }
+    rv = apr_memcache_set(memcache, key, big, METAPROTO_BIG_SIZE, 0, 5);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    ba = apr_bucket_alloc_create(pool);
+    bb = apr_brigade_create(pool, ba);
+    rv = apr_memcache_getb(memcache, key, bb, &len, &flags, &cas);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, METAPROTO_BIG_SIZE, len);
+    ABTS_INT_EQUAL(tc, 5, flags);
+    ABTS_TRUE(tc, cas != 0);
+    len = METAPROTO_BIG_SIZE + 1;
+    result = apr_palloc(pool, len);
+    rv = apr_brigade_flatten(bb, result, &len);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, METAPROTO_BIG_SIZE, len);
+    ABTS_TRUE(tc, memcmp(result, big, METAPROTO_BIG_SIZE) == 0);
+    apr_brigade_cleanup(bb);
+
+    rv = apr_memcache_getb(memcache, missing, bb, &len, NULL, NULL);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+    ABTS_TRUE(tc, APR_BRIGADE_EMPTY(bb));
+
+    /* compare and swap, once */
+    rv = apr_memcache_cas(memcache, key, "swapped", 7, 0, 0, cas);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_cas(memcache, key, "again", 5, 0, 0, cas);
+    ABTS_INT_EQUAL(tc, APR_EEXIST, rv);
+    rv = apr_memcache_getb(memcache, key, bb, &len, NULL, &cas2);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 7, len);
+    ABTS_TRUE(tc, cas2 != cas);
+    apr_brigade_cleanup(bb);
+    rv = apr_memcache_cas(memcache, missing, "value", 5, 0, 0, cas2);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+
+    /* touch, the key expires a second later */
+    rv = apr_memcache_touch(memcache, missing, 1);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+    rv = apr_memcache_touch(memcache, key2, 1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* multiple gets, with misses */
+    apr_memcache_add_multget_key(pool, key, &values);
+    apr_memcache_add_multget_key(pool, missing, &values);
+    for (i = 0; i < 50; i++) {
+        apr_memcache_add_multget_key(pool,
+                                     apr_psprintf(pool, "%smeta%d", prefix, i),
+                                     &values);
+    }
+    apr_pool_create(&tmppool, pool);
+    rv = apr_memcache_multgetp(memcache, tmppool, pool, values);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    value = apr_hash_get(values, key, APR_HASH_KEY_STRING);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, value->status);
+    ABTS_STR_EQUAL(tc, "swapped", value->data);
+    ABTS_INT_EQUAL(tc, cas2, value->cas);
+    value = apr_hash_get(values, missing, APR_HASH_KEY_STRING);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, value->status);
+    value = apr_hash_get(values, apr_pstrcat(pool, prefix, "meta10", NULL),
+                         APR_HASH_KEY_STRING);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, value->status);
+
+    apr_sleep(apr_time_from_msec(1100));
+    rv = apr_memcache_getp(memcache, pool, key2, &result, &len, NULL);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+
+    /* the text protocol has none of them */
+    rv = apr_memcache_getb(text, key, bb, &len, NULL, NULL);
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+    rv = apr_memcache_cas(text, key, "value", 5, 0, 0, cas2);
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+    rv = apr_memcache_touch(text, key, 0);
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+
+    apr_proc_kill(&proc, SIGTERM);
+    apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    apr_pool_destroy(pool);
+}
+
+/* consistent hashing: distribution, keys moved when a server is added or
+ * dead, and weights (no server needed)
+ */
+
+#define KETAMA_SERVERS 10
+#define KETAMA_KEYS 10000
+
+static apr_memcache_server_t *ketama_lookup(apr_memcache_t *mc, const char *key)
+{
+    return apr_memcache_find_server_hash(mc, apr_memcache_hash(mc, key, strlen(key)));
+}
+
+static void test_memcache_ketama(abts_case *tc, void *data)
+{
+    apr_memcache_t *mc;
+    apr_memcache_server_t *servers[KETAMA_SERVERS + 1], **owners, *s;
+    apr_memcache_ketama_t *ring;
+    apr_uint32_t weights[KETAMA_SERVERS + 1];
+    int counts[KETAMA_SERVERS + 1];
+    const char **keys;
+    int i, j, moved, wrong;
+    apr_status_t rv;
+
+    rv = apr_memcache_create(p, KETAMA_SERVERS + 1, 0, &mc);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_memcache_set_retry_period(mc, apr_time_from_sec(3600));
+    for (i = 0; i <= KETAMA_SERVERS; i++) {
+        rv = apr_memcache_server_create(p, HOST, PORT + i, 0, 1, 1,
+                                        apr_time_from_sec(60), &servers[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < KETAMA_SERVERS; i++) {
+        rv = apr_memcache_add_server(mc, servers[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    keys = apr_palloc(p, KETAMA_KEYS * sizeof(char *));
+    owners = apr_palloc(p, KETAMA_KEYS * sizeof(*owners));
+    for (i = 0; i < KETAMA_KEYS; i++) {
+        keys[i] = apr_psprintf(p, "%s%d", prefix, i);
+    }
+
+    /* the ring spreads the keys evenly */
+    rv = apr_memcache_ketama_create(&ring, mc, NULL, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    mc->hash_func = apr_memcache_hash_ketama;
+    mc->server_func = apr_memcache_find_server_hash_ketama;
+    mc->server_baton = ring;
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < KETAMA_KEYS; i++) {
+        owners[i] = ketama_lookup(mc, keys[i]);
+        for (j = 0; j < KETAMA_SERVERS && servers[j] != owners[i]; j++)
+            ;
+        counts[j]++;
+    }
+    for (j = 0; j < KETAMA_SERVERS; j++) {
+        ABTS_TRUE(tc, counts[j] > KETAMA_KEYS / KETAMA_SERVERS / 2);
+        ABTS_TRUE(tc, counts[j] < KETAMA_KEYS / KETAMA_SERVERS * 3 / 2);
+    }
+
+    /* and only moves about 1/11th of them, all to the new server */
+    rv = apr_memcache_add_server(mc, servers[KETAMA_SERVERS]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_memcache_ketama_create(&ring, mc, NULL, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    mc->server_baton = ring;
+    for (moved = wrong = 0, i = 0; i < KETAMA_KEYS; i++) {
+        s = ketama_lookup(mc, keys[i]);
+        if (s != owners[i]) {
+            moved++;
+            wrong += s != servers[KETAMA_SERVERS];
+            owners[i] = s;
+        }
+    }
+    ABTS_INT_EQUAL(tc, 0, wrong);
+    ABTS_TRUE(tc, moved > 0);
+    ABTS_TRUE(tc, moved < 2 * KETAMA_KEYS / (KETAMA_SERVERS + 1));
+
+    /* a dead server's keys go to the next servers on the ring only */
+    rv = apr_memcache_disable_server(mc, servers[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (wrong = 0, i = 0; i < KETAMA_KEYS; i++) {
+        s = ketama_lookup(mc, keys[i]);
+        if (owners[i] == servers[0]) {
+            wrong += s == NULL || s == servers[0];
+        }
+        else {
+            wrong += s != owners[i];
+        }
+    }
+    ABTS_INT_EQUAL(tc, 0, wrong);
+    rv = apr_memcache_enable_server(mc, servers[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* three times the weight, about three times the keys */
+    for (j = 0; j <= KETAMA_SERVERS; j++) {
+        weights[j] = j ? 1 : 3;
+    }
+    rv = apr_memcache_ketama_create(&ring, mc, weights, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    mc->server_baton = ring;
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < KETAMA_KEYS; i++) {
+        s = ketama_lookup(mc, keys[i]);
+        for (j = 0; j < KETAMA_SERVERS && servers[j] != s; j++)
+            ;
+        counts[j]++;
+    }
+    ABTS_TRUE(tc, counts[0] > 2 * KETAMA_KEYS / (KETAMA_SERVERS + 3));
+
+    /* whereas the default selection moves most of them */
+    rv = apr_memcache_create(p, KETAMA_SERVERS + 1, 0, &mc);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < KETAMA_SERVERS; i++) {
+        rv = apr_memcache_add_server(mc, servers[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < KETAMA_KEYS; i++) {
+        owners[i] = ketama_lookup(mc, keys[i]);
+    }
+    rv = apr_memcache_add_server(mc, servers[KETAMA_SERVERS]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (moved = 0, i = 0; i < KETAMA_KEYS; i++) {
+        moved += ketama_lookup(mc, keys[i]) != owners[i];
+    }
+    ABTS_TRUE(tc, moved > KETAMA_KEYS / 2);
+}
+
 abts_suite *testmemcache(abts_suite * suite)
 {
+    static apr_uint32_t meta = APR_MEMCACHE_META;
+
     suite = ADD_SUITE(suite);
     abts_run_test(suite, test_memcache_create, NULL);
     abts_run_test(suite, test_memcache_user_funcs, NULL);
+    abts_run_test(suite, test_memcache_ketama, NULL);
     abts_run_test(suite, test_memcache_meta, NULL);
     abts_run_test(suite, test_memcache_setget, NULL);
     abts_run_test(suite, test_memcache_multiget, NULL);
     abts_run_test(suite, test_memcache_addreplace, NULL);
     abts_run_test(suite, test_memcache_incrdecr, NULL);
     abts_run_test(suite, test_connection_validation, NULL);
+    abts_run_test(suite, test_memcache_pipeline, NULL);
+    abts_run_test(suite, test_memcache_pipeline, &meta);
+    abts_run_test(suite, test_memcache_metaproto, NULL);
 
     return suite;
 }
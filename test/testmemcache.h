@@ -20,5 +20,8 @@
 #define MOCK_HOST "localhost"
 #define MOCK_PORT 11231
 
+/* the first port of the mock serving the protocol, with -p */
+#define MOCK_SERVERS_PORT 11232
+
 #endif
 
@@ -21,6 +21,10 @@
 #include "apr_lib.h"
 #include "apr_network_io.h"
 #include "apr_poll.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#include <string.h>
 
 #if defined(__linux__)
 #include "arch/unix/apr_private.h"
@@ -572,6 +576,29 @@ static void pollset_remove(abts_case *tc, void *data)
              (hot_files[1].client_data == (void *)4)) ||
             ((hot_files[0].client_data == (void *)4) &&
              (hot_files[1].client_data == (void *)1)));
+
+    /* release the descriptors (for APR_POLLSET_IOURING) */
+    pfd.desc.s = s[0];
+    rv = apr_pollset_remove(pollset, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    pfd.desc.s = s[3];
+    rv = apr_pollset_remove(pollset, &pfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void remove_sockets_pollset(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    int i;
+
+    for (i = 0; i < LARGE_NUM_SOCKETS; i++) {
+        apr_pollfd_t socket_pollfd;
+
+        socket_pollfd.desc_type = APR_POLL_SOCKET;
+        socket_pollfd.desc.s = s[i];
+        rv = apr_pollset_remove(pollset, &socket_pollfd);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
 }
 
 #define POLLCB_PREREQ \
@@ -585,7 +612,8 @@ static void pollset_remove(abts_case *tc, void *data)
 static void setup_pollcb(abts_case *tc, void *data)
 {
     apr_status_t rv;
-    rv = apr_pollcb_create(&pollcb, LARGE_NUM_SOCKETS, p, 0);
+    rv = apr_pollcb_create_ex(&pollcb, LARGE_NUM_SOCKETS, p, 0,
+                              default_pollset_impl);
     if (rv == APR_ENOTIMPL) {
         pollcb = NULL;
         ABTS_NOT_IMPL(tc, "pollcb interface not supported");
@@ -829,6 +857,10 @@ static void pollset_wakeup(abts_case *tc, void *data)
     rv = apr_pollset_poll(pollset, -1, &num, &descriptors);
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
     ABTS_INT_EQUAL(tc, 1, num);
+
+    recv_msg(s, 0, p, tc);
+    rv = apr_pollset_remove(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
 /* Should never be invoked */
@@ -845,7 +877,8 @@ static void pollcb_wakeup(abts_case *tc, void *data)
     apr_status_t rv;
     apr_pollcb_t *pcb;
 
-    rv = apr_pollcb_create(&pcb, 1, p, APR_POLLSET_WAKEABLE);
+    rv = apr_pollcb_create_ex(&pcb, 1, p, APR_POLLSET_WAKEABLE,
+                              default_pollset_impl);
     if (rv == APR_ENOTIMPL) {
         ABTS_NOT_IMPL(tc, "pollcb interface not supported");
         return;
@@ -933,6 +966,573 @@ static void justsleep(abts_case *tc, void *data)
     }
 }
 
+static void pollset_level(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    apr_pollfd_t socket_pollfd;
+    const apr_pollfd_t *descs;
+    apr_int32_t num;
+    int i;
+
+    rv = apr_pollset_create_ex(&pollset, 1, p, 0, default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    socket_pollfd.desc_type = APR_POLL_SOCKET;
+    socket_pollfd.reqevents = APR_POLLIN;
+    socket_pollfd.desc.s = s[0];
+    socket_pollfd.client_data = s[0];
+    rv = apr_pollset_add(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    send_msg(s, sa, 0, tc);
+
+    /* reported as long as it's not consumed */
+    for (i = 0; i < 3; i++) {
+        rv = apr_pollset_poll(pollset, -1, &num, &descs);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, 1, num);
+        ABTS_PTR_EQUAL(tc, s[0], descs[0].client_data);
+        ABTS_INT_EQUAL(tc, APR_POLLIN, descs[0].rtnevents);
+    }
+
+    recv_msg(s, 0, p, tc);
+
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, num);
+
+    /* removed while reported */
+    send_msg(s, sa, 0, tc);
+    rv = apr_pollset_poll(pollset, -1, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    rv = apr_pollset_remove(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pollset_remove(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, num);
+
+    /* and added back */
+    rv = apr_pollset_add(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pollset_poll(pollset, -1, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[0], descs[0].client_data);
+
+    recv_msg(s, 0, p, tc);
+    rv = apr_pollset_remove(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void pollset_edge(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    apr_pollfd_t socket_pollfd;
+    const apr_pollfd_t *descs;
+    apr_int32_t num;
+
+    rv = apr_pollset_create_ex(&pollset, 1, p, 0, default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    socket_pollfd.desc_type = APR_POLL_SOCKET;
+    socket_pollfd.reqevents = APR_POLLIN | APR_POLLET;
+    socket_pollfd.desc.s = s[0];
+    socket_pollfd.client_data = s[0];
+    rv = apr_pollset_add(pollset, &socket_pollfd);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_POLLET not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    send_msg(s, sa, 0, tc);
+
+    rv = apr_pollset_poll(pollset, -1, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[0], descs[0].client_data);
+    ABTS_INT_EQUAL(tc, APR_POLLIN, descs[0].rtnevents);
+
+    /* not reported again until more data arrives, though not consumed */
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, num);
+
+    send_msg(s, sa, 0, tc);
+    rv = apr_pollset_poll(pollset, -1, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[0], descs[0].client_data);
+
+    recv_msg(s, 0, p, tc);
+    recv_msg(s, 0, p, tc);
+    rv = apr_pollset_remove(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void pollset_oneshot(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    apr_pollfd_t socket_pollfd;
+    const apr_pollfd_t *descs;
+    apr_int32_t num;
+
+    rv = apr_pollset_create_ex(&pollset, 1, p, 0, default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    socket_pollfd.desc_type = APR_POLL_SOCKET;
+    socket_pollfd.reqevents = APR_POLLIN | APR_POLLONESHOT;
+    socket_pollfd.desc.s = s[0];
+    socket_pollfd.client_data = s[0];
+    rv = apr_pollset_rearm(pollset, &socket_pollfd);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_POLLONESHOT not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, rv);
+    rv = apr_pollset_add(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    send_msg(s, sa, 0, tc);
+
+    rv = apr_pollset_poll(pollset, -1, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[0], descs[0].client_data);
+    ABTS_INT_EQUAL(tc, APR_POLLIN, descs[0].rtnevents);
+
+    /* disabled, though not consumed */
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, num);
+
+    /* until re-armed (with new client_data) */
+    socket_pollfd.client_data = s[1];
+    rv = apr_pollset_rearm(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pollset_poll(pollset, -1, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[1], descs[0].client_data);
+
+    recv_msg(s, 0, p, tc);
+    rv = apr_pollset_rearm(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, num);
+
+    rv = apr_pollset_remove(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static apr_status_t oneshot_pollcb_cb(void *baton, apr_pollfd_t *descriptor)
+{
+    pollcb_baton_t *pcb = (pollcb_baton_t *) baton;
+    ABTS_PTR_EQUAL(pcb->tc, s[0], descriptor->desc.s);
+    pcb->count++;
+    return APR_SUCCESS;
+}
+
+static void pollcb_oneshot(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollcb_t *pollcb;
+    apr_pollfd_t socket_pollfd;
+    pollcb_baton_t pcb;
+
+    rv = apr_pollcb_create_ex(&pollcb, 1, p, 0, default_pollset_impl);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "pollcb interface not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    socket_pollfd.desc_type = APR_POLL_SOCKET;
+    socket_pollfd.reqevents = APR_POLLIN | APR_POLLONESHOT;
+    socket_pollfd.desc.s = s[0];
+    socket_pollfd.client_data = s[0];
+    rv = apr_pollcb_add(pollcb, &socket_pollfd);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_POLLONESHOT not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    send_msg(s, sa, 0, tc);
+    pcb.tc = tc;
+    pcb.count = 0;
+    rv = apr_pollcb_poll(pollcb, -1, oneshot_pollcb_cb, &pcb);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, pcb.count);
+
+    rv = apr_pollcb_poll(pollcb, 0, oneshot_pollcb_cb, &pcb);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 1, pcb.count);
+
+    rv = apr_pollcb_rearm(pollcb, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pollcb_poll(pollcb, -1, oneshot_pollcb_cb, &pcb);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 2, pcb.count);
+
+    recv_msg(s, 0, p, tc);
+    rv = apr_pollcb_remove(pollcb, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void pollset_rearm_events(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    apr_pollfd_t socket_pollfd;
+    const apr_pollfd_t *descs;
+    apr_int32_t num;
+
+    rv = apr_pollset_create_ex(&pollset, 1, p, 0, default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    socket_pollfd.desc_type = APR_POLL_SOCKET;
+    socket_pollfd.reqevents = APR_POLLIN;
+    socket_pollfd.desc.s = s[0];
+    socket_pollfd.client_data = s[0];
+    rv = apr_pollset_add(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, num);
+
+    /* the new events apply to a descriptor still armed */
+    socket_pollfd.reqevents = APR_POLLOUT;
+    rv = apr_pollset_rearm(pollset, &socket_pollfd);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "apr_pollset_rearm() not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pollset_poll(pollset, JUSTSLEEP_DELAY, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[0], descs[0].client_data);
+    ABTS_INT_EQUAL(tc, APR_POLLOUT, descs[0].rtnevents);
+
+    /* and back, writable is not reported anymore */
+    socket_pollfd.reqevents = APR_POLLIN;
+    rv = apr_pollset_rearm(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_pollset_poll(pollset, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, num);
+
+    send_msg(s, sa, 0, tc);
+    rv = apr_pollset_poll(pollset, JUSTSLEEP_DELAY, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_INT_EQUAL(tc, APR_POLLIN, descs[0].rtnevents);
+
+    recv_msg(s, 0, p, tc);
+    rv = apr_pollset_remove(pollset, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void pollset_exclusive(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollsets[2];
+    apr_pollfd_t socket_pollfd;
+    const apr_pollfd_t *descs;
+    apr_int32_t num, total = 0;
+    int i;
+
+    socket_pollfd.desc_type = APR_POLL_SOCKET;
+    socket_pollfd.reqevents = APR_POLLIN | APR_POLLEXCL;
+    socket_pollfd.desc.s = s[0];
+    socket_pollfd.client_data = s[0];
+
+    /* honoured or ignored, either way the event is reported */
+    for (i = 0; i < 2; i++) {
+        rv = apr_pollset_create_ex(&pollsets[i], 1, p, 0,
+                                   default_pollset_impl);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_pollset_add(pollsets[i], &socket_pollfd);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    send_msg(s, sa, 0, tc);
+
+    for (i = 0; i < 2; i++) {
+        rv = apr_pollset_poll(pollsets[i], 0, &num, &descs);
+        if (rv == APR_SUCCESS) {
+            ABTS_INT_EQUAL(tc, 1, num);
+            ABTS_PTR_EQUAL(tc, s[0], descs[0].client_data);
+            total += num;
+        }
+        else {
+            ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+        }
+    }
+    ABTS_ASSERT(tc, "exclusive event not reported", total >= 1);
+
+    recv_msg(s, 0, p, tc);
+    for (i = 0; i < 2; i++) {
+        rv = apr_pollset_remove(pollsets[i], &socket_pollfd);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+}
+
+static void pollset_poll_ptrs(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *ps;
+    apr_pollfd_t socket_pollfd;
+    const apr_pollfd_t *const *descs;
+    apr_int32_t num;
+    int i;
+
+    rv = apr_pollset_create_ex(&ps, 4, p, 0, default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    socket_pollfd.desc_type = APR_POLL_SOCKET;
+    socket_pollfd.reqevents = APR_POLLIN;
+    for (i = 0; i < 3; i++) {
+        socket_pollfd.desc.s = s[i];
+        socket_pollfd.client_data = s[i];
+        rv = apr_pollset_add(ps, &socket_pollfd);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    rv = apr_pollset_poll_ptrs(ps, 0, &num, &descs);
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, num);
+
+    send_msg(s, sa, 1, tc);
+    rv = apr_pollset_poll_ptrs(ps, -1, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[1], descs[0]->desc.s);
+    ABTS_PTR_EQUAL(tc, s[1], descs[0]->client_data);
+    ABTS_INT_EQUAL(tc, APR_POLLIN, descs[0]->rtnevents);
+
+    /* the result stays valid after a remove and an add, until the next
+     * poll */
+    socket_pollfd.desc.s = s[1];
+    rv = apr_pollset_remove(ps, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    socket_pollfd.desc.s = s[3];
+    socket_pollfd.client_data = s[3];
+    rv = apr_pollset_add(ps, &socket_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_EQUAL(tc, s[1], descs[0]->desc.s);
+    ABTS_PTR_EQUAL(tc, s[1], descs[0]->client_data);
+
+    /* the removed descriptor is not reported anymore */
+    send_msg(s, sa, 2, tc);
+    rv = apr_pollset_poll_ptrs(ps, -1, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[2], descs[0]->client_data);
+
+    recv_msg(s, 1, p, tc);
+    recv_msg(s, 2, p, tc);
+
+    /* nor is a descriptor added since in place of the removed one */
+    send_msg(s, sa, 3, tc);
+    rv = apr_pollset_poll_ptrs(ps, -1, &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[3], descs[0]->client_data);
+    recv_msg(s, 3, p, tc);
+}
+
+#define POLL_RATE_DURATION apr_time_from_msec(200)
+
+/* Events per second handled by poll() with all the sockets ready */
+static double poll_rate(apr_pollset_t *ps, int use_ptrs, abts_case *tc)
+{
+    apr_status_t rv;
+    apr_int32_t num, i;
+    apr_time_t start, now;
+    apr_uint64_t events = 0;
+    apr_uintptr_t sum = 0;
+
+    start = now = apr_time_now();
+    do {
+        int j;
+
+        for (j = 0; j < 64; j++) {
+            if (use_ptrs) {
+                const apr_pollfd_t *const *descs;
+
+                rv = apr_pollset_poll_ptrs(ps, 0, &num, &descs);
+                for (i = 0; i < num; i++) {
+                    sum += (apr_uintptr_t)descs[i]->client_data;
+                }
+            }
+            else {
+                const apr_pollfd_t *descs;
+
+                rv = apr_pollset_poll(ps, 0, &num, &descs);
+                for (i = 0; i < num; i++) {
+                    sum += (apr_uintptr_t)descs[i].client_data;
+                }
+            }
+            if (rv != APR_SUCCESS) {
+                ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+                return 0;
+            }
+            events += num;
+        }
+        now = apr_time_now();
+    } while (now - start < POLL_RATE_DURATION);
+
+    ABTS_ASSERT(tc, "no events", sum != 0);
+    return (double)events * APR_USEC_PER_SEC / (now - start);
+}
+
+static void pollset_poll_rate(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *ps;
+    apr_pollfd_t socket_pollfd;
+    double copy_rate, ptrs_rate;
+    int i;
+
+    rv = apr_pollset_create_ex(&ps, LARGE_NUM_SOCKETS, p, 0,
+                               default_pollset_impl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    socket_pollfd.desc_type = APR_POLL_SOCKET;
+    socket_pollfd.reqevents = APR_POLLIN;
+    for (i = 0; i < LARGE_NUM_SOCKETS; i++) {
+        socket_pollfd.desc.s = s[i];
+        socket_pollfd.client_data = s[i];
+        rv = apr_pollset_add(ps, &socket_pollfd);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        send_msg(s, sa, i, tc);
+    }
+
+    copy_rate = poll_rate(ps, 0, tc);
+    ptrs_rate = poll_rate(ps, 1, tc);
+    abts_log_message("%s, %d ready sockets: apr_pollset_poll %.0f events/s, "
+                     "apr_pollset_poll_ptrs %.0f events/s",
+                     apr_pollset_method_name(ps), LARGE_NUM_SOCKETS,
+                     copy_rate, ptrs_rate);
+
+    for (i = 0; i < LARGE_NUM_SOCKETS; i++) {
+        recv_msg(s, i, p, tc);
+    }
+}
+
+#if APR_HAS_THREADS
+static apr_pollfd_t threadsafe_pollfd;
+
+static void * APR_THREAD_FUNC threadsafe_add(apr_thread_t *thd, void *data)
+{
+    apr_pollset_t *pollset = data;
+
+    apr_sleep(apr_time_from_msec(100));
+    apr_pollset_add(pollset, &threadsafe_pollfd);
+
+    return NULL;
+}
+
+static void pollset_threadsafe(abts_case *tc, void *data)
+{
+    apr_status_t rv, retval;
+    apr_pollset_t *pollset;
+    apr_thread_t *thread;
+    const apr_pollfd_t *descs;
+    apr_int32_t num;
+
+    rv = apr_pollset_create_ex(&pollset, 1, p, APR_POLLSET_THREADSAFE,
+                               default_pollset_impl);
+    if (rv == APR_ENOTIMPL) {
+        ABTS_NOT_IMPL(tc, "APR_POLLSET_THREADSAFE not supported");
+        return;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    threadsafe_pollfd.desc_type = APR_POLL_SOCKET;
+    threadsafe_pollfd.reqevents = APR_POLLIN;
+    threadsafe_pollfd.desc.s = s[0];
+    threadsafe_pollfd.client_data = s[0];
+
+    send_msg(s, sa, 0, tc);
+
+    /* added by another thread while polling */
+    rv = apr_thread_create(&thread, NULL, threadsafe_add, pollset, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_pollset_poll(pollset, apr_time_from_sec(5), &num, &descs);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, num);
+    ABTS_PTR_EQUAL(tc, s[0], descs[0].client_data);
+
+    apr_thread_join(&retval, thread);
+
+    recv_msg(s, 0, p, tc);
+    rv = apr_pollset_remove(pollset, &threadsafe_pollfd);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+#endif
+
+static void pollset_iouring(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_pollset_t *pollset;
+    apr_pollcb_t *pollcb;
+    const apr_pollfd_t *hot_files;
+    apr_int32_t nsds;
+    apr_time_t t1, t2;
+    const char *name;
+
+    /* io_uring where available, else falls back to the default method */
+    rv = apr_pollset_create_ex(&pollset, 1, p, 0, APR_POLLSET_IOURING);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    name = apr_pollset_method_name(pollset);
+    ABTS_ASSERT(tc, "unexpected pollset method",
+                strcmp(name, "io_uring") == 0
+                || strcmp(name, apr_poll_method_defname()) == 0);
+
+    nsds = 1;
+    t1 = apr_time_now();
+    rv = apr_pollset_poll(pollset, JUSTSLEEP_DELAY, &nsds, &hot_files);
+    t2 = apr_time_now();
+    ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, nsds);
+    ABTS_ASSERT(tc, "apr_pollset_poll() didn't sleep",
+                JUSTSLEEP_ENOUGH(t1, t2));
+
+    rv = apr_pollcb_create_ex(&pollcb, 1, p, 0, APR_POLLSET_IOURING);
+    if (rv != APR_ENOTIMPL) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        t1 = apr_time_now();
+        rv = apr_pollcb_poll(pollcb, JUSTSLEEP_DELAY, NULL, NULL);
+        t2 = apr_time_now();
+        ABTS_INT_EQUAL(tc, 1, APR_STATUS_IS_TIMEUP(rv));
+        ABTS_ASSERT(tc, "apr_pollcb_poll() didn't sleep",
+                    JUSTSLEEP_ENOUGH(t1, t2));
+    }
+}
+
+static void use_iouring_impl(abts_case *tc, void *data)
+{
+    default_pollset_impl = APR_POLLSET_IOURING;
+}
+
+static void use_default_impl(abts_case *tc, void *data)
+{
+    default_pollset_impl = APR_POLLSET_DEFAULT;
+}
+
 abts_suite *testpoll(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -963,15 +1563,66 @@ abts_suite *testpoll(abts_suite *suite)
     abts_run_test(suite, send_last_pollset, NULL);
     abts_run_test(suite, clear_last_pollset, NULL);
     abts_run_test(suite, pollset_remove, NULL);
+    abts_run_test(suite, remove_sockets_pollset, NULL);
     abts_run_test(suite, close_all_sockets, NULL);
     abts_run_test(suite, create_all_sockets, NULL);
     abts_run_test(suite, setup_pollcb, NULL);
     abts_run_test(suite, trigger_pollcb, NULL);
     abts_run_test(suite, timeout_pollcb, NULL);
     abts_run_test(suite, timeout_pollin_pollcb, NULL);
+    abts_run_test(suite, pollset_level, NULL);
+    abts_run_test(suite, pollset_edge, NULL);
+    abts_run_test(suite, pollset_oneshot, NULL);
+    abts_run_test(suite, pollcb_oneshot, NULL);
+    abts_run_test(suite, pollset_rearm_events, NULL);
+    abts_run_test(suite, pollset_exclusive, NULL);
+    abts_run_test(suite, pollset_poll_ptrs, NULL);
+    abts_run_test(suite, pollset_poll_rate, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, pollset_threadsafe, NULL);
+#endif
     abts_run_test(suite, pollset_wakeup, NULL);
     abts_run_test(suite, pollcb_wakeup, NULL);
     abts_run_test(suite, close_all_sockets, NULL);
+
+    /* the same with io_uring, or its fallback */
+    abts_run_test(suite, pollset_iouring, NULL);
+    abts_run_test(suite, use_iouring_impl, NULL);
+    abts_run_test(suite, create_all_sockets, NULL);
+    abts_run_test(suite, setup_pollset, NULL);
+    abts_run_test(suite, multi_event_pollset, NULL);
+    abts_run_test(suite, add_sockets_pollset, NULL);
+    abts_run_test(suite, nomessage_pollset, NULL);
+    abts_run_test(suite, send0_pollset, NULL);
+    abts_run_test(suite, recv0_pollset, NULL);
+    abts_run_test(suite, send_middle_pollset, NULL);
+    abts_run_test(suite, clear_middle_pollset, NULL);
+    abts_run_test(suite, send_last_pollset, NULL);
+    abts_run_test(suite, clear_last_pollset, NULL);
+    abts_run_test(suite, pollset_remove, NULL);
+    abts_run_test(suite, remove_sockets_pollset, NULL);
+    abts_run_test(suite, close_all_sockets, NULL);
+    abts_run_test(suite, create_all_sockets, NULL);
+    abts_run_test(suite, setup_pollcb, NULL);
+    abts_run_test(suite, trigger_pollcb, NULL);
+    abts_run_test(suite, timeout_pollcb, NULL);
+    abts_run_test(suite, timeout_pollin_pollcb, NULL);
+    abts_run_test(suite, pollset_level, NULL);
+    abts_run_test(suite, pollset_edge, NULL);
+    abts_run_test(suite, pollset_oneshot, NULL);
+    abts_run_test(suite, pollcb_oneshot, NULL);
+    abts_run_test(suite, pollset_rearm_events, NULL);
+    abts_run_test(suite, pollset_exclusive, NULL);
+    abts_run_test(suite, pollset_poll_ptrs, NULL);
+    abts_run_test(suite, pollset_poll_rate, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, pollset_threadsafe, NULL);
+#endif
+    abts_run_test(suite, pollset_wakeup, NULL);
+    abts_run_test(suite, pollcb_wakeup, NULL);
+    abts_run_test(suite, close_all_sockets, NULL);
+    abts_run_test(suite, use_default_impl, NULL);
+
     abts_run_test(suite, pollset_default, NULL);
     abts_run_test(suite, pollcb_default, NULL);
     abts_run_test(suite, justsleep, NULL);
@@ -0,0 +1,207 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Pools/allocator scalability benchmark: N threads create, fill, clear
+ * and destroy pools sharing one (mutex protected) allocator, with and
+ * without the per-thread magazines.
+ */
+
+#include "apr_thread_proc.h"
+#include "apr_thread_mutex.h"
+#include "apr_allocator.h"
+#include "apr_pools.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_strings.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !APR_HAS_THREADS
+int main(void)
+{
+    printf("This program won't work on this platform because there is no "
+           "support for threads.\n");
+    return 0;
+}
+#else /* !APR_HAS_THREADS */
+
+#define DEFAULT_MAX_COUNTER 100000
+#define DEFAULT_MAX_THREADS 8
+#define MAX_THREADS 256
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int max_threads = DEFAULT_MAX_THREADS;
+static apr_size_t max_free = 0;
+static apr_pool_t *pool;
+
+static void * APR_THREAD_FUNC pool_thread(apr_thread_t *thd, void *data)
+{
+    apr_allocator_t *allocator = data;
+    apr_pool_t *p;
+    long i;
+    int j;
+
+    for (i = 0; i < max_counter; i++) {
+        apr_pool_create_ex(&p, NULL, NULL, allocator);
+        for (j = 0; j < 8; j++) {
+            memset(apr_palloc(p, 2000), 0, 2000);
+        }
+        apr_pool_clear(p);
+        memset(apr_palloc(p, 12000), 0, 12000);
+        apr_pool_destroy(p);
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static apr_status_t run(int num_threads, apr_uint32_t magazines,
+                        apr_time_t *elapsed)
+{
+    apr_thread_t *t[MAX_THREADS];
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_status_t rv, retval;
+    apr_time_t start;
+    int i;
+
+    if ((rv = apr_allocator_create(&allocator)) != APR_SUCCESS) {
+        return rv;
+    }
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, pool);
+    if (rv != APR_SUCCESS) {
+        apr_allocator_destroy(allocator);
+        return rv;
+    }
+    apr_allocator_mutex_set(allocator, mutex);
+    apr_allocator_max_free_set(allocator, max_free);
+    if (magazines) {
+        rv = apr_allocator_magazines_set(allocator, magazines, 0);
+        if (rv != APR_SUCCESS) {
+            apr_allocator_destroy(allocator);
+            return rv;
+        }
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < num_threads; ++i) {
+        rv = apr_thread_create(&t[i], NULL, pool_thread, allocator, pool);
+        if (rv != APR_SUCCESS) {
+            num_threads = i;
+            break;
+        }
+    }
+    for (i = 0; i < num_threads; ++i) {
+        apr_thread_join(&retval, t[i]);
+    }
+    *elapsed = apr_time_now() - start;
+
+    apr_allocator_destroy(allocator);
+    apr_thread_mutex_destroy(mutex);
+
+    return rv;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    apr_time_t base[2] = {0, 0};
+    int n, mode;
+
+    printf("APR Pool/Allocator Scalability Test\n"
+           "===================================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:t:f:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAX_THREADS) {
+                fprintf(stderr, "Threads must be within 1..%d\n",
+                        MAX_THREADS);
+                exit(-1);
+            }
+        }
+        else if (optchar == 'f') {
+            max_free = (apr_size_t)apr_atoi64(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    printf("%ld pool create/clear/destroy cycles per thread, max_free %"
+           APR_SIZE_T_FMT "\n\n", max_counter, max_free);
+    printf("%8s %-10s %14s %14s %10s\n",
+           "threads", "mode", "usec", "cycles/sec", "scaling");
+
+    for (n = 1; ; n *= 2) {
+        if (n > max_threads) {
+            n = max_threads;
+        }
+        for (mode = 0; mode < 2; mode++) {
+            apr_time_t elapsed;
+            double rate;
+
+            rv = run(n, mode ? (apr_uint32_t)n : 0, &elapsed);
+            if (rv != APR_SUCCESS) {
+                fprintf(stderr, "%s run failed: [%d] %s\n",
+                        mode ? "magazines" : "shared",
+                        rv, apr_strerror(rv, errmsg, sizeof errmsg));
+                exit(-2);
+            }
+            if (elapsed <= 0) {
+                elapsed = 1;
+            }
+            rate = (double)max_counter * n * APR_USEC_PER_SEC / elapsed;
+            if (n == 1) {
+                base[mode] = elapsed;
+            }
+            printf("%8d %-10s %14" APR_TIME_T_FMT " %14.0f %9.2fx\n",
+                   n, mode ? "magazines" : "shared", elapsed, rate,
+                   (double)base[mode] * n / elapsed);
+        }
+        if (n == max_threads) {
+            break;
+        }
+    }
+
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -19,6 +19,8 @@
 #include "apr_pools.h"
 #include "apr_errno.h"
 #include "apr_file_io.h"
+#include "apr_allocator.h"
+#include "apr_thread_proc.h"
 #include <string.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -176,6 +178,242 @@ static void test_tags(abts_case *tc, void *data)
     ABTS_STR_EQUAL(tc, "main pool", apr_pool_get_tag(pmain));
 }
 
+static void test_slab(abts_case *tc, void *data)
+{
+    apr_pool_t *pslab;
+    char *a, *b, *c, *big;
+    apr_status_t rv;
+
+    rv = apr_pool_create_ex2(&pslab, pmain, NULL, NULL, APR_POOL_SLAB);
+    APR_ASSERT_SUCCESS(tc, "create slab pool", rv);
+
+    a = apr_palloc(pslab, 100);
+    b = apr_palloc(pslab, 100);
+    ABTS_PTR_NOTNULL(tc, a);
+    ABTS_PTR_NOTNULL(tc, b);
+    memset(a, 'a', 100);
+    memset(b, 'b', 100);
+
+#if !APR_POOL_DEBUG
+    /* Same size class: recycled, last freed first */
+    apr_pfree(pslab, a);
+    apr_pfree(pslab, b);
+    c = apr_palloc(pslab, 110);
+    ABTS_PTR_EQUAL(tc, b, c);
+    c = apr_pcalloc(pslab, 97);
+    ABTS_PTR_EQUAL(tc, a, c);
+    ABTS_INT_EQUAL(tc, 0, c[96]);
+
+    /* Different size class: not recycled */
+    apr_pfree(pslab, c);
+    c = apr_palloc(pslab, 200);
+    ABTS_PTR_NOTNULL(tc, c);
+    ABTS_TRUE(tc, c != a);
+
+    /* Large allocations are not recycled, but can be given back */
+    big = apr_palloc(pslab, 5000);
+    ABTS_PTR_NOTNULL(tc, big);
+    memset(big, 0, 5000);
+    apr_pfree(pslab, big);
+    c = apr_palloc(pslab, 5000);
+    ABTS_TRUE(tc, c != big);
+
+    /* Clearing forgets the free lists */
+    apr_pfree(pslab, b);
+    apr_pool_clear(pslab);
+    c = apr_palloc(pslab, 100);
+    ABTS_PTR_NOTNULL(tc, c);
+    c = apr_palloc(pslab, 100);
+    ABTS_PTR_NOTNULL(tc, c);
+#else
+    (void)c;
+    (void)big;
+#endif
+
+    /* A noop on regular pools */
+    a = apr_palloc(pchild, 100);
+    apr_pfree(pchild, a);
+    apr_pfree(pchild, NULL);
+    b = apr_palloc(pchild, 100);
+    ABTS_TRUE(tc, a != b);
+
+    apr_pool_destroy(pslab);
+}
+
+static void test_arenas(abts_case *tc, void *data)
+{
+    static const apr_uint32_t flags[] = {
+        APR_ALLOCATOR_HUGEPAGES, APR_ALLOCATOR_HUGETLB, 0
+    };
+    apr_allocator_t *allocator;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    int i, j;
+
+    for (i = 0; i < 3; i++) {
+        /* The last round asks for NUMA binding only */
+        rv = apr_allocator_create_ex(&allocator, flags[i], i == 2 ? 0 : -1);
+        if (rv == APR_ENOTIMPL) {
+            ABTS_NOT_IMPL(tc, "allocator arenas");
+            continue;
+        }
+        APR_ASSERT_SUCCESS(tc, "create allocator", rv);
+        apr_allocator_max_free_set(allocator, 32 * 1024);
+
+        rv = apr_pool_create_unmanaged_ex(&pool, NULL, allocator);
+        APR_ASSERT_SUCCESS(tc, "create pool", rv);
+        apr_allocator_owner_set(allocator, pool);
+
+        /* Enough to span several arenas, with node sizes mixed */
+        for (j = 0; j < 1000; j++) {
+            apr_size_t size = (j % 7 + 1) * 3000;
+            char *mem = apr_palloc(pool, size);
+
+            ABTS_PTR_NOTNULL(tc, mem);
+            memset(mem, j, size);
+            if (j % 100 == 99) {
+                apr_pool_clear(pool);
+            }
+        }
+        /* Larger than the arenas' nodes */
+        ABTS_PTR_NOTNULL(tc, apr_palloc(pool, 1024 * 1024));
+
+        apr_pool_destroy(pool);
+    }
+
+    rv = apr_allocator_create_ex(&allocator, 0, 1 << 20);
+    ABTS_TRUE(tc, rv == APR_EINVAL || rv == APR_ENOTIMPL);
+
+    /* Neither flags nor node, as apr_allocator_create() everywhere */
+    rv = apr_allocator_create_ex(&allocator, 0, -1);
+    APR_ASSERT_SUCCESS(tc, "create plain allocator", rv);
+    apr_allocator_destroy(allocator);
+}
+
+#if APR_HAS_THREADS
+
+#define MAGAZINE_THREADS 4
+#define MAGAZINE_NODES   64
+
+static void test_magazines_reuse(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_memnode_t *node, *nodes = NULL;
+    apr_memnode_t *seen[MAGAZINE_NODES];
+    apr_status_t rv;
+    int i, j, reused = 0;
+
+    rv = apr_allocator_create(&allocator);
+    APR_ASSERT_SUCCESS(tc, "create allocator", rv);
+    rv = apr_allocator_magazines_set(allocator, 1, MAGAZINE_NODES);
+    if (rv == APR_ENOTIMPL) {
+        apr_allocator_destroy(allocator);
+        ABTS_NOT_IMPL(tc, "allocator magazines");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "set magazines", rv);
+
+    for (i = 0; i < MAGAZINE_NODES; i++) {
+        seen[i] = apr_allocator_alloc(allocator, 1000);
+        ABTS_PTR_NOTNULL(tc, seen[i]);
+    }
+    for (i = 0; i < MAGAZINE_NODES; i++) {
+        seen[i]->next = NULL;
+        apr_allocator_free(allocator, seen[i]);
+    }
+
+    /* All the nodes fit in the magazine, so they must be recycled */
+    for (i = 0; i < MAGAZINE_NODES; i++) {
+        node = apr_allocator_alloc(allocator, 1000);
+        ABTS_PTR_NOTNULL(tc, node);
+        for (j = 0; j < MAGAZINE_NODES; j++) {
+            if (node == seen[j]) {
+                reused++;
+                break;
+            }
+        }
+        node->next = nodes;
+        nodes = node;
+    }
+    ABTS_INT_EQUAL(tc, MAGAZINE_NODES, reused);
+    apr_allocator_free(allocator, nodes);
+
+    /* Disabling the magazines gives their nodes back to the free lists */
+    rv = apr_allocator_magazines_set(allocator, 0, 0);
+    APR_ASSERT_SUCCESS(tc, "unset magazines", rv);
+    node = apr_allocator_alloc(allocator, 1000);
+    ABTS_PTR_NOTNULL(tc, node);
+    for (j = 0; j < MAGAZINE_NODES; j++) {
+        if (node == seen[j]) {
+            break;
+        }
+    }
+    ABTS_ASSERT(tc, "node recycled from free lists", j < MAGAZINE_NODES);
+    apr_allocator_free(allocator, node);
+
+    apr_allocator_destroy(allocator);
+}
+
+static void * APR_THREAD_FUNC magazines_thread(apr_thread_t *thd, void *data)
+{
+    apr_allocator_t *allocator = data;
+    apr_pool_t *pool;
+    int i, j;
+
+    for (i = 0; i < 1000; i++) {
+        apr_pool_create_ex(&pool, NULL, NULL, allocator);
+        for (j = 0; j < 10; j++) {
+            memset(apr_palloc(pool, 3000), j, 3000);
+        }
+        apr_pool_clear(pool);
+        memset(apr_palloc(pool, 20000), 0, 20000);
+        apr_pool_destroy(pool);
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+static void test_magazines_threads(abts_case *tc, void *data)
+{
+    apr_allocator_t *allocator;
+    apr_thread_mutex_t *mutex;
+    apr_thread_t *threads[MAGAZINE_THREADS];
+    apr_status_t rv, retval;
+    int i;
+
+    rv = apr_allocator_create(&allocator);
+    APR_ASSERT_SUCCESS(tc, "create allocator", rv);
+    rv = apr_thread_mutex_create(&mutex, APR_THREAD_MUTEX_DEFAULT, p);
+    APR_ASSERT_SUCCESS(tc, "create mutex", rv);
+    apr_allocator_mutex_set(allocator, mutex);
+    /* Limited free memory, to exercise the magazines' reservations */
+    apr_allocator_max_free_set(allocator, 64 * 1024);
+    rv = apr_allocator_magazines_set(allocator, MAGAZINE_THREADS / 2, 4);
+    if (rv == APR_ENOTIMPL) {
+        apr_allocator_destroy(allocator);
+        ABTS_NOT_IMPL(tc, "allocator magazines");
+        return;
+    }
+    APR_ASSERT_SUCCESS(tc, "set magazines", rv);
+
+    for (i = 0; i < MAGAZINE_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, magazines_thread,
+                               allocator, p);
+        APR_ASSERT_SUCCESS(tc, "create thread", rv);
+    }
+    for (i = 0; i < MAGAZINE_THREADS; i++) {
+        rv = apr_thread_join(&retval, threads[i]);
+        APR_ASSERT_SUCCESS(tc, "join thread", rv);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, retval);
+    }
+
+    apr_allocator_max_free_set(allocator, 0);
+    apr_allocator_destroy(allocator);
+}
+
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testpool(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -188,6 +426,12 @@ abts_suite *testpool(abts_suite *suite)
     abts_run_test(suite, calloc_bytes, NULL);
     abts_run_test(suite, test_cleanups, NULL);
     abts_run_test(suite, test_tags, NULL);
+    abts_run_test(suite, test_slab, NULL);
+    abts_run_test(suite, test_arenas, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_magazines_reuse, NULL);
+    abts_run_test(suite, test_magazines_threads, NULL);
+#endif
 
     return suite;
 }
@@ -17,10 +17,14 @@
 #include "apu.h"
 #include "apr_queue.h"
 #include "apr_thread_pool.h"
+#include "apr_thread_proc.h"
+#include "apr_atomic.h"
 #include "apr_time.h"
 #include "abts.h"
 #include "testutil.h"
 
+#include <string.h>
+
 #if APR_HAS_THREADS
 
 #define NUMBER_CONSUMERS    3
@@ -29,6 +33,10 @@
 #define PRODUCER_ACTIVITY   5
 #define QUEUE_SIZE          100
 
+#define MPMC_QUEUE_SIZE     16
+#define MPMC_ITEMS          20000
+#define MPMC_MAX_THREADS    4
+
 static apr_queue_t *queue;
 
 static void * APR_THREAD_FUNC consumer(apr_thread_t *thd, void *data)
@@ -121,7 +129,7 @@ static void test_queue_producer_consumer(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
-static void test_queue_timeout(abts_case *tc, void *data)
+static void queue_timeout(abts_case *tc, apr_uint32_t flags)
 {
     apr_queue_t *q;
     apr_status_t rv;
@@ -129,7 +137,7 @@ static void test_queue_timeout(abts_case *tc, void *data)
     unsigned int i;
     void *value;
 
-    rv = apr_queue_create(&q, 5, p);
+    rv = apr_queue_create_ex(&q, 5, flags, p);
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 
     for (i = 0; i < 2; ++i) {
@@ -170,6 +178,234 @@ static void test_queue_timeout(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
+static void test_queue_timeout(abts_case *tc, void *data)
+{
+    queue_timeout(tc, 0);
+}
+
+static void test_queue_lockfree_timeout(abts_case *tc, void *data)
+{
+    queue_timeout(tc, APR_QUEUE_LOCKFREE);
+}
+
+static void test_queue_lockfree_order(abts_case *tc, void *data)
+{
+    apr_queue_t *q;
+    apr_status_t rv;
+    apr_size_t i;
+    void *value;
+
+    rv = apr_queue_create_ex(&q, 0, APR_QUEUE_LOCKFREE, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    rv = apr_queue_create_ex(&q, 3, APR_QUEUE_LOCKFREE, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* wrap around the ring a few times */
+    for (i = 0; i < 10; ++i) {
+        rv = apr_queue_trypush(q, (void *)(2 * i));
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_queue_trypush(q, (void *)(2 * i + 1));
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, 2, apr_queue_size(q));
+
+        rv = apr_queue_trypop(q, &value);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_PTR_EQUAL(tc, (void *)(2 * i), value);
+        rv = apr_queue_pop(q, &value);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_PTR_EQUAL(tc, (void *)(2 * i + 1), value);
+        ABTS_INT_EQUAL(tc, 0, apr_queue_size(q));
+    }
+
+    rv = apr_queue_term(q);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_queue_trypush(q, NULL);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+    rv = apr_queue_trypop(q, &value);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+}
+
+static void queue_batch(abts_case *tc, apr_uint32_t flags)
+{
+    apr_queue_t *q;
+    apr_status_t rv;
+    apr_size_t i;
+    void *in[8], *out[8];
+    unsigned int n;
+
+    rv = apr_queue_create_ex(&q, 5, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < 8; ++i) {
+        in[i] = (void *)(i + 1);
+    }
+
+    n = 0;
+    rv = apr_queue_push_batch(q, in, &n, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, n);
+
+    /* as many as fit */
+    n = 3;
+    rv = apr_queue_push_batch(q, in, &n, -1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 3, n);
+    n = 5;
+    rv = apr_queue_push_batch(q, in + 3, &n, apr_time_from_msec(1));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 2, n);
+    ABTS_INT_EQUAL(tc, 5, apr_queue_size(q));
+
+    n = 3;
+    rv = apr_queue_push_batch(q, in + 5, &n, 0);
+    ABTS_TRUE(tc, APR_STATUS_IS_EAGAIN(rv));
+    ABTS_INT_EQUAL(tc, 0, n);
+    n = 3;
+    rv = apr_queue_push_batch(q, in + 5, &n, apr_time_from_msec(1));
+    ABTS_TRUE(tc, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, n);
+
+    /* as many as available, in order */
+    n = 2;
+    rv = apr_queue_pop_batch(q, out, &n, -1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 2, n);
+    n = 3;
+    rv = apr_queue_push_batch(q, in + 5, &n, -1);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 2, n);
+    n = 8;
+    rv = apr_queue_pop_batch(q, out + 2, &n, 0);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 5, n);
+    for (i = 0; i < 7; ++i) {
+        ABTS_PTR_EQUAL(tc, in[i], out[i]);
+    }
+
+    n = 8;
+    rv = apr_queue_pop_batch(q, out, &n, 0);
+    ABTS_TRUE(tc, APR_STATUS_IS_EAGAIN(rv));
+    ABTS_INT_EQUAL(tc, 0, n);
+    n = 8;
+    rv = apr_queue_pop_batch(q, out, &n, apr_time_from_msec(1));
+    ABTS_TRUE(tc, APR_STATUS_IS_TIMEUP(rv));
+    ABTS_INT_EQUAL(tc, 0, n);
+
+    rv = apr_queue_term(q);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    n = 8;
+    rv = apr_queue_pop_batch(q, out, &n, -1);
+    ABTS_INT_EQUAL(tc, APR_EOF, rv);
+    ABTS_INT_EQUAL(tc, 0, n);
+}
+
+static void test_queue_batch(abts_case *tc, void *data)
+{
+    queue_batch(tc, 0);
+}
+
+static void test_queue_lockfree_batch(abts_case *tc, void *data)
+{
+    queue_batch(tc, APR_QUEUE_LOCKFREE);
+}
+
+static volatile apr_uint32_t mpmc_popped;
+static volatile apr_uint32_t mpmc_errors;
+static apr_uint32_t mpmc_items;
+static unsigned char mpmc_seen[MPMC_MAX_THREADS * MPMC_ITEMS];
+
+static void * APR_THREAD_FUNC mpmc_producer(apr_thread_t *thd, void *data)
+{
+    apr_size_t base = (apr_size_t)data * MPMC_ITEMS;
+    apr_size_t i;
+
+    for (i = 0; i < MPMC_ITEMS; i++) {
+        apr_status_t rv;
+
+        do {
+            rv = apr_queue_push(queue, (void *)(base + i + 1));
+        } while (rv == APR_EINTR);
+        if (rv != APR_SUCCESS) {
+            apr_atomic_inc32(&mpmc_errors);
+        }
+    }
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC mpmc_consumer(apr_thread_t *thd, void *data)
+{
+    for (;;) {
+        apr_status_t rv;
+        void *v;
+
+        rv = apr_queue_pop(queue, &v);
+        if (rv == APR_EINTR) {
+            continue;
+        }
+        if (rv == APR_EOF) {
+            break;
+        }
+        if (rv != APR_SUCCESS || !v || (apr_size_t)v > mpmc_items
+                || mpmc_seen[(apr_size_t)v - 1]++) {
+            apr_atomic_inc32(&mpmc_errors);
+        }
+        apr_atomic_inc32(&mpmc_popped);
+    }
+    return NULL;
+}
+
+static void test_queue_lockfree_mpmc(abts_case *tc, void *data)
+{
+    apr_thread_t *producers[MPMC_MAX_THREADS], *consumers[MPMC_MAX_THREADS];
+    apr_status_t rv, retval;
+    int n, i, j;
+
+    for (n = 1; n <= MPMC_MAX_THREADS; n *= 2) {
+        rv = apr_queue_create_ex(&queue, MPMC_QUEUE_SIZE, APR_QUEUE_LOCKFREE,
+                                 p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+        mpmc_items = n * MPMC_ITEMS;
+        memset(mpmc_seen, 0, sizeof(mpmc_seen));
+        apr_atomic_set32(&mpmc_popped, 0);
+        apr_atomic_set32(&mpmc_errors, 0);
+
+        for (i = 0; i < n; i++) {
+            rv = apr_thread_create(&consumers[i], NULL, mpmc_consumer,
+                                   NULL, p);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+            rv = apr_thread_create(&producers[i], NULL, mpmc_producer,
+                                   (void *)(apr_size_t)i, p);
+            ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        }
+        for (i = 0; i < n; i++) {
+            apr_thread_join(&retval, producers[i]);
+        }
+
+        /* wait (up to 10s) for the consumers to drain the queue */
+        for (j = 0; j < 10000 && (apr_atomic_read32(&mpmc_popped)
+                                  < mpmc_items); ++j) {
+            apr_sleep(apr_time_from_msec(1));
+        }
+        ABTS_INT_EQUAL(tc, mpmc_items, apr_atomic_read32(&mpmc_popped));
+
+        /* the consumers now block on the empty queue */
+        rv = apr_queue_term(queue);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        for (i = 0; i < n; i++) {
+            apr_thread_join(&retval, consumers[i]);
+        }
+
+        ABTS_INT_EQUAL(tc, 0, apr_atomic_read32(&mpmc_errors));
+        for (j = 0; j < (int)mpmc_items; j++) {
+            if (mpmc_seen[j] != 1) {
+                break;
+            }
+        }
+        ABTS_INT_EQUAL(tc, mpmc_items, j);
+    }
+}
+
 #endif /* APR_HAS_THREADS */
 
 abts_suite *testqueue(abts_suite *suite)
@@ -179,6 +415,11 @@ abts_suite *testqueue(abts_suite *suite)
 #if APR_HAS_THREADS
     abts_run_test(suite, test_queue_producer_consumer, NULL);
     abts_run_test(suite, test_queue_timeout, NULL);
+    abts_run_test(suite, test_queue_lockfree_timeout, NULL);
+    abts_run_test(suite, test_queue_lockfree_order, NULL);
+    abts_run_test(suite, test_queue_lockfree_mpmc, NULL);
+    abts_run_test(suite, test_queue_batch, NULL);
+    abts_run_test(suite, test_queue_lockfree_batch, NULL);
 #endif /* APR_HAS_THREADS */
 
     return suite;
@@ -0,0 +1,228 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Queue benchmark: throughput of the classic (mutex) and lock-free
+ * apr_queue_t with the same number of producer and consumer threads,
+ * for increasing numbers of threads, then cost per item of the batch
+ * push/pop for increasing batch sizes.
+ */
+
+#include "apr_queue.h"
+#include "apr_thread_proc.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !APR_HAS_THREADS
+int main(void)
+{
+    fprintf(stderr,
+            "This program won't work on this platform because there is no "
+            "support for threads.\n");
+    return 0;
+}
+#else /* !APR_HAS_THREADS */
+
+#define DEFAULT_MAX_COUNTER 1000000
+#define DEFAULT_QUEUE_SIZE 1024
+#define MAX_THREADS 64
+#define MAX_BATCH 256
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static unsigned int queue_size = DEFAULT_QUEUE_SIZE;
+static int max_threads = 8;
+
+static apr_queue_t *queue;
+static long per_thread;
+static unsigned int batch;
+
+static void * APR_THREAD_FUNC producer(apr_thread_t *thd, void *data)
+{
+    void *items[MAX_BATCH];
+    unsigned int n;
+    long i;
+
+    if (batch == 1) {
+        for (i = 0; i < per_thread; i++) {
+            while (apr_queue_push(queue, (void *)(apr_size_t)(i + 1))
+                   == APR_EINTR)
+                ;
+        }
+        return NULL;
+    }
+
+    for (n = 0; n < batch; n++) {
+        items[n] = (void *)(apr_size_t)(n + 1);
+    }
+    for (i = 0; i < per_thread; i += n) {
+        n = per_thread - i < batch ? (unsigned int)(per_thread - i) : batch;
+        if (apr_queue_push_batch(queue, items, &n, -1) != APR_SUCCESS) {
+            n = 0;
+        }
+    }
+    return NULL;
+}
+
+static void * APR_THREAD_FUNC consumer(apr_thread_t *thd, void *data)
+{
+    void *items[MAX_BATCH];
+    unsigned int n;
+    long i;
+
+    if (batch == 1) {
+        for (i = 0; i < per_thread; i++) {
+            while (apr_queue_pop(queue, items) == APR_EINTR)
+                ;
+        }
+        return NULL;
+    }
+
+    for (i = 0; i < per_thread; i += n) {
+        n = per_thread - i < batch ? (unsigned int)(per_thread - i) : batch;
+        if (apr_queue_pop_batch(queue, items, &n, -1) != APR_SUCCESS) {
+            n = 0;
+        }
+    }
+    return NULL;
+}
+
+static double run(apr_pool_t *pool, int nthreads, apr_uint32_t flags)
+{
+    apr_thread_t *threads[2 * MAX_THREADS];
+    apr_status_t retval;
+    apr_time_t start, end;
+    int i;
+
+    if (apr_queue_create_ex(&queue, queue_size, flags, pool) != APR_SUCCESS) {
+        fprintf(stderr, "Could not create the queue\n");
+        exit(-1);
+    }
+    per_thread = max_counter / nthreads;
+
+    start = apr_time_now();
+    for (i = 0; i < nthreads; i++) {
+        if (apr_thread_create(&threads[2 * i], NULL, consumer, NULL,
+                              pool) != APR_SUCCESS
+                || apr_thread_create(&threads[2 * i + 1], NULL, producer,
+                                     NULL, pool) != APR_SUCCESS) {
+            fprintf(stderr, "Could not create the threads\n");
+            exit(-1);
+        }
+    }
+    for (i = 0; i < 2 * nthreads; i++) {
+        apr_thread_join(&retval, threads[i]);
+    }
+    end = apr_time_now();
+
+    apr_queue_term(queue);
+
+    return (double)per_thread * nthreads * APR_USEC_PER_SEC / 1000
+           / (end > start ? end - start : 1);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int n;
+
+    printf("APR Queue Performance Test\n"
+           "==========================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:s:t:v", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+            if (max_counter < MAX_THREADS) {
+                fprintf(stderr, "Invalid counter\n");
+                exit(-1);
+            }
+        }
+        else if (optchar == 's') {
+            queue_size = (unsigned int)atoi(optarg);
+            if (queue_size < 1) {
+                fprintf(stderr, "Invalid queue size\n");
+                exit(-1);
+            }
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAX_THREADS) {
+                fprintf(stderr, "Invalid number of threads (1-%d)\n",
+                        MAX_THREADS);
+                exit(-1);
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    printf("%ld items, queue of %u, throughput in K items/s\n\n",
+           max_counter, queue_size);
+    printf("%8s %14s %14s\n", "threads", "mutex", "lockfree");
+
+    batch = 1;
+    for (n = 1; n <= max_threads; n *= 2) {
+        double locked, lockfree;
+
+        locked = run(pool, n, 0);
+        lockfree = run(pool, n, APR_QUEUE_LOCKFREE);
+        printf("%5dx%-2d %14.0f %14.0f\n", n, n, locked, lockfree);
+    }
+
+    printf("\nBatch push/pop with %dx%d threads, nsec per item\n\n",
+           max_threads, max_threads);
+    printf("%8s %14s %14s\n", "batch", "mutex", "lockfree");
+
+    for (batch = 1; batch <= MAX_BATCH; batch *= 2) {
+        double locked, lockfree;
+
+        if (batch > queue_size) {
+            break;
+        }
+        locked = run(pool, max_threads, 0);
+        lockfree = run(pool, max_threads, APR_QUEUE_LOCKFREE);
+        printf("%8u %14.1f %14.1f\n", batch, 1000000 / locked,
+               1000000 / lockfree);
+    }
+
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -22,6 +22,9 @@
 #include "apr_hash.h"
 #include "apr_redis.h"
 #include "apr_network_io.h"
+#include "apr_thread_proc.h"
+#include "apr_signal.h"
+#include "testredis.h"
 
 #include <stdio.h>
 #if APR_HAVE_STDLIB_H
@@ -585,17 +588,713 @@ static void test_redis_setexget(abts_case * tc, void *data)
     }
 }
 
+/* consistent hashing: distribution, keys moved when a server is added or
+ * dead, and weights (no server needed)
+ */
+
+#define KETAMA_SERVERS 10
+#define KETAMA_KEYS 10000
+
+static apr_redis_server_t *ketama_lookup(apr_redis_t *rc, const char *key)
+{
+    return apr_redis_find_server_hash(rc, apr_redis_hash(rc, key, strlen(key)));
+}
+
+static void test_redis_ketama(abts_case *tc, void *data)
+{
+    apr_redis_t *rc;
+    apr_redis_server_t *servers[KETAMA_SERVERS + 1], **owners, *s;
+    apr_redis_ketama_t *ring;
+    apr_uint32_t weights[KETAMA_SERVERS + 1];
+    int counts[KETAMA_SERVERS + 1];
+    const char **keys;
+    int i, j, moved, wrong;
+    apr_status_t rv;
+
+    rv = apr_redis_create(p, KETAMA_SERVERS + 1, 0, &rc);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i <= KETAMA_SERVERS; i++) {
+        rv = apr_redis_server_create(p, HOST, PORT + i, 0, 1, 1, 60, 60,
+                                     &servers[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < KETAMA_SERVERS; i++) {
+        rv = apr_redis_add_server(rc, servers[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    keys = apr_palloc(p, KETAMA_KEYS * sizeof(char *));
+    owners = apr_palloc(p, KETAMA_KEYS * sizeof(*owners));
+    for (i = 0; i < KETAMA_KEYS; i++) {
+        keys[i] = apr_psprintf(p, "%s%d", prefix, i);
+    }
+
+    /* the ring spreads the keys evenly */
+    rv = apr_redis_ketama_create(&ring, rc, NULL, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rc->hash_func = apr_redis_hash_ketama;
+    rc->server_func = apr_redis_find_server_hash_ketama;
+    rc->server_baton = ring;
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < KETAMA_KEYS; i++) {
+        owners[i] = ketama_lookup(rc, keys[i]);
+        for (j = 0; j < KETAMA_SERVERS && servers[j] != owners[i]; j++)
+            ;
+        counts[j]++;
+    }
+    for (j = 0; j < KETAMA_SERVERS; j++) {
+        ABTS_TRUE(tc, counts[j] > KETAMA_KEYS / KETAMA_SERVERS / 2);
+        ABTS_TRUE(tc, counts[j] < KETAMA_KEYS / KETAMA_SERVERS * 3 / 2);
+    }
+
+    /* and only moves about 1/11th of them, all to the new server */
+    rv = apr_redis_add_server(rc, servers[KETAMA_SERVERS]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_redis_ketama_create(&ring, rc, NULL, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rc->server_baton = ring;
+    for (moved = wrong = 0, i = 0; i < KETAMA_KEYS; i++) {
+        s = ketama_lookup(rc, keys[i]);
+        if (s != owners[i]) {
+            moved++;
+            wrong += s != servers[KETAMA_SERVERS];
+            owners[i] = s;
+        }
+    }
+    ABTS_INT_EQUAL(tc, 0, wrong);
+    ABTS_TRUE(tc, moved > 0);
+    ABTS_TRUE(tc, moved < 2 * KETAMA_KEYS / (KETAMA_SERVERS + 1));
+
+    /* a dead server's keys go to the next servers on the ring only */
+    rv = apr_redis_disable_server(rc, servers[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (wrong = 0, i = 0; i < KETAMA_KEYS; i++) {
+        s = ketama_lookup(rc, keys[i]);
+        if (owners[i] == servers[0]) {
+            wrong += s == NULL || s == servers[0];
+        }
+        else {
+            wrong += s != owners[i];
+        }
+    }
+    ABTS_INT_EQUAL(tc, 0, wrong);
+    rv = apr_redis_enable_server(rc, servers[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* three times the weight, about three times the keys */
+    for (j = 0; j <= KETAMA_SERVERS; j++) {
+        weights[j] = j ? 1 : 3;
+    }
+    rv = apr_redis_ketama_create(&ring, rc, weights, 0, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rc->server_baton = ring;
+    memset(counts, 0, sizeof(counts));
+    for (i = 0; i < KETAMA_KEYS; i++) {
+        s = ketama_lookup(rc, keys[i]);
+        for (j = 0; j < KETAMA_SERVERS && servers[j] != s; j++)
+            ;
+        counts[j]++;
+    }
+    ABTS_TRUE(tc, counts[0] > 2 * KETAMA_KEYS / (KETAMA_SERVERS + 3));
+
+    /* whereas the default selection moves most of them */
+    rv = apr_redis_create(p, KETAMA_SERVERS + 1, 0, &rc);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < KETAMA_SERVERS; i++) {
+        rv = apr_redis_add_server(rc, servers[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < KETAMA_KEYS; i++) {
+        owners[i] = ketama_lookup(rc, keys[i]);
+    }
+    rv = apr_redis_add_server(rc, servers[KETAMA_SERVERS]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (moved = 0, i = 0; i < KETAMA_KEYS; i++) {
+        moved += ketama_lookup(rc, keys[i]) != owners[i];
+    }
+    ABTS_TRUE(tc, moved > KETAMA_KEYS / 2);
+}
+
+static void test_redis_multiget(abts_case * tc, void *data)
+{
+    apr_pool_t *pool = p;
+    apr_pool_t *tmppool;
+    apr_status_t rv;
+    apr_redis_t *redis;
+    apr_redis_server_t *server;
+    apr_redis_value_t *value;
+    apr_hash_t *tdata, *values = NULL;
+    apr_hash_index_t *hi;
+    apr_uint32_t i;
+
+    if (!has_redis_server()) {
+        ABTS_SKIP(tc, data, "Redis server not found.");
+        return;
+    }
+
+    rv = apr_redis_create(pool, 1, 0, &redis);
+    ABTS_ASSERT(tc, "redis create failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_server_create(pool, HOST, PORT, 0, 1, 1, 60, 60, &server);
+    ABTS_ASSERT(tc, "server create failed", rv == APR_SUCCESS);
+
+    rv = apr_redis_add_server(redis, server);
+    ABTS_ASSERT(tc, "server add failed", rv == APR_SUCCESS);
+
+    tdata = apr_hash_make(p);
+
+    create_test_hash(pool, tdata);
+
+    for (hi = apr_hash_first(p, tdata); hi; hi = apr_hash_next(hi)) {
+        const void *k;
+        void *v;
+        const char *key;
+
+        apr_hash_this(hi, &k, NULL, &v);
+        key = k;
+
+        rv = apr_redis_set(redis, key, v, strlen(v), 27);
+        ABTS_ASSERT(tc, "set failed", rv == APR_SUCCESS);
+    }
+
+    apr_pool_create(&tmppool, pool);
+    for (i = 0; i < TDATA_SET; i++)
+        apr_redis_add_multget_key(pool,
+                                  apr_pstrcat(pool, prefix,
+                                              apr_itoa(pool, i), NULL),
+                                  &values);
+
+    rv = apr_redis_multgetp(redis, tmppool, pool, values);
+
+    ABTS_ASSERT(tc, "multgetp failed", rv == APR_SUCCESS);
+    ABTS_ASSERT(tc, "multgetp returned too few results",
+                apr_hash_count(values) == TDATA_SET);
+
+    for (hi = apr_hash_first(p, values); hi; hi = apr_hash_next(hi)) {
+        value = apr_hash_this_val(hi);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, value->status);
+        ABTS_STR_EQUAL(tc, apr_hash_get(tdata, value->key,
+                                        APR_HASH_KEY_STRING), value->data);
+    }
+
+    for (hi = apr_hash_first(p, tdata); hi; hi = apr_hash_next(hi)) {
+        const void *k;
+        const char *key;
+
+        apr_hash_this(hi, &k, NULL, NULL);
+        key = k;
+
+        rv = apr_redis_delete(redis, key, 0);
+        ABTS_ASSERT(tc, "delete failed", rv == APR_SUCCESS);
+    }
+}
+
+/* pipelined commands, against the mock */
+
+#define PIPELINE_SERVERS 3
+#define PIPELINE_KEYS 200
+#define PIPELINE_BIG_SIZE (256 * 1024)
+
+static apr_status_t start_mock_servers(apr_proc_t *proc, int servers,
+                                       apr_pool_t *pool)
+{
+    apr_procattr_t *procattr;
+    apr_sockaddr_t *sa;
+    apr_socket_t *sock;
+    apr_status_t rv;
+    const char *args[6];
+    int i;
+
+    args[0] = "redismock" EXTENSION;
+    args[1] = "-p";
+    args[2] = apr_itoa(pool, MOCK_SERVERS_PORT);
+    args[3] = "-n";
+    args[4] = apr_itoa(pool, servers);
+    args[5] = NULL;
+
+    if ((rv = apr_procattr_create(&procattr, pool)) != APR_SUCCESS
+        || (rv = apr_procattr_io_set(procattr, APR_NO_PIPE, APR_NO_PIPE,
+                                     APR_NO_PIPE)) != APR_SUCCESS
+        || (rv = apr_procattr_error_check_set(procattr, 1)) != APR_SUCCESS
+        || (rv = apr_procattr_cmdtype_set(procattr, APR_PROGRAM_ENV))
+            != APR_SUCCESS
+        || (rv = apr_proc_create(proc, TESTBINPATH "redismock" EXTENSION,
+                                 args, NULL, procattr, pool)) != APR_SUCCESS
+        || (rv = apr_sockaddr_info_get(&sa, MOCK_HOST, APR_UNSPEC,
+                                       MOCK_SERVERS_PORT + servers - 1, 0,
+                                       pool)) != APR_SUCCESS) {
+        return rv;
+    }
+
+    /* Wait for the last server to listen */
+    for (i = 0; i < 50; i++) {
+        rv = apr_socket_create(&sock, sa->family, SOCK_STREAM, 0, pool);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        rv = apr_socket_connect(sock, sa);
+        apr_socket_close(sock);
+        if (rv == APR_SUCCESS) {
+            break;
+        }
+        apr_sleep(apr_time_from_msec(100));
+    }
+    return rv;
+}
+
+static void pipeline_count(void *baton, apr_redis_reply_t *reply)
+{
+    (*(int *)baton)++;
+}
+
+static void test_redis_pipeline(abts_case *tc, void *data)
+{
+    apr_pool_t *pool, *tmppool;
+    apr_status_t rv;
+    apr_redis_t *redis;
+    apr_redis_server_t *server;
+    apr_redis_pipeline_t *pipeline;
+    apr_redis_reply_t *replies[PIPELINE_KEYS + 1], *reply;
+    apr_redis_value_t *value;
+    apr_hash_t *values = NULL;
+    apr_proc_t proc;
+    apr_exit_why_e why;
+    const char *keys[PIPELINE_KEYS], *argv[3];
+    apr_size_t argvlen[3];
+    char *big, *big_cmd;
+    int exitcode, count, i;
+
+    apr_pool_create(&pool, p);
+
+    rv = start_mock_servers(&proc, PIPELINE_SERVERS, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS) {
+        return;
+    }
+
+    /* and one more server which is down */
+    rv = apr_redis_create(pool, PIPELINE_SERVERS + 1, 0, &redis);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < PIPELINE_SERVERS; i++) {
+        rv = apr_redis_server_create(pool, MOCK_HOST, MOCK_SERVERS_PORT + i,
+                                     0, 1, 1, 60, 60, &server);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        rv = apr_redis_add_server(redis, server);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+
+    rv = apr_redis_pipeline_create(&pipeline, redis, pipeline_count, &count,
+                                   pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* nothing queued */
+    rv = apr_redis_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* a value larger than the socket buffers, an empty one, and binary */
+    big = apr_palloc(pool, PIPELINE_BIG_SIZE);
+    for (i = 0; i < PIPELINE_BIG_SIZE; i++) {
+        big[i] = 'a' + i % 26;
+    }
+    big[PIPELINE_BIG_SIZE / 2] = '\0';
+    big[PIPELINE_BIG_SIZE / 2 + 1] = '\r';
+    big[PIPELINE_BIG_SIZE / 2 + 2] = '\n';
+
+    count = 0;
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        keys[i] = apr_psprintf(pool, "%spipeline%d", prefix, i);
+        argv[0] = "SET";
+        argv[1] = keys[i];
+        argv[2] = i == 0 ? big : i == 1 ? "" : keys[i];
+        argvlen[0] = 3;
+        argvlen[1] = strlen(keys[i]);
+        argvlen[2] = i == 0 ? PIPELINE_BIG_SIZE : strlen(argv[2]);
+        rv = apr_redis_pipeline_command(pipeline, keys[i], 3, argv, argvlen,
+                                        &replies[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+        ABTS_INT_EQUAL(tc, APR_INCOMPLETE, replies[i]->status);
+    }
+    rv = apr_redis_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, PIPELINE_KEYS, count);
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, replies[i]->status);
+        ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_STATUS, replies[i]->type);
+        ABTS_STR_EQUAL(tc, "OK", replies[i]->str);
+    }
+
+    /* all the keys and a missing one */
+    count = 0;
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        rv = apr_redis_pipeline_commandv(pipeline, keys[i], &replies[i],
+                                         "GET", keys[i], NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_redis_pipeline_commandv(pipeline, "pipelinemissing",
+                                     &replies[PIPELINE_KEYS], "GET",
+                                     "pipelinemissing", NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_redis_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, PIPELINE_KEYS + 1, count);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_STRING, replies[0]->type);
+    ABTS_INT_EQUAL(tc, PIPELINE_BIG_SIZE, replies[0]->len);
+    ABTS_TRUE(tc, memcmp(replies[0]->str, big, PIPELINE_BIG_SIZE) == 0);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_STRING, replies[1]->type);
+    ABTS_INT_EQUAL(tc, 0, replies[1]->len);
+    for (i = 2; i < PIPELINE_KEYS; i++) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, replies[i]->status);
+        ABTS_STR_EQUAL(tc, keys[i], replies[i]->str);
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, replies[PIPELINE_KEYS]->status);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_NIL, replies[PIPELINE_KEYS]->type);
+
+    /* what multgetp reads from the same servers */
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        apr_redis_add_multget_key(pool, keys[i], &values);
+    }
+    apr_redis_add_multget_key(pool, "pipelinemissing", &values);
+    apr_pool_create(&tmppool, pool);
+    rv = apr_redis_multgetp(redis, tmppool, pool, values);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        value = apr_hash_get(values, keys[i], APR_HASH_KEY_STRING);
+        ABTS_PTR_NOTNULL(tc, value);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, value->status);
+        ABTS_INT_EQUAL(tc, replies[i]->len, value->len);
+        ABTS_TRUE(tc, memcmp(replies[i]->str, value->data, value->len) == 0);
+    }
+    value = apr_hash_get(values, "pipelinemissing", APR_HASH_KEY_STRING);
+    ABTS_INT_EQUAL(tc, APR_NOTFOUND, value->status);
+
+    /* integers and errors, which are replies too */
+    apr_redis_pipeline_commandv(pipeline, keys[2], &replies[0], "DEL",
+                                keys[2], NULL);
+    apr_redis_pipeline_commandv(pipeline, keys[2], &replies[1], "INCRBY",
+                                keys[2], "-5", NULL);
+    apr_redis_pipeline_commandv(pipeline, keys[3], &replies[2], "INCR",
+                                keys[3], NULL);
+    apr_redis_pipeline_commandv(pipeline, keys[3], &replies[3], "NOSUCH",
+                                NULL);
+    rv = apr_redis_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_INTEGER, replies[0]->type);
+    ABTS_INT_EQUAL(tc, 1, (int)replies[0]->integer);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_INTEGER, replies[1]->type);
+    ABTS_INT_EQUAL(tc, -5, (int)replies[1]->integer);
+    for (i = 2; i < 4; i++) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, replies[i]->status);
+        ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_ERROR, replies[i]->type);
+        ABTS_TRUE(tc, strncmp(replies[i]->str, "ERR ", 4) == 0);
+    }
+
+    /* an error line larger than the buffers */
+    big_cmd = apr_palloc(pool, PIPELINE_BIG_SIZE + 1);
+    memset(big_cmd, 'X', PIPELINE_BIG_SIZE);
+    big_cmd[PIPELINE_BIG_SIZE] = '\0';
+    apr_redis_pipeline_commandv(pipeline, keys[0], &replies[0], big_cmd,
+                                NULL);
+    apr_redis_pipeline_commandv(pipeline, keys[0], &replies[1], "DEL",
+                                "pipelinemissing", NULL);
+    rv = apr_redis_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, replies[0]->status);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_ERROR, replies[0]->type);
+    ABTS_TRUE(tc, replies[0]->len > PIPELINE_BIG_SIZE);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, replies[1]->status);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_INTEGER, replies[1]->type);
+
+    /* an aggregate, larger than the buffers */
+    argv[0] = "MGET";
+    rv = apr_redis_pipeline_command(pipeline, keys[0], 1, argv, NULL, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_redis_pipeline_commandv(pipeline, keys[0], &reply, "MGET",
+                                     keys[0], keys[0], "pipelinemissing",
+                                     keys[1], NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_redis_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_ARRAY, reply->type);
+    ABTS_INT_EQUAL(tc, 4, reply->elements);
+    if (reply->elements == 4) {
+        for (i = 0; i < 2; i++) {
+            ABTS_INT_EQUAL(tc, PIPELINE_BIG_SIZE, reply->element[i]->len);
+            ABTS_TRUE(tc, memcmp(reply->element[i]->str, big,
+                                 PIPELINE_BIG_SIZE) == 0);
+        }
+        ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_NIL, reply->element[2]->type);
+        ABTS_INT_EQUAL(tc, 0, reply->element[3]->len);
+    }
+
+    /* the commands of a server which is down fail, not the others' */
+    rv = apr_redis_server_create(pool, MOCK_HOST,
+                                 MOCK_SERVERS_PORT + PIPELINE_SERVERS,
+                                 0, 1, 1, 60, 60, &server);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_redis_add_server(redis, server);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    count = 0;
+    for (i = 0; i < PIPELINE_KEYS; i++) {
+        apr_redis_pipeline_commandv(pipeline, keys[i], &replies[i], "GET",
+                                    keys[i], NULL);
+    }
+    rv = apr_redis_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_TRUE(tc, rv != APR_SUCCESS);
+    ABTS_INT_EQUAL(tc, PIPELINE_KEYS, count);
+    for (count = 0, i = 0; i < PIPELINE_KEYS; i++) {
+        if (replies[i]->status != APR_SUCCESS) {
+            ABTS_INT_EQUAL(tc, rv, replies[i]->status);
+            ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_NIL, replies[i]->type);
+            count++;
+        }
+    }
+    ABTS_TRUE(tc, count > 0 && count < PIPELINE_KEYS);
+    ABTS_INT_EQUAL(tc, APR_RC_SERVER_DEAD, server->status);
+
+    /* as are the keys of multgetp */
+    apr_redis_enable_server(redis, server);
+    rv = apr_redis_multgetp(redis, tmppool, pool, values);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (count = 0, i = 0; i < PIPELINE_KEYS; i++) {
+        value = apr_hash_get(values, keys[i], APR_HASH_KEY_STRING);
+        count += value->status != APR_SUCCESS;
+    }
+    ABTS_TRUE(tc, count > 0 && count < PIPELINE_KEYS);
+
+    apr_proc_kill(&proc, SIGTERM);
+    apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    apr_pool_destroy(pool);
+}
+
+/* the replies of RESP2 and RESP3, from DEBUG PROTOCOL of the mock */
+static void test_redis_resp3(abts_case *tc, void *data)
+{
+    static const char *types[] = {
+        "string", "integer", "double", "bignum", "null", "array", "set",
+        "map", "attrib", "push", "true", "false", "verbatim"
+    };
+#define NTYPES (sizeof(types) / sizeof(types[0]))
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_redis_t *redis;
+    apr_redis_server_t *server;
+    apr_redis_pipeline_t *pipeline;
+    apr_redis_reply_t *resp2[NTYPES], *resp3[NTYPES], *hello, *r;
+    apr_proc_t proc;
+    apr_exit_why_e why;
+    char *info;
+    int exitcode, i;
+
+    apr_pool_create(&pool, p);
+
+    rv = start_mock_servers(&proc, 1, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS) {
+        return;
+    }
+
+    rv = apr_redis_create(pool, 1, 0, &redis);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_redis_server_create(pool, MOCK_HOST, MOCK_SERVERS_PORT,
+                                 0, 1, 1, 60, 60, &server);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_redis_add_server(redis, server);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    rv = apr_redis_pipeline_create(&pipeline, redis, NULL, NULL, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* each type in RESP2, then in RESP3 back to RESP2 */
+    for (i = 0; i < NTYPES; i++) {
+        apr_redis_pipeline_commandv(pipeline, "", &resp2[i], "DEBUG",
+                                    "PROTOCOL", types[i], NULL);
+    }
+    apr_redis_pipeline_commandv(pipeline, "", &hello, "HELLO", "3", NULL);
+    for (i = 0; i < NTYPES; i++) {
+        apr_redis_pipeline_commandv(pipeline, "", &resp3[i], "DEBUG",
+                                    "PROTOCOL", types[i], NULL);
+    }
+    apr_redis_pipeline_commandv(pipeline, "", NULL, "HELLO", "2", NULL);
+    rv = apr_redis_pipeline_run(pipeline, apr_time_from_sec(10));
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_MAP, hello->type);
+    ABTS_INT_EQUAL(tc, 6, hello->elements);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_STRING, resp2[0]->type);
+    ABTS_STR_EQUAL(tc, "Hello World", resp2[0]->str);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_STRING, resp3[0]->type);
+    ABTS_STR_EQUAL(tc, "Hello World", resp3[0]->str);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_INTEGER, resp3[1]->type);
+    ABTS_INT_EQUAL(tc, 12345, (int)resp3[1]->integer);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_STRING, resp2[2]->type);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_DOUBLE, resp3[2]->type);
+    ABTS_STR_EQUAL(tc, "3.141", resp3[2]->str);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_BIGNUM, resp3[3]->type);
+    ABTS_STR_EQUAL(tc, "1234567999999999999999999999999999999",
+                   resp3[3]->str);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_NIL, resp2[4]->type);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_NIL, resp3[4]->type);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_ARRAY, resp3[5]->type);
+    ABTS_INT_EQUAL(tc, 3, resp3[5]->elements);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_ARRAY, resp2[6]->type);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_SET, resp3[6]->type);
+    ABTS_INT_EQUAL(tc, 3, resp3[6]->elements);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_ARRAY, resp2[7]->type);
+    ABTS_INT_EQUAL(tc, 6, resp2[7]->elements);
+    r = resp3[7];
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_MAP, r->type);
+    ABTS_INT_EQUAL(tc, 6, r->elements);
+    if (r->elements == 6) {
+        ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_INTEGER, r->element[2]->type);
+        ABTS_INT_EQUAL(tc, 1, (int)r->element[2]->integer);
+        ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_BOOLEAN, r->element[3]->type);
+        ABTS_INT_EQUAL(tc, 1, (int)r->element[3]->integer);
+    }
+
+    /* the attribute and the push are skipped, for the replies following */
+    ABTS_STR_EQUAL(tc, "Some real reply following the attribute",
+                   resp2[8]->str);
+    ABTS_STR_EQUAL(tc, "Some real reply following the attribute",
+                   resp3[8]->str);
+    ABTS_STR_EQUAL(tc, "Some real reply following the push reply",
+                   resp3[9]->str);
+
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_INTEGER, resp2[10]->type);
+    ABTS_INT_EQUAL(tc, 1, (int)resp2[10]->integer);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_BOOLEAN, resp3[10]->type);
+    ABTS_INT_EQUAL(tc, 1, (int)resp3[10]->integer);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_BOOLEAN, resp3[11]->type);
+    ABTS_INT_EQUAL(tc, 0, (int)resp3[11]->integer);
+
+    ABTS_STR_EQUAL(tc, "This is a verbatim\nstring", resp2[12]->str);
+    ABTS_INT_EQUAL(tc, APR_REDIS_REPLY_STRING, resp3[12]->type);
+    ABTS_STR_EQUAL(tc, "This is a verbatim\nstring", resp3[12]->str);
+
+    /* the connection is back to RESP2 for the other functions */
+    rv = apr_redis_version(server, pool, &info);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_STR_EQUAL(tc, "7.0.0", info);
+
+    apr_proc_kill(&proc, SIGTERM);
+    apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    apr_pool_destroy(pool);
+#undef NTYPES
+}
+
+#if APR_HAS_THREADS
+
+#define SHARDED_THREADS 8
+#define SHARDED_ITERATIONS 50
+
+typedef struct {
+    abts_case *tc;
+    apr_redis_t *redis;
+    int id;
+} sharded_info_t;
+
+static void * APR_THREAD_FUNC sharded_thread(apr_thread_t *thd, void *data)
+{
+    sharded_info_t *info = data;
+    apr_pool_t *pool;
+    apr_status_t rv;
+    char *key, *value, *result;
+    apr_size_t len;
+    int i;
+
+    apr_pool_create(&pool, NULL);
+    for (i = 0; i < SHARDED_ITERATIONS; i++) {
+        key = apr_psprintf(pool, "sharded-%d-%d", info->id, i);
+        value = apr_psprintf(pool, "%d", info->id * i);
+        rv = apr_redis_set(info->redis, key, value, strlen(value), 0);
+        ABTS_INT_EQUAL(info->tc, APR_SUCCESS, rv);
+        rv = apr_redis_getp(info->redis, pool, key, &result, &len, NULL);
+        ABTS_INT_EQUAL(info->tc, APR_SUCCESS, rv);
+        if (rv == APR_SUCCESS) {
+            ABTS_STR_EQUAL(info->tc, value, result);
+        }
+    }
+    apr_pool_destroy(pool);
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+/* threads sharing a server whose connections are sharded */
+static void test_redis_sharded(abts_case *tc, void *data)
+{
+    apr_pool_t *pool;
+    apr_status_t rv, retval;
+    apr_redis_t *redis;
+    apr_redis_server_t *server;
+    apr_thread_t *threads[SHARDED_THREADS];
+    sharded_info_t info[SHARDED_THREADS];
+    apr_proc_t proc;
+    apr_exit_why_e why;
+    int exitcode, i;
+
+    apr_pool_create(&pool, p);
+
+    rv = start_mock_servers(&proc, 1, pool);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    if (rv != APR_SUCCESS) {
+        return;
+    }
+
+    rv = apr_redis_create(pool, 1, 0, &redis);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_redis_server_create_ex(pool, MOCK_HOST, MOCK_SERVERS_PORT,
+                                    0, 4, 4, 60, 60, 4, APR_RESLIST_LOCKFREE,
+                                    &server);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_redis_add_server(redis, server);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    for (i = 0; i < SHARDED_THREADS; i++) {
+        info[i].tc = tc;
+        info[i].redis = redis;
+        info[i].id = i;
+        rv = apr_thread_create(&threads[i], NULL, sharded_thread, &info[i],
+                               pool);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < SHARDED_THREADS; i++) {
+        apr_thread_join(&retval, threads[i]);
+    }
+    ABTS_INT_EQUAL(tc, 0, apr_reslist_acquired_count(server->conns));
+
+    apr_proc_kill(&proc, SIGTERM);
+    apr_proc_wait(&proc, &exitcode, &why, APR_WAIT);
+    apr_pool_destroy(pool);
+}
+
+#endif /* APR_HAS_THREADS */
+
 abts_suite *testredis(abts_suite * suite)
 {
     suite = ADD_SUITE(suite);
 
     abts_run_test(suite, test_redis_create, NULL);
     abts_run_test(suite, test_redis_user_funcs, NULL);
+    abts_run_test(suite, test_redis_ketama, NULL);
     abts_run_test(suite, test_redis_meta, NULL);
     abts_run_test(suite, test_redis_setget, NULL);
     abts_run_test(suite, test_redis_setexget, NULL);
-    /* abts_run_test(suite, test_redis_multiget, NULL); */
+    abts_run_test(suite, test_redis_multiget, NULL);
     abts_run_test(suite, test_redis_incrdecr, NULL);
+    abts_run_test(suite, test_redis_pipeline, NULL);
+    abts_run_test(suite, test_redis_resp3, NULL);
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_redis_sharded, NULL);
+#endif
 
     return suite;
 }
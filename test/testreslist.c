@@ -21,6 +21,7 @@
 #include "apu.h"
 #include "apr_reslist.h"
 #include "apr_thread_pool.h"
+#include "apr_thread_proc.h"
 
 #if APR_HAVE_TIME_H
 #include <time.h>
@@ -213,7 +214,7 @@ static void test_shrinking(abts_case *tc, apr_reslist_t *rl, int acquire_flags)
     }
 }
 
-static void test_reslist(abts_case *tc, void *data)
+static void run_reslist(abts_case *tc, int acquire_flags, apr_uint32_t flags)
 {
     int i;
     apr_status_t rv;
@@ -221,7 +222,6 @@ static void test_reslist(abts_case *tc, void *data)
     my_parameters_t *params;
     apr_thread_pool_t *thrp;
     my_thread_info_t thread_info[CONSUMER_THREADS];
-    int acquire_flags = (int)(apr_uintptr_t)data;
 
     rv = apr_thread_pool_create(&thrp, CONSUMER_THREADS/2, CONSUMER_THREADS, p);
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
@@ -233,9 +233,9 @@ static void test_reslist(abts_case *tc, void *data)
     params->sleep_upon_destruct = DESTRUCT_SLEEP_TIME;
 
     /* We're going to want 10 blocks of data from our target rmm. */
-    rv = apr_reslist_create(&rl, RESLIST_MIN, RESLIST_SMAX, RESLIST_HMAX,
-                            RESLIST_TTL, my_constructor, my_destructor,
-                            params, p);
+    rv = apr_reslist_create_ex(&rl, RESLIST_MIN, RESLIST_SMAX, RESLIST_HMAX,
+                               RESLIST_TTL, my_constructor, my_destructor,
+                               params, flags, p);
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 
     for (i = 0; i < CONSUMER_THREADS; i++) {
@@ -261,6 +261,255 @@ static void test_reslist(abts_case *tc, void *data)
     ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
 }
 
+static void test_reslist(abts_case *tc, void *data)
+{
+    run_reslist(tc, (int)(apr_uintptr_t)data, 0);
+}
+
+static void test_reslist_lockfree(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_reslist_t *rl;
+    my_parameters_t *params;
+    void *vp;
+
+    run_reslist(tc, APR_RESLIST_ACQUIRE_LIFO, APR_RESLIST_LOCKFREE);
+
+    params = apr_pcalloc(p, sizeof(*params));
+    rv = apr_reslist_create_ex(&rl, 0, 1, 1, 0, my_constructor, my_destructor,
+                               params, APR_RESLIST_LOCKFREE, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_reslist_acquire_ex(rl, &vp, APR_RESLIST_ACQUIRE_FIFO);
+    ABTS_INT_EQUAL(tc, APR_ENOTIMPL, rv);
+    rv = apr_reslist_destroy(rl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_reslist_stats(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_reslist_t *rl;
+    apr_reslist_stats_t stats;
+    my_parameters_t *params;
+    my_resource_t *res[2];
+    void *vp;
+    apr_uint32_t flags = (apr_uint32_t)(apr_uintptr_t)data;
+    int i, waited;
+
+    params = apr_pcalloc(p, sizeof(*params));
+    rv = apr_reslist_create_ex(&rl, 0, 2, 2, 0, my_constructor, my_destructor,
+                               params, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_reslist_timeout_set(rl, 1000);
+
+    /* two constructions, then a timeout */
+    for (i = 0; i < 2; i++) {
+        rv = apr_reslist_acquire(rl, (void **)&res[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_reslist_acquire(rl, &vp);
+    ABTS_TRUE(tc, APR_STATUS_IS_TIMEUP(rv));
+
+    /* an idle one, the latest released */
+    rv = apr_reslist_release(rl, res[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_reslist_release(rl, res[1]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    rv = apr_reslist_acquire(rl, &vp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_PTR_EQUAL(tc, res[1], vp);
+    rv = apr_reslist_invalidate(rl, vp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, apr_reslist_acquired_count(rl));
+
+    apr_reslist_stats_get(rl, &stats);
+    ABTS_INT_EQUAL(tc, 2, stats.constructed);
+    ABTS_INT_EQUAL(tc, 1, stats.destroyed);
+    ABTS_INT_EQUAL(tc, 1, stats.timeouts);
+    ABTS_INT_EQUAL(tc, 1, stats.wait[0]);
+    for (waited = 0, i = 1; i < APR_RESLIST_WAIT_BUCKETS; i++) {
+        waited += stats.wait[i];
+    }
+    ABTS_INT_EQUAL(tc, 2, waited);
+
+    rv = apr_reslist_destroy(rl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_reslist_stats_get(rl, &stats);
+    ABTS_INT_EQUAL(tc, 2, stats.destroyed);
+}
+
+static void test_reslist_sharded(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_reslist_t *rl;
+    apr_reslist_stats_t stats;
+    my_parameters_t *params;
+    my_resource_t *res[RESLIST_HMAX];
+    apr_thread_pool_t *thrp;
+    my_thread_info_t thread_info[CONSUMER_THREADS];
+    apr_uint32_t flags = (apr_uint32_t)(apr_uintptr_t)data;
+    void *vp;
+    int i;
+
+    params = apr_pcalloc(p, sizeof(*params));
+
+    rv = apr_reslist_create_sharded(&rl, 0, RESLIST_MIN, RESLIST_SMAX,
+                                    RESLIST_HMAX, 0, my_constructor,
+                                    my_destructor, params, flags, p);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* min is split between the 4 shards, 3 of them get one */
+    rv = apr_reslist_create_sharded(&rl, 4, RESLIST_MIN, RESLIST_SMAX,
+                                    RESLIST_HMAX, RESLIST_TTL, my_constructor,
+                                    my_destructor, params, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, RESLIST_MIN, params->c_count);
+    apr_reslist_timeout_set(rl, 1000);
+
+    /* One thread can still have them all, borrowing from the siblings */
+    for (i = 0; i < RESLIST_HMAX; i++) {
+        rv = apr_reslist_acquire(rl, (void **)&res[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_INT_EQUAL(tc, RESLIST_HMAX, params->c_count - params->d_count);
+    ABTS_INT_EQUAL(tc, RESLIST_HMAX, apr_reslist_acquired_count(rl));
+    rv = apr_reslist_acquire(rl, &vp);
+    ABTS_TRUE(tc, APR_STATUS_IS_TIMEUP(rv));
+
+    rv = apr_reslist_invalidate(rl, res[0]);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 1; i < RESLIST_HMAX; i++) {
+        rv = apr_reslist_release(rl, res[i]);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    ABTS_INT_EQUAL(tc, 0, apr_reslist_acquired_count(rl));
+    rv = apr_reslist_release(rl, params);
+    ABTS_INT_EQUAL(tc, APR_EINVAL, rv);
+
+    /* Now with threads, each shard constructing on its own */
+    apr_reslist_timeout_set(rl, 0);
+    rv = apr_thread_pool_create(&thrp, CONSUMER_THREADS/2, CONSUMER_THREADS, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < CONSUMER_THREADS; i++) {
+        thread_info[i].tid = i;
+        thread_info[i].tc = tc;
+        thread_info[i].reslist = rl;
+        thread_info[i].work_delay_sleep = WORK_DELAY_SLEEP_TIME;
+        thread_info[i].acquire_flags = 0;
+        rv = apr_thread_pool_push(thrp, resource_consuming_thread,
+                                  &thread_info[i], 0, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 0, apr_reslist_acquired_count(rl));
+
+    rv = apr_reslist_destroy(rl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_reslist_stats_get(rl, &stats);
+    ABTS_INT_EQUAL(tc, stats.constructed, stats.destroyed);
+}
+
+#define CONTENTION_THREADS    8
+#define CONTENTION_ITERATIONS 20000
+#define CONTENTION_SHARDS     4
+
+typedef struct {
+    abts_case *tc;
+    apr_reslist_t *reslist;
+} contention_info_t;
+
+static void * APR_THREAD_FUNC contending_thread(apr_thread_t *thd, void *data)
+{
+    contention_info_t *info = data;
+    apr_status_t rv;
+    my_resource_t *res;
+    int i;
+
+    for (i = 0; i < CONTENTION_ITERATIONS; i++) {
+        rv = apr_reslist_acquire(info->reslist, (void **)&res);
+        if (rv != APR_SUCCESS) {
+            ABTS_INT_EQUAL(info->tc, APR_SUCCESS, rv);
+            break;
+        }
+        rv = apr_reslist_release(info->reslist, res);
+        if (rv != APR_SUCCESS) {
+            ABTS_INT_EQUAL(info->tc, APR_SUCCESS, rv);
+            break;
+        }
+    }
+
+    apr_thread_exit(thd, APR_SUCCESS);
+    return NULL;
+}
+
+/* Acquire/release per second, CONTENTION_THREADS sharing hmax resources */
+static double contention_rate(abts_case *tc, int hmax, int nshards,
+                              apr_uint32_t flags)
+{
+    apr_status_t rv, retval;
+    apr_reslist_t *rl;
+    apr_reslist_stats_t stats;
+    my_parameters_t *params;
+    apr_thread_t *threads[CONTENTION_THREADS];
+    contention_info_t info;
+    apr_time_t start, elapsed;
+    apr_uint32_t acquired = 0;
+    int i;
+
+    params = apr_pcalloc(p, sizeof(*params));
+    rv = apr_reslist_create_sharded(&rl, nshards, 0, hmax, hmax, 0,
+                                    my_constructor, my_destructor, params,
+                                    flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    info.tc = tc;
+    info.reslist = rl;
+
+    start = apr_time_now();
+    for (i = 0; i < CONTENTION_THREADS; i++) {
+        rv = apr_thread_create(&threads[i], NULL, contending_thread, &info, p);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    for (i = 0; i < CONTENTION_THREADS; i++) {
+        apr_thread_join(&retval, threads[i]);
+    }
+    elapsed = apr_time_now() - start;
+
+    apr_reslist_stats_get(rl, &stats);
+    for (i = 0; i < APR_RESLIST_WAIT_BUCKETS; i++) {
+        acquired += stats.wait[i];
+    }
+    ABTS_INT_EQUAL(tc, CONTENTION_THREADS * CONTENTION_ITERATIONS, acquired);
+    ABTS_ASSERT(tc, "too many resources", stats.constructed <= hmax);
+    ABTS_INT_EQUAL(tc, 0, apr_reslist_acquired_count(rl));
+
+    rv = apr_reslist_destroy(rl);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    apr_reslist_stats_get(rl, &stats);
+    ABTS_INT_EQUAL(tc, stats.constructed, stats.destroyed);
+
+    return (double)acquired * APR_USEC_PER_SEC / (elapsed ? elapsed : 1);
+}
+
+static void test_reslist_contention(abts_case *tc, void *data)
+{
+    int hmax;
+
+    for (hmax = CONTENTION_THREADS / 2; hmax <= CONTENTION_THREADS;
+         hmax *= 2) {
+        double locked = contention_rate(tc, hmax, 1, 0);
+        double lockfree = contention_rate(tc, hmax, 1, APR_RESLIST_LOCKFREE);
+        double sharded = contention_rate(tc, hmax, CONTENTION_SHARDS, 0);
+        double both = contention_rate(tc, hmax, CONTENTION_SHARDS,
+                                      APR_RESLIST_LOCKFREE);
+        abts_log_message("%d threads, %d resources: %.0f acquires/s locked, "
+                         "%.0f acquires/s lock-free, %d shards: %.0f "
+                         "acquires/s locked, %.0f acquires/s lock-free",
+                         CONTENTION_THREADS, hmax, locked, lockfree,
+                         CONTENTION_SHARDS, sharded, both);
+    }
+}
+
 static void test_reslist_no_ttl(abts_case *tc, void *data)
 {
     apr_status_t rv;
@@ -311,6 +560,14 @@ abts_suite *testreslist(abts_suite *suite)
     abts_run_test(suite, test_reslist,
                   (void*)(apr_uintptr_t)APR_RESLIST_ACQUIRE_FIFO);
     abts_run_test(suite, test_reslist_no_ttl, NULL);
+    abts_run_test(suite, test_reslist_lockfree, NULL);
+    abts_run_test(suite, test_reslist_stats, (void*)(apr_uintptr_t)0);
+    abts_run_test(suite, test_reslist_stats,
+                  (void*)(apr_uintptr_t)APR_RESLIST_LOCKFREE);
+    abts_run_test(suite, test_reslist_sharded, (void*)(apr_uintptr_t)0);
+    abts_run_test(suite, test_reslist_sharded,
+                  (void*)(apr_uintptr_t)APR_RESLIST_LOCKFREE);
+    abts_run_test(suite, test_reslist_contention, NULL);
 #endif
 
     return suite;
@@ -222,6 +222,99 @@ static void table_overlap3(abts_case *tc, void *data)
 
 }
 
+#define MANY_KEYS 100
+
+static void check_many(abts_case *tc, const apr_table_t *t, int from, int to)
+{
+    int i;
+
+    for (i = 0; i < MANY_KEYS; i++) {
+        const char *key = apr_psprintf(p, "x-FORWARDED-%d", i);
+        const char *val = apr_table_get(t, key);
+        if (i >= from && i < to) {
+            ABTS_STR_EQUAL(tc, apr_psprintf(p, "v%d", i), val);
+        }
+        else {
+            ABTS_PTR_EQUAL(tc, NULL, val);
+        }
+    }
+}
+
+static void table_many_keys(abts_case *tc, void *data)
+{
+    apr_table_t *t, *t2, *res;
+    int i;
+
+    t = apr_table_make(p, 4);
+    for (i = 0; i < MANY_KEYS; i++) {
+        apr_table_add(t, apr_psprintf(p, "X-Forwarded-%d", i),
+                      apr_psprintf(p, "v%d", i));
+    }
+    ABTS_INT_EQUAL(tc, MANY_KEYS, apr_table_elts(t)->nelts);
+    check_many(tc, t, 0, MANY_KEYS);
+
+    /* set replaces the duplicates */
+    apr_table_add(t, "X-Forwarded-7", "dup1");
+    apr_table_add(t, "x-forwarded-7", "dup2");
+    ABTS_STR_EQUAL(tc, "v7", apr_table_get(t, "X-Forwarded-7"));
+    ABTS_STR_EQUAL(tc, "v7,dup1,dup2", apr_table_getm(p, t, "X-Forwarded-7"));
+    apr_table_set(t, "X-FORWARDED-7", "v7");
+    ABTS_INT_EQUAL(tc, MANY_KEYS, apr_table_elts(t)->nelts);
+    check_many(tc, t, 0, MANY_KEYS);
+
+    /* unset moves the following entries */
+    for (i = 0; i < 10; i++) {
+        apr_table_unset(t, apr_psprintf(p, "X-Forwarded-%d", i));
+    }
+    ABTS_INT_EQUAL(tc, MANY_KEYS - 10, apr_table_elts(t)->nelts);
+    check_many(tc, t, 10, MANY_KEYS);
+
+    apr_table_merge(t, "X-Forwarded-50", "merged");
+    ABTS_STR_EQUAL(tc, "v50, merged", apr_table_get(t, "X-Forwarded-50"));
+    apr_table_setn(t, "X-Forwarded-50", "v50");
+    apr_table_mergen(t, "X-Forwarded-5", "v5");
+    ABTS_STR_EQUAL(tc, "v5", apr_table_get(t, "X-Forwarded-5"));
+    apr_table_unset(t, "X-Forwarded-5");
+
+    /* copy, then compress a table with duplicates */
+    t2 = apr_table_copy(p, t);
+    check_many(tc, t2, 10, MANY_KEYS);
+    for (i = 10; i < 20; i++) {
+        apr_table_addn(t2, apr_psprintf(p, "X-Forwarded-%d", i), "dup");
+    }
+    apr_table_compress(t2, APR_OVERLAP_TABLES_SET);
+    ABTS_INT_EQUAL(tc, MANY_KEYS - 10, apr_table_elts(t2)->nelts);
+    for (i = 10; i < 20; i++) {
+        const char *key = apr_psprintf(p, "X-Forwarded-%d", i);
+        ABTS_STR_EQUAL(tc, "dup", apr_table_get(t2, key));
+        apr_table_setn(t2, key, apr_psprintf(p, "v%d", i));
+    }
+    check_many(tc, t2, 10, MANY_KEYS);
+
+    /* overlay and overlap */
+    t2 = apr_table_make(p, 4);
+    for (i = 0; i < 10; i++) {
+        apr_table_add(t2, apr_psprintf(p, "X-Forwarded-%d", i),
+                      apr_psprintf(p, "v%d", i));
+    }
+    res = apr_table_overlay(p, t2, t);
+    check_many(tc, res, 0, MANY_KEYS);
+    apr_table_overlap(t, t2, APR_OVERLAP_TABLES_ADD);
+    check_many(tc, t, 0, MANY_KEYS);
+    apr_table_overlap(t, t2, APR_OVERLAP_TABLES_MERGE);
+    ABTS_INT_EQUAL(tc, MANY_KEYS, apr_table_elts(t)->nelts);
+    ABTS_STR_EQUAL(tc, "v3, v3", apr_table_get(t, "X-Forwarded-3"));
+    check_many(tc, res, 0, MANY_KEYS);
+
+    apr_table_clear(t);
+    check_many(tc, t, 0, 0);
+    for (i = 0; i < MANY_KEYS; i++) {
+        apr_table_setn(t, apr_psprintf(p, "X-Forwarded-%d", i),
+                       apr_psprintf(p, "v%d", i));
+    }
+    check_many(tc, t, 0, MANY_KEYS);
+}
+
 abts_suite *testtable(abts_suite *suite)
 {
     suite = ADD_SUITE(suite)
@@ -239,6 +332,7 @@ abts_suite *testtable(abts_suite *suite)
     abts_run_test(suite, table_overlap, NULL);
     abts_run_test(suite, table_overlap2, NULL);
     abts_run_test(suite, table_overlap3, NULL);
+    abts_run_test(suite, table_many_keys, NULL);
 
     return suite;
 }
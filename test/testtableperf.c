@@ -0,0 +1,182 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Tables benchmark: header-like tables whose keys share prefixes
+ * (Accept-*, X-Forwarded-*, Sec-*...), built per "request" and then
+ * looked up (hits and misses), set, merged and unset, for increasing
+ * numbers of headers.  The lookups are compared with a plain linear
+ * strcasecmp() scan of the entries.
+ */
+
+#include "apr_pools.h"
+#include "apr_tables.h"
+#include "apr_strings.h"
+#include "apr_cstr.h"
+#include "apr_lib.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define DEFAULT_MAX_COUNTER 20000
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+
+static const char *prefixes[] = {
+    "Accept-", "X-Forwarded-", "Sec-Fetch-", "Sec-CH-UA-", "X-Request-",
+    "Content-", "If-", "X-Custom-Header-"
+};
+#define NUM_PREFIXES (int)(sizeof(prefixes) / sizeof(prefixes[0]))
+
+static const char *linear_get(const apr_table_t *t, const char *key)
+{
+    const apr_array_header_t *arr = apr_table_elts(t);
+    const apr_table_entry_t *elts = (const apr_table_entry_t *)arr->elts;
+    int i;
+
+    for (i = 0; i < arr->nelts; i++) {
+        if (!apr_cstr_casecmp(elts[i].key, key)) {
+            return elts[i].val;
+        }
+    }
+    return NULL;
+}
+
+static void run(apr_pool_t *pool, int nheaders)
+{
+    apr_pool_t *rpool;
+    const char **keys, **lkeys, **misses;
+    apr_time_t t_build = 0, t_get = 0, t_linear = 0, t_update = 0, start;
+    long found = 0, i;
+    char *lower;
+    int j;
+
+    keys = apr_palloc(pool, nheaders * sizeof(char *));
+    lkeys = apr_palloc(pool, nheaders * sizeof(char *));
+    misses = apr_palloc(pool, nheaders * sizeof(char *));
+    for (j = 0; j < nheaders; j++) {
+        keys[j] = apr_psprintf(pool, "%s%d", prefixes[j % NUM_PREFIXES], j);
+        lkeys[j] = lower = apr_pstrdup(pool, keys[j]);
+        for (; *lower; lower++) {
+            *lower = apr_tolower(*lower);
+        }
+        misses[j] = apr_psprintf(pool, "%sMissing-%d",
+                                 prefixes[j % NUM_PREFIXES], j);
+    }
+    apr_pool_create(&rpool, pool);
+
+    for (i = 0; i < max_counter; i++) {
+        apr_table_t *t;
+
+        start = apr_time_now();
+        t = apr_table_make(rpool, 10);
+        for (j = 0; j < nheaders; j++) {
+            apr_table_addn(t, keys[j], "value");
+        }
+        t_build += apr_time_now() - start;
+
+        start = apr_time_now();
+        for (j = 0; j < nheaders; j++) {
+            found += apr_table_get(t, lkeys[j]) != NULL;
+            found += apr_table_get(t, misses[j]) == NULL;
+        }
+        t_get += apr_time_now() - start;
+
+        start = apr_time_now();
+        for (j = 0; j < nheaders; j++) {
+            found += linear_get(t, lkeys[j]) != NULL;
+            found += linear_get(t, misses[j]) == NULL;
+        }
+        t_linear += apr_time_now() - start;
+
+        start = apr_time_now();
+        for (j = 0; j < nheaders; j += 4) {
+            apr_table_setn(t, lkeys[j], "other");
+            apr_table_mergen(t, keys[j + 1 < nheaders ? j + 1 : j], "more");
+        }
+        for (j = 0; j < nheaders; j += 8) {
+            apr_table_unset(t, keys[j]);
+        }
+        t_update += apr_time_now() - start;
+
+        apr_pool_clear(rpool);
+    }
+
+    printf("%8d %12.1f %12.1f %12.1f %12.1f%s\n", nheaders,
+           (double)t_build * 1000 / max_counter / nheaders,
+           (double)t_get * 1000 / max_counter / (2 * nheaders),
+           (double)t_linear * 1000 / max_counter / (2 * nheaders),
+           (double)t_update * 1000 / max_counter,
+           found == 4 * nheaders * max_counter ? "" : "  (error)");
+
+    apr_pool_destroy(rpool);
+}
+
+int main(int argc, const char * const *argv)
+{
+    static const int nheaders[] = { 8, 16, 32, 80, 160 };
+    apr_pool_t *pool;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    int i;
+
+    printf("APR Tables Performance Test\n"
+           "===========================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:v", &optchar, &optarg)) == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+            if (max_counter < 1) {
+                fprintf(stderr, "Invalid counter\n");
+                exit(-1);
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    printf("%ld requests, times in nsec per header (build, get, linear) "
+           "or per request (update)\n\n", max_counter);
+    printf("%8s %12s %12s %12s %12s\n",
+           "headers", "build", "get", "linear", "update");
+
+    for (i = 0; i < (int)(sizeof(nheaders) / sizeof(nheaders[0])); i++) {
+        run(pool, nheaders[i]);
+    }
+
+    return 0;
+}
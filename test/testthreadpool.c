@@ -0,0 +1,346 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "apr_thread_pool.h"
+#include "apr_atomic.h"
+#include "apr_time.h"
+#include "abts.h"
+#include "testutil.h"
+
+#if APR_HAS_THREADS
+
+#define NUM_TASKS     1000
+#define NUM_ROOTS     10
+#define NUM_CHILDREN  100
+#define NUM_PRIO      20
+
+static volatile apr_uint32_t counter;
+static volatile apr_uint32_t gate;
+static volatile apr_uint32_t pushed;
+static apr_thread_pool_t *thrp;
+
+static int owner_a, owner_b, owner_c;
+static volatile apr_uint32_t count_b, count_c;
+
+static apr_uint32_t order[NUM_PRIO];
+static volatile apr_uint32_t order_idx;
+
+/* Wait (up to 10s) for the counter to reach n */
+static void wait_counter(volatile apr_uint32_t *cnt, apr_uint32_t n)
+{
+    int i;
+
+    for (i = 0; i < 10000 && apr_atomic_read32(cnt) < n; ++i) {
+        apr_sleep(apr_time_from_msec(1));
+    }
+}
+
+static void *APR_THREAD_FUNC count_task(apr_thread_t *thd, void *data)
+{
+    apr_atomic_inc32(data);
+    return NULL;
+}
+
+static void *APR_THREAD_FUNC root_task(apr_thread_t *thd, void *data)
+{
+    abts_case *tc = data;
+    int i;
+
+    for (i = 0; i < NUM_CHILDREN; ++i) {
+        ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                       apr_thread_pool_push(thrp, count_task,
+                                            (void *)&counter,
+                                            APR_THREAD_TASK_PRIORITY_NORMAL,
+                                            NULL));
+    }
+    apr_atomic_inc32(&counter);
+    return NULL;
+}
+
+static void *APR_THREAD_FUNC gate_task(apr_thread_t *thd, void *data)
+{
+    while (!apr_atomic_read32(&gate)) {
+        apr_sleep(apr_time_from_msec(1));
+    }
+    return NULL;
+}
+
+static void *APR_THREAD_FUNC prio_task(apr_thread_t *thd, void *data)
+{
+    order[apr_atomic_inc32(&order_idx)] = (apr_uint32_t)(apr_size_t)data;
+    return NULL;
+}
+
+static void *APR_THREAD_FUNC pushing_gate_task(apr_thread_t *thd, void *data)
+{
+    int i;
+
+    for (i = 0; i < 50; ++i) {
+        apr_thread_pool_push(thrp, count_task, (void *)&count_b, 0, &owner_b);
+        apr_thread_pool_push(thrp, count_task, (void *)&count_c, 0, &owner_c);
+    }
+    apr_atomic_set32(&pushed, 1);
+    return gate_task(thd, data);
+}
+
+static void push_tasks(abts_case *tc, apr_uint32_t flags)
+{
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create_ex(&thrp, 2, 4, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_atomic_set32(&counter, 0);
+    for (i = 0; i < NUM_TASKS; ++i) {
+        rv = apr_thread_pool_push(thrp, count_task, (void *)&counter,
+                                  (apr_byte_t)i, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    wait_counter(&counter, NUM_TASKS);
+    ABTS_INT_EQUAL(tc, NUM_TASKS, apr_atomic_read32(&counter));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_push(abts_case *tc, void *data)
+{
+    push_tasks(tc, 0);
+}
+
+static void test_ws_push(abts_case *tc, void *data)
+{
+    push_tasks(tc, APR_THREAD_POOL_WORK_STEALING);
+}
+
+static void push_batch(abts_case *tc, apr_uint32_t flags)
+{
+    void *params[NUM_TASKS];
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create_ex(&thrp, 0, 4, flags, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_atomic_set32(&counter, 0);
+    for (i = 0; i < NUM_TASKS; ++i) {
+        params[i] = (void *)&counter;
+    }
+    rv = apr_thread_pool_push_batch(thrp, count_task, params, 0,
+                                    APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < NUM_TASKS; i += NUM_TASKS / 10) {
+        rv = apr_thread_pool_push_batch(thrp, count_task, params + i,
+                                        NUM_TASKS / 10,
+                                        APR_THREAD_TASK_PRIORITY_NORMAL,
+                                        NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    wait_counter(&counter, NUM_TASKS);
+    ABTS_INT_EQUAL(tc, NUM_TASKS, apr_atomic_read32(&counter));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_push_batch(abts_case *tc, void *data)
+{
+    push_batch(tc, 0);
+}
+
+static void test_ws_push_batch(abts_case *tc, void *data)
+{
+    push_batch(tc, APR_THREAD_POOL_WORK_STEALING);
+}
+
+static void *APR_THREAD_FUNC root_batch_task(apr_thread_t *thd, void *data)
+{
+    abts_case *tc = data;
+    void *params[NUM_CHILDREN];
+    int i;
+
+    for (i = 0; i < NUM_CHILDREN; ++i) {
+        params[i] = (void *)&counter;
+    }
+    ABTS_INT_EQUAL(tc, APR_SUCCESS,
+                   apr_thread_pool_push_batch(thrp, count_task, params,
+                                              NUM_CHILDREN,
+                                              APR_THREAD_TASK_PRIORITY_NORMAL,
+                                              NULL));
+    apr_atomic_inc32(&counter);
+    return NULL;
+}
+
+static void test_ws_nested(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create_ex(&thrp, 4, 4,
+                                   APR_THREAD_POOL_WORK_STEALING, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_atomic_set32(&counter, 0);
+    for (i = 0; i < NUM_ROOTS; ++i) {
+        rv = apr_thread_pool_push(thrp, root_task, tc,
+                                  APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    wait_counter(&counter, NUM_ROOTS * (NUM_CHILDREN + 1));
+    ABTS_INT_EQUAL(tc, NUM_ROOTS * (NUM_CHILDREN + 1),
+                   apr_atomic_read32(&counter));
+    ABTS_INT_EQUAL(tc, NUM_ROOTS * (NUM_CHILDREN + 1),
+                   apr_thread_pool_tasks_run_count(thrp));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_ws_nested_batch(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    int i;
+
+    rv = apr_thread_pool_create_ex(&thrp, 4, 4,
+                                   APR_THREAD_POOL_WORK_STEALING, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_atomic_set32(&counter, 0);
+    for (i = 0; i < NUM_ROOTS; ++i) {
+        rv = apr_thread_pool_push(thrp, root_batch_task, tc,
+                                  APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    wait_counter(&counter, NUM_ROOTS * (NUM_CHILDREN + 1));
+    ABTS_INT_EQUAL(tc, NUM_ROOTS * (NUM_CHILDREN + 1),
+                   apr_atomic_read32(&counter));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_ws_priority(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_size_t i;
+
+    /* a single thread, busy until the tasks are queued */
+    rv = apr_thread_pool_create_ex(&thrp, 1, 1,
+                                   APR_THREAD_POOL_WORK_STEALING, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_atomic_set32(&gate, 0);
+    apr_atomic_set32(&order_idx, 0);
+    rv = apr_thread_pool_push(thrp, gate_task, NULL,
+                              APR_THREAD_TASK_PRIORITY_HIGHEST, NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    for (i = 0; i < NUM_PRIO; ++i) {
+        rv = apr_thread_pool_push(thrp, prio_task, (void *)i,
+                                  i % 2 ? APR_THREAD_TASK_PRIORITY_HIGHEST
+                                        : APR_THREAD_TASK_PRIORITY_LOWEST,
+                                  NULL);
+        ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    }
+    apr_atomic_set32(&gate, 1);
+    wait_counter(&order_idx, NUM_PRIO);
+    ABTS_INT_EQUAL(tc, NUM_PRIO, apr_atomic_read32(&order_idx));
+
+    /* highest first, each in the order pushed */
+    for (i = 0; i < NUM_PRIO / 2; ++i) {
+        ABTS_INT_EQUAL(tc, 2 * i + 1, order[i]);
+        ABTS_INT_EQUAL(tc, 2 * i, order[NUM_PRIO / 2 + i]);
+    }
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_ws_schedule(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+    apr_time_t start;
+
+    rv = apr_thread_pool_create_ex(&thrp, 2, 2,
+                                   APR_THREAD_POOL_WORK_STEALING, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    apr_atomic_set32(&counter, 0);
+    start = apr_time_now();
+    rv = apr_thread_pool_schedule(thrp, count_task, (void *)&counter,
+                                  apr_time_from_msec(50), NULL);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 1, apr_thread_pool_scheduled_tasks_count(thrp));
+    wait_counter(&counter, 1);
+    ABTS_INT_EQUAL(tc, 1, apr_atomic_read32(&counter));
+    ABTS_TRUE(tc, apr_time_now() - start >= apr_time_from_msec(50));
+    ABTS_INT_EQUAL(tc, 0, apr_thread_pool_scheduled_tasks_count(thrp));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+static void test_ws_cancel(abts_case *tc, void *data)
+{
+    apr_status_t rv;
+
+    rv = apr_thread_pool_create_ex(&thrp, 1, 1,
+                                   APR_THREAD_POOL_WORK_STEALING, p);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+
+    /* the tasks pushed by the running task are in its thread's deque */
+    apr_atomic_set32(&gate, 0);
+    apr_atomic_set32(&pushed, 0);
+    apr_atomic_set32(&count_b, 0);
+    apr_atomic_set32(&count_c, 0);
+    rv = apr_thread_pool_push(thrp, pushing_gate_task, NULL, 0, &owner_a);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    wait_counter(&pushed, 1);
+    ABTS_INT_EQUAL(tc, 100, apr_thread_pool_tasks_count(thrp));
+
+    rv = apr_thread_pool_tasks_cancel(thrp, &owner_b);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+    ABTS_INT_EQUAL(tc, 50, apr_thread_pool_tasks_count(thrp));
+
+    apr_atomic_set32(&gate, 1);
+    wait_counter(&count_c, 50);
+    ABTS_INT_EQUAL(tc, 50, apr_atomic_read32(&count_c));
+    ABTS_INT_EQUAL(tc, 0, apr_atomic_read32(&count_b));
+
+    rv = apr_thread_pool_destroy(thrp);
+    ABTS_INT_EQUAL(tc, APR_SUCCESS, rv);
+}
+
+#endif /* APR_HAS_THREADS */
+
+abts_suite *testthreadpool(abts_suite *suite)
+{
+    suite = ADD_SUITE(suite);
+
+#if APR_HAS_THREADS
+    abts_run_test(suite, test_push, NULL);
+    abts_run_test(suite, test_ws_push, NULL);
+    abts_run_test(suite, test_ws_nested, NULL);
+    abts_run_test(suite, test_ws_priority, NULL);
+    abts_run_test(suite, test_ws_schedule, NULL);
+    abts_run_test(suite, test_ws_cancel, NULL);
+    abts_run_test(suite, test_push_batch, NULL);
+    abts_run_test(suite, test_ws_push_batch, NULL);
+    abts_run_test(suite, test_ws_nested_batch, NULL);
+#endif /* APR_HAS_THREADS */
+
+    return suite;
+}
@@ -0,0 +1,252 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* Thread pool benchmark: throughput of short tasks in the classic and
+ * work stealing modes, for increasing numbers of threads.  The tasks are
+ * either all pushed from the main thread ("external"), or pushed by a few
+ * root tasks running in the pool ("nested").  Then the cost per task of
+ * pushing them from the main thread in batches of increasing sizes.
+ */
+
+#include "apr_thread_pool.h"
+#include "apr_thread_mutex.h"
+#include "apr_thread_cond.h"
+#include "apr_atomic.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_time.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#if !APR_HAS_THREADS
+int main(void)
+{
+    fprintf(stderr,
+            "This program won't work on this platform because there is no "
+            "support for threads.\n");
+    return 0;
+}
+#else /* !APR_HAS_THREADS */
+
+#define DEFAULT_MAX_COUNTER 1000000
+#define DEFAULT_TASK_WORK 100
+#define MAX_THREADS 64
+#define NUM_ROOTS 16
+#define MAX_BATCH 256
+
+static long max_counter = DEFAULT_MAX_COUNTER;
+static int task_work = DEFAULT_TASK_WORK;
+static int max_threads = 16;
+
+static apr_thread_pool_t *thrp;
+static apr_thread_mutex_t *done_lock;
+static apr_thread_cond_t *done_cond;
+static volatile apr_uint32_t done_cnt;
+static apr_uint32_t done_total;
+static int done;
+static volatile apr_uint32_t sink;
+
+static void task_done(void)
+{
+    if (apr_atomic_inc32(&done_cnt) + 1 == done_total) {
+        apr_thread_mutex_lock(done_lock);
+        done = 1;
+        apr_thread_cond_signal(done_cond);
+        apr_thread_mutex_unlock(done_lock);
+    }
+}
+
+static void *APR_THREAD_FUNC work_task(apr_thread_t *thd, void *data)
+{
+    apr_uint32_t x = (apr_uint32_t)(apr_size_t)data;
+    int i;
+
+    for (i = 0; i < task_work; i++) {
+        x = x * 1103515245 + 12345;
+    }
+    sink += x;
+    task_done();
+    return NULL;
+}
+
+static void *APR_THREAD_FUNC root_task(apr_thread_t *thd, void *data)
+{
+    long i, n = (long)(apr_size_t)data;
+
+    for (i = 0; i < n; i++) {
+        apr_thread_pool_push(thrp, work_task, (void *)(apr_size_t)i,
+                             APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+    }
+    task_done();
+    return NULL;
+}
+
+static double run(apr_pool_t *pool, int nthreads, apr_uint32_t flags,
+                  int nested, long batch)
+{
+    void *params[MAX_BATCH];
+    apr_time_t start, end;
+    long i;
+
+    if (apr_thread_pool_create_ex(&thrp, nthreads, nthreads, flags,
+                                  pool) != APR_SUCCESS) {
+        fprintf(stderr, "Could not create the thread pool\n");
+        exit(-1);
+    }
+
+    done = 0;
+    apr_atomic_set32(&done_cnt, 0);
+    start = apr_time_now();
+    if (nested) {
+        done_total = (apr_uint32_t)(max_counter / NUM_ROOTS * NUM_ROOTS
+                                    + NUM_ROOTS);
+        for (i = 0; i < NUM_ROOTS; i++) {
+            apr_thread_pool_push(thrp, root_task,
+                                 (void *)(apr_size_t)(max_counter / NUM_ROOTS),
+                                 APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+        }
+    }
+    else if (batch > 1) {
+        done_total = (apr_uint32_t)max_counter;
+        for (i = 0; i < max_counter; i += batch) {
+            long j, n = max_counter - i < batch ? max_counter - i : batch;
+
+            for (j = 0; j < n; j++) {
+                params[j] = (void *)(apr_size_t)(i + j);
+            }
+            apr_thread_pool_push_batch(thrp, work_task, params, n,
+                                       APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+        }
+    }
+    else {
+        done_total = (apr_uint32_t)max_counter;
+        for (i = 0; i < max_counter; i++) {
+            apr_thread_pool_push(thrp, work_task, (void *)(apr_size_t)i,
+                                 APR_THREAD_TASK_PRIORITY_NORMAL, NULL);
+        }
+    }
+    apr_thread_mutex_lock(done_lock);
+    while (!done) {
+        apr_thread_cond_wait(done_cond, done_lock);
+    }
+    apr_thread_mutex_unlock(done_lock);
+    end = apr_time_now();
+
+    apr_thread_pool_destroy(thrp);
+
+    return (double)done_total * APR_USEC_PER_SEC / 1000
+           / (end > start ? end - start : 1);
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    char errmsg[200];
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    long batch;
+    int n;
+
+    printf("APR Thread Pool Performance Test\n"
+           "================================\n\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fprintf(stderr, "Could not set up to parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    while ((rv = apr_getopt(opt, "c:t:w:v", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'c') {
+            max_counter = atol(optarg);
+            if (max_counter < NUM_ROOTS) {
+                fprintf(stderr, "Invalid counter\n");
+                exit(-1);
+            }
+        }
+        else if (optchar == 't') {
+            max_threads = atoi(optarg);
+            if (max_threads < 1 || max_threads > MAX_THREADS) {
+                fprintf(stderr, "Invalid number of threads (1-%d)\n",
+                        MAX_THREADS);
+                exit(-1);
+            }
+        }
+        else if (optchar == 'w') {
+            task_work = atoi(optarg);
+            if (task_work < 0) {
+                fprintf(stderr, "Invalid task work\n");
+                exit(-1);
+            }
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fprintf(stderr, "Could not parse options: [%d] %s\n",
+                rv, apr_strerror(rv, errmsg, sizeof errmsg));
+        exit(-1);
+    }
+
+    if (apr_thread_mutex_create(&done_lock, APR_THREAD_MUTEX_DEFAULT,
+                                pool) != APR_SUCCESS
+            || apr_thread_cond_create(&done_cond, pool) != APR_SUCCESS) {
+        fprintf(stderr, "Could not create the done condition\n");
+        exit(-1);
+    }
+
+    printf("%ld tasks (%d work loops each), throughput in K tasks/s\n\n",
+           max_counter, task_work);
+    printf("%8s %14s %14s %14s %14s\n", "threads",
+           "external", "external-ws", "nested", "nested-ws");
+
+    for (n = 1; n <= max_threads; n *= 2) {
+        double ext, ext_ws, nest, nest_ws;
+
+        ext = run(pool, n, 0, 0, 1);
+        ext_ws = run(pool, n, APR_THREAD_POOL_WORK_STEALING, 0, 1);
+        nest = run(pool, n, 0, 1, 1);
+        nest_ws = run(pool, n, APR_THREAD_POOL_WORK_STEALING, 1, 1);
+        printf("%8d %14.0f %14.0f %14.0f %14.0f\n",
+               n, ext, ext_ws, nest, nest_ws);
+    }
+
+    printf("\nBatch push with %d threads, nsec per task\n\n", max_threads);
+    printf("%8s %14s %14s\n", "batch", "external", "external-ws");
+
+    for (batch = 1; batch <= MAX_BATCH; batch *= 2) {
+        double ext, ext_ws;
+
+        ext = run(pool, max_threads, 0, 0, batch);
+        ext_ws = run(pool, max_threads, APR_THREAD_POOL_WORK_STEALING, 0,
+                     batch);
+        printf("%8ld %14.1f %14.1f\n", batch, 1000000 / ext,
+               1000000 / ext_ws);
+    }
+
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
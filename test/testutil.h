@@ -127,6 +127,8 @@ abts_suite *testmemcache(abts_suite *suite);
 abts_suite *testredis(abts_suite *suite);
 abts_suite *testreslist(abts_suite *suite);
 abts_suite *testqueue(abts_suite *suite);
+abts_suite *testthreadpool(abts_suite *suite);
+abts_suite *testioqueue(abts_suite *suite);
 abts_suite *testxml(abts_suite *suite);
 abts_suite *testxlate(abts_suite *suite);
 abts_suite *testrmm(abts_suite *suite);
@@ -0,0 +1,356 @@
+/* Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* wakeupperf.c
+ * This benchmark measures the wakeup of APR_POLLSET_WAKEABLE pollsets and
+ * APR_POLLCB_WAKEABLE pollcbs across threads, with each pollset method
+ * available:
+ *
+ *   latency     two threads wake each other's pollset (or pollcb) up in
+ *               turn; the time per wakeup is half the round trip
+ *   throughput  several threads call apr_pollset_wakeup() in a loop while
+ *               one thread polls; it prints the wakeup calls and the
+ *               returns from poll per second (wakeups pending at the same
+ *               time are coalesced into one)
+ *
+ * To run,
+ *
+ *   ./wakeupperf [-n round trips] [-t waker threads] [-d seconds]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "apr.h"
+#include "apr_errno.h"
+#include "apr_general.h"
+#include "apr_getopt.h"
+#include "apr_poll.h"
+#include "apr_thread_proc.h"
+#include "apr_time.h"
+
+#if APR_HAS_THREADS
+
+#define DEFAULT_ROUND_TRIPS 20000
+#define DEFAULT_WAKERS 2
+#define DEFAULT_DURATION 1
+
+static int round_trips = DEFAULT_ROUND_TRIPS;
+static int wakers = DEFAULT_WAKERS;
+static int duration = DEFAULT_DURATION;
+
+static const struct {
+    apr_pollset_method_e method;
+    const char *name;
+} methods[] = {
+    { APR_POLLSET_SELECT, "select" },
+    { APR_POLLSET_POLL, "poll" },
+    { APR_POLLSET_EPOLL, "epoll" },
+    { APR_POLLSET_KQUEUE, "kqueue" },
+    { APR_POLLSET_PORT, "port" },
+    { APR_POLLSET_IOURING, "io_uring" }
+};
+
+/* What both sides of the ping-pong, or the throughput poller, share */
+typedef struct peer_t {
+    apr_pollset_t *pollset;
+    apr_pollcb_t *pollcb;
+    struct peer_t *other;
+    int count;
+    volatile int *done;
+    /* counters */
+    long wakeups;
+    long polls;
+} peer_t;
+
+static void fail(const char *msg, apr_status_t rv)
+{
+    char errmsg[200];
+
+    fprintf(stderr, "%s: [%d] %s\n", msg, rv,
+            apr_strerror(rv, errmsg, sizeof errmsg));
+    exit(-1);
+}
+
+static apr_status_t wakeup_cb(void *baton, apr_pollfd_t *descriptor)
+{
+    return APR_SUCCESS;
+}
+
+/* Wait for the peer's wakeup, returning whether it happened */
+static int wait_wakeup(peer_t *peer)
+{
+    apr_status_t rv;
+
+    for (;;) {
+        if (peer->pollset) {
+            apr_int32_t num;
+            const apr_pollfd_t *descs;
+
+            rv = apr_pollset_poll(peer->pollset, -1, &num, &descs);
+        }
+        else {
+            rv = apr_pollcb_poll(peer->pollcb, -1, wakeup_cb, NULL);
+        }
+        if (APR_STATUS_IS_EINTR(rv)) {
+            return 1;
+        }
+        if (rv != APR_SUCCESS && !APR_STATUS_IS_TIMEUP(rv)) {
+            fail("Could not poll", rv);
+        }
+    }
+}
+
+static void wake_up(peer_t *peer)
+{
+    apr_status_t rv;
+
+    if (peer->pollset) {
+        rv = apr_pollset_wakeup(peer->pollset);
+    }
+    else {
+        rv = apr_pollcb_wakeup(peer->pollcb);
+    }
+    if (rv != APR_SUCCESS) {
+        fail("Could not wake up", rv);
+    }
+}
+
+static void * APR_THREAD_FUNC pong_thread(apr_thread_t *thd, void *data)
+{
+    peer_t *peer = data;
+    int i;
+
+    for (i = 0; i < peer->count; i++) {
+        wait_wakeup(peer);
+        wake_up(peer->other);
+    }
+
+    return NULL;
+}
+
+static int create_peer(peer_t *peer, apr_pollset_method_e method,
+                       int use_pollcb, apr_pool_t *pool)
+{
+    apr_status_t rv;
+
+    memset(peer, 0, sizeof(*peer));
+    if (use_pollcb) {
+        rv = apr_pollcb_create_ex(&peer->pollcb, 1, pool,
+                                  APR_POLLSET_NODEFAULT | APR_POLLSET_WAKEABLE,
+                                  method);
+    }
+    else {
+        rv = apr_pollset_create_ex(&peer->pollset, 1, pool,
+                                   APR_POLLSET_NODEFAULT | APR_POLLSET_WAKEABLE,
+                                   method);
+    }
+    if (rv == APR_ENOTIMPL) {
+        return 0;
+    }
+    if (rv != APR_SUCCESS) {
+        fail("Could not create the pollset", rv);
+    }
+    return 1;
+}
+
+/* Microseconds per wakeup */
+static int run_latency(apr_pollset_method_e method, int use_pollcb,
+                       double *usecs, apr_pool_t *parent)
+{
+    peer_t ping, pong;
+    apr_thread_t *thread;
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    apr_status_t rv;
+    int i;
+
+    apr_pool_create(&pool, parent);
+
+    if (!create_peer(&ping, method, use_pollcb, pool)
+        || !create_peer(&pong, method, use_pollcb, pool)) {
+        apr_pool_destroy(pool);
+        return 0;
+    }
+    ping.other = &pong;
+    pong.other = &ping;
+    pong.count = round_trips;
+
+    rv = apr_thread_create(&thread, NULL, pong_thread, &pong, pool);
+    if (rv != APR_SUCCESS) {
+        fail("Could not create a thread", rv);
+    }
+
+    start = apr_time_now();
+    for (i = 0; i < round_trips; i++) {
+        wake_up(&pong);
+        wait_wakeup(&ping);
+    }
+    end = apr_time_now();
+
+    apr_thread_join(&rv, thread);
+    apr_pool_destroy(pool);
+
+    *usecs = (double)(end - start) / round_trips / 2;
+    return 1;
+}
+
+static void * APR_THREAD_FUNC waker_thread(apr_thread_t *thd, void *data)
+{
+    peer_t *peer = data;
+
+    while (!*peer->done) {
+        wake_up(peer->other);
+        peer->wakeups++;
+    }
+
+    return NULL;
+}
+
+/* Wakeup calls and poll returns per second */
+static int run_throughput(apr_pollset_method_e method, double *calls,
+                          double *polls, apr_pool_t *parent)
+{
+    peer_t poller, *peers;
+    apr_thread_t **threads;
+    apr_pool_t *pool;
+    apr_time_t start, end;
+    apr_status_t rv;
+    volatile int done = 0;
+    long total = 0;
+    int i;
+
+    apr_pool_create(&pool, parent);
+
+    if (!create_peer(&poller, method, 0, pool)) {
+        apr_pool_destroy(pool);
+        return 0;
+    }
+
+    peers = apr_pcalloc(pool, wakers * sizeof(peer_t));
+    threads = apr_palloc(pool, wakers * sizeof(apr_thread_t *));
+    start = apr_time_now();
+    for (i = 0; i < wakers; i++) {
+        peers[i].other = &poller;
+        peers[i].done = &done;
+        rv = apr_thread_create(&threads[i], NULL, waker_thread, &peers[i],
+                               pool);
+        if (rv != APR_SUCCESS) {
+            fail("Could not create a thread", rv);
+        }
+    }
+
+    do {
+        wait_wakeup(&poller);
+        poller.polls++;
+        end = apr_time_now();
+    } while (end - start < apr_time_from_sec(duration));
+
+    done = 1;
+    for (i = 0; i < wakers; i++) {
+        apr_thread_join(&rv, threads[i]);
+        total += peers[i].wakeups;
+    }
+    end = apr_time_now();
+    apr_pool_destroy(pool);
+
+    *calls = (double)total * APR_USEC_PER_SEC / (end - start);
+    *polls = (double)poller.polls * APR_USEC_PER_SEC / (end - start);
+    return 1;
+}
+
+int main(int argc, const char * const *argv)
+{
+    apr_pool_t *pool;
+    apr_status_t rv;
+    apr_getopt_t *opt;
+    char optchar;
+    const char *optarg;
+    double pollset_usecs, pollcb_usecs, calls, polls;
+    int i;
+
+    printf("APR Pollset Wakeup Test\n"
+           "=======================\n");
+
+    apr_initialize();
+    atexit(apr_terminate);
+
+    if (apr_pool_create(&pool, NULL) != APR_SUCCESS)
+        exit(-1);
+
+    if ((rv = apr_getopt_init(&opt, pool, argc, argv)) != APR_SUCCESS) {
+        fail("Could not set up to parse options", rv);
+    }
+
+    while ((rv = apr_getopt(opt, "d:n:t:", &optchar, &optarg))
+           == APR_SUCCESS) {
+        if (optchar == 'd') {
+            duration = atoi(optarg);
+        }
+        else if (optchar == 'n') {
+            round_trips = atoi(optarg);
+        }
+        else if (optchar == 't') {
+            wakers = atoi(optarg);
+        }
+    }
+
+    if (rv != APR_SUCCESS && rv != APR_EOF) {
+        fail("Could not parse options", rv);
+    }
+    if (duration < 1 || round_trips < 1 || wakers < 1) {
+        fprintf(stderr, "Invalid options\n");
+        exit(-1);
+    }
+
+    printf("\n%d round trips, %d waker threads for %d s\n\n",
+           round_trips, wakers, duration);
+    printf("%-10s %14s %14s %14s %14s\n", "", "pollset",
+           "pollcb", "wakeup", "poll");
+    printf("%-10s %14s %14s %14s %14s\n", "method", "usecs/wakeup",
+           "usecs/wakeup", "calls/s", "returns/s");
+
+    for (i = 0; i < sizeof(methods) / sizeof(methods[0]); i++) {
+        if (!run_latency(methods[i].method, 0, &pollset_usecs, pool)) {
+            continue;
+        }
+        printf("%-10s %14.2f", methods[i].name, pollset_usecs);
+        if (run_latency(methods[i].method, 1, &pollcb_usecs, pool)) {
+            printf(" %14.2f", pollcb_usecs);
+        }
+        else {
+            printf(" %14s", "n/a");
+        }
+        if (run_throughput(methods[i].method, &calls, &polls, pool)) {
+            printf(" %14.0f %14.0f", calls, polls);
+        }
+        printf("\n");
+        fflush(stdout);
+    }
+
+    return 0;
+}
+
+#else /* !APR_HAS_THREADS */
+
+int main(void)
+{
+    fprintf(stderr, "This test requires APR thread support.\n");
+    return 0;
+}
+
+#endif /* !APR_HAS_THREADS */
@@ -30,6 +30,7 @@
 #include "apr_portable.h"
 #include "apr_thread_mutex.h"
 #include "apr_thread_cond.h"
+#include "apr_atomic.h"
 #include "apr_errno.h"
 #include "apr_queue.h"
 
@@ -40,18 +41,42 @@
 #define QUEUE_DEBUG
  */
 
+#define QUEUE_CACHE_LINE 64
+
+/*
+ * Slot of the lock-free ring.  For the position pos mapping to the slot,
+ * seq == pos when the slot is free for the producer claiming pos, and
+ * seq == pos + 1 when it holds the data for the consumer claiming pos.
+ * The consumer then frees it for the next round with seq = pos + bounds.
+ */
+typedef struct queue_cell_t {
+    volatile apr_uint64_t seq;
+    void               *data;
+} queue_cell_t;
+
 struct apr_queue_t {
     void              **data;
     unsigned int        nelts; /**< # elements */
     unsigned int        in;    /**< next empty location */
     unsigned int        out;   /**< next filled location */
     unsigned int        bounds;/**< max size of queue */
-    unsigned int        full_waiters;
-    unsigned int        empty_waiters;
+    volatile apr_uint32_t full_waiters;
+    volatile apr_uint32_t empty_waiters;
     apr_thread_mutex_t *one_big_mutex;
     apr_thread_cond_t  *not_empty;
     apr_thread_cond_t  *not_full;
-    int                 terminated;
+    volatile int        terminated;
+    /* APR_QUEUE_LOCKFREE ring (NULL otherwise), with the producers' and
+     * consumers' positions on their own cache lines.
+     */
+    queue_cell_t       *cells;
+    volatile apr_uint32_t full_signals;
+    volatile apr_uint32_t empty_signals;
+    char                pad1[QUEUE_CACHE_LINE];
+    volatile apr_uint64_t enqueue_pos;
+    char                pad2[QUEUE_CACHE_LINE];
+    volatile apr_uint64_t dequeue_pos;
+    char                pad3[QUEUE_CACHE_LINE];
 };
 
 #ifdef QUEUE_DEBUG
@@ -101,9 +126,22 @@ static apr_status_t queue_destroy(void *data)
 APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
                                            unsigned int queue_capacity,
                                            apr_pool_t *a)
+{
+    return apr_queue_create_ex(q, queue_capacity, 0, a);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_create_ex(apr_queue_t **q,
+                                              unsigned int queue_capacity,
+                                              apr_uint32_t flags,
+                                              apr_pool_t *a)
 {
     apr_status_t rv;
     apr_queue_t *queue;
+
+    if ((flags & APR_QUEUE_LOCKFREE) && !queue_capacity) {
+        return APR_EINVAL;
+    }
+
     queue = apr_palloc(a, sizeof(apr_queue_t));
     *q = queue;
 
@@ -125,8 +163,25 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
         return rv;
     }
 
-    /* Set all the data in the queue to NULL */
-    queue->data = apr_pcalloc(a, queue_capacity * sizeof(void*));
+    if (flags & APR_QUEUE_LOCKFREE) {
+        unsigned int i;
+
+        queue->data = NULL;
+        queue->cells = apr_palloc(a, queue_capacity * sizeof(queue_cell_t));
+        for (i = 0; i < queue_capacity; i++) {
+            queue->cells[i].seq = i;
+            queue->cells[i].data = NULL;
+        }
+        queue->enqueue_pos = 0;
+        queue->dequeue_pos = 0;
+        queue->full_signals = 0;
+        queue->empty_signals = 0;
+    }
+    else {
+        /* Set all the data in the queue to NULL */
+        queue->data = apr_pcalloc(a, queue_capacity * sizeof(void*));
+        queue->cells = NULL;
+    }
     queue->bounds = queue_capacity;
     queue->nelts = 0;
     queue->in = 0;
@@ -141,19 +196,333 @@ APR_DECLARE(apr_status_t) apr_queue_create(apr_queue_t **q,
 }
 
 /**
- * Push new data onto the queue. Blocks if the queue is full. Once
- * the push operation has completed, it signals other threads waiting
+ * Claim the next free slots of the lock-free ring (up to *nelts, at least
+ * one) and store the first elements of data in them, or return APR_EAGAIN
+ * if the queue is full.  The number of elements stored is put in *nelts.
+ */
+static apr_status_t lf_enqueue(apr_queue_t *queue, void **data,
+                               unsigned int *nelts)
+{
+    apr_uint64_t pos = apr_atomic_read64(&queue->enqueue_pos);
+    unsigned int n, i, idx;
+
+    for (;;) {
+        queue_cell_t *cell;
+        apr_int64_t dif;
+
+        idx = (unsigned int)(pos % queue->bounds);
+        cell = &queue->cells[idx];
+
+        dif = (apr_int64_t)(apr_atomic_read64(&cell->seq) - pos);
+        if (dif == 0) {
+            apr_uint64_t cur;
+
+            /* Claim the following free slots with the same CAS, they
+             * can't be taken by another producer until it succeeds.
+             */
+            for (n = 1; n < *nelts; n++) {
+                if (++cell == queue->cells + queue->bounds) {
+                    cell = queue->cells;
+                }
+                if (apr_atomic_read64(&cell->seq) != pos + n) {
+                    break;
+                }
+            }
+            cur = apr_atomic_cas64(&queue->enqueue_pos, pos + n, pos);
+            if (cur == pos) {
+                break;
+            }
+            pos = cur;
+        }
+        else if (dif < 0) {
+            /* the slot still holds the data from the previous round */
+            *nelts = 0;
+            return APR_EAGAIN;
+        }
+        else {
+            pos = apr_atomic_read64(&queue->enqueue_pos);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        queue_cell_t *cell = &queue->cells[idx];
+
+        cell->data = data[i];
+        apr_atomic_set64(&cell->seq, pos + i + 1);
+        if (++idx == queue->bounds) {
+            idx = 0;
+        }
+    }
+    *nelts = n;
+    return APR_SUCCESS;
+}
+
+/**
+ * Claim the next filled slots of the lock-free ring (up to *nelts, at
+ * least one) and take their data, or return APR_EAGAIN if the queue is
+ * empty.  The number of elements taken is put in *nelts.
+ */
+static apr_status_t lf_dequeue(apr_queue_t *queue, void **data,
+                               unsigned int *nelts)
+{
+    apr_uint64_t pos = apr_atomic_read64(&queue->dequeue_pos);
+    unsigned int n, i, idx;
+
+    for (;;) {
+        queue_cell_t *cell;
+        apr_int64_t dif;
+
+        idx = (unsigned int)(pos % queue->bounds);
+        cell = &queue->cells[idx];
+
+        dif = (apr_int64_t)(apr_atomic_read64(&cell->seq) - (pos + 1));
+        if (dif == 0) {
+            apr_uint64_t cur;
+
+            for (n = 1; n < *nelts; n++) {
+                if (++cell == queue->cells + queue->bounds) {
+                    cell = queue->cells;
+                }
+                if (apr_atomic_read64(&cell->seq) != pos + n + 1) {
+                    break;
+                }
+            }
+            cur = apr_atomic_cas64(&queue->dequeue_pos, pos + n, pos);
+            if (cur == pos) {
+                break;
+            }
+            pos = cur;
+        }
+        else if (dif < 0) {
+            /* the slot is not filled (yet) for this round */
+            *nelts = 0;
+            return APR_EAGAIN;
+        }
+        else {
+            pos = apr_atomic_read64(&queue->dequeue_pos);
+        }
+    }
+
+    for (i = 0; i < n; i++) {
+        queue_cell_t *cell = &queue->cells[idx];
+
+        data[i] = cell->data;
+        apr_atomic_set64(&cell->seq, pos + i + queue->bounds);
+        if (++idx == queue->bounds) {
+            idx = 0;
+        }
+    }
+    *nelts = n;
+    return APR_SUCCESS;
+}
+
+/**
+ * Wake up (at most) count threads waiting on cond which have not been
+ * signaled yet, if any.  The waiters increment their count before retrying under
+ * the lock, and the caller has just published its push or pop, so either
+ * the waiter sees it or we see the waiter (which can't miss the signal
+ * while we hold the lock).  The signals are counted until the woken up
+ * threads get the lock back, so that the following pushes or pops don't
+ * take the lock to signal the same waiters again in the meantime.
+ */
+static apr_status_t lf_signal(apr_queue_t *queue,
+                              volatile apr_uint32_t *waiters,
+                              volatile apr_uint32_t *signals,
+                              apr_thread_cond_t *cond, unsigned int count)
+{
+    apr_uint32_t nwaiters;
+    apr_status_t rv;
+
+    nwaiters = apr_atomic_read32(waiters);
+    if (!nwaiters || nwaiters <= apr_atomic_read32(signals)) {
+        return APR_SUCCESS;
+    }
+
+    rv = apr_thread_mutex_lock(queue->one_big_mutex);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    while (count-- > 0 && *waiters > *signals) {
+        apr_atomic_inc32(signals);
+        rv = apr_thread_cond_signal(cond);
+        if (rv != APR_SUCCESS) {
+            apr_thread_mutex_unlock(queue->one_big_mutex);
+            return rv;
+        }
+    }
+    return apr_thread_mutex_unlock(queue->one_big_mutex);
+}
+
+/**
+ * Wait (under the lock) for the lock-free queue to be not full (push)
+ * or not empty (pop), and retry the operation once woken up, with the
+ * same outcomes as in queue_push() and queue_pop().
+ */
+static apr_status_t lf_wait(apr_queue_t *queue, void *in, void **out,
+                            apr_interval_time_t timeout)
+{
+    volatile apr_uint32_t *waiters, *signals;
+    apr_thread_cond_t *cond;
+    apr_status_t rv;
+    unsigned int n = 1;
+
+    if (out) {
+        waiters = &queue->empty_waiters;
+        signals = &queue->empty_signals;
+        cond = queue->not_empty;
+    }
+    else {
+        waiters = &queue->full_waiters;
+        signals = &queue->full_signals;
+        cond = queue->not_full;
+    }
+
+    rv = apr_thread_mutex_lock(queue->one_big_mutex);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    apr_atomic_inc32(waiters);
+    rv = out ? lf_dequeue(queue, out, &n) : lf_enqueue(queue, &in, &n);
+    if (rv == APR_EAGAIN && !queue->terminated) {
+        if (timeout > 0) {
+            rv = apr_thread_cond_timedwait(cond, queue->one_big_mutex,
+                                           timeout);
+        }
+        else {
+            rv = apr_thread_cond_wait(cond, queue->one_big_mutex);
+        }
+        /* Whether signaled or not, consume one signal; any signal still
+         * pending is then for a thread woken up but not here yet.
+         */
+        if (*signals) {
+            apr_atomic_dec32(signals);
+        }
+        if (rv != APR_SUCCESS) {
+            apr_atomic_dec32(waiters);
+            apr_thread_mutex_unlock(queue->one_big_mutex);
+            return rv;
+        }
+        n = 1;
+        rv = out ? lf_dequeue(queue, out, &n) : lf_enqueue(queue, &in, &n);
+    }
+    apr_atomic_dec32(waiters);
+
+    if (rv == APR_EAGAIN) {
+        /* If we wake up and it's still full/empty, then we were interrupted */
+        Q_DBG(out ? "queue empty (intr)" : "queue full (intr)", queue);
+        rv = apr_thread_mutex_unlock(queue->one_big_mutex);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        if (queue->terminated) {
+            return APR_EOF; /* no more elements ever again */
+        }
+        else {
+            return APR_EINTR;
+        }
+    }
+
+    return apr_thread_mutex_unlock(queue->one_big_mutex);
+}
+
+/**
+ * Push as many of the *nelts elements of data as fit in the lock-free
+ * queue, waiting for the first one only, and wake up as many poppers.
+ */
+static apr_status_t lf_queue_push(apr_queue_t *queue, void **data,
+                                  unsigned int *nelts,
+                                  apr_interval_time_t timeout)
+{
+    apr_status_t rv;
+    unsigned int n = *nelts, more;
+
+    rv = lf_enqueue(queue, data, &n);
+    if (rv == APR_EAGAIN) {
+        if (!timeout) {
+            *nelts = 0;
+            return APR_EAGAIN;
+        }
+        rv = lf_wait(queue, data[0], NULL, timeout);
+        if (rv != APR_SUCCESS) {
+            *nelts = 0;
+            return rv;
+        }
+        n = 1;
+    }
+    more = *nelts - n;
+    if (more && lf_enqueue(queue, data + n, &more) == APR_SUCCESS) {
+        n += more;
+    }
+    *nelts = n;
+
+    return lf_signal(queue, &queue->empty_waiters, &queue->empty_signals,
+                     queue->not_empty, n);
+}
+
+/**
+ * Pop up to *nelts elements from the lock-free queue into data, waiting
+ * for the first one only, and wake up as many pushers.
+ */
+static apr_status_t lf_queue_pop(apr_queue_t *queue, void **data,
+                                 unsigned int *nelts,
+                                 apr_interval_time_t timeout)
+{
+    apr_status_t rv;
+    unsigned int n = *nelts, more;
+
+    rv = lf_dequeue(queue, data, &n);
+    if (rv == APR_EAGAIN) {
+        if (!timeout) {
+            *nelts = 0;
+            return APR_EAGAIN;
+        }
+        rv = lf_wait(queue, NULL, data, timeout);
+        if (rv != APR_SUCCESS) {
+            *nelts = 0;
+            return rv;
+        }
+        n = 1;
+    }
+    more = *nelts - n;
+    if (more && lf_dequeue(queue, data + n, &more) == APR_SUCCESS) {
+        n += more;
+    }
+    *nelts = n;
+
+    return lf_signal(queue, &queue->full_waiters, &queue->full_signals,
+                     queue->not_full, n);
+}
+
+/**
+ * Push new data onto the queue, as many of the *nelts elements as fit
+ * (the number pushed is returned in *nelts). Blocks if the queue is full.
+ * Once the push operation has completed, it signals other threads waiting
  * in apr_queue_pop() that they may continue consuming sockets.
  */
-static apr_status_t queue_push(apr_queue_t *queue, void *data,
+static apr_status_t queue_push(apr_queue_t *queue, void **data,
+                               unsigned int *nelts,
                                apr_interval_time_t timeout)
 {
     apr_status_t rv;
+    unsigned int n, i;
 
     if (queue->terminated) {
+        *nelts = 0;
         return APR_EOF; /* no more elements ever again */
     }
 
+    if (!*nelts) {
+        return APR_SUCCESS;
+    }
+
+    if (queue->cells) {
+        return lf_queue_push(queue, data, nelts, timeout);
+    }
+
+    n = *nelts;
+    *nelts = 0;
+
     rv = apr_thread_mutex_lock(queue->one_big_mutex);
     if (rv != APR_SUCCESS) {
         return rv;
@@ -197,13 +566,19 @@ static apr_status_t queue_push(apr_queue_t *queue, void *data,
         }
     }
 
-    queue->data[queue->in] = data;
-    queue->in++;
-    if (queue->in >= queue->bounds)
-        queue->in -= queue->bounds;
-    queue->nelts++;
+    if (n > queue->bounds - queue->nelts) {
+        n = queue->bounds - queue->nelts;
+    }
+    for (i = 0; i < n; i++) {
+        queue->data[queue->in] = data[i];
+        queue->in++;
+        if (queue->in >= queue->bounds)
+            queue->in -= queue->bounds;
+    }
+    queue->nelts += n;
+    *nelts = n;
 
-    if (queue->empty_waiters) {
+    for (i = 0; i < n && i < queue->empty_waiters; i++) {
         Q_DBG("sig !empty", queue);
         rv = apr_thread_cond_signal(queue->not_empty);
         if (rv != APR_SUCCESS) {
@@ -218,7 +593,8 @@ static apr_status_t queue_push(apr_queue_t *queue, void *data,
 
 APR_DECLARE(apr_status_t) apr_queue_push(apr_queue_t *queue, void *data)
 {
-    return queue_push(queue, data, -1);
+    unsigned int n = 1;
+    return queue_push(queue, &data, &n, -1);
 }
 
 /**
@@ -228,38 +604,76 @@ APR_DECLARE(apr_status_t) apr_queue_push(apr_queue_t *queue, void *data)
  */
 APR_DECLARE(apr_status_t) apr_queue_trypush(apr_queue_t *queue, void *data)
 {
-    return queue_push(queue, data, 0);
+    unsigned int n = 1;
+    return queue_push(queue, &data, &n, 0);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_timedpush(apr_queue_t *queue, void *data,
                                               apr_interval_time_t timeout)
 {
-    return queue_push(queue, data, timeout);
+    unsigned int n = 1;
+    return queue_push(queue, &data, &n, timeout);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_push_batch(apr_queue_t *queue,
+                                               void **data,
+                                               unsigned int *nelts,
+                                               apr_interval_time_t timeout)
+{
+    return queue_push(queue, data, nelts, timeout);
 }
 
 /**
  * not thread safe
  */
 APR_DECLARE(unsigned int) apr_queue_size(apr_queue_t *queue) {
+    if (queue->cells) {
+        apr_uint64_t out = apr_atomic_read64(&queue->dequeue_pos);
+        apr_uint64_t in = apr_atomic_read64(&queue->enqueue_pos);
+
+        /* pushes/pops in progress may be seen half way */
+        if (in <= out) {
+            return 0;
+        }
+        if (in - out >= queue->bounds) {
+            return queue->bounds;
+        }
+        return (unsigned int)(in - out);
+    }
     return queue->nelts;
 }
 
 /**
- * Retrieves the next item from the queue. If there are no
+ * Retrieves the next items (up to *nelts) from the queue. If there are no
  * items available, it will either return APR_EAGAIN (timeout = 0),
  * or block until one becomes available (infinitely with timeout < 0,
  * otherwise until the given timeout expires). Once retrieved, the
- * item is placed into the address specified by 'data'.
+ * items are placed into the array specified by 'data', and their
+ * number into *nelts.
  */
 static apr_status_t queue_pop(apr_queue_t *queue, void **data,
+                              unsigned int *nelts,
                               apr_interval_time_t timeout)
 {
     apr_status_t rv;
+    unsigned int n, i;
 
     if (queue->terminated) {
+        *nelts = 0;
         return APR_EOF; /* no more elements ever again */
     }
 
+    if (!*nelts) {
+        return APR_SUCCESS;
+    }
+
+    if (queue->cells) {
+        return lf_queue_pop(queue, data, nelts, timeout);
+    }
+
+    n = *nelts;
+    *nelts = 0;
+
     rv = apr_thread_mutex_lock(queue->one_big_mutex);
     if (rv != APR_SUCCESS) {
         return rv;
@@ -304,13 +718,19 @@ static apr_status_t queue_pop(apr_queue_t *queue, void **data,
         }
     }
 
-    *data = queue->data[queue->out];
-    queue->nelts--;
+    if (n > queue->nelts) {
+        n = queue->nelts;
+    }
+    for (i = 0; i < n; i++) {
+        data[i] = queue->data[queue->out];
+        queue->out++;
+        if (queue->out >= queue->bounds)
+            queue->out -= queue->bounds;
+    }
+    queue->nelts -= n;
+    *nelts = n;
 
-    queue->out++;
-    if (queue->out >= queue->bounds)
-        queue->out -= queue->bounds;
-    if (queue->full_waiters) {
+    for (i = 0; i < n && i < queue->full_waiters; i++) {
         Q_DBG("signal !full", queue);
         rv = apr_thread_cond_signal(queue->not_full);
         if (rv != APR_SUCCESS) {
@@ -325,18 +745,29 @@ static apr_status_t queue_pop(apr_queue_t *queue, void **data,
 
 APR_DECLARE(apr_status_t) apr_queue_pop(apr_queue_t *queue, void **data)
 {
-    return queue_pop(queue, data, -1);
+    unsigned int n = 1;
+    return queue_pop(queue, data, &n, -1);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_trypop(apr_queue_t *queue, void **data)
 {
-    return queue_pop(queue, data, 0);
+    unsigned int n = 1;
+    return queue_pop(queue, data, &n, 0);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_timedpop(apr_queue_t *queue, void **data,
                                              apr_interval_time_t timeout)
 {
-    return queue_pop(queue, data, timeout);
+    unsigned int n = 1;
+    return queue_pop(queue, data, &n, timeout);
+}
+
+APR_DECLARE(apr_status_t) apr_queue_pop_batch(apr_queue_t *queue,
+                                              void **data,
+                                              unsigned int *nelts,
+                                              apr_interval_time_t timeout)
+{
+    return queue_pop(queue, data, nelts, timeout);
 }
 
 APR_DECLARE(apr_status_t) apr_queue_interrupt_all(apr_queue_t *queue)
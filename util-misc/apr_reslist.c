@@ -17,13 +17,25 @@
 #include <assert.h>
 
 #include "apu.h"
+#include "apr_private.h"
 #include "apr_reslist.h"
 #include "apr_errno.h"
+#include "apr_atomic.h"
 #include "apr_strings.h"
+#include "apr_portable.h"
 #include "apr_thread_mutex.h"
 #include "apr_thread_cond.h"
+#include "apr_thread_proc.h"
 #include "apr_ring.h"
 
+#ifdef HAVE_SCHED_GETCPU
+#include <sched.h>
+#endif
+
+/* Internal acquire flags, for sharded lists */
+#define RESLIST_ACQUIRE_NOWAIT 0x100 /* APR_EAGAIN rather than waiting */
+#define RESLIST_ACQUIRE_IDLE   0x200 /* APR_EAGAIN unless one is idle */
+
 /**
  * A single resource element.
  */
@@ -31,6 +43,7 @@ struct apr_res_t {
     apr_time_t freed;
     void *opaque;
     APR_RING_ENTRY(apr_res_t) link;
+    volatile apr_uint32_t next; /* next slot on a lock-free stack, from 1 */
 };
 typedef struct apr_res_t apr_res_t;
 
@@ -58,6 +71,31 @@ struct apr_reslist_t {
     apr_thread_mutex_t *listlock;
     apr_thread_cond_t *avail;
 #endif
+    apr_uint32_t flags; /* APR_RESLIST_* creation flags */
+    /* APR_RESLIST_LOCKFREE: the available resources and the empty
+     * containers live on two stacks of hmax slots, each head holding
+     * a change counter in the high 32 bits (against ABA) and the top
+     * slot number in the low 32 bits. ntotal is still protected by
+     * listlock, nidle is replaced by the atomic idle. */
+    apr_res_t *slots;
+    volatile apr_uint64_t avail_head;
+    volatile apr_uint64_t free_head;
+    volatile apr_uint32_t idle;
+    volatile apr_uint32_t waiters; /* acquires in the slow path */
+    volatile apr_uint64_t expiry; /* when maintenance may expire something */
+    /* statistics */
+    volatile apr_uint32_t constructed;
+    volatile apr_uint32_t destroyed;
+    volatile apr_uint32_t timeouts;
+    volatile apr_uint32_t wait[APR_RESLIST_WAIT_BUCKETS];
+    /* sharded list: the shards, and which one constructed each of the
+     * resources in an open addressed table of owners_mask + 1 entries,
+     * indexed by the top bits of the hash (owners_shift = 64 - bits) */
+    apr_reslist_t **shards;
+    int nshards;
+    struct reslist_owner_t *owners;
+    apr_uint32_t owners_mask;
+    int owners_shift;
 };
 
 /**
@@ -138,20 +176,531 @@ static apr_status_t create_resource(apr_reslist_t *reslist, apr_res_t **ret_res)
     res = get_container(reslist);
 
     rv = reslist->constructor(&res->opaque, reslist->params, reslist->pool);
+    if (rv == APR_SUCCESS) {
+        apr_atomic_inc32(&reslist->constructed);
+    }
 
     *ret_res = res;
     return rv;
 }
 
+/**
+ * Destroy a single resource.
+ * Assumes: that the reslist is locked.
+ */
+static apr_status_t destroy_opaque(apr_reslist_t *reslist, void *opaque)
+{
+    apr_atomic_inc32(&reslist->destroyed);
+    return reslist->destructor(opaque, reslist->params, reslist->pool);
+}
+
 /**
  * Destroy a single idle resource.
  * Assumes: that the reslist is locked.
  */
 static apr_status_t destroy_resource(apr_reslist_t *reslist, apr_res_t *res)
 {
-    return reslist->destructor(res->opaque, reslist->params, reslist->pool);
+    return destroy_opaque(reslist, res->opaque);
+}
+
+/**
+ * Account for a successful acquire that had to wait since start.
+ */
+static void record_wait(apr_reslist_t *reslist, apr_time_t start)
+{
+    apr_interval_time_t waited = apr_time_now() - start;
+    apr_interval_time_t limit = 10;
+    int i = 1;
+
+    while (i < APR_RESLIST_WAIT_BUCKETS - 1 && waited >= limit) {
+        limit *= 10;
+        i++;
+    }
+    apr_atomic_inc32(&reslist->wait[i]);
+}
+
+#if APR_HAS_THREADS
+
+#define LF_SLOT(head) ((apr_uint32_t)(head))
+#define LF_NEXT(head, slot) ((((head) >> 32) + 1) << 32 | (slot))
+
+/**
+ * Push a container onto a lock-free stack.
+ */
+static void lf_push(apr_reslist_t *reslist, volatile apr_uint64_t *head,
+                    apr_res_t *res)
+{
+    apr_uint32_t slot = (apr_uint32_t)(res - reslist->slots) + 1;
+    apr_uint64_t old;
+
+    do {
+        old = apr_atomic_read64(head);
+        res->next = LF_SLOT(old);
+    } while (apr_atomic_cas64(head, LF_NEXT(old, slot), old) != old);
+}
+
+/**
+ * Pop a container from a lock-free stack, or NULL if it is empty.
+ */
+static apr_res_t *lf_pop(apr_reslist_t *reslist, volatile apr_uint64_t *head)
+{
+    apr_uint64_t old;
+    apr_res_t *res;
+
+    do {
+        old = apr_atomic_read64(head);
+        if (!LF_SLOT(old)) {
+            return NULL;
+        }
+        res = &reslist->slots[LF_SLOT(old) - 1];
+    } while (apr_atomic_cas64(head, LF_NEXT(old, res->next), old) != old);
+
+    return res;
+}
+
+/**
+ * Take all the available resources at once, and return them chained
+ * through their next slot, oldest first.
+ */
+static apr_uint32_t lf_take_all(apr_reslist_t *reslist, int *count)
+{
+    apr_uint64_t old;
+    apr_uint32_t slot, next, prev = 0;
+    apr_res_t *res;
+
+    do {
+        old = apr_atomic_read64(&reslist->avail_head);
+    } while (LF_SLOT(old) && apr_atomic_cas64(&reslist->avail_head,
+                                              LF_NEXT(old, 0), old) != old);
+
+    /* The chain is ours now, reverse it */
+    *count = 0;
+    for (slot = LF_SLOT(old); slot; slot = next) {
+        res = &reslist->slots[slot - 1];
+        next = res->next;
+        res->next = prev;
+        prev = slot;
+        (*count)++;
+    }
+    apr_atomic_sub32(&reslist->idle, *count);
+
+    return prev;
+}
+
+/**
+ * Make a resource available on the lock-free stack.
+ */
+static apr_status_t lf_put(apr_reslist_t *reslist, void *resource,
+                           apr_time_t now)
+{
+    apr_res_t *res;
+
+    /* There is always an empty container for a resource which is not
+     * available, unless the caller did not get it from this list.
+     */
+    res = lf_pop(reslist, &reslist->free_head);
+    if (!res) {
+        return APR_EGENERAL;
+    }
+    res->opaque = resource;
+    res->freed = now;
+    apr_atomic_inc32(&reslist->idle);
+    lf_push(reslist, &reslist->avail_head, res);
+
+    return APR_SUCCESS;
+}
+
+/**
+ * Construct a resource and make it available, waking up a waiter.
+ * Assumes: that the reslist is locked.
+ */
+static apr_status_t lf_create(apr_reslist_t *reslist)
+{
+    apr_status_t rv;
+    void *resource;
+
+    rv = reslist->constructor(&resource, reslist->params, reslist->pool);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+    apr_atomic_inc32(&reslist->constructed);
+    reslist->ntotal++;
+    lf_put(reslist, resource, reslist->ttl ? apr_time_now() : 0);
+    if (apr_atomic_read32(&reslist->waiters)) {
+        apr_thread_cond_signal(reslist->avail);
+    }
+    return APR_SUCCESS;
+}
+
+/**
+ * Maintenance of a lock-free reslist, see reslist_maintain().
+ * Assumes: that the reslist is locked.
+ */
+static apr_status_t lf_maintain(apr_reslist_t *reslist)
+{
+    apr_status_t rv = APR_SUCCESS;
+    apr_time_t now, expiry;
+    apr_uint32_t slot;
+    apr_res_t *res;
+    int created_one = 0, expiring = 1, nidle;
+
+    while ((int)apr_atomic_read32(&reslist->idle) < reslist->min
+           && reslist->ntotal < reslist->hmax) {
+        rv = lf_create(reslist);
+        if (rv != APR_SUCCESS) {
+            return rv;
+        }
+        created_one++;
+    }
+
+    if (created_one || !reslist->ttl) {
+        return APR_SUCCESS;
+    }
+
+    /* The oldest resources are at the bottom of the stack, so take them
+     * all, expire from the oldest and push the others back in order.
+     * Acquires meanwhile find the stack empty and wait for the lock.
+     */
+    now = apr_time_now();
+    expiry = now + reslist->ttl;
+    slot = lf_take_all(reslist, &nidle);
+    nidle += (int)apr_atomic_read32(&reslist->idle);
+    while (slot) {
+        res = &reslist->slots[slot - 1];
+        slot = res->next;
+        if (expiring) {
+            if (rv == APR_SUCCESS && nidle > reslist->smax
+                && now - res->freed >= reslist->ttl) {
+                /* this res is expired - kill it */
+                reslist->ntotal--;
+                nidle--;
+                rv = destroy_resource(reslist, res);
+                lf_push(reslist, &reslist->free_head, res);
+                continue;
+            }
+            /* Nothing expires before the oldest one left */
+            expiry = res->freed + reslist->ttl;
+            expiring = 0;
+        }
+        apr_atomic_inc32(&reslist->idle);
+        lf_push(reslist, &reslist->avail_head, res);
+    }
+    apr_atomic_set64(&reslist->expiry, expiry);
+
+    return rv;
+}
+
+/**
+ * Destroy all the available resources of a lock-free reslist.
+ * Assumes: that the reslist is locked.
+ */
+static apr_status_t lf_cleanup(apr_reslist_t *rl)
+{
+    apr_status_t rv = APR_SUCCESS;
+    apr_uint32_t slot;
+    apr_res_t *res;
+    int count;
+
+    for (slot = lf_take_all(rl, &count); slot; ) {
+        apr_status_t rv1;
+        res = &rl->slots[slot - 1];
+        slot = res->next;
+        rl->ntotal--;
+        rv1 = destroy_resource(rl, res);
+        if (rv1 != APR_SUCCESS) {
+            rv = rv1;
+        }
+        lf_push(rl, &rl->free_head, res);
+    }
+
+    assert(rl->idle == 0);
+    assert(rl->ntotal == 0);
+
+    return rv;
+}
+
+static apr_status_t lf_acquire(apr_reslist_t *reslist, void **resource,
+                               int flags)
+{
+    apr_status_t rv;
+    apr_res_t *res;
+    apr_time_t start;
+
+    /* Fast path, take the latest resource released */
+    while ((res = lf_pop(reslist, &reslist->avail_head)) != NULL) {
+        apr_atomic_dec32(&reslist->idle);
+        if (!reslist->ttl || apr_time_now() - res->freed < reslist->ttl) {
+            *resource = res->opaque;
+            lf_push(reslist, &reslist->free_head, res);
+            apr_atomic_inc32(&reslist->wait[0]);
+            return APR_SUCCESS;
+        }
+        /* The latest is expired, so are the ones below it, kill them
+         * as we meet them. The container is freed before unlocking, or
+         * a resource constructed meanwhile could miss one on release. */
+        apr_thread_mutex_lock(reslist->listlock);
+        apr_pool_owner_set(reslist->pool, 0);
+        reslist->ntotal--;
+        rv = destroy_resource(reslist, res);
+        lf_push(reslist, &reslist->free_head, res);
+        if (apr_atomic_read32(&reslist->waiters)) {
+            apr_thread_cond_signal(reslist->avail);
+        }
+        apr_thread_mutex_unlock(reslist->listlock);
+        if (rv != APR_SUCCESS) {
+            return rv;  /* FIXME: this might cause unnecessary fails */
+        }
+    }
+
+    if (flags & RESLIST_ACQUIRE_IDLE) {
+        return APR_EAGAIN;
+    }
+
+    /* Slow path, construct a resource or wait for one to be released.
+     * Releases check for waiters after pushing, and take the lock to
+     * signal, so a push can't be missed between our pop and our wait.
+     */
+    start = apr_time_now();
+    apr_thread_mutex_lock(reslist->listlock);
+    apr_pool_owner_set(reslist->pool, 0);
+    apr_atomic_inc32(&reslist->waiters);
+    for (;;) {
+        res = lf_pop(reslist, &reslist->avail_head);
+        if (res) {
+            apr_atomic_dec32(&reslist->idle);
+            if (reslist->ttl && apr_time_now() - res->freed >= reslist->ttl) {
+                reslist->ntotal--;
+                rv = destroy_resource(reslist, res);
+                lf_push(reslist, &reslist->free_head, res);
+                if (rv != APR_SUCCESS) {
+                    break;
+                }
+                continue;
+            }
+            *resource = res->opaque;
+            lf_push(reslist, &reslist->free_head, res);
+            rv = APR_SUCCESS;
+            break;
+        }
+        if (reslist->ntotal < reslist->hmax) {
+            rv = reslist->constructor(resource, reslist->params,
+                                      reslist->pool);
+            if (rv == APR_SUCCESS) {
+                apr_atomic_inc32(&reslist->constructed);
+                reslist->ntotal++;
+            }
+            break;
+        }
+        if (flags & RESLIST_ACQUIRE_NOWAIT) {
+            rv = APR_EAGAIN;
+            break;
+        }
+        if (reslist->timeout) {
+            rv = apr_thread_cond_timedwait(reslist->avail, reslist->listlock,
+                                           reslist->timeout);
+            if (rv != APR_SUCCESS) {
+                if (APR_STATUS_IS_TIMEUP(rv)) {
+                    apr_atomic_inc32(&reslist->timeouts);
+                }
+                break;
+            }
+        }
+        else {
+            apr_thread_cond_wait(reslist->avail, reslist->listlock);
+        }
+    }
+    apr_atomic_dec32(&reslist->waiters);
+    apr_thread_mutex_unlock(reslist->listlock);
+
+    if (rv == APR_SUCCESS) {
+        record_wait(reslist, start);
+    }
+    return rv;
+}
+
+static apr_status_t lf_release(apr_reslist_t *reslist, void *resource)
+{
+    apr_status_t rv;
+    apr_time_t now = reslist->ttl ? apr_time_now() : 0;
+
+    rv = lf_put(reslist, resource, now);
+    if (rv != APR_SUCCESS) {
+        return rv;
+    }
+
+    if (apr_atomic_read32(&reslist->waiters)) {
+        apr_thread_mutex_lock(reslist->listlock);
+        apr_thread_cond_signal(reslist->avail);
+        apr_thread_mutex_unlock(reslist->listlock);
+    }
+
+    /* Only take the lock when maintenance has something to do; ntotal
+     * is read unlocked here as a hint, lf_maintain() checks again. */
+    if (((int)apr_atomic_read32(&reslist->idle) < reslist->min
+         && reslist->ntotal < reslist->hmax)
+        || (reslist->ttl
+            && (int)apr_atomic_read32(&reslist->idle) > reslist->smax
+            && now >= (apr_time_t)apr_atomic_read64(&reslist->expiry))) {
+        apr_thread_mutex_lock(reslist->listlock);
+        apr_pool_owner_set(reslist->pool, 0);
+        rv = lf_maintain(reslist);
+        apr_thread_mutex_unlock(reslist->listlock);
+    }
+
+    return rv;
+}
+
+/**
+ * An entry of the owners table of a sharded list.
+ */
+typedef struct reslist_owner_t {
+    void *volatile resource; /* NULL if never used, or owner_gone */
+    int shard;
+} reslist_owner_t;
+
+/**
+ * Params of the constructor and destructor of a shard.
+ */
+typedef struct reslist_shard_t {
+    apr_reslist_t *parent;
+    int shard;
+} reslist_shard_t;
+
+static char owner_gone[1];
+
+/* Fibonacci hashing: the top bits of the 64-bit product depend on all
+ * the bits of the pointer, where the low ones would only reorder its
+ * low bits and collide for resources at the same offset of pages. */
+#define OWNER_HASH(resource, shift) \
+    ((apr_uint32_t)((apr_uint64_t)(apr_uintptr_t)(resource) \
+                    * APR_UINT64_C(0x9E3779B97F4A7C15) >> (shift)))
+
+/**
+ * Record the shard of a new resource. There are twice as many entries
+ * as resources, and an entry is never free again once used: the lookups
+ * of present resources stop before the end of the chain of collisions.
+ */
+static void owner_set(apr_reslist_t *rl, void *resource, int shard)
+{
+    apr_uint32_t i = OWNER_HASH(resource, rl->owners_shift);
+    void *cur;
+
+    for (;; i++) {
+        reslist_owner_t *owner = &rl->owners[i & rl->owners_mask];
+        cur = owner->resource;
+        if ((!cur || cur == owner_gone)
+            && apr_atomic_casptr(&owner->resource, resource, cur) == cur) {
+            owner->shard = shard;
+            return;
+        }
+    }
+}
+
+static reslist_owner_t *owner_find(apr_reslist_t *rl, void *resource)
+{
+    apr_uint32_t i = OWNER_HASH(resource, rl->owners_shift), n;
+
+    for (n = 0; n <= rl->owners_mask; n++, i++) {
+        reslist_owner_t *owner = &rl->owners[i & rl->owners_mask];
+        if (owner->resource == resource) {
+            return owner;
+        }
+        if (!owner->resource) {
+            break;
+        }
+    }
+    return NULL;
+}
+
+static apr_status_t shard_construct(void **resource, void *params,
+                                    apr_pool_t *pool)
+{
+    reslist_shard_t *shard = params;
+    apr_reslist_t *rl = shard->parent;
+    apr_status_t rv;
+
+    rv = rl->constructor(resource, rl->params, pool);
+    if (rv == APR_SUCCESS) {
+        owner_set(rl, *resource, shard->shard);
+    }
+    return rv;
 }
 
+static apr_status_t shard_destruct(void *resource, void *params,
+                                   apr_pool_t *pool)
+{
+    reslist_shard_t *shard = params;
+    apr_reslist_t *rl = shard->parent;
+    reslist_owner_t *owner;
+
+    owner = owner_find(rl, resource);
+    if (owner) {
+        owner->resource = owner_gone;
+    }
+    return rl->destructor(resource, rl->params, pool);
+}
+
+/**
+ * The shard a resource goes back to, or NULL if none constructed it.
+ */
+static apr_reslist_t *shard_of(apr_reslist_t *rl, void *resource)
+{
+    reslist_owner_t *owner = owner_find(rl, resource);
+
+    return owner ? rl->shards[owner->shard] : NULL;
+}
+
+#if APR_HAS_THREAD_LOCAL
+static APR_THREAD_LOCAL apr_uint32_t thread_number;
+static volatile apr_uint32_t thread_count;
+#endif
+
+/**
+ * The shard of the calling thread.
+ */
+static int shard_select(apr_reslist_t *rl)
+{
+    apr_uint32_t n;
+
+#ifdef HAVE_SCHED_GETCPU
+    if (rl->flags & APR_RESLIST_SHARD_CPU) {
+        int cpu = sched_getcpu();
+        if (cpu >= 0) {
+            return cpu % rl->nshards;
+        }
+    }
+#endif
+#if APR_HAS_THREAD_LOCAL
+    /* Number the threads as they come, which spreads them evenly */
+    n = thread_number;
+    if (!n) {
+        n = thread_number = apr_atomic_inc32(&thread_count) + 1;
+    }
+#else
+    n = OWNER_HASH(apr_os_thread_current(), 32);
+#endif
+    return (int)(n % rl->nshards);
+}
+
+static apr_status_t shards_cleanup(apr_reslist_t *rl)
+{
+    apr_status_t rv = APR_SUCCESS;
+    int i;
+
+    for (i = 0; i < rl->nshards; i++) {
+        if (rl->shards[i]) {
+            apr_status_t rv1 = apr_reslist_destroy(rl->shards[i]);
+            if (rv1 != APR_SUCCESS) {
+                rv = rv1;
+            }
+        }
+    }
+
+    return rv;
+}
+
+#endif /* APR_HAS_THREADS */
+
 static apr_status_t reslist_cleanup(void *data_)
 {
     apr_status_t rv = APR_SUCCESS;
@@ -159,8 +708,16 @@ static apr_status_t reslist_cleanup(void *data_)
     apr_res_t *res;
 
 #if APR_HAS_THREADS
+    if (rl->shards) {
+        return shards_cleanup(rl);
+    }
+
     apr_thread_mutex_lock(rl->listlock);
     apr_pool_owner_set(rl->pool, 0);
+
+    if (rl->flags & APR_RESLIST_LOCKFREE) {
+        rv = lf_cleanup(rl);
+    }
 #endif
 
     while (rl->nidle > 0) {
@@ -198,6 +755,12 @@ static apr_status_t reslist_maintain(apr_reslist_t *reslist)
     apr_res_t *res;
     int created_one = 0;
 
+#if APR_HAS_THREADS
+    if (reslist->flags & APR_RESLIST_LOCKFREE) {
+        return lf_maintain(reslist);
+    }
+#endif
+
     /* Check if we need to create more resources, and if we are allowed to. */
     while (reslist->nidle < reslist->min && reslist->ntotal < reslist->hmax) {
         /* Create the resource */
@@ -250,6 +813,18 @@ APR_DECLARE(apr_status_t) apr_reslist_maintain(apr_reslist_t *reslist)
     apr_status_t rv;
 
 #if APR_HAS_THREADS
+    if (reslist->shards) {
+        int i;
+
+        for (i = 0; i < reslist->nshards; i++) {
+            rv = apr_reslist_maintain(reslist->shards[i]);
+            if (rv != APR_SUCCESS) {
+                return rv;
+            }
+        }
+        return APR_SUCCESS;
+    }
+
     apr_thread_mutex_lock(reslist->listlock);
     apr_pool_owner_set(reslist->pool, 0);
 #endif
@@ -260,13 +835,14 @@ APR_DECLARE(apr_status_t) apr_reslist_maintain(apr_reslist_t *reslist)
     return rv;
 }
 
-APR_DECLARE(apr_status_t) apr_reslist_create(apr_reslist_t **reslist,
-                                             int min, int smax, int hmax,
-                                             apr_interval_time_t ttl,
-                                             apr_reslist_constructor con,
-                                             apr_reslist_destructor de,
-                                             void *params,
-                                             apr_pool_t *pool)
+APR_DECLARE(apr_status_t) apr_reslist_create_ex(apr_reslist_t **reslist,
+                                                int min, int smax, int hmax,
+                                                apr_interval_time_t ttl,
+                                                apr_reslist_constructor con,
+                                                apr_reslist_destructor de,
+                                                void *params,
+                                                apr_uint32_t flags,
+                                                apr_pool_t *pool)
 {
     apr_status_t rv;
     apr_reslist_t *rl;
@@ -274,7 +850,7 @@ APR_DECLARE(apr_status_t) apr_reslist_create(apr_reslist_t **reslist,
     /* Do some sanity checks so we don't thrash around in the
      * maintenance routine later. */
     if (min < 0 || min > smax || min > hmax || smax > hmax || hmax == 0 ||
-        ttl < 0) {
+        ttl < 0 || (flags & ~APR_RESLIST_LOCKFREE)) {
         return APR_EINVAL;
     }
 
@@ -287,6 +863,8 @@ APR_DECLARE(apr_status_t) apr_reslist_create(apr_reslist_t **reslist,
         smax = 1;
     }
     hmax = 1;
+    /* and nobody to race with */
+    flags &= ~APR_RESLIST_LOCKFREE;
 #endif
 
     rl = apr_pcalloc(pool, sizeof(*rl));
@@ -298,10 +876,22 @@ APR_DECLARE(apr_status_t) apr_reslist_create(apr_reslist_t **reslist,
     rl->constructor = con;
     rl->destructor = de;
     rl->params = params;
+    rl->flags = flags;
 
     APR_RING_INIT(&rl->avail_list, apr_res_t, link);
     APR_RING_INIT(&rl->free_list, apr_res_t, link);
 
+#if APR_HAS_THREADS
+    if (flags & APR_RESLIST_LOCKFREE) {
+        int i;
+
+        rl->slots = apr_pcalloc(pool, hmax * sizeof(apr_res_t));
+        for (i = 0; i < hmax; i++) {
+            lf_push(rl, &rl->free_head, &rl->slots[i]);
+        }
+    }
+#endif
+
 #if APR_HAS_THREADS
     rv = apr_thread_mutex_create(&rl->listlock, APR_THREAD_MUTEX_DEFAULT,
                                  pool);
@@ -330,6 +920,104 @@ APR_DECLARE(apr_status_t) apr_reslist_create(apr_reslist_t **reslist,
     return APR_SUCCESS;
 }
 
+APR_DECLARE(apr_status_t) apr_reslist_create(apr_reslist_t **reslist,
+                                             int min, int smax, int hmax,
+                                             apr_interval_time_t ttl,
+                                             apr_reslist_constructor con,
+                                             apr_reslist_destructor de,
+                                             void *params,
+                                             apr_pool_t *pool)
+{
+    return apr_reslist_create_ex(reslist, min, smax, hmax, ttl, con, de,
+                                 params, 0, pool);
+}
+
+APR_DECLARE(apr_status_t) apr_reslist_create_sharded(apr_reslist_t **reslist,
+                                                     int nshards,
+                                                     int min, int smax,
+                                                     int hmax,
+                                                     apr_interval_time_t ttl,
+                                                     apr_reslist_constructor con,
+                                                     apr_reslist_destructor de,
+                                                     void *params,
+                                                     apr_uint32_t flags,
+                                                     apr_pool_t *pool)
+{
+#if APR_HAS_THREADS
+    apr_status_t rv;
+    apr_reslist_t *rl;
+    reslist_shard_t *shard;
+    apr_uint32_t size;
+    int i;
+#endif
+
+    if (nshards < 1 || (flags & ~(APR_RESLIST_LOCKFREE |
+                                  APR_RESLIST_SHARD_CPU))) {
+        return APR_EINVAL;
+    }
+    if (nshards > hmax) {
+        nshards = hmax;
+    }
+
+#if APR_HAS_THREADS
+    if (nshards > 1) {
+        if (min < 0 || min > smax || smax > hmax || ttl < 0) {
+            return APR_EINVAL;
+        }
+
+        rl = apr_pcalloc(pool, sizeof(*rl));
+        rl->pool = pool;
+        rl->min = min;
+        rl->smax = smax;
+        rl->hmax = hmax;
+        rl->ttl = ttl;
+        rl->constructor = con;
+        rl->destructor = de;
+        rl->params = params;
+        rl->flags = flags;
+
+        size = 2;
+        rl->owners_shift = 63;
+        while (size < 2 * (apr_uint32_t)hmax) {
+            size <<= 1;
+            rl->owners_shift--;
+        }
+        rl->owners = apr_pcalloc(pool, size * sizeof(reslist_owner_t));
+        rl->owners_mask = size - 1;
+
+        /* Split the budget, the first shards taking the remainders */
+        rl->nshards = nshards;
+        rl->shards = apr_pcalloc(pool, nshards * sizeof(apr_reslist_t *));
+        shard = apr_palloc(pool, nshards * sizeof(reslist_shard_t));
+        for (i = 0; i < nshards; i++) {
+            shard[i].parent = rl;
+            shard[i].shard = i;
+            rv = apr_reslist_create_ex(&rl->shards[i],
+                                       min / nshards + (i < min % nshards),
+                                       smax / nshards + (i < smax % nshards),
+                                       hmax / nshards + (i < hmax % nshards),
+                                       ttl, shard_construct, shard_destruct,
+                                       &shard[i],
+                                       flags & APR_RESLIST_LOCKFREE, pool);
+            if (rv != APR_SUCCESS) {
+                shards_cleanup(rl);
+                return rv;
+            }
+        }
+
+        apr_pool_cleanup_register(rl->pool, rl, reslist_cleanup,
+                                  apr_pool_cleanup_null);
+
+        *reslist = rl;
+
+        return APR_SUCCESS;
+    }
+#endif
+
+    return apr_reslist_create_ex(reslist, min, smax, hmax, ttl, con, de,
+                                 params, flags & APR_RESLIST_LOCKFREE, pool);
+}
+
 APR_DECLARE(apr_status_t) apr_reslist_destroy(apr_reslist_t *reslist)
 {
     return apr_pool_cleanup_run(reslist->pool, reslist, reslist_cleanup);
@@ -340,12 +1028,17 @@ static apr_status_t reslist_acquire(apr_reslist_t *reslist,
 {
     apr_status_t rv;
     apr_res_t *res;
-    int fifo;
+    apr_time_t start;
+    int fifo = flags & APR_RESLIST_ACQUIRE_FIFO;
 
-    if (flags & ~APR_RESLIST_ACQUIRE_MASK) {
-        return APR_EINVAL;
+#if APR_HAS_THREADS
+    if (reslist->flags & APR_RESLIST_LOCKFREE) {
+        if (fifo) {
+            return APR_ENOTIMPL;
+        }
+        return lf_acquire(reslist, resource, flags);
     }
-    fifo = flags & APR_RESLIST_ACQUIRE_FIFO;
+#endif
 
 #if APR_HAS_THREADS
     apr_thread_mutex_lock(reslist->listlock);
@@ -382,18 +1075,33 @@ static apr_status_t reslist_acquire(apr_reslist_t *reslist,
         res = pop_resource(reslist, fifo);
         *resource = res->opaque;
         free_container(reslist, res);
+        apr_atomic_inc32(&reslist->wait[0]);
 #if APR_HAS_THREADS
         apr_thread_mutex_unlock(reslist->listlock);
 #endif
         return APR_SUCCESS;
     }
+#if APR_HAS_THREADS
+    if (flags & RESLIST_ACQUIRE_IDLE) {
+        apr_thread_mutex_unlock(reslist->listlock);
+        return APR_EAGAIN;
+    }
+#endif
+    start = apr_time_now();
     /* If we've hit our max, block until we're allowed to create
      * a new one, or something becomes free. */
     while (reslist->ntotal >= reslist->hmax && reslist->nidle <= 0) {
 #if APR_HAS_THREADS
+        if (flags & RESLIST_ACQUIRE_NOWAIT) {
+            apr_thread_mutex_unlock(reslist->listlock);
+            return APR_EAGAIN;
+        }
         if (reslist->timeout) {
             if ((rv = apr_thread_cond_timedwait(reslist->avail,
                 reslist->listlock, reslist->timeout)) != APR_SUCCESS) {
+                if (APR_STATUS_IS_TIMEUP(rv)) {
+                    apr_atomic_inc32(&reslist->timeouts);
+                }
                 apr_thread_mutex_unlock(reslist->listlock);
                 return rv;
             }
@@ -414,6 +1122,7 @@ static apr_status_t reslist_acquire(apr_reslist_t *reslist,
 #if APR_HAS_THREADS
         apr_thread_mutex_unlock(reslist->listlock);
 #endif
+        record_wait(reslist, start);
         return APR_SUCCESS;
     }
     /* Otherwise the reason we dropped out of the loop
@@ -429,19 +1138,61 @@ static apr_status_t reslist_acquire(apr_reslist_t *reslist,
 #if APR_HAS_THREADS
         apr_thread_mutex_unlock(reslist->listlock);
 #endif
+        if (rv == APR_SUCCESS) {
+            record_wait(reslist, start);
+        }
         return rv;
     }
 }
 
+#if APR_HAS_THREADS
+static apr_status_t shards_acquire(apr_reslist_t *reslist,
+                                   void **resource, int flags)
+{
+    apr_status_t rv;
+    int i, n = reslist->nshards, s = shard_select(reslist);
+
+    /* Our own shard first, then an idle resource from a sibling, then
+     * one constructed by a sibling, and only then wait for our shard. */
+    rv = reslist_acquire(reslist->shards[s], resource,
+                         flags | RESLIST_ACQUIRE_NOWAIT);
+    for (i = 1; APR_STATUS_IS_EAGAIN(rv) && i < n; i++) {
+        rv = reslist_acquire(reslist->shards[(s + i) % n], resource,
+                             flags | RESLIST_ACQUIRE_IDLE);
+    }
+    for (i = 1; APR_STATUS_IS_EAGAIN(rv) && i < n; i++) {
+        rv = reslist_acquire(reslist->shards[(s + i) % n], resource,
+                             flags | RESLIST_ACQUIRE_NOWAIT);
+    }
+    if (APR_STATUS_IS_EAGAIN(rv)) {
+        rv = reslist_acquire(reslist->shards[s], resource, flags);
+    }
+    return rv;
+}
+#endif
+
 APR_DECLARE(apr_status_t) apr_reslist_acquire_ex(apr_reslist_t *reslist,
                                                  void **resource, int flags)
 {
+    if (flags & ~APR_RESLIST_ACQUIRE_MASK) {
+        return APR_EINVAL;
+    }
+#if APR_HAS_THREADS
+    if (reslist->shards) {
+        return shards_acquire(reslist, resource, flags);
+    }
+#endif
     return reslist_acquire(reslist, resource, flags);
 }
 
 APR_DECLARE(apr_status_t) apr_reslist_acquire(apr_reslist_t *reslist,
                                               void **resource)
 {
+#if APR_HAS_THREADS
+    if (reslist->shards) {
+        return shards_acquire(reslist, resource, 0);
+    }
+#endif
     return reslist_acquire(reslist, resource, 0);
 }
 
@@ -452,6 +1203,14 @@ APR_DECLARE(apr_status_t) apr_reslist_release(apr_reslist_t *reslist,
     apr_res_t *res;
 
 #if APR_HAS_THREADS
+    if (reslist->shards) {
+        apr_reslist_t *shard = shard_of(reslist, resource);
+        return shard ? apr_reslist_release(shard, resource) : APR_EINVAL;
+    }
+    if (reslist->flags & APR_RESLIST_LOCKFREE) {
+        return lf_release(reslist, resource);
+    }
+
     apr_thread_mutex_lock(reslist->listlock);
     apr_pool_owner_set(reslist->pool, 0);
 #endif
@@ -468,6 +1227,11 @@ APR_DECLARE(apr_status_t) apr_reslist_release(apr_reslist_t *reslist,
 APR_DECLARE(void) apr_reslist_timeout_set(apr_reslist_t *reslist,
                                           apr_interval_time_t timeout)
 {
+    int i;
+
+    for (i = 0; i < reslist->nshards; i++) {
+        reslist->shards[i]->timeout = timeout;
+    }
     reslist->timeout = timeout;
 }
 
@@ -476,10 +1240,24 @@ APR_DECLARE(apr_uint32_t) apr_reslist_acquired_count(apr_reslist_t *reslist)
     apr_uint32_t count;
 
 #if APR_HAS_THREADS
+    if (reslist->shards) {
+        int i;
+
+        for (count = 0, i = 0; i < reslist->nshards; i++) {
+            count += apr_reslist_acquired_count(reslist->shards[i]);
+        }
+        return count;
+    }
+
     apr_thread_mutex_lock(reslist->listlock);
     apr_pool_owner_set(reslist->pool, 0);
 #endif
-    count = reslist->ntotal - reslist->nidle;
+    if (reslist->flags & APR_RESLIST_LOCKFREE) {
+        count = reslist->ntotal - apr_atomic_read32(&reslist->idle);
+    }
+    else {
+        count = reslist->ntotal - reslist->nidle;
+    }
 #if APR_HAS_THREADS
     apr_thread_mutex_unlock(reslist->listlock);
 #endif
@@ -492,10 +1270,15 @@ APR_DECLARE(apr_status_t) apr_reslist_invalidate(apr_reslist_t *reslist,
 {
     apr_status_t ret;
 #if APR_HAS_THREADS
+    if (reslist->shards) {
+        apr_reslist_t *shard = shard_of(reslist, resource);
+        return shard ? apr_reslist_invalidate(shard, resource) : APR_EINVAL;
+    }
+
     apr_thread_mutex_lock(reslist->listlock);
     apr_pool_owner_set(reslist->pool, 0);
 #endif
-    ret = reslist->destructor(resource, reslist->params, reslist->pool);
+    ret = destroy_opaque(reslist, resource);
     reslist->ntotal--;
 #if APR_HAS_THREADS
     apr_thread_cond_signal(reslist->avail);
@@ -507,6 +1290,13 @@ APR_DECLARE(apr_status_t) apr_reslist_invalidate(apr_reslist_t *reslist,
 APR_DECLARE(void) apr_reslist_cleanup_order_set(apr_reslist_t *rl,
                                                 apr_uint32_t mode)
 {
+    int i;
+
+    /* The shards first, so that the list runs before them */
+    for (i = 0; i < rl->nshards; i++) {
+        apr_reslist_cleanup_order_set(rl->shards[i], mode);
+    }
+
     apr_pool_cleanup_kill(rl->pool, rl, reslist_cleanup);
     if (mode == APR_RESLIST_CLEANUP_FIRST)
         apr_pool_pre_cleanup_register(rl->pool, rl, reslist_cleanup);
@@ -514,3 +1304,30 @@ APR_DECLARE(void) apr_reslist_cleanup_order_set(apr_reslist_t *rl,
         apr_pool_cleanup_register(rl->pool, rl, reslist_cleanup,
                                   apr_pool_cleanup_null);
 }
+
+APR_DECLARE(void) apr_reslist_stats_get(apr_reslist_t *reslist,
+                                        apr_reslist_stats_t *stats)
+{
+    int i;
+
+    stats->constructed = apr_atomic_read32(&reslist->constructed);
+    stats->destroyed = apr_atomic_read32(&reslist->destroyed);
+    stats->timeouts = apr_atomic_read32(&reslist->timeouts);
+    for (i = 0; i < APR_RESLIST_WAIT_BUCKETS; i++) {
+        stats->wait[i] = apr_atomic_read32(&reslist->wait[i]);
+    }
+
+    /* a sharded list has none of its own */
+    for (i = 0; i < reslist->nshards; i++) {
+        apr_reslist_stats_t shard;
+        int j;
+
+        apr_reslist_stats_get(reslist->shards[i], &shard);
+        stats->constructed += shard.constructed;
+        stats->destroyed += shard.destroyed;
+        stats->timeouts += shard.timeouts;
+        for (j = 0; j < APR_RESLIST_WAIT_BUCKETS; j++) {
+            stats->wait[j] += shard.wait[j];
+        }
+    }
+}
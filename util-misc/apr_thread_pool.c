@@ -21,12 +21,36 @@
 #include "apr_ring.h"
 #include "apr_thread_cond.h"
 #include "apr_portable.h"
+#include "apr_atomic.h"
 
 #if APR_HAS_THREADS
 
 #define TASK_PRIORITY_SEGS 4
 #define TASK_PRIORITY_SEG(x) (((x)->dispatch.priority & 0xFF) / 64)
 
+/* Work stealing mode (APR_THREAD_POOL_WORK_STEALING) */
+#define WS_DEQUE_SIZE   256     /* tasks per deque, power of two */
+#define WS_BATCH_MAX    32      /* shared tasks taken at once */
+#define WS_SHARED_TICK  61      /* local tasks run before checking shared */
+#define WS_RECYCLED_MAX 64      /* recycled tasks kept by a thread */
+#define WS_CANCEL_WAIT  apr_time_from_msec(10)
+
+/* Task states in work stealing mode, only the tasks in the deques can be
+ * cancelled or run concurrently thus the state is changed atomically.
+ * The upper bits of the state word hold a generation bumped each time the
+ * task is queued in a deque, so that a canceller which reads the owner of a
+ * (possibly stale) deque entry can only cancel that very queuing of it.
+ */
+#define WS_TASK_SHARED    0     /* in the shared rings (under the lock) */
+#define WS_TASK_QUEUED    1     /* in a deque */
+#define WS_TASK_RUNNING   2
+#define WS_TASK_CANCELLED 3
+#define WS_TASK_MASK      3u
+#define WS_TASK_STATE(s)  ((s) & WS_TASK_MASK)
+#define WS_TASK_SET(s, st) (((s) & ~WS_TASK_MASK) | (st))
+#define WS_TASK_REQUEUE(s) ((((s) & ~WS_TASK_MASK) + WS_TASK_MASK + 1) \
+                            | WS_TASK_QUEUED)
+
 typedef struct apr_thread_pool_task
 {
     APR_RING_ENTRY(apr_thread_pool_task) link;
@@ -38,10 +62,40 @@ typedef struct apr_thread_pool_task
         apr_byte_t priority;
         apr_time_t time;
     } dispatch;
+    volatile apr_uint32_t state;
 } apr_thread_pool_task_t;
 
 APR_RING_HEAD(apr_thread_pool_tasks, apr_thread_pool_task);
 
+/*
+ * Chase-Lev deque: the owner thread pushes and pops at the bottom, the
+ * other threads steal from the top.  The indexes are free running.
+ */
+typedef struct ws_deque_t
+{
+    volatile apr_uint32_t top;
+    char pad[64 - sizeof(apr_uint32_t)];
+    volatile apr_uint32_t bottom;
+    apr_thread_pool_task_t *volatile tasks[WS_DEQUE_SIZE];
+} ws_deque_t;
+
+/* The per thread state in work stealing mode */
+typedef struct ws_slot_t
+{
+    ws_deque_t deques[TASK_PRIORITY_SEGS];
+    struct apr_thread_pool_tasks recycled_tasks;    /* owner only */
+    apr_size_t recycled_cnt;
+    apr_size_t tasks_run;
+    apr_uint32_t seed;
+    int used;                                       /* under the lock */
+    struct apr_thread_pool *tp;
+} ws_slot_t;
+
+#if APR_HAS_THREAD_LOCAL
+/* The slot of the current thread, if a work stealing thread */
+static APR_THREAD_LOCAL ws_slot_t *ws_current;
+#endif
+
 struct apr_thread_list_elt
 {
     APR_RING_ENTRY(apr_thread_list_elt) link;
@@ -82,11 +136,15 @@ struct apr_thread_pool
     struct apr_thread_pool_tasks *recycled_tasks;
     struct apr_thread_list *recycled_thds;
     apr_thread_pool_task_t *task_idx[TASK_PRIORITY_SEGS];
+    ws_slot_t *ws_slots;        /* NULL unless work stealing */
+    apr_size_t ws_nslots;
+    volatile apr_uint32_t ws_idle;      /* threads going to wait */
 };
 
 static apr_status_t thread_pool_construct(apr_thread_pool_t **tp,
                                           apr_size_t init_threads,
                                           apr_size_t max_threads,
+                                          apr_uint32_t flags,
                                           apr_pool_t *pool)
 {
     apr_status_t rv;
@@ -165,6 +223,26 @@ static apr_status_t thread_pool_construct(apr_thread_pool_t **tp,
         goto CATCH_ENOMEM;
     }
     APR_RING_INIT(me->recycled_thds, apr_thread_list_elt, link);
+    if (flags & APR_THREAD_POOL_WORK_STEALING) {
+        apr_size_t i;
+
+        me->ws_nslots = max_threads > init_threads ? max_threads
+                                                   : init_threads;
+        if (!me->ws_nslots) {
+            me->ws_nslots = 1;
+        }
+        me->ws_slots = apr_pcalloc(me->pool,
+                                   me->ws_nslots * sizeof(*me->ws_slots));
+        if (!me->ws_slots) {
+            goto CATCH_ENOMEM;
+        }
+        for (i = 0; i < me->ws_nslots; ++i) {
+            ws_slot_t *slot = &me->ws_slots[i];
+            APR_RING_INIT(&slot->recycled_tasks, apr_thread_pool_task, link);
+            slot->seed = (apr_uint32_t)i + 1;
+            slot->tp = me;
+        }
+    }
     goto FINAL_EXIT;
   CATCH_ENOMEM:
     rv = APR_ENOMEM;
@@ -373,6 +451,36 @@ static void *APR_THREAD_FUNC thread_pool_func(apr_thread_t * t, void *param)
     return NULL;                /* should not be here, safe net */
 }
 
+static void *APR_THREAD_FUNC ws_thread_pool_func(apr_thread_t *t,
+                                                 void *param);
+
+/*
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static apr_status_t create_thread(apr_thread_pool_t *me)
+{
+    apr_thread_t *thd;
+    apr_status_t rv;
+
+    if (me->ws_slots) {
+        /* no more slot for a work stealing thread */
+        if (me->thd_cnt >= me->ws_nslots) {
+            return APR_SUCCESS;
+        }
+        rv = apr_thread_create(&thd, NULL, ws_thread_pool_func, me,
+                               me->pool);
+    }
+    else {
+        rv = apr_thread_create(&thd, NULL, thread_pool_func, me, me->pool);
+    }
+    if (APR_SUCCESS == rv) {
+        ++me->thd_cnt;
+        if (me->thd_cnt > me->thd_high)
+            me->thd_high = me->thd_cnt;
+    }
+    return rv;
+}
+
 /* Must be locked by the caller */
 static void join_dead_threads(apr_thread_pool_t *me)
 {
@@ -421,13 +529,21 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
                                                  apr_size_t max_threads,
                                                  apr_pool_t * pool)
 {
-    apr_thread_t *t;
+    return apr_thread_pool_create_ex(me, init_threads, max_threads, 0, pool);
+}
+
+APR_DECLARE(apr_status_t) apr_thread_pool_create_ex(apr_thread_pool_t ** me,
+                                                    apr_size_t init_threads,
+                                                    apr_size_t max_threads,
+                                                    apr_uint32_t flags,
+                                                    apr_pool_t * pool)
+{
     apr_status_t rv = APR_SUCCESS;
     apr_thread_pool_t *tp;
 
     *me = NULL;
 
-    rv = thread_pool_construct(&tp, init_threads, max_threads, pool);
+    rv = thread_pool_construct(&tp, init_threads, max_threads, flags, pool);
     if (APR_SUCCESS != rv)
         return rv;
     apr_pool_pre_cleanup_register(tp->pool, tp, thread_pool_cleanup);
@@ -439,14 +555,10 @@ APR_DECLARE(apr_status_t) apr_thread_pool_create(apr_thread_pool_t ** me,
     apr_thread_mutex_lock(tp->lock);
     apr_pool_owner_set(tp->pool, 0);
     while (init_threads--) {
-        rv = apr_thread_create(&t, NULL, thread_pool_func, tp, tp->pool);
+        rv = create_thread(tp);
         if (APR_SUCCESS != rv) {
             break;
         }
-        tp->thd_cnt++;
-        if (tp->thd_cnt > tp->thd_high) {
-            tp->thd_high = tp->thd_cnt;
-        }
     }
     apr_thread_mutex_unlock(tp->lock);
 
@@ -463,6 +575,24 @@ APR_DECLARE(apr_status_t) apr_thread_pool_destroy(apr_thread_pool_t * me)
     return APR_SUCCESS;
 }
 
+static void task_init(apr_thread_pool_task_t *t, apr_thread_start_t func,
+                      void *param, apr_byte_t priority, void *owner,
+                      apr_time_t time)
+{
+    APR_RING_ELEM_INIT(t, link);
+
+    t->func = func;
+    t->param = param;
+    t->owner = owner;
+    if (time > 0) {
+        t->dispatch.time = apr_time_now() + time;
+    }
+    else {
+        t->dispatch.priority = priority;
+    }
+    t->state = WS_TASK_SET(t->state, WS_TASK_SHARED);
+}
+
 /*
  * NOTE: This function is not thread safe by itself. Caller should hold the lock
  */
@@ -478,22 +608,13 @@ static apr_thread_pool_task_t *task_new(apr_thread_pool_t * me,
         if (NULL == t) {
             return NULL;
         }
+        t->state = WS_TASK_SHARED;
     }
     else {
         t = APR_RING_FIRST(me->recycled_tasks);
         APR_RING_REMOVE(t, link);
     }
-    APR_RING_ELEM_INIT(t, link);
-
-    t->func = func;
-    t->param = param;
-    t->owner = owner;
-    if (time > 0) {
-        t->dispatch.time = apr_time_now() + time;
-    }
-    else {
-        t->dispatch.priority = priority;
-    }
+    task_init(t, func, param, priority, owner, time);
     return t;
 }
 
@@ -549,7 +670,6 @@ static apr_status_t schedule_task(apr_thread_pool_t *me,
 {
     apr_thread_pool_task_t *t;
     apr_thread_pool_task_t *t_loc;
-    apr_thread_t *thd;
     apr_status_t rv = APR_SUCCESS;
 
     apr_thread_mutex_lock(me->lock);
@@ -591,12 +711,7 @@ static apr_status_t schedule_task(apr_thread_pool_t *me,
     }
     /* there should be at least one thread for scheduled tasks */
     if (0 == me->thd_cnt) {
-        rv = apr_thread_create(&thd, NULL, thread_pool_func, me, me->pool);
-        if (APR_SUCCESS == rv) {
-            ++me->thd_cnt;
-            if (me->thd_cnt > me->thd_high)
-                me->thd_high = me->thd_cnt;
-        }
+        rv = create_thread(me);
     }
     apr_thread_cond_signal(me->more_work);
     apr_thread_mutex_unlock(me->lock);
@@ -604,14 +719,658 @@ static apr_status_t schedule_task(apr_thread_pool_t *me,
     return rv;
 }
 
-static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
-                             void *param, apr_byte_t priority, int push,
-                             void *owner)
+/*
+ * Insert the task at the bottom (push) or the top of the tasks of same
+ * priority.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void insert_task(apr_thread_pool_t *me, apr_thread_pool_task_t *t,
+                        int push)
 {
-    apr_thread_pool_task_t *t;
     apr_thread_pool_task_t *t_loc;
-    apr_thread_t *thd;
+    apr_thread_pool_task_t *sentinel;
+    int seg, next;
+
+    t_loc = add_if_empty(me, t);
+    if (NULL == t_loc) {
+        goto FINAL_EXIT;
+    }
+
+    seg = TASK_PRIORITY_SEG(t);
+    if (push) {
+        /* Walk backward from the end of the segment, rather than forward
+         * through all the tasks of the same priority.
+         */
+        sentinel = APR_RING_SENTINEL(me->tasks, apr_thread_pool_task, link);
+        for (next = seg - 1; next >= 0 && !me->task_idx[next]; next--)
+            ;
+        t_loc = next >= 0 ? me->task_idx[next] : sentinel;
+        while (APR_RING_PREV(t_loc, link) != sentinel
+               && TASK_PRIORITY_SEG(APR_RING_PREV(t_loc, link)) == seg
+               && APR_RING_PREV(t_loc, link)->dispatch.priority <
+                  t->dispatch.priority) {
+            t_loc = APR_RING_PREV(t_loc, link);
+        }
+    }
+    APR_RING_INSERT_BEFORE(t_loc, t, link);
+    if (t_loc == me->task_idx[seg]) {
+        me->task_idx[seg] = t;
+    }
+
+  FINAL_EXIT:
+    me->task_cnt++;
+    if (me->task_cnt > me->tasks_high)
+        me->tasks_high = me->task_cnt;
+}
+
+/*
+ * Work stealing mode.
+ *
+ * Each thread owns a slot with a Chase-Lev deque per priority segment, the
+ * tasks pushed by a running task go to its own deque and are popped from
+ * there (LIFO) without locking, while the other threads steal them (FIFO)
+ * when they run out of tasks.  The tasks pushed from outside go to the
+ * shared (locked) ring as usual, from which the threads take batches into
+ * their deques.  The lock and the more_work condition are then only used
+ * for the shared and scheduled tasks, to idle and to wake up the threads.
+ */
+
+/* Atomically change the task's state from 'from' to 'to' (same generation),
+ * returns whether it did.
+ */
+static int ws_task_transit(apr_thread_pool_task_t *task,
+                           apr_uint32_t from, apr_uint32_t to)
+{
+    apr_uint32_t s = apr_atomic_read32(&task->state);
+
+    if (WS_TASK_STATE(s) != from) {
+        return 0;
+    }
+    return apr_atomic_cas32(&task->state, WS_TASK_SET(s, to), s) == s;
+}
+
+static int ws_deque_push(ws_deque_t *dq, apr_thread_pool_task_t *task)
+{
+    apr_uint32_t b = dq->bottom;
+
+    if (b - apr_atomic_read32(&dq->top) >= WS_DEQUE_SIZE) {
+        return 0;
+    }
+    dq->tasks[b & (WS_DEQUE_SIZE - 1)] = task;
+    apr_atomic_set32(&dq->bottom, b + 1);
+    return 1;
+}
+
+static apr_thread_pool_task_t *ws_deque_pop(ws_deque_t *dq)
+{
+    apr_thread_pool_task_t *task;
+    apr_uint32_t b, t;
+
+    b = dq->bottom;
+    if (b == apr_atomic_read32(&dq->top)) {
+        return NULL;
+    }
+    /* full barrier: the stealers must see the new bottom before we read
+     * the top */
+    apr_atomic_xchg32(&dq->bottom, --b);
+    t = apr_atomic_read32(&dq->top);
+    if ((apr_int32_t)(b - t) < 0) {
+        /* stolen meanwhile */
+        apr_atomic_set32(&dq->bottom, b + 1);
+        return NULL;
+    }
+    task = dq->tasks[b & (WS_DEQUE_SIZE - 1)];
+    if (b != t) {
+        return task;
+    }
+    /* last task, race with the stealers */
+    if (apr_atomic_cas32(&dq->top, t + 1, t) != t) {
+        task = NULL;
+    }
+    apr_atomic_set32(&dq->bottom, b + 1);
+    return task;
+}
+
+static apr_thread_pool_task_t *ws_deque_steal(ws_deque_t *dq, int *retry)
+{
+    apr_thread_pool_task_t *task;
+    apr_uint32_t b, t;
+
+    t = apr_atomic_read32(&dq->top);
+    b = apr_atomic_read32(&dq->bottom);
+    if ((apr_int32_t)(b - t) <= 0) {
+        return NULL;
+    }
+    task = dq->tasks[t & (WS_DEQUE_SIZE - 1)];
+    if (apr_atomic_cas32(&dq->top, t + 1, t) != t) {
+        *retry = 1;
+        return NULL;
+    }
+    return task;
+}
+
+/*
+ * Count the tasks queued (not cancelled) in the deques, or return 1 as soon
+ * as one is found if any is set.  This is racy unless it's a thread going
+ * to idle which checks that no task was queued behind its back.
+ */
+static apr_size_t ws_tasks_count(apr_thread_pool_t *me, int any)
+{
+    apr_size_t n = 0, i;
+    int seg;
+
+    for (i = 0; i < me->ws_nslots; ++i) {
+        for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+            ws_deque_t *dq = &me->ws_slots[i].deques[seg];
+            apr_uint32_t t = apr_atomic_read32(&dq->top);
+            apr_uint32_t b = apr_atomic_read32(&dq->bottom);
+
+            if ((apr_int32_t)(b - t) > WS_DEQUE_SIZE) {
+                t = b - WS_DEQUE_SIZE;
+            }
+            for (; (apr_int32_t)(b - t) > 0; ++t) {
+                apr_thread_pool_task_t *task;
+                task = dq->tasks[t & (WS_DEQUE_SIZE - 1)];
+                if (WS_TASK_STATE(task->state) == WS_TASK_QUEUED) {
+                    if (any) {
+                        return 1;
+                    }
+                    n++;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+static void ws_recycle_task(ws_slot_t *slot, apr_thread_pool_task_t *task)
+{
+    APR_RING_INSERT_TAIL(&slot->recycled_tasks, task,
+                         apr_thread_pool_task, link);
+    slot->recycled_cnt++;
+}
+
+/*
+ * Give the recycled tasks above keep back to the pool.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void ws_giveback_tasks(apr_thread_pool_t *me, ws_slot_t *slot,
+                              apr_size_t keep)
+{
+    while (slot->recycled_cnt > keep) {
+        apr_thread_pool_task_t *task = APR_RING_FIRST(&slot->recycled_tasks);
+        APR_RING_REMOVE(task, link);
+        APR_RING_INSERT_TAIL(me->recycled_tasks, task,
+                             apr_thread_pool_task, link);
+        slot->recycled_cnt--;
+    }
+}
+
+/*
+ * Push a task to the slot's deque, or to the shared ring if full.
+ */
+static apr_status_t ws_queue_task(apr_thread_pool_t *me, ws_slot_t *slot,
+                                  apr_thread_start_t func, void *param,
+                                  apr_byte_t priority, int push, void *owner)
+{
+    apr_thread_pool_task_t *t;
+    apr_uint32_t cnt;
+    ws_deque_t *dq;
+
+    if (APR_RING_EMPTY(&slot->recycled_tasks, apr_thread_pool_task, link)) {
+        apr_thread_mutex_lock(me->lock);
+        apr_pool_owner_set(me->pool, 0);
+        t = task_new(me, func, param, priority, owner, 0);
+        apr_thread_mutex_unlock(me->lock);
+        if (NULL == t) {
+            return APR_ENOMEM;
+        }
+    }
+    else {
+        t = APR_RING_FIRST(&slot->recycled_tasks);
+        APR_RING_REMOVE(t, link);
+        slot->recycled_cnt--;
+        task_init(t, func, param, priority, owner, 0);
+    }
+
+    apr_atomic_set32(&t->state, WS_TASK_REQUEUE(t->state));
+    dq = &slot->deques[TASK_PRIORITY_SEG(t)];
+    if (!ws_deque_push(dq, t)) {
+        /* Full, share the oldest half of the deque (and the task if still
+         * full) in one go */
+        apr_thread_mutex_lock(me->lock);
+        apr_pool_owner_set(me->pool, 0);
+        for (cnt = 0; cnt < WS_DEQUE_SIZE / 2; ++cnt) {
+            apr_thread_pool_task_t *old;
+            int retry = 0;
+            old = ws_deque_steal(dq, &retry);
+            if (!old) {
+                if (retry) {
+                    continue;
+                }
+                break;
+            }
+            if (ws_task_transit(old, WS_TASK_QUEUED, WS_TASK_SHARED)) {
+                insert_task(me, old, 1);
+            }
+            else {
+                ws_recycle_task(slot, old);
+            }
+        }
+        if (!ws_deque_push(dq, t)) {
+            t->state = WS_TASK_SET(t->state, WS_TASK_SHARED);
+            insert_task(me, t, push);
+        }
+        apr_thread_cond_signal(me->more_work);
+        apr_thread_mutex_unlock(me->lock);
+    }
+    return APR_SUCCESS;
+}
+
+/*
+ * Push tasks (one per param) from a work stealing thread, then wake up an
+ * idle thread to steal them, or create one if none.
+ */
+static apr_status_t ws_add_tasks(apr_thread_pool_t *me, ws_slot_t *slot,
+                                 apr_thread_start_t func, void **params,
+                                 apr_size_t n, apr_byte_t priority, int push,
+                                 void *owner)
+{
     apr_status_t rv = APR_SUCCESS;
+    apr_uint32_t cnt;
+    apr_size_t i;
+    ws_deque_t *dq;
+
+    if (me->terminated) {
+        return APR_NOTFOUND;
+    }
+
+    for (i = 0; i < n && APR_SUCCESS == rv; ++i) {
+        rv = ws_queue_task(me, slot, func, params[i], priority, push, owner);
+    }
+    if (0 == i) {
+        return rv;
+    }
+
+    /* This pairs with the ws_idle increment before ws_tasks_count() in
+     * ws_thread_pool_func() so that no wakeup is lost.
+     */
+    dq = &slot->deques[(priority & 0xFF) / 64];
+    cnt = dq->bottom - apr_atomic_read32(&dq->top);
+    if (apr_atomic_read32(&me->ws_idle)
+            || (0 == me->idle_cnt && me->thd_cnt < me->thd_max
+                && cnt > me->threshold)) {
+        apr_status_t rv2 = APR_SUCCESS;
+
+        apr_thread_mutex_lock(me->lock);
+        apr_pool_owner_set(me->pool, 0);
+        if (0 == me->idle_cnt && me->thd_cnt < me->thd_max
+                && cnt > me->threshold) {
+            rv2 = create_thread(me);
+        }
+        apr_thread_cond_signal(me->more_work);
+        apr_thread_mutex_unlock(me->lock);
+        if (APR_SUCCESS == rv) {
+            rv = rv2;
+        }
+    }
+    return rv;
+}
+
+/*
+ * Take a due scheduled task or a shared task to run, and a batch of the
+ * next shared tasks into the slot's deques.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static apr_thread_pool_task_t *ws_pop_shared(apr_thread_pool_t *me,
+                                             ws_slot_t *slot)
+{
+    apr_thread_pool_task_t *batch[WS_BATCH_MAX], *task;
+    apr_size_t n, i;
+
+    task = pop_task(me);
+    if (!task) {
+        return NULL;
+    }
+    task->state = WS_TASK_SET(task->state, WS_TASK_RUNNING);
+
+    /* Leave some for the other threads */
+    n = me->task_cnt / (me->thd_cnt ? me->thd_cnt : 1);
+    if (n > WS_BATCH_MAX) {
+        n = WS_BATCH_MAX;
+    }
+    for (i = 0; i < n && (batch[i] = pop_task(me)); ++i)
+        ;
+    /* Pushed backward to be popped (LIFO) in the shared order */
+    while (i-- > 0) {
+        apr_thread_pool_task_t *t = batch[i];
+        apr_atomic_set32(&t->state, WS_TASK_REQUEUE(t->state));
+        if (!ws_deque_push(&slot->deques[TASK_PRIORITY_SEG(t)], t)) {
+            t->state = WS_TASK_SET(t->state, WS_TASK_SHARED);
+            insert_task(me, t, 0);
+        }
+    }
+    return task;
+}
+
+static apr_thread_pool_task_t *ws_get_shared(apr_thread_pool_t *me,
+                                             ws_slot_t *slot,
+                                             struct apr_thread_list_elt *elt)
+{
+    apr_thread_pool_task_t *task;
+
+    if (!me->task_cnt && !me->scheduled_task_cnt) {
+        return NULL;
+    }
+
+    apr_thread_mutex_lock(me->lock);
+    apr_pool_owner_set(me->pool, 0);
+    task = ws_pop_shared(me, slot);
+    if (task) {
+        ++slot->tasks_run;
+        elt->current_owner = task->owner;
+    }
+    ws_giveback_tasks(me, slot, WS_RECYCLED_MAX);
+    apr_thread_mutex_unlock(me->lock);
+
+    return task;
+}
+
+static apr_thread_pool_task_t *ws_steal_task(apr_thread_pool_t *me,
+                                             ws_slot_t *slot)
+{
+    apr_thread_pool_task_t *task;
+    apr_size_t i, start;
+    int seg, retry;
+
+    for (seg = TASK_PRIORITY_SEGS - 1; seg >= 0; seg--) {
+        do {
+            retry = 0;
+            slot->seed = slot->seed * 1103515245 + 12345;
+            start = (slot->seed >> 16) % me->ws_nslots;
+            for (i = 0; i < me->ws_nslots; ++i) {
+                ws_slot_t *victim = &me->ws_slots[(start + i) % me->ws_nslots];
+                if (victim != slot) {
+                    task = ws_deque_steal(&victim->deques[seg], &retry);
+                    if (task) {
+                        return task;
+                    }
+                }
+            }
+        } while (retry);
+    }
+    return NULL;
+}
+
+/*
+ * Get the next task to run, from the slot's deques first, then from the
+ * shared tasks and finally from the other threads' deques.  The shared
+ * tasks are also checked every WS_SHARED_TICK tasks so that they can't be
+ * starved by the local ones.
+ */
+static apr_thread_pool_task_t *ws_next_task(apr_thread_pool_t *me,
+                                            ws_slot_t *slot,
+                                            struct apr_thread_list_elt *elt,
+                                            int *tick)
+{
+    apr_thread_pool_task_t *task;
+    int seg;
+
+    for (;;) {
+        if (++*tick >= WS_SHARED_TICK) {
+            *tick = 0;
+            task = ws_get_shared(me, slot, elt);
+            if (task) {
+                return task;
+            }
+        }
+
+        task = NULL;
+        for (seg = TASK_PRIORITY_SEGS - 1; seg >= 0 && !task; seg--) {
+            task = ws_deque_pop(&slot->deques[seg]);
+        }
+        if (!task) {
+            *tick = 0;
+            task = ws_get_shared(me, slot, elt);
+            if (task) {
+                return task;
+            }
+            task = ws_steal_task(me, slot);
+            if (!task) {
+                return NULL;
+            }
+        }
+
+        /* Set the owner before the task is marked running, for
+         * apr_thread_pool_tasks_cancel() to wait for it or cancel it.
+         */
+        elt->current_owner = task->owner;
+        if (ws_task_transit(task, WS_TASK_QUEUED, WS_TASK_RUNNING)) {
+            ++slot->tasks_run;
+            return task;
+        }
+        elt->current_owner = NULL;
+        ws_recycle_task(slot, task);
+    }
+}
+
+/*
+ * Move the tasks left in the slot's deques to the shared ring, and release
+ * the slot for another thread.
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void ws_slot_release(apr_thread_pool_t *me, ws_slot_t *slot)
+{
+    apr_thread_pool_task_t *task;
+    int seg, shared = 0;
+
+    for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+        while ((task = ws_deque_pop(&slot->deques[seg]))) {
+            if (ws_task_transit(task, WS_TASK_QUEUED, WS_TASK_SHARED)) {
+                insert_task(me, task, 1);
+                shared = 1;
+            }
+            else {
+                ws_recycle_task(slot, task);
+            }
+        }
+    }
+    ws_giveback_tasks(me, slot, 0);
+    slot->used = 0;
+#if APR_HAS_THREAD_LOCAL
+    ws_current = NULL;
+#endif
+    if (shared) {
+        apr_thread_cond_signal(me->more_work);
+    }
+}
+
+/*
+ * The worker thread function in work stealing mode, same as
+ * thread_pool_func() but running the tasks from ws_next_task() without
+ * holding the lock.
+ */
+static void *APR_THREAD_FUNC ws_thread_pool_func(apr_thread_t *t,
+                                                 void *param)
+{
+    apr_thread_pool_t *me = param;
+    apr_thread_pool_task_t *task = NULL;
+    apr_interval_time_t wait;
+    struct apr_thread_list_elt *elt;
+    ws_slot_t *slot;
+    apr_size_t i;
+    int tick = 0;
+
+    apr_thread_mutex_lock(me->lock);
+    apr_pool_owner_set(me->pool, 0);
+
+    elt = elt_new(me, t);
+    if (!elt) {
+        apr_thread_mutex_unlock(me->lock);
+        apr_thread_exit(t, APR_ENOMEM);
+    }
+
+    /* thd_cnt <= ws_nslots, so there is one */
+    for (i = 0; i < me->ws_nslots && me->ws_slots[i].used; ++i)
+        ;
+    assert(i < me->ws_nslots);
+    slot = &me->ws_slots[i];
+    slot->used = 1;
+#if APR_HAS_THREAD_LOCAL
+    ws_current = slot;
+#endif
+
+    for (;;) {
+        /* Test if not new element, it is awakened from idle */
+        if (APR_RING_NEXT(elt, link) != elt) {
+            --me->idle_cnt;
+            APR_RING_REMOVE(elt, link);
+        }
+
+        if (elt->state != TH_STOP) {
+            ++me->busy_cnt;
+            APR_RING_INSERT_TAIL(me->busy_thds, elt,
+                                 apr_thread_list_elt, link);
+            apr_thread_mutex_unlock(me->lock);
+
+            while (elt->state != TH_STOP
+                   && (task = ws_next_task(me, slot, elt, &tick))) {
+                /* Run the task (or drop it if terminated already) */
+                if (!me->terminated) {
+                    apr_thread_data_set(task, "apr_thread_pool_task", NULL, t);
+                    task->func(t, task->param);
+                }
+
+                elt->current_owner = NULL;
+                ws_recycle_task(slot, task);
+                if (elt->signal_work_done) {
+                    apr_thread_mutex_lock(me->lock);
+                    apr_pool_owner_set(me->pool, 0);
+                    elt->signal_work_done = 0;
+                    apr_thread_cond_signal(me->work_done);
+                    apr_thread_mutex_unlock(me->lock);
+                }
+            }
+
+            apr_thread_mutex_lock(me->lock);
+            apr_pool_owner_set(me->pool, 0);
+            APR_RING_REMOVE(elt, link);
+            --me->busy_cnt;
+        }
+        assert(NULL == elt->current_owner);
+
+        /* thread should die? */
+        if (me->terminated
+                || elt->state != TH_RUN
+                || (me->idle_cnt >= me->idle_max
+                    && (me->idle_max || !me->scheduled_task_cnt)
+                    && !me->idle_wait)) {
+            if ((TH_PROBATION == elt->state) && me->idle_wait)
+                ++me->thd_timed_out;
+            break;
+        }
+
+        /* busy thread become idle */
+        ++me->idle_cnt;
+        APR_RING_INSERT_TAIL(me->idle_thds, elt, apr_thread_list_elt, link);
+        ws_giveback_tasks(me, slot, WS_RECYCLED_MAX);
+
+        /* Tasks queued since we last looked? */
+        apr_atomic_inc32(&me->ws_idle);
+        if (me->task_cnt || ws_tasks_count(me, 1)) {
+            apr_atomic_dec32(&me->ws_idle);
+            continue;
+        }
+
+        if (me->scheduled_task_cnt)
+            wait = waiting_time(me);
+        else if (me->idle_cnt > me->idle_max) {
+            wait = me->idle_wait;
+            elt->state = TH_PROBATION;
+        }
+        else
+            wait = -1;
+
+        if (wait >= 0) {
+            apr_thread_cond_timedwait(me->more_work, me->lock, wait);
+        }
+        else {
+            apr_thread_cond_wait(me->more_work, me->lock);
+        }
+        apr_pool_owner_set(me->pool, 0);
+        apr_atomic_dec32(&me->ws_idle);
+    }
+
+    ws_slot_release(me, slot);
+
+    /* Dead thread, to be joined */
+    APR_RING_INSERT_TAIL(me->dead_thds, elt, apr_thread_list_elt, link);
+    if (--me->thd_cnt == 0 && me->terminated) {
+        apr_thread_cond_signal(me->all_done);
+    }
+    apr_thread_mutex_unlock(me->lock);
+
+    apr_thread_exit(t, APR_SUCCESS);
+    return NULL;                /* should not be here, safe net */
+}
+
+/*
+ * Cancel the tasks of the owner queued in the deques, those which are
+ * popped or stolen meanwhile are either cancelled or running (waited for).
+ * NOTE: This function is not thread safe by itself. Caller should hold the lock
+ */
+static void ws_cancel_tasks(apr_thread_pool_t *me, void *owner)
+{
+    apr_size_t i;
+    int seg;
+
+    for (i = 0; i < me->ws_nslots; ++i) {
+        for (seg = 0; seg < TASK_PRIORITY_SEGS; seg++) {
+            ws_deque_t *dq = &me->ws_slots[i].deques[seg];
+            apr_uint32_t t = apr_atomic_read32(&dq->top);
+            apr_uint32_t b = apr_atomic_read32(&dq->bottom);
+
+            if ((apr_int32_t)(b - t) > WS_DEQUE_SIZE) {
+                t = b - WS_DEQUE_SIZE;
+            }
+            for (; (apr_int32_t)(b - t) > 0; ++t) {
+                apr_thread_pool_task_t *task;
+                apr_uint32_t s;
+                task = dq->tasks[t & (WS_DEQUE_SIZE - 1)];
+                /* The slot may be stale, with the task recycled and queued
+                 * again for another owner since, so the owner is read after
+                 * the state and the cancellation applies to that generation
+                 * only (the owner is set before the task is queued).
+                 */
+                s = apr_atomic_read32(&task->state);
+                if (WS_TASK_STATE(s) == WS_TASK_QUEUED
+                        && (!owner || task->owner == owner)) {
+                    apr_atomic_cas32(&task->state,
+                                     WS_TASK_SET(s, WS_TASK_CANCELLED), s);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Add a task per param, with a single lock acquisition and wakeup pass.
+ */
+static apr_status_t add_tasks(apr_thread_pool_t *me, apr_thread_start_t func,
+                              void **params, apr_size_t n,
+                              apr_byte_t priority, int push, void *owner)
+{
+    apr_thread_pool_task_t *t;
+    apr_status_t rv = APR_SUCCESS;
+    apr_size_t i, created, woken;
+
+#if APR_HAS_THREAD_LOCAL
+    /* Tasks pushed by a task go to the deque of its thread */
+    if (ws_current && ws_current->tp == me) {
+        return ws_add_tasks(me, ws_current, func, params, n, priority, push,
+                            owner);
+    }
+#endif
 
     apr_thread_mutex_lock(me->lock);
     apr_pool_owner_set(me->pool, 0);
@@ -625,50 +1384,54 @@ static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
     /* Maintain dead threads */
     join_dead_threads(me);
 
-    t = task_new(me, func, param, priority, owner, 0);
-    if (NULL == t) {
+    for (i = 0; i < n; ++i) {
+        t = task_new(me, func, params[i], priority, owner, 0);
+        if (NULL == t) {
+            rv = APR_ENOMEM;
+            break;
+        }
+        insert_task(me, t, push);
+    }
+    if (0 == i) {
         apr_thread_mutex_unlock(me->lock);
-        return APR_ENOMEM;
+        return rv;
     }
 
-    t_loc = add_if_empty(me, t);
-    if (NULL == t_loc) {
-        goto FINAL_EXIT;
-    }
+    /* As many new threads and wakeups as tasks, at most */
+    for (created = 0; created < i; ++created) {
+        apr_status_t rv2;
 
-    if (push) {
-        while (APR_RING_SENTINEL(me->tasks, apr_thread_pool_task, link) !=
-               t_loc && t_loc->dispatch.priority >= t->dispatch.priority) {
-            t_loc = APR_RING_NEXT(t_loc, link);
-        }
-    }
-    APR_RING_INSERT_BEFORE(t_loc, t, link);
-    if (!push) {
-        if (t_loc == me->task_idx[TASK_PRIORITY_SEG(t)]) {
-            me->task_idx[TASK_PRIORITY_SEG(t)] = t;
+        if (!(0 == me->thd_cnt
+              || (0 == me->idle_cnt && me->thd_cnt < me->thd_max
+                  && me->task_cnt > me->threshold))) {
+            break;
         }
-    }
-
-  FINAL_EXIT:
-    me->task_cnt++;
-    if (me->task_cnt > me->tasks_high)
-        me->tasks_high = me->task_cnt;
-    if (0 == me->thd_cnt || (0 == me->idle_cnt && me->thd_cnt < me->thd_max &&
-                             me->task_cnt > me->threshold)) {
-        rv = apr_thread_create(&thd, NULL, thread_pool_func, me, me->pool);
-        if (APR_SUCCESS == rv) {
-            ++me->thd_cnt;
-            if (me->thd_cnt > me->thd_high)
-                me->thd_high = me->thd_cnt;
+        rv2 = create_thread(me);
+        if (APR_SUCCESS != rv2) {
+            if (APR_SUCCESS == rv) {
+                rv = rv2;
+            }
+            break;
         }
     }
 
+    /* No broadcast, which would make the idle threads on probation exit */
     apr_thread_cond_signal(me->more_work);
+    for (woken = 1; woken < i && woken < me->idle_cnt; ++woken) {
+        apr_thread_cond_signal(me->more_work);
+    }
     apr_thread_mutex_unlock(me->lock);
 
     return rv;
 }
 
+static apr_status_t add_task(apr_thread_pool_t *me, apr_thread_start_t func,
+                             void *param, apr_byte_t priority, int push,
+                             void *owner)
+{
+    return add_tasks(me, func, &param, 1, priority, push, owner);
+}
+
 APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
                                                apr_thread_start_t func,
                                                void *param,
@@ -678,6 +1441,16 @@ APR_DECLARE(apr_status_t) apr_thread_pool_push(apr_thread_pool_t *me,
     return add_task(me, func, param, priority, 1, owner);
 }
 
+APR_DECLARE(apr_status_t) apr_thread_pool_push_batch(apr_thread_pool_t *me,
+                                                     apr_thread_start_t func,
+                                                     void **params,
+                                                     apr_size_t nelts,
+                                                     apr_byte_t priority,
+                                                     void *owner)
+{
+    return add_tasks(me, func, params, nelts, priority, 1, owner);
+}
+
 APR_DECLARE(apr_status_t) apr_thread_pool_schedule(apr_thread_pool_t *me,
                                                    apr_thread_start_t func,
                                                    void *param,
@@ -772,7 +1545,15 @@ static void wait_on_busy_threads(apr_thread_pool_t *me, void *owner)
 #endif
 
         elt->signal_work_done = 1;
-        apr_thread_cond_wait(me->work_done, me->lock);
+        if (me->ws_slots) {
+            /* work stealing threads don't hold the lock when they reset
+             * current_owner, so the signal may be missed */
+            apr_thread_cond_timedwait(me->work_done, me->lock,
+                                      WS_CANCEL_WAIT);
+        }
+        else {
+            apr_thread_cond_wait(me->work_done, me->lock);
+        }
         apr_pool_owner_set(me->pool, 0);
 
         /* Restart */
@@ -797,6 +1578,9 @@ APR_DECLARE(apr_status_t) apr_thread_pool_tasks_cancel(apr_thread_pool_t *me,
     if (me->scheduled_task_cnt > 0) {
         rv = remove_scheduled_tasks(me, owner);
     }
+    if (me->ws_slots) {
+        ws_cancel_tasks(me, owner);
+    }
 
     wait_on_busy_threads(me, owner);
 
@@ -807,6 +1591,9 @@ APR_DECLARE(apr_status_t) apr_thread_pool_tasks_cancel(apr_thread_pool_t *me,
 
 APR_DECLARE(apr_size_t) apr_thread_pool_tasks_count(apr_thread_pool_t *me)
 {
+    if (me->ws_slots) {
+        return me->task_cnt + ws_tasks_count(me, 0);
+    }
     return me->task_cnt;
 }
 
@@ -834,7 +1621,12 @@ APR_DECLARE(apr_size_t) apr_thread_pool_idle_count(apr_thread_pool_t *me)
 APR_DECLARE(apr_size_t)
     apr_thread_pool_tasks_run_count(apr_thread_pool_t * me)
 {
-    return me->tasks_run;
+    apr_size_t n = me->tasks_run, i;
+
+    for (i = 0; i < me->ws_nslots; ++i) {
+        n += me->ws_slots[i].tasks_run;
+    }
+    return n;
 }
 
 APR_DECLARE(apr_size_t)